@@ -31,7 +31,7 @@
 static int parse_dst_action_selector(int *argc, char ***argv, nikss_context_t *nikss_ctx,
                                      nikss_action_selector_context_t *ctx, bool is_last, const char **instance_name)
 {
-    int error_code = nikss_action_selector_ctx_name(nikss_ctx, ctx, **argv);
+    int error_code = open_action_selector_ctx(nikss_ctx, ctx, **argv);
     if (error_code != NO_ERROR) {
         return error_code;
     }
@@ -277,27 +277,6 @@ json_t *create_json_member_entry(nikss_action_selector_context_t *ctx, nikss_act
     return member_root;
 }
 
-json_t *create_json_all_members(nikss_action_selector_context_t *ctx)
-{
-    json_t *members_root = json_object();
-    if (members_root == NULL) {
-        return NULL;
-    }
-
-    nikss_action_selector_member_context_t *member = NULL;
-    while ((member = nikss_action_selector_get_next_member(ctx)) != NULL) {
-        json_t *member_json = create_json_member_entry(ctx, member);
-        nikss_action_selector_member_free(member);
-        if (member_json == NULL) {
-            json_decref(members_root);
-            return NULL;
-        }
-        set_json_object_at_index(members_root, member_json, nikss_action_selector_get_member_reference(member));
-    }
-
-    return members_root;
-}
-
 json_t *create_json_group_entry(nikss_action_selector_context_t *ctx, nikss_action_selector_group_context_t *group, json_t *member_refs)
 {
     json_t *group_root = json_object();
@@ -324,27 +303,6 @@ json_t *create_json_group_entry(nikss_action_selector_context_t *ctx, nikss_acti
     return group_root;
 }
 
-json_t *create_json_all_groups(nikss_action_selector_context_t *ctx)
-{
-    json_t *groups_root = json_object();
-    if (groups_root == NULL) {
-        return NULL;
-    }
-
-    nikss_action_selector_group_context_t *group = NULL;
-    while ((group = nikss_action_selector_get_next_group(ctx)) != NULL) {
-        json_t *group_entry = create_json_group_entry(ctx, group, NULL);
-        nikss_action_selector_group_free(group);
-        if (group_entry == NULL) {
-            json_decref(groups_root);
-            return NULL;
-        }
-        set_json_object_at_index(groups_root, group_entry, nikss_action_selector_get_group_reference(group));
-    }
-
-    return groups_root;
-}
-
 json_t *create_json_empty_group_action(nikss_action_selector_context_t *ctx)
 {
     nikss_action_selector_member_context_t ega;
@@ -363,8 +321,85 @@ json_t *create_json_empty_group_action(nikss_action_selector_context_t *ctx)
     return ega_root;
 }
 
+/* Members and groups are printed as soon as they are read, so whole selector never is kept in memory */
+static int print_all_action_selector_entries(nikss_action_selector_context_t *ctx, const char *instance_name,
+                                             FILE *out)
+{
+    int ret = NO_ERROR;
+    json_stream_t stream;
+    char idx_str[16];
+
+    json_stream_init(&stream, out, ndjson_output);
+    json_stream_open_object(&stream, NULL);
+    json_stream_open_object(&stream, instance_name);
+
+    json_stream_open_object(&stream, "member_refs");
+    nikss_action_selector_member_context_t *member = NULL;
+    while ((member = nikss_action_selector_get_next_member(ctx)) != NULL) {
+        json_t *member_json = create_json_member_entry(ctx, member);
+        snprintf(idx_str, sizeof(idx_str), "%u", nikss_action_selector_get_member_reference(member));
+        nikss_action_selector_member_free(member);
+        if (member_json == NULL) {
+            ret = ENOMEM;
+            goto clean_up;
+        }
+        json_stream_add(&stream, idx_str, member_json);
+    }
+    json_stream_close(&stream);
+
+    if (nikss_action_selector_has_group_capability(ctx)) {
+        json_stream_open_object(&stream, "group_refs");
+        nikss_action_selector_group_context_t *group = NULL;
+        while ((group = nikss_action_selector_get_next_group(ctx)) != NULL) {
+            json_t *group_entry = create_json_group_entry(ctx, group, NULL);
+            snprintf(idx_str, sizeof(idx_str), "%u", nikss_action_selector_get_group_reference(group));
+            nikss_action_selector_group_free(group);
+            if (group_entry == NULL) {
+                ret = ENOMEM;
+                goto clean_up;
+            }
+            json_stream_add(&stream, idx_str, group_entry);
+        }
+        json_stream_close(&stream);
+
+        json_t *empty_group_action = create_json_empty_group_action(ctx);
+        if (empty_group_action == NULL) {
+            ret = ENOMEM;
+            goto clean_up;
+        }
+        json_stream_add(&stream, "empty_group_action", empty_group_action);
+    }
+
+clean_up:
+    json_stream_finish(&stream, ret);
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to create JSON\n");
+    }
+
+    return ret;
+}
+
+int dump_action_selector(nikss_context_t *nikss_ctx, const char *instance_name, FILE *out)
+{
+    nikss_action_selector_context_t ctx;
+    nikss_action_selector_ctx_init(&ctx);
+
+    int ret = nikss_action_selector_ctx_name(nikss_ctx, &ctx, instance_name);
+    if (ret == NO_ERROR) {
+        ret = print_all_action_selector_entries(&ctx, instance_name, out);
+    }
+
+    nikss_action_selector_ctx_free(&ctx);
+
+    return ret;
+}
+
 int print_action_selector(nikss_action_selector_context_t *ctx, const char *instance_name, get_mode_t mode, uint32_t reference)
 {
+    if (mode == GET_MODE_ALL) {
+        return print_all_action_selector_entries(ctx, instance_name, stdout);
+    }
+
     int ret = EINVAL;
     json_t *root = json_object();
     json_t *instance = json_object();
@@ -374,20 +409,7 @@ int print_action_selector(nikss_action_selector_context_t *ctx, const char *inst
     json_t *new_entry = NULL;
 
     bool failed = false;
-    if (mode == GET_MODE_ALL) {
-        members = create_json_all_members(ctx);
-        if (members == NULL) {
-            failed = true;
-        }
-
-        if (nikss_action_selector_has_group_capability(ctx)) {
-            groups = create_json_all_groups(ctx);
-            empty_group_action = create_json_empty_group_action(ctx);
-            if (groups == NULL || empty_group_action == NULL) {
-                failed = true;
-            }
-        }
-    } else if (mode == GET_MODE_MEMBER) {
+    if (mode == GET_MODE_MEMBER) {
         members = json_object();
         nikss_action_selector_member_context_t member;
         nikss_action_selector_member_init(&member);
@@ -911,6 +933,72 @@ clean_up:
     return error_code;
 }
 
+int do_action_selector_set_group(int argc, char **argv)
+{
+    int error_code = EPERM;
+    nikss_context_t nikss_ctx;
+    nikss_action_selector_context_t ctx;
+    nikss_action_selector_group_context_t group;
+    uint32_t *member_refs = NULL;
+    size_t n_members = 0;
+
+    nikss_context_init(&nikss_ctx);
+    nikss_action_selector_ctx_init(&ctx);
+    nikss_action_selector_group_init(&group);
+
+    /* 0. Get the pipeline id */
+    if (parse_pipeline_id(&argc, &argv, &nikss_ctx) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    if (argc < 1) {
+        fprintf(stderr, "too few parameters\n");
+        goto clean_up;
+    }
+
+    /* 1. Get Action Selector */
+    if (parse_dst_action_selector(&argc, &argv, &nikss_ctx, &ctx, false, NULL) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    /* 2. Get group reference */
+    if (parse_group_reference(&argc, &argv, &group) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    /* 3. Get all the member references, none makes group empty */
+    if (argc < 1 || !is_keyword(*argv, "members")) {
+        fprintf(stderr, "expected keyword 'members'\n");
+        goto clean_up;
+    }
+    NEXT_ARG();
+    member_refs = calloc((size_t) argc + 1, sizeof(uint32_t));
+    if (member_refs == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        error_code = ENOMEM;
+        goto clean_up;
+    }
+    while (argc > 0) {
+        char *ptr = NULL;
+        member_refs[n_members++] = strtoul(*argv, &ptr, 0);
+        if (*ptr) {
+            fprintf(stderr, "%s: unable to parse as a member reference\n", *argv);
+            goto clean_up;
+        }
+        NEXT_ARG();
+    }
+
+    error_code = nikss_action_selector_set_group_members(&ctx, &group, member_refs, n_members);
+
+clean_up:
+    free(member_refs);
+    nikss_action_selector_group_free(&group);
+    nikss_action_selector_ctx_free(&ctx);
+    nikss_context_free(&nikss_ctx);
+
+    return error_code;
+}
+
 int do_action_selector_help(int argc, char **argv)
 {
     (void) argc; (void) argv;
@@ -925,6 +1013,7 @@ int do_action_selector_help(int argc, char **argv)
             ""
             "       %1$s action-selector add-to-group pipe ID ACTION_SELECTOR_NAME MEMBER_REF to GROUP_REF\n"
             "       %1$s action-selector delete-from-group pipe ID ACTION_SELECTOR_NAME MEMBER_REF from GROUP_REF\n"
+            "       %1$s action-selector set-group pipe ID ACTION_SELECTOR_NAME GROUP_REF members [MEMBER_REF...]\n"
             ""
             "       %1$s action-selector empty-group-action pipe ID ACTION_SELECTOR_NAME action ACTION [data ACTION_PARAMS]\n"
             ""
@@ -20,6 +20,9 @@
 
 #include "common.h"
 
+/* Prints all members and groups like `action-selector get` does */
+int dump_action_selector(nikss_context_t *nikss_ctx, const char *instance_name, FILE *out);
+
 int do_action_selector_add_member(int argc, char **argv);
 int do_action_selector_delete_member(int argc, char **argv);
 int do_action_selector_update_member(int argc, char **argv);
@@ -27,6 +30,7 @@ int do_action_selector_create_group(int argc, char **argv);
 int do_action_selector_delete_group(int argc, char **argv);
 int do_action_selector_add_to_group(int argc, char **argv);
 int do_action_selector_delete_from_group(int argc, char **argv);
+int do_action_selector_set_group(int argc, char **argv);
 int do_action_selector_empty_group_action(int argc, char **argv);
 int do_action_selector_get(int argc, char **argv);
 
@@ -42,6 +46,7 @@ static const struct cmd action_selector_cmds[] = {
         {"delete-group",         do_action_selector_delete_group},
         {"add-to-group",         do_action_selector_add_to_group},
         {"delete-from-group",    do_action_selector_delete_from_group},
+        {"set-group",            do_action_selector_set_group},
         {"empty-group-action",   do_action_selector_empty_group_action},
         {"get",                  do_action_selector_get},
         {0}
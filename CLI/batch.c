@@ -0,0 +1,357 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <nikss/nikss.h>
+#include <nikss/nikss_pipeline.h>
+
+#include "batch.h"
+#include "serve.h"
+#include "table.h"
+
+#define BATCH_MAX_ARGS 256
+/* Maximum number of table operations committed at once */
+#define BATCH_MAX_GROUP_SIZE 4096
+
+/* Consecutive operations of the same type on the same table, committed with one library call */
+typedef struct table_op_group {
+    nikss_context_t nikss_ctx;
+    nikss_table_entry_ctx_t ctx;
+    nikss_table_entry_batch_t batch;
+    bool opened;
+    nikss_pipeline_id_t pipeline_id;
+    char *table_name;
+    enum table_write_type_t write_type;
+    size_t *lines;
+} table_op_group_t;
+
+typedef struct batch_stats {
+    size_t n_ops;
+    size_t n_failed;
+    int first_error;
+} batch_stats_t;
+
+static void print_line_status(batch_stats_t *stats, size_t line_no, int ret)
+{
+    stats->n_ops += 1;
+    if (ret == NO_ERROR) {
+        fprintf(stdout, "%zu: ok\n", line_no);
+        return;
+    }
+
+    stats->n_failed += 1;
+    if (stats->first_error == NO_ERROR) {
+        stats->first_error = ret;
+    }
+    fprintf(stdout, "%zu: error %d (%s)\n", line_no, ret, strerror(ret));
+}
+
+static void table_op_group_init(table_op_group_t *group)
+{
+    memset(group, 0, sizeof(table_op_group_t));
+    nikss_context_init(&group->nikss_ctx);
+    nikss_table_entry_ctx_init(&group->ctx);
+    nikss_table_entry_batch_init(&group->batch);
+}
+
+/* Contexts are initialized again, so closing the group twice is safe */
+static void table_op_group_close(table_op_group_t *group)
+{
+    nikss_table_entry_ctx_free(&group->ctx);
+    nikss_context_free(&group->nikss_ctx);
+    nikss_context_init(&group->nikss_ctx);
+    nikss_table_entry_ctx_init(&group->ctx);
+    if (group->table_name != NULL) {
+        free(group->table_name);
+    }
+    group->table_name = NULL;
+    group->opened = false;
+}
+
+static void table_op_group_free(table_op_group_t *group)
+{
+    table_op_group_close(group);
+    nikss_table_entry_batch_free(&group->batch);
+    if (group->lines != NULL) {
+        free(group->lines);
+    }
+    group->lines = NULL;
+}
+
+static void table_op_group_flush(table_op_group_t *group, batch_stats_t *stats)
+{
+    size_t n_entries = nikss_table_entry_batch_get_size(&group->batch);
+    if (n_entries == 0) {
+        return;
+    }
+
+    if (group->write_type == TABLE_ADD_NEW_ENTRY) {
+        nikss_table_entry_batch_add(&group->ctx, &group->batch);
+    } else if (group->write_type == TABLE_UPDATE_EXISTING_ENTRY) {
+        nikss_table_entry_batch_update(&group->ctx, &group->batch);
+    } else {
+        nikss_table_entry_batch_del(&group->ctx, &group->batch);
+    }
+
+    for (size_t i = 0; i < n_entries; i++) {
+        print_line_status(stats, group->lines[i], nikss_table_entry_batch_get_result(&group->batch, i));
+    }
+
+    /* Batch can't be emptied, so replace it with a new one */
+    nikss_table_entry_batch_free(&group->batch);
+    nikss_table_entry_batch_init(&group->batch);
+}
+
+/* Opens table for the group, context of the previous group is reused when it is the same table */
+static int table_op_group_open(table_op_group_t *group, nikss_pipeline_id_t pipeline_id, const char *table_name)
+{
+    if (group->opened && group->pipeline_id == pipeline_id && strcmp(group->table_name, table_name) == 0) {
+        return NO_ERROR;
+    }
+
+    table_op_group_close(group);
+
+    nikss_context_set_pipeline(&group->nikss_ctx, pipeline_id);
+    if (!nikss_pipeline_exists(&group->nikss_ctx)) {
+        fprintf(stderr, "pipeline with given id %u does not exist or is inaccessible\n", pipeline_id);
+        return ENOENT;
+    }
+    int ret = nikss_table_entry_ctx_tblname(&group->nikss_ctx, &group->ctx, table_name);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+    nikss_table_entry_ctx_thread_safe(&group->ctx, true);
+
+    group->table_name = strdup(table_name);
+    if (group->table_name == NULL) {
+        return ENOMEM;
+    }
+    group->pipeline_id = pipeline_id;
+    group->opened = true;
+
+    return NO_ERROR;
+}
+
+/* Matches "table { add | update | delete } pipe ID TABLE ..." */
+static bool is_table_write(int argc, char **argv, enum table_write_type_t *write_type)
+{
+    if (argc < 5 || !is_keyword(argv[0], "table") || !is_keyword(argv[2], "pipe")) {
+        return false;
+    }
+    if (is_keyword(argv[1], "add")) {
+        *write_type = TABLE_ADD_NEW_ENTRY;
+    } else if (is_keyword(argv[1], "update")) {
+        *write_type = TABLE_UPDATE_EXISTING_ENTRY;
+    } else if (is_keyword(argv[1], "delete")) {
+        *write_type = TABLE_DELETE_ENTRY;
+    } else {
+        return false;
+    }
+
+    char *endptr = NULL;
+    strtoul(argv[3], &endptr, 0);
+    return *endptr == '\0';
+}
+
+/* Parses table write and appends it to the group, the group is committed first
+ * when the operation can't be merged into it. */
+static int append_table_write(table_op_group_t *group, batch_stats_t *stats, int argc, char **argv,
+                              enum table_write_type_t write_type, size_t line_no)
+{
+    nikss_pipeline_id_t pipeline_id = strtoul(argv[3], NULL, 0);
+    const char *table_name = argv[4];
+    size_t n_entries = nikss_table_entry_batch_get_size(&group->batch);
+
+    bool same_table = group->opened && group->pipeline_id == pipeline_id &&
+                      strcmp(group->table_name, table_name) == 0;
+    if (n_entries > 0 && (!same_table || group->write_type != write_type || n_entries >= BATCH_MAX_GROUP_SIZE)) {
+        table_op_group_flush(group, stats);
+        n_entries = 0;
+    }
+
+    int ret = table_op_group_open(group, pipeline_id, table_name);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+    group->write_type = write_type;
+
+    if (group->lines == NULL) {
+        group->lines = malloc(BATCH_MAX_GROUP_SIZE * sizeof(size_t));
+        if (group->lines == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    nikss_table_entry_t entry;
+    nikss_table_entry_init(&entry);
+    argc -= 5;
+    argv += 5;
+    ret = parse_table_entry(&argc, &argv, &group->ctx, &entry, write_type);
+    if (ret == NO_ERROR) {
+        ret = nikss_table_entry_batch_append(&group->batch, &entry);
+    }
+    if (ret == NO_ERROR) {
+        group->lines[n_entries] = line_no;
+    }
+    nikss_table_entry_free(&entry);
+
+    return ret;
+}
+
+static double elapsed_seconds(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - start->tv_sec) + (double) (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int run_batch(FILE *in)
+{
+    table_op_group_t group;
+    batch_stats_t stats = { .n_ops = 0, .n_failed = 0, .first_error = NO_ERROR };
+    char *argv[BATCH_MAX_ARGS + 1];
+    char *line = NULL;
+    size_t line_size = 0;
+    size_t line_no = 0;
+    struct timespec start;
+
+    table_op_group_init(&group);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    /* Parsed BTF is the most expensive part of opening objects, so keep it between commands */
+    bool btf_cache_was_enabled = nikss_btf_cache_is_enabled();
+    nikss_btf_cache_enable(true);
+    bool was_non_interactive = non_interactive;
+    non_interactive = true;
+
+    while (getline(&line, &line_size, in) >= 0) {
+        line_no++;
+
+        char *first = line + strspn(line, " \t\r\n");
+        if (*first == '\0' || *first == '#') {
+            continue;
+        }
+
+        int argc = split_command_line(line, argv, BATCH_MAX_ARGS);
+        if (argc <= 0) {
+            print_line_status(&stats, line_no, EINVAL);
+            continue;
+        }
+        argv[argc] = NULL;
+
+        enum table_write_type_t write_type;
+        if (is_table_write(argc, argv, &write_type)) {
+            int ret = append_table_write(&group, &stats, argc, argv, write_type, line_no);
+            if (ret != NO_ERROR) {
+                /* Status of earlier commands is printed first */
+                table_op_group_flush(&group, &stats);
+                print_line_status(&stats, line_no, ret);
+            }
+            continue;
+        }
+
+        /* Other commands are executed one by one, preserving order of operations; they might
+         * load, replace or unload the pipeline, so the table is opened again after them */
+        table_op_group_flush(&group, &stats);
+        table_op_group_close(&group);
+        int ret;
+        if (is_keyword(argv[0], "batch") || is_keyword(argv[0], "serve")) {
+            fprintf(stderr, "%s: command not allowed in batch\n", argv[0]);
+            ret = EINVAL;
+        } else {
+            ret = run_nikssctl_command(argc, argv);
+        }
+        print_line_status(&stats, line_no, ret < 0 ? EINVAL : ret);
+    }
+    table_op_group_flush(&group, &stats);
+
+    double elapsed = elapsed_seconds(&start);
+    fprintf(stderr, "%zu operations, %zu failed, %.3f s, %.0f operations/s\n",
+            stats.n_ops, stats.n_failed, elapsed, elapsed > 0 ? (double) stats.n_ops / elapsed : 0.0);
+
+    /* Cache of the caller (e.g. serve) is kept */
+    if (!btf_cache_was_enabled) {
+        nikss_btf_cache_enable(false);
+    }
+    non_interactive = was_non_interactive;
+    table_op_group_free(&group);
+    if (line != NULL) {
+        free(line);
+    }
+
+    return stats.first_error;
+}
+
+int do_batch(int argc, char **argv)
+{
+    const char *file_name = NULL;
+
+    if (argc > 0 && is_keyword(*argv, "help")) {
+        return do_batch_help(argc, argv);
+    }
+    if (argc > 0 && (is_keyword(*argv, "file") || is_keyword(*argv, "-f"))) {
+        NEXT_ARG_RET();
+        file_name = *argv;
+        NEXT_ARG();
+    }
+    if (argc > 0) {
+        fprintf(stderr, "%s: unused argument\n", *argv);
+        return EINVAL;
+    }
+
+    FILE *in = stdin;
+    if (file_name != NULL && strcmp(file_name, "-") != 0) {
+        in = fopen(file_name, "r");
+        if (in == NULL) {
+            int ret = errno;
+            fprintf(stderr, "%s: %s\n", file_name, strerror(ret));
+            return ret;
+        }
+    }
+
+    int ret = run_batch(in);
+
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    return ret;
+}
+
+int do_batch_help(int argc, char **argv)
+{
+    (void) argc; (void) argv;
+
+    fprintf(stderr,
+            "Usage: %1$s batch [{ file | -f } PATH]\n"
+            "\n"
+            "Executes commands read from file (default: standard input), one command per line,\n"
+            "with arguments the same as for %1$s. Empty lines and lines starting with '#'\n"
+            "are ignored. Consecutive \"table add\", \"table update\" and \"table delete\"\n"
+            "commands on the same table are committed together.\n"
+            "Status of every command is printed as \"LINE: ok\" or \"LINE: error CODE (REASON)\",\n"
+            "the summary is printed at the end.\n"
+            "",
+            program_name);
+
+    return 0;
+}
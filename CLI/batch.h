@@ -0,0 +1,26 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __NIKSSCTL_BATCH_H
+#define __NIKSSCTL_BATCH_H
+
+#include "common.h"
+
+int do_batch(int argc, char **argv);
+int do_batch_help(int argc, char **argv);
+
+#endif  /* __NIKSSCTL_BATCH_H */
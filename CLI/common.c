@@ -41,6 +41,55 @@ bool is_keyword(const char *word, const char *str)
     return !memcmp(str, word, strlen(str));
 }
 
+int split_command_line(char *line, char **argv, int max_args)
+{
+    int argc = 0;
+    char *src = line;
+
+    while (*src != '\0') {
+        while (*src == ' ' || *src == '\t' || *src == '\r' || *src == '\n') {
+            src++;
+        }
+        if (*src == '\0') {
+            break;
+        }
+        if (argc >= max_args) {
+            fprintf(stderr, "too many arguments\n");
+            return -1;
+        }
+
+        char *dst = src;
+        argv[argc++] = dst;
+        char quote = '\0';
+        while (*src != '\0') {
+            if (quote != '\0') {
+                if (*src == quote) {
+                    quote = '\0';
+                    src++;
+                    continue;
+                }
+            } else if (*src == '\'' || *src == '"') {
+                quote = *src++;
+                continue;
+            } else if (*src == ' ' || *src == '\t' || *src == '\r' || *src == '\n') {
+                src++;
+                break;
+            }
+            *dst++ = *src++;
+        }
+        if (quote != '\0') {
+            fprintf(stderr, "unterminated quote\n");
+            return -1;
+        }
+        /* src is ahead of dst or points to the end of string, so terminating argument is safe */
+        if (dst < src) {
+            *dst = '\0';
+        }
+    }
+
+    return argc;
+}
+
 int parse_pipeline_id(int *argc, char ***argv, nikss_context_t * nikss_ctx)
 {
     if (*argc < 2) {
@@ -107,6 +156,16 @@ int parse_keyword_value_pairs(int *argc, char ***argv, parser_keyword_value_pair
     return NO_ERROR;
 }
 
+int check_sample_count(unsigned long interval_ms, unsigned long count)
+{
+    if (non_interactive && interval_ms != 0 && count == 0) {
+        fprintf(stderr, "interval without count is not allowed in serve and batch mode\n");
+        return EINVAL;
+    }
+
+    return NO_ERROR;
+}
+
 /******************************************************************************
  * JSON related functions
  *****************************************************************************/
@@ -165,10 +224,421 @@ int build_struct_json(void *json_parent, void *ctx, void *entry, get_next_field_
     return NO_ERROR;
 }
 
+/******************************************************************************
+ * Streaming JSON output
+ *****************************************************************************/
+
+void json_stream_init(json_stream_t *stream, FILE *out, bool ndjson)
+{
+    memset(stream, 0, sizeof(json_stream_t));
+    stream->out = out;
+    stream->ndjson = ndjson;
+}
+
+static void json_stream_indent(json_stream_t *stream, int depth)
+{
+    fputc('\n', stream->out);
+    for (int i = 0; i < depth; i++) {
+        fputs("    ", stream->out);
+    }
+}
+
+static void json_stream_print_key(json_stream_t *stream, const char *key, bool compact)
+{
+    json_t *key_str = json_string(key);
+    if (key_str != NULL) {
+        json_dumpf(key_str, stream->out, JSON_ENCODE_ANY | JSON_ENSURE_ASCII);
+        json_decref(key_str);
+    }
+    fputs(compact ? ":" : ": ", stream->out);
+}
+
+/* Prints separator and key of the next element in the current container */
+static void json_stream_begin_element(json_stream_t *stream, const char *key)
+{
+    if (stream->depth == 0) {
+        return;
+    }
+
+    if (!stream->is_empty[stream->depth - 1]) {
+        fputc(',', stream->out);
+    }
+    stream->is_empty[stream->depth - 1] = false;
+    json_stream_indent(stream, stream->depth);
+    if (!stream->is_array[stream->depth - 1] && key != NULL) {
+        json_stream_print_key(stream, key, false);
+    }
+}
+
+static void json_stream_open(json_stream_t *stream, const char *key, bool is_array)
+{
+    if (stream->depth >= JSON_STREAM_MAX_DEPTH) {
+        return;
+    }
+
+    if (!stream->ndjson) {
+        json_stream_begin_element(stream, key);
+        fputc(is_array ? '[' : '{', stream->out);
+    }
+    stream->is_empty[stream->depth] = true;
+    stream->is_array[stream->depth] = is_array;
+    stream->depth++;
+}
+
+void json_stream_open_object(json_stream_t *stream, const char *key)
+{
+    json_stream_open(stream, key, false);
+}
+
+void json_stream_open_array(json_stream_t *stream, const char *key)
+{
+    json_stream_open(stream, key, true);
+}
+
+void json_stream_close(json_stream_t *stream)
+{
+    if (stream->depth <= 0) {
+        return;
+    }
+
+    stream->depth--;
+    if (stream->ndjson) {
+        return;
+    }
+    if (!stream->is_empty[stream->depth]) {
+        json_stream_indent(stream, stream->depth);
+    }
+    fputc(stream->is_array[stream->depth] ? ']' : '}', stream->out);
+}
+
+int json_stream_add(json_stream_t *stream, const char *key, json_t *value)
+{
+    if (value == NULL) {
+        return ENOMEM;
+    }
+
+    bool has_key = key != NULL && stream->depth > 0 && !stream->is_array[stream->depth - 1];
+    if (stream->ndjson) {
+        if (has_key) {
+            fputc('{', stream->out);
+            json_stream_print_key(stream, key, true);
+        }
+        json_dumpf(value, stream->out, JSON_COMPACT | JSON_ENCODE_ANY | JSON_ENSURE_ASCII);
+        fputs(has_key ? "}\n" : "\n", stream->out);
+        json_decref(value);
+        return NO_ERROR;
+    }
+
+    json_stream_begin_element(stream, key);
+    char *dumped = json_dumps(value, JSON_INDENT(4) | JSON_ENCODE_ANY | JSON_ENSURE_ASCII);
+    json_decref(value);
+    if (dumped == NULL) {
+        return ENOMEM;
+    }
+    /* Strings can't contain new line character, so every one of them starts a new line of the value */
+    for (const char *line = dumped; *line != '\0';) {
+        const char *end = strchr(line, '\n');
+        if (end == NULL) {
+            fputs(line, stream->out);
+            break;
+        }
+        fwrite(line, 1, end - line, stream->out);
+        json_stream_indent(stream, stream->depth);
+        line = end + 1;
+    }
+    free(dumped);
+
+    return NO_ERROR;
+}
+
+int json_stream_add_members(json_stream_t *stream, json_t *object)
+{
+    if (object == NULL) {
+        return ENOMEM;
+    }
+
+    int ret = NO_ERROR;
+    const char *key = NULL;
+    json_t *value = NULL;
+    json_object_foreach(object, key, value) {
+        ret = json_stream_add(stream, key, json_incref(value));
+        if (ret != NO_ERROR) {
+            break;
+        }
+    }
+    json_decref(object);
+
+    return ret;
+}
+
+void json_stream_finish(json_stream_t *stream, int error)
+{
+    if (error != NO_ERROR) {
+        while (stream->depth > 1) {
+            json_stream_close(stream);
+        }
+        json_stream_add(stream, "error", json_string(strerror(error)));
+    }
+    while (stream->depth > 0) {
+        json_stream_close(stream);
+    }
+}
+
+/******************************************************************************
+ * Cache of object contexts
+ *****************************************************************************/
+
+/* Opened objects are kept only for long-running modes, limit keeps file descriptors and memory bounded */
+#define CONTEXT_CACHE_MAX_ENTRIES 64
+
+enum cached_context_type {
+    CACHED_TABLE_CTX,
+    CACHED_COUNTER_CTX,
+    CACHED_METER_CTX,
+    CACHED_ACTION_SELECTOR_CTX,
+};
+
+typedef struct cached_context {
+    enum cached_context_type type;
+    nikss_pipeline_id_t pipeline_id;
+    uint64_t pipeline_load_time;
+    char *name;
+    unsigned long last_request;
+
+    nikss_context_t nikss_ctx;
+    union {
+        nikss_table_entry_ctx_t table;
+        nikss_counter_context_t counter;
+        nikss_meter_ctx_t meter;
+        nikss_action_selector_context_t action_selector;
+    };
+} cached_context_t;
+
+/* Entries are allocated one by one, because clones of table contexts point to them */
+static struct {
+    bool enabled;
+    unsigned long current_request;
+    size_t n_entries;
+    cached_context_t *entries[CONTEXT_CACHE_MAX_ENTRIES];
+} context_cache;
+
+static void free_cached_context(cached_context_t *entry)
+{
+    switch (entry->type) {  /* NOLINT(hicpp-multiway-paths-covered): no default branch, so new types are reported */
+        case CACHED_TABLE_CTX:
+            nikss_table_entry_ctx_free(&entry->table);
+            break;
+        case CACHED_COUNTER_CTX:
+            nikss_counter_ctx_free(&entry->counter);
+            break;
+        case CACHED_METER_CTX:
+            nikss_meter_ctx_free(&entry->meter);
+            break;
+        case CACHED_ACTION_SELECTOR_CTX:
+            nikss_action_selector_ctx_free(&entry->action_selector);
+            break;
+    }
+    nikss_context_free(&entry->nikss_ctx);
+    free(entry->name);
+    free(entry);
+}
+
+void context_cache_enable(bool enable)
+{
+    if (!enable) {
+        context_cache_invalidate();
+    }
+    context_cache.enabled = enable;
+}
+
+void context_cache_invalidate(void)
+{
+    for (size_t i = 0; i < context_cache.n_entries; i++) {
+        free_cached_context(context_cache.entries[i]);
+    }
+    context_cache.n_entries = 0;
+}
+
+void context_cache_begin_request(void)
+{
+    context_cache.current_request += 1;
+}
+
+static void remove_cached_context(size_t pos)
+{
+    free_cached_context(context_cache.entries[pos]);
+    context_cache.n_entries -= 1;
+    memmove(&context_cache.entries[pos], &context_cache.entries[pos + 1],
+            (context_cache.n_entries - pos) * sizeof(context_cache.entries[0]));
+}
+
+/* Returns NULL when object is not cached; entry opened for another load of the pipeline is removed */
+static cached_context_t *find_cached_context(enum cached_context_type type, nikss_pipeline_id_t pipeline_id,
+                                             uint64_t load_time, const char *name)
+{
+    for (size_t i = 0; i < context_cache.n_entries; i++) {
+        cached_context_t *entry = context_cache.entries[i];
+        if (entry->type != type || entry->pipeline_id != pipeline_id || strcmp(entry->name, name) != 0) {
+            continue;
+        }
+        /* Entries are not removed while contexts of the current request might point to them */
+        if (entry->pipeline_load_time != load_time && entry->last_request != context_cache.current_request) {
+            remove_cached_context(i);
+            return NULL;
+        }
+        entry->last_request = context_cache.current_request;
+        return entry->pipeline_load_time == load_time ? entry : NULL;
+    }
+
+    return NULL;
+}
+
+/* Makes room for a new entry, returns false when every entry is used by the current request */
+static bool reserve_cached_context(void)
+{
+    if (context_cache.n_entries < CONTEXT_CACHE_MAX_ENTRIES) {
+        return true;
+    }
+
+    size_t lru = context_cache.n_entries;
+    for (size_t i = 0; i < context_cache.n_entries; i++) {
+        unsigned long last_request = context_cache.entries[i]->last_request;
+        if (last_request != context_cache.current_request &&
+            (lru == context_cache.n_entries || last_request < context_cache.entries[lru]->last_request)) {
+            lru = i;
+        }
+    }
+    if (lru == context_cache.n_entries) {
+        return false;
+    }
+    remove_cached_context(lru);
+
+    return true;
+}
+
+static cached_context_t *open_cached_context(enum cached_context_type type, nikss_pipeline_id_t pipeline_id,
+                                             uint64_t load_time, const char *name)
+{
+    if (!reserve_cached_context()) {
+        return NULL;
+    }
+
+    cached_context_t *entry = calloc(1, sizeof(cached_context_t));
+    if (entry == NULL) {
+        return NULL;
+    }
+    entry->name = strdup(name);
+    if (entry->name == NULL) {
+        free(entry);
+        return NULL;
+    }
+    entry->type = type;
+    entry->pipeline_id = pipeline_id;
+    entry->pipeline_load_time = load_time;
+    entry->last_request = context_cache.current_request;
+    nikss_context_init(&entry->nikss_ctx);
+    nikss_context_set_pipeline(&entry->nikss_ctx, pipeline_id);
+
+    int ret = EINVAL;
+    switch (type) {  /* NOLINT(hicpp-multiway-paths-covered): no default branch, so new types are reported */
+        case CACHED_TABLE_CTX:
+            nikss_table_entry_ctx_init(&entry->table);
+            ret = nikss_table_entry_ctx_tblname(&entry->nikss_ctx, &entry->table, name);
+            break;
+        case CACHED_COUNTER_CTX:
+            nikss_counter_ctx_init(&entry->counter);
+            ret = nikss_counter_ctx_name(&entry->nikss_ctx, &entry->counter, name);
+            break;
+        case CACHED_METER_CTX:
+            nikss_meter_ctx_init(&entry->meter);
+            ret = nikss_meter_ctx_name(&entry->meter, &entry->nikss_ctx, name);
+            break;
+        case CACHED_ACTION_SELECTOR_CTX:
+            nikss_action_selector_ctx_init(&entry->action_selector);
+            ret = nikss_action_selector_ctx_name(&entry->nikss_ctx, &entry->action_selector, name);
+            break;
+    }
+    if (ret != NO_ERROR) {
+        free_cached_context(entry);
+        return NULL;
+    }
+
+    context_cache.entries[context_cache.n_entries++] = entry;
+    return entry;
+}
+
+static cached_context_t *get_cached_context(enum cached_context_type type, nikss_context_t *nikss_ctx,
+                                            const char *name)
+{
+    if (!context_cache.enabled) {
+        return NULL;
+    }
+
+    nikss_pipeline_id_t pipeline_id = nikss_context_get_pipeline(nikss_ctx);
+    uint64_t load_time = nikss_pipeline_get_load_time(nikss_ctx);
+    if (load_time == 0) {
+        return NULL;
+    }
+
+    cached_context_t *entry = find_cached_context(type, pipeline_id, load_time, name);
+    if (entry == NULL) {
+        entry = open_cached_context(type, pipeline_id, load_time, name);
+    }
+
+    return entry;
+}
+
+int open_table_ctx(nikss_context_t *nikss_ctx, nikss_table_entry_ctx_t *ctx, const char *name)
+{
+    cached_context_t *entry = get_cached_context(CACHED_TABLE_CTX, nikss_ctx, name);
+    if (entry == NULL) {
+        return nikss_table_entry_ctx_tblname(nikss_ctx, ctx, name);
+    }
+
+    nikss_table_entry_ctx_free(ctx);
+    return nikss_table_entry_ctx_clone(ctx, &entry->table);
+}
+
+int open_counter_ctx(nikss_context_t *nikss_ctx, nikss_counter_context_t *ctx, const char *name)
+{
+    cached_context_t *entry = get_cached_context(CACHED_COUNTER_CTX, nikss_ctx, name);
+    if (entry == NULL) {
+        return nikss_counter_ctx_name(nikss_ctx, ctx, name);
+    }
+
+    nikss_counter_ctx_free(ctx);
+    return nikss_counter_ctx_clone(ctx, &entry->counter);
+}
+
+int open_meter_ctx(nikss_context_t *nikss_ctx, nikss_meter_ctx_t *ctx, const char *name)
+{
+    cached_context_t *entry = get_cached_context(CACHED_METER_CTX, nikss_ctx, name);
+    if (entry == NULL) {
+        return nikss_meter_ctx_name(ctx, nikss_ctx, name);
+    }
+
+    nikss_meter_ctx_free(ctx);
+    return nikss_meter_ctx_clone(ctx, &entry->meter);
+}
+
+int open_action_selector_ctx(nikss_context_t *nikss_ctx, nikss_action_selector_context_t *ctx, const char *name)
+{
+    cached_context_t *entry = get_cached_context(CACHED_ACTION_SELECTOR_CTX, nikss_ctx, name);
+    if (entry == NULL) {
+        return nikss_action_selector_ctx_name(nikss_ctx, ctx, name);
+    }
+
+    nikss_action_selector_ctx_free(ctx);
+    return nikss_action_selector_ctx_clone(ctx, &entry->action_selector);
+}
+
 /******************************************************************************
  * Data translation functions to byte stream
  *****************************************************************************/
 
+/* Numbers up to this size are parsed without GMP */
+#define NATIVE_NUMBER_MAX_BYTES 16
+
 static int update_context(const char *data, size_t len, void *ctx, enum destination_ctx_type_t ctx_type)
 {
     switch (ctx_type) {  /* NOLINT(hicpp-multiway-paths-covered): do not add default branch so clang-tidy can warn about unimplemented support for new context type */
@@ -197,31 +667,110 @@ static int update_context(const char *data, size_t len, void *ctx, enum destinat
     return EPERM;
 }
 
-static bool is_valid_mac_address(const char * data)
+/* Parses MAC address in form 11:22:33:44:55:66 or 11-22-33-44-55-66, bytes are stored from the last
+ * octet, i.e. least significant byte first, the same as numbers exported from GMP */
+static bool parse_mac_address(const char *data, uint8_t *bytes)
 {
-    if (strlen(data) != 2*6+5)  /* 11:22:33:44:55:66 */{
+    if (strlen(data) != 2*6+5) {
         return false;
     }
 
-    unsigned digits = 0;
-    unsigned separators = 0;
-    unsigned pos = 0;
-    const unsigned separator_pos[] = {2, 5, 8, 11, 14};
-    while (*data) {
-        if (separators < 5 && pos == separator_pos[separators]) {
-            if ((*data != ':') && (*data != '-')) {
+    for (int i = 0; i < 6; i++) {
+        const char *octet = data + i * 3;
+        if (!isxdigit(octet[0]) || !isxdigit(octet[1])) {
+            return false;
+        }
+        if (i < 5 && octet[2] != ':' && octet[2] != '-') {
+            return false;
+        }
+        unsigned upper = isdigit(octet[0]) ? octet[0] - '0' : tolower(octet[0]) - 'a' + 10;
+        unsigned lower = isdigit(octet[1]) ? octet[1] - '0' : tolower(octet[1]) - 'a' + 10;
+        bytes[5 - i] = (uint8_t) ((upper << 4) | lower);
+    }
+
+    return true;
+}
+
+/* Parses dotted-decimal IPv4 address with the same rules as inet_pton() */
+static bool parse_ipv4_address(const char *data, uint32_t *addr)
+{
+    uint32_t value = 0;
+
+    for (int i = 0; i < 4; i++) {
+        if (i > 0 && *data++ != '.') {
+            return false;
+        }
+        if (!isdigit(*data)) {
+            return false;
+        }
+        /* leading zeros are not allowed */
+        if (data[0] == '0' && isdigit(data[1])) {
+            return false;
+        }
+        unsigned octet = 0;
+        while (isdigit(*data)) {
+            octet = octet * 10 + (*data++ - '0');
+            if (octet > 255) {
                 return false;
             }
-            separators++;
+        }
+        value = (value << 8) | octet;
+    }
+    if (*data != '\0') {
+        return false;
+    }
+
+    *addr = value;
+    return true;
+}
+
+/* Parses number the same way as mpz_set_str() with base 0 does, but only when it fits into
+ * NATIVE_NUMBER_MAX_BYTES bytes. Bytes are stored least significant first on every host,
+ * like mpz_export() with order -1 does. */
+static bool parse_native_number(const char *data, uint8_t *bytes)
+{
+    unsigned base = 10;
+    if (data[0] == '0' && (data[1] == 'x' || data[1] == 'X')) {
+        base = 16;
+        data += 2;
+    } else if (data[0] == '0' && (data[1] == 'b' || data[1] == 'B')) {
+        base = 2;
+        data += 2;
+    } else if (data[0] == '0' && data[1] != '\0') {
+        base = 8;
+        data += 1;
+    }
+    if (*data == '\0') {
+        return false;
+    }
+
+    memset(bytes, 0, NATIVE_NUMBER_MAX_BYTES);
+    for (; *data != '\0'; data++) {
+        unsigned digit;
+        if (isdigit(*data)) {
+            digit = *data - '0';
         } else if (isxdigit(*data)) {
-            digits++;
+            digit = tolower(*data) - 'a' + 10;
         } else {
             return false;
         }
-        data++; pos++;
+        if (digit >= base) {
+            return false;
+        }
+
+        unsigned carry = digit;
+        for (size_t i = 0; i < NATIVE_NUMBER_MAX_BYTES; i++) {
+            unsigned value = bytes[i] * base + carry;
+            bytes[i] = (uint8_t) (value & 0xFF);
+            carry = value >> 8;
+        }
+        if (carry != 0) {
+            /* too big, leave it for GMP */
+            return false;
+        }
     }
 
-    return separators == 5 && digits == 12;
+    return true;
 }
 
 static int convert_number_to_bytes(const char *data, void *ctx, enum destination_ctx_type_t ctx_type)
@@ -256,6 +805,36 @@ static int convert_number_to_bytes(const char *data, void *ctx, enum destination
         }
     }
 
+    /* Most of numbers fit into native integer, so GMP is not needed for them */
+    uint8_t native_number[NATIVE_NUMBER_MAX_BYTES];
+    if (parse_native_number(data, native_number)) {
+        len = NATIVE_NUMBER_MAX_BYTES;
+        while (len > 1 && native_number[len - 1] == 0) {
+            len--;
+        }
+        if (forced_len != 0) {
+            if (len > forced_len) {
+                fprintf(stderr, "%s: do not fits into %zu bytes\n", data, forced_len);
+                return EPERM;
+            }
+            len = forced_len;
+        }
+        if (len <= NATIVE_NUMBER_MAX_BYTES) {
+            return update_context((void *) native_number, len, ctx, ctx_type);
+        }
+
+        buffer = calloc(1, len);
+        if (buffer == NULL) {
+            fprintf(stderr, "not enough memory\n");
+            return ENOMEM;
+        }
+        memcpy(buffer, native_number, NATIVE_NUMBER_MAX_BYTES);
+        error_code = update_context(buffer, len, ctx, ctx_type);
+        free(buffer);
+
+        return error_code;
+    }
+
     mpz_init(number);
     if (mpz_set_str(number, data, 0) != 0) {
         fprintf(stderr, "%s: failed to parse number\n", data);
@@ -296,16 +875,19 @@ static int convert_number_to_bytes(const char *data, void *ctx, enum destination
 
 int translate_data_to_bytes(const char *data, void *ctx, enum destination_ctx_type_t ctx_type)
 {
+    /* Addresses contain separators which never appear in numbers, so check them only when needed */
+    bool has_dot = strchr(data, '.') != NULL;
+    bool has_colon = strchr(data, ':') != NULL;
+
     /* Try parse as a IPv4 */
-    struct in_addr sa_buffer;
-    if (inet_pton(AF_INET, data, &sa_buffer) == 1) {
-        sa_buffer.s_addr = htonl(sa_buffer.s_addr);
-        return update_context((void *) &sa_buffer, sizeof(sa_buffer), ctx, ctx_type);
+    uint32_t ipv4_addr;
+    if (has_dot && parse_ipv4_address(data, &ipv4_addr)) {
+        return update_context((void *) &ipv4_addr, sizeof(ipv4_addr), ctx, ctx_type);
     }
 
     /* Try parse as a IPv6 */
     uint64_t ipv6_addr[2];
-    if (inet_pton(AF_INET6, data, &ipv6_addr[0]) == 1) {
+    if (has_colon && inet_pton(AF_INET6, data, &ipv6_addr[0]) == 1) {
 #if __BYTE_ORDER == __LITTLE_ENDIAN
         /* Swap byte order */
         uint64_t tmp = be64toh(ipv6_addr[0]);
@@ -316,16 +898,9 @@ int translate_data_to_bytes(const char *data, void *ctx, enum destination_ctx_ty
     }
 
     /* Try parse as a MAC address */
-    if (is_valid_mac_address(data)) {
-        unsigned int v[6];
-        if (sscanf(data, "%x%*c%x%*c%x%*c%x%*c%x%*c%x",  /* NOLINT(cert-err34-c): we can ignore errors because string has been validated */
-                   &(v[0]), &(v[1]), &(v[2]), &(v[3]), &(v[4]), &(v[5])) == 6) {
-            uint8_t bytes[6];
-            for (int i = 0; i < 6; i++) {
-                bytes[i] = (uint8_t) v[5 - i];
-            }
-            return update_context((void *) &(bytes[0]), 6, ctx, ctx_type);
-        }
+    uint8_t mac_addr[6];
+    if (parse_mac_address(data, mac_addr)) {
+        return update_context((void *) &(mac_addr[0]), sizeof(mac_addr), ctx, ctx_type);
     }
 
     /* Last chance: parse as number */
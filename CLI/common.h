@@ -50,15 +50,66 @@ typedef struct parser_keyword_value_pair {
 
 bool is_keyword(const char *word, const char *str);
 
+/* Splits line into arguments in place. Arguments are separated with white spaces,
+ * single or double quotes might be used to pass argument with white spaces. */
+int split_command_line(char *line, char **argv, int max_args);
+
 int parse_pipeline_id(int *argc, char ***argv, nikss_context_t * nikss_ctx);
 
 /* Optional values are not written when they are missing on command line, so they must be initialized */
 int parse_keyword_value_pairs(int *argc, char ***argv, parser_keyword_value_pair_t *kv_pairs);
+/* Sampling with interval and without count never ends, which is allowed only in interactive mode */
+int check_sample_count(unsigned long interval_ms, unsigned long count);
 
 typedef nikss_struct_field_t *(*get_next_field_func_t)(void*, void*);
 int build_struct_json(void *json_parent, void *ctx, void *entry, get_next_field_func_t get_next_field);
 
 extern const char *program_name;
+/* Set by --ndjson option */
+extern bool ndjson_output;
+/* Set while commands are executed by serve or batch, where they must not run forever */
+extern bool non_interactive;
+
+/* Writes JSON document incrementally: every value is serialized and released as soon as
+ * it is added, so big dumps are never kept in memory. Output is the same as from json_dumpf()
+ * with JSON_INDENT(4). In NDJSON mode containers are not printed, instead every added value
+ * is printed compact in a separate line, with its key when it is a member of an object. */
+#define JSON_STREAM_MAX_DEPTH 16
+
+typedef struct json_stream {
+    FILE *out;
+    bool ndjson;
+    int depth;
+    bool is_empty[JSON_STREAM_MAX_DEPTH];
+    bool is_array[JSON_STREAM_MAX_DEPTH];
+} json_stream_t;
+
+void json_stream_init(json_stream_t *stream, FILE *out, bool ndjson);
+/* Key is ignored when container is opened inside array or as the root element */
+void json_stream_open_object(json_stream_t *stream, const char *key);
+void json_stream_open_array(json_stream_t *stream, const char *key);
+void json_stream_close(json_stream_t *stream);
+/* Steals reference to the value */
+int json_stream_add(json_stream_t *stream, const char *key, json_t *value);
+/* Adds every member of the object, reference to the object is stolen */
+int json_stream_add_members(json_stream_t *stream, json_t *object);
+/* Closes all the open containers. Output can't be taken back, so on error the document is
+ * marked as incomplete with an "error" member of the root object before it is closed. */
+void json_stream_finish(json_stream_t *stream, int error);
+
+/* In serve mode contexts of tables, counters, meters and action selectors are opened once and cloned for every command.
+ * Entries are bound to a load of the pipeline, so a reloaded pipeline is opened again. Contexts
+ * returned for one request stay valid until the next request begins. */
+void context_cache_enable(bool enable);
+/* Must not be called while contexts returned by the cache are in use */
+void context_cache_invalidate(void);
+void context_cache_begin_request(void);
+/* Open object the same way as nikss_table_entry_ctx_tblname(), nikss_counter_ctx_name(), nikss_meter_ctx_name()
+ * and nikss_action_selector_ctx_name(), from the cache when it is enabled */
+int open_table_ctx(nikss_context_t *nikss_ctx, nikss_table_entry_ctx_t *ctx, const char *name);
+int open_counter_ctx(nikss_context_t *nikss_ctx, nikss_counter_context_t *ctx, const char *name);
+int open_meter_ctx(nikss_context_t *nikss_ctx, nikss_meter_ctx_t *ctx, const char *name);
+int open_action_selector_ctx(nikss_context_t *nikss_ctx, nikss_action_selector_context_t *ctx, const char *name);
 
 enum destination_ctx_type_t {
     CTX_MATCH_KEY,
@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <jansson.h>
 
@@ -37,7 +38,7 @@ static int parse_dst_counter(int *argc, char ***argv, const char **counter_name,
     if (counter_name != NULL) {
         *counter_name = **argv;
     }
-    int error_code = nikss_counter_ctx_name(nikss_ctx, ctx, **argv);
+    int error_code = open_counter_ctx(nikss_ctx, ctx, **argv);
     if (error_code != NO_ERROR) {
         return error_code;
     }
@@ -57,7 +58,7 @@ static int parse_counter_key(int *argc, char ***argv, nikss_counter_entry_t *ent
     bool has_any_key = false;
     while (*argc > 0) {
         if (has_any_key) {
-            if (is_keyword(**argv, "value")) {
+            if (is_keyword(**argv, "value") || is_keyword(**argv, "percpu")) {
                 return NO_ERROR;
             }
         }
@@ -154,6 +155,36 @@ int build_json_counter_value(void *parent, nikss_counter_entry_t *entry, nikss_c
     return NO_ERROR;
 }
 
+static int build_json_counter_percpu_value(json_t *parent, nikss_counter_entry_t *entry, nikss_counter_type_t type)
+{
+    json_t *percpu = json_array();
+    if (percpu == NULL) {
+        return ENOMEM;
+    }
+    json_object_set(parent, "percpu", percpu);
+
+    int ret = NO_ERROR;
+    size_t n_cpus = nikss_counter_entry_get_n_cpus(entry);
+    for (size_t cpu = 0; cpu < n_cpus && ret == NO_ERROR; cpu++) {
+        nikss_counter_entry_t cpu_entry;
+        nikss_counter_entry_init(&cpu_entry);
+        nikss_counter_entry_set_bytes(&cpu_entry, nikss_counter_entry_get_cpu_bytes(entry, cpu));
+        nikss_counter_entry_set_packets(&cpu_entry, nikss_counter_entry_get_cpu_packets(entry, cpu));
+
+        json_t *cpu_value = json_object();
+        if (cpu_value == NULL) {
+            ret = ENOMEM;
+            break;
+        }
+        ret = build_json_counter_value(cpu_value, &cpu_entry, type);
+        json_array_append_new(percpu, cpu_value);
+        nikss_counter_entry_free(&cpu_entry);
+    }
+
+    json_decref(percpu);
+    return ret;
+}
+
 static int build_json_counter_entry(json_t *parent, nikss_counter_context_t *ctx, nikss_counter_entry_t *entry)
 {
     if (parent == NULL) {
@@ -180,6 +211,9 @@ static int build_json_counter_entry(json_t *parent, nikss_counter_context_t *ctx
     json_object_set(parent, "value", json_value);
 
     int ret = build_json_counter_value(json_value, entry, type);
+    if (ret == NO_ERROR && nikss_counter_entry_get_n_cpus(entry) > 0) {
+        ret = build_json_counter_percpu_value(json_value, entry, type);
+    }
     json_decref(json_value);
 
     return ret;
@@ -203,58 +237,50 @@ int build_json_counter_type(void *parent, nikss_counter_type_t type)
 static int print_json_counter(nikss_counter_context_t *ctx, nikss_counter_entry_t *entry,
                               const char *counter_name, bool entry_has_key)
 {
-    int ret = EINVAL;
-    json_t *root = json_object();
-    json_t *instance_name = json_object();
-    json_t *entries = json_array();
-
-    if (root == NULL || instance_name == NULL || entries == NULL) {
-        fprintf(stderr, "failed to prepare JSON\n");
-        ret = ENOMEM;
-        goto clean_up;
-    }
+    int ret = NO_ERROR;
+    json_stream_t stream;
 
-    json_object_set(instance_name, "entries", entries);
-    if (json_object_set(root, counter_name, instance_name)) {
-        fprintf(stderr, "failed to add JSON key %s\n", counter_name);
-        goto clean_up;
+    if (entry_has_key) {
+        if ((ret = nikss_counter_get(ctx, entry)) != NO_ERROR) {
+            return ret;
+        }
     }
 
-    build_json_counter_type(instance_name, nikss_counter_get_type(ctx));
+    json_stream_init(&stream, stdout, ndjson_output);
+    json_stream_open_object(&stream, NULL);
+    json_stream_open_object(&stream, counter_name);
+    json_stream_open_array(&stream, "entries");
 
     if (entry_has_key) {
-        if ((ret = nikss_counter_get(ctx, entry)) != NO_ERROR) {
-            goto clean_up;
-        }
         json_t *current_obj = json_object();
         ret = build_json_counter_entry(current_obj, ctx, entry);
-        json_array_append_new(entries, current_obj);
+        json_stream_add(&stream, NULL, current_obj);
     } else {
         nikss_counter_entry_t *iter = NULL;
         while ((iter = nikss_counter_get_next(ctx)) != NULL) {
             json_t *current_obj = json_object();
             ret = build_json_counter_entry(current_obj, ctx, iter);
-            json_array_append_new(entries, current_obj);
             nikss_counter_entry_free(iter);
             if (ret != NO_ERROR) {
+                json_decref(current_obj);
                 break;
             }
+            json_stream_add(&stream, NULL, current_obj);
         }
     }
+    json_stream_close(&stream);
 
-    if (ret != NO_ERROR) {
-        fprintf(stderr, "failed to build JSON: %s\n", strerror(ret));
-        goto clean_up;
+    json_t *counter_type = json_object();
+    if (counter_type != NULL) {
+        build_json_counter_type(counter_type, nikss_counter_get_type(ctx));
     }
+    json_stream_add_members(&stream, counter_type);
 
-    json_dumpf(root, stdout, JSON_INDENT(4) | JSON_ENSURE_ASCII);
-
-    ret = NO_ERROR;
+    json_stream_finish(&stream, ret);
 
-clean_up:
-    json_decref(instance_name);
-    json_decref(entries);
-    json_decref(root);
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to build JSON: %s\n", strerror(ret));
+    }
 
     return ret;
 }
@@ -286,6 +312,15 @@ int do_counter_get(int argc, char **argv)
         }
     }
 
+    if (argc > 0 && is_keyword(*argv, "percpu")) {
+        if (!nikss_counter_is_percpu(&ctx)) {
+            fprintf(stderr, "%s: not a per-CPU counter\n", counter_name);
+            goto clean_up;
+        }
+        nikss_counter_ctx_percpu_breakdown(&ctx, true);
+        NEXT_ARG();
+    }
+
     if (argc > 0) {
         fprintf(stderr, "%s: unused argument\n", *argv);
         goto clean_up;
@@ -381,13 +416,206 @@ clean_up:
     return ret;
 }
 
+static int print_json_counter_snapshot(nikss_counter_context_t *ctx, nikss_counter_snapshot_t *snapshot,
+                                       const char *counter_name, FILE *out)
+{
+    int ret = NO_ERROR;
+    json_t *root = json_object();
+    json_t *instance_name = json_object();
+    json_t *entries = json_array();
+    json_t *removed = NULL;
+    nikss_counter_entry_t entry;
+
+    nikss_counter_entry_init(&entry);
+
+    if (root == NULL || instance_name == NULL || entries == NULL) {
+        fprintf(stderr, "failed to prepare JSON\n");
+        ret = ENOMEM;
+        goto clean_up;
+    }
+
+    json_object_set(instance_name, "entries", entries);
+    if (json_object_set(root, counter_name, instance_name)) {
+        fprintf(stderr, "failed to add JSON key %s\n", counter_name);
+        ret = EINVAL;
+        goto clean_up;
+    }
+
+    build_json_counter_type(instance_name, nikss_counter_get_type(ctx));
+    json_object_set_new(instance_name, "size", json_integer((json_int_t) nikss_counter_snapshot_get_size(snapshot)));
+
+    size_t n_changed = nikss_counter_snapshot_get_n_changed(snapshot);
+    for (size_t i = 0; i < n_changed; i++) {
+        size_t index = nikss_counter_snapshot_get_changed(snapshot, i);
+        ret = nikss_counter_snapshot_get_entry(ctx, snapshot, index, &entry);
+        if (ret != NO_ERROR) {
+            break;
+        }
+        json_t *current_obj = json_object();
+        ret = build_json_counter_entry(current_obj, ctx, &entry);
+        json_array_append_new(entries, current_obj);
+        if (ret != NO_ERROR) {
+            break;
+        }
+    }
+
+    /* Removed entries are printed with their last values */
+    size_t n_removed = nikss_counter_snapshot_get_n_removed(snapshot);
+    if (ret == NO_ERROR && n_removed > 0) {
+        removed = json_array();
+        if (removed == NULL) {
+            ret = ENOMEM;
+        } else {
+            json_object_set(instance_name, "removed", removed);
+        }
+    }
+    for (size_t i = 0; ret == NO_ERROR && i < n_removed; i++) {
+        ret = nikss_counter_snapshot_get_removed(ctx, snapshot, i, &entry);
+        if (ret != NO_ERROR) {
+            break;
+        }
+        json_t *current_obj = json_object();
+        ret = build_json_counter_entry(current_obj, ctx, &entry);
+        json_array_append_new(removed, current_obj);
+    }
+
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to build JSON: %s\n", strerror(ret));
+        goto clean_up;
+    }
+
+    json_dumpf(root, out, ndjson_output ? JSON_COMPACT : (JSON_INDENT(4) | JSON_ENSURE_ASCII));
+    fprintf(out, "\n");
+    fflush(out);
+
+clean_up:
+    nikss_counter_entry_free(&entry);
+    json_decref(instance_name);
+    json_decref(entries);
+    if (removed != NULL) {
+        json_decref(removed);
+    }
+    json_decref(root);
+
+    return ret;
+}
+
+int parse_snapshot_options(int *argc, char ***argv, unsigned long *interval_ms, unsigned long *count)
+{
+    while (*argc > 0) {
+        char *ptr = NULL;
+        if (is_keyword(**argv, "interval")) {
+            NEXT_ARGP_RET();
+            *interval_ms = strtoul(**argv, &ptr, 0);
+        } else if (is_keyword(**argv, "count")) {
+            NEXT_ARGP_RET();
+            *count = strtoul(**argv, &ptr, 0);
+        } else {
+            fprintf(stderr, "%s: unused argument\n", **argv);
+            return EINVAL;
+        }
+
+        if (ptr == NULL || *ptr != '\0') {
+            fprintf(stderr, "%s: unable to parse as a number\n", **argv);
+            return EINVAL;
+        }
+        NEXT_ARGP();
+    }
+
+    return check_sample_count(*interval_ms, *count);
+}
+
+int dump_counter(nikss_context_t *nikss_ctx, const char *counter_name, FILE *out)
+{
+    nikss_counter_context_t ctx;
+    nikss_counter_snapshot_t snapshot;
+
+    nikss_counter_ctx_init(&ctx);
+    nikss_counter_snapshot_init(&snapshot);
+
+    /* The first snapshot contains every entry and is read with batch operations */
+    int ret = nikss_counter_ctx_name(nikss_ctx, &ctx, counter_name);
+    if (ret == NO_ERROR) {
+        ret = nikss_counter_snapshot_update(&ctx, &snapshot);
+    }
+    if (ret == NO_ERROR) {
+        ret = print_json_counter_snapshot(&ctx, &snapshot, counter_name, out);
+    }
+
+    nikss_counter_snapshot_free(&snapshot);
+    nikss_counter_ctx_free(&ctx);
+
+    return ret;
+}
+
+int do_counter_snapshot(int argc, char **argv)
+{
+    int ret = EINVAL;
+    const char *counter_name = NULL;
+    unsigned long interval_ms = 0;
+    unsigned long count = 0;
+    nikss_context_t nikss_ctx;
+    nikss_counter_context_t ctx;
+    nikss_counter_snapshot_t snapshot;
+
+    nikss_context_init(&nikss_ctx);
+    nikss_counter_ctx_init(&ctx);
+    nikss_counter_snapshot_init(&snapshot);
+
+    if (parse_pipeline_id(&argc, &argv, &nikss_ctx) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    if (parse_dst_counter(&argc, &argv, &counter_name, &nikss_ctx, &ctx) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    if (parse_snapshot_options(&argc, &argv, &interval_ms, &count) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    /* Without interval only a single (full) snapshot is taken */
+    if (interval_ms == 0) {
+        count = 1;
+    }
+
+    struct timespec delay = {
+        .tv_sec = (time_t) (interval_ms / 1000),
+        .tv_nsec = (long) (interval_ms % 1000) * 1000000L,
+    };
+
+    for (unsigned long i = 0; count == 0 || i < count; i++) {
+        if (i > 0) {
+            nanosleep(&delay, NULL);
+        }
+
+        ret = nikss_counter_snapshot_update(&ctx, &snapshot);
+        if (ret != NO_ERROR) {
+            break;
+        }
+
+        ret = print_json_counter_snapshot(&ctx, &snapshot, counter_name, stdout);
+        if (ret != NO_ERROR) {
+            break;
+        }
+    }
+
+clean_up:
+    nikss_counter_snapshot_free(&snapshot);
+    nikss_counter_ctx_free(&ctx);
+    nikss_context_free(&nikss_ctx);
+
+    return ret;
+}
+
 int do_counter_help(int argc, char **argv)
 {
     (void) argc; (void) argv;
     fprintf(stderr,
-            "Usage: %1$s counter get pipe ID COUNTER_NAME [key DATA]\n"
+            "Usage: %1$s counter get pipe ID COUNTER_NAME [key DATA] [percpu]\n"
             "       %1$s counter set pipe ID COUNTER_NAME [key DATA] value COUNTER_VALUE\n"
             "       %1$s counter reset pipe ID COUNTER_NAME [key DATA]\n"
+            "       %1$s counter snapshot pipe ID COUNTER_NAME [interval MSEC] [count N]\n"
             "\n"
             "       COUNTER_VALUE := { BYTES | PACKETS | BYTES:PACKETS }\n"
             "",
@@ -23,6 +23,7 @@
 int do_counter_get(int argc, char **argv);
 int do_counter_set(int argc, char **argv);
 int do_counter_reset(int argc, char **argv);
+int do_counter_snapshot(int argc, char **argv);
 int do_counter_help(int argc, char **argv);
 
 static const struct cmd counter_cmds[] = {
@@ -30,11 +31,16 @@ static const struct cmd counter_cmds[] = {
         {"get",   do_counter_get},
         {"set",   do_counter_set},
         {"reset", do_counter_reset},
+        {"snapshot", do_counter_snapshot},
         {0}
 };
 
 int parse_counter_value_str(const char *str, nikss_counter_type_t type, nikss_counter_entry_t *entry);
 int build_json_counter_value(void *parent, nikss_counter_entry_t *entry, nikss_counter_type_t type);
 int build_json_counter_type(void *parent, nikss_counter_type_t type);
+/* Parses `[interval MSEC] [count N]`, consumes all remaining arguments */
+int parse_snapshot_options(int *argc, char ***argv, unsigned long *interval_ms, unsigned long *count);
+/* Prints a full snapshot of the counter like `counter snapshot` does */
+int dump_counter(nikss_context_t *nikss_ctx, const char *counter_name, FILE *out);
 
 #endif  /* __NIKSSCTL_COUNTER_H */
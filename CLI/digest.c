@@ -16,8 +16,11 @@
  */
 
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <jansson.h>
 
@@ -25,6 +28,8 @@
 
 #include "digest.h"
 
+#define DIGEST_BATCH_SIZE 256
+
 static int parse_digest(int *argc, char ***argv, nikss_context_t *nikss_ctx,
                         nikss_digest_context_t *ctx, const char **instance_name)
 {
@@ -82,24 +87,40 @@ int get_digests_and_print(int argc, char **argv, bool only_single_entry)
         goto clean_up;
     }
 
-    nikss_digest_t digest;
-    while (nikss_digest_get_next(&ctx, &digest) == NO_ERROR) {
-        json_t *entry = json_object();
-        if (entry == NULL) {
-            fprintf(stderr, "failed to prepare digest message in JSON\n");
-            goto clean_up;
+    int ret = NO_ERROR;
+    if (only_single_entry) {
+        nikss_digest_t digest;
+        if (nikss_digest_get_next(&ctx, &digest) == NO_ERROR) {
+            json_t *entry = json_object();
+            if (entry == NULL) {
+                fprintf(stderr, "failed to prepare digest message in JSON\n");
+                nikss_digest_free(&digest);
+                goto clean_up;
+            }
+            ret = build_struct_json(entry, &ctx, &digest, (get_next_field_func_t) nikss_digest_get_next_field);
+            json_array_append_new(entries, entry);
+            nikss_digest_free(&digest);
         }
-        int ret = build_struct_json(entry, &ctx, &digest, (get_next_field_func_t) nikss_digest_get_next_field);
-        json_array_append_new(entries, entry);
-        nikss_digest_free(&digest);
-
-        if (ret != NO_ERROR) {
-            break;
+    } else {
+        nikss_digest_t digests[DIGEST_BATCH_SIZE];
+        size_t n_digests = 0;
+        while (ret == NO_ERROR && nikss_digest_get_batch(&ctx, digests, DIGEST_BATCH_SIZE, &n_digests) == NO_ERROR) {
+            for (size_t i = 0; i < n_digests && ret == NO_ERROR; i++) {
+                json_t *entry = json_object();
+                if (entry == NULL) {
+                    fprintf(stderr, "failed to prepare digest message in JSON\n");
+                    goto clean_up;
+                }
+                ret = build_struct_json(entry, &ctx, &digests[i], (get_next_field_func_t) nikss_digest_get_next_field);
+                json_array_append_new(entries, entry);
+            }
         }
+    }
 
-        if (only_single_entry) {
-            break;
-        }
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to build digest message JSON: %s\n", strerror(ret));
+        error_code = ret;
+        goto clean_up;
     }
 
     json_dumpf(root, stdout, JSON_INDENT(4) | JSON_ENSURE_ASCII);
@@ -128,12 +149,141 @@ int do_digest_get_all(int argc, char **argv)
     return get_digests_and_print(argc, argv, false);
 }
 
+struct digest_watch_state {
+    const char *digest_instance_name;
+    unsigned long count;
+    unsigned long n_printed;
+};
+
+static int print_watched_digest(nikss_digest_context_t *ctx, nikss_digest_t *digest, void *user_ctx)
+{
+    struct digest_watch_state *state = user_ctx;
+    json_t *root = json_object();
+    json_t *entry = json_object();
+    if (root == NULL || entry == NULL) {
+        fprintf(stderr, "failed to prepare digest message in JSON\n");
+        json_decref(entry);
+        json_decref(root);
+        return ENOMEM;
+    }
+
+    int ret = build_struct_json(entry, ctx, digest, (get_next_field_func_t) nikss_digest_get_next_field);
+    json_object_set_new(root, state->digest_instance_name, entry);
+    if (ret == NO_ERROR) {
+        /* One message per line, so output can be consumed while it is being generated */
+        json_dumpf(root, stdout, JSON_COMPACT | JSON_ENSURE_ASCII);
+        fprintf(stdout, "\n");
+        fflush(stdout);
+        state->n_printed++;
+    }
+    json_decref(root);
+
+    /* Stop polling, so messages after the last requested one are left in the queue */
+    if (ret == NO_ERROR && state->count != 0 && state->n_printed >= state->count) {
+        return ECANCELED;
+    }
+
+    return ret;
+}
+
+static int parse_watch_options(int *argc, char ***argv, unsigned long *count, unsigned long *timeout_ms)
+{
+    while (*argc > 0) {
+        char *ptr = NULL;
+        if (is_keyword(**argv, "count")) {
+            NEXT_ARGP_RET();
+            *count = strtoul(**argv, &ptr, 0);
+        } else if (is_keyword(**argv, "timeout")) {
+            NEXT_ARGP_RET();
+            *timeout_ms = strtoul(**argv, &ptr, 0);
+        } else {
+            fprintf(stderr, "%s: unused argument\n", **argv);
+            return EINVAL;
+        }
+
+        if (ptr == NULL || *ptr != '\0') {
+            fprintf(stderr, "%s: unable to parse as a number\n", **argv);
+            return EINVAL;
+        }
+        NEXT_ARGP();
+    }
+
+    /* Even with count, messages may never arrive, so only timeout bounds the time of the command */
+    if (non_interactive && *timeout_ms == 0) {
+        fprintf(stderr, "watch without timeout is not allowed in serve and batch mode\n");
+        return EINVAL;
+    }
+
+    return NO_ERROR;
+}
+
+static long elapsed_ms_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000L + (now.tv_nsec - start->tv_nsec) / 1000000L;
+}
+
+int do_digest_watch(int argc, char **argv)
+{
+    nikss_context_t nikss_ctx;
+    nikss_digest_context_t ctx;
+    int error_code = EPERM;
+    struct digest_watch_state state = { 0 };
+    unsigned long timeout_ms = 0;
+    struct timespec start;
+
+    nikss_context_init(&nikss_ctx);
+    nikss_digest_ctx_init(&ctx);
+
+    if (parse_pipeline_id(&argc, &argv, &nikss_ctx) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    if (parse_digest(&argc, &argv, &nikss_ctx, &ctx, &state.digest_instance_name) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    if ((error_code = parse_watch_options(&argc, &argv, &state.count, &timeout_ms)) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (true) {
+        int wait_ms = -1;
+        if (timeout_ms != 0) {
+            long remaining_ms = (long) timeout_ms - elapsed_ms_since(&start);
+            if (remaining_ms <= 0) {
+                error_code = NO_ERROR;
+                break;
+            }
+            wait_ms = remaining_ms < INT_MAX ? (int) remaining_ms : INT_MAX;
+        }
+
+        error_code = nikss_digest_poll(&ctx, wait_ms, print_watched_digest, &state);
+        if (error_code == ECANCELED && state.count != 0 && state.n_printed >= state.count) {
+            error_code = NO_ERROR;
+            break;
+        }
+        if (error_code != NO_ERROR && error_code != ETIMEDOUT && error_code != EINTR) {
+            break;
+        }
+    }
+
+clean_up:
+    nikss_digest_ctx_free(&ctx);
+    nikss_context_free(&nikss_ctx);
+
+    return error_code;
+}
+
 int do_digest_help(int argc, char **argv)
 {
     (void) argc; (void) argv;
     fprintf(stderr,
             "Usage: %1$s digest get pipe ID DIGEST_NAME\n"
-            "       %1$s digest get-all pipe ID DIGEST_NAME\n",
+            "       %1$s digest get-all pipe ID DIGEST_NAME\n"
+            "       %1$s digest watch pipe ID DIGEST_NAME [count N] [timeout MSEC]\n",
             program_name);
     return 0;
 }
@@ -44,7 +44,7 @@ int convert_str_to_meter_value(const char *str, nikss_meter_value_t *value)
 int parse_dst_meter(int *argc, char ***argv, nikss_context_t *nikss_ctx,
                     nikss_meter_ctx_t *ctx, const char **instance_name)
 {
-    int error_code = nikss_meter_ctx_name(ctx, nikss_ctx, **argv);
+    int error_code = open_meter_ctx(nikss_ctx, ctx, **argv);
     if (error_code != NO_ERROR) {
         return error_code;
     }
@@ -72,7 +72,7 @@ int parse_meter_index(int *argc, char ***argv, nikss_meter_entry_t *entry)
             return error_code;
         }
 
-        if (*argc > 1 && strstr(*(*argv + 1), ":") != NULL) {
+        if (*argc > 1 && (strstr(*(*argv + 1), ":") != NULL || is_keyword(*(*argv + 1), "profile"))) {
             break;
         }
 
@@ -131,6 +131,37 @@ int parse_meter_data(int *argc, char ***argv, nikss_meter_entry_t *entry)
     return nikss_meter_entry_data(entry, pir, pbs, cir, cbs);
 }
 
+static int parse_meter_profile_id(const char *str, nikss_meter_profile_id_t *profile_id)
+{
+    char *end_ptr = NULL;
+    *profile_id = strtoul(str, &end_ptr, 0);
+    if (*end_ptr != '\0' || *profile_id == 0) {
+        fprintf(stderr, "%s: invalid meter profile ID\n", str);
+        return EINVAL;
+    }
+    return NO_ERROR;
+}
+
+/* Parses either PIR:PBS CIR:CBS or profile PROFILE_ID */
+static int parse_meter_config(int *argc, char ***argv, nikss_meter_entry_t *entry)
+{
+    if (*argc < 2 || !is_keyword(*(*argv + 1), "profile")) {
+        return parse_meter_data(argc, argv, entry);
+    }
+
+    NEXT_ARGP_RET();
+    NEXT_ARGP_RET();
+
+    nikss_meter_profile_id_t profile_id = 0;
+    int error_code = parse_meter_profile_id(**argv, &profile_id);
+    if (error_code != NO_ERROR) {
+        return error_code;
+    }
+    nikss_meter_entry_profile(entry, profile_id);
+
+    return NO_ERROR;
+}
+
 /******************************************************************************
  * JSON functions
  *****************************************************************************/
@@ -183,28 +214,22 @@ json_t *create_json_meter_entry(nikss_meter_ctx_t *ctx, nikss_meter_entry_t *met
 
     json_object_set_new(entry_root, "index", meter_index);
     json_object_set_new(entry_root, "config", meter_config);
+    if (nikss_meter_entry_get_profile(meter) != 0) {
+        json_object_set_new(entry_root, "profile", json_integer(nikss_meter_entry_get_profile(meter)));
+    }
 
     return entry_root;
 }
 
-int print_meter(nikss_meter_ctx_t *ctx, nikss_meter_entry_t *entry, const char *meter_name)
+int print_meter(nikss_meter_ctx_t *ctx, nikss_meter_entry_t *entry, const char *meter_name, FILE *out)
 {
-    int ret = EINVAL;
-    json_t *root = json_object();
-    json_t *instance_name = json_object();
-    json_t *entries = json_array();
-
-    if (root == NULL || instance_name == NULL || entries == NULL) {
-        fprintf(stderr, "failed to prepare JSON\n");
-        ret = ENOMEM;
-        goto clean_up;
-    }
+    int ret = ENOMEM;
+    json_stream_t stream;
 
-    if (json_object_set(root, meter_name, instance_name)) {
-        fprintf(stderr, "failed to add JSON key %s\n", meter_name);
-        goto clean_up;
-    }
-    json_object_set(instance_name, "entries", entries);
+    json_stream_init(&stream, out, ndjson_output);
+    json_stream_open_object(&stream, NULL);
+    json_stream_open_object(&stream, meter_name);
+    json_stream_open_array(&stream, "entries");
 
     if (entry != NULL) {
         json_t *parsed_entry = create_json_meter_entry(ctx, entry);
@@ -212,27 +237,39 @@ int print_meter(nikss_meter_ctx_t *ctx, nikss_meter_entry_t *entry, const char *
             fprintf(stderr, "failed to create table JSON entry\n");
             goto clean_up;
         }
-        json_array_append_new(entries, parsed_entry);
+        json_stream_add(&stream, NULL, parsed_entry);
     } else {
         nikss_meter_entry_t *current_entry = NULL;
         while ((current_entry = nikss_meter_get_next(ctx)) != NULL) {
             json_t *parsed_entry = create_json_meter_entry(ctx, current_entry);
+            nikss_meter_entry_free(current_entry);
             if (parsed_entry == NULL) {
                 fprintf(stderr, "failed to create table JSON entry\n");
                 goto clean_up;
             }
-            json_array_append_new(entries, parsed_entry);
-            nikss_meter_entry_free(current_entry);
+            json_stream_add(&stream, NULL, parsed_entry);
         }
     }
 
-    json_dumpf(root, stdout, JSON_INDENT(4) | JSON_ENSURE_ASCII);
     ret = NO_ERROR;
 
 clean_up:
-    json_decref(instance_name);
-    json_decref(entries);
-    json_decref(root);
+    json_stream_finish(&stream, ret);
+
+    return ret;
+}
+
+int dump_meter(nikss_context_t *nikss_ctx, const char *meter_name, FILE *out)
+{
+    nikss_meter_ctx_t ctx;
+    nikss_meter_ctx_init(&ctx);
+
+    int ret = nikss_meter_ctx_name(&ctx, nikss_ctx, meter_name);
+    if (ret == NO_ERROR) {
+        ret = print_meter(&ctx, NULL, meter_name, out);
+    }
+
+    nikss_meter_ctx_free(&ctx);
 
     return ret;
 }
@@ -282,9 +319,9 @@ int do_meter_get(int argc, char **argv)
             goto clean_up;
         }
 
-        error_code = print_meter(&meter_ctx, &entry, meter_name);
+        error_code = print_meter(&meter_ctx, &entry, meter_name, stdout);
     } else {
-        error_code = print_meter(&meter_ctx, NULL, meter_name);
+        error_code = print_meter(&meter_ctx, NULL, meter_name, stdout);
     }
 
 clean_up:
@@ -321,7 +358,7 @@ int do_meter_update(int argc, char **argv)
     }
 
     /* 3. Get meter parameters */
-    if (parse_meter_data(&argc, &argv, &entry) != NO_ERROR) {
+    if (parse_meter_config(&argc, &argv, &entry) != NO_ERROR) {
         goto clean_up;
     }
 
@@ -341,6 +378,80 @@ clean_up:
     return error_code;
 }
 
+static int parse_meter_index_value(const char *str, uint32_t *index)
+{
+    char *end_ptr = NULL;
+    *index = strtoul(str, &end_ptr, 0);
+    if (*end_ptr != '\0') {
+        fprintf(stderr, "%s: failed to parse index\n", str);
+        return EINVAL;
+    }
+    return NO_ERROR;
+}
+
+int do_meter_update_range(int argc, char **argv)
+{
+    nikss_meter_entry_t entry;
+    nikss_meter_ctx_t meter_ctx;
+    nikss_context_t nikss_ctx;
+    int error_code = EPERM;
+    uint32_t first_index = 0;
+    uint32_t last_index = 0;
+
+    nikss_meter_entry_init(&entry);
+    nikss_meter_ctx_init(&meter_ctx);
+    nikss_context_init(&nikss_ctx);
+
+    /* 0. Get the pipeline id */
+    if (parse_pipeline_id(&argc, &argv, &nikss_ctx) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    /* 1. Get meter */
+    if (parse_dst_meter(&argc, &argv, &nikss_ctx, &meter_ctx, NULL) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    /* 2. Get index range */
+    if (!is_keyword(*argv, "from")) {
+        fprintf(stderr, "expected 'from' keyword\n");
+        goto clean_up;
+    }
+    NEXT_ARG();
+    if (argc < 1 || parse_meter_index_value(*argv, &first_index) != NO_ERROR) {
+        goto clean_up;
+    }
+    NEXT_ARG();
+    if (!is_keyword(*argv, "to")) {
+        fprintf(stderr, "expected 'to' keyword\n");
+        goto clean_up;
+    }
+    NEXT_ARG();
+    if (argc < 1 || parse_meter_index_value(*argv, &last_index) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    /* 3. Get meter parameters */
+    if (parse_meter_config(&argc, &argv, &entry) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    NEXT_ARG();
+
+    if (argc > 0) {
+        fprintf(stderr, "%s: unused argument\n", *argv);
+        goto clean_up;
+    }
+
+    error_code = nikss_meter_entry_update_range(&meter_ctx, first_index, last_index, &entry);
+
+clean_up:
+    nikss_meter_entry_free(&entry);
+    nikss_meter_ctx_free(&meter_ctx);
+    nikss_context_free(&nikss_ctx);
+    return error_code;
+}
+
 int do_meter_reset(int argc, char **argv)
 {
     nikss_meter_entry_t entry;
@@ -384,15 +495,175 @@ clean_up:
     return error_code;
 }
 
+static int parse_meter_profile_data(int *argc, char ***argv, nikss_meter_ctx_t *ctx, nikss_context_t *nikss_ctx,
+                                    const char **meter_name, nikss_meter_profile_id_t *profile_id)
+{
+    if (parse_pipeline_id(argc, argv, nikss_ctx) != NO_ERROR) {
+        return EPERM;
+    }
+
+    if (*argc < 1) {
+        fprintf(stderr, "expected meter name\n");
+        return EPERM;
+    }
+    int error_code = parse_dst_meter(argc, argv, nikss_ctx, ctx, meter_name);
+    if (error_code != NO_ERROR) {
+        return error_code;
+    }
+
+    if (*argc < 1) {
+        fprintf(stderr, "expected meter profile ID\n");
+        return EPERM;
+    }
+    return parse_meter_profile_id(**argv, profile_id);
+}
+
+int do_meter_profile_update(int argc, char **argv)
+{
+    nikss_meter_entry_t entry;
+    nikss_meter_ctx_t meter_ctx;
+    nikss_context_t nikss_ctx;
+    nikss_meter_profile_id_t profile_id = 0;
+    int error_code = EPERM;
+
+    nikss_meter_entry_init(&entry);
+    nikss_meter_ctx_init(&meter_ctx);
+    nikss_context_init(&nikss_ctx);
+
+    /* 0. Get the pipeline id, meter and profile ID */
+    if (parse_meter_profile_data(&argc, &argv, &meter_ctx, &nikss_ctx, NULL, &profile_id) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    /* 1. Get meter parameters */
+    if (parse_meter_data(&argc, &argv, &entry) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    NEXT_ARG();
+
+    if (argc > 0) {
+        fprintf(stderr, "%s: unused argument\n", *argv);
+        goto clean_up;
+    }
+
+    nikss_meter_value_t pir, cir, pbs, cbs;  /* NOLINT */
+    nikss_meter_entry_get_data(&entry, &pir, &pbs, &cir, &cbs);
+    error_code = nikss_meter_profile_update(&meter_ctx, profile_id, pir, pbs, cir, cbs);
+
+clean_up:
+    nikss_meter_entry_free(&entry);
+    nikss_meter_ctx_free(&meter_ctx);
+    nikss_context_free(&nikss_ctx);
+    return error_code;
+}
+
+int do_meter_profile_delete(int argc, char **argv)
+{
+    nikss_meter_ctx_t meter_ctx;
+    nikss_context_t nikss_ctx;
+    nikss_meter_profile_id_t profile_id = 0;
+    int error_code = EPERM;
+
+    nikss_meter_ctx_init(&meter_ctx);
+    nikss_context_init(&nikss_ctx);
+
+    if (parse_meter_profile_data(&argc, &argv, &meter_ctx, &nikss_ctx, NULL, &profile_id) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    NEXT_ARG();
+
+    if (argc > 0) {
+        fprintf(stderr, "%s: unused argument\n", *argv);
+        goto clean_up;
+    }
+
+    error_code = nikss_meter_profile_delete(&meter_ctx, profile_id);
+
+clean_up:
+    nikss_meter_ctx_free(&meter_ctx);
+    nikss_context_free(&nikss_ctx);
+    return error_code;
+}
+
+int do_meter_profile_get(int argc, char **argv)
+{
+    nikss_meter_entry_t entry;
+    nikss_meter_ctx_t meter_ctx;
+    nikss_context_t nikss_ctx;
+    nikss_meter_profile_id_t profile_id = 0;
+    int error_code = EPERM;
+    const char *meter_name = NULL;
+    json_t *root = NULL;
+
+    nikss_meter_entry_init(&entry);
+    nikss_meter_ctx_init(&meter_ctx);
+    nikss_context_init(&nikss_ctx);
+
+    if (parse_meter_profile_data(&argc, &argv, &meter_ctx, &nikss_ctx, &meter_name, &profile_id) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    NEXT_ARG();
+
+    if (argc > 0) {
+        fprintf(stderr, "%s: unused argument\n", *argv);
+        goto clean_up;
+    }
+
+    nikss_meter_value_t pir, cir, pbs, cbs;  /* NOLINT */
+    error_code = nikss_meter_profile_get(&meter_ctx, profile_id, &pir, &pbs, &cir, &cbs);
+    if (error_code != NO_ERROR) {
+        goto clean_up;
+    }
+    nikss_meter_entry_data(&entry, pir, pbs, cir, cbs);
+
+    root = json_object();
+    json_t *meter_root = json_object();
+    json_t *profile_root = json_object();
+    json_t *meter_config = create_json_meter_config(&entry);
+    if (root == NULL || meter_root == NULL || profile_root == NULL || meter_config == NULL) {
+        fprintf(stderr, "failed to build JSON meter profile\n");
+        json_decref(meter_root);
+        json_decref(profile_root);
+        json_decref(meter_config);
+        error_code = ENOMEM;
+        goto clean_up;
+    }
+
+    json_object_set_new(profile_root, "id", json_integer(profile_id));
+    json_object_set_new(profile_root, "config", meter_config);
+    json_object_set_new(profile_root, "instances",
+                        json_integer((json_int_t) nikss_meter_profile_get_n_instances(&meter_ctx, profile_id)));
+    json_object_set_new(meter_root, "profile", profile_root);
+    json_object_set_new(root, meter_name, meter_root);
+
+    json_dumpf(root, stdout, ndjson_output ? JSON_COMPACT : (JSON_INDENT(4) | JSON_ENSURE_ASCII));
+    fprintf(stdout, "\n");
+
+clean_up:
+    json_decref(root);
+    nikss_meter_entry_free(&entry);
+    nikss_meter_ctx_free(&meter_ctx);
+    nikss_context_free(&nikss_ctx);
+    return error_code;
+}
+
 int do_meter_help(int argc, char **argv)
 {
     (void) argc; (void) argv;
 
     fprintf(stderr,
             "Usage: %1$s meter get pipe ID METER_NAME [index INDEX]\n"
-            "       %1$s meter update pipe ID METER_NAME index INDEX PIR:PBS CIR:CBS\n"
+            "       %1$s meter update pipe ID METER_NAME index INDEX CONFIG\n"
+            "       %1$s meter update-range pipe ID METER_NAME from FIRST_INDEX to LAST_INDEX CONFIG\n"
             "       %1$s meter reset pipe ID METER_NAME [index INDEX]\n"
+            "       %1$s meter profile-update pipe ID METER_NAME PROFILE_ID PIR:PBS CIR:CBS\n"
+            "       %1$s meter profile-delete pipe ID METER_NAME PROFILE_ID\n"
+            "       %1$s meter profile-get pipe ID METER_NAME PROFILE_ID\n"
             "\n"
+            "       CONFIG := { PIR:PBS CIR:CBS | profile PROFILE_ID }\n"
             "       INDEX := { DATA }\n"
             "       PIR := { DATA }\n"
             "       PBS := { DATA }\n"
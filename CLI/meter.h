@@ -22,18 +22,28 @@
 
 int do_meter_get(int argc, char **argv);
 int do_meter_update(int argc, char **argv);
+int do_meter_update_range(int argc, char **argv);
 int do_meter_reset(int argc, char **argv);
+int do_meter_profile_update(int argc, char **argv);
+int do_meter_profile_delete(int argc, char **argv);
+int do_meter_profile_get(int argc, char **argv);
 int do_meter_help(int argc, char **argv);
 
 static const struct cmd meter_cmds[] = {
         {"help",   do_meter_help},
         {"get",    do_meter_get},
         {"update", do_meter_update},
+        {"update-range", do_meter_update_range},
         {"reset",  do_meter_reset},
+        {"profile-update", do_meter_profile_update},
+        {"profile-delete", do_meter_profile_delete},
+        {"profile-get", do_meter_profile_get},
         {0}
 };
 
 int parse_meter_data(int *argc, char ***argv, nikss_meter_entry_t *entry);
 void *create_json_meter_config(nikss_meter_entry_t *meter);
+/* Prints every meter instance like `meter get` does */
+int dump_meter(nikss_context_t *nikss_ctx, const char *meter_name, FILE *out);
 
 #endif /* __NIKSSCTL_METER_H */
@@ -17,6 +17,7 @@
 
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <jansson.h>
 
@@ -212,6 +213,111 @@ err:
     return ret;
 }
 
+static int parse_group_members(int *argc, char ***argv, nikss_mcast_grp_member_t **members, size_t *n_members)
+{
+    *members = NULL;
+    *n_members = 0;
+    if (*argc < 1) {
+        return NO_ERROR;
+    }
+
+    /* Each member takes 4 arguments, so this is an upper bound */
+    *members = calloc(*argc / 4 + 1, sizeof(nikss_mcast_grp_member_t));
+    if (*members == NULL) {
+        return ENOMEM;
+    }
+
+    while (*argc > 0) {
+        uint32_t egress_port = 0;
+        uint16_t instance = 0;
+        parser_keyword_value_pair_t kv[] = {
+                {"egress-port", &egress_port, sizeof(egress_port), true, "egress port"},
+                {"instance",    &instance,    sizeof(instance),    true, "egress port instance"},
+                { 0 },
+        };
+
+        int ret = parse_keyword_value_pairs(argc, argv, &kv[0]);
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+
+        nikss_mcast_grp_member_init(&(*members)[*n_members]);
+        nikss_mcast_grp_member_port(&(*members)[*n_members], egress_port);
+        nikss_mcast_grp_member_instance(&(*members)[*n_members], instance);
+        *n_members += 1;
+    }
+
+    return NO_ERROR;
+}
+
+int do_multicast_set_group_members(int argc, char **argv)
+{
+    nikss_context_t ctx;
+    nikss_mcast_grp_ctx_t mcast_grp;
+    nikss_mcast_grp_member_t *members = NULL;
+    size_t n_members = 0;
+    int ret = EINVAL;
+
+    nikss_context_init(&ctx);
+    nikss_mcast_grp_context_init(&mcast_grp);
+
+    if (parse_group(&argc, &argv, &ctx, &mcast_grp) != NO_ERROR) {
+        goto err;
+    }
+
+    if ((ret = parse_group_members(&argc, &argv, &members, &n_members)) != NO_ERROR) {
+        goto err;
+    }
+
+    if (!nikss_mcast_grp_exists(&ctx, &mcast_grp)) {
+        fprintf(stderr, "multicast group does not exist\n");
+        ret = ENOENT;
+        goto err;
+    }
+
+    ret = nikss_mcast_grp_set_members(&ctx, &mcast_grp, members, n_members);
+
+err:
+    if (members != NULL) {
+        free(members);
+    }
+    nikss_mcast_grp_context_free(&mcast_grp);
+    nikss_context_free(&ctx);
+
+    return ret;
+}
+
+int do_multicast_replace_group(int argc, char **argv)
+{
+    nikss_context_t ctx;
+    nikss_mcast_grp_ctx_t mcast_grp;
+    nikss_mcast_grp_member_t *members = NULL;
+    size_t n_members = 0;
+    int ret = EINVAL;
+
+    nikss_context_init(&ctx);
+    nikss_mcast_grp_context_init(&mcast_grp);
+
+    if (parse_group(&argc, &argv, &ctx, &mcast_grp) != NO_ERROR) {
+        goto err;
+    }
+
+    if ((ret = parse_group_members(&argc, &argv, &members, &n_members)) != NO_ERROR) {
+        goto err;
+    }
+
+    ret = nikss_mcast_grp_replace(&ctx, &mcast_grp, members, n_members);
+
+err:
+    if (members != NULL) {
+        free(members);
+    }
+    nikss_mcast_grp_context_free(&mcast_grp);
+    nikss_context_free(&ctx);
+
+    return ret;
+}
+
 static json_t *create_json_single_group(nikss_context_t *ctx, nikss_mcast_grp_ctx_t *group)
 {
     json_t *root = json_object();
@@ -348,9 +454,12 @@ int do_multicast_help(int argc, char **argv)
         "       %1$s multicast-group delete pipe ID MULTICAST_GROUP\n"
         "       %1$s multicast-group add-member pipe ID MULTICAST_GROUP egress-port OUTPUT_PORT instance INSTANCE_ID\n"
         "       %1$s multicast-group del-member pipe ID MULTICAST_GROUP egress-port OUTPUT_PORT instance INSTANCE_ID\n"
+        "       %1$s multicast-group set-members pipe ID MULTICAST_GROUP [MEMBER ...]\n"
+        "       %1$s multicast-group replace pipe ID MULTICAST_GROUP [MEMBER ...]\n"
         "       %1$s multicast-group get pipe ID [MULTICAST_GROUP]\n"
         "\n"
         "       MULTICAST_GROUP := id MULTICAST_GROUP_ID\n"
+        "       MEMBER := egress-port OUTPUT_PORT instance INSTANCE_ID\n"
         "",
         program_name);
 
@@ -16,12 +16,21 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <linux/ethtool.h>
+#include <linux/sockios.h>
+#include <net/if.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
 #include <sys/utsname.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <nikss/nikss_pipeline.h>
+
 #include "os_validate.h"
 
 #define MAX_STR_LEN 128
@@ -447,8 +456,460 @@ static int validate_config_and_print(struct os_configuration *conf)
     return 0;
 }
 
+/*
+ * Performance audit. Every check adds a finding to the report, which is printed as text or JSON at the end.
+ */
+
+enum perf_finding_status {
+    PERF_OK,
+    PERF_INFO,
+    PERF_WARNING
+};
+
+struct perf_audit {
+    json_t *findings;
+    unsigned n_warnings;
+};
+
+static void add_perf_finding(struct perf_audit *audit, const char *check, const char *device, const char *value,
+                             enum perf_finding_status status, const char *recommendation)
+{
+    const char *status_str[] = {"ok", "info", "warning"};
+    json_t *finding = json_object();
+    if (finding == NULL) {
+        return;
+    }
+
+    json_object_set_new(finding, "check", json_string(check));
+    if (device != NULL) {
+        json_object_set_new(finding, "device", json_string(device));
+    }
+    json_object_set_new(finding, "value", json_string(value));
+    json_object_set_new(finding, "status", json_string(status_str[status]));
+    if (status != PERF_OK && recommendation != NULL) {
+        json_object_set_new(finding, "recommendation", json_string(recommendation));
+    }
+    json_array_append_new(audit->findings, finding);
+
+    if (status == PERF_WARNING) {
+        audit->n_warnings++;
+    }
+}
+
+/* Reads the first line of a file from procfs or sysfs without trailing new line character */
+static int read_first_line(const char *path, char *buf, size_t len)
+{
+    FILE *file = fopen(path, "re");
+    if (file == NULL) {
+        return errno;
+    }
+
+    int ret = fgets(buf, (int) len, file) != NULL ? 0 : EIO;
+    fclose(file);
+    if (ret == 0) {
+        buf[strcspn(buf, "\n")] = 0;
+    }
+
+    return ret;
+}
+
+static void audit_sysctl(struct perf_audit *audit, const char *check, const char *path, const char *expected,
+                         enum perf_finding_status status_if_not_expected, const char *recommendation)
+{
+    char value[MAX_STR_LEN];
+    if (read_first_line(path, value, sizeof(value)) != 0) {
+        add_perf_finding(audit, check, NULL, "unknown", PERF_INFO, "run as root to read this setting");
+        return;
+    }
+
+    enum perf_finding_status status = strcmp(value, expected) == 0 ? PERF_OK : status_if_not_expected;
+    add_perf_finding(audit, check, NULL, value, status, recommendation);
+}
+
+static void audit_memlock(struct perf_audit *audit, const struct os_configuration *conf)
+{
+    struct rlimit limit;
+    char value[MAX_STR_LEN];
+    unsigned current_kernel_ver[4] = {conf->kernel_ver_major, conf->kernel_ver_minor, 0, 0};
+    unsigned memcg_accounting_ver[4] = {5, 11, 0, 0};
+
+    if (getrlimit(RLIMIT_MEMLOCK, &limit) != 0) {
+        return;
+    }
+
+    if (limit.rlim_cur == RLIM_INFINITY) {
+        snprintf(value, sizeof(value), "unlimited");
+    } else {
+        snprintf(value, sizeof(value), "%llu KiB", (unsigned long long) limit.rlim_cur / 1024);
+    }
+
+    /* Since 5.11 memory of BPF objects is charged to memory cgroup instead */
+    bool enough = limit.rlim_cur == RLIM_INFINITY || compare_versions(current_kernel_ver, memcg_accounting_ver) >= 0;
+    add_perf_finding(audit, "memlock limit", NULL, value, enough ? PERF_OK : PERF_WARNING,
+                     "large maps and tuples fail to be created, run 'ulimit -l unlimited' "
+                     "or set LimitMEMLOCK=infinity for the service");
+}
+
+/* Drivers implementing XDP in native mode, otherwise XDP runs in much slower generic mode */
+static bool driver_has_native_xdp(const char *driver)
+{
+    const char *drivers[] = {
+            "bnxt_en", "ena", "i40e", "ice", "igb", "igc", "ixgbe", "ixgbevf", "mlx4_core", "mlx4_en",
+            "mlx5_core", "mvneta", "mvpp2", "nfp", "qede", "sfc", "stmmac", "thunder-nicvf", "tun",
+            "veth", "virtio_net", "hv_netvsc", "dpaa2-eth", "fsl_dpaa2_eth", "cpsw", "bonding", NULL
+    };
+
+    for (unsigned i = 0; drivers[i] != NULL; ++i) {
+        if (strcmp(driver, drivers[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Driver as reported by 'ethtool -i', which works also for virtual devices (veth, tun, bonding) */
+static bool get_device_driver(const char *dev, char *driver, size_t len)
+{
+    struct ethtool_drvinfo info = { .cmd = ETHTOOL_GDRVINFO };
+    struct ifreq ifr;
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, dev, IFNAMSIZ - 1);
+    ifr.ifr_data = (void *) &info;
+
+    int sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (sock >= 0) {
+        int ret = ioctl(sock, SIOCETHTOOL, &ifr);
+        close(sock);
+        if (ret == 0 && info.driver[0] != '\0') {
+            snprintf(driver, len, "%.*s", (int) sizeof(info.driver), info.driver);
+            return true;
+        }
+    }
+
+    /* Fall back to the driver of the parent device of NIC */
+    char path[MAX_STR_LEN * 2];
+    char link[MAX_STR_LEN * 2];
+    snprintf(path, sizeof(path), "/sys/class/net/%s/device/driver", dev);
+    ssize_t link_len = readlink(path, link, sizeof(link) - 1);
+    if (link_len <= 0) {
+        return false;
+    }
+    link[link_len] = 0;
+    snprintf(driver, len, "%s", strrchr(link, '/') != NULL ? strrchr(link, '/') + 1 : link);
+
+    return true;
+}
+
+static void audit_device_driver(struct perf_audit *audit, const char *dev)
+{
+    char driver[MAX_STR_LEN];
+
+    if (!get_device_driver(dev, driver, sizeof(driver))) {
+        add_perf_finding(audit, "XDP native mode support", dev, "unknown driver", PERF_INFO,
+                         "driver of the device can't be determined, check with 'ethtool -i' whether it supports "
+                         "native XDP");
+        return;
+    }
+
+    add_perf_finding(audit, "XDP native mode support", dev, driver,
+                     driver_has_native_xdp(driver) ? PERF_OK : PERF_WARNING,
+                     "driver is not known to support native XDP, XDP programs would run in generic mode "
+                     "which is slower than TC; load the TC pipeline or use a NIC with native XDP");
+}
+
+static unsigned count_rx_queues(const char *dev)
+{
+    char path[MAX_STR_LEN * 2];
+    unsigned n_queues = 0;
+
+    for (;; ++n_queues) {
+        snprintf(path, sizeof(path), "/sys/class/net/%s/queues/rx-%u", dev, n_queues);
+        if (access(path, F_OK) != 0) {
+            break;
+        }
+    }
+
+    return n_queues;
+}
+
+static void audit_device_irqs(struct perf_audit *audit, const char *dev)
+{
+    char value[MAX_STR_LEN];
+    char recommendation[MAX_STR_LEN * 2];
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned n_queues = count_rx_queues(dev);
+
+    snprintf(value, sizeof(value), "%u RX queues, %ld CPUs", n_queues, n_cpus);
+    snprintf(recommendation, sizeof(recommendation),
+             "packets are processed by a single CPU, enable RSS with 'ethtool -L %s combined N'", dev);
+    add_perf_finding(audit, "RSS queues", dev, value, n_queues > 1 || n_cpus <= 1 ? PERF_OK : PERF_WARNING,
+                     recommendation);
+
+    /* IRQs of queues are named after the device by most drivers, e.g. "eth0-TxRx-1" */
+    FILE *interrupts = fopen("/proc/interrupts", "re");
+    if (interrupts == NULL) {
+        return;
+    }
+
+    char buf[BUFSIZ];
+    unsigned n_irqs = 0;
+    char first_affinity[MAX_STR_LEN] = {0};
+    bool same_affinity = true;
+    size_t dev_len = strlen(dev);
+    while (fgets(buf, BUFSIZ, interrupts) != NULL) {
+        char *name = strrchr(buf, ' ');
+        if (name == NULL || strncmp(name + 1, dev, dev_len) != 0 ||
+            (name[dev_len + 1] != '-' && name[dev_len + 1] != '\n')) {
+            continue;
+        }
+
+        char path[MAX_STR_LEN];
+        char affinity[MAX_STR_LEN];
+        snprintf(path, sizeof(path), "/proc/irq/%lu/smp_affinity_list", strtoul(buf, NULL, 10));
+        if (read_first_line(path, affinity, sizeof(affinity)) != 0) {
+            continue;
+        }
+        if (n_irqs == 0) {
+            strncpy(first_affinity, affinity, sizeof(first_affinity) - 1);
+        } else if (strcmp(first_affinity, affinity) != 0) {
+            same_affinity = false;
+        }
+        n_irqs++;
+    }
+    fclose(interrupts);
+
+    if (n_irqs < 2) {
+        return;
+    }
+    snprintf(value, sizeof(value), "%u IRQs%s%s", n_irqs, same_affinity ? " on CPUs " : " spread over CPUs",
+             same_affinity ? first_affinity : "");
+    snprintf(recommendation, sizeof(recommendation),
+             "all queues of %s are served by the same CPUs, spread them with irqbalance or "
+             "by writing /proc/irq/N/smp_affinity_list", dev);
+    add_perf_finding(audit, "IRQ spread", dev, value, same_affinity ? PERF_WARNING : PERF_OK, recommendation);
+}
+
+static void audit_device_numa(struct perf_audit *audit, const char *dev)
+{
+    char path[MAX_STR_LEN * 2];
+    char node[MAX_STR_LEN];
+    char recommendation[MAX_STR_LEN * 2];
+
+    /* Single node systems have nothing to co-locate */
+    if (access("/sys/devices/system/node/node1", F_OK) != 0) {
+        return;
+    }
+
+    snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node", dev);
+    if (read_first_line(path, node, sizeof(node)) != 0 || strcmp(node, "-1") == 0) {
+        add_perf_finding(audit, "NUMA node", dev, "unknown", PERF_INFO, NULL);
+        return;
+    }
+
+    snprintf(recommendation, sizeof(recommendation),
+             "place large maps on the node of the NIC with 'pipeline load ... map NAME numa %s' and "
+             "serve the IRQs from CPUs of this node (/sys/class/net/%s/device/local_cpulist)", node, dev);
+    add_perf_finding(audit, "NUMA node", dev, node, PERF_INFO, recommendation);
+}
+
+static int get_ethtool_value(int sock, const char *dev, uint32_t cmd, uint32_t *value)
+{
+    struct ethtool_value eval = { .cmd = cmd };
+    struct ifreq ifr;
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, dev, IFNAMSIZ - 1);
+    ifr.ifr_data = (void *) &eval;
+    if (ioctl(sock, SIOCETHTOOL, &ifr) != 0) {
+        return errno;
+    }
+    *value = eval.data;
+
+    return 0;
+}
+
+static void audit_device_offloads(struct perf_audit *audit, const char *dev)
+{
+    char recommendation[MAX_STR_LEN * 2];
+    uint32_t value = 0;
+
+    int sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return;
+    }
+
+    if (get_ethtool_value(sock, dev, ETHTOOL_GFLAGS, &value) == 0) {
+        bool lro = (value & ETH_FLAG_LRO) != 0;
+        snprintf(recommendation, sizeof(recommendation),
+                 "drivers refuse native XDP with LRO and TC sees merged packets, run 'ethtool -K %s lro off'", dev);
+        add_perf_finding(audit, "LRO", dev, lro ? "on" : "off", lro ? PERF_WARNING : PERF_OK, recommendation);
+    }
+
+    if (get_ethtool_value(sock, dev, ETHTOOL_GGRO, &value) == 0) {
+        snprintf(recommendation, sizeof(recommendation),
+                 "GRO runs after XDP, but before TC pipeline it merges and later splits forwarded packets, "
+                 "consider 'ethtool -K %s gro off' for the TC pipeline", dev);
+        add_perf_finding(audit, "GRO", dev, value != 0 ? "on" : "off", value != 0 ? PERF_INFO : PERF_OK,
+                         recommendation);
+    }
+
+    close(sock);
+}
+
+static void print_perf_audit(struct perf_audit *audit)
+{
+    for (size_t index = 0; index < json_array_size(audit->findings); index++) {
+        json_t *finding = json_array_get(audit->findings, index);
+        const char *device = json_string_value(json_object_get(finding, "device"));
+        const char *status = json_string_value(json_object_get(finding, "status"));
+        const char *recommendation = json_string_value(json_object_get(finding, "recommendation"));
+
+        printf("%s%s%s: %s", device != NULL ? device : "", device != NULL ? " " : "",
+               json_string_value(json_object_get(finding, "check")),
+               json_string_value(json_object_get(finding, "value")));
+        if (strcmp(status, "ok") == 0) {
+            printf(" ... OK\n");
+        } else {
+            printf(" ... %s\n", strcmp(status, "warning") == 0 ? "WARNING" : "INFO");
+        }
+        if (recommendation != NULL) {
+            printf("    recommendation: %s\n", recommendation);
+        }
+    }
+
+    if (audit->n_warnings > 0) {
+        printf("\n%u setting(s) may limit throughput of NIKSS.\n\n", audit->n_warnings);
+    } else {
+        printf("\nNo performance issues found.\n\n");
+    }
+}
+
+/* Return codes like validate_config_and_print: 0 when no warnings, 1 otherwise */
+static int audit_performance(struct os_configuration *conf, char **devices, int n_devices, bool json_output)
+{
+    struct perf_audit audit = {
+            .findings = json_array(),
+            .n_warnings = 0,
+    };
+    if (audit.findings == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return ENOMEM;
+    }
+
+    audit_sysctl(&audit, "JIT compiler enabled", "/proc/sys/net/core/bpf_jit_enable", "1", PERF_WARNING,
+                 "programs are interpreted or JIT prints debug output, run 'sysctl -w net.core.bpf_jit_enable=1'");
+    audit_sysctl(&audit, "JIT hardening", "/proc/sys/net/core/bpf_jit_harden", "0", PERF_INFO,
+                 "constant blinding makes JIT-ed programs slower, when unprivileged BPF is disabled run "
+                 "'sysctl -w net.core.bpf_jit_harden=0'");
+    audit_sysctl(&audit, "BPF run time statistics", "/proc/sys/kernel/bpf_stats_enabled", "0", PERF_WARNING,
+                 "every run of a program is timed, run 'sysctl -w kernel.bpf_stats_enabled=0' after profiling");
+    audit_memlock(&audit, conf);
+
+    for (int i = 0; i < n_devices; i++) {
+        if (if_nametoindex(devices[i]) == 0) {
+            add_perf_finding(&audit, "device", devices[i], "not found", PERF_WARNING, "check name of the port");
+            continue;
+        }
+        audit_device_driver(&audit, devices[i]);
+        audit_device_irqs(&audit, devices[i]);
+        audit_device_numa(&audit, devices[i]);
+        audit_device_offloads(&audit, devices[i]);
+    }
+
+    int ret = audit.n_warnings > 0 ? 1 : 0;
+    if (json_output) {
+        json_t *root = json_object();
+        json_t *report = json_object();
+        json_object_set_new(report, "findings", audit.findings);
+        json_object_set_new(report, "warnings", json_integer(audit.n_warnings));
+        json_object_set_new(root, "performance_audit", report);
+        json_dumpf(root, stdout, ndjson_output ? JSON_COMPACT : (JSON_INDENT(4) | JSON_ENSURE_ASCII));
+        printf("\n");
+        json_decref(root);
+    } else {
+        print_perf_audit(&audit);
+        json_decref(audit.findings);
+    }
+
+    return ret;
+}
+
+/* Names of ports of the pipeline, they are audited when devices are not given */
+static int get_pipeline_ports(nikss_context_t *ctx, char ***devices, int *n_devices)
+{
+    nikss_port_list_t list;
+    nikss_port_spec_t *port = NULL;
+    int ret = nikss_port_list_init(&list, ctx);
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to list ports of the pipeline: %s\n", strerror(ret));
+        return ret;
+    }
+
+    while ((port = nikss_port_list_get_next_port(&list)) != NULL) {
+        char **new_devices = realloc(*devices, (*n_devices + 1) * sizeof(char *));
+        char *name = strdup(nikss_port_spec_get_name(port));
+        nikss_port_spec_free(port);
+        if (new_devices == NULL || name == NULL) {
+            free(name);
+            if (new_devices != NULL) {
+                *devices = new_devices;
+            }
+            fprintf(stderr, "not enough memory\n");
+            ret = ENOMEM;
+            break;
+        }
+        *devices = new_devices;
+        (*devices)[(*n_devices)++] = name;
+    }
+    nikss_port_list_free(&list);
+
+    return ret;
+}
+
+static void free_pipeline_ports(char **devices, int n_devices)
+{
+    for (int i = 0; i < n_devices; i++) {
+        free(devices[i]);
+    }
+    free(devices);
+}
+
 int do_os_validate(int argc, char **argv)
 {
+    bool perf = false;
+    bool json_output = false;
+    bool has_pipeline = false;
+    char **devices = NULL;
+    int n_devices = 0;
+    nikss_context_t nikss_ctx;
+
+    nikss_context_init(&nikss_ctx);
+
+    /* validate-os [perf [pipe ID] [dev DEV...] [json]] */
+    if (argc > 0 && is_keyword(*argv, "perf")) {
+        perf = true;
+        NEXT_ARG();
+        if (argc > 0 && is_keyword(*argv, "pipe")) {
+            if (parse_pipeline_id(&argc, &argv, &nikss_ctx) != NO_ERROR) {
+                nikss_context_free(&nikss_ctx);
+                return EINVAL;
+            }
+            has_pipeline = true;
+        }
+        if (argc > 0 && is_keyword(*argv, "dev")) {
+            NEXT_ARG_RET();
+            devices = argv;
+            while (argc > 0 && !is_keyword(*argv, "json")) {
+                n_devices++;
+                NEXT_ARG();
+            }
+        }
+        if (argc > 0 && is_keyword(*argv, "json")) {
+            json_output = true;
+            NEXT_ARG();
+        }
+    }
     if (argc > 0) {
         fprintf(stderr, "%s: unused argument\n", argv[0]);
     }
@@ -456,6 +917,27 @@ int do_os_validate(int argc, char **argv)
     struct os_configuration conf;
     memset(&conf, 0, sizeof(struct os_configuration));
 
+    if (perf) {
+        int ret = NO_ERROR;
+        bool own_devices = has_pipeline && n_devices == 0;
+        if (decode_uname(&conf) != 0) {
+            fprintf(stderr, "failed to obtain system configuration\n");
+            ret = EPERM;
+        }
+        if (ret == NO_ERROR && own_devices) {
+            ret = get_pipeline_ports(&nikss_ctx, &devices, &n_devices);
+        }
+        if (ret == NO_ERROR) {
+            ret = audit_performance(&conf, devices, n_devices, json_output);
+        }
+        if (own_devices) {
+            free_pipeline_ports(devices, n_devices);
+        }
+        nikss_context_free(&nikss_ctx);
+        return ret;
+    }
+    nikss_context_free(&nikss_ctx);
+
     int (*get_conf_func[])(struct os_configuration *) = {
             decode_uname,
             decode_mounts,
@@ -16,6 +16,8 @@
  */
 
 #include <errno.h>
+#include <fnmatch.h>
+#include <net/if.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -27,7 +29,12 @@
 #include <nikss/nikss.h>
 #include <nikss/nikss_pipeline.h>
 
+#include "action_selector.h"
 #include "common.h"
+#include "counter.h"
+#include "meter.h"
+#include "register.h"
+#include "table.h"
 
 static json_t * json_port_entry(const char *intf, int ifindex)
 {
@@ -113,6 +120,63 @@ static int parse_pipeline_id_without_pipe_keyword(int *argc, char ***argv, uint3
     return NO_ERROR;
 }
 
+static void print_load_timings(const nikss_pipeline_load_stats_t *stats)
+{
+    fprintf(stdout, "Object open:      %10.3f ms\n", (double) stats->object_open_ns / 1e6);
+    fprintf(stdout, "Object load:      %10.3f ms\n", (double) stats->object_load_ns / 1e6);
+    fprintf(stdout, "Programs pinning: %10.3f ms (%u programs)\n", (double) stats->prog_pin_ns / 1e6, stats->n_programs);
+    fprintf(stdout, "Maps pinning:     %10.3f ms (%u maps)\n", (double) stats->map_pin_ns / 1e6, stats->n_maps);
+    fprintf(stdout, "Ternary tuples:   %10.3f ms (%u tuples)\n", (double) stats->tuples_ns / 1e6, stats->n_tuples);
+    fprintf(stdout, "Maps init:        %10.3f ms\n", (double) stats->map_init_ns / 1e6);
+    fprintf(stdout, "Total:            %10.3f ms\n", (double) stats->total_ns / 1e6);
+}
+
+static int parse_uint32_arg(const char *arg, const char *what, uint32_t *value)
+{
+    char *endptr = NULL;
+    *value = strtoul(arg, &endptr, 0);
+    if (*endptr) {
+        fprintf(stderr, "%s: unable to parse as %s\n", arg, what);
+        return EINVAL;
+    }
+    return NO_ERROR;
+}
+
+/* map NAME [size N] [no-prealloc] [mmapable] [numa NODE] */
+static int parse_map_override(int *argc, char ***argv, nikss_map_override_t *override)
+{
+    NEXT_ARGP_RET();
+    override->name = **argv;
+    override->numa_node = -1;
+    NEXT_ARGP();
+
+    while (*argc > 0) {
+        if (is_keyword(**argv, "size")) {
+            NEXT_ARGP_RET();
+            if (parse_uint32_arg(**argv, "a number of entries", &override->max_entries) != NO_ERROR ||
+                override->max_entries == 0) {
+                return EINVAL;
+            }
+        } else if (is_keyword(**argv, "no-prealloc")) {
+            override->no_prealloc = true;
+        } else if (is_keyword(**argv, "mmapable")) {
+            override->mmapable = true;
+        } else if (is_keyword(**argv, "numa")) {
+            NEXT_ARGP_RET();
+            uint32_t node = 0;
+            if (parse_uint32_arg(**argv, "a NUMA node", &node) != NO_ERROR || node > INT32_MAX) {
+                return EINVAL;
+            }
+            override->numa_node = (int) node;
+        } else {
+            break;
+        }
+        NEXT_ARGP();
+    }
+
+    return NO_ERROR;
+}
+
 int do_pipeline_load(int argc, char **argv)
 {
     uint32_t id = 0;
@@ -125,12 +189,40 @@ int do_pipeline_load(int argc, char **argv)
         fprintf(stderr, "expected path to the ELF file\n");
         return EINVAL;
     }
-    if (argc > 1) {
-        fprintf(stderr, "too many arguments\n");
-        return EINVAL;
-    }
 
     char *file = *argv;
+    bool print_timings = false;
+    NEXT_ARG();
+
+    /* Every override takes at least two arguments */
+    nikss_map_override_t *overrides = calloc(argc / 2 + 1, sizeof(nikss_map_override_t));
+    nikss_pipeline_load_opts_t opts = {
+            .map_overrides = overrides,
+            .n_map_overrides = 0,
+    };
+    if (overrides == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return ENOMEM;
+    }
+
+    int ret = NO_ERROR;
+    while (argc > 0) {
+        if (is_keyword(*argv, "timings")) {
+            print_timings = true;
+            NEXT_ARG();
+        } else if (is_keyword(*argv, "map")) {
+            ret = parse_map_override(&argc, &argv, &overrides[opts.n_map_overrides]);
+            if (ret != NO_ERROR) {
+                free(overrides);
+                return ret;
+            }
+            opts.n_map_overrides++;
+        } else {
+            fprintf(stderr, "%s: unused argument\n", *argv);
+            free(overrides);
+            return EINVAL;
+        }
+    }
 
     nikss_context_t ctx;
     nikss_context_init(&ctx);
@@ -139,10 +231,13 @@ int do_pipeline_load(int argc, char **argv)
     if (nikss_pipeline_exists(&ctx)) {
         fprintf(stderr, "pipeline id %u already exists\n", id);
         nikss_context_free(&ctx);
+        free(overrides);
         return EEXIST;
     }
 
-    int ret = nikss_pipeline_load(&ctx, file);
+    nikss_pipeline_load_stats_t stats;
+    ret = nikss_pipeline_load_with_opts(&ctx, file, &opts, &stats);
+    free(overrides);
     if (ret) {
         fprintf(stdout, "An error occurred during pipeline load id %u\n", id);
         nikss_context_free(&ctx);
@@ -150,6 +245,50 @@ int do_pipeline_load(int argc, char **argv)
     }
 
     fprintf(stdout, "Pipeline id %u successfully loaded!\n", id);
+    if (print_timings) {
+        print_load_timings(&stats);
+    }
+    nikss_context_free(&ctx);
+    return NO_ERROR;
+}
+
+int do_pipeline_replace(int argc, char **argv)
+{
+    uint32_t id = 0;
+
+    if (parse_pipeline_id_without_pipe_keyword(&argc, &argv, &id) != NO_ERROR) {
+        return EINVAL;
+    }
+
+    if (argc < 1) {
+        fprintf(stderr, "expected path to the ELF file\n");
+        return EINVAL;
+    }
+    if (argc > 1) {
+        fprintf(stderr, "too many arguments\n");
+        return EINVAL;
+    }
+
+    char *file = *argv;
+
+    nikss_context_t ctx;
+    nikss_context_init(&ctx);
+    nikss_context_set_pipeline(&ctx, id);
+
+    if (!nikss_pipeline_exists(&ctx)) {
+        fprintf(stderr, "pipeline with given id %u does not exist\n", id);
+        nikss_context_free(&ctx);
+        return ENOENT;
+    }
+
+    int ret = nikss_pipeline_replace(&ctx, file);
+    if (ret) {
+        fprintf(stdout, "An error occurred during pipeline replace id %u\n", id);
+        nikss_context_free(&ctx);
+        return ret;
+    }
+
+    fprintf(stdout, "Pipeline id %u successfully replaced!\n", id);
     nikss_context_free(&ctx);
     return NO_ERROR;
 }
@@ -206,10 +345,56 @@ static int parse_interface(int *argc, char ***argv, const char **interface)
     return NO_ERROR;
 }
 
+static bool is_interface_pattern(const char *name)
+{
+    return strpbrk(name, "*?[") != NULL;
+}
+
+/* Expands glob patterns into names of existing interfaces */
+static int collect_interfaces(int argc, char **argv, const char ***interfaces, size_t *n_interfaces,
+                              struct if_nameindex **host_interfaces)
+{
+    *interfaces = malloc((size_t) argc * sizeof(const char *));
+    if (*interfaces == NULL) {
+        return ENOMEM;
+    }
+
+    for (int i = 0; i < argc; i++) {
+        if (!is_interface_pattern(argv[i])) {
+            (*interfaces)[(*n_interfaces)++] = argv[i];
+            continue;
+        }
+
+        if (*host_interfaces == NULL) {
+            *host_interfaces = if_nameindex();
+            if (*host_interfaces == NULL) {
+                return errno;
+            }
+        }
+
+        for (struct if_nameindex *iface = *host_interfaces; iface->if_index != 0; iface++) {
+            if (fnmatch(argv[i], iface->if_name, 0) != 0) {
+                continue;
+            }
+            const char **tmp = realloc(*interfaces, (*n_interfaces + (size_t) argc) * sizeof(const char *));
+            if (tmp == NULL) {
+                return ENOMEM;
+            }
+            *interfaces = tmp;
+            (*interfaces)[(*n_interfaces)++] = iface->if_name;
+        }
+    }
+
+    return NO_ERROR;
+}
+
 int do_pipeline_port_add(int argc, char **argv)
 {
     int ret = NO_ERROR;
-    const char *intf = NULL;
+    const char **interfaces = NULL;
+    size_t n_interfaces = 0;
+    struct if_nameindex *host_interfaces = NULL;
+    int *port_ids = NULL;
     nikss_context_t ctx;
     nikss_context_init(&ctx);
 
@@ -217,25 +402,67 @@ int do_pipeline_port_add(int argc, char **argv)
         goto err;
     }
 
-    if ((ret = parse_interface(&argc, &argv, &intf)) != NO_ERROR) {
+    /* dev DEV [DEV ...], where DEV may be a glob pattern */
+    if (!is_keyword(*argv, "dev")) {
+        fprintf(stderr, "expected 'dev', got: %s\n", *argv != NULL ? *argv : "");
+        ret = EINVAL;
         goto err;
     }
-
-    if (argc != 0) {
-        fprintf(stderr, "too many arguments\n");
+    NEXT_ARG();
+    if (argc < 1) {
+        fprintf(stderr, "expected interface name\n");
         ret = EINVAL;
         goto err;
     }
+    bool single_port = argc == 1 && !is_interface_pattern(*argv);
 
-    int ifindex = 0;
-    ret = nikss_pipeline_add_port(&ctx, intf, &ifindex);
+    ret = collect_interfaces(argc, argv, &interfaces, &n_interfaces, &host_interfaces);
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to get interfaces: %s\n", strerror(ret));
+        goto err;
+    }
+    if (n_interfaces == 0) {
+        fprintf(stderr, "no interface matches given name(s)\n");
+        ret = ENODEV;
+        goto err;
+    }
+
+    port_ids = calloc(n_interfaces, sizeof(int));
+    if (port_ids == NULL) {
+        ret = ENOMEM;
+        goto err;
+    }
+
+    ret = nikss_pipeline_add_ports(&ctx, interfaces, n_interfaces, port_ids);
     if (ret) {
         fprintf(stderr, "failed to add port: %s\n", strerror(ret));
+    }
+
+    if (single_port) {
+        if (ret == NO_ERROR) {
+            print_port(interfaces[0], port_ids[0]);
+        }
     } else {
-        print_port(intf, ifindex);
+        json_t *root = json_array();
+        for (size_t i = 0; i < n_interfaces; i++) {
+            if (port_ids[i] != 0) {
+                json_array_append_new(root, json_port_entry(interfaces[i], port_ids[i]));
+            }
+        }
+        json_dumpf(root, stdout, JSON_INDENT(4) | JSON_ENSURE_ASCII);
+        json_decref(root);
     }
 
 err:
+    if (port_ids != NULL) {
+        free(port_ids);
+    }
+    if (interfaces != NULL) {
+        free(interfaces);
+    }
+    if (host_interfaces != NULL) {
+        if_freenameindex(host_interfaces);
+    }
     nikss_context_free(&ctx);
     return ret;
 }
@@ -301,15 +528,499 @@ int do_pipeline_show(int argc, char **argv)
     return ret_code;
 }
 
+static uint64_t monotonic_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static const nikss_pipeline_prog_stats_t *find_prog_stats(const nikss_pipeline_stats_t *stats,
+                                                          const nikss_pipeline_prog_stats_t *prog)
+{
+    for (size_t i = 0; i < stats->n_progs; i++) {
+        if (stats->progs[i].prog_id == prog->prog_id) {
+            return &stats->progs[i];
+        }
+    }
+    return NULL;
+}
+
+/* When previous is NULL cumulative values are printed, otherwise rates since the previous sample */
+static int print_pipeline_stats(nikss_context_t *ctx, const nikss_pipeline_stats_t *stats,
+                                const nikss_pipeline_stats_t *previous, uint64_t elapsed_ns)
+{
+    json_t *root = json_object();
+    json_t *pipeline = json_object();
+    json_t *programs = json_object();
+
+    if (root == NULL || pipeline == NULL || programs == NULL) {
+        fprintf(stderr, "failed to prepare JSON\n");
+        json_decref(root);
+        json_decref(pipeline);
+        json_decref(programs);
+        return ENOMEM;
+    }
+
+    json_object_set_new(root, "pipeline", pipeline);
+    json_object_set_new(pipeline, "id", json_integer(nikss_context_get_pipeline(ctx)));
+    if (previous == NULL) {
+        json_object_set_new(pipeline, "stats_enabled", json_boolean(nikss_pipeline_stats_enabled_by_sysctl()));
+    } else {
+        json_object_set_new(pipeline, "interval_ms", json_real((double) elapsed_ns / 1e6));
+    }
+    json_object_set_new(pipeline, "programs", programs);
+
+    for (size_t i = 0; i < stats->n_progs; i++) {
+        const nikss_pipeline_prog_stats_t *prog = &stats->progs[i];
+        uint64_t run_cnt = prog->run_cnt;
+        uint64_t run_time_ns = prog->run_time_ns;
+        uint64_t recursion_misses = prog->recursion_misses;
+        json_t *entry = json_object();
+
+        if (previous != NULL) {
+            /* Program replaced in the meantime is counted from zero */
+            const nikss_pipeline_prog_stats_t *prev = find_prog_stats(previous, prog);
+            if (prev != NULL) {
+                run_cnt -= prev->run_cnt;
+                run_time_ns -= prev->run_time_ns;
+                recursion_misses -= prev->recursion_misses;
+            }
+        }
+
+        json_object_set_new(entry, "prog_id", json_integer(prog->prog_id));
+        json_object_set_new(entry, "run_cnt", json_integer((json_int_t) run_cnt));
+        json_object_set_new(entry, "run_time_ns", json_integer((json_int_t) run_time_ns));
+        json_object_set_new(entry, "ns_per_packet",
+                            json_real(run_cnt > 0 ? (double) run_time_ns / (double) run_cnt : 0));
+        if (previous != NULL) {
+            json_object_set_new(entry, "packets_per_sec",
+                                json_real(elapsed_ns > 0 ? (double) run_cnt * 1e9 / (double) elapsed_ns : 0));
+        }
+        json_object_set_new(entry, "recursion_misses", json_integer((json_int_t) recursion_misses));
+        json_object_set_new(programs, prog->name, entry);
+    }
+
+    json_dumpf(root, stdout, ndjson_output ? JSON_COMPACT : (JSON_INDENT(4) | JSON_ENSURE_ASCII));
+    fprintf(stdout, "\n");
+    fflush(stdout);
+    json_decref(root);
+
+    return NO_ERROR;
+}
+
+static int parse_stats_options(int *argc, char ***argv, unsigned long *interval_ms, unsigned long *count)
+{
+    while (*argc > 0) {
+        char *ptr = NULL;
+        if (is_keyword(**argv, "interval")) {
+            NEXT_ARGP_RET();
+            *interval_ms = strtoul(**argv, &ptr, 0);
+        } else if (is_keyword(**argv, "count")) {
+            NEXT_ARGP_RET();
+            *count = strtoul(**argv, &ptr, 0);
+        } else {
+            fprintf(stderr, "%s: unused argument\n", **argv);
+            return EINVAL;
+        }
+
+        if (ptr == NULL || *ptr != '\0') {
+            fprintf(stderr, "%s: unable to parse as a number\n", **argv);
+            return EINVAL;
+        }
+        NEXT_ARGP();
+    }
+
+    return check_sample_count(*interval_ms, *count);
+}
+
+int do_pipeline_stats(int argc, char **argv)
+{
+    nikss_context_t ctx;
+    nikss_pipeline_stats_t stats[2];
+    unsigned long interval_ms = 0;
+    unsigned long count = 0;
+    int stats_fd = -1;
+    int ret = EINVAL;
+    uint32_t id = 0;
+
+    if (parse_pipeline_id_without_pipe_keyword(&argc, &argv, &id) != NO_ERROR) {
+        return EINVAL;
+    }
+    if (parse_stats_options(&argc, &argv, &interval_ms, &count) != NO_ERROR) {
+        return EINVAL;
+    }
+
+    nikss_context_init(&ctx);
+    nikss_context_set_pipeline(&ctx, id);
+
+    if (!nikss_pipeline_exists(&ctx)) {
+        fprintf(stderr, "pipeline with given id %u does not exist or is inaccessible\n", id);
+        ret = ENOENT;
+        goto clean_up;
+    }
+
+    /* Without interval only cumulative values are printed */
+    if (interval_ms == 0) {
+        ret = nikss_pipeline_get_stats(&ctx, &stats[0]);
+        if (ret == NO_ERROR) {
+            ret = print_pipeline_stats(&ctx, &stats[0], NULL, 0);
+        }
+        goto clean_up;
+    }
+
+    /* Statistics are collected as long as this file descriptor is open */
+    stats_fd = nikss_pipeline_stats_enable();
+    if (stats_fd < 0) {
+        ret = -stats_fd;
+        goto clean_up;
+    }
+
+    struct timespec delay = {
+        .tv_sec = (time_t) (interval_ms / 1000),
+        .tv_nsec = (long) (interval_ms % 1000) * 1000000L,
+    };
+
+    ret = nikss_pipeline_get_stats(&ctx, &stats[0]);
+    uint64_t last_sample_ns = monotonic_time_ns();
+    for (unsigned long i = 0; ret == NO_ERROR && (count == 0 || i < count); i++) {
+        nikss_pipeline_stats_t *previous = &stats[i % 2];
+        nikss_pipeline_stats_t *current = &stats[(i + 1) % 2];
+
+        nanosleep(&delay, NULL);
+        ret = nikss_pipeline_get_stats(&ctx, current);
+        if (ret != NO_ERROR) {
+            break;
+        }
+        uint64_t now = monotonic_time_ns();
+        ret = print_pipeline_stats(&ctx, current, previous, now - last_sample_ns);
+        last_sample_ns = now;
+    }
+
+clean_up:
+    if (stats_fd >= 0) {
+        nikss_pipeline_stats_disable(stats_fd);
+    }
+    nikss_context_free(&ctx);
+
+    return ret;
+}
+
+static int print_cpumap(nikss_context_t *ctx)
+{
+    uint32_t n_cpus = nikss_pipeline_cpumap_size(ctx);
+    json_t *root = json_object();
+    json_t *pipeline = json_object();
+    json_t *cpus = json_object();
+    int ret = NO_ERROR;
+
+    if (root == NULL || pipeline == NULL || cpus == NULL) {
+        fprintf(stderr, "failed to prepare JSON\n");
+        json_decref(root);
+        json_decref(pipeline);
+        json_decref(cpus);
+        return ENOMEM;
+    }
+
+    json_object_set_new(root, "pipeline", pipeline);
+    json_object_set_new(pipeline, "id", json_integer(nikss_context_get_pipeline(ctx)));
+    json_object_set_new(pipeline, "cpumap", cpus);
+
+    for (uint32_t cpu = 0; cpu < n_cpus; cpu++) {
+        nikss_cpumap_entry_t entry;
+        ret = nikss_pipeline_cpumap_get(ctx, cpu, &entry);
+        if (ret != NO_ERROR) {
+            break;
+        }
+        /* CPUs which were never a redirect target */
+        if (entry.qsize == 0 && entry.enqueued == 0 && entry.received == 0) {
+            continue;
+        }
+
+        char cpu_str[16];
+        snprintf(cpu_str, sizeof(cpu_str), "%u", cpu);
+        json_t *cpu_entry = json_object();
+        json_object_set_new(cpu_entry, "qsize", json_integer(entry.qsize));
+        json_object_set_new(cpu_entry, "enqueued", json_integer((json_int_t) entry.enqueued));
+        json_object_set_new(cpu_entry, "received", json_integer((json_int_t) entry.received));
+        json_object_set_new(cpu_entry, "dropped", json_integer((json_int_t) entry.dropped));
+        json_object_set_new(cpus, cpu_str, cpu_entry);
+    }
+
+    if (ret == NO_ERROR) {
+        json_dumpf(root, stdout, ndjson_output ? JSON_COMPACT : (JSON_INDENT(4) | JSON_ENSURE_ASCII));
+        fprintf(stdout, "\n");
+    }
+    json_decref(root);
+
+    return ret;
+}
+
+/* pipeline cpumap id ID [set cpu CPU qsize N | del cpu CPU] */
+int do_pipeline_cpumap(int argc, char **argv)
+{
+    uint32_t id = 0;
+    uint32_t cpu = 0;
+    uint32_t qsize = 0;
+    bool show = true;
+
+    if (parse_pipeline_id_without_pipe_keyword(&argc, &argv, &id) != NO_ERROR) {
+        return EINVAL;
+    }
+
+    if (argc > 0 && (is_keyword(*argv, "set") || is_keyword(*argv, "del"))) {
+        bool is_set = is_keyword(*argv, "set");
+        show = false;
+        NEXT_ARG_RET();
+        if (!is_keyword(*argv, "cpu")) {
+            fprintf(stderr, "expected 'cpu', got: %s\n", *argv);
+            return EINVAL;
+        }
+        NEXT_ARG_RET();
+        if (parse_uint32_arg(*argv, "a CPU", &cpu) != NO_ERROR) {
+            return EINVAL;
+        }
+        NEXT_ARG();
+        if (is_set) {
+            if (argc < 1 || !is_keyword(*argv, "qsize")) {
+                fprintf(stderr, "expected 'qsize'\n");
+                return EINVAL;
+            }
+            NEXT_ARG_RET();
+            if (parse_uint32_arg(*argv, "a queue size", &qsize) != NO_ERROR || qsize == 0) {
+                return EINVAL;
+            }
+            NEXT_ARG();
+        }
+    }
+    if (argc > 0) {
+        fprintf(stderr, "%s: unused argument\n", *argv);
+        return EINVAL;
+    }
+
+    nikss_context_t ctx;
+    nikss_context_init(&ctx);
+    nikss_context_set_pipeline(&ctx, id);
+
+    int ret = NO_ERROR;
+    if (!nikss_pipeline_exists(&ctx)) {
+        fprintf(stderr, "pipeline with given id %u does not exist or is inaccessible\n", id);
+        ret = ENOENT;
+    } else if (nikss_pipeline_cpumap_size(&ctx) == 0) {
+        fprintf(stderr, "pipeline id %u has no CPUMAP\n", id);
+        ret = ENOTSUP;
+    } else if (show) {
+        ret = print_cpumap(&ctx);
+    } else {
+        ret = nikss_pipeline_cpumap_set(&ctx, cpu, qsize);
+    }
+
+    nikss_context_free(&ctx);
+    return ret;
+}
+
+/* Output of a single object, rendered by a worker thread */
+struct dump_buffer {
+    char *data;
+    size_t size;
+};
+
+struct dump_output {
+    size_t n_emitted;
+    int first_error;
+};
+
+typedef int (*dump_object_func_t)(nikss_context_t *nikss_ctx, const char *name, FILE *out);
+
+static int read_dump_object(nikss_context_t *ctx, nikss_pipeline_dump_object_t *obj, void *arg)
+{
+    (void) arg;
+    dump_object_func_t dump = NULL;
+
+    switch (obj->type) {
+        case NIKSS_PIPELINE_OBJECT_TABLE:
+            dump = dump_table;
+            break;
+        case NIKSS_PIPELINE_OBJECT_ACTION_SELECTOR:
+            dump = dump_action_selector;
+            break;
+        case NIKSS_PIPELINE_OBJECT_COUNTER:
+            dump = dump_counter;
+            break;
+        case NIKSS_PIPELINE_OBJECT_METER:
+            dump = dump_meter;
+            break;
+        case NIKSS_PIPELINE_OBJECT_REGISTER:
+            dump = dump_register;
+            break;
+        default:
+            /* Reading of digests removes them from the queue, so they are skipped as unknown objects */
+            return NO_ERROR;
+    }
+
+    struct dump_buffer *buffer = calloc(1, sizeof(struct dump_buffer));
+    if (buffer == NULL) {
+        return ENOMEM;
+    }
+    FILE *out = open_memstream(&buffer->data, &buffer->size);
+    if (out == NULL) {
+        int err = errno;
+        free(buffer);
+        return err;
+    }
+
+    int ret = dump(ctx, obj->name, out);
+    fclose(out);
+    obj->data = buffer;
+
+    return ret;
+}
+
+static void print_dump_buffer(const struct dump_buffer *buffer)
+{
+    size_t size = buffer->size;
+    while (size > 0 && (buffer->data[size - 1] == '\n' || buffer->data[size - 1] == ' ')) {
+        --size;
+    }
+
+    if (ndjson_output) {
+        fwrite(buffer->data, 1, size, stdout);
+        fputc('\n', stdout);
+        return;
+    }
+
+    /* Every object is a complete JSON document, so only indent it as element of the array */
+    fputs("\n    ", stdout);
+    for (size_t i = 0; i < size; i++) {
+        fputc(buffer->data[i], stdout);
+        if (buffer->data[i] == '\n') {
+            fputs("    ", stdout);
+        }
+    }
+}
+
+static int emit_dump_object(nikss_pipeline_dump_object_t *obj, void *arg)
+{
+    struct dump_output *output = arg;
+    struct dump_buffer *buffer = obj->data;
+
+    if (obj->error != NO_ERROR && obj->error != ECANCELED) {
+        fprintf(stderr, "failed to dump %s %s: %s\n",
+                nikss_pipeline_object_type_to_str(obj->type), obj->name, strerror(obj->error));
+        if (output->first_error == NO_ERROR) {
+            output->first_error = obj->error;
+        }
+    }
+
+    if (buffer != NULL && obj->error == NO_ERROR) {
+        if (ndjson_output) {
+            /* Entries are printed as separate lines, so tell to which object they belong */
+            json_t *header = json_object();
+            json_object_set_new(header, "object", json_string(obj->name));
+            json_object_set_new(header, "type", json_string(nikss_pipeline_object_type_to_str(obj->type)));
+            json_dumpf(header, stdout, JSON_COMPACT | JSON_ENSURE_ASCII);
+            fputc('\n', stdout);
+            json_decref(header);
+        } else if (output->n_emitted > 0) {
+            fputc(',', stdout);
+        }
+        print_dump_buffer(buffer);
+        output->n_emitted++;
+    }
+
+    if (buffer != NULL) {
+        free(buffer->data);
+        free(buffer);
+        obj->data = NULL;
+    }
+
+    /* Keep going, dump should contain as much as possible */
+    return NO_ERROR;
+}
+
+int do_pipeline_dump(int argc, char **argv)
+{
+    nikss_context_t ctx;
+    struct dump_output output = { 0 };
+    unsigned long threads = 1;
+    uint32_t id = 0;
+
+    if (parse_pipeline_id_without_pipe_keyword(&argc, &argv, &id) != NO_ERROR) {
+        return EINVAL;
+    }
+
+    if (argc >= 1 && is_keyword(*argv, "threads")) {
+        NEXT_ARG();
+        if (argc < 1) {
+            fprintf(stderr, "expected number of threads\n");
+            return EINVAL;
+        }
+        char *ptr = NULL;
+        threads = strtoul(*argv, &ptr, 0);
+        if (*ptr) {
+            fprintf(stderr, "%s: unable to parse as a number of threads\n", *argv);
+            return EINVAL;
+        }
+        NEXT_ARG();
+    }
+
+    if (argc > 0) {
+        fprintf(stderr, "%s: unused argument\n", *argv);
+        return EINVAL;
+    }
+
+    nikss_context_init(&ctx);
+    nikss_context_set_pipeline(&ctx, id);
+
+    if (!nikss_pipeline_exists(&ctx)) {
+        fprintf(stderr, "pipeline with given id %u does not exist or is inaccessible\n", id);
+        nikss_context_free(&ctx);
+        return ENOENT;
+    }
+
+    if (!ndjson_output) {
+        fputc('[', stdout);
+    }
+    int ret = nikss_pipeline_dump(&ctx, (unsigned) threads, read_dump_object, emit_dump_object, &output);
+    if (!ndjson_output) {
+        fputs(output.n_emitted > 0 ? "\n]\n" : "]\n", stdout);
+    }
+
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to dump pipeline: %s\n", strerror(ret));
+    } else {
+        ret = output.first_error;
+    }
+
+    nikss_context_free(&ctx);
+    return ret;
+}
+
 int do_pipeline_help(int argc, char **argv)
 {
     (void) argc; (void) argv;
     fprintf(stderr,
-            "Usage: %1$s pipeline load id ID PATH\n"
+            "Usage: %1$s pipeline load id ID PATH [timings] [map NAME [size N] [no-prealloc] [mmapable] [numa NODE]]...\n"
+            "       %1$s pipeline replace id ID PATH\n"
             "       %1$s pipeline unload id ID\n"
             "       %1$s pipeline show id ID\n"
-            "       %1$s add-port pipe id ID dev DEV\n"
+            "       %1$s pipeline stats id ID [interval MSEC] [count N]\n"
+            "       %1$s pipeline dump id ID [threads N]\n"
+            "       %1$s pipeline cpumap id ID [set cpu CPU qsize N | del cpu CPU]\n"
+            "       %1$s add-port pipe id ID dev DEV [DEV ...]\n"
             "       %1$s del-port pipe id ID dev DEV\n"
+            "\n"
+            "Stats print run time and number of runs of BPF programs of the pipeline. With interval,\n"
+            "statistics are enabled in the kernel and time per packet and packet rate are printed\n"
+            "every MSEC milliseconds, N times or until interrupted.\n"
+            "\n"
+            "Dump prints every table, action selector, counter, meter and register of the pipeline,\n"
+            "sorted by name, as an array of documents in format of their get commands (counters as\n"
+            "snapshot). Objects are read by N threads (1 by default). Digests are skipped, because\n"
+            "reading removes them.\n"
+            "\n"
+            "Cpumap configures queues of CPUs to which XDP pipeline redirects packets through its\n"
+            "CPUMAP. Without set or del, queue sizes and enqueue/drop counters of CPUs are printed.\n"
             "",
             program_name);
     return NO_ERROR;
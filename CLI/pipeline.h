@@ -22,16 +22,24 @@
 
 int do_pipeline_help(int argc, char **argv);
 int do_pipeline_load(int argc, char **argv);
+int do_pipeline_replace(int argc, char **argv);
 int do_pipeline_unload(int argc, char **argv);
 int do_pipeline_port_add(int argc, char **argv);
 int do_pipeline_port_del(int argc, char **argv);
 int do_pipeline_show(int argc, char **argv);
+int do_pipeline_stats(int argc, char **argv);
+int do_pipeline_dump(int argc, char **argv);
+int do_pipeline_cpumap(int argc, char **argv);
 
 static const struct cmd pipeline_cmds[] = {
         {"help",     do_pipeline_help },
         {"load",     do_pipeline_load },
+        {"replace",  do_pipeline_replace },
         {"unload",   do_pipeline_unload },
         {"show",     do_pipeline_show },
+        {"stats",    do_pipeline_stats },
+        {"dump",     do_pipeline_dump },
+        {"cpumap",   do_pipeline_cpumap },
         {0}
 };
 
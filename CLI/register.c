@@ -121,7 +121,7 @@ static int build_entry(nikss_register_context_t *ctx, nikss_register_entry_t *en
 }
 
 static int get_and_print_register_json(nikss_register_context_t *ctx, nikss_register_entry_t *entry,
-                                       const char *register_name, bool entry_has_index)
+                                       const char *register_name, bool entry_has_index, FILE *out)
 {
     int ret = NO_ERROR;
     json_t *root = json_object();
@@ -160,7 +160,7 @@ static int get_and_print_register_json(nikss_register_context_t *ctx, nikss_regi
         goto clean_up;
     }
 
-    json_dumpf(root, stdout, JSON_INDENT(4) | JSON_ENSURE_ASCII);
+    json_dumpf(root, out, ndjson_output ? JSON_COMPACT : (JSON_INDENT(4) | JSON_ENSURE_ASCII));
     ret = NO_ERROR;
 
 clean_up:
@@ -170,6 +170,25 @@ clean_up:
     return ret;
 }
 
+int dump_register(nikss_context_t *nikss_ctx, const char *register_name, FILE *out)
+{
+    nikss_register_context_t ctx;
+    nikss_register_entry_t entry;
+
+    nikss_register_ctx_init(&ctx);
+    nikss_register_entry_init(&entry);
+
+    int ret = nikss_register_ctx_name(nikss_ctx, &ctx, register_name);
+    if (ret == NO_ERROR) {
+        ret = get_and_print_register_json(&ctx, &entry, register_name, false, out);
+    }
+
+    nikss_register_entry_free(&entry);
+    nikss_register_ctx_free(&ctx);
+
+    return ret;
+}
+
 int do_register_get(int argc, char **argv)
 {
     int ret = EINVAL;
@@ -202,7 +221,7 @@ int do_register_get(int argc, char **argv)
         goto clean_up;
     }
 
-    ret = get_and_print_register_json(&ctx, &entry, register_name, register_index_provided);
+    ret = get_and_print_register_json(&ctx, &entry, register_name, register_index_provided, stdout);
 
 clean_up:
     nikss_register_entry_free(&entry);
@@ -20,6 +20,9 @@
 
 #include "common.h"
 
+/* Prints every register cell like `register get` does */
+int dump_register(nikss_context_t *nikss_ctx, const char *register_name, FILE *out);
+
 int do_register_get(int argc, char **argv);
 int do_register_set(int argc, char **argv);
 int do_register_help(int argc, char **argv);
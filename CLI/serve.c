@@ -0,0 +1,342 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <nikss/nikss.h>
+
+#include "serve.h"
+
+#define SERVE_MAX_ARGS 256
+/* Clients are served in turns, so one idle connection does not block the others */
+#define SERVE_MAX_CLIENTS 16
+#define SERVE_MAX_REQUEST_SIZE 65536
+
+typedef struct serve_client {
+    int fd;
+    size_t len;
+    char *buf;
+} serve_client_t;
+
+/* Runs command with its stdout and stderr redirected to the client */
+static int handle_request(int client_fd, char *line)
+{
+    char *argv[SERVE_MAX_ARGS];
+    int ret = 0;
+
+    fflush(stdout);
+    fflush(stderr);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int saved_stderr = dup(STDERR_FILENO);
+    if (saved_stdout < 0 || saved_stderr < 0) {
+        ret = errno;
+        goto clean_up;
+    }
+    dup2(client_fd, STDOUT_FILENO);
+    dup2(client_fd, STDERR_FILENO);
+
+    int argc = split_command_line(line, argv, SERVE_MAX_ARGS);
+    if (argc < 0) {
+        ret = EINVAL;
+    } else if (argc > 0 && is_keyword(argv[0], "serve")) {
+        fprintf(stderr, "server is already running\n");
+        ret = EINVAL;
+    } else if (argc > 0 && is_keyword(argv[0], "batch")) {
+        /* Batch would read commands from standard input of the server */
+        fprintf(stderr, "batch: command not allowed in serve, send commands one by one\n");
+        ret = EINVAL;
+    } else if (argc > 0) {
+        context_cache_begin_request();
+        /* Pipeline commands load, replace and unload objects, so cached contexts are opened again */
+        bool is_pipeline_command = is_keyword(argv[0], "pipeline");
+        if (is_pipeline_command) {
+            context_cache_invalidate();
+        }
+        ret = run_nikssctl_command(argc, argv);
+        if (is_pipeline_command) {
+            context_cache_invalidate();
+        }
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_stdout, STDOUT_FILENO);
+    dup2(saved_stderr, STDERR_FILENO);
+
+clean_up:
+    if (saved_stdout >= 0) {
+        close(saved_stdout);
+    }
+    if (saved_stderr >= 0) {
+        close(saved_stderr);
+    }
+
+    return ret;
+}
+
+static bool send_status(int client_fd, int ret)
+{
+    /* End of response: NUL byte and exit code of the command */
+    char status[32];
+    int len = snprintf(status, sizeof(status), "%c%d\n", '\0', ret);
+    return write(client_fd, status, len) == len;
+}
+
+static void close_client(serve_client_t *client)
+{
+    close(client->fd);
+    client->fd = -1;
+    free(client->buf);
+    client->buf = NULL;
+    client->len = 0;
+}
+
+/* Executes every complete request received from the client, returns false when connection has to be closed */
+static bool handle_client_data(serve_client_t *client)
+{
+    ssize_t n_read = read(client->fd, client->buf + client->len, SERVE_MAX_REQUEST_SIZE - client->len);
+    if (n_read < 0 && errno == EINTR) {
+        return true;
+    }
+    if (n_read <= 0) {
+        return false;
+    }
+    client->len += (size_t) n_read;
+
+    char *line = client->buf;
+    char *end = NULL;
+    while ((end = memchr(line, '\n', client->len - (size_t) (line - client->buf))) != NULL) {
+        *end = '\0';
+        if (!send_status(client->fd, handle_request(client->fd, line))) {
+            return false;
+        }
+        line = end + 1;
+    }
+
+    client->len -= (size_t) (line - client->buf);
+    memmove(client->buf, line, client->len);
+    if (client->len == SERVE_MAX_REQUEST_SIZE) {
+        dprintf(client->fd, "request too long\n");
+        send_status(client->fd, E2BIG);
+        return false;
+    }
+
+    return true;
+}
+
+static void accept_client(int server_fd, serve_client_t *clients)
+{
+    int client_fd = accept(server_fd, NULL, NULL);
+    if (client_fd < 0) {
+        if (errno != EINTR) {
+            fprintf(stderr, "failed to accept connection: %s\n", strerror(errno));
+        }
+        return;
+    }
+
+    for (int i = 0; i < SERVE_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0) {
+            continue;
+        }
+        clients[i].buf = malloc(SERVE_MAX_REQUEST_SIZE);
+        if (clients[i].buf == NULL) {
+            break;
+        }
+        clients[i].fd = client_fd;
+        clients[i].len = 0;
+        return;
+    }
+
+    dprintf(client_fd, "too many clients\n");
+    send_status(client_fd, EBUSY);
+    close(client_fd);
+}
+
+/* Only socket is removed, so a mistyped path never deletes other files */
+static int remove_stale_socket(const char *path)
+{
+    struct stat path_stat;
+    if (lstat(path, &path_stat) != 0) {
+        return errno == ENOENT ? NO_ERROR : errno;
+    }
+    if (!S_ISSOCK(path_stat.st_mode)) {
+        return EEXIST;
+    }
+    if (unlink(path) != 0) {
+        return errno;
+    }
+
+    return NO_ERROR;
+}
+
+/* Socket created by this process is described by socket_stat, it is used to remove only that socket on exit */
+static int open_server_socket(const char *path, struct stat *socket_stat)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        return -1;
+    }
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        fprintf(stderr, "failed to create socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    /* Remove socket left by previous instance */
+    int err = remove_stale_socket(path);
+    if (err != NO_ERROR) {
+        fprintf(stderr, "%s: unable to replace existing file: %s\n", path, strerror(err));
+        close(fd);
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+        fprintf(stderr, "failed to listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if (lstat(path, socket_stat) != 0) {
+        memset(socket_stat, 0, sizeof(*socket_stat));
+    }
+
+    return fd;
+}
+
+static void remove_server_socket(const char *path, const struct stat *socket_stat)
+{
+    struct stat path_stat;
+
+    /* Another instance might have replaced the socket in the meantime */
+    if (lstat(path, &path_stat) == 0 && S_ISSOCK(path_stat.st_mode) &&
+        path_stat.st_dev == socket_stat->st_dev && path_stat.st_ino == socket_stat->st_ino) {
+        unlink(path);
+    }
+}
+
+int do_serve(int argc, char **argv)
+{
+    const char *socket_path = NIKSSCTL_DEFAULT_SOCKET;
+
+    if (argc > 0 && is_keyword(*argv, "help")) {
+        return do_serve_help(argc, argv);
+    }
+    if (argc > 0 && is_keyword(*argv, "socket")) {
+        NEXT_ARG_RET();
+        socket_path = *argv;
+        NEXT_ARG();
+    }
+    if (argc > 0) {
+        fprintf(stderr, "%s: unused argument\n", *argv);
+        return EINVAL;
+    }
+
+    struct stat socket_stat;
+    int server_fd = open_server_socket(socket_path, &socket_stat);
+    if (server_fd < 0) {
+        return EPERM;
+    }
+
+    /* Client might disconnect before its response is sent */
+    signal(SIGPIPE, SIG_IGN);
+
+    /* Parsed BTF is the most expensive part of opening objects, so keep it between requests;
+     * opened tables and counters are kept as well, as long as their pipeline is not reloaded */
+    nikss_btf_cache_enable(true);
+    context_cache_enable(true);
+    non_interactive = true;
+
+    serve_client_t clients[SERVE_MAX_CLIENTS];
+    for (int i = 0; i < SERVE_MAX_CLIENTS; i++) {
+        clients[i].fd = -1;
+        clients[i].buf = NULL;
+        clients[i].len = 0;
+    }
+
+    fprintf(stderr, "listening on %s\n", socket_path);
+    while (true) {
+        struct pollfd fds[SERVE_MAX_CLIENTS + 1];
+        fds[0].fd = server_fd;
+        fds[0].events = POLLIN;
+        for (int i = 0; i < SERVE_MAX_CLIENTS; i++) {
+            /* Negative descriptors are ignored by poll() */
+            fds[i + 1].fd = clients[i].fd;
+            fds[i + 1].events = POLLIN;
+        }
+
+        if (poll(fds, SERVE_MAX_CLIENTS + 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "failed to wait for clients: %s\n", strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < SERVE_MAX_CLIENTS; i++) {
+            if (clients[i].fd >= 0 && (fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)) != 0 &&
+                !handle_client_data(&clients[i])) {
+                close_client(&clients[i]);
+            }
+        }
+        if ((fds[0].revents & POLLIN) != 0) {
+            accept_client(server_fd, clients);
+        }
+    }
+
+    for (int i = 0; i < SERVE_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0) {
+            close_client(&clients[i]);
+        }
+    }
+    context_cache_enable(false);
+    nikss_btf_cache_enable(false);
+    non_interactive = false;
+    close(server_fd);
+    remove_server_socket(socket_path, &socket_stat);
+
+    return EPERM;
+}
+
+int do_serve_help(int argc, char **argv)
+{
+    (void) argc; (void) argv;
+
+    fprintf(stderr,
+            "Usage: %1$s serve [socket PATH]\n"
+            "\n"
+            "Listens on Unix socket (default: %2$s) and executes commands sent by clients.\n"
+            "Every request is a single line with arguments the same as for %1$s, e.g.\n"
+            "\"table get pipe 1 ingress_tbl\". Response is the output of the command\n"
+            "followed by NUL byte and exit code of the command in a separate line.\n"
+            "Up to %3$d clients are connected at once, their commands are executed one at a time.\n"
+            "",
+            program_name, NIKSSCTL_DEFAULT_SOCKET, SERVE_MAX_CLIENTS);
+
+    return 0;
+}
@@ -0,0 +1,31 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __NIKSSCTL_SERVE_H
+#define __NIKSSCTL_SERVE_H
+
+#include "common.h"
+
+#define NIKSSCTL_DEFAULT_SOCKET "/var/run/nikss-ctl.sock"
+
+/* Executes single command line, the same as when it is passed to nikss-ctl (implemented in main.c) */
+int run_nikssctl_command(int argc, char **argv);
+
+int do_serve(int argc, char **argv);
+int do_serve_help(int argc, char **argv);
+
+#endif  /* __NIKSSCTL_SERVE_H */
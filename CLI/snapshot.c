@@ -0,0 +1,199 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nikss/nikss_snapshot.h>
+
+#include "snapshot.h"
+
+static int parse_snapshot_file(int *argc, char ***argv, const char **path)
+{
+    if (*argc < 2 || !is_keyword(**argv, "file")) {
+        fprintf(stderr, "expected 'file' keyword\n");
+        return EINVAL;
+    }
+    NEXT_ARGP();
+    *path = **argv;
+    NEXT_ARGP();
+
+    return NO_ERROR;
+}
+
+int do_snapshot_export(int argc, char **argv)
+{
+    nikss_context_t nikss_ctx;
+    const char *path = NULL;
+    int ret = EINVAL;
+
+    nikss_context_init(&nikss_ctx);
+
+    if (parse_pipeline_id(&argc, &argv, &nikss_ctx) != NO_ERROR) {
+        goto clean_up;
+    }
+    if (parse_snapshot_file(&argc, &argv, &path) != NO_ERROR) {
+        goto clean_up;
+    }
+    if (argc > 0) {
+        fprintf(stderr, "%s: unused argument\n", *argv);
+        goto clean_up;
+    }
+
+    ret = nikss_snapshot_export(&nikss_ctx, path);
+
+clean_up:
+    nikss_context_free(&nikss_ctx);
+
+    return ret;
+}
+
+int do_snapshot_import(int argc, char **argv)
+{
+    nikss_context_t nikss_ctx;
+    nikss_snapshot_t snapshot;
+    const char *path = NULL;
+    int ret = EINVAL;
+
+    nikss_context_init(&nikss_ctx);
+    nikss_snapshot_init(&snapshot);
+
+    if (parse_pipeline_id(&argc, &argv, &nikss_ctx) != NO_ERROR) {
+        goto clean_up;
+    }
+    if (parse_snapshot_file(&argc, &argv, &path) != NO_ERROR) {
+        goto clean_up;
+    }
+    if (argc > 0) {
+        fprintf(stderr, "%s: unused argument\n", *argv);
+        goto clean_up;
+    }
+
+    ret = nikss_snapshot_open(&snapshot, path);
+    if (ret == NO_ERROR) {
+        ret = nikss_snapshot_import(&nikss_ctx, &snapshot);
+    }
+
+clean_up:
+    nikss_snapshot_close(&snapshot);
+    nikss_context_free(&nikss_ctx);
+
+    return ret;
+}
+
+static json_t *create_json_raw_data(const void *data, size_t len)
+{
+    char *str = convert_bin_data_to_hexstr(data, len);
+    if (str == NULL) {
+        return NULL;
+    }
+    json_t *json = json_string(str);
+    free(str);
+
+    return json;
+}
+
+static int print_snapshot_diff_entry(const nikss_snapshot_diff_entry_t *entry, void *arg)
+{
+    json_stream_t *stream = arg;
+    const char *change = "changed";
+    if (entry->type == NIKSS_SNAPSHOT_ENTRY_ADDED) {
+        change = "added";
+    } else if (entry->type == NIKSS_SNAPSHOT_ENTRY_REMOVED) {
+        change = "removed";
+    }
+
+    json_t *root = json_object();
+    if (root == NULL) {
+        return ENOMEM;
+    }
+    json_object_set_new(root, "map", json_string(entry->map_name));
+    json_object_set_new(root, "change", json_string(change));
+    json_object_set_new(root, "key", create_json_raw_data(entry->key, entry->key_size));
+    if (entry->old_value != NULL) {
+        json_object_set_new(root, "old_value", create_json_raw_data(entry->old_value, entry->old_value_size));
+    }
+    if (entry->new_value != NULL) {
+        json_object_set_new(root, "new_value", create_json_raw_data(entry->new_value, entry->new_value_size));
+    }
+
+    return json_stream_add(stream, NULL, root);
+}
+
+int do_snapshot_diff(int argc, char **argv)
+{
+    nikss_snapshot_t old_snapshot;
+    nikss_snapshot_t new_snapshot;
+    const char *old_path = NULL;
+    const char *new_path = NULL;
+    int ret = EINVAL;
+
+    nikss_snapshot_init(&old_snapshot);
+    nikss_snapshot_init(&new_snapshot);
+
+    if (parse_snapshot_file(&argc, &argv, &old_path) != NO_ERROR) {
+        goto clean_up;
+    }
+    if (parse_snapshot_file(&argc, &argv, &new_path) != NO_ERROR) {
+        goto clean_up;
+    }
+    if (argc > 0) {
+        fprintf(stderr, "%s: unused argument\n", *argv);
+        goto clean_up;
+    }
+
+    if ((ret = nikss_snapshot_open(&old_snapshot, old_path)) != NO_ERROR) {
+        goto clean_up;
+    }
+    if ((ret = nikss_snapshot_open(&new_snapshot, new_path)) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    json_stream_t stream;
+    json_stream_init(&stream, stdout, ndjson_output);
+    json_stream_open_object(&stream, NULL);
+    json_stream_open_array(&stream, "diff");
+    ret = nikss_snapshot_diff(&old_snapshot, &new_snapshot, print_snapshot_diff_entry, &stream);
+    json_stream_close(&stream);
+    json_stream_close(&stream);
+
+clean_up:
+    nikss_snapshot_close(&old_snapshot);
+    nikss_snapshot_close(&new_snapshot);
+
+    return ret;
+}
+
+int do_snapshot_help(int argc, char **argv)
+{
+    (void) argc; (void) argv;
+
+    fprintf(stderr,
+            "Usage: %1$s snapshot export pipe ID file PATH\n"
+            "       %1$s snapshot import pipe ID file PATH\n"
+            "       %1$s snapshot diff file OLD_PATH file NEW_PATH\n"
+            "\n"
+            "Snapshot is a binary file with raw content of maps holding state of the pipeline\n"
+            "(tables, counters, meters, registers, groups etc.). Import restores the state, so\n"
+            "entries missing in the snapshot are removed. Diff prints changed entries as raw data.\n"
+            "",
+            program_name);
+
+    return 0;
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __NIKSSCTL_SNAPSHOT_H
+#define __NIKSSCTL_SNAPSHOT_H
+
+#include "common.h"
+
+int do_snapshot_export(int argc, char **argv);
+int do_snapshot_import(int argc, char **argv);
+int do_snapshot_diff(int argc, char **argv);
+int do_snapshot_help(int argc, char **argv);
+
+static const struct cmd snapshot_cmds[] = {
+        {"help",   do_snapshot_help},
+        {"export", do_snapshot_export},
+        {"import", do_snapshot_import},
+        {"diff",   do_snapshot_diff},
+        {0}
+};
+
+#endif  /* __NIKSSCTL_SNAPSHOT_H */
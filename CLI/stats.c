@@ -0,0 +1,173 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <jansson.h>
+
+#include <nikss/nikss_stats.h>
+
+#include "serve.h"
+#include "stats.h"
+
+static json_t *create_json_op_counters(const nikss_stats_op_counters_t *counters)
+{
+    json_t *root = json_object();
+    json_t *histogram = json_object();
+    if (root == NULL || histogram == NULL) {
+        if (root != NULL) {
+            json_decref(root);
+        }
+        if (histogram != NULL) {
+            json_decref(histogram);
+        }
+        return NULL;
+    }
+
+    json_object_set_new(root, "calls", json_integer((json_int_t) counters->calls));
+    json_object_set_new(root, "errors", json_integer((json_int_t) counters->errors));
+    json_object_set_new(root, "total_ns", json_integer((json_int_t) counters->total_ns));
+    json_object_set_new(root, "mean_ns", json_integer((json_int_t) (counters->total_ns / counters->calls)));
+    json_object_set_new(root, "max_ns", json_integer((json_int_t) counters->max_ns));
+
+    /* Key is the lower bound of the bucket in ns, empty buckets are omitted */
+    for (unsigned i = 0; i < NIKSS_STATS_HISTOGRAM_BUCKETS; i++) {
+        if (counters->histogram[i] == 0) {
+            continue;
+        }
+        char bucket[32];
+        snprintf(bucket, sizeof(bucket), "%llu", i == 0 ? 0ULL : 1ULL << i);
+        json_object_set_new(histogram, bucket, json_integer((json_int_t) counters->histogram[i]));
+    }
+    json_object_set_new(root, "histogram_ns", histogram);
+
+    return root;
+}
+
+static int print_stats(FILE *out)
+{
+    nikss_stats_t stats;
+
+    if (!nikss_stats_available()) {
+        fprintf(stderr, "statistics are not available, library built without ENABLE_STATS\n");
+        return ENOTSUP;
+    }
+
+    int ret = nikss_stats_get(&stats);
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to read statistics: %s\n", strerror(ret));
+        return ret;
+    }
+
+    json_t *root = json_object();
+    if (root == NULL) {
+        fprintf(stderr, "failed to prepare JSON\n");
+        return ENOMEM;
+    }
+    for (int op = 0; op < NIKSS_STATS_N_OPS; op++) {
+        if (stats.ops[op].calls == 0) {
+            continue;
+        }
+        json_t *entry = create_json_op_counters(&stats.ops[op]);
+        if (entry == NULL) {
+            fprintf(stderr, "failed to prepare JSON\n");
+            json_decref(root);
+            return ENOMEM;
+        }
+        json_object_set_new(root, nikss_stats_op_name((nikss_stats_op_t) op), entry);
+    }
+
+    json_t *wrapper = json_object();
+    if (wrapper == NULL) {
+        json_decref(root);
+        return ENOMEM;
+    }
+    json_object_set_new(wrapper, "stats", root);
+    json_dumpf(wrapper, out, JSON_INDENT(4) | JSON_PRESERVE_ORDER);
+    fprintf(out, "\n");
+    json_decref(wrapper);
+
+    return NO_ERROR;
+}
+
+int do_stats_show(int argc, char **argv)
+{
+    if (argc > 0) {
+        fprintf(stderr, "%s: unused argument\n", *argv);
+        return EINVAL;
+    }
+
+    return print_stats(stdout);
+}
+
+int do_stats_reset(int argc, char **argv)
+{
+    if (argc > 0) {
+        fprintf(stderr, "%s: unused argument\n", *argv);
+        return EINVAL;
+    }
+
+    if (!nikss_stats_available()) {
+        fprintf(stderr, "statistics are not available, library built without ENABLE_STATS\n");
+        return ENOTSUP;
+    }
+    nikss_stats_reset();
+
+    return NO_ERROR;
+}
+
+int do_stats_run(int argc, char **argv)
+{
+    if (argc < 1) {
+        fprintf(stderr, "expected command\n");
+        return EINVAL;
+    }
+
+    if (!nikss_stats_available()) {
+        fprintf(stderr, "statistics are not available, library built without ENABLE_STATS\n");
+        return ENOTSUP;
+    }
+
+    nikss_stats_reset();
+    int ret = run_nikssctl_command(argc, argv);
+    fflush(stdout);
+    /* Output of the command stays untouched */
+    print_stats(stderr);
+
+    return ret;
+}
+
+int do_stats_help(int argc, char **argv)
+{
+    (void) argc; (void) argv;
+
+    fprintf(stderr,
+            "Usage: %1$s stats show\n"
+            "       %1$s stats reset\n"
+            "       %1$s stats run COMMAND [ARGS...]\n"
+            "\n"
+            "Call counts and latency histograms of library operations (table operations, ternary\n"
+            "tuple opens, BPF map syscalls, BTF loading). Statistics belong to the process, so show\n"
+            "and reset are useful within serve and batch; run executes a single command and prints\n"
+            "its statistics to the standard error. Requires library built with ENABLE_STATS.\n"
+            "",
+            program_name);
+
+    return 0;
+}
@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <jansson.h>
 
@@ -30,6 +31,9 @@
 #include "meter.h"
 #include "table.h"
 
+/* Number of entries read from kernel at once when whole table is printed */
+#define TABLE_DUMP_BATCH_SIZE 1024
+
 /******************************************************************************
  * Command line parsing functions
  *****************************************************************************/
@@ -40,10 +44,12 @@ static int parse_dst_table(int *argc, char ***argv, nikss_context_t *nikss_ctx,
     if (table_name != NULL) {
         *table_name = **argv;
     }
-    int error_code = nikss_table_entry_ctx_tblname(nikss_ctx, ctx, **argv);
+    int error_code = open_table_ctx(nikss_ctx, ctx, **argv);
     if (error_code != NO_ERROR) {
         return error_code;
     }
+    /* Do not interleave changes of ternary tables with other processes, e.g. a controller */
+    nikss_table_entry_ctx_thread_safe(ctx, true);
 
     if (can_be_last) {
         NEXT_ARGP();
@@ -554,26 +560,18 @@ enum table_print_mode {
 };
 
 static int print_json_table(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry,
-                            const char *table_name, enum table_print_mode mode)
+                            const char *table_name, enum table_print_mode mode, FILE *out)
 {
-    int ret = EINVAL;
-    json_t *root = json_object();
-    json_t *instance_name = json_object();
-    json_t *entries = json_array();
+    int ret = ENOMEM;
+    json_stream_t stream;
 
-    if (root == NULL || instance_name == NULL || entries == NULL) {
-        fprintf(stderr, "failed to prepare JSON\n");
-        ret = ENOMEM;
-        goto clean_up;
-    }
-
-    if (json_object_set(root, table_name, instance_name)) {
-        fprintf(stderr, "failed to add JSON key %s\n", table_name);
-        goto clean_up;
-    }
+    /* Entries are printed as soon as they are read, so whole table never is kept in memory */
+    json_stream_init(&stream, out, ndjson_output);
+    json_stream_open_object(&stream, NULL);
+    json_stream_open_object(&stream, table_name);
 
     if (mode == PRINT_SINGLE_ENTRY || mode == PRINT_WHOLE_TABLE) {
-        json_object_set(instance_name, "entries", entries);
+        json_stream_open_array(&stream, "entries");
     }
 
     if (entry != NULL && mode == PRINT_SINGLE_ENTRY) {
@@ -582,22 +580,27 @@ static int print_json_table(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *e
             fprintf(stderr, "failed to create table JSON entry\n");
             goto clean_up;
         }
-        json_array_append_new(entries, parsed_entry);
+        json_stream_add(&stream, NULL, parsed_entry);
     }
 
     if (mode == PRINT_WHOLE_TABLE) {
         nikss_table_entry_t *current_entry = NULL;
+        nikss_table_entry_ctx_use_arena(ctx, true);
         while ((current_entry = nikss_table_entry_get_next(ctx)) != NULL) {
             json_t *parsed_entry = create_json_entry(ctx, current_entry, false);
+            nikss_table_entry_free(current_entry);
             if (parsed_entry == NULL) {
                 fprintf(stderr, "failed to create table JSON entry\n");
                 goto clean_up;
             }
-            json_array_append_new(entries, parsed_entry);
-            nikss_table_entry_free(current_entry);
+            json_stream_add(&stream, NULL, parsed_entry);
         }
     }
 
+    if (mode == PRINT_SINGLE_ENTRY || mode == PRINT_WHOLE_TABLE) {
+        json_stream_close(&stream);
+    }
+
     if (mode == PRINT_DEFAULT_ENTRY || mode == PRINT_WHOLE_TABLE) {
         nikss_table_entry_t default_entry;
         nikss_table_entry_init(&default_entry);
@@ -607,128 +610,205 @@ static int print_json_table(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *e
             json_t *parsed_entry = create_json_entry(ctx, &default_entry, true);
             if (parsed_entry == NULL) {
                 fprintf(stderr, "failed to create table JSON default entry\n");
+                nikss_table_entry_free(&default_entry);
                 goto clean_up;
             }
-            json_object_set_new(instance_name, "default_action", parsed_entry);
+            json_stream_add(&stream, "default_action", parsed_entry);
         }
         nikss_table_entry_free(&default_entry);
     }
 
-    if (build_json_table_metadata(ctx, instance_name) != NO_ERROR) {
+    json_t *metadata = json_object();
+    if (metadata == NULL || build_json_table_metadata(ctx, metadata) != NO_ERROR) {
         fprintf(stderr, "failed to create table JSON entry metadata\n");
+        json_decref(metadata);
         goto clean_up;
     }
+    json_stream_add_members(&stream, metadata);
 
-    json_dumpf(root, stdout, JSON_INDENT(4) | JSON_ENSURE_ASCII);
     ret = NO_ERROR;
 
 clean_up:
-    json_decref(instance_name);
-    json_decref(entries);
-    json_decref(root);
+    json_stream_finish(&stream, ret);
 
     return ret;
 }
 
-/******************************************************************************
- * Command line table functions
- *****************************************************************************/
+static int add_json_hexstr(json_t *parent, const char *name, const void *data, size_t len)
+{
+    char *str = convert_bin_data_to_hexstr(data, len);
+    if (str == NULL) {
+        return ENOMEM;
+    }
+    int ret = json_object_set_new(parent, name, json_string(str));
+    free(str);
 
-enum table_write_type_t {
-    TABLE_ADD_NEW_ENTRY,
-    TABLE_UPDATE_EXISTING_ENTRY,
-    TABLE_SET_DEFAULT_ENTRY
-};
+    return ret != 0 ? ENOMEM : NO_ERROR;
+}
 
-int do_table_write(int argc, char **argv, enum table_write_type_t write_type)
+static json_t *create_json_direct_objects_entry(const nikss_table_direct_objects_entry_t *entry)
 {
-    nikss_table_entry_t entry;
-    nikss_table_entry_ctx_t ctx;
-    nikss_action_t action;
-    nikss_context_t nikss_ctx;
-    int error_code = EPERM;
+    json_t *root = json_object();
+    json_t *counters = json_object();
+    json_t *meters = json_object();
 
-    nikss_context_init(&nikss_ctx);
-    nikss_table_entry_ctx_init(&ctx);
-    nikss_table_entry_init(&entry);
-    nikss_action_init(&action);
+    if (root == NULL || counters == NULL || meters == NULL) {
+        json_decref(root);
+        json_decref(counters);
+        json_decref(meters);
+        return NULL;
+    }
+    json_object_set_new(root, "DirectCounter", counters);
+    json_object_set_new(root, "DirectMeter", meters);
 
-    /* 0. Get the pipeline id */
-    if (parse_pipeline_id(&argc, &argv, &nikss_ctx) != NO_ERROR) {
-        goto clean_up;
+    if (add_json_hexstr(root, "key", entry->key, entry->key_size) != NO_ERROR) {
+        goto err;
+    }
+    if (entry->mask != NULL && add_json_hexstr(root, "mask", entry->mask, entry->mask_size) != NO_ERROR) {
+        goto err;
     }
 
-    /* no NEXT_ARG before in version from this file, so this check must be preserved */
-    if (argc < 1) {
-        fprintf(stderr, "too few parameters\n");
-        goto clean_up;
+    for (size_t i = 0; i < entry->n_counters; i++) {
+        const nikss_direct_counter_value_t *value = &entry->counters[i];
+        nikss_counter_entry_t counter;
+        json_t *counter_entry = json_object();
+
+        nikss_counter_entry_init(&counter);
+        nikss_counter_entry_set_bytes(&counter, value->bytes);
+        nikss_counter_entry_set_packets(&counter, value->packets);
+        int ret = counter_entry == NULL ? ENOMEM : build_json_counter_value(counter_entry, &counter, value->type);
+        nikss_counter_entry_free(&counter);
+        if (ret != NO_ERROR || json_object_set_new(counters, value->name, counter_entry) != 0) {
+            goto err;
+        }
     }
 
-    /* 1. Get table */
-    if (parse_dst_table(&argc, &argv, &nikss_ctx, &ctx, NULL, false) != NO_ERROR) {
-        goto clean_up;
+    for (size_t i = 0; i < entry->n_meters; i++) {
+        const nikss_direct_meter_value_t *value = &entry->meters[i];
+        nikss_meter_entry_t meter;
+
+        nikss_meter_entry_init(&meter);
+        nikss_meter_entry_data(&meter, value->pir, value->pbs, value->cir, value->cbs);
+        json_t *meter_entry = create_json_meter_config(&meter);
+        nikss_meter_entry_free(&meter);
+        if (meter_entry == NULL || json_object_set_new(meters, value->name, meter_entry) != 0) {
+            goto err;
+        }
     }
 
-    /* 2. Get action */
-    bool can_ba_last_arg = write_type == TABLE_SET_DEFAULT_ENTRY ? true : false;
-    if (parse_table_action(&argc, &argv, &ctx, &action, can_ba_last_arg) != NO_ERROR) {
-        goto clean_up;
+    return root;
+
+err:
+    json_decref(root);
+    return NULL;
+}
+
+static int print_json_direct_objects_cb(const nikss_table_direct_objects_entry_t *entry, void *arg)
+{
+    json_t *parsed_entry = create_json_direct_objects_entry(entry);
+    if (parsed_entry == NULL) {
+        fprintf(stderr, "failed to create table JSON entry\n");
+        return ENOMEM;
     }
 
-    /* 3. Get key - default entry has no key */
-    if (write_type != TABLE_SET_DEFAULT_ENTRY) {
-        if (parse_table_key(&argc, &argv, &entry) != NO_ERROR) {
+    return json_stream_add((json_stream_t *) arg, NULL, parsed_entry);
+}
+
+/* Prints only keys and direct objects, one JSON document per call */
+static int print_json_table_direct_objects(nikss_table_entry_ctx_t *ctx, const char *table_name, FILE *out)
+{
+    json_stream_t stream;
+
+    json_stream_init(&stream, out, ndjson_output);
+    json_stream_open_object(&stream, NULL);
+    json_stream_open_object(&stream, table_name);
+    json_stream_open_array(&stream, "entries");
+
+    int ret = nikss_table_entry_ctx_dump_direct_objects(ctx, print_json_direct_objects_cb, &stream);
+    json_stream_finish(&stream, ret);
+
+    return ret;
+}
+
+int dump_table(nikss_context_t *nikss_ctx, const char *table_name, FILE *out)
+{
+    nikss_table_entry_ctx_t ctx;
+    nikss_table_entry_ctx_init(&ctx);
+
+    int ret = nikss_table_entry_ctx_tblname(nikss_ctx, &ctx, table_name);
+    if (ret == NO_ERROR) {
+        ret = nikss_table_entry_ctx_batch_size(&ctx, TABLE_DUMP_BATCH_SIZE);
+    }
+    if (ret == NO_ERROR) {
+        ret = print_json_table(&ctx, NULL, table_name, PRINT_WHOLE_TABLE, out);
+    }
+
+    nikss_table_entry_ctx_free(&ctx);
+
+    return ret;
+}
+
+/******************************************************************************
+ * Command line table functions
+ *****************************************************************************/
+
+int parse_table_entry(int *argc, char ***argv, nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry,
+                      enum table_write_type_t write_type)
+{
+    nikss_action_t action;
+    int error_code = EINVAL;
+
+    nikss_action_init(&action);
+
+    if (write_type == TABLE_DELETE_ENTRY) {
+        /* Key is the only argument of delete */
+        if (parse_table_key(argc, argv, entry) != NO_ERROR) {
+            goto clean_up;
+        }
+    } else {
+        /* 1. Get action */
+        bool can_ba_last_arg = write_type == TABLE_SET_DEFAULT_ENTRY ? true : false;
+        if (parse_table_action(argc, argv, ctx, &action, can_ba_last_arg) != NO_ERROR) {
             goto clean_up;
         }
-    }
 
-    /* 4. Get action parameters */
-    if (parse_action_data(&argc, &argv, &ctx, &entry, &action) != NO_ERROR) {
-        goto clean_up;
-    }
+        /* 2. Get key - default entry has no key */
+        if (write_type != TABLE_SET_DEFAULT_ENTRY) {
+            if (parse_table_key(argc, argv, entry) != NO_ERROR) {
+                goto clean_up;
+            }
+        }
 
-    /* 5. Get entry priority - not applicable to default entry */
-    if (write_type != TABLE_SET_DEFAULT_ENTRY) {
-        if (parse_entry_priority(&argc, &argv, &entry) != NO_ERROR) {
+        /* 3. Get action parameters */
+        if (parse_action_data(argc, argv, ctx, entry, &action) != NO_ERROR) {
             goto clean_up;
         }
+
+        /* 4. Get entry priority - not applicable to default entry */
+        if (write_type != TABLE_SET_DEFAULT_ENTRY) {
+            if (parse_entry_priority(argc, argv, entry) != NO_ERROR) {
+                goto clean_up;
+            }
+        }
     }
 
-    if (argc > 0) {
-        fprintf(stderr, "%s: unused argument\n", *argv);
+    if (*argc > 0) {
+        fprintf(stderr, "%s: unused argument\n", **argv);
         goto clean_up;
     }
 
-    nikss_table_entry_action(&entry, &action);
-
-    if (write_type == TABLE_ADD_NEW_ENTRY) {
-        error_code = nikss_table_entry_add(&ctx, &entry);
-    } else if (write_type == TABLE_UPDATE_EXISTING_ENTRY) {
-        error_code = nikss_table_entry_update(&ctx, &entry);
-    } else if (write_type == TABLE_SET_DEFAULT_ENTRY) {
-        error_code = nikss_table_entry_set_default_entry(&ctx, &entry);
+    if (write_type != TABLE_DELETE_ENTRY) {
+        nikss_table_entry_action(entry, &action);
     }
+    error_code = NO_ERROR;
 
 clean_up:
     nikss_action_free(&action);
-    nikss_table_entry_free(&entry);
-    nikss_table_entry_ctx_free(&ctx);
-    nikss_context_free(&nikss_ctx);
 
     return error_code;
 }
 
-int do_table_add(int argc, char **argv)
-{
-    return do_table_write(argc, argv, TABLE_ADD_NEW_ENTRY);
-}
-
-int do_table_update(int argc, char **argv)
-{
-    return do_table_write(argc, argv, TABLE_UPDATE_EXISTING_ENTRY);
-}
-
-int do_table_delete(int argc, char **argv)
+static int do_table_write(int argc, char **argv, enum table_write_type_t write_type)
 {
     nikss_table_entry_t entry;
     nikss_table_entry_ctx_t ctx;
@@ -750,23 +830,27 @@ int do_table_delete(int argc, char **argv)
         goto clean_up;
     }
 
-    /* 1. Get table */
-    if (parse_dst_table(&argc, &argv, &nikss_ctx, &ctx, NULL, true) != NO_ERROR) {
+    /* 1. Get table, table name might be the last argument of delete */
+    bool table_can_be_last = write_type == TABLE_DELETE_ENTRY;
+    if (parse_dst_table(&argc, &argv, &nikss_ctx, &ctx, NULL, table_can_be_last) != NO_ERROR) {
         goto clean_up;
     }
 
-    /* 2. Get key */
-    if (parse_table_key(&argc, &argv, &entry) != NO_ERROR) {
+    /* 2. Get the rest of entry */
+    if (parse_table_entry(&argc, &argv, &ctx, &entry, write_type) != NO_ERROR) {
         goto clean_up;
     }
 
-    if (argc > 0) {
-        fprintf(stderr, "%s: unused argument\n", *argv);
-        goto clean_up;
+    if (write_type == TABLE_ADD_NEW_ENTRY) {
+        error_code = nikss_table_entry_add(&ctx, &entry);
+    } else if (write_type == TABLE_UPDATE_EXISTING_ENTRY) {
+        error_code = nikss_table_entry_update(&ctx, &entry);
+    } else if (write_type == TABLE_SET_DEFAULT_ENTRY) {
+        error_code = nikss_table_entry_set_default_entry(&ctx, &entry);
+    } else if (write_type == TABLE_DELETE_ENTRY) {
+        error_code = nikss_table_entry_del(&ctx, &entry);
     }
 
-    error_code = nikss_table_entry_del(&ctx, &entry);
-
 clean_up:
     nikss_table_entry_free(&entry);
     nikss_table_entry_ctx_free(&ctx);
@@ -775,6 +859,21 @@ clean_up:
     return error_code;
 }
 
+int do_table_add(int argc, char **argv)
+{
+    return do_table_write(argc, argv, TABLE_ADD_NEW_ENTRY);
+}
+
+int do_table_update(int argc, char **argv)
+{
+    return do_table_write(argc, argv, TABLE_UPDATE_EXISTING_ENTRY);
+}
+
+int do_table_delete(int argc, char **argv)
+{
+    return do_table_write(argc, argv, TABLE_DELETE_ENTRY);
+}
+
 static int do_table_default_get(int argc, char **argv)
 {
     nikss_table_entry_ctx_t ctx;
@@ -800,7 +899,7 @@ static int do_table_default_get(int argc, char **argv)
         goto clean_up;
     }
 
-    error_code = print_json_table(&ctx, NULL, table_name, PRINT_DEFAULT_ENTRY);
+    error_code = print_json_table(&ctx, NULL, table_name, PRINT_DEFAULT_ENTRY, stdout);
 
 clean_up:
     nikss_table_entry_ctx_free(&ctx);
@@ -854,13 +953,38 @@ int do_table_get(int argc, char **argv)
         goto clean_up;
     }
 
-    /* 3. Get key */
+    /* 3. Get number of threads used to read tuples of ternary table */
+    if (argc >= 1 && is_keyword(*argv, "threads")) {
+        NEXT_ARG();
+        if (argc < 1) {
+            fprintf(stderr, "expected number of threads\n");
+            goto clean_up;
+        }
+        char *ptr = NULL;
+        uint32_t threads = strtoul(*argv, &ptr, 0);
+        if (*ptr) {
+            fprintf(stderr, "%s: unable to parse as a number of threads\n", *argv);
+            goto clean_up;
+        }
+        nikss_table_entry_ctx_tuple_threads(&ctx, threads);
+        NEXT_ARG();
+    }
+
+    /* 4. Get key or fast dump of direct objects */
     bool key_provided = (argc >= 1 && is_keyword(*argv, "key"));
+    bool counters_only = (argc >= 1 && is_keyword(*argv, "counters-only"));
+    unsigned long interval_ms = 0;
+    unsigned long count = 0;
     if (key_provided) {
         print_mode = PRINT_SINGLE_ENTRY;
         if (parse_table_key(&argc, &argv, &entry) != NO_ERROR) {
             goto clean_up;
         }
+    } else if (counters_only) {
+        NEXT_ARG();
+        if (parse_snapshot_options(&argc, &argv, &interval_ms, &count) != NO_ERROR) {
+            goto clean_up;
+        }
     }
 
     if (argc > 0) {
@@ -868,13 +992,43 @@ int do_table_get(int argc, char **argv)
         goto clean_up;
     }
 
+    if (counters_only) {
+        error_code = nikss_table_entry_ctx_batch_size(&ctx, TABLE_DUMP_BATCH_SIZE);
+        if (error_code != NO_ERROR) {
+            goto clean_up;
+        }
+        /* Without interval table is dumped only once */
+        if (interval_ms == 0) {
+            count = 1;
+        }
+        struct timespec delay = {
+            .tv_sec = (time_t) (interval_ms / 1000),
+            .tv_nsec = (long) (interval_ms % 1000) * 1000000L,
+        };
+        for (unsigned long i = 0; count == 0 || i < count; i++) {
+            if (i > 0) {
+                nanosleep(&delay, NULL);
+            }
+            error_code = print_json_table_direct_objects(&ctx, table_name, stdout);
+            if (error_code != NO_ERROR) {
+                break;
+            }
+        }
+        goto clean_up;
+    }
+
     if (key_provided) {
         error_code = nikss_table_entry_get(&ctx, &entry);
         if (error_code != NO_ERROR) {
             goto clean_up;
         }
+    } else {
+        error_code = nikss_table_entry_ctx_batch_size(&ctx, TABLE_DUMP_BATCH_SIZE);
+        if (error_code != NO_ERROR) {
+            goto clean_up;
+        }
     }
-    error_code = print_json_table(&ctx, &entry, table_name, print_mode);
+    error_code = print_json_table(&ctx, &entry, table_name, print_mode, stdout);
 
 clean_up:
     nikss_table_entry_free(&entry);
@@ -884,6 +1038,114 @@ clean_up:
     return error_code;
 }
 
+int do_table_compact(int argc, char **argv)
+{
+    nikss_table_entry_ctx_t ctx;
+    nikss_context_t nikss_ctx;
+    nikss_tuple_compaction_stats_t stats;
+    int error_code = EPERM;
+    const char *table_name = NULL;
+
+    nikss_context_init(&nikss_ctx);
+    nikss_table_entry_ctx_init(&ctx);
+
+    /* 0. Get the pipeline id */
+    if (parse_pipeline_id(&argc, &argv, &nikss_ctx) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    /* 1. Get table */
+    if (parse_dst_table(&argc, &argv, &nikss_ctx, &ctx, &table_name, true) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    /* 2. Get the smallest size of tuples */
+    if (argc >= 1 && is_keyword(*argv, "min-size")) {
+        NEXT_ARG();
+        if (argc < 1) {
+            fprintf(stderr, "expected size of tuples\n");
+            goto clean_up;
+        }
+        char *ptr = NULL;
+        uint32_t min_size = strtoul(*argv, &ptr, 0);
+        if (*ptr || min_size == 0) {
+            fprintf(stderr, "%s: unable to parse as a size of tuples\n", *argv);
+            goto clean_up;
+        }
+        nikss_table_entry_ctx_tuple_initial_size(&ctx, min_size);
+        NEXT_ARG();
+    }
+
+    if (argc > 0) {
+        fprintf(stderr, "%s: unused argument\n", *argv);
+        goto clean_up;
+    }
+
+    error_code = nikss_table_entry_ctx_compact_tuples(&ctx, &stats);
+    if (error_code != NO_ERROR) {
+        goto clean_up;
+    }
+
+    json_t *root = json_object();
+    json_t *result = json_object();
+    if (root == NULL || result == NULL) {
+        fprintf(stderr, "failed to prepare JSON\n");
+        json_decref(root);
+        json_decref(result);
+        error_code = ENOMEM;
+        goto clean_up;
+    }
+    json_object_set_new(result, "tuples", json_integer(stats.n_tuples));
+    json_object_set_new(result, "removed_tuples", json_integer(stats.removed_tuples));
+    json_object_set_new(result, "moved_tuples", json_integer(stats.moved_tuples));
+    json_object_set_new(result, "resized_tuples", json_integer(stats.resized_tuples));
+    json_object_set_new(root, table_name, result);
+
+    json_dumpf(root, stdout, ndjson_output ? JSON_COMPACT : (JSON_INDENT(4) | JSON_ENSURE_ASCII));
+    fprintf(stdout, "\n");
+    json_decref(root);
+
+clean_up:
+    nikss_table_entry_ctx_free(&ctx);
+    nikss_context_free(&nikss_ctx);
+
+    return error_code;
+}
+
+int do_table_clear(int argc, char **argv)
+{
+    nikss_table_entry_ctx_t ctx;
+    nikss_context_t nikss_ctx;
+    int error_code = EPERM;
+    const char *table_name = NULL;
+
+    nikss_context_init(&nikss_ctx);
+    nikss_table_entry_ctx_init(&ctx);
+
+    /* 0. Get the pipeline id */
+    if (parse_pipeline_id(&argc, &argv, &nikss_ctx) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    /* 1. Get table */
+    if (parse_dst_table(&argc, &argv, &nikss_ctx, &ctx, &table_name, true) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    if (argc > 0) {
+        fprintf(stderr, "%s: unused argument\n", *argv);
+        goto clean_up;
+    }
+
+    error_code = nikss_table_clear(&ctx);
+
+clean_up:
+    nikss_table_entry_ctx_free(&ctx);
+    nikss_context_free(&nikss_ctx);
+
+    return error_code;
+}
+
 int do_table_help(int argc, char **argv)
 {
     (void) argc; (void) argv;
@@ -893,9 +1155,12 @@ int do_table_help(int argc, char **argv)
             "       %1$s table add pipe ID TABLE_NAME ref key MATCH_KEY data ACTION_REFS [priority PRIORITY]\n"
             "       %1$s table update pipe ID TABLE_NAME action ACTION key MATCH_KEY [data ACTION_PARAMS] [priority PRIORITY]\n"
             "       %1$s table delete pipe ID TABLE_NAME [key MATCH_KEY]\n"
-            "       %1$s table get pipe ID TABLE_NAME [ref] [key MATCH_KEY]\n"
+            "       %1$s table get pipe ID TABLE_NAME [ref] [threads N] [key MATCH_KEY]\n"
+            "       %1$s table get pipe ID TABLE_NAME counters-only [interval MSEC] [count N]\n"
             "       %1$s table default set pipe ID TABLE_NAME action ACTION [data ACTION_PARAMS]\n"
             "       %1$s table default get pipe ID TABLE_NAME\n"
+            "       %1$s table compact pipe ID TABLE_NAME [min-size N]\n"
+            "       %1$s table clear pipe ID TABLE_NAME\n"
             /* Support for this one might be preserved, but makes no sense, because indirect tables
              * has no default entry. In other words we do not forbid this syntax explicitly.
              * "       %1$s table default pipe ID TABLE_NAME ref data ACTION_REFS\n" */
@@ -20,11 +20,27 @@
 
 #include "common.h"
 
+enum table_write_type_t {
+    TABLE_ADD_NEW_ENTRY,
+    TABLE_UPDATE_EXISTING_ENTRY,
+    TABLE_SET_DEFAULT_ENTRY,
+    TABLE_DELETE_ENTRY
+};
+
+/* Parses arguments of table write command following the table name into entry */
+int parse_table_entry(int *argc, char ***argv, nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry,
+                      enum table_write_type_t write_type);
+
+/* Prints the whole table like `table get` does */
+int dump_table(nikss_context_t *nikss_ctx, const char *table_name, FILE *out);
+
 int do_table_add(int argc, char **argv);
 int do_table_update(int argc, char **argv);
 int do_table_delete(int argc, char **argv);
 int do_table_default(int argc, char **argv);
 int do_table_get(int argc, char **argv);
+int do_table_compact(int argc, char **argv);
+int do_table_clear(int argc, char **argv);
 int do_table_help(int argc, char **argv);
 
 static const struct cmd table_cmds[] = {
@@ -34,6 +50,8 @@ static const struct cmd table_cmds[] = {
         {"delete",  do_table_delete},
         {"default", do_table_default},
         {"get",     do_table_get},
+        {"compact", do_table_compact},
+        {"clear",   do_table_clear},
         {0}
 };
 
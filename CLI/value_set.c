@@ -17,6 +17,7 @@
 
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <jansson.h>
@@ -213,6 +214,142 @@ clean_up:
     return ret;
 }
 
+#define VALUE_SET_MAX_FIELDS 64
+
+/* Parses a line of file with values. Each line contains one value, which consists of
+ * fields separated with white spaces. Empty lines and lines starting with '#' are skipped. */
+static int parse_value_set_line(char *line, nikss_table_entry_t *entry, bool *has_value)
+{
+    char *args[VALUE_SET_MAX_FIELDS + 1] = { "value" };
+    int n_args = 1;
+    char *save_ptr = NULL;
+
+    *has_value = false;
+    for (char *token = strtok_r(line, " \t\r\n", &save_ptr); token != NULL;
+         token = strtok_r(NULL, " \t\r\n", &save_ptr)) {
+        if (n_args == 1 && token[0] == '#') {
+            break;
+        }
+        if (n_args > VALUE_SET_MAX_FIELDS) {
+            fprintf(stderr, "too many fields\n");
+            return EINVAL;
+        }
+        args[n_args++] = token;
+    }
+    if (n_args == 1) {
+        return NO_ERROR;
+    }
+
+    *has_value = true;
+    char **argv = args;
+    return parse_key_data(&n_args, &argv, entry);
+}
+
+static int load_value_set_file(const char *path, nikss_table_entry_t **entries, size_t *n_entries)
+{
+    FILE *file = fopen(path, "re");
+    if (file == NULL) {
+        int ret = errno;
+        fprintf(stderr, "%s: failed to open file: %s\n", path, strerror(ret));
+        return ret;
+    }
+
+    int ret = NO_ERROR;
+    size_t capacity = 0;
+    char *line = NULL;
+    size_t line_size = 0;
+    size_t line_no = 0;
+    while (getline(&line, &line_size, file) >= 0) {
+        line_no++;
+        if (*n_entries == capacity) {
+            size_t new_capacity = capacity == 0 ? 1024 : 2 * capacity;
+            nikss_table_entry_t *new_entries = realloc(*entries, new_capacity * sizeof(nikss_table_entry_t));
+            if (new_entries == NULL) {
+                fprintf(stderr, "not enough memory\n");
+                ret = ENOMEM;
+                break;
+            }
+            *entries = new_entries;
+            capacity = new_capacity;
+        }
+
+        bool has_value = false;
+        nikss_table_entry_init(&(*entries)[*n_entries]);
+        ret = parse_value_set_line(line, &(*entries)[*n_entries], &has_value);
+        if (ret != NO_ERROR || !has_value) {
+            nikss_table_entry_free(&(*entries)[*n_entries]);
+        }
+        if (ret != NO_ERROR) {
+            /* cppcheck-suppress invalidPrintfArgType_uint ; cppcheck failed to recognize a real type of size_t */
+            fprintf(stderr, "%s:%lu: failed to parse value\n", path, line_no);
+            break;
+        }
+        if (has_value) {
+            *n_entries += 1;
+        }
+    }
+
+    if (line != NULL) {
+        free(line);
+    }
+    fclose(file);
+
+    return ret;
+}
+
+int do_value_set_load(int argc, char **argv)
+{
+    int ret = EINVAL;
+    const char *value_set_name = NULL;
+    nikss_context_t nikss_ctx;
+    nikss_value_set_context_t ctx;
+    nikss_table_entry_t *entries = NULL;
+    size_t n_entries = 0;
+
+    nikss_context_init(&nikss_ctx);
+    nikss_value_set_context_init(&ctx);
+
+    if (parse_pipeline_id(&argc, &argv, &nikss_ctx) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    if (parse_dst_value_set(&argc, &argv, &value_set_name, &nikss_ctx, &ctx) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    if (argc < 2 || !is_keyword(*argv, "file")) {
+        fprintf(stderr, "expected \'file\' keyword and path\n");
+        goto clean_up;
+    }
+    NEXT_ARG();
+    const char *path = *argv;
+    NEXT_ARG();
+
+    if (argc > 0) {
+        fprintf(stderr, "%s: unused argument\n", *argv);
+        goto clean_up;
+    }
+
+    ret = load_value_set_file(path, &entries, &n_entries);
+    if (ret != NO_ERROR) {
+        goto clean_up;
+    }
+
+    ret = nikss_value_set_replace(&ctx, entries, n_entries);
+
+clean_up:
+    for (size_t i = 0; i < n_entries; i++) {
+        nikss_table_entry_free(&entries[i]);
+    }
+    if (entries != NULL) {
+        free(entries);
+    }
+    nikss_value_set_context_free(&ctx);
+    nikss_context_free(&nikss_ctx);
+
+    return ret;
+}
+
 int do_value_set_help(int argc, char **argv)
 {
     (void) argc; (void) argv;
@@ -220,6 +357,7 @@ int do_value_set_help(int argc, char **argv)
             "Usage: %1$s value_set get pipe ID VALUE_SET_NAME\n"
             "       %1$s value_set insert pipe ID VALUE_SET_NAME value DATA\n"
             "       %1$s value_set delete pipe ID VALUE_SET_NAME value DATA\n"
+            "       %1$s value_set load pipe ID VALUE_SET_NAME file PATH\n"
             "",
             program_name);
 
@@ -24,12 +24,14 @@ int do_value_set_help(int argc, char **argv);
 int do_value_set_get(int argc, char **argv);
 int do_value_set_delete(int argc, char **argv);
 int do_value_set_insert(int argc, char **argv);
+int do_value_set_load(int argc, char **argv);
 
 static const struct cmd value_set_cmds[] = {
         {"help", do_value_set_help},
         {"get",  do_value_set_get},
         {"delete",  do_value_set_delete},
         {"insert",  do_value_set_insert},
+        {"load",  do_value_set_load},
         {0}
 };
 
@@ -0,0 +1,927 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Control plane microbenchmarks. Every operation is timed separately, results (throughput
+ * and latency percentiles) are written as JSON, so they can be compared between releases.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <jansson.h>
+
+#include <nikss/nikss.h>
+#include <nikss/nikss_digest.h>
+#include <nikss/nikss_pipeline.h>
+#include <nikss/nikss_pre.h>
+
+#define DEFAULT_PIPELINE_ID 99
+#define DEFAULT_SCALE 10000
+#define DEFAULT_TERNARY_MASKS 8
+#define DEFAULT_PRE_GROUPS 256
+#define DEFAULT_PRE_MEMBERS 8
+
+/* Keys are generated from 24 bits, the highest byte is used by LPM and ternary masks */
+#define MAX_SCALE (1U << 24)
+#define MAX_TERNARY_MASKS 8
+#define LPM_PREFIX_LEN 24
+#define FIRST_PRE_GROUP_ID 1
+
+#define NSEC_PER_SEC 1000000000ULL
+
+typedef struct bench_config {
+    const char *program;
+    nikss_pipeline_id_t pipeline_id;
+    uint32_t scale;
+    uint32_t ternary_masks;
+    uint32_t pre_groups;
+    uint32_t pre_members;
+
+    const char *exact_table;
+    const char *lpm_table;
+    const char *ternary_table;
+    const char *action;
+    const char *counter;
+    const char *meter;
+    const char *digest;
+
+    /* Comma separated list of benchmarks to run, NULL runs all of them */
+    const char *benchmarks;
+} bench_config_t;
+
+typedef struct bench_result {
+    char name[64];
+    uint64_t *latencies;
+    size_t n_samples;
+    size_t capacity;
+    size_t n_errors;
+    int first_error;
+    uint64_t start_ns;
+    uint64_t elapsed_ns;
+} bench_result_t;
+
+static const char *program_name = "nikss-bench";
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * NSEC_PER_SEC + (uint64_t) ts.tv_nsec;
+}
+
+static int bench_result_init(bench_result_t *result, const char *prefix, const char *suffix, size_t capacity)
+{
+    memset(result, 0, sizeof(bench_result_t));
+    snprintf(result->name, sizeof(result->name), "%s%s", prefix, suffix);
+    result->first_error = NO_ERROR;
+    result->capacity = capacity > 0 ? capacity : 1;
+    result->latencies = malloc(result->capacity * sizeof(uint64_t));
+    if (result->latencies == NULL) {
+        return ENOMEM;
+    }
+    result->start_ns = now_ns();
+    return NO_ERROR;
+}
+
+static void bench_result_free(bench_result_t *result)
+{
+    if (result->latencies != NULL) {
+        free(result->latencies);
+    }
+    result->latencies = NULL;
+}
+
+/* Failed operations are not a part of latency statistics */
+static void bench_result_record(bench_result_t *result, uint64_t op_start_ns, int error_code)
+{
+    uint64_t latency = now_ns() - op_start_ns;
+
+    if (error_code != NO_ERROR) {
+        if (result->n_errors == 0) {
+            result->first_error = error_code;
+        }
+        result->n_errors++;
+        return;
+    }
+    if (result->n_samples < result->capacity) {
+        result->latencies[result->n_samples++] = latency;
+    }
+}
+
+static void bench_result_finish(bench_result_t *result)
+{
+    result->elapsed_ns = now_ns() - result->start_ns;
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+    uint64_t l = *(const uint64_t *) a;
+    uint64_t r = *(const uint64_t *) b;
+    return (l > r) - (l < r);
+}
+
+/* Percentile is given in per mille, samples have to be sorted */
+static uint64_t latency_percentile(bench_result_t *result, unsigned percentile)
+{
+    size_t idx = ((result->n_samples - 1) * percentile) / 1000;
+    return result->latencies[idx];
+}
+
+static json_t *create_json_result(bench_result_t *result)
+{
+    json_t *root = json_object();
+    json_t *latency = json_object();
+    if (root == NULL || latency == NULL) {
+        if (root != NULL) {
+            json_decref(root);
+        }
+        if (latency != NULL) {
+            json_decref(latency);
+        }
+        return NULL;
+    }
+
+    double elapsed = (double) result->elapsed_ns / (double) NSEC_PER_SEC;
+    double ops_per_sec = elapsed > 0 ? (double) result->n_samples / elapsed : 0;
+
+    json_object_set_new(root, "name", json_string(result->name));
+    json_object_set_new(root, "ops", json_integer((json_int_t) result->n_samples));
+    json_object_set_new(root, "errors", json_integer((json_int_t) result->n_errors));
+    if (result->n_errors > 0) {
+        json_object_set_new(root, "first_error", json_string(strerror(result->first_error)));
+    }
+    json_object_set_new(root, "elapsed_sec", json_real(elapsed));
+    json_object_set_new(root, "ops_per_sec", json_real(ops_per_sec));
+
+    if (result->n_samples > 0) {
+        uint64_t sum = 0;
+        qsort(result->latencies, result->n_samples, sizeof(uint64_t), compare_latency);
+        for (size_t i = 0; i < result->n_samples; i++) {
+            sum += result->latencies[i];
+        }
+        json_object_set_new(latency, "min", json_integer((json_int_t) result->latencies[0]));
+        json_object_set_new(latency, "mean", json_integer((json_int_t) (sum / result->n_samples)));
+        json_object_set_new(latency, "p50", json_integer((json_int_t) latency_percentile(result, 500)));
+        json_object_set_new(latency, "p90", json_integer((json_int_t) latency_percentile(result, 900)));
+        json_object_set_new(latency, "p99", json_integer((json_int_t) latency_percentile(result, 990)));
+        json_object_set_new(latency, "p999", json_integer((json_int_t) latency_percentile(result, 999)));
+        json_object_set_new(latency, "max",
+                            json_integer((json_int_t) result->latencies[result->n_samples - 1]));
+    }
+    json_object_set_new(root, "latency_ns", latency);
+
+    return root;
+}
+
+static void add_result(json_t *results, bench_result_t *result)
+{
+    bench_result_finish(result);
+    json_t *entry = create_json_result(result);
+    if (entry == NULL) {
+        fprintf(stderr, "%s: failed to create JSON result\n", result->name);
+        return;
+    }
+    json_array_append_new(results, entry);
+}
+
+static void add_skipped(json_t *results, const char *name, int error_code)
+{
+    json_t *entry = json_object();
+    if (entry == NULL) {
+        return;
+    }
+    json_object_set_new(entry, "name", json_string(name));
+    json_object_set_new(entry, "skipped", json_string(strerror(error_code)));
+    json_array_append_new(results, entry);
+}
+
+static bool benchmark_enabled(const bench_config_t *cfg, const char *name)
+{
+    if (cfg->benchmarks == NULL) {
+        return true;
+    }
+
+    size_t len = strlen(name);
+    const char *item = cfg->benchmarks;
+    while (item != NULL && *item != '\0') {
+        const char *end = strchr(item, ',');
+        size_t item_len = end != NULL ? (size_t) (end - item) : strlen(item);
+        if (item_len == len && strncmp(item, name, len) == 0) {
+            return true;
+        }
+        item = end != NULL ? end + 1 : NULL;
+    }
+    return false;
+}
+
+static uint32_t ternary_block_mask(uint32_t block)
+{
+    return ~(1U << (31 - block));
+}
+
+/* Entries of ternary table are split into blocks with the same mask */
+static uint32_t ternary_mask(const bench_config_t *cfg, uint32_t i)
+{
+    return ternary_block_mask((uint32_t) (((uint64_t) i * cfg->ternary_masks) / cfg->scale));
+}
+
+static int build_entry(nikss_table_entry_t *entry, enum nikss_matchkind_t kind, uint32_t key,
+                       uint32_t mask, uint32_t priority, uint32_t action_id)
+{
+    nikss_match_key_t mk;
+    int ret;
+
+    nikss_matchkey_init(&mk);
+    nikss_matchkey_type(&mk, kind);
+    ret = nikss_matchkey_data(&mk, (const char *) &key, sizeof(key));
+    if (ret == NO_ERROR && kind == NIKSS_LPM) {
+        ret = nikss_matchkey_prefix_len(&mk, LPM_PREFIX_LEN);
+    } else if (ret == NO_ERROR && kind == NIKSS_TERNARY) {
+        ret = nikss_matchkey_mask(&mk, (const char *) &mask, sizeof(mask));
+        nikss_table_entry_priority(entry, priority);
+    }
+    if (ret == NO_ERROR) {
+        ret = nikss_table_entry_matchkey(entry, &mk);
+    }
+    nikss_matchkey_free(&mk);
+    if (ret != NO_ERROR || action_id == NIKSS_INVALID_ACTION_ID) {
+        return ret;
+    }
+
+    nikss_action_t action;
+    nikss_action_param_t param;
+    uint32_t port = 1;
+
+    nikss_action_init(&action);
+    nikss_action_set_id(&action, action_id);
+    ret = nikss_action_param_create(&param, (const char *) &port, sizeof(port));
+    if (ret == NO_ERROR) {
+        ret = nikss_action_param(&action, &param);
+    }
+    if (ret == NO_ERROR) {
+        nikss_table_entry_action(entry, &action);
+    }
+    nikss_action_free(&action);
+
+    return ret;
+}
+
+static int build_table_entry(nikss_table_entry_t *entry, const bench_config_t *cfg,
+                             enum nikss_matchkind_t kind, uint32_t i, uint32_t action_id)
+{
+    uint32_t key = kind == NIKSS_LPM ? i << (32 - LPM_PREFIX_LEN) : i;
+
+    return build_entry(entry, kind, key, ternary_mask(cfg, i), i + 1, action_id);
+}
+
+static void bench_table_write(nikss_table_entry_ctx_t *ctx, const bench_config_t *cfg, const char *prefix,
+                              enum nikss_matchkind_t kind, uint32_t action_id, json_t *results)
+{
+    bool is_delete = action_id == NIKSS_INVALID_ACTION_ID;
+    bench_result_t result;
+
+    if (bench_result_init(&result, prefix, is_delete ? "_delete" : "_insert", cfg->scale) != NO_ERROR) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < cfg->scale; i++) {
+        nikss_table_entry_t entry;
+        nikss_table_entry_init(&entry);
+        int ret = build_table_entry(&entry, cfg, kind, i, action_id);
+        if (ret == NO_ERROR) {
+            uint64_t start = now_ns();
+            if (is_delete) {
+                ret = nikss_table_entry_del(ctx, &entry);
+            } else {
+                ret = nikss_table_entry_add(ctx, &entry);
+            }
+            bench_result_record(&result, start, ret);
+        } else {
+            bench_result_record(&result, now_ns(), ret);
+        }
+        nikss_table_entry_free(&entry);
+    }
+
+    add_result(results, &result);
+    bench_result_free(&result);
+}
+
+static void bench_table_dump(nikss_table_entry_ctx_t *ctx, const bench_config_t *cfg, const char *prefix,
+                             json_t *results)
+{
+    bench_result_t result;
+
+    if (bench_result_init(&result, prefix, "_dump", cfg->scale) != NO_ERROR) {
+        return;
+    }
+
+    /* The same way as nikss-ctl dumps a table */
+    nikss_table_entry_ctx_use_arena(ctx, true);
+    while (true) {
+        uint64_t start = now_ns();
+        nikss_table_entry_t *entry = nikss_table_entry_get_next(ctx);
+        if (entry == NULL) {
+            break;
+        }
+        bench_result_record(&result, start, NO_ERROR);
+        nikss_table_entry_free(entry);
+    }
+    nikss_table_entry_ctx_use_arena(ctx, false);
+
+    add_result(results, &result);
+    bench_result_free(&result);
+}
+
+static void bench_table(nikss_context_t *nikss_ctx, const bench_config_t *cfg, const char *prefix,
+                        const char *table_name, enum nikss_matchkind_t kind, json_t *results)
+{
+    nikss_table_entry_ctx_t ctx;
+
+    if (!benchmark_enabled(cfg, prefix)) {
+        return;
+    }
+
+    nikss_table_entry_ctx_init(&ctx);
+    int ret = nikss_table_entry_ctx_tblname(nikss_ctx, &ctx, table_name);
+    if (ret != NO_ERROR) {
+        add_skipped(results, prefix, ret);
+        goto clean_up;
+    }
+
+    uint32_t action_id = nikss_table_get_action_id_by_name(&ctx, cfg->action);
+    if (action_id == NIKSS_INVALID_ACTION_ID) {
+        add_skipped(results, prefix, ENOENT);
+        goto clean_up;
+    }
+
+    bench_table_write(&ctx, cfg, prefix, kind, action_id, results);
+    bench_table_dump(&ctx, cfg, prefix, results);
+    bench_table_write(&ctx, cfg, prefix, kind, NIKSS_INVALID_ACTION_ID, results);
+
+clean_up:
+    nikss_table_entry_ctx_free(&ctx);
+}
+
+/* Every block of entries with the same mask starts with a low priority and continues with high ones, the highest
+ * priority decreases from block to block. New tuple is placed by the priority of its first entry, so tuples end up
+ * in the order of blocks only when priorities of the following entries are tracked as well. */
+static uint32_t sorted_ternary_priority(const bench_config_t *cfg, uint32_t block_size, uint32_t block, uint32_t j)
+{
+    if (j == 0) {
+        return block + 1;
+    }
+    return cfg->ternary_masks + (cfg->ternary_masks - block) * block_size + j;
+}
+
+static uint32_t sorted_ternary_block(const bench_config_t *cfg, uint32_t block_size, uint32_t priority)
+{
+    if (priority <= cfg->ternary_masks) {
+        return priority - 1;
+    }
+    return cfg->ternary_masks - (priority - cfg->ternary_masks) / block_size;
+}
+
+/* Tuples are dumped in the order of the list, entry found in a tuple placed too early is reported as an error */
+static void bench_ternary_sorted_order(nikss_table_entry_ctx_t *ctx, const bench_config_t *cfg,
+                                       uint32_t block_size, json_t *results)
+{
+    bench_result_t result;
+    uint32_t last_block = 0;
+
+    if (bench_result_init(&result, "ternary_sorted", "_order", cfg->scale) != NO_ERROR) {
+        return;
+    }
+
+    while (true) {
+        uint64_t start = now_ns();
+        nikss_table_entry_t *entry = nikss_table_entry_get_next(ctx);
+        if (entry == NULL) {
+            break;
+        }
+        uint32_t block = sorted_ternary_block(cfg, block_size, nikss_table_entry_get_priority(entry));
+        bench_result_record(&result, start, block < last_block ? EILSEQ : NO_ERROR);
+        if (block > last_block) {
+            last_block = block;
+        }
+        nikss_table_entry_free(entry);
+    }
+
+    add_result(results, &result);
+    bench_result_free(&result);
+}
+
+/* Batch insert into a ternary table which keeps tuples sorted by priority, followed by check of their order */
+static void bench_ternary_sorted(nikss_context_t *nikss_ctx, const bench_config_t *cfg, json_t *results)
+{
+    const char *prefix = "ternary_sorted";
+    uint32_t block_size = cfg->scale / cfg->ternary_masks;
+    nikss_table_entry_ctx_t ctx;
+    nikss_table_entry_batch_t batch;
+    bench_result_t result;
+
+    if (!benchmark_enabled(cfg, prefix)) {
+        return;
+    }
+    if (block_size < 2) {
+        add_skipped(results, prefix, EINVAL);
+        return;
+    }
+
+    nikss_table_entry_ctx_init(&ctx);
+    nikss_table_entry_batch_init(&batch);
+    int ret = nikss_table_entry_ctx_tblname(nikss_ctx, &ctx, cfg->ternary_table);
+    if (ret == NO_ERROR) {
+        ret = nikss_table_entry_ctx_sort_tuples(&ctx, true);
+    }
+    if (ret != NO_ERROR) {
+        add_skipped(results, prefix, ret);
+        goto clean_up;
+    }
+
+    uint32_t action_id = nikss_table_get_action_id_by_name(&ctx, cfg->action);
+    if (action_id == NIKSS_INVALID_ACTION_ID) {
+        add_skipped(results, prefix, ENOENT);
+        goto clean_up;
+    }
+
+    for (uint32_t block = 0; block < cfg->ternary_masks; block++) {
+        for (uint32_t j = 0; j < block_size; j++) {
+            nikss_table_entry_t entry;
+            nikss_table_entry_init(&entry);
+            ret = build_entry(&entry, NIKSS_TERNARY, block * block_size + j, ternary_block_mask(block),
+                              sorted_ternary_priority(cfg, block_size, block, j), action_id);
+            if (ret == NO_ERROR) {
+                ret = nikss_table_entry_batch_append(&batch, &entry);
+            }
+            nikss_table_entry_free(&entry);
+            if (ret != NO_ERROR) {
+                add_skipped(results, prefix, ret);
+                goto clean_up;
+            }
+        }
+    }
+
+    if (bench_result_init(&result, prefix, "_insert", 1) != NO_ERROR) {
+        goto clean_up;
+    }
+    uint64_t start = now_ns();
+    bench_result_record(&result, start, nikss_table_entry_batch_add(&ctx, &batch));
+    add_result(results, &result);
+    bench_result_free(&result);
+
+    bench_ternary_sorted_order(&ctx, cfg, block_size, results);
+    nikss_table_entry_batch_del(&ctx, &batch);
+
+clean_up:
+    nikss_table_entry_batch_free(&batch);
+    nikss_table_entry_ctx_free(&ctx);
+}
+
+static void bench_counter(nikss_context_t *nikss_ctx, const bench_config_t *cfg, json_t *results)
+{
+    nikss_counter_context_t ctx;
+    bench_result_t result;
+
+    if (!benchmark_enabled(cfg, "counter")) {
+        return;
+    }
+
+    nikss_counter_ctx_init(&ctx);
+    int ret = nikss_counter_ctx_name(nikss_ctx, &ctx, cfg->counter);
+    if (ret != NO_ERROR) {
+        add_skipped(results, "counter", ret);
+        goto clean_up;
+    }
+
+    if (bench_result_init(&result, "counter", "_read", cfg->scale) != NO_ERROR) {
+        goto clean_up;
+    }
+    uint32_t n_indexes = ctx.counter.max_entries > 0 ? ctx.counter.max_entries : 1;
+    for (uint32_t i = 0; i < cfg->scale; i++) {
+        nikss_counter_entry_t entry;
+        uint32_t index = i % n_indexes;
+
+        nikss_counter_entry_init(&entry);
+        ret = nikss_counter_entry_set_key(&entry, &index, sizeof(index));
+        if (ret == NO_ERROR) {
+            uint64_t start = now_ns();
+            ret = nikss_counter_get(&ctx, &entry);
+            bench_result_record(&result, start, ret);
+        } else {
+            bench_result_record(&result, now_ns(), ret);
+        }
+        nikss_counter_entry_free(&entry);
+    }
+    add_result(results, &result);
+    bench_result_free(&result);
+
+clean_up:
+    nikss_counter_ctx_free(&ctx);
+}
+
+static void bench_meter(nikss_context_t *nikss_ctx, const bench_config_t *cfg, json_t *results)
+{
+    nikss_meter_ctx_t ctx;
+    bench_result_t result;
+
+    if (!benchmark_enabled(cfg, "meter")) {
+        return;
+    }
+
+    nikss_meter_ctx_init(&ctx);
+    int ret = nikss_meter_ctx_name(&ctx, nikss_ctx, cfg->meter);
+    if (ret != NO_ERROR) {
+        add_skipped(results, "meter", ret);
+        goto clean_up;
+    }
+
+    if (bench_result_init(&result, "meter", "_update", cfg->scale) != NO_ERROR) {
+        goto clean_up;
+    }
+    uint32_t n_indexes = ctx.meter.max_entries > 0 ? ctx.meter.max_entries : 1;
+    for (uint32_t i = 0; i < cfg->scale; i++) {
+        nikss_meter_entry_t entry;
+        uint32_t index = i % n_indexes;
+
+        nikss_meter_entry_init(&entry);
+        ret = nikss_meter_entry_index(&entry, (const char *) &index, sizeof(index));
+        if (ret == NO_ERROR) {
+            /* 1 Gbps / 100 Mbps with 10 kB bursts */
+            ret = nikss_meter_entry_data(&entry, 125000000, 10000, 12500000, 10000);
+        }
+        if (ret == NO_ERROR) {
+            uint64_t start = now_ns();
+            ret = nikss_meter_entry_update(&ctx, &entry);
+            bench_result_record(&result, start, ret);
+        } else {
+            bench_result_record(&result, now_ns(), ret);
+        }
+        nikss_meter_entry_free(&entry);
+    }
+    add_result(results, &result);
+    bench_result_free(&result);
+
+clean_up:
+    nikss_meter_ctx_free(&ctx);
+}
+
+/* Digests are generated by the data plane, so this drains only messages which are already queued */
+static void bench_digest(nikss_context_t *nikss_ctx, const bench_config_t *cfg, json_t *results)
+{
+    nikss_digest_context_t ctx;
+    bench_result_t result;
+
+    if (!benchmark_enabled(cfg, "digest")) {
+        return;
+    }
+
+    nikss_digest_ctx_init(&ctx);
+    int ret = nikss_digest_ctx_name(nikss_ctx, &ctx, cfg->digest);
+    if (ret != NO_ERROR) {
+        add_skipped(results, "digest", ret);
+        goto clean_up;
+    }
+
+    if (bench_result_init(&result, "digest", "_drain", cfg->scale) != NO_ERROR) {
+        goto clean_up;
+    }
+    for (uint32_t i = 0; i < cfg->scale; i++) {
+        nikss_digest_t digest;
+        uint64_t start = now_ns();
+        ret = nikss_digest_get_next(&ctx, &digest);
+        if (ret == ENOENT) {
+            break;
+        }
+        bench_result_record(&result, start, ret);
+        if (ret == NO_ERROR) {
+            nikss_digest_free(&digest);
+        }
+    }
+    add_result(results, &result);
+    bench_result_free(&result);
+
+clean_up:
+    nikss_digest_ctx_free(&ctx);
+}
+
+static void bench_pre_groups(nikss_context_t *nikss_ctx, const bench_config_t *cfg,
+                             nikss_mcast_grp_member_t *members, bool is_delete, json_t *results)
+{
+    bench_result_t result;
+
+    if (bench_result_init(&result, "pre_group", is_delete ? "_delete" : "_program", cfg->pre_groups) != NO_ERROR) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < cfg->pre_groups; i++) {
+        nikss_mcast_grp_ctx_t group;
+        int ret;
+
+        nikss_mcast_grp_context_init(&group);
+        nikss_mcast_grp_id(&group, FIRST_PRE_GROUP_ID + i);
+        uint64_t start = now_ns();
+        if (is_delete) {
+            ret = nikss_mcast_grp_delete(nikss_ctx, &group);
+        } else {
+            ret = nikss_mcast_grp_create(nikss_ctx, &group);
+            if (ret == NO_ERROR) {
+                ret = nikss_mcast_grp_set_members(nikss_ctx, &group, members, cfg->pre_members);
+            }
+        }
+        bench_result_record(&result, start, ret);
+        nikss_mcast_grp_context_free(&group);
+    }
+
+    add_result(results, &result);
+    bench_result_free(&result);
+}
+
+static void bench_pre(nikss_context_t *nikss_ctx, const bench_config_t *cfg, json_t *results)
+{
+    nikss_mcast_grp_member_t *members = NULL;
+
+    if (!benchmark_enabled(cfg, "pre")) {
+        return;
+    }
+
+    members = malloc(cfg->pre_members * sizeof(nikss_mcast_grp_member_t));
+    if (members == NULL) {
+        add_skipped(results, "pre", ENOMEM);
+        return;
+    }
+    for (uint32_t i = 0; i < cfg->pre_members; i++) {
+        nikss_mcast_grp_member_init(&members[i]);
+        nikss_mcast_grp_member_port(&members[i], i + 1);
+        nikss_mcast_grp_member_instance(&members[i], 1);
+    }
+
+    bench_pre_groups(nikss_ctx, cfg, members, false, results);
+    bench_pre_groups(nikss_ctx, cfg, members, true, results);
+
+    for (uint32_t i = 0; i < cfg->pre_members; i++) {
+        nikss_mcast_grp_member_free(&members[i]);
+    }
+    free(members);
+}
+
+static json_t *run_benchmarks(nikss_context_t *ctx, const bench_config_t *cfg)
+{
+    json_t *root = json_object();
+    json_t *results = json_array();
+    if (root == NULL || results == NULL) {
+        if (root != NULL) {
+            json_decref(root);
+        }
+        if (results != NULL) {
+            json_decref(results);
+        }
+        return NULL;
+    }
+
+    json_object_set_new(root, "pipeline", json_integer(cfg->pipeline_id));
+    if (cfg->program != NULL) {
+        json_object_set_new(root, "program", json_string(cfg->program));
+    }
+    json_object_set_new(root, "scale", json_integer(cfg->scale));
+    json_object_set_new(root, "timestamp", json_integer((json_int_t) time(NULL)));
+    json_object_set_new(root, "results", results);
+
+    bench_table(ctx, cfg, "exact", cfg->exact_table, NIKSS_EXACT, results);
+    bench_table(ctx, cfg, "lpm", cfg->lpm_table, NIKSS_LPM, results);
+    bench_table(ctx, cfg, "ternary", cfg->ternary_table, NIKSS_TERNARY, results);
+    bench_ternary_sorted(ctx, cfg, results);
+    bench_counter(ctx, cfg, results);
+    bench_meter(ctx, cfg, results);
+    bench_digest(ctx, cfg, results);
+    bench_pre(ctx, cfg, results);
+
+    return root;
+}
+
+static void print_help(void)
+{
+    fprintf(stderr,
+            "Usage: %1$s [OPTIONS]\n"
+            "\n"
+            "Measures throughput and latency of the control plane operations, results are printed as JSON.\n"
+            "\n"
+            "  -o, --program FILE        load FILE into the pipeline before and unload it after benchmarks,\n"
+            "                            otherwise an already loaded pipeline is used\n"
+            "  -p, --pipe ID             pipeline ID (default: %2$u)\n"
+            "  -n, --scale N             number of table entries, counter reads etc. (default: %3$u)\n"
+            "  -m, --ternary-masks N     number of masks in the ternary table, at most %4$u (default: %5$u)\n"
+            "  -g, --pre-groups N        number of multicast groups (default: %6$u)\n"
+            "  -M, --pre-members N       number of members in every multicast group (default: %7$u)\n"
+            "  -b, --benchmarks LIST     comma separated list from: exact,lpm,ternary,\n"
+            "                            ternary_sorted,counter,meter,digest,pre\n"
+            "  -O, --output FILE         write results to FILE instead of standard output\n"
+            "      --exact-table NAME    (default: ingress_tbl_exact)\n"
+            "      --lpm-table NAME      (default: ingress_tbl_lpm)\n"
+            "      --ternary-table NAME  (default: ingress_tbl_ternary)\n"
+            "      --action NAME         action with a single 32-bit parameter used by table entries\n"
+            "                            (default: ingress_do_forward)\n"
+            "      --counter NAME        (default: ingress_counter)\n"
+            "      --meter NAME          (default: ingress_meter)\n"
+            "      --digest NAME         (default: mac_learn_digest)\n"
+            "  -h, --help                print this help\n"
+            "\n"
+            "Benchmarks for objects which are not present in the pipeline are reported as skipped.\n",
+            program_name, DEFAULT_PIPELINE_ID, DEFAULT_SCALE, MAX_TERNARY_MASKS, DEFAULT_TERNARY_MASKS,
+            DEFAULT_PRE_GROUPS, DEFAULT_PRE_MEMBERS);
+}
+
+static int parse_uint(const char *arg, uint32_t min, uint32_t max, uint32_t *value)
+{
+    char *end = NULL;
+    errno = 0;
+    unsigned long long v = strtoull(arg, &end, 0);
+    if (errno != 0 || end == arg || *end != '\0' || v < min || v > max) {
+        fprintf(stderr, "%s: invalid value, expected number from %u to %u\n", arg, min, max);
+        return EINVAL;
+    }
+    *value = (uint32_t) v;
+    return NO_ERROR;
+}
+
+enum long_only_options {
+    OPT_EXACT_TABLE = 256,
+    OPT_LPM_TABLE,
+    OPT_TERNARY_TABLE,
+    OPT_ACTION,
+    OPT_COUNTER,
+    OPT_METER,
+    OPT_DIGEST,
+};
+
+static int parse_options(int argc, char **argv, bench_config_t *cfg, const char **output)
+{
+    static const struct option long_options[] = {
+        {"program",       required_argument, NULL, 'o'},
+        {"pipe",          required_argument, NULL, 'p'},
+        {"scale",         required_argument, NULL, 'n'},
+        {"ternary-masks", required_argument, NULL, 'm'},
+        {"pre-groups",    required_argument, NULL, 'g'},
+        {"pre-members",   required_argument, NULL, 'M'},
+        {"benchmarks",    required_argument, NULL, 'b'},
+        {"output",        required_argument, NULL, 'O'},
+        {"exact-table",   required_argument, NULL, OPT_EXACT_TABLE},
+        {"lpm-table",     required_argument, NULL, OPT_LPM_TABLE},
+        {"ternary-table", required_argument, NULL, OPT_TERNARY_TABLE},
+        {"action",        required_argument, NULL, OPT_ACTION},
+        {"counter",       required_argument, NULL, OPT_COUNTER},
+        {"meter",         required_argument, NULL, OPT_METER},
+        {"digest",        required_argument, NULL, OPT_DIGEST},
+        {"help",          no_argument,       NULL, 'h'},
+        {NULL,            0,                 NULL, 0},
+    };
+    uint32_t pipeline_id = cfg->pipeline_id;
+    int ret = NO_ERROR;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "o:p:n:m:g:M:b:O:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'o': cfg->program = optarg; break;
+            case 'p': ret = parse_uint(optarg, 1, UINT32_MAX, &pipeline_id); break;
+            case 'n': ret = parse_uint(optarg, 1, MAX_SCALE, &cfg->scale); break;
+            case 'm': ret = parse_uint(optarg, 1, MAX_TERNARY_MASKS, &cfg->ternary_masks); break;
+            case 'g': ret = parse_uint(optarg, 1, UINT32_MAX - FIRST_PRE_GROUP_ID, &cfg->pre_groups); break;
+            case 'M': ret = parse_uint(optarg, 1, UINT16_MAX, &cfg->pre_members); break;
+            case 'b': cfg->benchmarks = optarg; break;
+            case 'O': *output = optarg; break;
+            case OPT_EXACT_TABLE: cfg->exact_table = optarg; break;
+            case OPT_LPM_TABLE: cfg->lpm_table = optarg; break;
+            case OPT_TERNARY_TABLE: cfg->ternary_table = optarg; break;
+            case OPT_ACTION: cfg->action = optarg; break;
+            case OPT_COUNTER: cfg->counter = optarg; break;
+            case OPT_METER: cfg->meter = optarg; break;
+            case OPT_DIGEST: cfg->digest = optarg; break;
+            case 'h':
+                print_help();
+                exit(0);
+            default:
+                print_help();
+                return EINVAL;
+        }
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+    }
+    if (optind < argc) {
+        fprintf(stderr, "%s: unused argument\n", argv[optind]);
+        return EINVAL;
+    }
+    cfg->pipeline_id = pipeline_id;
+
+    return NO_ERROR;
+}
+
+int main(int argc, char **argv)
+{
+    bench_config_t cfg = {
+        .program = NULL,
+        .pipeline_id = DEFAULT_PIPELINE_ID,
+        .scale = DEFAULT_SCALE,
+        .ternary_masks = DEFAULT_TERNARY_MASKS,
+        .pre_groups = DEFAULT_PRE_GROUPS,
+        .pre_members = DEFAULT_PRE_MEMBERS,
+        .exact_table = "ingress_tbl_exact",
+        .lpm_table = "ingress_tbl_lpm",
+        .ternary_table = "ingress_tbl_ternary",
+        .action = "ingress_do_forward",
+        .counter = "ingress_counter",
+        .meter = "ingress_meter",
+        .digest = "mac_learn_digest",
+        .benchmarks = NULL,
+    };
+    const char *output = NULL;
+    nikss_context_t ctx;
+    json_t *report = NULL;
+    FILE *out = stdout;
+    bool pipeline_loaded = false;
+
+    if (argc > 0) {
+        program_name = argv[0];
+    }
+
+    int ret = parse_options(argc, argv, &cfg, &output);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+
+    nikss_context_init(&ctx);
+    nikss_context_set_pipeline(&ctx, cfg.pipeline_id);
+
+    if (cfg.program != NULL) {
+        if (nikss_pipeline_exists(&ctx)) {
+            fprintf(stderr, "pipeline with ID %u already exists\n", cfg.pipeline_id);
+            ret = EEXIST;
+            goto clean_up;
+        }
+        ret = nikss_pipeline_load(&ctx, cfg.program);
+        if (ret != NO_ERROR) {
+            fprintf(stderr, "failed to load %s: %s\n", cfg.program, strerror(ret));
+            goto clean_up;
+        }
+        pipeline_loaded = true;
+    } else if (!nikss_pipeline_exists(&ctx)) {
+        fprintf(stderr, "pipeline with ID %u does not exist\n", cfg.pipeline_id);
+        ret = ENOENT;
+        goto clean_up;
+    }
+
+    report = run_benchmarks(&ctx, &cfg);
+    if (report == NULL) {
+        fprintf(stderr, "failed to prepare results\n");
+        ret = ENOMEM;
+        goto clean_up;
+    }
+
+    if (output != NULL) {
+        out = fopen(output, "w");
+        if (out == NULL) {
+            ret = errno;
+            fprintf(stderr, "failed to open %s: %s\n", output, strerror(ret));
+            goto clean_up;
+        }
+    }
+    json_dumpf(report, out, JSON_INDENT(4));
+    fprintf(out, "\n");
+    if (out != stdout) {
+        fclose(out);
+    }
+
+clean_up:
+    if (report != NULL) {
+        json_decref(report);
+    }
+    if (pipeline_loaded) {
+        int unload_ret = nikss_pipeline_unload(&ctx);
+        if (unload_ret != NO_ERROR) {
+            fprintf(stderr, "failed to unload pipeline: %s\n", strerror(unload_ret));
+        }
+    }
+    nikss_context_free(&ctx);
+
+    return ret;
+}
@@ -36,6 +36,8 @@ typedef struct nikss_btf {
     void * btf;
     /* To create bpf maps with BTF info */
     int btf_fd;
+    /* Reference to parsed BTF shared between contexts, see load_btf() */
+    void *handle;
 } nikss_btf_t;
 
 typedef struct nikss_bpf_map_descriptor {
@@ -44,6 +46,7 @@ typedef struct nikss_bpf_map_descriptor {
     uint32_t key_size;
     uint32_t value_size;
     uint32_t max_entries;
+    uint32_t map_flags;
     /* Effective type IDs for key/value */
     uint32_t key_type_id;
     uint32_t value_type_id;
@@ -63,6 +66,11 @@ typedef uint32_t nikss_pipeline_id_t;
  */
 typedef struct nikss_context {
     nikss_pipeline_id_t pipeline_id;
+
+    /* Shared by all the objects opened with this context, released by nikss_context_free()
+     * or when pipeline is changed. Objects may be still used after that. */
+    nikss_btf_t btf;
+    void *map_cache;
 } nikss_context_t;
 
 /**
@@ -86,6 +94,34 @@ void nikss_context_free(nikss_context_t *ctx);
 void nikss_context_set_pipeline(nikss_context_t *ctx, nikss_pipeline_id_t pipeline_id);
 nikss_pipeline_id_t nikss_context_get_pipeline(nikss_context_t *ctx);
 
+/**
+ * Keep BTF metadata parsed by object contexts in memory for the whole process, so that
+ * long-running processes do not parse them again for every opened object. BTF is
+ * identified by its kernel ID, so reloaded pipeline is not affected by old entries.
+ * The number of cached BTF objects is limited and the cache is emptied when a pipeline
+ * is unloaded (also by replace), so BTF of removed programs is not kept in kernel.
+ * Disabling the cache releases it, contexts using cached BTF keep their references.
+ * Not thread safe.
+ */
+void nikss_btf_cache_enable(bool enable);
+bool nikss_btf_cache_is_enabled(void);
+
+/**
+ * Bump allocator for objects released together, e.g. table entries built or read in bulk.
+ * Memory is released only by reset (which keeps allocated chunks for reuse) or free.
+ */
+typedef struct nikss_arena {
+    void *first_chunk;
+    void *current_chunk;
+    void *last_chunk;
+    size_t chunk_size;
+} nikss_arena_t;
+
+/* chunk_size equal to 0 selects the default size */
+void nikss_arena_init(nikss_arena_t *arena, size_t chunk_size);
+void nikss_arena_reset(nikss_arena_t *arena);
+void nikss_arena_free(nikss_arena_t *arena);
+
 typedef enum nikss_struct_field_type {
     NIKSS_STRUCT_FIELD_TYPE_UNKNOWN = 0,
     NIKSS_STRUCT_FIELD_TYPE_DATA,
@@ -147,6 +183,11 @@ typedef struct nikss_counter_entry {
 
     nikss_counter_value_t bytes;
     nikss_counter_value_t packets;
+
+    /* Per-CPU values, filled only when breakdown is requested for a per-CPU counter */
+    size_t n_cpus;
+    nikss_counter_value_t *percpu_bytes;
+    nikss_counter_value_t *percpu_packets;
 } nikss_counter_entry_t;
 
 typedef struct nikss_counter_context {
@@ -158,11 +199,15 @@ typedef struct nikss_counter_context {
 
     nikss_counter_entry_t current_entry;
     void *prev_entry_key;
+
+    bool percpu_breakdown;
 } nikss_counter_context_t;
 
 void nikss_counter_ctx_init(nikss_counter_context_t *ctx);
 void nikss_counter_ctx_free(nikss_counter_context_t *ctx);
 int nikss_counter_ctx_name(nikss_context_t *nikss_ctx, nikss_counter_context_t *ctx, const char *name);
+/* Opens the same counter as src without parsing its metadata again, src may be freed before dst */
+int nikss_counter_ctx_clone(nikss_counter_context_t *dst, const nikss_counter_context_t *src);
 
 void nikss_counter_entry_init(nikss_counter_entry_t *entry);
 void nikss_counter_entry_free(nikss_counter_entry_t *entry);
@@ -173,6 +218,13 @@ int nikss_counter_entry_set_key(nikss_counter_entry_t *entry, const void *data,
 nikss_struct_field_t *nikss_counter_entry_get_next_key(nikss_counter_context_t *ctx, nikss_counter_entry_t *entry);
 
 nikss_counter_type_t nikss_counter_get_type(nikss_counter_context_t *ctx);
+/* Counters backed by a per-CPU map are always read as a sum over all CPUs. When breakdown
+ * is enabled, values of each CPU are also available through nikss_counter_entry_get_cpu_*(). */
+bool nikss_counter_is_percpu(nikss_counter_context_t *ctx);
+void nikss_counter_ctx_percpu_breakdown(nikss_counter_context_t *ctx, bool enable);
+size_t nikss_counter_entry_get_n_cpus(nikss_counter_entry_t *entry);
+nikss_counter_value_t nikss_counter_entry_get_cpu_packets(nikss_counter_entry_t *entry, size_t cpu);
+nikss_counter_value_t nikss_counter_entry_get_cpu_bytes(nikss_counter_entry_t *entry, size_t cpu);
 void nikss_counter_entry_set_packets(nikss_counter_entry_t *entry, nikss_counter_value_t packets);
 void nikss_counter_entry_set_bytes(nikss_counter_entry_t *entry, nikss_counter_value_t bytes);
 nikss_counter_value_t nikss_counter_entry_get_packets(nikss_counter_entry_t *entry);
@@ -183,6 +235,55 @@ nikss_counter_entry_t *nikss_counter_get_next(nikss_counter_context_t *ctx);
 int nikss_counter_set(nikss_counter_context_t *ctx, nikss_counter_entry_t *entry);
 int nikss_counter_reset(nikss_counter_context_t *ctx, nikss_counter_entry_t *entry);
 
+/*
+ * Counter snapshot: the whole counter is read in one batched pass into packed arrays.
+ * Each subsequent nikss_counter_snapshot_update() records which entries changed since
+ * the previous one and which were removed, so only these have to be exported. Entries
+ * are matched by key. On the first update every entry is reported as changed.
+ */
+typedef struct nikss_counter_snapshot {
+    size_t n_entries;
+    size_t capacity;
+    size_t key_size;
+    char *keys;
+    nikss_counter_value_t *bytes;
+    nikss_counter_value_t *packets;
+    /* Indexes of entries sorted by key */
+    size_t *order;
+
+    /* State of the previous update, used to find changed entries */
+    size_t n_prev_entries;
+    char *prev_keys;
+    nikss_counter_value_t *prev_bytes;
+    nikss_counter_value_t *prev_packets;
+    size_t *prev_order;
+
+    size_t n_changed;
+    size_t *changed;
+    /* Indexes of entries of the previous update */
+    size_t n_removed;
+    size_t *removed;
+
+    /* Raw buffers for batched lookup, values are read in chunks */
+    size_t chunk_size;
+    char *raw_values;
+    void *batch_token;
+} nikss_counter_snapshot_t;
+
+void nikss_counter_snapshot_init(nikss_counter_snapshot_t *snapshot);
+void nikss_counter_snapshot_free(nikss_counter_snapshot_t *snapshot);
+int nikss_counter_snapshot_update(nikss_counter_context_t *ctx, nikss_counter_snapshot_t *snapshot);
+size_t nikss_counter_snapshot_get_size(nikss_counter_snapshot_t *snapshot);
+size_t nikss_counter_snapshot_get_n_changed(nikss_counter_snapshot_t *snapshot);
+/* Returns index of i-th changed entry, which may be passed to nikss_counter_snapshot_get_entry() */
+size_t nikss_counter_snapshot_get_changed(nikss_counter_snapshot_t *snapshot, size_t i);
+int nikss_counter_snapshot_get_entry(nikss_counter_context_t *ctx, nikss_counter_snapshot_t *snapshot,
+                                     size_t index, nikss_counter_entry_t *entry);
+/* Entries present in the previous update but not in the last one, with their last values */
+size_t nikss_counter_snapshot_get_n_removed(nikss_counter_snapshot_t *snapshot);
+int nikss_counter_snapshot_get_removed(nikss_counter_context_t *ctx, nikss_counter_snapshot_t *snapshot,
+                                       size_t i, nikss_counter_entry_t *entry);
+
 /*
  * P4 Registers
  */
@@ -194,6 +295,8 @@ typedef struct nikss_register_entry {
     char *raw_value;
     size_t current_field_id;
     nikss_struct_field_t current_field;
+    /* For per-CPU registers: CPU slot returned by nikss_register_get_next_value_field() */
+    size_t current_cpu;
 } nikss_register_entry_t;
 
 typedef struct nikss_register_context {
@@ -203,8 +306,21 @@ typedef struct nikss_register_context {
     nikss_struct_field_descriptor_set_t value_fds;
     nikss_register_entry_t current_entry;
     void *prev_entry_key;
+
+    /* Memory mapped cells, see nikss_register_map() */
+    void *mmap_base;
+    size_t mmap_size;
 } nikss_register_context_t;
 
+/* Direct view of register cells shared with the data plane. Cell i starts at
+ * cells + i * cell_size and holds value_size bytes in the data plane format. */
+typedef struct nikss_register_view {
+    char *cells;
+    size_t n_cells;
+    size_t cell_size;
+    size_t value_size;
+} nikss_register_view_t;
+
 void nikss_register_ctx_init(nikss_register_context_t *ctx);
 void nikss_register_ctx_free(nikss_register_context_t *ctx);
 int nikss_register_ctx_name(nikss_context_t *nikss_ctx, nikss_register_context_t *ctx, const char *name);
@@ -218,14 +334,32 @@ int nikss_register_entry_set_value(nikss_register_entry_t *entry, const void *da
 nikss_struct_field_t * nikss_register_get_next_index_field(nikss_register_context_t *ctx, nikss_register_entry_t *entry);
 nikss_struct_field_t * nikss_register_get_next_value_field(nikss_register_context_t *ctx, nikss_register_entry_t *entry);
 
+/* Registers backed by a per-CPU map are written with the same value on every CPU. On read,
+ * value of CPU 0 is returned unless another CPU is selected with nikss_register_entry_select_cpu(). */
+size_t nikss_register_get_n_cpus(nikss_register_context_t *ctx);
+int nikss_register_entry_select_cpu(nikss_register_context_t *ctx, nikss_register_entry_t *entry, size_t cpu);
+
 int nikss_register_get(nikss_register_context_t *ctx, nikss_register_entry_t *entry);
 int nikss_register_set(nikss_register_context_t *ctx, nikss_register_entry_t *entry);
 
+/* Raw access to n_cells consecutive cells starting at first_index. Register must be indexed with
+ * a 32-bit integer. Values are packed, value size bytes each, in the data plane format. Memory
+ * mapped cells are used when possible, otherwise batch operations are used. Per-CPU registers
+ * are read from CPU 0 and written with the same value on every CPU. */
+size_t nikss_register_get_value_size(nikss_register_context_t *ctx);
+int nikss_register_read_range(nikss_register_context_t *ctx, uint32_t first_index, uint32_t n_cells, void *values);
+int nikss_register_write_range(nikss_register_context_t *ctx, uint32_t first_index, uint32_t n_cells,
+                               const void *values);
+/* Maps register cells into memory, so they can be accessed without syscalls. Works only for
+ * array registers created with BPF_F_MMAPABLE flag. Mapping is valid until context is freed. */
+int nikss_register_map(nikss_register_context_t *ctx, nikss_register_view_t *view);
+
 /*
  * P4 Meters
  */
 
 typedef uint64_t nikss_meter_value_t;
+typedef uint32_t nikss_meter_profile_id_t;
 
 typedef struct nikss_meter_entry {
     nikss_struct_field_set_t index_sfs;
@@ -237,6 +371,9 @@ typedef struct nikss_meter_entry {
     nikss_meter_value_t pir;
     nikss_meter_value_t cbs;
     nikss_meter_value_t cir;
+
+    /* When not 0 configuration is taken from the profile */
+    nikss_meter_profile_id_t profile_id;
 } nikss_meter_entry_t;
 
 typedef struct nikss_meter_ctx {
@@ -246,6 +383,13 @@ typedef struct nikss_meter_ctx {
 
     nikss_meter_entry_t current_entry;
     void *previous_index;
+
+    /* Maps with profiles defined with nikss_meter_profile_update() and with profile of every
+     * instance. They are shared by all contexts of the meter, fd is -1 when not opened yet. */
+    nikss_bpf_map_descriptor_t profiles;
+    nikss_bpf_map_descriptor_t instance_profiles;
+    nikss_pipeline_id_t pipeline_id;
+    char *name;
 } nikss_meter_ctx_t;
 
 void nikss_meter_entry_init(nikss_meter_entry_t *entry);
@@ -267,13 +411,48 @@ nikss_struct_field_t * nikss_meter_entry_get_next_index_field(nikss_meter_ctx_t
 void nikss_meter_ctx_init(nikss_meter_ctx_t *ctx);
 void nikss_meter_ctx_free(nikss_meter_ctx_t *ctx);
 int nikss_meter_ctx_name(nikss_meter_ctx_t *ctx, nikss_context_t *nikss_ctx, const char *name);
+/* Opens the same meter as src without parsing its metadata again, src may be freed before dst */
+int nikss_meter_ctx_clone(nikss_meter_ctx_t *dst, const nikss_meter_ctx_t *src);
 int nikss_meter_entry_get(nikss_meter_ctx_t *ctx, nikss_meter_entry_t *entry);
 nikss_meter_entry_t *nikss_meter_get_next(nikss_meter_ctx_t *ctx);
 int nikss_meter_entry_update(nikss_meter_ctx_t *ctx, nikss_meter_entry_t *entry);
+
+/* Configuration of meter instance for batch update. Only meters indexed by a single integer field are supported. */
+typedef struct nikss_meter_batch_entry {
+    uint32_t index;
+    nikss_meter_value_t pir;
+    nikss_meter_value_t pbs;
+    nikss_meter_value_t cir;
+    nikss_meter_value_t cbs;
+} nikss_meter_batch_entry_t;
+
+int nikss_meter_entry_update_batch(nikss_meter_ctx_t *ctx, const nikss_meter_batch_entry_t *entries, size_t n_entries);
+/* Applies configuration from profile (index is ignored) to all instances from first_index to last_index. */
+int nikss_meter_entry_update_range(nikss_meter_ctx_t *ctx, uint32_t first_index, uint32_t last_index,
+                                   const nikss_meter_entry_t *profile);
 /* When entry is null or nikss_meter_entry_index() has not been executed before
  * on meter entry then resets all entries in meter. */
 int nikss_meter_entry_reset(nikss_meter_ctx_t *ctx, nikss_meter_entry_t *entry);
 
+/* Meter profiles. Configuration shared by many meter instances is kept in a map pinned next to the
+ * pipeline, together with a map of instances using it, so profiles are shared by all processes and
+ * contexts of the meter. Instance gets a profile when it's updated with profile ID set by
+ * nikss_meter_entry_profile(). Profile can't be deleted while any instance uses it. */
+int nikss_meter_profile_update(nikss_meter_ctx_t *ctx, nikss_meter_profile_id_t profile_id,
+                               nikss_meter_value_t pir,
+                               nikss_meter_value_t pbs,
+                               nikss_meter_value_t cir,
+                               nikss_meter_value_t cbs);
+int nikss_meter_profile_delete(nikss_meter_ctx_t *ctx, nikss_meter_profile_id_t profile_id);
+int nikss_meter_profile_get(nikss_meter_ctx_t *ctx, nikss_meter_profile_id_t profile_id,
+                            nikss_meter_value_t *pir,
+                            nikss_meter_value_t *pbs,
+                            nikss_meter_value_t *cir,
+                            nikss_meter_value_t *cbs);
+size_t nikss_meter_profile_get_n_instances(nikss_meter_ctx_t *ctx, nikss_meter_profile_id_t profile_id);
+void nikss_meter_entry_profile(nikss_meter_entry_t *entry, nikss_meter_profile_id_t profile_id);
+nikss_meter_profile_id_t nikss_meter_entry_get_profile(nikss_meter_entry_t *entry);
+
 /*
  * Tables
  */
@@ -337,6 +516,7 @@ typedef struct nikss_action {
 
     size_t n_params;
     nikss_action_param_t *params;
+    bool params_from_arena;
 } nikss_action_t;
 
 typedef struct nikss_direct_counter_entry {
@@ -394,6 +574,9 @@ typedef struct nikss_table_entry {
     size_t n_direct_meters;
     nikss_direct_meter_entry_t *direct_meters;
 
+    /* When set, match keys and action are allocated from the arena */
+    nikss_arena_t *arena;
+
     /* For iteration over entry data */
     size_t current_match_key_id;
     nikss_match_key_t current_match_key;
@@ -405,6 +588,50 @@ typedef struct nikss_table_entry {
     nikss_direct_meter_context_t current_direct_meter_ctx;
 } nikss_table_entry_t;
 
+/* Layout of table key and value resolved from BTF once per table, so encoding
+ * and decoding of entries does not have to walk BTF types. */
+typedef struct nikss_table_codec_field {
+    size_t offset;
+    size_t size;
+    bool network_order;  /* fields wider than 64 bits */
+    enum nikss_matchkind_t match_kind;  /* key fields only; ternary is resolved from mask */
+} nikss_table_codec_field_t;
+
+typedef struct nikss_table_codec_action {
+    size_t n_params;
+    nikss_table_codec_field_t *params;
+} nikss_table_codec_action_t;
+
+/* Field of cache key and the field of table key with the same name */
+typedef struct nikss_table_codec_cache_field {
+    size_t cache_offset;
+    size_t key_offset;
+    size_t size;
+} nikss_table_codec_cache_field_t;
+
+typedef struct nikss_table_codec {
+    /* struct key */
+    bool key_compiled;
+    bool has_lpm_prefix;
+    nikss_table_codec_field_t lpm_prefix;
+    size_t n_key_fields;
+    nikss_table_codec_field_t *key_fields;
+
+    /* direct action value */
+    bool value_compiled;
+    bool has_action_id;
+    nikss_table_codec_field_t action_id;
+    bool has_priority;
+    nikss_table_codec_field_t priority;
+    size_t n_actions;
+    nikss_table_codec_action_t *actions;
+
+    /* struct key of cache, to invalidate only cache entries which may be matched by a changed entry */
+    bool cache_key_compiled;
+    size_t n_cache_key_fields;
+    nikss_table_codec_cache_field_t *cache_key_fields;
+} nikss_table_codec_t;
+
 /*
  * TODO: specific fields of table entry context are still to be added.
  * The table entry context may store information about a table itself (e.g. key size, num of entries, etc.).
@@ -422,6 +649,13 @@ typedef struct nikss_table_entry_context {
 
     /* for cache maintenance */
     nikss_bpf_map_descriptor_t cache;
+    /* optional, when present the cache is invalidated by incrementing epoch instead of clearing it */
+    nikss_bpf_map_descriptor_t cache_epoch;
+
+    /* optional DIR-24-8 leaves and routes of LPM table, kept in sync with it */
+    nikss_bpf_map_descriptor_t dir24;
+    nikss_bpf_map_descriptor_t dir24_tbl8;
+    nikss_bpf_map_descriptor_t dir24_routes;
 
     nikss_btf_t btf_metadata;
 
@@ -433,6 +667,10 @@ typedef struct nikss_table_entry_context {
     size_t n_direct_meters;
     nikss_direct_meter_context_t *direct_meters_ctx;
 
+    /* 64-bit "last_hit" member of value, time of the last match written by the data plane */
+    bool has_last_hit;
+    size_t last_hit_offset;
+
     /* ActionSelector and ActionProfile
      * TODO: use this to construct value*/
     nikss_struct_field_descriptor_set_t table_implementations;
@@ -442,6 +680,68 @@ typedef struct nikss_table_entry_context {
     void *current_raw_key;
     void *current_raw_key_mask;
     nikss_table_entry_t current_entry;
+
+    /* for iteration over table in chunks, enabled when batch_size is not 0 */
+    uint32_t batch_size;
+    char *batch_keys;
+    char *batch_values;
+    void *batch_token;
+    uint32_t batch_count;
+    uint32_t batch_position;
+    bool batch_started;
+    bool batch_finished;
+    bool batch_not_supported;
+
+    /* for iteration over ternary table with many tuples read at once,
+     * enabled when tuple_threads is greater than 1 */
+    uint32_t tuple_threads;
+    struct nikss_ternary_tuple_dump *tuple_dumps;
+    uint32_t n_tuple_dumps;
+    uint32_t tuple_dump_index;
+    uint32_t tuple_dump_position;
+    bool tuple_dumps_loaded;
+
+    /* userspace copy of the prefixes list of ternary table, in the list order
+     * (first one is the head); used only when prefix_cache_valid is true */
+    char *prefix_cache_keys;
+    char *prefix_cache_values;
+    /* highest entry priority in each tuple, computed only when sort_tuples is set */
+    uint32_t *prefix_cache_priorities;
+    uint32_t prefix_cache_count;
+    uint32_t prefix_cache_capacity;
+    bool prefix_cache_valid;
+    /* priorities were computed for the cached tuples, so a reload reads only tuples of changed prefixes */
+    bool prefix_cache_has_priorities;
+
+    /* keep prefixes list sorted by the highest priority in tuples */
+    bool sort_tuples;
+
+    /* size of new tuples, 0 means the size of the table */
+    uint32_t tuple_initial_size;
+    /* NUMA node of new tuples given at pipeline load, negative if not set */
+    int tuple_numa_node;
+
+    /* compiled in nikss_table_entry_ctx_tblname() */
+    nikss_table_codec_t codec;
+
+    /* entries returned by nikss_table_entry_get_next() are allocated from here when enabled */
+    nikss_arena_t entry_arena;
+    bool use_entry_arena;
+
+    /* serialize changes of ternary table with other threads and processes */
+    bool thread_safe;
+    nikss_pipeline_id_t pipeline_id;
+    /* context which owns metadata for contexts created by nikss_table_entry_ctx_clone() */
+    const struct nikss_table_entry_context *clone_source;
+
+    /* queues and worker of nikss_table_entry_async_submit(), created by nikss_table_entry_ctx_async_start() */
+    struct nikss_table_async *async;
+
+    /* userspace copy of the table, enabled by nikss_table_entry_ctx_shadow() */
+    struct nikss_table_shadow *shadow;
+
+    /* scan state of nikss_table_entry_ctx_aging_step(), created by nikss_table_entry_ctx_aging_start() */
+    struct nikss_table_aging *aging;
 } nikss_table_entry_ctx_t;
 
 void nikss_table_entry_ctx_init(nikss_table_entry_ctx_t *ctx);
@@ -450,9 +750,55 @@ int nikss_table_entry_ctx_tblname(nikss_context_t *nikss_ctx, nikss_table_entry_
 void nikss_table_entry_ctx_mark_indirect(nikss_table_entry_ctx_t *ctx);
 bool nikss_table_entry_ctx_is_indirect(nikss_table_entry_ctx_t *ctx);
 bool nikss_table_entry_ctx_has_priority(nikss_table_entry_ctx_t *ctx);
+/* Sizes of key and value in the layout used by the raw entry API */
+size_t nikss_table_entry_ctx_get_key_size(nikss_table_entry_ctx_t *ctx);
+size_t nikss_table_entry_ctx_get_value_size(nikss_table_entry_ctx_t *ctx);
+/* Number of entries read at once by nikss_table_entry_get_next(), 0 disables reading in chunks.
+ * Falls back to reading entry by entry when kernel or table does not support it. */
+int nikss_table_entry_ctx_batch_size(nikss_table_entry_ctx_t *ctx, uint32_t batch_size);
+/* Ternary tables only. When enabled, new tuples are inserted into the list of tuples after all tuples
+ * with the same or higher priority of entries. Priorities of tuples are read once per context, entries
+ * added to existing tuples by other contexts are taken into account by rebalance, which restores this
+ * order when priorities change. */
+int nikss_table_entry_ctx_sort_tuples(nikss_table_entry_ctx_t *ctx, bool enable);
+int nikss_table_entry_ctx_rebalance_tuples(nikss_table_entry_ctx_t *ctx);
+/* Ternary tables only. Every tuple is opened once and read in chunks of batch_size entries, one tuple after
+ * another. When threads is greater than 1, nikss_table_entry_get_next() reads all the tuples at the beginning
+ * of iteration using up to this number of threads, then entries are returned from memory. */
+int nikss_table_entry_ctx_tuple_threads(nikss_table_entry_ctx_t *ctx, uint32_t threads);
+/* Ternary tables only. New tuples are created for max_entries entries instead of the size of the table and grow
+ * twice every time they are full, up to the size of the table. 0 (default) creates tuples with the full size.
+ * Falls back to the full size when kernel requires inner maps of the same size as the one from the program. */
+int nikss_table_entry_ctx_tuple_initial_size(nikss_table_entry_ctx_t *ctx, uint32_t max_entries);
+
+typedef struct nikss_tuple_compaction_stats {
+    uint32_t n_tuples;
+    uint32_t removed_tuples;
+    uint32_t moved_tuples;
+    uint32_t resized_tuples;
+} nikss_tuple_compaction_stats_t;
+
+/* Ternary tables only. Removes tuples without entries, moves remaining tuples to the lowest free tuple ids
+ * and, when tuple_initial_size is set, shrinks tuples which use less than a quarter of their size. Tuple ids
+ * of removed tuples are also reused when new tuples are added. Stats might be NULL. */
+int nikss_table_entry_ctx_compact_tuples(nikss_table_entry_ctx_t *ctx, nikss_tuple_compaction_stats_t *stats);
+/* Entries returned by nikss_table_entry_get_next() reuse memory of the previous entry instead of
+ * allocating it again. Entry stays valid until the next call, as without the arena. */
+int nikss_table_entry_ctx_use_arena(nikss_table_entry_ctx_t *ctx, bool enable);
+/* Changes of ternary tables (adding and removing tuples) are serialized with a lock on the directory of
+ * the pipeline in bpffs, which excludes other threads and processes. Other tables do not need it.
+ * The cache of prefixes is validated again every time the lock is taken. */
+int nikss_table_entry_ctx_thread_safe(nikss_table_entry_ctx_t *ctx, bool enable);
+/* Creates a context for another thread without opening the table again: maps get new file descriptors and
+ * metadata is shared with src, which must not be freed before its clones. Every clone has its own state
+ * of iteration and is thread safe. One context must not be used by many threads at the same time. */
+int nikss_table_entry_ctx_clone(nikss_table_entry_ctx_t *dst, const nikss_table_entry_ctx_t *src);
 
 void nikss_table_entry_init(nikss_table_entry_t *entry);
 void nikss_table_entry_free(nikss_table_entry_t *entry);
+/* Must be called before any key or action is added. Memory from the arena is not released by
+ * nikss_table_entry_free(), but by nikss_arena_reset() or nikss_arena_free(), so entry must be freed before. */
+int nikss_table_entry_use_arena(nikss_table_entry_t *entry, nikss_arena_t *arena);
 
 /* can be invoked multiple times */
 int nikss_table_entry_matchkey(nikss_table_entry_t *entry, nikss_match_key_t *mk);
@@ -509,12 +855,186 @@ const char *nikss_action_get_name(nikss_table_entry_ctx_t *ctx, uint32_t action_
 int nikss_table_entry_add(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry);
 int nikss_table_entry_update(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry);
 int nikss_table_entry_del(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry);
+/* Removes all entries, the same as nikss_table_entry_del() with entry without key. Maps are cleared
+ * with batch operations when possible; lookup in ternary table stops matching before its tuples are removed. */
+int nikss_table_clear(nikss_table_entry_ctx_t *ctx);
 int nikss_table_entry_get(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry);
 nikss_table_entry_t *nikss_table_entry_get_next(nikss_table_entry_ctx_t *ctx);
 
+/* Raw entries: key, mask and value are already encoded as stored in the BPF map (no BTF conversions).
+ * Mask is required only for ternary tables, priority is read from the value. Entry is optional and
+ * provides direct counters and meters (and priority when it is not part of the value). */
+int nikss_table_entry_add_raw(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry,
+                              const void *key, const void *mask, const void *value);
+int nikss_table_entry_update_raw(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry,
+                                 const void *key, const void *mask, const void *value);
+int nikss_table_entry_del_raw(nikss_table_entry_ctx_t *ctx, const void *key, const void *mask);
+/* Value must have space for nikss_table_entry_ctx_get_value_size() bytes */
+int nikss_table_entry_get_raw(nikss_table_entry_ctx_t *ctx, const void *key, const void *mask, void *value);
+
+/*
+ * Fast dump of direct counters and meters, e.g. for periodic telemetry. Entries are read in batches and
+ * only direct objects are decoded from values, actions and keys are not. Restarts iteration done with
+ * nikss_table_entry_get_next().
+ */
+typedef struct nikss_direct_counter_value {
+    const char *name;
+    nikss_counter_type_t type;
+    nikss_counter_value_t bytes;
+    nikss_counter_value_t packets;
+} nikss_direct_counter_value_t;
+
+typedef struct nikss_direct_meter_value {
+    const char *name;
+    nikss_meter_value_t pir;
+    nikss_meter_value_t pbs;
+    nikss_meter_value_t cir;
+    nikss_meter_value_t cbs;
+} nikss_direct_meter_value_t;
+
+/* Valid only during the callback */
+typedef struct nikss_table_direct_objects_entry {
+    /* Key and mask in the layout of the raw entry API, mask is NULL for tables other than ternary */
+    const void *key;
+    size_t key_size;
+    const void *mask;
+    size_t mask_size;
+    size_t n_counters;
+    const nikss_direct_counter_value_t *counters;
+    size_t n_meters;
+    const nikss_direct_meter_value_t *meters;
+} nikss_table_direct_objects_entry_t;
+
+/* Non-zero return value stops the dump and is returned */
+typedef int (*nikss_table_direct_objects_cb_t)(const nikss_table_direct_objects_entry_t *entry, void *arg);
+
+int nikss_table_entry_ctx_dump_direct_objects(nikss_table_entry_ctx_t *ctx, nikss_table_direct_objects_cb_t cb,
+                                              void *arg);
+
 int nikss_table_entry_set_default_entry(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry);
 int nikss_table_entry_get_default_entry(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry);
 
+/* Batch of table entries, written to the table with a few syscalls */
+typedef struct nikss_table_entry_batch {
+    size_t n_entries;
+    size_t capacity;
+    nikss_table_entry_t *entries;
+    int *results;
+} nikss_table_entry_batch_t;
+
+void nikss_table_entry_batch_init(nikss_table_entry_batch_t *batch);
+void nikss_table_entry_batch_free(nikss_table_entry_batch_t *batch);
+/* Moves entry into the batch, entry is re-initialized and can be reused */
+int nikss_table_entry_batch_append(nikss_table_entry_batch_t *batch, nikss_table_entry_t *entry);
+size_t nikss_table_entry_batch_get_size(nikss_table_entry_batch_t *batch);
+/* Result of the last operation for idx-th appended entry */
+int nikss_table_entry_batch_get_result(nikss_table_entry_batch_t *batch, size_t idx);
+
+/* Return NO_ERROR when every entry succeeded, otherwise error code of the first failed entry.
+ * For ternary tables consecutive entries with the same mask are committed together,
+ * so group such entries to get the best performance. */
+int nikss_table_entry_batch_add(nikss_table_entry_ctx_t *ctx, nikss_table_entry_batch_t *batch);
+int nikss_table_entry_batch_update(nikss_table_entry_ctx_t *ctx, nikss_table_entry_batch_t *batch);
+int nikss_table_entry_batch_del(nikss_table_entry_ctx_t *ctx, nikss_table_entry_batch_t *batch);
+
+/*
+ * Shadow table: userspace copy of the table content, loaded when enabled and kept up to date by writes
+ * done with this context. nikss_table_entry_get() is served from the copy and updates which would not
+ * change an entry are skipped. Writes made by other contexts (including clones and asynchronous writes)
+ * or processes are found by reconcile. Not supported for ternary tables and tables with direct objects.
+ */
+int nikss_table_entry_ctx_shadow(nikss_table_entry_ctx_t *ctx, bool enable);
+size_t nikss_table_entry_ctx_shadow_size(nikss_table_entry_ctx_t *ctx);
+/* True when the shadow has entry with the same key and value, entry is encoded but not written */
+bool nikss_table_entry_shadow_equal(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry);
+
+typedef enum nikss_table_shadow_diff_type {
+    /* present only in the kernel */
+    NIKSS_TABLE_SHADOW_ENTRY_ADDED,
+    /* present only in the shadow */
+    NIKSS_TABLE_SHADOW_ENTRY_REMOVED,
+    NIKSS_TABLE_SHADOW_ENTRY_CHANGED,
+} nikss_table_shadow_diff_type_t;
+
+/* Key and values in the layout of the BPF map, the same as used by the raw entry API */
+typedef struct nikss_table_shadow_diff {
+    nikss_table_shadow_diff_type_t type;
+    const void *key;
+    size_t key_size;
+    /* NULL when entry is added */
+    const void *shadow_value;
+    /* NULL when entry is removed */
+    const void *kernel_value;
+    size_t value_size;
+} nikss_table_shadow_diff_t;
+
+/* Non-zero return value stops comparison and is returned */
+typedef int (*nikss_table_shadow_diff_cb_t)(const nikss_table_shadow_diff_t *diff, void *arg);
+
+/* Reads the table and reports differences from the shadow, then the shadow is replaced with content of
+ * the table. cb may be NULL to only refresh the shadow. */
+int nikss_table_entry_ctx_shadow_reconcile(nikss_table_entry_ctx_t *ctx, nikss_table_shadow_diff_cb_t cb, void *arg);
+
+/*
+ * Asynchronous table writes. Submitted entries are queued and written by a worker thread of the context,
+ * which coalesces consecutive requests of the same type into batch operations. Results are delivered
+ * through a completion queue; its eventfd is readable whenever there are completions to poll.
+ */
+typedef enum nikss_table_async_op {
+    NIKSS_TABLE_ASYNC_ADD,
+    NIKSS_TABLE_ASYNC_UPDATE,
+    NIKSS_TABLE_ASYNC_DELETE,
+} nikss_table_async_op_t;
+
+typedef struct nikss_table_async_completion {
+    uint64_t cookie;
+    nikss_table_async_op_t op;
+    int result;
+} nikss_table_async_completion_t;
+
+/* Worker writes at most max_batch entries at once, 0 means the default. The context becomes thread safe. */
+int nikss_table_entry_ctx_async_start(nikss_table_entry_ctx_t *ctx, uint32_t max_batch);
+/* eventfd of the completion queue, -1 when asynchronous writes are not started */
+int nikss_table_entry_ctx_async_fd(nikss_table_entry_ctx_t *ctx);
+/* Moves entry into the queue, entry is re-initialized and can be reused. Entry must not use an arena.
+ * Memory for its completion is reserved here, so ENOMEM is returned by submit and never lost later. */
+int nikss_table_entry_async_submit(nikss_table_entry_ctx_t *ctx, nikss_table_async_op_t op,
+                                   nikss_table_entry_t *entry, uint64_t cookie);
+/* Moves up to max completions in order of submission, returns their number. Never blocks. */
+size_t nikss_table_entry_async_poll(nikss_table_entry_ctx_t *ctx, nikss_table_async_completion_t *completions,
+                                    size_t max);
+/* Blocks until every submitted request is completed */
+int nikss_table_entry_ctx_async_flush(nikss_table_entry_ctx_t *ctx);
+/* Completes queued requests and stops the worker; completions not polled are dropped.
+ * Called also by nikss_table_entry_ctx_free(). It frees the queues, so it must not run at the same
+ * time as other asynchronous functions of the context; the caller serializes it with them. */
+void nikss_table_entry_ctx_async_stop(nikss_table_entry_ctx_t *ctx);
+
+/*
+ * Aging of idle entries of exact match tables, e.g. used as flow caches. Time of the last match is taken
+ * from the 64-bit "last_hit" member of the value, which the data plane sets with bpf_ktime_get_ns() and the
+ * library sets on every write. Tables without it are aged by direct counters: entry is idle as long as its
+ * counter does not change. Every step reads at most slice_size entries and removes expired ones with batch
+ * delete, so the caller bounds the cost of aging by the interval between steps.
+ */
+typedef struct nikss_table_aging_stats {
+    uint32_t scanned;
+    uint32_t expired;
+    /* the last step visited the rest of the table, the next one starts from the beginning */
+    bool pass_finished;
+} nikss_table_aging_stats_t;
+
+/* Called for every removed entry, key is in the layout of the BPF map */
+typedef void (*nikss_table_aging_expiry_cb_t)(const void *key, size_t key_size, uint64_t idle_ns, void *arg);
+
+/* slice_size 0 means the default, cb may be NULL */
+int nikss_table_entry_ctx_aging_start(nikss_table_entry_ctx_t *ctx, uint64_t idle_timeout_ns, uint32_t slice_size,
+                                      nikss_table_aging_expiry_cb_t cb, void *arg);
+/* Stats might be NULL */
+int nikss_table_entry_ctx_aging_step(nikss_table_entry_ctx_t *ctx, nikss_table_aging_stats_t *stats);
+/* Called also by nikss_table_entry_ctx_free() */
+void nikss_table_entry_ctx_aging_stop(nikss_table_entry_ctx_t *ctx);
+
 /* DirectCounter */
 void nikss_direct_counter_ctx_init(nikss_direct_counter_context_t *dc_ctx);
 void nikss_direct_counter_ctx_free(nikss_direct_counter_context_t *dc_ctx);
@@ -555,6 +1075,14 @@ typedef struct nikss_action_selector_group_context {
     uint32_t group_ref;
 } nikss_action_selector_group_context_t;
 
+/* Type for internal use, tracks free references to avoid probing map for them */
+typedef struct nikss_action_selector_ref_allocator {
+    uint64_t *used_refs;  /* bitmap, bit is set when reference is taken */
+    uint32_t max_ref;
+    uint32_t next_free_hint;
+    bool initialized;
+} nikss_action_selector_ref_allocator_t;
+
 typedef struct nikss_action_selector_context {
     nikss_btf_t btf;
 
@@ -569,11 +1097,31 @@ typedef struct nikss_action_selector_context {
     uint32_t current_group_id;
     nikss_action_selector_member_context_t current_member;
     uint32_t current_member_id; /* used to iterate over members of group and over all possible members */
+
+    /* Built on first insert with one scan of map, then maintained on every add/delete */
+    nikss_action_selector_ref_allocator_t member_refs;
+    nikss_action_selector_ref_allocator_t group_refs;
+
+    /* Number of groups which reference each member, indexed by member reference. Used only when
+     * the context is exclusive, built on first member removal, then maintained by operations on
+     * groups using this context. */
+    bool exclusive;
+    uint32_t *member_use_count;
+    uint32_t member_use_count_max_ref;
+
+    /* serialize changes of selector with other threads and processes */
+    bool thread_safe;
+    nikss_pipeline_id_t pipeline_id;
 } nikss_action_selector_context_t;
 
 void nikss_action_selector_ctx_init(nikss_action_selector_context_t *ctx);
 void nikss_action_selector_ctx_free(nikss_action_selector_context_t *ctx);
 int nikss_action_selector_ctx_name(nikss_context_t *nikss_ctx, nikss_action_selector_context_t *ctx, const char *name);
+/* Opens the same action selector as src without loading BTF again, src may be freed before dst. References
+ * used by the selector and exclusive mode are not copied, they are read again when needed. Every clone has
+ * its own state of iteration and is thread safe. */
+int nikss_action_selector_ctx_clone(nikss_action_selector_context_t *dst,
+                                    const nikss_action_selector_context_t *src);
 
 void nikss_action_selector_member_init(nikss_action_selector_member_context_t *member);
 void nikss_action_selector_member_free(nikss_action_selector_member_context_t *member);
@@ -582,6 +1130,14 @@ void nikss_action_selector_group_init(nikss_action_selector_group_context_t *gro
 void nikss_action_selector_group_free(nikss_action_selector_group_context_t *group);
 
 bool nikss_action_selector_has_group_capability(nikss_action_selector_context_t *ctx);
+/* Declares that groups are not changed by other processes or contexts while the context is exclusive, so
+ * removal of a member checks references to it with counts kept by the context instead of scanning all the
+ * groups every time. Without it every removal of a member scans groups. */
+int nikss_action_selector_ctx_exclusive(nikss_action_selector_context_t *ctx, bool enable);
+/* Changes of members and groups, including reservation of their references, are serialized with a lock on
+ * the directory of the pipeline in bpffs, which excludes other threads and processes. Iteration over members
+ * and groups is not protected, so one context must not be used by many threads at the same time. */
+int nikss_action_selector_ctx_thread_safe(nikss_action_selector_context_t *ctx, bool enable);
 
 /* Reuse table API */
 int nikss_action_selector_member_action(nikss_action_selector_member_context_t *member, nikss_action_t *action);
@@ -607,6 +1163,11 @@ int nikss_action_selector_del_member_from_group(nikss_action_selector_context_t
                                                 nikss_action_selector_member_context_t *member);
 
 /* Reuse table API */
+/* Replaces all the members of a group with a single batch update, packets never see an incomplete group */
+int nikss_action_selector_set_group_members(nikss_action_selector_context_t *ctx,
+                                            nikss_action_selector_group_context_t *group,
+                                            const uint32_t *member_refs, size_t n_members);
+
 int nikss_action_selector_set_empty_group_action(nikss_action_selector_context_t *ctx, nikss_action_t *action);
 int nikss_action_selector_get_empty_group_action(nikss_action_selector_context_t *ctx,
                                                  nikss_action_selector_member_context_t *member);
@@ -24,30 +24,69 @@
 extern "C" {
 #endif
 
-typedef struct nikss_digest_context {
-    nikss_bpf_map_descriptor_t queue;
-    nikss_btf_t btf_metadata;
-
-    nikss_struct_field_descriptor_set_t fds;
-} nikss_digest_context_t;
-
 /* Used to read a next Digest message. */
 typedef struct nikss_digest {
     char *raw_data;  /* stores data from map as a single block */
+    bool pooled;     /* raw_data belongs to the context's message pool */
 
     size_t current_field_id;
     nikss_struct_field_t current;
 } nikss_digest_t;
 
+struct nikss_digest_context;
+
+/* Called for every received Digest message. Digest is valid only within the callback,
+ * its data might point directly into the ring buffer. Non-zero return value stops polling. */
+typedef int (*nikss_digest_callback_t)(struct nikss_digest_context *ctx, nikss_digest_t *digest, void *user_ctx);
+
+typedef struct nikss_digest_context {
+    nikss_bpf_map_descriptor_t queue;
+    nikss_btf_t btf_metadata;
+
+    nikss_struct_field_descriptor_set_t fds;
+
+    /* Optional BPF_MAP_TYPE_RINGBUF backend: "<digest name>_ringbuf" map */
+    nikss_bpf_map_descriptor_t ringbuf_map;
+    void *ringbuf;
+    /* Data is passed to callback without copying when byte order doesn't have to be fixed */
+    bool zero_copy;
+    char *scratch;
+
+    nikss_digest_callback_t callback;
+    void *callback_ctx;
+    int callback_ret;
+
+    /* Preallocated message pool used by nikss_digest_get_batch() */
+    char *pool;
+    size_t pool_capacity;
+
+    /* Destination for messages copied from the ring buffer */
+    char *copy_target;
+    size_t copy_max;
+    size_t copy_count;
+} nikss_digest_context_t;
+
 void nikss_digest_ctx_init(nikss_digest_context_t *ctx);
 void nikss_digest_ctx_free(nikss_digest_context_t *ctx);
 int nikss_digest_ctx_name(nikss_context_t *nikss_ctx, nikss_digest_context_t *ctx, const char *name);
 /* Will initialize digest, but must be later freed */
 int nikss_digest_get_next(nikss_digest_context_t *ctx, nikss_digest_t *digest);
 void nikss_digest_free(nikss_digest_t *digest);
+/* Reads up to max_digests messages into caller-provided slots, number of read messages is stored in n_digests.
+ * Message data is stored in a pool owned by the context and stays valid until the next call or
+ * nikss_digest_ctx_free(). Calling nikss_digest_free() on these messages is allowed, but not required. */
+int nikss_digest_get_batch(nikss_digest_context_t *ctx, nikss_digest_t *digests, size_t max_digests, size_t *n_digests);
 
 nikss_struct_field_t * nikss_digest_get_next_field(nikss_digest_context_t *ctx, nikss_digest_t *digest);
 
+/* Waits up to timeout_ms (negative value means forever) for Digest messages and passes each of them
+ * to callback. Returns ETIMEDOUT when no message was received. Uses epoll on the ring buffer backend,
+ * queue backend has no wait primitive, so it is periodically drained instead. */
+int nikss_digest_poll(nikss_digest_context_t *ctx, int timeout_ms, nikss_digest_callback_t callback, void *user_ctx);
+/* File descriptor which can be used with (e)poll() to wait for messages, or -1 for queue backend. */
+int nikss_digest_get_fd(nikss_digest_context_t *ctx);
+bool nikss_digest_has_ringbuf(nikss_digest_context_t *ctx);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -27,8 +27,50 @@ extern "C" {
 bool nikss_pipeline_exists(nikss_context_t *ctx);
 /* This function should load BPF program and initialize default maps (call map initializer program) */
 int nikss_pipeline_load(nikss_context_t *ctx, const char *file);
+
+/* Time (in nanoseconds) spent in phases of pipeline load */
+typedef struct nikss_pipeline_load_stats {
+    uint64_t object_open_ns;  /* parsing of ELF file */
+    uint64_t object_load_ns;  /* creation of maps and verification of programs */
+    uint64_t prog_pin_ns;
+    uint64_t map_pin_ns;
+    uint64_t tuples_ns;       /* adding tuples of ternary tables to their tuples maps */
+    uint64_t map_init_ns;     /* run of map initializer program */
+    uint64_t total_ns;
+    unsigned n_programs;
+    unsigned n_maps;
+    unsigned n_tuples;
+} nikss_pipeline_load_stats_t;
+
+/* stats may be NULL */
+int nikss_pipeline_load_with_stats(nikss_context_t *ctx, const char *file, nikss_pipeline_load_stats_t *stats);
+
+/* Changes of a map definition applied before the program is loaded. Name of a ternary table applies to its
+ * tuple template and tuples, so tuples added later have the same size, flags and NUMA node. */
+typedef struct nikss_map_override {
+    const char *name;
+    uint32_t max_entries;  /* 0 keeps size from the program */
+    bool no_prealloc;      /* BPF_F_NO_PREALLOC, for hash maps */
+    bool mmapable;         /* BPF_F_MMAPABLE, for array maps */
+    int numa_node;         /* negative keeps the default */
+} nikss_map_override_t;
+
+typedef struct nikss_pipeline_load_opts {
+    const nikss_map_override_t *map_overrides;
+    size_t n_map_overrides;
+} nikss_pipeline_load_opts_t;
+
+/* opts and stats may be NULL */
+int nikss_pipeline_load_with_opts(nikss_context_t *ctx, const char *file, const nikss_pipeline_load_opts_t *opts,
+                                  nikss_pipeline_load_stats_t *stats);
 int nikss_pipeline_unload(nikss_context_t *ctx);
+/* Replaces running pipeline with program from file without detaching it from ports. Contents of maps
+ * with the same name and type are migrated, then programs are atomically exchanged on every port. */
+int nikss_pipeline_replace(nikss_context_t *ctx, const char *file);
 int nikss_pipeline_add_port(nikss_context_t *ctx, const char *interface, int *port_id);
+/* Programs and maps are opened once for all interfaces. Port ID of interface which failed is set to 0 and
+ * the first error is returned, but remaining interfaces are still added. port_ids may be NULL. */
+int nikss_pipeline_add_ports(nikss_context_t *ctx, const char *interfaces[], size_t n_interfaces, int *port_ids);
 int nikss_pipeline_del_port(nikss_context_t *ctx, const char *interface);
 
 typedef struct nikss_port_spec {
@@ -41,6 +83,11 @@ typedef struct nikss_port_list {
     void *current_iface;
     nikss_port_spec_t current_port;
     unsigned xdp_prog_id; /* XDP program is always present if port is attached */
+    /* Registry of ports of the pipeline, when present interfaces are not scanned */
+    int registry_fd;
+    uint32_t registry_key;
+    bool has_registry_key;
+    char current_name[16];  /* IF_NAMESIZE */
 } nikss_port_list_t;
 
 int nikss_port_list_init(nikss_port_list_t *list, nikss_context_t *ctx);
@@ -53,10 +100,58 @@ void nikss_port_spec_free(nikss_port_spec_t *port);
 
 /* seconds since UNIX timestamp, 0 on error */
 uint64_t nikss_pipeline_get_load_timestamp(nikss_context_t *ctx);
+/* Nanoseconds since boot as reported by kernel, 0 on error; unlike the timestamp above it does not
+ * change between calls, so it identifies a load of the pipeline */
+uint64_t nikss_pipeline_get_load_time(nikss_context_t *ctx);
 
 bool nikss_pipeline_is_TC_based(nikss_context_t *ctx);
 bool nikss_pipeline_has_egress_program(nikss_context_t *ctx);
 
+/* Runtime statistics of a BPF program of the pipeline. The kernel updates them only while statistics
+ * are enabled, either by nikss_pipeline_stats_enable() or by sysctl kernel.bpf_stats_enabled. */
+typedef struct nikss_pipeline_prog_stats {
+    /* Name of the pinned program, e.g. "classifier_tc-ingress" */
+    const char *name;
+    uint32_t prog_id;
+    uint64_t run_cnt;
+    uint64_t run_time_ns;
+    uint64_t recursion_misses;
+} nikss_pipeline_prog_stats_t;
+
+#define NIKSS_PIPELINE_MAX_PROGS 6
+
+typedef struct nikss_pipeline_stats {
+    size_t n_progs;
+    nikss_pipeline_prog_stats_t progs[NIKSS_PIPELINE_MAX_PROGS];
+} nikss_pipeline_stats_t;
+
+/* Enables collection of statistics (BPF_ENABLE_STATS) for all BPF programs until the returned file
+ * descriptor is passed to nikss_pipeline_stats_disable(). Returns negative error code on failure. */
+int nikss_pipeline_stats_enable(void);
+void nikss_pipeline_stats_disable(int stats_fd);
+/* True when statistics are collected regardless of nikss_pipeline_stats_enable() */
+bool nikss_pipeline_stats_enabled_by_sysctl(void);
+/* Reads statistics of ingress and egress programs (TC and XDP) present in the pipeline */
+int nikss_pipeline_get_stats(nikss_context_t *ctx, nikss_pipeline_stats_t *stats);
+
+/* Steering of packets to other CPUs by XDP pipelines with "cpu_map" CPUMAP */
+typedef struct nikss_cpumap_entry {
+    uint32_t cpu;
+    /* Size of the queue in packets, 0 when packets are not redirected to this CPU */
+    uint32_t qsize;
+    /* Counters from optional "cpu_map_stats" map, 0 without it. Packets enqueued on the source
+     * CPUs but not received by the target one were dropped, usually because the queue was full. */
+    uint64_t enqueued;
+    uint64_t received;
+    uint64_t dropped;
+} nikss_cpumap_entry_t;
+
+/* Number of CPUs which can be configured, 0 when the pipeline has no CPUMAP */
+uint32_t nikss_pipeline_cpumap_size(nikss_context_t *ctx);
+/* Enables CPU as a redirect target with a queue of qsize packets, qsize 0 disables it */
+int nikss_pipeline_cpumap_set(nikss_context_t *ctx, uint32_t cpu, uint32_t qsize);
+int nikss_pipeline_cpumap_get(nikss_context_t *ctx, uint32_t cpu, nikss_cpumap_entry_t *entry);
+
 typedef struct nikss_pipeline_object {
     char name[256];
 } nikss_pipeline_object_t;
@@ -74,6 +169,45 @@ nikss_pipeline_object_t * nikss_pipeline_objects_list_get_next_object(nikss_pipe
 const char * nikss_pipeline_object_get_name(nikss_pipeline_object_t *obj);
 void nikss_pipeline_object_free(nikss_pipeline_object_t *obj);
 
+typedef enum nikss_pipeline_object_type {
+    NIKSS_PIPELINE_OBJECT_UNKNOWN = 0,
+    NIKSS_PIPELINE_OBJECT_TABLE,
+    /* ActionProfile or ActionSelector */
+    NIKSS_PIPELINE_OBJECT_ACTION_SELECTOR,
+    NIKSS_PIPELINE_OBJECT_COUNTER,
+    NIKSS_PIPELINE_OBJECT_METER,
+    NIKSS_PIPELINE_OBJECT_REGISTER,
+    NIKSS_PIPELINE_OBJECT_DIGEST,
+} nikss_pipeline_object_type_t;
+
+/* Type is guessed from maps of the object and their BTF, e.g. tables have default action map */
+nikss_pipeline_object_type_t nikss_pipeline_object_get_type(nikss_context_t *ctx, const char *name);
+const char * nikss_pipeline_object_type_to_str(nikss_pipeline_object_type_t type);
+
+/*
+ * Dump of all the pipeline objects. Objects are read by a pool of worker threads, every one of them
+ * uses its own nikss_context_t, and results are emitted from the calling thread sorted by object name.
+ */
+typedef struct nikss_pipeline_dump_object {
+    const char *name;
+    nikss_pipeline_object_type_t type;
+    /* Result of the read callback, ECANCELED when the object was not read because dump was stopped */
+    int error;
+    /* Set by the read callback, must be released by the emit callback */
+    void *data;
+} nikss_pipeline_dump_object_t;
+
+/* Called from worker threads, the context belongs to the worker and must not be kept */
+typedef int (*nikss_pipeline_dump_read_cb_t)(nikss_context_t *ctx, nikss_pipeline_dump_object_t *obj, void *arg);
+/* Called for every object in order, as soon as it and all the preceding objects are read. Non-zero return
+ * value stops the dump and is returned, objects which are left are still emitted with ECANCELED error. */
+typedef int (*nikss_pipeline_dump_emit_cb_t)(nikss_pipeline_dump_object_t *obj, void *arg);
+
+/* With n_workers lower than 2 objects are read by the calling thread using ctx. At most n_workers objects
+ * are read ahead of the last emitted one, workers wait for the emit callback before taking more. */
+int nikss_pipeline_dump(nikss_context_t *ctx, unsigned n_workers, nikss_pipeline_dump_read_cb_t read_cb,
+                        nikss_pipeline_dump_emit_cb_t emit_cb, void *arg);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
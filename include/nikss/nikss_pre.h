@@ -29,6 +29,9 @@ extern "C" {
  */
 typedef uint32_t nikss_clone_session_id_t;
 
+/* Predecessors of session/group members, internal use only */
+struct nikss_pre_member_index;
+
 struct nikss_clone_session_entry {
     uint32_t  egress_port;
     uint16_t  instance;
@@ -47,6 +50,9 @@ typedef struct nikss_clone_session_ctx {
     nikss_clone_session_entry_t current_entry;
     uint32_t current_egress_port;
     uint16_t current_instance;
+
+    /* Speeds up removing of entries */
+    struct nikss_pre_member_index *member_index;
 } nikss_clone_session_ctx_t;
 
 
@@ -76,6 +82,14 @@ uint16_t nikss_clone_session_entry_get_truncate_length(nikss_clone_session_entry
 
 int nikss_clone_session_entry_update(nikss_context_t *ctx, nikss_clone_session_ctx_t *session, nikss_clone_session_entry_t *entry);
 int nikss_clone_session_entry_delete(nikss_context_t *ctx, nikss_clone_session_ctx_t *session, nikss_clone_session_entry_t *entry);
+/* Replaces all entries of existing session with the given ones, in the given order.
+ * Entries are written in batch to a new map which then replaces the current one. */
+int nikss_clone_session_set_entries(nikss_context_t *ctx, nikss_clone_session_ctx_t *session,
+                                    const nikss_clone_session_entry_t *entries, size_t n_entries);
+/* Same as above, so the data plane switches to the new list at once, but session is created
+ * if it does not exist. */
+int nikss_clone_session_replace(nikss_context_t *ctx, nikss_clone_session_ctx_t *session,
+                                const nikss_clone_session_entry_t *entries, size_t n_entries);
 int nikss_clone_session_entry_exists(nikss_context_t *ctx, nikss_clone_session_ctx_t *session, nikss_clone_session_entry_t *entry);
 int nikss_clone_session_entry_get(nikss_context_t *ctx, nikss_clone_session_ctx_t *session, nikss_clone_session_entry_t *entry);
 
@@ -109,6 +123,9 @@ typedef struct nikss_mcast_grp_context {
     nikss_mcast_grp_member_t current_member;
     uint32_t current_egress_port;
     uint16_t current_instance;
+
+    /* Speeds up removing of members */
+    struct nikss_pre_member_index *member_index;
 } nikss_mcast_grp_ctx_t;
 
 void nikss_mcast_grp_context_init(nikss_mcast_grp_ctx_t *group);
@@ -131,6 +148,12 @@ uint32_t nikss_mcast_grp_member_get_port(nikss_mcast_grp_member_t *member);
 uint16_t nikss_mcast_grp_member_get_instance(nikss_mcast_grp_member_t *member);
 
 int nikss_mcast_grp_member_update(nikss_context_t *ctx, nikss_mcast_grp_ctx_t *group, nikss_mcast_grp_member_t *member);
+/* Replaces all members of the group with the given ones. */
+int nikss_mcast_grp_set_members(nikss_context_t *ctx, nikss_mcast_grp_ctx_t *group,
+                                const nikss_mcast_grp_member_t *members, size_t n_members);
+/* Replaces all members of the group at once, see nikss_clone_session_replace(). */
+int nikss_mcast_grp_replace(nikss_context_t *ctx, nikss_mcast_grp_ctx_t *group,
+                            const nikss_mcast_grp_member_t *members, size_t n_members);
 int nikss_mcast_grp_member_exists(nikss_context_t *ctx, nikss_mcast_grp_ctx_t *group, nikss_mcast_grp_member_t *member);
 int nikss_mcast_grp_member_delete(nikss_context_t *ctx, nikss_mcast_grp_ctx_t *group, nikss_mcast_grp_member_t *member);
 
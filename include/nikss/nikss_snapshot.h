@@ -0,0 +1,128 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __NIKSS_SNAPSHOT_H_
+#define __NIKSS_SNAPSHOT_H_
+
+#include <nikss/nikss.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binary snapshot of the pipeline state: raw content of every map which holds tables, counters,
+ * registers, meters, groups etc. File is designed to be memory mapped, all the offsets are from
+ * the beginning of the file and every block is aligned to 8B. Data is stored in host order.
+ *
+ * Layout: header, then for every map its schema, keys and values blocks, then array of map
+ * descriptors. Keys of every map are sorted with memcmp(), so snapshots can be merged quickly.
+ * Content of map-in-map (e.g. PRE, action selector groups, ternary tuples) is stored as separate
+ * inner maps named "OUTER_NAME/KEY_IN_HEX", value of outer map is index of the inner map.
+ */
+
+#define NIKSS_SNAPSHOT_MAGIC "NIKSSSNP"
+#define NIKSS_SNAPSHOT_VERSION 1
+#define NIKSS_SNAPSHOT_MAP_NAME_LEN 256
+#define NIKSS_SNAPSHOT_NO_PARENT UINT32_MAX
+
+typedef struct nikss_snapshot_header {
+    char magic[8];
+    uint32_t version;
+    nikss_pipeline_id_t pipeline_id;
+    uint32_t n_maps;
+    /* Number of value slots stored for per-CPU maps */
+    uint32_t n_cpus;
+    uint64_t maps_offset;
+    uint64_t file_size;
+} nikss_snapshot_header_t;
+
+typedef struct nikss_snapshot_map {
+    char name[NIKSS_SNAPSHOT_MAP_NAME_LEN];
+    uint32_t type;
+    uint32_t key_size;
+    uint32_t value_size;
+    uint32_t max_entries;
+    uint32_t map_flags;
+    /* Size of every value in values block, for per-CPU maps includes all the CPUs */
+    uint32_t value_buffer_size;
+    /* Index of outer map for inner maps */
+    uint32_t parent;
+    /* Text description of key and value fields derived from BTF, NUL terminated, might be empty */
+    uint32_t schema_size;
+    uint64_t schema_offset;
+    uint64_t n_entries;
+    uint64_t keys_offset;
+    uint64_t values_offset;
+} nikss_snapshot_map_t;
+
+typedef struct nikss_snapshot {
+    void *base;
+    size_t size;
+    const nikss_snapshot_header_t *header;
+    const nikss_snapshot_map_t *maps;
+} nikss_snapshot_t;
+
+/* Writes state of the pipeline to the file */
+int nikss_snapshot_export(nikss_context_t *ctx, const char *path);
+
+/* File is memory mapped read-only and validated, then it can be accessed directly */
+void nikss_snapshot_init(nikss_snapshot_t *snapshot);
+int nikss_snapshot_open(nikss_snapshot_t *snapshot, const char *path);
+void nikss_snapshot_close(nikss_snapshot_t *snapshot);
+
+size_t nikss_snapshot_get_n_maps(const nikss_snapshot_t *snapshot);
+const nikss_snapshot_map_t *nikss_snapshot_get_map(const nikss_snapshot_t *snapshot, size_t idx);
+const nikss_snapshot_map_t *nikss_snapshot_find_map(const nikss_snapshot_t *snapshot, const char *name);
+const void *nikss_snapshot_get_map_keys(const nikss_snapshot_t *snapshot, const nikss_snapshot_map_t *map);
+const void *nikss_snapshot_get_map_values(const nikss_snapshot_t *snapshot, const nikss_snapshot_map_t *map);
+const char *nikss_snapshot_get_map_schema(const nikss_snapshot_t *snapshot, const nikss_snapshot_map_t *map);
+
+/* Restores maps of the pipeline to the state from the snapshot using batch operations. Entries not
+ * present in the snapshot are removed. Maps which are missing or have different layout are skipped. */
+int nikss_snapshot_import(nikss_context_t *ctx, const nikss_snapshot_t *snapshot);
+
+typedef enum nikss_snapshot_diff_type {
+    NIKSS_SNAPSHOT_ENTRY_ADDED,
+    NIKSS_SNAPSHOT_ENTRY_REMOVED,
+    NIKSS_SNAPSHOT_ENTRY_CHANGED,
+} nikss_snapshot_diff_type_t;
+
+typedef struct nikss_snapshot_diff_entry {
+    const char *map_name;
+    nikss_snapshot_diff_type_t type;
+    const void *key;
+    size_t key_size;
+    /* NULL when entry is added or value is not comparable, e.g. for map-in-map */
+    const void *old_value;
+    size_t old_value_size;
+    /* NULL when entry is removed or value is not comparable */
+    const void *new_value;
+    size_t new_value_size;
+} nikss_snapshot_diff_entry_t;
+
+/* Called for every difference, non-zero return value stops comparison and is returned */
+typedef int (*nikss_snapshot_diff_cb_t)(const nikss_snapshot_diff_entry_t *entry, void *arg);
+
+int nikss_snapshot_diff(const nikss_snapshot_t *old_snapshot, const nikss_snapshot_t *new_snapshot,
+                        nikss_snapshot_diff_cb_t cb, void *arg);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __NIKSS_SNAPSHOT_H_ */
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __NIKSS_STATS_H_
+#define __NIKSS_STATS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Call counts and latencies of library operations. They are collected only when the library is
+ * built with ENABLE_STATS, otherwise instrumentation is compiled out and statistics are empty.
+ */
+
+typedef enum nikss_stats_op {
+    NIKSS_STATS_TABLE_ADD = 0,
+    NIKSS_STATS_TABLE_UPDATE,
+    NIKSS_STATS_TABLE_GET,
+    NIKSS_STATS_TABLE_DEL,
+    NIKSS_STATS_TERNARY_TUPLE_OPEN,
+    NIKSS_STATS_LOAD_BTF,
+    NIKSS_STATS_BPF_MAP_LOOKUP_ELEM,
+    NIKSS_STATS_BPF_MAP_UPDATE_ELEM,
+    NIKSS_STATS_BPF_MAP_DELETE_ELEM,
+    NIKSS_STATS_BPF_MAP_GET_NEXT_KEY,
+    NIKSS_STATS_BPF_MAP_LOOKUP_AND_DELETE_ELEM,
+    NIKSS_STATS_BPF_MAP_LOOKUP_BATCH,
+    NIKSS_STATS_BPF_MAP_UPDATE_BATCH,
+    NIKSS_STATS_BPF_MAP_DELETE_BATCH,
+    NIKSS_STATS_BPF_MAP_GET_FD_BY_ID,
+    NIKSS_STATS_BPF_OBJ_GET,
+    NIKSS_STATS_N_OPS,
+} nikss_stats_op_t;
+
+/* Bucket i counts calls which took from 2^i to 2^(i+1) - 1 ns, the last one also all the longer calls */
+#define NIKSS_STATS_HISTOGRAM_BUCKETS 32
+
+typedef struct nikss_stats_op_counters {
+    uint64_t calls;
+    /* For libbpf calls also ENOENT, e.g. at the end of iteration over a map */
+    uint64_t errors;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t histogram[NIKSS_STATS_HISTOGRAM_BUCKETS];
+} nikss_stats_op_counters_t;
+
+typedef struct nikss_stats {
+    nikss_stats_op_counters_t ops[NIKSS_STATS_N_OPS];
+} nikss_stats_t;
+
+/* Returns false when the library is built without statistics */
+bool nikss_stats_available(void);
+
+/* Statistics are shared by all the contexts and threads of the process. Returns ENOTSUP
+ * when statistics are not available. */
+int nikss_stats_get(nikss_stats_t *stats);
+void nikss_stats_reset(void);
+
+const char *nikss_stats_op_name(nikss_stats_op_t op);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __NIKSS_STATS_H_ */
@@ -46,6 +46,9 @@ nikss_table_entry_t *nikss_value_set_get_next_entry(nikss_value_set_context_t *c
 
 int nikss_value_set_insert(nikss_value_set_context_t *ctx, nikss_table_entry_t *entry);
 int nikss_value_set_delete(nikss_value_set_context_t *ctx, nikss_table_entry_t *entry);
+/* Replaces whole content of the value_set with given entries. Current content is read and only
+ * the difference is written, using batch operations. Supported for exact match value_set only. */
+int nikss_value_set_replace(nikss_value_set_context_t *ctx, nikss_table_entry_t *entries, size_t n_entries);
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -21,6 +21,11 @@
 #define COUNTER_PACKETS_OR_BYTES_STRUCT_ENTRIES  1
 #define COUNTER_PACKETS_AND_BYTES_STRUCT_ENTRIES 2
 
+/* TC filters are attached with fixed handle and priority (the same as chosen by the kernel for
+ * the first filter), so they can be found and replaced in place later. */
+#define TC_FILTER_HANDLE   1
+#define TC_FILTER_PRIORITY 49152
+
 #ifdef __GNUC__
     #pragma GCC diagnostic push
     #pragma GCC diagnostic ignored "-Wunused-variable"
@@ -76,6 +81,25 @@ static const char *XDP_EGRESS_PROG = "xdp_devmap_xdp-egress";
  */
 static const char *XDP_EGRESS_PROG_OPTIMIZED = "xdp_xdp-egress";
 
+/**
+ * The name of map registering ports of the pipeline, pinned next to programs.
+ * It is maintained by this library, not by the data plane.
+ */
+static const char *PORTS_REGISTRY = "nikss_ports";
+
+/**
+ * Suffix of map with NUMA node of tuples of a ternary table, pinned next to programs when the node
+ * is given at load, so tuples created later are placed on the same node. Maintained by this library.
+ */
+static const char *TUPLES_NUMA_NODE_SUFFIX = "_tuples_numa";
+
+/**
+ * Suffixes of maps with meter profiles and with profile used by every meter instance, pinned next
+ * to programs when the first profile of a meter is defined. Maintained by this library.
+ */
+static const char *METER_PROFILES_SUFFIX = "_profiles";
+static const char *METER_INSTANCE_PROFILES_SUFFIX = "_profile_of";
+
 /**
  * The name of XDP devmap.
  */
@@ -86,6 +110,23 @@ static const char *XDP_DEVMAP = "tx_port";
  */
 static const char *XDP_JUMP_TBL = "egress_progs_table";
 
+/**
+ * The name of optional CPUMAP used by the data plane to redirect packets to other CPUs.
+ */
+static const char *XDP_CPUMAP = "cpu_map";
+
+/**
+ * The name of optional per-CPU array with two 64-bit counters for every target CPU:
+ * packets redirected to it (updated by the data plane) and packets received by it
+ * (updated by the CPUMAP program).
+ */
+static const char *XDP_CPUMAP_STATS = "cpu_map_stats";
+
+/**
+ * The name of optional program run on the target CPU for packets redirected through CPUMAP.
+ */
+static const char *XDP_CPUMAP_PROG = "xdp_cpumap_xdp-cpumap";
+
 /**
  * The name of the BPF MAP storing clone sessions.
  */
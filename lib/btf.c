@@ -20,7 +20,10 @@
 #include <errno.h>
 #include <linux/bpf.h>
 #include <linux/btf.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <nikss/nikss.h>
@@ -226,13 +229,150 @@ size_t btf_get_type_size_by_id(struct btf *btf, uint32_t type_id)
     return 0;
 }
 
+struct cached_struct_type {
+    uint32_t type_id;
+    size_t data_size;
+    nikss_struct_field_descriptor_set_t fds;
+};
+
+/* Parsed BTF shared between object contexts, nikss_context_t and the process-wide cache */
+struct btf_handle {
+    unsigned refcount;
+    uint32_t btf_id;
+    struct btf *btf;
+    int btf_fd;
+
+    /* results of parse_struct_type(), they depend only on BTF; handle might be
+     * used by contexts in many threads, so they are guarded by the lock */
+    pthread_mutex_t struct_types_lock;
+    size_t n_struct_types;
+    struct cached_struct_type *struct_types;
+};
+
+static struct btf_handle *btf_handle_get(struct btf_handle *handle)
+{
+    __atomic_add_fetch(&handle->refcount, 1, __ATOMIC_RELAXED);
+    return handle;
+}
+
+static void btf_handle_put(struct btf_handle *handle)
+{
+    if (handle == NULL || __atomic_sub_fetch(&handle->refcount, 1, __ATOMIC_ACQ_REL) > 0) {
+        return;
+    }
+
+    btf__free(handle->btf);
+    close_object_fd(&handle->btf_fd);
+    for (size_t i = 0; i < handle->n_struct_types; i++) {
+        free_struct_field_descriptor_set(&handle->struct_types[i].fds);
+    }
+    if (handle->struct_types != NULL) {
+        free(handle->struct_types);
+    }
+    pthread_mutex_destroy(&handle->struct_types_lock);
+    free(handle);
+}
+
+/* Cached BTF keeps its kernel object alive, so the number of entries is limited */
+#define BTF_CACHE_MAX_ENTRIES 16
+
+/* Process-wide cache of parsed BTF, indexed by BTF object ID, so it remains valid after pipeline reload */
+static struct {
+    bool enabled;
+    size_t n_entries;
+    struct btf_handle **entries;
+} btf_cache;  /* NOLINT(cppcoreguidelines-avoid-non-const-global-variables) */
+static pthread_mutex_t btf_cache_lock = PTHREAD_MUTEX_INITIALIZER;  /* NOLINT(cppcoreguidelines-avoid-non-const-global-variables) */
+
+static void clear_btf_cache(void)
+{
+    for (size_t i = 0; i < btf_cache.n_entries; i++) {
+        btf_handle_put(btf_cache.entries[i]);
+    }
+    if (btf_cache.entries != NULL) {
+        free(btf_cache.entries);
+    }
+    btf_cache.entries = NULL;
+    btf_cache.n_entries = 0;
+}
+
+void invalidate_btf_cache(void)
+{
+    pthread_mutex_lock(&btf_cache_lock);
+    clear_btf_cache();
+    pthread_mutex_unlock(&btf_cache_lock);
+}
+
+void nikss_btf_cache_enable(bool enable)
+{
+    pthread_mutex_lock(&btf_cache_lock);
+    if (enable == false) {
+        clear_btf_cache();
+    }
+    btf_cache.enabled = enable;
+    pthread_mutex_unlock(&btf_cache_lock);
+}
+
+bool nikss_btf_cache_is_enabled(void)
+{
+    pthread_mutex_lock(&btf_cache_lock);
+    bool enabled = btf_cache.enabled;
+    pthread_mutex_unlock(&btf_cache_lock);
+
+    return enabled;
+}
+
+static struct btf_handle *find_cached_btf(uint32_t btf_id)
+{
+    for (size_t i = 0; i < btf_cache.n_entries; i++) {
+        if (btf_cache.entries[i]->btf_id == btf_id) {
+            return btf_cache.entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void add_btf_to_cache(struct btf_handle *handle)
+{
+    /* The oldest entry is most likely BTF of unloaded pipeline */
+    if (btf_cache.n_entries >= BTF_CACHE_MAX_ENTRIES) {
+        btf_handle_put(btf_cache.entries[0]);
+        btf_cache.n_entries -= 1;
+        memmove(&btf_cache.entries[0], &btf_cache.entries[1], btf_cache.n_entries * sizeof(btf_cache.entries[0]));
+    }
+
+    struct btf_handle **entries = realloc(btf_cache.entries, (btf_cache.n_entries + 1) * sizeof(*entries));
+    if (entries == NULL) {
+        return;  /* BTF just will not be cached */
+    }
+    btf_cache.entries = entries;
+    entries[btf_cache.n_entries] = btf_handle_get(handle);
+    btf_cache.n_entries += 1;
+}
+
+static int attach_btf_handle(nikss_btf_t *btf, struct btf_handle *handle)
+{
+    int fd = dup(handle->btf_fd);
+    if (fd < 0) {
+        return errno;
+    }
+
+    btf->btf = handle->btf;
+    btf->btf_fd = fd;
+    btf->handle = btf_handle_get(handle);
+
+    return NO_ERROR;
+}
+
 void init_btf(nikss_btf_t *btf)
 {
     btf->btf = NULL;
     btf->btf_fd = -1;
+    btf->handle = NULL;
 }
 
-static int try_load_btf(nikss_btf_t *btf, const char *program_name)
+static int try_load_btf(struct btf_handle **handle, const char *program_name)
 {
     /* BTF metadata are associated with eBPF program, eBPF map may do not own BTF */
     int associated_prog = bpf_obj_get(program_name);
@@ -248,46 +388,95 @@ static int try_load_btf(nikss_btf_t *btf, const char *program_name)
         return ENOENT;
     }
 
-    error = btf__get_from_id(prog_info.btf_id, (struct btf **) &(btf->btf));
-    btf->btf_fd = bpf_btf_get_fd_by_id(prog_info.btf_id);
-    if (btf->btf == NULL || btf->btf_fd < 0 || error != 0) {
-        goto free_btf;
+    pthread_mutex_lock(&btf_cache_lock);
+    if (btf_cache.enabled) {
+        struct btf_handle *cached = find_cached_btf(prog_info.btf_id);
+        if (cached != NULL) {
+            *handle = btf_handle_get(cached);
+            pthread_mutex_unlock(&btf_cache_lock);
+            return NO_ERROR;
+        }
     }
+    pthread_mutex_unlock(&btf_cache_lock);
 
-    return NO_ERROR;
+    struct btf_handle *new_handle = calloc(1, sizeof(struct btf_handle));
+    if (new_handle == NULL) {
+        return ENOMEM;
+    }
+    new_handle->refcount = 1;
+    new_handle->btf_id = prog_info.btf_id;
+    pthread_mutex_init(&new_handle->struct_types_lock, NULL);
 
-free_btf:
-    if (btf->btf != NULL) {
-        btf__free(btf->btf);
+    error = btf__get_from_id(prog_info.btf_id, &(new_handle->btf));
+    new_handle->btf_fd = bpf_btf_get_fd_by_id(prog_info.btf_id);
+    if (new_handle->btf == NULL || new_handle->btf_fd < 0 || error != 0) {
+        if (new_handle->btf != NULL) {
+            btf__free(new_handle->btf);
+        }
+        close_object_fd(&new_handle->btf_fd);
+        pthread_mutex_destroy(&new_handle->struct_types_lock);
+        free(new_handle);
+        return ENOENT;
     }
-    btf->btf = NULL;
-    close_object_fd(&btf->btf_fd);
 
-    return ENOENT;
+    pthread_mutex_lock(&btf_cache_lock);
+    if (btf_cache.enabled) {
+        add_btf_to_cache(new_handle);
+    }
+    pthread_mutex_unlock(&btf_cache_lock);
+    *handle = new_handle;
+
+    return NO_ERROR;
 }
 
-int load_btf(nikss_context_t *nikss_ctx, nikss_btf_t *btf)
+static int load_shared_btf(nikss_context_t *nikss_ctx, nikss_btf_t *btf)
 {
     if (btf->btf != NULL) {
         return NO_ERROR;
     }
 
-    char program_file_name[256];
-    const char *programs_to_search[] = { TC_INGRESS_PROG, XDP_INGRESS_PROG, TC_EGRESS_PROG };
-    int number_of_programs = sizeof(programs_to_search) / sizeof(programs_to_search[0]);
+    /* BTF is loaded once per nikss_context_t and shared by every object opened with it */
+    if (nikss_ctx->btf.handle == NULL) {
+        char program_file_name[256];
+        const char *programs_to_search[] = { TC_INGRESS_PROG, XDP_INGRESS_PROG, TC_EGRESS_PROG };
+        int number_of_programs = sizeof(programs_to_search) / sizeof(programs_to_search[0]);
+        struct btf_handle *handle = NULL;
 
-    for (int i = 0; i < number_of_programs; i++) {
-        snprintf(program_file_name, sizeof(program_file_name), "%s/%s%u/%s",
-                 BPF_FS, PIPELINE_PREFIX, nikss_context_get_pipeline(nikss_ctx), programs_to_search[i]);
-        if (try_load_btf(btf, program_file_name) == NO_ERROR) {
-            break;
+        for (int i = 0; i < number_of_programs; i++) {
+            snprintf(program_file_name, sizeof(program_file_name), "%s/%s%u/%s",
+                     BPF_FS, PIPELINE_PREFIX, nikss_context_get_pipeline(nikss_ctx), programs_to_search[i]);
+            if (try_load_btf(&handle, program_file_name) == NO_ERROR) {
+                break;
+            }
+        }
+        if (handle == NULL) {
+            return ENOENT;
+        }
+
+        int ret = attach_btf_handle(&nikss_ctx->btf, handle);
+        btf_handle_put(handle);
+        if (ret != NO_ERROR) {
+            return ret;
         }
     }
-    if (btf->btf == NULL) {
-        return ENOENT;
+
+    return attach_btf_handle(btf, nikss_ctx->btf.handle);
+}
+
+int load_btf(nikss_context_t *nikss_ctx, nikss_btf_t *btf)
+{
+    return NIKSS_STATS_CALL(NIKSS_STATS_LOAD_BTF, load_shared_btf(nikss_ctx, btf));
+}
+
+int share_btf(nikss_btf_t *dst, const nikss_btf_t *src)
+{
+    init_btf(dst);
+    if (src->handle == NULL) {
+        /* Only BTF loaded with load_btf() can be shared */
+        return src->btf == NULL ? NO_ERROR : ENOTSUP;
     }
 
-    return NO_ERROR;
+    return attach_btf_handle(dst, src->handle);
 }
 
 void free_btf(nikss_btf_t *btf)
@@ -296,13 +485,142 @@ void free_btf(nikss_btf_t *btf)
         return;
     }
 
-    if (btf->btf) {
+    /* BTF loaded with load_btf() is shared, so only release reference to it */
+    if (btf->handle != NULL) {
+        btf_handle_put(btf->handle);
+    } else if (btf->btf != NULL) {
         btf__free(btf->btf);
     }
     btf->btf = NULL;
+    btf->handle = NULL;
     close_object_fd(&btf->btf_fd);
 }
 
+int copy_cached_struct_type(nikss_btf_t *btf, uint32_t type_id, size_t data_size,
+                            nikss_struct_field_descriptor_set_t *fds)
+{
+    struct btf_handle *handle = btf->handle;
+    if (handle == NULL) {
+        return ENOENT;
+    }
+
+    int ret = ENOENT;
+    pthread_mutex_lock(&handle->struct_types_lock);
+    for (size_t i = 0; i < handle->n_struct_types; i++) {
+        if (handle->struct_types[i].type_id == type_id && handle->struct_types[i].data_size == data_size) {
+            ret = copy_struct_field_descriptor_set(fds, &handle->struct_types[i].fds);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&handle->struct_types_lock);
+
+    return ret;
+}
+
+void cache_struct_type(nikss_btf_t *btf, uint32_t type_id, size_t data_size,
+                       const nikss_struct_field_descriptor_set_t *fds)
+{
+    struct btf_handle *handle = btf->handle;
+    if (handle == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&handle->struct_types_lock);
+
+    struct cached_struct_type *types = realloc(handle->struct_types,
+                                               (handle->n_struct_types + 1) * sizeof(struct cached_struct_type));
+    if (types == NULL) {
+        goto unlock;
+    }
+    handle->struct_types = types;
+
+    struct cached_struct_type *entry = &types[handle->n_struct_types];
+    memset(entry, 0, sizeof(*entry));
+    if (copy_struct_field_descriptor_set(&entry->fds, fds) != NO_ERROR) {
+        goto unlock;
+    }
+    entry->type_id = type_id;
+    entry->data_size = data_size;
+    handle->n_struct_types += 1;
+
+unlock:
+    pthread_mutex_unlock(&handle->struct_types_lock);
+}
+
+struct cached_map {
+    char *name;
+    nikss_bpf_map_descriptor_t md;
+};
+
+struct map_cache {
+    size_t n_maps;
+    struct cached_map *maps;
+};
+
+static struct cached_map *find_cached_map(nikss_context_t *nikss_ctx, const char *name)
+{
+    struct map_cache *cache = nikss_ctx->map_cache;
+    if (cache == NULL) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < cache->n_maps; i++) {
+        if (strcmp(cache->maps[i].name, name) == 0) {
+            return &cache->maps[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void add_map_to_cache(nikss_context_t *nikss_ctx, const char *name, nikss_bpf_map_descriptor_t *md)
+{
+    if (nikss_ctx->map_cache == NULL) {
+        nikss_ctx->map_cache = calloc(1, sizeof(struct map_cache));
+        if (nikss_ctx->map_cache == NULL) {
+            return;
+        }
+    }
+    struct map_cache *cache = nikss_ctx->map_cache;
+
+    struct cached_map *maps = realloc(cache->maps, (cache->n_maps + 1) * sizeof(struct cached_map));
+    if (maps == NULL) {
+        return;
+    }
+    cache->maps = maps;
+
+    struct cached_map *entry = &maps[cache->n_maps];
+    entry->name = strdup(name);
+    if (entry->name == NULL) {
+        return;
+    }
+    entry->md = *md;
+    entry->md.fd = dup(md->fd);
+    if (entry->md.fd < 0) {
+        free(entry->name);
+        return;
+    }
+    cache->n_maps += 1;
+}
+
+void free_context_cache(nikss_context_t *nikss_ctx)
+{
+    free_btf(&nikss_ctx->btf);
+
+    struct map_cache *cache = nikss_ctx->map_cache;
+    if (cache != NULL) {
+        for (size_t i = 0; i < cache->n_maps; i++) {
+            free(cache->maps[i].name);
+            close_object_fd(&cache->maps[i].md.fd);
+        }
+        if (cache->maps != NULL) {
+            free(cache->maps);
+        }
+        free(cache);
+    }
+    nikss_ctx->map_cache = NULL;
+}
+
 int open_bpf_map(nikss_context_t *nikss_ctx, const char *name, nikss_btf_t *btf, nikss_bpf_map_descriptor_t *md)
 {
     char buffer[256];
@@ -312,16 +630,27 @@ int open_bpf_map(nikss_context_t *nikss_ctx, const char *name, nikss_btf_t *btf,
         return EPERM;
     }
 
-    build_ebpf_map_filename(buffer, sizeof(buffer), nikss_ctx, name);
-    md->fd = bpf_obj_get(buffer);
-    if (md->fd < 0) {
-        return errno;
-    }
+    /* Map might have been already opened by other object within the same context */
+    struct cached_map *cached = find_cached_map(nikss_ctx, name);
+    if (cached != NULL) {
+        *md = cached->md;
+        md->fd = dup(cached->md.fd);
+        if (md->fd < 0) {
+            return errno;
+        }
+    } else {
+        build_ebpf_map_filename(buffer, sizeof(buffer), nikss_ctx, name);
+        md->fd = bpf_obj_get(buffer);
+        if (md->fd < 0) {
+            return errno;
+        }
 
-    /* get key/value size */
-    errno_val = update_map_info(md);
-    if (errno_val != NO_ERROR) {
-        return errno_val;
+        /* get key/value size */
+        errno_val = update_map_info(md);
+        if (errno_val != NO_ERROR) {
+            return errno_val;
+        }
+        add_map_to_cache(nikss_ctx, name, md);
     }
 
     /* Find BTF type IDs for our map */
@@ -371,6 +700,7 @@ int update_map_info(nikss_bpf_map_descriptor_t *md)
     md->key_size = info.key_size;
     md->value_size = info.value_size;
     md->max_entries = info.max_entries;
+    md->map_flags = info.map_flags;
     md->map_key_type_id = info.btf_key_type_id;
     md->map_value_type_id = info.btf_value_type_id;
 
@@ -43,7 +43,21 @@ size_t btf_get_type_size_by_id(struct btf *btf, uint32_t type_id);
 
 void init_btf(nikss_btf_t *btf);
 int load_btf(nikss_context_t *nikss_ctx, nikss_btf_t *btf);
+/* Takes another reference to BTF of src, e.g. for a cloned context */
+int share_btf(nikss_btf_t *dst, const nikss_btf_t *src);
 void free_btf(nikss_btf_t *btf);
+/* Drops process-wide cache of BTF, e.g. when pipeline is unloaded; contexts keep their references */
+void invalidate_btf_cache(void);
+
+/* Parsed structures are cached together with shared BTF */
+/* Copies cached structure to fds, returns ENOENT when it is not cached */
+int copy_cached_struct_type(nikss_btf_t *btf, uint32_t type_id, size_t data_size,
+                            nikss_struct_field_descriptor_set_t *fds);
+void cache_struct_type(nikss_btf_t *btf, uint32_t type_id, size_t data_size,
+                       const nikss_struct_field_descriptor_set_t *fds);
+
+/* Releases BTF and map descriptors cached in nikss_context_t */
+void free_context_cache(nikss_context_t *nikss_ctx);
 
 int open_bpf_map(nikss_context_t *nikss_ctx, const char *name, nikss_btf_t *btf, nikss_bpf_map_descriptor_t *md);
 int update_map_info(nikss_bpf_map_descriptor_t *md);
@@ -15,10 +15,13 @@
  * limitations under the License.
  */
 
+#include <bpf/libbpf.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
 #include <unistd.h>
 
 #include "bpf_defs.h"
@@ -75,6 +78,165 @@ void close_object_fd(int *fd)
     *fd = -1;
 }
 
+#define ARENA_DEFAULT_CHUNK_SIZE 16384
+#define ARENA_ALIGNMENT          16
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;
+    size_t used;
+    _Alignas(ARENA_ALIGNMENT) char data[];
+};
+
+void nikss_arena_init(nikss_arena_t *arena, size_t chunk_size)
+{
+    if (arena == NULL) {
+        return;
+    }
+
+    memset(arena, 0, sizeof(nikss_arena_t));
+    arena->chunk_size = chunk_size;
+}
+
+void nikss_arena_reset(nikss_arena_t *arena)
+{
+    if (arena == NULL) {
+        return;
+    }
+
+    for (struct arena_chunk *chunk = arena->first_chunk; chunk != NULL; chunk = chunk->next) {
+        chunk->used = 0;
+    }
+    arena->current_chunk = arena->first_chunk;
+}
+
+void nikss_arena_free(nikss_arena_t *arena)
+{
+    if (arena == NULL) {
+        return;
+    }
+
+    struct arena_chunk *chunk = arena->first_chunk;
+    while (chunk != NULL) {
+        struct arena_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+
+    arena->first_chunk = NULL;
+    arena->current_chunk = NULL;
+    arena->last_chunk = NULL;
+}
+
+void *arena_alloc(nikss_arena_t *arena, size_t size)
+{
+    size = (size + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1);
+
+    /* Chunks after the current one are free after reset */
+    struct arena_chunk *chunk = arena->current_chunk;
+    while (chunk != NULL && chunk->used + size > chunk->size) {
+        chunk = chunk->next;
+    }
+
+    if (chunk == NULL) {
+        size_t chunk_size = arena->chunk_size != 0 ? arena->chunk_size : ARENA_DEFAULT_CHUNK_SIZE;
+        if (size > chunk_size) {
+            chunk_size = size;
+        }
+        chunk = malloc(sizeof(struct arena_chunk) + chunk_size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->next = NULL;
+        chunk->size = chunk_size;
+        chunk->used = 0;
+
+        if (arena->last_chunk != NULL) {
+            ((struct arena_chunk *) arena->last_chunk)->next = chunk;
+        } else {
+            arena->first_chunk = chunk;
+        }
+        arena->last_chunk = chunk;
+    }
+
+    arena->current_chunk = chunk;
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+
+    return ptr;
+}
+
+bool is_percpu_map(const nikss_bpf_map_descriptor_t *md)
+{
+    return md->type == BPF_MAP_TYPE_PERCPU_ARRAY ||
+           md->type == BPF_MAP_TYPE_PERCPU_HASH ||
+           md->type == BPF_MAP_TYPE_LRU_PERCPU_HASH;
+}
+
+size_t get_map_value_slots(const nikss_bpf_map_descriptor_t *md)
+{
+    if (!is_percpu_map(md)) {
+        return 1;
+    }
+
+    int n_cpus = libbpf_num_possible_cpus();
+    if (n_cpus < 1) {
+        fprintf(stderr, "failed to get number of possible CPUs: %s\n", strerror(-n_cpus));
+        return 1;
+    }
+
+    return (size_t) n_cpus;
+}
+
+size_t get_map_value_slot_size(const nikss_bpf_map_descriptor_t *md)
+{
+    if (!is_percpu_map(md)) {
+        return md->value_size;
+    }
+
+    return (md->value_size + 7) & ~((size_t) 7);
+}
+
+size_t get_map_value_buffer_size(const nikss_bpf_map_descriptor_t *md)
+{
+    return get_map_value_slots(md) * get_map_value_slot_size(md);
+}
+
+bool is_pipeline_state_map(const char *name, uint32_t map_type)
+{
+    /* Per-port, program or runtime-only state, set up again for the new pipeline */
+    const char *skipped_names[] = {
+            XDP_DEVMAP,
+            XDP_JUMP_TBL,
+            "xdp2tc_shared_map",
+            "crc_lookup_tbl",
+    };
+    for (unsigned i = 0; i < sizeof(skipped_names) / sizeof(skipped_names[0]); i++) {
+        if (strcmp(name, skipped_names[i]) == 0) {
+            return false;
+        }
+    }
+    /* Tuples of ternary tables are moved together with their tuples map */
+    if (strstr(name, "_tuple_") != NULL) {
+        return false;
+    }
+
+    switch (map_type) {
+        case BPF_MAP_TYPE_HASH:
+        case BPF_MAP_TYPE_ARRAY:
+        case BPF_MAP_TYPE_PERCPU_HASH:
+        case BPF_MAP_TYPE_PERCPU_ARRAY:
+        case BPF_MAP_TYPE_LRU_HASH:
+        case BPF_MAP_TYPE_LRU_PERCPU_HASH:
+        case BPF_MAP_TYPE_LPM_TRIE:
+        case BPF_MAP_TYPE_ARRAY_OF_MAPS:
+        case BPF_MAP_TYPE_HASH_OF_MAPS:
+            return true;
+        default:
+            return false;
+    }
+}
+
 int build_ebpf_map_filename(char *buffer, size_t maxlen, nikss_context_t *ctx, const char *name)
 {
     return snprintf(buffer, maxlen, "%s/%s%u/maps/%s",
@@ -93,6 +255,68 @@ int build_ebpf_pipeline_path(char *buffer, size_t maxlen, nikss_context_t *ctx)
                     BPF_FS, PIPELINE_PREFIX, ctx->pipeline_id);
 }
 
+/* Lock held by the current thread. flock() on another open file description would block against it,
+ * so nested locks of the same pipeline (e.g. cache epoch under ternary table lock) reuse it. */
+static _Thread_local struct {
+    nikss_pipeline_id_t pipeline_id;
+    int fd;
+    unsigned depth;
+} held_pipeline_lock = { .fd = -1 };
+
+int pipeline_lock(nikss_pipeline_id_t pipeline_id)
+{
+    char path[256];
+
+    if (held_pipeline_lock.depth > 0 && held_pipeline_lock.pipeline_id == pipeline_id) {
+        held_pipeline_lock.depth++;
+        return held_pipeline_lock.fd;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s%u", BPF_FS, PIPELINE_PREFIX, pipeline_id);
+
+    /* Every lock has its own open file description, so it also excludes other threads */
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    while (flock(fd, LOCK_EX) != 0) {
+        if (errno != EINTR) {
+            int err = errno;
+            close(fd);
+            return -err;
+        }
+    }
+
+    if (held_pipeline_lock.depth == 0) {
+        held_pipeline_lock.pipeline_id = pipeline_id;
+        held_pipeline_lock.fd = fd;
+        held_pipeline_lock.depth = 1;
+    }
+
+    return fd;
+}
+
+void pipeline_unlock(int *lock_fd)
+{
+    if (lock_fd == NULL || *lock_fd < 0) {
+        return;
+    }
+
+    if (held_pipeline_lock.depth > 0 && held_pipeline_lock.fd == *lock_fd) {
+        held_pipeline_lock.depth--;
+        if (held_pipeline_lock.depth > 0) {
+            /* Released by the outermost unlock */
+            *lock_fd = -1;
+            return;
+        }
+        held_pipeline_lock.fd = -1;
+    }
+
+    /* Lock is released on close */
+    close_object_fd(lock_fd);
+}
+
 void free_struct_field_descriptor_set(nikss_struct_field_descriptor_set_t *fds)
 {
     if (fds == NULL) {
@@ -112,6 +336,31 @@ void free_struct_field_descriptor_set(nikss_struct_field_descriptor_set_t *fds)
     fds->n_fields = 0;
 }
 
+int copy_struct_field_descriptor_set(nikss_struct_field_descriptor_set_t *dst,
+                                    const nikss_struct_field_descriptor_set_t *src)
+{
+    dst->n_fields = 0;
+    dst->decoded_with_btf = src->decoded_with_btf;
+    dst->fields = calloc(src->n_fields, sizeof(nikss_struct_field_descriptor_t));
+    if (dst->fields == NULL) {
+        return ENOMEM;
+    }
+    dst->n_fields = src->n_fields;
+
+    for (size_t i = 0; i < src->n_fields; i++) {
+        dst->fields[i] = src->fields[i];
+        if (src->fields[i].name != NULL) {
+            dst->fields[i].name = strdup(src->fields[i].name);
+            if (dst->fields[i].name == NULL) {
+                free_struct_field_descriptor_set(dst);
+                return ENOMEM;
+            }
+        }
+    }
+
+    return NO_ERROR;
+}
+
 static int setup_struct_field_descriptor_set_no_btf(nikss_struct_field_descriptor_set_t *fds, size_t data_size)
 {
     fds->fields = calloc(1, sizeof(nikss_struct_field_descriptor_t));
@@ -301,6 +550,11 @@ int parse_struct_type(nikss_btf_t *btf_md, uint32_t type_id, size_t data_size, n
         return setup_struct_field_descriptor_set_no_btf(fds, data_size);
     }
 
+    int cached = copy_cached_struct_type(btf_md, type_id, data_size, fds);
+    if (cached != ENOENT) {
+        return cached;
+    }
+
     fds->n_fields = count_total_fields(btf_md, type_id);
     if (fds->n_fields != 0) {
         fds->fields = calloc(fds->n_fields, sizeof(nikss_struct_field_descriptor_t));
@@ -312,7 +566,12 @@ int parse_struct_type(nikss_btf_t *btf_md, uint32_t type_id, size_t data_size, n
 
     fds->decoded_with_btf = true;
     unsigned field_idx = 0;
-    return setup_struct_field_descriptor_set_btf(btf_md, fds, type_id, &field_idx, 0);
+    int ret = setup_struct_field_descriptor_set_btf(btf_md, fds, type_id, &field_idx, 0);
+    if (ret == NO_ERROR) {
+        cache_struct_type(btf_md, type_id, data_size, fds);
+    }
+
+    return ret;
 }
 
 nikss_struct_field_descriptor_t *get_struct_field_descriptor(nikss_struct_field_descriptor_set_t *fds, size_t index)
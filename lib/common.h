@@ -21,6 +21,8 @@
 #include <stdint.h>
 #include <nikss/nikss.h>
 
+#include "stats.h"
+
 int str_ends_with(const char *str, const char *suffix);
 bool remove_suffix_from_str(char *str, const char *suffix);
 
@@ -30,11 +32,32 @@ void swap_byte_order(char *data, size_t len);
 
 void close_object_fd(int *fd);
 
+/* Returned memory is aligned as for malloc() */
+void *arena_alloc(nikss_arena_t *arena, size_t size);
+
+/* Per-CPU maps store one value slot per possible CPU; each slot is aligned to 8B */
+bool is_percpu_map(const nikss_bpf_map_descriptor_t *md);
+size_t get_map_value_slots(const nikss_bpf_map_descriptor_t *md);
+size_t get_map_value_slot_size(const nikss_bpf_map_descriptor_t *md);
+size_t get_map_value_buffer_size(const nikss_bpf_map_descriptor_t *md);
+
+/* Tells whether map holds state of the pipeline which should be preserved, i.e. it is not
+ * per-port, program or runtime-only map. Tuples of ternary tables are part of their tuples map. */
+bool is_pipeline_state_map(const char *name, uint32_t map_type);
+
 int build_ebpf_map_filename(char *buffer, size_t maxlen, nikss_context_t *ctx, const char *name);
 int build_ebpf_prog_filename(char *buffer, size_t maxlen, nikss_context_t *ctx, const char *name);
 int build_ebpf_pipeline_path(char *buffer, size_t maxlen, nikss_context_t *ctx);
 
+/* Exclusive lock of the pipeline directory in bpffs, it excludes other threads and processes. Returns
+ * file descriptor to release with pipeline_unlock() or negative error code. The lock is reentrant within
+ * a thread, every pipeline_lock() must be paired with pipeline_unlock(). */
+int pipeline_lock(nikss_pipeline_id_t pipeline_id);
+void pipeline_unlock(int *lock_fd);
+
 void free_struct_field_descriptor_set(nikss_struct_field_descriptor_set_t *fds);
+int copy_struct_field_descriptor_set(nikss_struct_field_descriptor_set_t *dst,
+                                    const nikss_struct_field_descriptor_set_t *src);
 int parse_struct_type(nikss_btf_t *btf_md, uint32_t type_id, size_t data_size, nikss_struct_field_descriptor_set_t *fds);
 nikss_struct_field_descriptor_t *get_struct_field_descriptor(nikss_struct_field_descriptor_set_t *fds, size_t index);
 
@@ -19,9 +19,12 @@
 
 #include <nikss/nikss.h>
 
+#include "btf.h"
+
 void nikss_context_init(nikss_context_t *ctx)
 {
     memset( ctx, 0, sizeof(nikss_context_t));
+    init_btf(&ctx->btf);
 }
 
 void nikss_context_free(nikss_context_t *ctx)
@@ -30,11 +33,18 @@ void nikss_context_free(nikss_context_t *ctx)
         return;
     }
 
+    free_context_cache(ctx);
+
     memset( ctx, 0, sizeof(nikss_context_t));
+    init_btf(&ctx->btf);
 }
 
 void nikss_context_set_pipeline(nikss_context_t *ctx, nikss_pipeline_id_t pipeline_id)
 {
+    /* Cached objects belong to the previous pipeline */
+    if (ctx->pipeline_id != pipeline_id) {
+        free_context_cache(ctx);
+    }
     ctx->pipeline_id = pipeline_id;
 }
 
@@ -17,6 +17,7 @@
 
 #include <bpf/bpf.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <linux/bpf.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -28,6 +29,36 @@
 #include "common.h"
 #include "nikss_table.h"
 
+#define ACTION_SELECTOR_LOCKED(ctx, call) ({                         \
+        int _lock_fd = -1;                                           \
+        int _ret = lock_action_selector((ctx), &_lock_fd);           \
+        if (_ret == NO_ERROR) {                                      \
+            _ret = (call);                                           \
+            pipeline_unlock(&_lock_fd);                              \
+        }                                                            \
+        _ret;                                                        \
+    })
+
+static int lock_action_selector(nikss_action_selector_context_t *ctx, int *lock_fd)
+{
+    *lock_fd = -1;
+    if (ctx == NULL || ctx->thread_safe == false) {
+        return NO_ERROR;
+    }
+
+    /* References tracked by the context might be outdated after changes made by others,
+     * but reservation of a reference detects it anyway, so they are not built again */
+    *lock_fd = pipeline_lock(ctx->pipeline_id);
+    if (*lock_fd < 0) {
+        int err = -(*lock_fd);
+        *lock_fd = -1;
+        fprintf(stderr, "failed to lock pipeline: %s\n", strerror(err));
+        return err;
+    }
+
+    return NO_ERROR;
+}
+
 static int open_group_map(nikss_action_selector_context_t *ctx,
                           nikss_action_selector_group_context_t *group)
 {
@@ -93,6 +124,69 @@ static uint32_t find_member_entry_idx_in_group(nikss_bpf_map_descriptor_t *group
     return 0;
 }
 
+static void update_member_use_count(nikss_action_selector_context_t *ctx, uint32_t member_ref, bool increment)
+{
+    if (ctx->member_use_count == NULL || member_ref > ctx->member_use_count_max_ref) {
+        return;
+    }
+
+    if (increment) {
+        ctx->member_use_count[member_ref] += 1;
+    } else if (ctx->member_use_count[member_ref] > 0) {
+        ctx->member_use_count[member_ref] -= 1;
+    }
+}
+
+/* Updates use count for every member of currently opened group */
+static void update_member_use_count_for_group(nikss_action_selector_context_t *ctx, bool increment)
+{
+    uint32_t number_of_members = 0;
+    if (get_number_of_members_in_group(ctx, &number_of_members) != NO_ERROR) {
+        return;
+    }
+
+    for (uint32_t index = 1; index <= number_of_members; ++index) {
+        uint32_t member_ref;  /* NOLINT(cppcoreguidelines-init-variables) */
+        if (bpf_map_lookup_elem(ctx->group.fd, &index, &member_ref) == 0) {
+            update_member_use_count(ctx, member_ref, increment);
+        }
+    }
+}
+
+/* Counts references to members from all the groups with one pass over them */
+static int build_member_use_count(nikss_action_selector_context_t *ctx)
+{
+    uint32_t key = 0;
+    uint32_t next_key = 0;
+    uint32_t *prev_key = NULL;
+
+    if (ctx->member_use_count != NULL) {
+        return NO_ERROR;
+    }
+    if (ctx->group.fd >= 0) {
+        return EINVAL;
+    }
+
+    ctx->member_use_count = calloc((size_t) ctx->map_of_members.max_entries + 1, sizeof(uint32_t));
+    if (ctx->member_use_count == NULL) {
+        return ENOMEM;
+    }
+    ctx->member_use_count_max_ref = ctx->map_of_members.max_entries;
+
+    while (bpf_map_get_next_key(ctx->map_of_groups.fd, prev_key, &next_key) == 0) {
+        nikss_action_selector_group_context_t group;
+        group.group_ref = next_key;
+        if (open_group_map(ctx, &group) == NO_ERROR) {
+            update_member_use_count_for_group(ctx, true);
+            close_object_fd(&ctx->group.fd);
+        }
+        key = next_key;
+        prev_key = &key;
+    }
+
+    return NO_ERROR;
+}
+
 static bool validate_member_reference(nikss_action_selector_context_t *ctx,
                                       nikss_action_selector_member_context_t *member)
 {
@@ -110,6 +204,62 @@ static bool validate_member_reference(nikss_action_selector_context_t *ctx,
     return true;
 }
 
+static void ref_allocator_free(nikss_action_selector_ref_allocator_t *allocator)
+{
+    if (allocator->used_refs != NULL) {
+        free(allocator->used_refs);
+    }
+    memset(allocator, 0, sizeof(*allocator));
+}
+
+static void ref_allocator_mark(nikss_action_selector_ref_allocator_t *allocator, uint32_t ref, bool used)
+{
+    if (allocator->initialized == false || ref == NIKSS_ACTION_SELECTOR_INVALID_REFERENCE || ref > allocator->max_ref) {
+        return;
+    }
+
+    if (used) {
+        allocator->used_refs[ref / 64] |= (uint64_t) 1 << (ref % 64);
+    } else {
+        allocator->used_refs[ref / 64] &= ~((uint64_t) 1 << (ref % 64));
+        if (ref < allocator->next_free_hint) {
+            allocator->next_free_hint = ref;
+        }
+    }
+}
+
+static bool ref_allocator_is_used(nikss_action_selector_ref_allocator_t *allocator, uint32_t ref)
+{
+    return (allocator->used_refs[ref / 64] & ((uint64_t) 1 << (ref % 64))) != 0;
+}
+
+/* Builds bitmap of used references with one pass over the map */
+static int ref_allocator_build(nikss_action_selector_ref_allocator_t *allocator, nikss_bpf_map_descriptor_t *map)
+{
+    ref_allocator_free(allocator);
+
+    /* Reference 0 is invalid, so it is not available for allocation */
+    size_t n_words = map->max_entries / 64 + 1;
+    allocator->used_refs = calloc(n_words, sizeof(uint64_t));
+    if (allocator->used_refs == NULL) {
+        return ENOMEM;
+    }
+    allocator->max_ref = map->max_entries;
+    allocator->next_free_hint = 1;
+    allocator->initialized = true;
+
+    uint32_t key = 0;
+    uint32_t next_key = 0;
+    uint32_t *prev_key = NULL;
+    while (bpf_map_get_next_key(map->fd, prev_key, &next_key) == 0) {
+        ref_allocator_mark(allocator, next_key, true);
+        key = next_key;
+        prev_key = &key;
+    }
+
+    return NO_ERROR;
+}
+
 void nikss_action_selector_ctx_init(nikss_action_selector_context_t *ctx)
 {
     if (ctx == NULL) {
@@ -148,6 +298,14 @@ void nikss_action_selector_ctx_free(nikss_action_selector_context_t *ctx)
 
     nikss_action_selector_group_free(&ctx->current_group);
     nikss_action_selector_member_free(&ctx->current_member);
+
+    ref_allocator_free(&ctx->member_refs);
+    ref_allocator_free(&ctx->group_refs);
+
+    if (ctx->member_use_count != NULL) {
+        free(ctx->member_use_count);
+    }
+    ctx->member_use_count = NULL;
 }
 
 static int do_open_action_selector(nikss_context_t *nikss_ctx, nikss_action_selector_context_t *ctx, const char *name)
@@ -226,10 +384,63 @@ int nikss_action_selector_ctx_name(nikss_context_t *nikss_ctx, nikss_action_sele
         fprintf(stderr, "couldn't open ActionSelector/ActionProfile %s: %s\n", name, strerror(ret));
         return ret;
     }
+    ctx->pipeline_id = nikss_context_get_pipeline(nikss_ctx);
 
     return NO_ERROR;
 }
 
+static int duplicate_selector_map_fd(nikss_bpf_map_descriptor_t *dst, const nikss_bpf_map_descriptor_t *src)
+{
+    *dst = *src;
+    if (src->fd < 0) {
+        return NO_ERROR;
+    }
+
+    dst->fd = fcntl(src->fd, F_DUPFD_CLOEXEC, 0);
+    if (dst->fd < 0) {
+        return errno;
+    }
+
+    return NO_ERROR;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_action_selector_ctx_clone(nikss_action_selector_context_t *dst,
+                                    const nikss_action_selector_context_t *src)
+{
+    if (dst == NULL || src == NULL || dst == src) {
+        return EINVAL;
+    }
+
+    nikss_action_selector_ctx_init(dst);
+    dst->pipeline_id = src->pipeline_id;
+    dst->thread_safe = true;
+
+    /* Other processes may change the selector between uses of clones, so references are not shared */
+    int ret = share_btf(&dst->btf, &src->btf);
+    if (ret == NO_ERROR) {
+        ret = duplicate_selector_map_fd(&dst->map_of_groups, &src->map_of_groups);
+    }
+    if (ret == NO_ERROR) {
+        ret = duplicate_selector_map_fd(&dst->group, &src->group);
+    }
+    if (ret == NO_ERROR) {
+        ret = duplicate_selector_map_fd(&dst->map_of_members, &src->map_of_members);
+    }
+    if (ret == NO_ERROR) {
+        ret = duplicate_selector_map_fd(&dst->empty_group_action, &src->empty_group_action);
+    }
+    if (ret == NO_ERROR) {
+        ret = duplicate_selector_map_fd(&dst->cache, &src->cache);
+    }
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to clone action selector context: %s\n", strerror(ret));
+        nikss_action_selector_ctx_free(dst);
+    }
+
+    return ret;
+}
+
 void nikss_action_selector_member_init(nikss_action_selector_member_context_t *member)
 {
     if (member == NULL) {
@@ -267,6 +478,36 @@ void nikss_action_selector_group_free(nikss_action_selector_group_context_t *gro
     (void) group;
 }
 
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_action_selector_ctx_exclusive(nikss_action_selector_context_t *ctx, bool enable)
+{
+    if (ctx == NULL) {
+        return EINVAL;
+    }
+
+    ctx->exclusive = enable;
+    /* Counts are built again when needed, changes made in the meantime are not tracked */
+    if (!enable && ctx->member_use_count != NULL) {
+        free(ctx->member_use_count);
+        ctx->member_use_count = NULL;
+        ctx->member_use_count_max_ref = 0;
+    }
+
+    return NO_ERROR;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_action_selector_ctx_thread_safe(nikss_action_selector_context_t *ctx, bool enable)
+{
+    if (ctx == NULL) {
+        return EINVAL;
+    }
+
+    ctx->thread_safe = enable;
+
+    return NO_ERROR;
+}
+
 bool nikss_action_selector_has_group_capability(nikss_action_selector_context_t *ctx)
 {
     if (ctx == NULL) {
@@ -317,7 +558,8 @@ void nikss_action_selector_set_group_reference(nikss_action_selector_group_conte
     group->group_ref = group_ref;
 }
 
-static uint32_t find_and_reserve_reference(nikss_bpf_map_descriptor_t *map, void *data)
+static uint32_t find_and_reserve_reference(nikss_bpf_map_descriptor_t *map,
+                                           nikss_action_selector_ref_allocator_t *allocator, void *data)
 {
     uint32_t ref = NIKSS_ACTION_SELECTOR_INVALID_REFERENCE;
     if (map->key_size != 4) {
@@ -329,6 +571,13 @@ static uint32_t find_and_reserve_reference(nikss_bpf_map_descriptor_t *map, void
         return NIKSS_ACTION_SELECTOR_INVALID_REFERENCE;
     }
 
+    if (allocator->initialized == false) {
+        if (ref_allocator_build(allocator, map) != NO_ERROR) {
+            fprintf(stderr, "not enough memory\n");
+            return NIKSS_ACTION_SELECTOR_INVALID_REFERENCE;
+        }
+    }
+
     char *value = malloc(map->value_size);
     if (value == NULL) {
         fprintf(stderr, "not enough memory\n");
@@ -340,9 +589,15 @@ static uint32_t find_and_reserve_reference(nikss_bpf_map_descriptor_t *map, void
         memset(value, 0, map->value_size);
     }
 
+    /* Bitmap might be outdated when other process modifies the map, so reservation
+     * still uses BPF_NOEXIST and a taken reference is just skipped. */
     bool found = false;
-    for (ref = 1; ref <= map->max_entries; ++ref) {
+    for (ref = allocator->next_free_hint; ref <= allocator->max_ref; ++ref) {
+        if (ref_allocator_is_used(allocator, ref)) {
+            continue;
+        }
         int return_code = bpf_map_update_elem(map->fd, &ref, value, BPF_NOEXIST);
+        ref_allocator_mark(allocator, ref, true);
         if (return_code == 0) {
             found = true;
             break;
@@ -351,38 +606,17 @@ static uint32_t find_and_reserve_reference(nikss_bpf_map_descriptor_t *map, void
     free(value);
 
     if (found == true) {
+        allocator->next_free_hint = ref + 1;
         return ref;
     }
-    return NIKSS_ACTION_SELECTOR_INVALID_REFERENCE;
-}
 
-int nikss_action_selector_add_member(nikss_action_selector_context_t *ctx, nikss_action_selector_member_context_t *member)
-{
-    if (ctx == NULL || member == NULL) {
-        return EINVAL;
-    }
-    if (ctx->map_of_members.fd < 0) {
-        fprintf(stderr, "Map of members not opened\n");
-        return EINVAL;
-    }
-
-    member->member_ref = find_and_reserve_reference(&ctx->map_of_members, NULL);
-    if (member->member_ref == NIKSS_ACTION_SELECTOR_INVALID_REFERENCE) {
-        fprintf(stderr, "failed to find available reference for member\n");
-        return EFBIG;  /* Probably, here we know we have access to eBPF, so most probably version is that map is full */
-    }
+    /* Map might be full or references were released by other process, so rebuild bitmap next time */
+    ref_allocator_free(allocator);
 
-    int ret = nikss_action_selector_update_member(ctx, member);
-    if (ret != NO_ERROR) {
-        /* Remove reserved reference if failed to add */
-        bpf_map_delete_elem(ctx->map_of_members.fd, &member->member_ref);
-        return ret;
-    }
-
-    return ret;
+    return NIKSS_ACTION_SELECTOR_INVALID_REFERENCE;
 }
 
-int nikss_action_selector_update_member(nikss_action_selector_context_t *ctx, nikss_action_selector_member_context_t *member)
+static int do_update_member(nikss_action_selector_context_t *ctx, nikss_action_selector_member_context_t *member)
 {
     if (ctx == NULL || member == NULL) {
         return EINVAL;
@@ -416,7 +650,44 @@ int nikss_action_selector_update_member(nikss_action_selector_context_t *ctx, ni
     return nikss_table_entry_update(&tec, &te);
 }
 
-static bool member_in_use(nikss_action_selector_context_t *ctx, nikss_action_selector_member_context_t *member)
+int nikss_action_selector_update_member(nikss_action_selector_context_t *ctx, nikss_action_selector_member_context_t *member)
+{
+    return ACTION_SELECTOR_LOCKED(ctx, do_update_member(ctx, member));
+}
+
+static int do_add_member(nikss_action_selector_context_t *ctx, nikss_action_selector_member_context_t *member)
+{
+    if (ctx == NULL || member == NULL) {
+        return EINVAL;
+    }
+    if (ctx->map_of_members.fd < 0) {
+        fprintf(stderr, "Map of members not opened\n");
+        return EINVAL;
+    }
+
+    member->member_ref = find_and_reserve_reference(&ctx->map_of_members, &ctx->member_refs, NULL);
+    if (member->member_ref == NIKSS_ACTION_SELECTOR_INVALID_REFERENCE) {
+        fprintf(stderr, "failed to find available reference for member\n");
+        return EFBIG;  /* Probably, here we know we have access to eBPF, so most probably version is that map is full */
+    }
+
+    int ret = do_update_member(ctx, member);
+    if (ret != NO_ERROR) {
+        /* Remove reserved reference if failed to add */
+        bpf_map_delete_elem(ctx->map_of_members.fd, &member->member_ref);
+        ref_allocator_mark(&ctx->member_refs, member->member_ref, false);
+        return ret;
+    }
+
+    return ret;
+}
+
+int nikss_action_selector_add_member(nikss_action_selector_context_t *ctx, nikss_action_selector_member_context_t *member)
+{
+    return ACTION_SELECTOR_LOCKED(ctx, do_add_member(ctx, member));
+}
+
+static bool member_in_use_scan(nikss_action_selector_context_t *ctx, nikss_action_selector_member_context_t *member)
 {
     bool found = false;
     uint32_t key = 0;
@@ -457,7 +728,27 @@ static bool member_in_use(nikss_action_selector_context_t *ctx, nikss_action_sel
     return found;
 }
 
-int nikss_action_selector_del_member(nikss_action_selector_context_t *ctx, nikss_action_selector_member_context_t *member)
+static bool member_in_use(nikss_action_selector_context_t *ctx, nikss_action_selector_member_context_t *member)
+{
+    if (ctx->map_of_groups.fd < 0) {
+        return false; /* No groups available */
+    }
+
+    /* Counts are not valid when groups may be changed by others */
+    if (!ctx->exclusive || build_member_use_count(ctx) != NO_ERROR || member->member_ref > ctx->member_use_count_max_ref) {
+        return member_in_use_scan(ctx, member);
+    }
+
+    uint32_t use_count = ctx->member_use_count[member->member_ref];
+    if (use_count > 0) {
+        fprintf(stderr, "%u referenced in %u group(s)\n", member->member_ref, use_count);
+        return true;
+    }
+
+    return false;
+}
+
+static int do_del_member(nikss_action_selector_context_t *ctx, nikss_action_selector_member_context_t *member)
 {
     if (ctx == NULL || member == NULL) {
         return EINVAL;
@@ -487,6 +778,7 @@ int nikss_action_selector_del_member(nikss_action_selector_context_t *ctx, nikss
         fprintf(stderr, "failed to delete member %u: %s\n", member->member_ref, strerror(ret));
         return ret;
     }
+    ref_allocator_mark(&ctx->member_refs, member->member_ref, false);
 
     ret = clear_table_cache(&ctx->cache);
     if (ret != NO_ERROR) {
@@ -496,7 +788,12 @@ int nikss_action_selector_del_member(nikss_action_selector_context_t *ctx, nikss
     return NO_ERROR;
 }
 
-int nikss_action_selector_add_group(nikss_action_selector_context_t *ctx, nikss_action_selector_group_context_t *group)
+int nikss_action_selector_del_member(nikss_action_selector_context_t *ctx, nikss_action_selector_member_context_t *member)
+{
+    return ACTION_SELECTOR_LOCKED(ctx, do_del_member(ctx, member));
+}
+
+static int do_add_group(nikss_action_selector_context_t *ctx, nikss_action_selector_group_context_t *group)
 {
     if (ctx == NULL || group == NULL) {
         return EINVAL;
@@ -530,7 +827,7 @@ int nikss_action_selector_add_group(nikss_action_selector_context_t *ctx, nikss_
         return err;
     }
 
-    group->group_ref = find_and_reserve_reference(&ctx->map_of_groups, &ctx->group.fd);
+    group->group_ref = find_and_reserve_reference(&ctx->map_of_groups, &ctx->group_refs, &ctx->group.fd);
     /* Group is no more needed, restore ctx to its original state */
     close_object_fd(&ctx->group.fd);
 
@@ -542,7 +839,12 @@ int nikss_action_selector_add_group(nikss_action_selector_context_t *ctx, nikss_
     return NO_ERROR;
 }
 
-int nikss_action_selector_del_group(nikss_action_selector_context_t *ctx, nikss_action_selector_group_context_t *group)
+int nikss_action_selector_add_group(nikss_action_selector_context_t *ctx, nikss_action_selector_group_context_t *group)
+{
+    return ACTION_SELECTOR_LOCKED(ctx, do_add_group(ctx, group));
+}
+
+static int do_del_group(nikss_action_selector_context_t *ctx, nikss_action_selector_group_context_t *group)
 {
     if (ctx == NULL || group == NULL) {
         return EINVAL;
@@ -552,12 +854,24 @@ int nikss_action_selector_del_group(nikss_action_selector_context_t *ctx, nikss_
         return EINVAL;
     }
 
+    /* Members of group are needed after its removal to update their use count */
+    if (ctx->member_use_count != NULL && ctx->group.fd < 0) {
+        open_group_map(ctx, group);
+    }
+
     int ret = bpf_map_delete_elem(ctx->map_of_groups.fd, &group->group_ref);
     if (ret != 0) {
         ret = errno;
         fprintf(stderr, "failed to delete group %u: %s\n", group->group_ref, strerror(ret));
+        close_object_fd(&ctx->group.fd);
         return ret;
     }
+    ref_allocator_mark(&ctx->group_refs, group->group_ref, false);
+
+    if (ctx->group.fd >= 0) {
+        update_member_use_count_for_group(ctx, false);
+        close_object_fd(&ctx->group.fd);
+    }
 
     ret = clear_table_cache(&ctx->cache);
     if (ret != NO_ERROR) {
@@ -567,6 +881,11 @@ int nikss_action_selector_del_group(nikss_action_selector_context_t *ctx, nikss_
     return NO_ERROR;
 }
 
+int nikss_action_selector_del_group(nikss_action_selector_context_t *ctx, nikss_action_selector_group_context_t *group)
+{
+    return ACTION_SELECTOR_LOCKED(ctx, do_del_group(ctx, group));
+}
+
 static int append_member_to_group(nikss_action_selector_context_t *ctx,
                                   nikss_action_selector_member_context_t *member)
 {
@@ -607,9 +926,9 @@ static int append_member_to_group(nikss_action_selector_context_t *ctx,
     return NO_ERROR;
 }
 
-int nikss_action_selector_add_member_to_group(nikss_action_selector_context_t *ctx,
-                                              nikss_action_selector_group_context_t *group,
-                                              nikss_action_selector_member_context_t *member)
+static int do_add_member_to_group(nikss_action_selector_context_t *ctx,
+                                  nikss_action_selector_group_context_t *group,
+                                  nikss_action_selector_member_context_t *member)
 {
     int return_code = NO_ERROR;
 
@@ -641,6 +960,7 @@ int nikss_action_selector_add_member_to_group(nikss_action_selector_context_t *c
     if (return_code != NO_ERROR) {
         return return_code;
     }
+    update_member_use_count(ctx, member->member_ref, true);
 
     return_code = clear_table_cache(&ctx->cache);
     if (return_code != NO_ERROR) {
@@ -650,6 +970,13 @@ int nikss_action_selector_add_member_to_group(nikss_action_selector_context_t *c
     return return_code;
 }
 
+int nikss_action_selector_add_member_to_group(nikss_action_selector_context_t *ctx,
+                                              nikss_action_selector_group_context_t *group,
+                                              nikss_action_selector_member_context_t *member)
+{
+    return ACTION_SELECTOR_LOCKED(ctx, do_add_member_to_group(ctx, group, member));
+}
+
 static int remove_member_from_group(nikss_action_selector_context_t *ctx,
                                     nikss_action_selector_member_context_t *member)
 {
@@ -720,9 +1047,9 @@ static int remove_member_from_group(nikss_action_selector_context_t *ctx,
     return NO_ERROR;
 }
 
-int nikss_action_selector_del_member_from_group(nikss_action_selector_context_t *ctx,
-                                                nikss_action_selector_group_context_t *group,
-                                                nikss_action_selector_member_context_t *member)
+static int do_del_member_from_group(nikss_action_selector_context_t *ctx,
+                                    nikss_action_selector_group_context_t *group,
+                                    nikss_action_selector_member_context_t *member)
 {
     int return_code = NO_ERROR;
 
@@ -755,6 +1082,7 @@ int nikss_action_selector_del_member_from_group(nikss_action_selector_context_t
     if (return_code != NO_ERROR) {
         return return_code;
     }
+    update_member_use_count(ctx, member->member_ref, false);
 
     return_code = clear_table_cache(&ctx->cache);
     if (return_code != NO_ERROR) {
@@ -764,7 +1092,205 @@ int nikss_action_selector_del_member_from_group(nikss_action_selector_context_t
     return NO_ERROR;
 }
 
-int nikss_action_selector_set_empty_group_action(nikss_action_selector_context_t *ctx, nikss_action_t *action)
+int nikss_action_selector_del_member_from_group(nikss_action_selector_context_t *ctx,
+                                                nikss_action_selector_group_context_t *group,
+                                                nikss_action_selector_member_context_t *member)
+{
+    return ACTION_SELECTOR_LOCKED(ctx, do_del_member_from_group(ctx, group, member));
+}
+
+static int compare_member_refs(const void *a, const void *b)
+{
+    uint32_t ref_a = *((const uint32_t *) a);
+    uint32_t ref_b = *((const uint32_t *) b);
+
+    return (ref_a > ref_b) - (ref_a < ref_b);
+}
+
+static int validate_group_members(nikss_action_selector_context_t *ctx, const uint32_t *member_refs, size_t n_members)
+{
+    uint32_t *sorted = malloc((n_members + 1) * sizeof(uint32_t));
+    if (sorted == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return ENOMEM;
+    }
+    if (n_members > 0) {
+        memcpy(sorted, member_refs, n_members * sizeof(uint32_t));
+    }
+    qsort(sorted, n_members, sizeof(uint32_t), compare_member_refs);
+
+    int ret = NO_ERROR;
+    for (size_t i = 0; i < n_members; i++) {
+        if (i > 0 && sorted[i] == sorted[i - 1]) {
+            fprintf(stderr, "%u given more than once\n", sorted[i]);
+            ret = EEXIST;
+            break;
+        }
+        nikss_action_selector_member_context_t member = { .member_ref = sorted[i] };
+        if (sorted[i] == NIKSS_ACTION_SELECTOR_INVALID_REFERENCE || !validate_member_reference(ctx, &member)) {
+            fprintf(stderr, "invalid member reference: %u\n", sorted[i]);
+            ret = EINVAL;
+            break;
+        }
+    }
+    free(sorted);
+
+    return ret;
+}
+
+/* Rewrites the opened group, old members are returned to update their use count */
+static int rewrite_group_members(nikss_action_selector_context_t *ctx, const uint32_t *member_refs,
+                                 uint32_t n_members, uint32_t **old_refs, uint32_t *n_old)
+{
+    if (ctx->group.key_size != 4 || ctx->group.value_size != 4 || ctx->group.fd < 0) {
+        return EINVAL;
+    }
+    /* Index 0 holds number of members */
+    if (n_members >= ctx->group.max_entries) {
+        fprintf(stderr, "too many members for group, at most %u allowed\n", ctx->group.max_entries - 1);
+        return E2BIG;
+    }
+
+    int return_code = get_number_of_members_in_group(ctx, n_old);
+    if (return_code != NO_ERROR) {
+        return return_code;
+    }
+    if (*n_old >= ctx->group.max_entries) {
+        fprintf(stderr, "detected data inconsistency in group\n");
+        return EINVAL;
+    }
+
+    uint32_t n_max = n_members > *n_old ? n_members : *n_old;
+    uint32_t *keys = malloc(((size_t) n_max + 1) * sizeof(uint32_t));
+    uint32_t *values = malloc(((size_t) n_max + 1) * sizeof(uint32_t));
+    *old_refs = malloc(((size_t) *n_old + 1) * sizeof(uint32_t));
+    if (keys == NULL || values == NULL || *old_refs == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return_code = ENOMEM;
+        goto clean_up;
+    }
+
+    for (uint32_t index = 1; index <= *n_old; ++index) {
+        if (bpf_map_lookup_elem(ctx->group.fd, &index, &(*old_refs)[index - 1]) != 0) {
+            (*old_refs)[index - 1] = NIKSS_ACTION_SELECTOR_INVALID_REFERENCE;
+        }
+    }
+
+    /* Order of entries in the batch matters, because the data plane selects member by index lower than or
+     * equal to the number of members. A growing group gets its new members before the number of members is
+     * increased, a shrinking one first decreases the number of members and then prunes unused values. Every
+     * member in range is always valid, so a packet selects either old or new member, never an unused one. */
+    uint32_t n_keys = 0;
+    if (n_members < *n_old) {
+        keys[n_keys] = 0;
+        values[n_keys++] = n_members;
+    }
+    for (uint32_t i = 0; i < n_members; i++) {
+        keys[n_keys] = i + 1;
+        values[n_keys++] = member_refs[i];
+    }
+    if (n_members >= *n_old) {
+        keys[n_keys] = 0;
+        values[n_keys++] = n_members;
+    }
+    for (uint32_t index = n_members + 1; index <= *n_old; index++) {
+        keys[n_keys] = index;
+        values[n_keys++] = 0;
+    }
+
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = 0,
+                        .flags = 0,
+    );
+    uint32_t n_updated = n_keys;
+    if (bpf_map_update_batch(ctx->group.fd, keys, values, &n_updated, &opts) != 0) {
+        /* Fall back to single updates in the same order when batch is not supported */
+        return_code = errno;
+        if (n_updated != 0 && n_updated != n_keys) {
+            fprintf(stderr, "failed to update members of group: %s\n", strerror(return_code));
+            goto clean_up;
+        }
+        return_code = NO_ERROR;
+        for (uint32_t i = 0; i < n_keys; i++) {
+            if (bpf_map_update_elem(ctx->group.fd, &keys[i], &values[i], BPF_ANY) != 0) {
+                return_code = errno;
+                fprintf(stderr, "failed to update members of group: %s\n", strerror(return_code));
+                goto clean_up;
+            }
+        }
+    }
+
+clean_up:
+    free(keys);
+    free(values);
+
+    return return_code;
+}
+
+static int do_set_group_members(nikss_action_selector_context_t *ctx,
+                                nikss_action_selector_group_context_t *group,
+                                const uint32_t *member_refs, size_t n_members)
+{
+    uint32_t *old_refs = NULL;
+    uint32_t n_old = 0;
+
+    if (ctx == NULL || group == NULL || (member_refs == NULL && n_members > 0)) {
+        return EINVAL;
+    }
+    if (ctx->group.key_size != 4 || ctx->group.value_size != 4) {
+        fprintf(stderr, "invalid group map\n");
+        return EINVAL;
+    }
+    if (ctx->group.fd >= 0) {
+        fprintf(stderr, "group map not closed properly before\n");
+        return EINVAL;
+    }
+    if (n_members >= UINT32_MAX) {
+        return E2BIG;
+    }
+
+    int return_code = validate_group_members(ctx, member_refs, n_members);
+    if (return_code != NO_ERROR) {
+        return return_code;
+    }
+
+    return_code = open_group_map(ctx, group);
+    if (return_code != NO_ERROR) {
+        return return_code;
+    }
+
+    return_code = rewrite_group_members(ctx, member_refs, (uint32_t) n_members, &old_refs, &n_old);
+    close_object_fd(&ctx->group.fd);
+    if (return_code == NO_ERROR) {
+        for (uint32_t i = 0; i < n_old; i++) {
+            update_member_use_count(ctx, old_refs[i], false);
+        }
+        for (size_t i = 0; i < n_members; i++) {
+            update_member_use_count(ctx, member_refs[i], true);
+        }
+    }
+    free(old_refs);
+    if (return_code != NO_ERROR) {
+        return return_code;
+    }
+
+    return_code = clear_table_cache(&ctx->cache);
+    if (return_code != NO_ERROR) {
+        fprintf(stderr, "failed to clear cache: %s\n", strerror(return_code));
+    }
+
+    return NO_ERROR;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_action_selector_set_group_members(nikss_action_selector_context_t *ctx,
+                                            nikss_action_selector_group_context_t *group,
+                                            const uint32_t *member_refs, size_t n_members)
+{
+    return ACTION_SELECTOR_LOCKED(ctx, do_set_group_members(ctx, group, member_refs, n_members));
+}
+
+static int do_set_empty_group_action(nikss_action_selector_context_t *ctx, nikss_action_t *action)
 {
     if (ctx == NULL || action == NULL) {
         return EINVAL;
@@ -803,6 +1329,11 @@ int nikss_action_selector_set_empty_group_action(nikss_action_selector_context_t
     return nikss_table_entry_update(&tec, &te);
 }
 
+int nikss_action_selector_set_empty_group_action(nikss_action_selector_context_t *ctx, nikss_action_t *action)
+{
+    return ACTION_SELECTOR_LOCKED(ctx, do_set_empty_group_action(ctx, action));
+}
+
 int nikss_action_selector_get_empty_group_action(nikss_action_selector_context_t *ctx,
                                                  nikss_action_selector_member_context_t *member)
 {
@@ -17,6 +17,7 @@
 
 #include <bpf/bpf.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -28,6 +29,8 @@
 #include "nikss_counter.h"
 
 #define MAX_COUNTER_VALUE_SIZE 16
+/* Number of entries whose values (of every CPU) are read at once by nikss_counter_snapshot_update() */
+#define COUNTER_SNAPSHOT_CHUNK_SIZE 1024
 
 #define MAX_COUNTER_VALUE_SIZE_SINGLE_FIELD 8
 #define MAX_COUNTER_VALUE_SIZE_BOTH_FIELDS  MAX_COUNTER_VALUE_SIZE
@@ -60,6 +63,36 @@ void nikss_counter_ctx_free(nikss_counter_context_t *ctx)
     ctx->prev_entry_key= NULL;
 }
 
+int nikss_counter_ctx_clone(nikss_counter_context_t *dst, const nikss_counter_context_t *src)
+{
+    if (dst == NULL || src == NULL || dst == src) {
+        return EINVAL;
+    }
+
+    nikss_counter_ctx_init(dst);
+    dst->counter = src->counter;
+    dst->counter.fd = -1;
+    dst->counter_type = src->counter_type;
+    dst->percpu_breakdown = src->percpu_breakdown;
+
+    int ret = share_btf(&dst->btf_metadata, &src->btf_metadata);
+    if (ret == NO_ERROR && src->counter.fd >= 0) {
+        dst->counter.fd = fcntl(src->counter.fd, F_DUPFD_CLOEXEC, 0);
+        if (dst->counter.fd < 0) {
+            ret = errno;
+        }
+    }
+    if (ret == NO_ERROR) {
+        ret = copy_struct_field_descriptor_set(&dst->key_fds, &src->key_fds);
+    }
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to clone counter context: %s\n", strerror(ret));
+        nikss_counter_ctx_free(dst);
+    }
+
+    return ret;
+}
+
 nikss_counter_type_t get_counter_type(nikss_btf_t *btf, uint32_t type_id)
 {
     const struct btf_type *type = btf_get_type_by_id(btf->btf, type_id);
@@ -176,6 +209,17 @@ void nikss_counter_entry_free(nikss_counter_entry_t *entry)
         free(entry->raw_key);
     }
     entry->raw_key = NULL;
+
+    if (entry->percpu_bytes != NULL) {
+        free(entry->percpu_bytes);
+    }
+    entry->percpu_bytes = NULL;
+
+    if (entry->percpu_packets != NULL) {
+        free(entry->percpu_packets);
+    }
+    entry->percpu_packets = NULL;
+    entry->n_cpus = 0;
 }
 
 int nikss_counter_entry_set_key(nikss_counter_entry_t *entry, const void *data, size_t data_len)
@@ -230,6 +274,48 @@ nikss_counter_type_t nikss_counter_get_type(nikss_counter_context_t *ctx)
     return ctx->counter_type;
 }
 
+bool nikss_counter_is_percpu(nikss_counter_context_t *ctx)
+{
+    if (ctx == NULL) {
+        return false;
+    }
+
+    return is_percpu_map(&ctx->counter);
+}
+
+void nikss_counter_ctx_percpu_breakdown(nikss_counter_context_t *ctx, bool enable)
+{
+    if (ctx == NULL) {
+        return;
+    }
+
+    ctx->percpu_breakdown = enable;
+}
+
+size_t nikss_counter_entry_get_n_cpus(nikss_counter_entry_t *entry)
+{
+    if (entry == NULL) {
+        return 0;
+    }
+    return entry->n_cpus;
+}
+
+nikss_counter_value_t nikss_counter_entry_get_cpu_packets(nikss_counter_entry_t *entry, size_t cpu)
+{
+    if (entry == NULL || entry->percpu_packets == NULL || cpu >= entry->n_cpus) {
+        return 0;
+    }
+    return entry->percpu_packets[cpu];
+}
+
+nikss_counter_value_t nikss_counter_entry_get_cpu_bytes(nikss_counter_entry_t *entry, size_t cpu)
+{
+    if (entry == NULL || entry->percpu_bytes == NULL || cpu >= entry->n_cpus) {
+        return 0;
+    }
+    return entry->percpu_bytes[cpu];
+}
+
 void nikss_counter_entry_set_packets(nikss_counter_entry_t *entry, nikss_counter_value_t packets)
 {
     if (entry == NULL) {
@@ -295,20 +381,89 @@ int convert_counter_data_to_entry(const char *data, size_t counter_size,
     return NO_ERROR;
 }
 
+static int allocate_percpu_breakdown(nikss_counter_entry_t *entry, size_t n_cpus)
+{
+    if (entry->n_cpus == n_cpus && entry->percpu_bytes != NULL && entry->percpu_packets != NULL) {
+        return NO_ERROR;  /* already allocated */
+    }
+
+    if (entry->percpu_bytes != NULL) {
+        free(entry->percpu_bytes);
+    }
+    if (entry->percpu_packets != NULL) {
+        free(entry->percpu_packets);
+    }
+    entry->percpu_bytes = calloc(n_cpus, sizeof(nikss_counter_value_t));
+    entry->percpu_packets = calloc(n_cpus, sizeof(nikss_counter_value_t));
+    entry->n_cpus = n_cpus;
+
+    if (entry->percpu_bytes == NULL || entry->percpu_packets == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return ENOMEM;
+    }
+
+    return NO_ERROR;
+}
+
+/* Sums values from all CPU slots, also stores each of them if breakdown was requested */
+static int aggregate_percpu_counter_value(nikss_counter_context_t *ctx, const char *value, nikss_counter_entry_t *entry)
+{
+    size_t n_cpus = get_map_value_slots(&ctx->counter);
+    size_t slot_size = get_map_value_slot_size(&ctx->counter);
+    bool breakdown = ctx->percpu_breakdown;
+
+    if (breakdown) {
+        int ret = allocate_percpu_breakdown(entry, n_cpus);
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+    }
+
+    nikss_counter_value_t bytes = 0;
+    nikss_counter_value_t packets = 0;
+    for (size_t cpu = 0; cpu < n_cpus; cpu++) {
+        convert_counter_data_to_entry(value + cpu * slot_size, ctx->counter.value_size, ctx->counter_type, entry);
+        bytes += entry->bytes;
+        packets += entry->packets;
+        if (breakdown) {
+            entry->percpu_bytes[cpu] = entry->bytes;
+            entry->percpu_packets[cpu] = entry->packets;
+        }
+    }
+
+    entry->bytes = bytes;
+    entry->packets = packets;
+
+    return NO_ERROR;
+}
+
 static int read_and_parse_counter_value(nikss_counter_context_t *ctx, nikss_counter_entry_t *entry)
 {
-    char value[MAX_COUNTER_VALUE_SIZE];
-    int ret = bpf_map_lookup_elem(ctx->counter.fd, entry->raw_key, &value[0]);
+    char *value = malloc(get_map_value_buffer_size(&ctx->counter));
+    if (value == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return ENOMEM;
+    }
+
+    int ret = bpf_map_lookup_elem(ctx->counter.fd, entry->raw_key, value);
     if (ret != 0) {
         ret = errno;
         fprintf(stderr, "failed to read Counter entry: %s\n", strerror(ret));
-        return ret;
+        goto clean_up;
     }
 
     /* raw_key is always used as a data source for user request on next field, so convert it to right byte order */
     fix_struct_data_byte_order(&ctx->key_fds, entry->raw_key, ctx->counter.key_size);
 
-    return convert_counter_data_to_entry(value, ctx->counter.value_size, ctx->counter_type, entry);
+    if (is_percpu_map(&ctx->counter)) {
+        ret = aggregate_percpu_counter_value(ctx, value, entry);
+    } else {
+        ret = convert_counter_data_to_entry(value, ctx->counter.value_size, ctx->counter_type, entry);
+    }
+
+clean_up:
+    free(value);
+    return ret;
 }
 
 int nikss_counter_get(nikss_counter_context_t *ctx, nikss_counter_entry_t *entry)
@@ -402,7 +557,8 @@ static int set_all_counters(nikss_counter_context_t *ctx, void *encoded_value, b
     int ret = 0;
     bool can_remove_entries = is_zero_counter_value(encoded_value, ctx->counter.value_size);
 
-    if (ctx->counter.type == BPF_MAP_TYPE_ARRAY || !remove_entry_allowed) {
+    if (ctx->counter.type == BPF_MAP_TYPE_ARRAY || ctx->counter.type == BPF_MAP_TYPE_PERCPU_ARRAY ||
+        !remove_entry_allowed) {
         can_remove_entries = false;
     }
 
@@ -452,36 +608,49 @@ static int do_counter_set(nikss_counter_context_t *ctx, nikss_counter_entry_t *e
         return EINVAL;
     }
 
-    char value[MAX_COUNTER_VALUE_SIZE];
-    if (convert_counter_entry_to_data(ctx, entry, &value[0]) != NO_ERROR) {
-        return EINVAL;
+    /* For per-CPU counters the whole value is assigned to CPU 0 and other CPUs are zeroed,
+     * so the aggregated value read back is equal to the one that has been set. */
+    char *value = calloc(1, get_map_value_buffer_size(&ctx->counter));
+    if (value == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return ENOMEM;
+    }
+
+    int ret = convert_counter_entry_to_data(ctx, entry, value);
+    if (ret != NO_ERROR) {
+        ret = EINVAL;
+        goto clean_up;
     }
 
     if (entry->entry_key.n_fields == 0) {
-        return set_all_counters(ctx, &value[0], remove_entry_allowed);
+        ret = set_all_counters(ctx, value, remove_entry_allowed);
+        goto clean_up;
     }
 
     if (allocate_key_buffer(ctx, entry) == NULL) {
-        return ENOMEM;
+        ret = ENOMEM;
+        goto clean_up;
     }
 
-    int ret = construct_struct_from_fields(&entry->entry_key, &ctx->key_fds, entry->raw_key, ctx->counter.key_size);
+    ret = construct_struct_from_fields(&entry->entry_key, &ctx->key_fds, entry->raw_key, ctx->counter.key_size);
     if (ret != NO_ERROR) {
-        return ret;
+        goto clean_up;
     }
 
     if (remove_entry_allowed &&
-        ctx->counter.type == BPF_MAP_TYPE_HASH &&
-        is_zero_counter_value(&value[0], ctx->counter.value_size)) {
+        (ctx->counter.type == BPF_MAP_TYPE_HASH || ctx->counter.type == BPF_MAP_TYPE_PERCPU_HASH) &&
+        is_zero_counter_value(value, ctx->counter.value_size)) {
         ret = bpf_map_delete_elem(ctx->counter.fd, entry->raw_key);
     } else {
-        ret = bpf_map_update_elem(ctx->counter.fd, entry->raw_key, &value[0], 0);
+        ret = bpf_map_update_elem(ctx->counter.fd, entry->raw_key, value, 0);
     }
     if (ret != 0) {
         ret = errno;
         fprintf(stderr, "failed to set an entry: %s\n", strerror(ret));
     }
 
+clean_up:
+    free(value);
     return ret;
 }
 
@@ -501,3 +670,390 @@ int nikss_counter_reset(nikss_counter_context_t *ctx, nikss_counter_entry_t *ent
 
     return do_counter_set(ctx, entry, true);
 }
+
+void nikss_counter_snapshot_init(nikss_counter_snapshot_t *snapshot)
+{
+    if (snapshot == NULL) {
+        return;
+    }
+
+    memset(snapshot, 0, sizeof(nikss_counter_snapshot_t));
+}
+
+static void free_snapshot_buffer(void **buffer)
+{
+    if (*buffer != NULL) {
+        free(*buffer);
+    }
+    *buffer = NULL;
+}
+
+void nikss_counter_snapshot_free(nikss_counter_snapshot_t *snapshot)
+{
+    if (snapshot == NULL) {
+        return;
+    }
+
+    free_snapshot_buffer((void **) &snapshot->keys);
+    free_snapshot_buffer((void **) &snapshot->bytes);
+    free_snapshot_buffer((void **) &snapshot->packets);
+    free_snapshot_buffer((void **) &snapshot->order);
+    free_snapshot_buffer((void **) &snapshot->prev_keys);
+    free_snapshot_buffer((void **) &snapshot->prev_bytes);
+    free_snapshot_buffer((void **) &snapshot->prev_packets);
+    free_snapshot_buffer((void **) &snapshot->prev_order);
+    free_snapshot_buffer((void **) &snapshot->changed);
+    free_snapshot_buffer((void **) &snapshot->removed);
+    free_snapshot_buffer((void **) &snapshot->raw_values);
+    free_snapshot_buffer((void **) &snapshot->batch_token);
+
+    snapshot->n_entries = 0;
+    snapshot->n_prev_entries = 0;
+    snapshot->n_changed = 0;
+    snapshot->n_removed = 0;
+    snapshot->capacity = 0;
+}
+
+static int allocate_snapshot_buffers(nikss_counter_context_t *ctx, nikss_counter_snapshot_t *snapshot)
+{
+    size_t capacity = ctx->counter.max_entries;
+    if (snapshot->capacity == capacity && snapshot->keys != NULL) {
+        return NO_ERROR;  /* already allocated */
+    }
+
+    nikss_counter_snapshot_free(snapshot);
+
+    size_t key_size = ctx->counter.key_size;
+    size_t token_size = key_size > sizeof(uint64_t) ? key_size : sizeof(uint64_t);
+    size_t chunk_size = capacity < COUNTER_SNAPSHOT_CHUNK_SIZE ? capacity : COUNTER_SNAPSHOT_CHUNK_SIZE;
+
+    snapshot->keys = malloc(capacity * key_size);
+    snapshot->bytes = malloc(capacity * sizeof(nikss_counter_value_t));
+    snapshot->packets = malloc(capacity * sizeof(nikss_counter_value_t));
+    snapshot->order = malloc(capacity * sizeof(size_t));
+    snapshot->prev_keys = malloc(capacity * key_size);
+    snapshot->prev_bytes = malloc(capacity * sizeof(nikss_counter_value_t));
+    snapshot->prev_packets = malloc(capacity * sizeof(nikss_counter_value_t));
+    snapshot->prev_order = malloc(capacity * sizeof(size_t));
+    snapshot->changed = malloc(capacity * sizeof(size_t));
+    snapshot->removed = malloc(capacity * sizeof(size_t));
+    /* Values of all CPUs are needed only until they are summed up, so they are read in chunks */
+    snapshot->raw_values = malloc(chunk_size * get_map_value_buffer_size(&ctx->counter));
+    snapshot->batch_token = calloc(1, token_size);
+
+    if (snapshot->keys == NULL || snapshot->bytes == NULL || snapshot->packets == NULL || snapshot->order == NULL ||
+        snapshot->prev_keys == NULL || snapshot->prev_bytes == NULL || snapshot->prev_packets == NULL ||
+        snapshot->prev_order == NULL || snapshot->changed == NULL || snapshot->removed == NULL ||
+        snapshot->raw_values == NULL || snapshot->batch_token == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        nikss_counter_snapshot_free(snapshot);
+        return ENOMEM;
+    }
+
+    snapshot->capacity = capacity;
+    snapshot->chunk_size = chunk_size;
+
+    return NO_ERROR;
+}
+
+/* Sums up values of all CPUs of n_values entries read to raw_values, starting from entry first */
+static void decode_snapshot_values(nikss_counter_context_t *ctx, nikss_counter_snapshot_t *snapshot,
+                                   size_t first, size_t n_values)
+{
+    size_t n_slots = get_map_value_slots(&ctx->counter);
+    size_t slot_size = get_map_value_slot_size(&ctx->counter);
+    nikss_counter_entry_t value;
+
+    for (size_t i = 0; i < n_values; i++) {
+        const char *raw_value = snapshot->raw_values + i * n_slots * slot_size;
+        snapshot->bytes[first + i] = 0;
+        snapshot->packets[first + i] = 0;
+        for (size_t cpu = 0; cpu < n_slots; cpu++) {
+            convert_counter_data_to_entry(raw_value + cpu * slot_size, ctx->counter.value_size,
+                                          ctx->counter_type, &value);
+            snapshot->bytes[first + i] += value.bytes;
+            snapshot->packets[first + i] += value.packets;
+        }
+    }
+}
+
+/* Reads whole counter into snapshot->keys, snapshot->bytes and snapshot->packets */
+static int read_snapshot_batch(nikss_counter_context_t *ctx, nikss_counter_snapshot_t *snapshot)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = 0,
+                        .flags = 0,
+    );
+
+    size_t n_entries = 0;
+    bool started = false;
+
+    while (n_entries < snapshot->capacity) {
+        size_t remaining = snapshot->capacity - n_entries;
+        uint32_t count = remaining < snapshot->chunk_size ? remaining : snapshot->chunk_size;
+        void *in_batch = started ? snapshot->batch_token : NULL;
+        int ret = bpf_map_lookup_batch(ctx->counter.fd, in_batch, snapshot->batch_token,
+                                       snapshot->keys + n_entries * ctx->counter.key_size,
+                                       snapshot->raw_values, &count, &opts);
+        if (ret != 0) {
+            ret = errno;
+            if (ret == ENOENT) {
+                /* No more entries, but the last chunk is still valid */
+                decode_snapshot_values(ctx, snapshot, n_entries, count);
+                n_entries += count;
+                break;
+            }
+            if (!started) {
+                /* Kernel or map type does not support batch lookup */
+                return ENOTSUP;
+            }
+            fprintf(stderr, "failed to read Counter entries: %s\n", strerror(ret));
+            return ret;
+        }
+
+        started = true;
+        decode_snapshot_values(ctx, snapshot, n_entries, count);
+        n_entries += count;
+    }
+
+    snapshot->n_entries = n_entries;
+
+    return NO_ERROR;
+}
+
+static int read_snapshot_iterative(nikss_counter_context_t *ctx, nikss_counter_snapshot_t *snapshot)
+{
+    size_t key_size = ctx->counter.key_size;
+    size_t value_size = get_map_value_buffer_size(&ctx->counter);
+    size_t n_entries = 0;
+    size_t n_values = 0;
+    char *prev_key = NULL;
+
+    while (n_entries < snapshot->capacity) {
+        char *key = snapshot->keys + n_entries * key_size;
+        if (bpf_map_get_next_key(ctx->counter.fd, prev_key, key) != 0) {
+            break;
+        }
+
+        if (bpf_map_lookup_elem(ctx->counter.fd, key, snapshot->raw_values + n_values * value_size) != 0) {
+            int ret = errno;
+            if (ret == ENOENT) {
+                /* Entry removed in the meantime, get next key with the same predecessor */
+                continue;
+            }
+            fprintf(stderr, "failed to read Counter entry: %s\n", strerror(ret));
+            return ret;
+        }
+
+        prev_key = key;
+        n_entries++;
+        n_values++;
+        if (n_values == snapshot->chunk_size) {
+            decode_snapshot_values(ctx, snapshot, n_entries - n_values, n_values);
+            n_values = 0;
+        }
+    }
+    decode_snapshot_values(ctx, snapshot, n_entries - n_values, n_values);
+
+    snapshot->n_entries = n_entries;
+
+    return NO_ERROR;
+}
+
+static int compare_snapshot_indexes(const void *first, const void *second)
+{
+    size_t a = *((const size_t *) first);
+    size_t b = *((const size_t *) second);
+
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static int compare_snapshot_keys(const void *first, const void *second, void *arg)
+{
+    const nikss_counter_snapshot_t *snapshot = arg;
+    size_t a = *((const size_t *) first);
+    size_t b = *((const size_t *) second);
+
+    return memcmp(snapshot->keys + a * snapshot->key_size, snapshot->keys + b * snapshot->key_size,
+                  snapshot->key_size);
+}
+
+/* Entries are matched by key, so order of keys in the map does not matter. Arrays are read in order
+ * of keys already, then sorting is skipped. */
+static void sort_snapshot_entries(nikss_counter_snapshot_t *snapshot)
+{
+    bool sorted = true;
+    for (size_t i = 0; i < snapshot->n_entries; i++) {
+        snapshot->order[i] = i;
+        if (sorted && i > 0 && compare_snapshot_keys(&snapshot->order[i - 1], &snapshot->order[i], snapshot) > 0) {
+            sorted = false;
+        }
+    }
+
+    if (!sorted) {
+        qsort_r(snapshot->order, snapshot->n_entries, sizeof(size_t), compare_snapshot_keys, snapshot);
+    }
+}
+
+/* Merges sorted entries of the previous and the current update */
+static void find_changed_snapshot_entries(nikss_counter_snapshot_t *snapshot)
+{
+    size_t key_size = snapshot->key_size;
+    size_t prev = 0;
+    size_t cur = 0;
+
+    snapshot->n_changed = 0;
+    snapshot->n_removed = 0;
+    while (cur < snapshot->n_entries || prev < snapshot->n_prev_entries) {
+        int cmp = 0;
+        if (cur >= snapshot->n_entries) {
+            cmp = 1;
+        } else if (prev >= snapshot->n_prev_entries) {
+            cmp = -1;
+        } else {
+            cmp = memcmp(snapshot->keys + snapshot->order[cur] * key_size,
+                         snapshot->prev_keys + snapshot->prev_order[prev] * key_size, key_size);
+        }
+
+        if (cmp > 0) {
+            snapshot->removed[snapshot->n_removed++] = snapshot->prev_order[prev++];
+            continue;
+        }
+
+        size_t index = snapshot->order[cur++];
+        if (cmp < 0) {
+            snapshot->changed[snapshot->n_changed++] = index;
+            continue;
+        }
+
+        size_t prev_index = snapshot->prev_order[prev++];
+        if (snapshot->bytes[index] != snapshot->prev_bytes[prev_index] ||
+            snapshot->packets[index] != snapshot->prev_packets[prev_index]) {
+            snapshot->changed[snapshot->n_changed++] = index;
+        }
+    }
+
+    /* Changed entries are reported in the order they are read from the map */
+    qsort(snapshot->changed, snapshot->n_changed, sizeof(size_t), compare_snapshot_indexes);
+}
+
+#define SWAP_SNAPSHOT_BUFFERS(type, a, b) ({ type _tmp = (a); (a) = (b); (b) = _tmp; })
+
+int nikss_counter_snapshot_update(nikss_counter_context_t *ctx, nikss_counter_snapshot_t *snapshot)
+{
+    if (ctx == NULL || snapshot == NULL) {
+        return EINVAL;
+    }
+
+    bool first_update = snapshot->keys == NULL || snapshot->capacity != ctx->counter.max_entries;
+    int ret = allocate_snapshot_buffers(ctx, snapshot);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+    snapshot->key_size = ctx->counter.key_size;
+
+    /* Current state becomes the previous one; swap buffers to avoid copying */
+    SWAP_SNAPSHOT_BUFFERS(char *, snapshot->keys, snapshot->prev_keys);
+    SWAP_SNAPSHOT_BUFFERS(nikss_counter_value_t *, snapshot->bytes, snapshot->prev_bytes);
+    SWAP_SNAPSHOT_BUFFERS(nikss_counter_value_t *, snapshot->packets, snapshot->prev_packets);
+    SWAP_SNAPSHOT_BUFFERS(size_t *, snapshot->order, snapshot->prev_order);
+    snapshot->n_prev_entries = first_update ? 0 : snapshot->n_entries;
+
+    ret = read_snapshot_batch(ctx, snapshot);
+    if (ret == ENOTSUP) {
+        ret = read_snapshot_iterative(ctx, snapshot);
+    }
+    if (ret != NO_ERROR) {
+        snapshot->n_entries = 0;
+        snapshot->n_changed = 0;
+        snapshot->n_removed = 0;
+        return ret;
+    }
+
+    sort_snapshot_entries(snapshot);
+    find_changed_snapshot_entries(snapshot);
+
+    return NO_ERROR;
+}
+
+size_t nikss_counter_snapshot_get_size(nikss_counter_snapshot_t *snapshot)
+{
+    if (snapshot == NULL) {
+        return 0;
+    }
+    return snapshot->n_entries;
+}
+
+size_t nikss_counter_snapshot_get_n_changed(nikss_counter_snapshot_t *snapshot)
+{
+    if (snapshot == NULL) {
+        return 0;
+    }
+    return snapshot->n_changed;
+}
+
+size_t nikss_counter_snapshot_get_changed(nikss_counter_snapshot_t *snapshot, size_t i)
+{
+    if (snapshot == NULL || i >= snapshot->n_changed) {
+        return 0;
+    }
+    return snapshot->changed[i];
+}
+
+size_t nikss_counter_snapshot_get_n_removed(nikss_counter_snapshot_t *snapshot)
+{
+    if (snapshot == NULL) {
+        return 0;
+    }
+    return snapshot->n_removed;
+}
+
+int nikss_counter_snapshot_get_removed(nikss_counter_context_t *ctx, nikss_counter_snapshot_t *snapshot,
+                                       size_t i, nikss_counter_entry_t *entry)
+{
+    if (ctx == NULL || snapshot == NULL || entry == NULL) {
+        return EINVAL;
+    }
+
+    if (i >= snapshot->n_removed) {
+        return ERANGE;
+    }
+
+    if (allocate_key_buffer(ctx, entry) == NULL) {
+        return ENOMEM;
+    }
+
+    size_t index = snapshot->removed[i];
+    memcpy(entry->raw_key, snapshot->prev_keys + index * ctx->counter.key_size, ctx->counter.key_size);
+    fix_struct_data_byte_order(&ctx->key_fds, entry->raw_key, ctx->counter.key_size);
+    entry->current_key_id = 0;
+    entry->bytes = snapshot->prev_bytes[index];
+    entry->packets = snapshot->prev_packets[index];
+
+    return NO_ERROR;
+}
+
+int nikss_counter_snapshot_get_entry(nikss_counter_context_t *ctx, nikss_counter_snapshot_t *snapshot,
+                                     size_t index, nikss_counter_entry_t *entry)
+{
+    if (ctx == NULL || snapshot == NULL || entry == NULL) {
+        return EINVAL;
+    }
+
+    if (index >= snapshot->n_entries) {
+        return ERANGE;
+    }
+
+    if (allocate_key_buffer(ctx, entry) == NULL) {
+        return ENOMEM;
+    }
+
+    /* Byte order of the key is fixed only for exported entries */
+    memcpy(entry->raw_key, snapshot->keys + index * ctx->counter.key_size, ctx->counter.key_size);
+    fix_struct_data_byte_order(&ctx->key_fds, entry->raw_key, ctx->counter.key_size);
+    entry->current_key_id = 0;
+    entry->bytes = snapshot->bytes[index];
+    entry->packets = snapshot->packets[index];
+
+    return NO_ERROR;
+}
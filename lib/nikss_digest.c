@@ -16,9 +16,12 @@
  */
 
 #include <bpf/bpf.h>
+#include <bpf/libbpf.h>
 #include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <nikss/nikss.h>
 #include <nikss/nikss_digest.h>
@@ -26,6 +29,12 @@
 #include "btf.h"
 #include "common.h"
 
+/* Queue maps cannot be waited on, so they are checked periodically */
+#define DIGEST_QUEUE_POLL_INTERVAL_MS 10
+
+/* Returned from ring buffer callback to stop processing, record is consumed anyway */
+#define DIGEST_RINGBUF_STOP (-ECANCELED)
+
 void nikss_digest_ctx_init(nikss_digest_context_t *ctx)
 {
     if (ctx == NULL) {
@@ -34,6 +43,7 @@ void nikss_digest_ctx_init(nikss_digest_context_t *ctx)
     memset(ctx, 0, sizeof(nikss_digest_context_t));
 
     ctx->queue.fd = -1;
+    ctx->ringbuf_map.fd = -1;
     init_btf(&ctx->btf_metadata);
 }
 
@@ -43,8 +53,25 @@ void nikss_digest_ctx_free(nikss_digest_context_t *ctx)
         return;
     }
 
+    if (ctx->ringbuf != NULL) {
+        ring_buffer__free(ctx->ringbuf);
+    }
+    ctx->ringbuf = NULL;
+
+    if (ctx->scratch != NULL) {
+        free(ctx->scratch);
+    }
+    ctx->scratch = NULL;
+
+    if (ctx->pool != NULL) {
+        free(ctx->pool);
+    }
+    ctx->pool = NULL;
+    ctx->pool_capacity = 0;
+
     free_btf(&ctx->btf_metadata);
     close_object_fd(&(ctx->queue.fd));
+    close_object_fd(&(ctx->ringbuf_map.fd));
     free_struct_field_descriptor_set(&ctx->fds);
 }
 
@@ -53,6 +80,84 @@ static int parse_digest_btf(nikss_digest_context_t *ctx)
     return parse_struct_type(&ctx->btf_metadata, ctx->queue.value_type_id, ctx->queue.value_size, &ctx->fds);
 }
 
+static bool digest_needs_byte_order_fix(nikss_digest_context_t *ctx)
+{
+    if (!ctx->fds.decoded_with_btf) {
+        return false;
+    }
+
+    for (size_t i = 0; i < ctx->fds.n_fields; i++) {
+        if (ctx->fds.fields[i].type == NIKSS_STRUCT_FIELD_TYPE_DATA && ctx->fds.fields[i].data_len > 8) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int ringbuf_sample_cb(void *cb_ctx, void *data, size_t size)
+{
+    nikss_digest_context_t *ctx = cb_ctx;
+
+    if (size < ctx->queue.value_size) {
+        fprintf(stderr, "dropping too short digest message\n");
+        return 0;
+    }
+
+    /* Messages are copied out by nikss_digest_get_next() and nikss_digest_get_batch() */
+    if (ctx->copy_target != NULL) {
+        memcpy(ctx->copy_target + ctx->copy_count * ctx->queue.value_size, data, ctx->queue.value_size);
+        ctx->copy_count++;
+        return ctx->copy_count >= ctx->copy_max ? DIGEST_RINGBUF_STOP : 0;
+    }
+
+    nikss_digest_t digest;
+    memset(&digest, 0, sizeof(nikss_digest_t));
+    if (ctx->zero_copy) {
+        digest.raw_data = data;
+    } else {
+        memcpy(ctx->scratch, data, ctx->queue.value_size);
+        fix_struct_data_byte_order(&ctx->fds, ctx->scratch, ctx->queue.value_size);
+        digest.raw_data = ctx->scratch;
+    }
+
+    int ret = ctx->callback(ctx, &digest, ctx->callback_ctx);
+    if (ret != 0) {
+        ctx->callback_ret = ret;
+        return DIGEST_RINGBUF_STOP;
+    }
+
+    return 0;
+}
+
+static int open_digest_ringbuf(nikss_context_t *nikss_ctx, nikss_digest_context_t *ctx, const char *name)
+{
+    char ringbuf_name[256];
+    snprintf(ringbuf_name, sizeof(ringbuf_name), "%s_ringbuf", name);
+
+    if (open_bpf_map(nikss_ctx, ringbuf_name, NULL, &ctx->ringbuf_map) != NO_ERROR) {
+        /* Ring buffer is optional, use the queue */
+        close_object_fd(&ctx->ringbuf_map.fd);
+        return NO_ERROR;
+    }
+
+    if (ctx->ringbuf_map.type != BPF_MAP_TYPE_RINGBUF) {
+        fprintf(stderr, "warning: %s: not a ring buffer, using queue\n", ringbuf_name);
+        close_object_fd(&ctx->ringbuf_map.fd);
+        return NO_ERROR;
+    }
+
+    ctx->ringbuf = ring_buffer__new(ctx->ringbuf_map.fd, ringbuf_sample_cb, ctx, NULL);
+    if (ctx->ringbuf == NULL) {
+        int ret = errno;
+        fprintf(stderr, "%s: failed to open ring buffer: %s\n", ringbuf_name, strerror(ret));
+        close_object_fd(&ctx->ringbuf_map.fd);
+        return ret;
+    }
+
+    return NO_ERROR;
+}
+
 int nikss_digest_ctx_name(nikss_context_t *nikss_ctx, nikss_digest_context_t *ctx, const char *name)
 {
     if (nikss_ctx == NULL || ctx == NULL || name == NULL) {
@@ -81,6 +186,48 @@ int nikss_digest_ctx_name(nikss_context_t *nikss_ctx, nikss_digest_context_t *ct
         return ret;
     }
 
+    ctx->scratch = malloc(ctx->queue.value_size);
+    if (ctx->scratch == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return ENOMEM;
+    }
+    ctx->zero_copy = !digest_needs_byte_order_fix(ctx);
+
+    return open_digest_ringbuf(nikss_ctx, ctx, name);
+}
+
+/* Copies up to max_messages from the ring buffer into buffer, byte order is not fixed */
+static int copy_digests_from_ringbuf(nikss_digest_context_t *ctx, char *buffer, size_t max_messages, size_t *n_messages)
+{
+    ctx->copy_target = buffer;
+    ctx->copy_max = max_messages;
+    ctx->copy_count = 0;
+    int ret = ring_buffer__consume(ctx->ringbuf);
+    *n_messages = ctx->copy_count;
+    ctx->copy_target = NULL;
+
+    if (ret >= 0 || ret == DIGEST_RINGBUF_STOP) {
+        return NO_ERROR;
+    }
+
+    ret = -ret;
+    fprintf(stderr, "failed to read from ring buffer: %s\n", strerror(ret));
+    return ret;
+}
+
+static int get_next_digest_from_ringbuf(nikss_digest_context_t *ctx, nikss_digest_t *digest)
+{
+    size_t n_messages = 0;
+    int ret = copy_digests_from_ringbuf(ctx, digest->raw_data, 1, &n_messages);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+    if (n_messages == 0) {
+        return ENOENT;
+    }
+
+    fix_struct_data_byte_order(&ctx->fds, digest->raw_data, ctx->queue.value_size);
+
     return NO_ERROR;
 }
 
@@ -102,6 +249,14 @@ int nikss_digest_get_next(nikss_digest_context_t *ctx, nikss_digest_t *digest)
         return ENOMEM;
     }
 
+    if (ctx->ringbuf != NULL) {
+        int ret = get_next_digest_from_ringbuf(ctx, digest);
+        if (ret != NO_ERROR) {
+            nikss_digest_free(digest);
+        }
+        return ret;
+    }
+
     int ret = bpf_map_lookup_and_delete_elem(ctx->queue.fd, NULL, digest->raw_data);
     if (ret != 0) {
         ret = errno;
@@ -123,7 +278,7 @@ void nikss_digest_free(nikss_digest_t *digest)
         return;
     }
 
-    if (digest->raw_data != NULL) {
+    if (digest->raw_data != NULL && !digest->pooled) {
         free(digest->raw_data);
     }
 
@@ -152,3 +307,217 @@ nikss_struct_field_t * nikss_digest_get_next_field(nikss_digest_context_t *ctx,
 
     return &digest->current;
 }
+
+static int allocate_digest_pool(nikss_digest_context_t *ctx, size_t n_messages)
+{
+    if (ctx->pool != NULL && ctx->pool_capacity >= n_messages) {
+        return NO_ERROR;
+    }
+
+    char *pool = realloc(ctx->pool, n_messages * ctx->queue.value_size);
+    if (pool == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return ENOMEM;
+    }
+    ctx->pool = pool;
+    ctx->pool_capacity = n_messages;
+
+    return NO_ERROR;
+}
+
+/* Same as fix_struct_data_byte_order() for every message, but fields are looked up once per batch */
+static void fix_digest_batch_byte_order(nikss_digest_context_t *ctx, char *messages, size_t n_messages)
+{
+    if (!digest_needs_byte_order_fix(ctx)) {
+        return;
+    }
+
+    size_t value_size = ctx->queue.value_size;
+    for (size_t i = 0; i < ctx->fds.n_fields; i++) {
+        nikss_struct_field_descriptor_t *fd = &ctx->fds.fields[i];
+        if (fd->type != NIKSS_STRUCT_FIELD_TYPE_DATA || fd->data_len <= 8 ||
+            fd->data_offset + fd->data_len > value_size) {
+            continue;
+        }
+        for (size_t msg = 0; msg < n_messages; msg++) {
+            swap_byte_order(messages + msg * value_size + fd->data_offset, fd->data_len);
+        }
+    }
+}
+
+static int pop_digests_from_queue(nikss_digest_context_t *ctx, char *buffer, size_t max_messages, size_t *n_messages)
+{
+    *n_messages = 0;
+    while (*n_messages < max_messages) {
+        if (bpf_map_lookup_and_delete_elem(ctx->queue.fd, NULL, buffer + *n_messages * ctx->queue.value_size) != 0) {
+            int ret = errno;
+            if (ret == ENOENT) {
+                break;
+            }
+            fprintf(stderr, "failed to pop element from queue: %s\n", strerror(ret));
+            return ret;
+        }
+        (*n_messages)++;
+    }
+
+    return NO_ERROR;
+}
+
+int nikss_digest_get_batch(nikss_digest_context_t *ctx, nikss_digest_t *digests, size_t max_digests, size_t *n_digests)
+{
+    if (ctx == NULL || digests == NULL || n_digests == NULL) {
+        return EINVAL;
+    }
+
+    *n_digests = 0;
+    if (ctx->queue.fd < 0) {
+        return EBADF;
+    }
+    if (max_digests == 0) {
+        return NO_ERROR;
+    }
+
+    int ret = allocate_digest_pool(ctx, max_digests);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+
+    size_t n_read = 0;
+    if (ctx->ringbuf != NULL) {
+        ret = copy_digests_from_ringbuf(ctx, ctx->pool, max_digests, &n_read);
+    } else {
+        ret = pop_digests_from_queue(ctx, ctx->pool, max_digests, &n_read);
+    }
+
+    /* Messages read before an error are still returned */
+    fix_digest_batch_byte_order(ctx, ctx->pool, n_read);
+    for (size_t i = 0; i < n_read; i++) {
+        memset(&digests[i], 0, sizeof(nikss_digest_t));
+        digests[i].raw_data = ctx->pool + i * ctx->queue.value_size;
+        digests[i].pooled = true;
+    }
+    *n_digests = n_read;
+
+    if (ret == NO_ERROR && n_read == 0) {
+        return ENOENT;
+    }
+
+    return ret;
+}
+
+static int poll_digest_ringbuf(nikss_digest_context_t *ctx, int timeout_ms)
+{
+    int ret = ring_buffer__poll(ctx->ringbuf, timeout_ms);
+    if (ret == DIGEST_RINGBUF_STOP) {
+        return ctx->callback_ret;
+    }
+    if (ret == 0) {
+        return ETIMEDOUT;
+    }
+    if (ret < 0) {
+        ret = -ret;
+        if (ret != EINTR) {
+            fprintf(stderr, "failed to wait for digests: %s\n", strerror(ret));
+        }
+        return ret;
+    }
+
+    return NO_ERROR;
+}
+
+static long elapsed_ms_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000L + (now.tv_nsec - start->tv_nsec) / 1000000L;
+}
+
+static int poll_digest_queue(nikss_digest_context_t *ctx, int timeout_ms)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while (true) {
+        size_t n_received = 0;
+
+        while (bpf_map_lookup_and_delete_elem(ctx->queue.fd, NULL, ctx->scratch) == 0) {
+            nikss_digest_t digest;
+            memset(&digest, 0, sizeof(nikss_digest_t));
+            fix_struct_data_byte_order(&ctx->fds, ctx->scratch, ctx->queue.value_size);
+            digest.raw_data = ctx->scratch;
+            n_received++;
+
+            int ret = ctx->callback(ctx, &digest, ctx->callback_ctx);
+            if (ret != 0) {
+                return ret;
+            }
+        }
+
+        int ret = errno;
+        if (ret != ENOENT) {
+            fprintf(stderr, "failed to pop element from queue: %s\n", strerror(ret));
+            return ret;
+        }
+
+        if (n_received > 0) {
+            return NO_ERROR;
+        }
+
+        long wait_ms = DIGEST_QUEUE_POLL_INTERVAL_MS;
+        if (timeout_ms >= 0) {
+            long remaining_ms = timeout_ms - elapsed_ms_since(&start);
+            if (remaining_ms <= 0) {
+                return ETIMEDOUT;
+            }
+            if (remaining_ms < wait_ms) {
+                wait_ms = remaining_ms;
+            }
+        }
+
+        struct timespec delay = {
+            .tv_sec = wait_ms / 1000,
+            .tv_nsec = (wait_ms % 1000) * 1000000L,
+        };
+        nanosleep(&delay, NULL);
+    }
+}
+
+int nikss_digest_poll(nikss_digest_context_t *ctx, int timeout_ms, nikss_digest_callback_t callback, void *user_ctx)
+{
+    if (ctx == NULL || callback == NULL) {
+        return EINVAL;
+    }
+
+    if (ctx->queue.fd < 0 || ctx->scratch == NULL) {
+        return EBADF;
+    }
+
+    ctx->callback = callback;
+    ctx->callback_ctx = user_ctx;
+    ctx->callback_ret = NO_ERROR;
+
+    if (ctx->ringbuf != NULL) {
+        return poll_digest_ringbuf(ctx, timeout_ms);
+    }
+
+    return poll_digest_queue(ctx, timeout_ms);
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_digest_get_fd(nikss_digest_context_t *ctx)
+{
+    if (ctx == NULL || ctx->ringbuf == NULL) {
+        return -1;
+    }
+
+    return ring_buffer__epoll_fd(ctx->ringbuf);
+}
+
+bool nikss_digest_has_ringbuf(nikss_digest_context_t *ctx)
+{
+    if (ctx == NULL) {
+        return false;
+    }
+
+    return ctx->ringbuf != NULL;
+}
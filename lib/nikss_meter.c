@@ -18,14 +18,16 @@
 #include <bpf/bpf.h>
 #include <bpf/btf.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <linux/bpf.h>
-#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <nikss/nikss.h>
 
+#include "bpf_defs.h"
 #include "btf.h"
 #include "common.h"
 #include "nikss_meter.h"
@@ -52,7 +54,9 @@ static void convert_rate(const nikss_meter_value_t *rate, nikss_meter_value_t *p
     if (*period >= METER_PERIOD_MIN) {
         *unit_per_period = 1;
     } else {
-        *unit_per_period = (uint64_t) ceil(METER_PERIOD_MIN / ((double) (*period)));
+        /* Integer ceil(), period shorter than 1 ns is treated as 1 ns */
+        nikss_meter_value_t divisor = *period > 0 ? *period : 1;
+        *unit_per_period = (METER_PERIOD_MIN + divisor - 1) / divisor;
         *period = (NS_IN_S * (*unit_per_period)) / *rate;
     }
 }
@@ -214,6 +218,8 @@ void nikss_meter_ctx_init(nikss_meter_ctx_t *ctx)
 
     nikss_meter_entry_init(&ctx->current_entry);
     ctx->meter.fd = -1;
+    ctx->profiles.fd = -1;
+    ctx->instance_profiles.fd = -1;
     init_btf(&ctx->btf_metadata);
 }
 
@@ -232,6 +238,13 @@ void nikss_meter_ctx_free(nikss_meter_ctx_t *ctx)
         free(ctx->previous_index);
     }
     ctx->previous_index = NULL;
+
+    close_object_fd(&ctx->profiles.fd);
+    close_object_fd(&ctx->instance_profiles.fd);
+    if (ctx->name != NULL) {
+        free(ctx->name);
+    }
+    ctx->name = NULL;
 }
 
 int nikss_meter_ctx_name(nikss_meter_ctx_t *ctx, nikss_context_t *nikss_ctx, const char *name)
@@ -265,9 +278,358 @@ int nikss_meter_ctx_name(nikss_meter_ctx_t *ctx, nikss_context_t *nikss_ctx, con
         return ret;
     }
 
+    /* Profile maps are opened when needed, because they may be created later by another process */
+    ctx->pipeline_id = nikss_ctx->pipeline_id;
+    ctx->name = strdup(name);
+    if (ctx->name == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return ENOMEM;
+    }
+
     return NO_ERROR;
 }
 
+static int duplicate_meter_map_fd(nikss_bpf_map_descriptor_t *dst, const nikss_bpf_map_descriptor_t *src)
+{
+    *dst = *src;
+    if (src->fd < 0) {
+        return NO_ERROR;
+    }
+
+    dst->fd = fcntl(src->fd, F_DUPFD_CLOEXEC, 0);
+    if (dst->fd < 0) {
+        return errno;
+    }
+
+    return NO_ERROR;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_meter_ctx_clone(nikss_meter_ctx_t *dst, const nikss_meter_ctx_t *src)
+{
+    if (dst == NULL || src == NULL || dst == src) {
+        return EINVAL;
+    }
+
+    nikss_meter_ctx_init(dst);
+    dst->pipeline_id = src->pipeline_id;
+
+    int ret = share_btf(&dst->btf_metadata, &src->btf_metadata);
+    if (ret == NO_ERROR) {
+        ret = duplicate_meter_map_fd(&dst->meter, &src->meter);
+    }
+    if (ret == NO_ERROR) {
+        ret = duplicate_meter_map_fd(&dst->profiles, &src->profiles);
+    }
+    if (ret == NO_ERROR) {
+        ret = duplicate_meter_map_fd(&dst->instance_profiles, &src->instance_profiles);
+    }
+    if (ret == NO_ERROR) {
+        ret = copy_struct_field_descriptor_set(&dst->index_fds, &src->index_fds);
+    }
+    if (ret == NO_ERROR && src->name != NULL) {
+        dst->name = strdup(src->name);
+        if (dst->name == NULL) {
+            ret = ENOMEM;
+        }
+    }
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to clone meter context: %s\n", strerror(ret));
+        nikss_meter_ctx_free(dst);
+    }
+
+    return ret;
+}
+
+/* Opens maps with profiles of the meter. They are created only when create is set,
+ * so ENOENT means that no profile of the meter has been defined yet. */
+static int open_meter_profile_maps(nikss_meter_ctx_t *ctx, bool create)
+{
+    if (ctx->profiles.fd >= 0 && ctx->instance_profiles.fd >= 0) {
+        return NO_ERROR;
+    }
+    if (ctx->name == NULL) {
+        return ENOENT;
+    }
+
+    struct {
+        nikss_bpf_map_descriptor_t *md;
+        const char *suffix;
+        struct bpf_create_map_attr attr;
+    } maps[] = {
+        {
+            .md = &ctx->profiles,
+            .suffix = METER_PROFILES_SUFFIX,
+            .attr = {
+                .name = METER_PROFILES_SUFFIX + 1,
+                .map_type = BPF_MAP_TYPE_HASH,
+                .key_size = sizeof(nikss_meter_profile_id_t),
+                .value_size = sizeof(struct nikss_meter_profile),
+                .max_entries = METER_MAX_PROFILES,
+            },
+        },
+        {
+            .md = &ctx->instance_profiles,
+            .suffix = METER_INSTANCE_PROFILES_SUFFIX,
+            .attr = {
+                .name = METER_INSTANCE_PROFILES_SUFFIX + 1,
+                .map_type = BPF_MAP_TYPE_HASH,
+                .map_flags = BPF_F_NO_PREALLOC,
+                .key_size = ctx->meter.key_size,
+                .value_size = sizeof(nikss_meter_profile_id_t),
+                .max_entries = ctx->meter.max_entries,
+            },
+        },
+    };
+
+    nikss_context_t nikss_ctx;
+    nikss_context_init(&nikss_ctx);
+    nikss_context_set_pipeline(&nikss_ctx, ctx->pipeline_id);
+
+    int return_code = NO_ERROR;
+    for (size_t i = 0; i < sizeof(maps) / sizeof(maps[0]) && return_code == NO_ERROR; i++) {
+        char name[256];
+        char pinned_file[256];
+        nikss_bpf_map_descriptor_t *md = maps[i].md;
+        if (md->fd >= 0) {
+            continue;
+        }
+
+        snprintf(name, sizeof(name), "%s%s", ctx->name, maps[i].suffix);
+        build_ebpf_prog_filename(pinned_file, sizeof(pinned_file), &nikss_ctx, name);
+        md->fd = bpf_obj_get(pinned_file);
+        if (md->fd < 0 && create) {
+            md->fd = bpf_create_map_xattr(&maps[i].attr);
+            if (md->fd >= 0 && bpf_obj_pin(md->fd, pinned_file) != 0) {
+                /* Map might have been created in the meantime by another process */
+                close_object_fd(&md->fd);
+                md->fd = bpf_obj_get(pinned_file);
+            }
+        }
+        if (md->fd < 0) {
+            return_code = errno;
+            if (create) {
+                fprintf(stderr, "failed to open meter profiles: %s\n", strerror(return_code));
+            }
+            break;
+        }
+        return_code = update_map_info(md);
+    }
+
+    nikss_context_free(&nikss_ctx);
+    if (return_code != NO_ERROR) {
+        close_object_fd(&ctx->profiles.fd);
+        close_object_fd(&ctx->instance_profiles.fd);
+    }
+
+    return return_code;
+}
+
+static int read_meter_profile(nikss_meter_ctx_t *ctx, nikss_meter_profile_id_t profile_id,
+                              struct nikss_meter_profile *profile)
+{
+    if (open_meter_profile_maps(ctx, false) != NO_ERROR ||
+        bpf_map_lookup_elem(ctx->profiles.fd, &profile_id, profile) != 0) {
+        fprintf(stderr, "meter profile %u does not exist\n", profile_id);
+        return ENOENT;
+    }
+    return NO_ERROR;
+}
+
+static int convert_meter_profile_to_data(const struct nikss_meter_profile *profile, nikss_meter_data_t *data)
+{
+    nikss_meter_entry_t config;
+    nikss_meter_entry_init(&config);
+    nikss_meter_entry_data(&config, profile->pir, profile->pbs, profile->cir, profile->cbs);
+    return convert_meter_entry_to_data(&config, data);
+}
+
+static nikss_meter_profile_id_t get_instance_profile(nikss_meter_ctx_t *ctx, const char *raw_index)
+{
+    nikss_meter_profile_id_t profile_id = 0;
+    if (open_meter_profile_maps(ctx, false) != NO_ERROR ||
+        bpf_map_lookup_elem(ctx->instance_profiles.fd, raw_index, &profile_id) != 0) {
+        return 0;
+    }
+    return profile_id;
+}
+
+/* Records that instances use the given profile, profile ID 0 detaches them from their profiles */
+static int set_instance_profiles(nikss_meter_ctx_t *ctx, char *keys, uint32_t count,
+                                 nikss_meter_profile_id_t profile_id)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = 0,
+                        .flags = 0,
+    );
+
+    if (open_meter_profile_maps(ctx, false) != NO_ERROR) {
+        /* Without profiles there is nothing to detach from */
+        return profile_id == 0 ? NO_ERROR : ENOENT;
+    }
+
+    int fd = ctx->instance_profiles.fd;
+    size_t key_size = ctx->instance_profiles.key_size;
+    uint32_t processed = count;
+    if (profile_id == 0) {
+        if (bpf_map_delete_batch(fd, keys, &processed, &opts) == 0) {
+            return NO_ERROR;
+        }
+        /* Batch delete stops on instance without profile, continue one by one */
+        if (processed >= count) {
+            processed = 0;
+        }
+        for (uint32_t i = processed; i < count; i++) {
+            if (bpf_map_delete_elem(fd, keys + (size_t) i * key_size) != 0 && errno != ENOENT) {
+                int return_code = errno;
+                fprintf(stderr, "failed to detach meter profile: %s\n", strerror(return_code));
+                return return_code;
+            }
+        }
+        return NO_ERROR;
+    }
+
+    nikss_meter_profile_id_t *values = malloc(count * sizeof(nikss_meter_profile_id_t));
+    if (values == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return ENOMEM;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        values[i] = profile_id;
+    }
+
+    int return_code = NO_ERROR;
+    if (bpf_map_update_batch(fd, keys, values, &processed, &opts) != 0) {
+        if (processed >= count) {
+            processed = 0;
+        }
+        for (uint32_t i = processed; i < count; i++) {
+            if (bpf_map_update_elem(fd, keys + (size_t) i * key_size, &profile_id, BPF_ANY) != 0) {
+                return_code = errno;
+                fprintf(stderr, "failed to assign meter profile: %s\n", strerror(return_code));
+                break;
+            }
+        }
+    }
+
+    free(values);
+    return return_code;
+}
+
+static int append_profile_instance(char **instances, size_t *n_instances, size_t *capacity,
+                                   const char *key, size_t key_size)
+{
+    if (*n_instances == *capacity) {
+        size_t new_capacity = *capacity == 0 ? 64 : 2 * (*capacity);
+        char *new_instances = realloc(*instances, new_capacity * key_size);
+        if (new_instances == NULL) {
+            fprintf(stderr, "not enough memory\n");
+            return ENOMEM;
+        }
+        *instances = new_instances;
+        *capacity = new_capacity;
+    }
+
+    memcpy(*instances + (*n_instances) * key_size, key, key_size);
+    *n_instances += 1;
+    return NO_ERROR;
+}
+
+/* Collects raw indexes of instances using the profile, falls back to
+ * iteration with get_next_key on kernels without batch lookup. */
+static int find_profile_instances(nikss_meter_ctx_t *ctx, nikss_meter_profile_id_t profile_id,
+                                  char **instances, size_t *n_instances)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = 0,
+                        .flags = 0,
+    );
+
+    *instances = NULL;
+    *n_instances = 0;
+    if (open_meter_profile_maps(ctx, false) != NO_ERROR) {
+        return NO_ERROR;
+    }
+
+    int return_code = NO_ERROR;
+    int fd = ctx->instance_profiles.fd;
+    size_t key_size = ctx->instance_profiles.key_size;
+    size_t capacity = 0;
+    /* Batch token of hash map has size of the key, but it is at least 4 bytes long */
+    size_t token_size = key_size > sizeof(uint32_t) ? key_size : sizeof(uint32_t);
+    char *keys = malloc(METER_BATCH_SIZE * key_size);
+    nikss_meter_profile_id_t *ids = malloc(METER_BATCH_SIZE * sizeof(nikss_meter_profile_id_t));
+    char *token = malloc(token_size);
+    char *next_key = malloc(key_size);
+    if (keys == NULL || ids == NULL || token == NULL || next_key == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return_code = ENOMEM;
+        goto clean_up;
+    }
+
+    bool started = false;
+    bool use_batch = true;
+    while (use_batch) {
+        uint32_t count = METER_BATCH_SIZE;
+        bool last = false;
+        if (bpf_map_lookup_batch(fd, started ? token : NULL, token, keys, ids, &count, &opts) != 0) {
+            if (errno != ENOENT) {
+                if (!started) {
+                    use_batch = false;
+                    break;
+                }
+                return_code = errno;
+                fprintf(stderr, "failed to read meter profiles: %s\n", strerror(return_code));
+                goto clean_up;
+            }
+            last = true;
+        }
+        started = true;
+
+        for (uint32_t i = 0; i < count; i++) {
+            if (ids[i] != profile_id) {
+                continue;
+            }
+            return_code = append_profile_instance(instances, n_instances, &capacity, keys + (size_t) i * key_size,
+                                                  key_size);
+            if (return_code != NO_ERROR) {
+                goto clean_up;
+            }
+        }
+        if (last) {
+            break;
+        }
+    }
+
+    if (!use_batch) {
+        char *prev_key = NULL;
+        while (bpf_map_get_next_key(fd, prev_key, next_key) == 0) {
+            nikss_meter_profile_id_t id = 0;
+            if (bpf_map_lookup_elem(fd, next_key, &id) == 0 && id == profile_id) {
+                return_code = append_profile_instance(instances, n_instances, &capacity, next_key, key_size);
+                if (return_code != NO_ERROR) {
+                    goto clean_up;
+                }
+            }
+            memcpy(keys, next_key, key_size);
+            prev_key = keys;
+        }
+    }
+
+clean_up:
+    free(keys);
+    free(ids);
+    free(token);
+    free(next_key);
+    if (return_code != NO_ERROR) {
+        free(*instances);
+        *instances = NULL;
+        *n_instances = 0;
+    }
+
+    return return_code;
+}
+
 int nikss_meter_entry_get(nikss_meter_ctx_t *ctx, nikss_meter_entry_t *entry)
 {
     int return_code = NO_ERROR;
@@ -306,6 +668,8 @@ int nikss_meter_entry_get(nikss_meter_ctx_t *ctx, nikss_meter_entry_t *entry)
         goto clean_up;
     }
 
+    entry->profile_id = get_instance_profile(ctx, entry->raw_index);
+
     /* Later raw_index is used instead of user provided data, so fix its byte order */
     fix_struct_data_byte_order(&ctx->index_fds, entry->raw_index, ctx->meter.key_size);
 
@@ -335,6 +699,11 @@ nikss_meter_entry_t *nikss_meter_get_next(nikss_meter_ctx_t *ctx)
         goto clean_up;
     }
 
+    if (ctx->previous_index == NULL) {
+        /* Iteration starts, profiles might have been defined since the previous one */
+        open_meter_profile_maps(ctx, false);
+    }
+
     if (bpf_map_get_next_key(ctx->meter.fd, ctx->previous_index, next_key) != 0) {
         /* restart iteration */
         if (ctx->previous_index != NULL) {
@@ -367,6 +736,11 @@ nikss_meter_entry_t *nikss_meter_get_next(nikss_meter_ctx_t *ctx)
         goto clean_up;
     }
 
+    ctx->current_entry.profile_id = 0;
+    if (ctx->instance_profiles.fd >= 0) {
+        bpf_map_lookup_elem(ctx->instance_profiles.fd, ctx->current_entry.raw_index, &ctx->current_entry.profile_id);
+    }
+
     fix_struct_data_byte_order(&ctx->index_fds, ctx->current_entry.raw_index, ctx->meter.key_size);
 
     nikss_meter_data_t data;
@@ -405,7 +779,15 @@ int nikss_meter_entry_update(nikss_meter_ctx_t *ctx, nikss_meter_entry_t *entry)
         return EINVAL;
     }
 
-    return_code = convert_meter_entry_to_data(entry, &data);
+    if (entry->profile_id != 0) {
+        struct nikss_meter_profile profile;
+        return_code = read_meter_profile(ctx, entry->profile_id, &profile);
+        if (return_code == NO_ERROR) {
+            return_code = convert_meter_profile_to_data(&profile, &data);
+        }
+    } else {
+        return_code = convert_meter_entry_to_data(entry, &data);
+    }
     if (return_code != NO_ERROR) {
         return return_code;
     }
@@ -434,11 +816,188 @@ int nikss_meter_entry_update(nikss_meter_ctx_t *ctx, nikss_meter_entry_t *entry)
         goto clean_up;
     }
 
+    return_code = set_instance_profiles(ctx, entry->raw_index, 1, entry->profile_id);
+
 clean_up:
     free(value_buffer);
     return return_code;
 }
 
+/* Builds meter key from a plain index, which is possible when the index is a single integer field. */
+static int build_meter_index_key(nikss_meter_ctx_t *ctx, uint32_t index, char *key)
+{
+    nikss_struct_field_descriptor_t *index_field = NULL;
+    for (size_t i = 0; i < ctx->index_fds.n_fields; i++) {
+        if (ctx->index_fds.fields[i].type != NIKSS_STRUCT_FIELD_TYPE_DATA) {
+            continue;
+        }
+        if (index_field != NULL) {
+            index_field = NULL;
+            break;
+        }
+        index_field = &ctx->index_fds.fields[i];
+    }
+    if (index_field == NULL || index_field->data_offset + index_field->data_len > ctx->meter.key_size) {
+        fprintf(stderr, "meter index is not a single integer field\n");
+        return ENOTSUP;
+    }
+
+    memset(key, 0, ctx->meter.key_size);
+    char *dst = key + index_field->data_offset;
+    if (index_field->data_len == sizeof(uint8_t) && index <= UINT8_MAX) {
+        *((uint8_t *) dst) = (uint8_t) index;
+    } else if (index_field->data_len == sizeof(uint16_t) && index <= UINT16_MAX) {
+        uint16_t value = (uint16_t) index;
+        memcpy(dst, &value, sizeof(value));
+    } else if (index_field->data_len == sizeof(uint32_t)) {
+        memcpy(dst, &index, sizeof(index));
+    } else if (index_field->data_len == sizeof(uint64_t)) {
+        uint64_t value = index;
+        memcpy(dst, &value, sizeof(value));
+    } else {
+        fprintf(stderr, "meter index %u out of range\n", index);
+        return ERANGE;
+    }
+
+    return NO_ERROR;
+}
+
+static int meter_batch_commit(nikss_meter_ctx_t *ctx, char *keys, char *values, uint32_t count)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = BPF_F_LOCK,
+                        .flags = 0,
+    );
+
+    uint32_t processed = count;
+    if (bpf_map_update_batch(ctx->meter.fd, keys, values, &processed, &opts) == 0) {
+        return NO_ERROR;
+    }
+    /* Kernels without batch operations do not update the counter */
+    if (processed >= count) {
+        processed = 0;
+    }
+
+    for (uint32_t i = processed; i < count; i++) {
+        if (bpf_map_update_elem(ctx->meter.fd, keys + (size_t) i * ctx->meter.key_size,
+                                values + (size_t) i * ctx->meter.value_size, BPF_F_LOCK) != 0) {
+            int return_code = errno;
+            fprintf(stderr, "failed to set up meter: %s\n", strerror(return_code));
+            return return_code;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+/* Sets up meters in chunks of METER_BATCH_SIZE instances. When profile is not NULL all the
+ * instances from first_index get the same configuration, otherwise it is taken from entries. */
+static int meter_update_batch(nikss_meter_ctx_t *ctx, const nikss_meter_batch_entry_t *entries,
+                              uint32_t first_index, const nikss_meter_entry_t *profile, size_t n_entries)
+{
+    int return_code = NO_ERROR;
+    size_t chunk = n_entries < METER_BATCH_SIZE ? n_entries : METER_BATCH_SIZE;
+    char *keys = malloc(chunk * ctx->meter.key_size);
+    char *values = calloc(chunk, ctx->meter.value_size);
+    if (keys == NULL || values == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return_code = ENOMEM;
+        goto clean_up;
+    }
+
+    nikss_meter_data_t profile_data;
+    memset(&profile_data, 0, sizeof(profile_data));
+    nikss_meter_profile_id_t profile_id = profile != NULL ? profile->profile_id : 0;
+    if (profile_id != 0) {
+        struct nikss_meter_profile shared_profile;
+        return_code = read_meter_profile(ctx, profile_id, &shared_profile);
+        if (return_code == NO_ERROR) {
+            return_code = convert_meter_profile_to_data(&shared_profile, &profile_data);
+        }
+        if (return_code != NO_ERROR) {
+            goto clean_up;
+        }
+    } else if (profile != NULL) {
+        convert_meter_entry_to_data(profile, &profile_data);
+    }
+
+    size_t done = 0;
+    while (done < n_entries) {
+        uint32_t count = (uint32_t) (n_entries - done < chunk ? n_entries - done : chunk);
+
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t index = profile != NULL ? first_index + (uint32_t) (done + i) : entries[done + i].index;
+            return_code = build_meter_index_key(ctx, index, keys + (size_t) i * ctx->meter.key_size);
+            if (return_code != NO_ERROR) {
+                goto clean_up;
+            }
+        }
+
+        /* Rates conversion uses integer arithmetic only, profile is converted only once */
+        for (uint32_t i = 0; i < count; i++) {
+            nikss_meter_data_t data = profile_data;
+            if (profile == NULL) {
+                const nikss_meter_batch_entry_t *entry = &entries[done + i];
+                convert_rate(&entry->pir, &data.pir_period, &data.pir_unit_per_period);
+                convert_rate(&entry->cir, &data.cir_period, &data.cir_unit_per_period);
+                data.pbs = entry->pbs;
+                data.pbs_left = entry->pbs;
+                data.cbs = entry->cbs;
+                data.cbs_left = entry->cbs;
+            }
+            memcpy(values + (size_t) i * ctx->meter.value_size, &data, sizeof(data));
+        }
+
+        return_code = meter_batch_commit(ctx, keys, values, count);
+        if (return_code != NO_ERROR) {
+            goto clean_up;
+        }
+
+        return_code = set_instance_profiles(ctx, keys, count, profile_id);
+        if (return_code != NO_ERROR) {
+            goto clean_up;
+        }
+        done += count;
+    }
+
+clean_up:
+    if (keys != NULL) {
+        free(keys);
+    }
+    if (values != NULL) {
+        free(values);
+    }
+
+    return return_code;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_meter_entry_update_batch(nikss_meter_ctx_t *ctx, const nikss_meter_batch_entry_t *entries, size_t n_entries)
+{
+    if (ctx == NULL || (entries == NULL && n_entries > 0)) {
+        return EINVAL;
+    }
+    if (n_entries == 0) {
+        return NO_ERROR;
+    }
+
+    return meter_update_batch(ctx, entries, 0, NULL, n_entries);
+}
+
+int nikss_meter_entry_update_range(nikss_meter_ctx_t *ctx, uint32_t first_index, uint32_t last_index,
+                                   const nikss_meter_entry_t *profile)
+{
+    if (ctx == NULL || profile == NULL || first_index > last_index) {
+        return EINVAL;
+    }
+    if (ctx->meter.type == BPF_MAP_TYPE_ARRAY && last_index >= ctx->meter.max_entries) {
+        fprintf(stderr, "meter index %u out of range, meter has %u instances\n", last_index, ctx->meter.max_entries);
+        return ERANGE;
+    }
+
+    return meter_update_batch(ctx, NULL, first_index, profile, (size_t) (last_index - first_index) + 1);
+}
+
 int nikss_meter_entry_reset(nikss_meter_ctx_t *ctx, nikss_meter_entry_t *entry)
 {
     if (ctx == NULL) {
@@ -447,34 +1006,196 @@ int nikss_meter_entry_reset(nikss_meter_ctx_t *ctx, nikss_meter_entry_t *entry)
 
     /* Remove all entries if nikss_meter_entry_index were not executed on meter entry. */
     if (entry == NULL || entry->index_sfs.n_fields < 1) {
-        return delete_all_map_entries(&ctx->meter);
-    }
-
-    if (ctx->meter.type == BPF_MAP_TYPE_ARRAY) {
-        int return_code = nikss_meter_entry_data(entry, 0, 0, 0, 0);
-        if (return_code != NO_ERROR) {
-            return return_code;
+        int return_code = delete_all_map_entries(&ctx->meter);
+        if (return_code == NO_ERROR && open_meter_profile_maps(ctx, false) == NO_ERROR) {
+            return_code = delete_all_map_entries(&ctx->instance_profiles);
         }
-        return nikss_meter_entry_update(ctx, entry);
+        return return_code;
     }
 
     void *key_buffer = malloc(ctx->meter.key_size);
-    if (key_buffer == NULL) {
+    void *value_buffer = calloc(1, ctx->meter.value_size);
+    int return_code = NO_ERROR;
+    if (key_buffer == NULL || value_buffer == NULL) {
         fprintf(stderr, "not enough memory\n");
-        return ENOMEM;
+        return_code = ENOMEM;
+        goto clean_up;
     }
 
-    int return_code = construct_struct_from_fields(&entry->index_sfs, &ctx->index_fds, key_buffer, ctx->meter.key_size);
+    return_code = construct_struct_from_fields(&entry->index_sfs, &ctx->index_fds, key_buffer, ctx->meter.key_size);
     if (return_code != NO_ERROR) {
         goto clean_up;
     }
 
-    if (bpf_map_delete_elem(ctx->meter.fd, key_buffer) != 0) {
+    /* Instance of indirect meter can't be removed from array, so it is set up with zeros */
+    if (ctx->meter.type == BPF_MAP_TYPE_ARRAY) {
+        return_code = bpf_map_update_elem(ctx->meter.fd, key_buffer, value_buffer, BPF_F_LOCK);
+    } else {
+        return_code = bpf_map_delete_elem(ctx->meter.fd, key_buffer);
+    }
+    if (return_code != 0) {
         return_code = errno;
         fprintf(stderr, "failed to reset meter entry: %s\n", strerror(return_code));
+        goto clean_up;
     }
 
+    return_code = set_instance_profiles(ctx, key_buffer, 1, 0);
+
 clean_up:
     free(key_buffer);
+    free(value_buffer);
     return return_code;
 }
+
+int nikss_meter_profile_update(nikss_meter_ctx_t *ctx, nikss_meter_profile_id_t profile_id,
+                               nikss_meter_value_t pir,
+                               nikss_meter_value_t pbs,
+                               nikss_meter_value_t cir,
+                               nikss_meter_value_t cbs)
+{
+    if (ctx == NULL || profile_id == 0) {
+        return EINVAL;
+    }
+
+    int return_code = open_meter_profile_maps(ctx, true);
+    if (return_code != NO_ERROR) {
+        return return_code;
+    }
+
+    struct nikss_meter_profile profile = {
+        .pir = pir,
+        .pbs = pbs,
+        .cir = cir,
+        .cbs = cbs,
+    };
+    nikss_meter_data_t data;
+    return_code = convert_meter_profile_to_data(&profile, &data);
+    if (return_code != NO_ERROR) {
+        return return_code;
+    }
+
+    if (bpf_map_update_elem(ctx->profiles.fd, &profile_id, &profile, BPF_ANY) != 0) {
+        return_code = errno;
+        fprintf(stderr, "failed to set up meter profile %u: %s\n", profile_id, strerror(return_code));
+        return return_code;
+    }
+
+    char *instances = NULL;
+    size_t n_instances = 0;
+    return_code = find_profile_instances(ctx, profile_id, &instances, &n_instances);
+    if (return_code != NO_ERROR || n_instances == 0) {
+        return return_code;
+    }
+
+    /* Write new configuration to all instances using the profile */
+    size_t chunk = n_instances < METER_BATCH_SIZE ? n_instances : METER_BATCH_SIZE;
+    char *values = calloc(chunk, ctx->meter.value_size);
+    if (values == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        free(instances);
+        return ENOMEM;
+    }
+    for (size_t i = 0; i < chunk; i++) {
+        memcpy(values + i * ctx->meter.value_size, &data, sizeof(nikss_meter_data_t));
+    }
+
+    for (size_t done = 0; done < n_instances; done += chunk) {
+        uint32_t count = (uint32_t) (n_instances - done < chunk ? n_instances - done : chunk);
+        return_code = meter_batch_commit(ctx, instances + done * ctx->meter.key_size, values, count);
+        if (return_code != NO_ERROR) {
+            break;
+        }
+    }
+
+    free(values);
+    free(instances);
+    return return_code;
+}
+
+int nikss_meter_profile_delete(nikss_meter_ctx_t *ctx, nikss_meter_profile_id_t profile_id)
+{
+    if (ctx == NULL) {
+        return EINVAL;
+    }
+
+    struct nikss_meter_profile profile;
+    int return_code = read_meter_profile(ctx, profile_id, &profile);
+    if (return_code != NO_ERROR) {
+        return return_code;
+    }
+
+    char *instances = NULL;
+    size_t n_instances = 0;
+    return_code = find_profile_instances(ctx, profile_id, &instances, &n_instances);
+    free(instances);
+    if (return_code != NO_ERROR) {
+        return return_code;
+    }
+    if (n_instances > 0) {
+        /* cppcheck-suppress invalidPrintfArgType_uint ; cppcheck failed to recognize a real type of size_t */
+        fprintf(stderr, "meter profile %u is used by %lu instances\n", profile_id, n_instances);
+        return EBUSY;
+    }
+
+    if (bpf_map_delete_elem(ctx->profiles.fd, &profile_id) != 0) {
+        return_code = errno;
+        fprintf(stderr, "failed to delete meter profile %u: %s\n", profile_id, strerror(return_code));
+    }
+
+    return return_code;
+}
+
+int nikss_meter_profile_get(nikss_meter_ctx_t *ctx, nikss_meter_profile_id_t profile_id,
+                            nikss_meter_value_t *pir,
+                            nikss_meter_value_t *pbs,
+                            nikss_meter_value_t *cir,
+                            nikss_meter_value_t *cbs)
+{
+    if (ctx == NULL || pir == NULL || pbs == NULL || cir == NULL || cbs == NULL) {
+        return EINVAL;
+    }
+
+    struct nikss_meter_profile profile;
+    int return_code = read_meter_profile(ctx, profile_id, &profile);
+    if (return_code != NO_ERROR) {
+        return return_code;
+    }
+
+    *pir = profile.pir;
+    *pbs = profile.pbs;
+    *cir = profile.cir;
+    *cbs = profile.cbs;
+
+    return NO_ERROR;
+}
+
+size_t nikss_meter_profile_get_n_instances(nikss_meter_ctx_t *ctx, nikss_meter_profile_id_t profile_id)
+{
+    if (ctx == NULL) {
+        return 0;
+    }
+
+    char *instances = NULL;
+    size_t n_instances = 0;
+    if (find_profile_instances(ctx, profile_id, &instances, &n_instances) != NO_ERROR) {
+        return 0;
+    }
+    free(instances);
+
+    return n_instances;
+}
+
+void nikss_meter_entry_profile(nikss_meter_entry_t *entry, nikss_meter_profile_id_t profile_id)
+{
+    if (entry != NULL) {
+        entry->profile_id = profile_id;
+    }
+}
+
+nikss_meter_profile_id_t nikss_meter_entry_get_profile(nikss_meter_entry_t *entry)
+{
+    if (entry == NULL) {
+        return 0;
+    }
+    return entry->profile_id;
+}
@@ -24,6 +24,16 @@
 #define METER_PERIOD_MIN 100
 #endif
 
+/* Maximum number of profiles of a single meter */
+#ifndef METER_MAX_PROFILES
+#define METER_MAX_PROFILES 1024
+#endif
+
+/* Number of meter instances written with a single batch update */
+#ifndef METER_BATCH_SIZE
+#define METER_BATCH_SIZE 4096
+#endif
+
 #ifndef NS_IN_S
 #define NS_IN_S (uint64_t) 1e9
 #endif
@@ -43,6 +53,14 @@ typedef struct {
 
 #define DIRECT_METER_SIZE sizeof(nikss_meter_data_t)
 
+/* Value of the map with profiles, rates are converted when the profile is applied */
+struct nikss_meter_profile {
+    nikss_meter_value_t pir;
+    nikss_meter_value_t pbs;
+    nikss_meter_value_t cir;
+    nikss_meter_value_t cbs;
+};
+
 int convert_meter_entry_to_data(const nikss_meter_entry_t *entry, nikss_meter_data_t *data);
 int convert_meter_data_to_entry(const nikss_meter_data_t *data, nikss_meter_entry_t *entry);
 
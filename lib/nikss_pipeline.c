@@ -19,13 +19,16 @@
 #include <bpf/libbpf.h>
 #include <dirent.h>
 #include <errno.h>
-#include <ftw.h>
+#include <fcntl.h>
 #include <linux/if_link.h>
 #include <net/if.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <nikss/nikss_pipeline.h>
@@ -33,6 +36,7 @@
 #include "bpf_defs.h"
 #include "btf.h"
 #include "common.h"
+#include "nikss_counter.h"
 
 static char *program_pin_name(struct bpf_program *prog)
 {
@@ -79,79 +83,84 @@ static int tc_create_hook(int ifindex, const char *interface)
     return ret;
 }
 
-static int tc_attach_prog(nikss_context_t *ctx, const char *prog, int ifindex, enum bpf_tc_attach_point hook_point, const char *interface)
+static int tc_detach_prog(int ifindex, enum bpf_tc_attach_point hook_point, const char *interface)
 {
+    DECLARE_LIBBPF_OPTS(bpf_tc_hook, hook,
+                        .ifindex = ifindex,
+                        .attach_point = hook_point);
+    DECLARE_LIBBPF_OPTS(bpf_tc_opts, opts,
+                        .handle = TC_FILTER_HANDLE,
+                        .priority = TC_FILTER_PRIORITY);
+
     int ret = NO_ERROR;
-    int fd = open_prog_by_name(ctx, prog);
-    if (fd < 0) {
+    if (bpf_tc_detach(&hook, &opts) != 0) {
         ret = errno;
-        if (ret == ENOENT && hook_point == BPF_TC_EGRESS) {
-            fprintf(stderr, "skipping empty egress program...\n");
+        /* Nothing to detach */
+        if (ret == ENOENT) {
             return NO_ERROR;
         }
-
-        fprintf(stderr, "failed to open program %s: %s\n", prog, strerror(ret));
-        return ret;
+        fprintf(stderr, "failed to detach bpf program from interface %s: %s\n", interface, strerror(ret));
     }
 
+    return ret;
+}
+
+static int tc_attach_fd(int fd, int ifindex, enum bpf_tc_attach_point hook_point, const char *interface, bool replace)
+{
     DECLARE_LIBBPF_OPTS(bpf_tc_hook, hook,
                         .ifindex = ifindex,
                         .attach_point = hook_point);
     DECLARE_LIBBPF_OPTS(bpf_tc_opts, opts,
-                        .prog_fd = fd);
+                        .prog_fd = fd,
+                        .handle = TC_FILTER_HANDLE,
+                        .priority = TC_FILTER_PRIORITY,
+                        .flags = replace ? BPF_TC_F_REPLACE : 0);
 
+    int ret = NO_ERROR;
     if (bpf_tc_attach(&hook, &opts) != 0) {
         ret = errno;
         fprintf(stderr, "failed to attach bpf program to interface %s: %s\n", interface, strerror(ret));
-        goto clean_up;
     }
 
-clean_up:
-    close(fd);
-
     return ret;
 }
 
-static int tc_create_hook_and_attach_progs(nikss_context_t *ctx, int ifindex, const char *interface)
+/* When replace is set, program already attached to the hook is atomically exchanged with the new one */
+static int tc_attach_prog(nikss_context_t *ctx, const char *prog, int ifindex, enum bpf_tc_attach_point hook_point,
+                          const char *interface, bool replace)
 {
-    int ret = tc_create_hook(ifindex, interface);
-    if (ret != NO_ERROR) {
-        return ret;
-    }
+    int ret = NO_ERROR;
+    int fd = open_prog_by_name(ctx, prog);
+    if (fd < 0) {
+        ret = errno;
+        if (ret == ENOENT && hook_point == BPF_TC_EGRESS) {
+            fprintf(stderr, "skipping empty egress program...\n");
+            /* Egress program of the previous pipeline must not stay attached */
+            return replace ? tc_detach_prog(ifindex, hook_point, interface) : NO_ERROR;
+        }
 
-    ret = tc_attach_prog(ctx, TC_INGRESS_PROG, ifindex, BPF_TC_INGRESS, interface);
-    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to open program %s: %s\n", prog, strerror(ret));
         return ret;
     }
 
-    ret = tc_attach_prog(ctx, TC_EGRESS_PROG, ifindex, BPF_TC_EGRESS, interface);
-    if (ret != NO_ERROR) {
-        return ret;
-    }
+    ret = tc_attach_fd(fd, ifindex, hook_point, interface, replace);
+    close(fd);
 
-    return NO_ERROR;
+    return ret;
 }
 
-static int xdp_attach_prog_to_port(int *fd, nikss_context_t *ctx, int ifindex, const char *prog)
+static int xdp_attach_fd_to_port(int fd, int ifindex)
 {
     __u32 flags = 0;
     int ret = 0;
 
-    *fd = open_prog_by_name(ctx, prog);
-    if (*fd < 0) {
-        ret = errno;  // from sys_call
-        fprintf(stderr, "failed to open program %s: %s\n", prog, strerror(ret));
-        return ret;
-    }
-
     /* TODO: add support for hardware offload mode (XDP_FLAGS_HW_MODE) */
 
     flags = XDP_FLAGS_DRV_MODE;
-    ret = bpf_set_link_xdp_fd(ifindex, *fd, flags);
+    ret = bpf_set_link_xdp_fd(ifindex, fd, flags);
     if (ret != -EOPNOTSUPP) {
         if (ret < 0) {
             fprintf(stderr, "failed to attach XDP program in driver mode: %s\n", strerror(-ret));
-            close_object_fd(fd);
             return -ret;
         }
         return NO_ERROR;
@@ -159,10 +168,9 @@ static int xdp_attach_prog_to_port(int *fd, nikss_context_t *ctx, int ifindex, c
 
     fprintf(stderr, "XDP native mode not supported by driver, retrying with generic SKB mode\n");
     flags = XDP_FLAGS_SKB_MODE;
-    ret = bpf_set_link_xdp_fd(ifindex, *fd, flags);
+    ret = bpf_set_link_xdp_fd(ifindex, fd, flags);
     if (ret < 0) {
         fprintf(stderr, "failed to attach XDP program in SKB mode: %s\n", strerror(-ret));
-        close_object_fd(fd);
         return -ret;
     }
 
@@ -196,22 +204,13 @@ static int update_prog_devmap(nikss_bpf_map_descriptor_t *devmap, int ifindex, c
     return NO_ERROR;
 }
 
-static int xdp_port_add(nikss_context_t *ctx, const char *intf, int ifindex)
+/* Installs egress program(s) of the pipeline for the port, used also when pipeline is replaced */
+static int xdp_port_setup_egress(nikss_context_t *ctx, const char *intf, int ifindex)
 {
     int ret = NO_ERROR;
-    int ig_prog_fd = 0;
-    int eg_prog_fd = 0;
-
-    /* TODO: Should we attach ingress pipeline at the end of whole procedure?
-     *  For short time packets will be served only in ingress but not in egress pipeline. */
-    ret = xdp_attach_prog_to_port(&ig_prog_fd, ctx, ifindex, XDP_INGRESS_PROG);
-    if (ret != NO_ERROR) {
-        return ret;
-    }
-    close_object_fd(&ig_prog_fd);
 
     /* may not exist, ignore errors */
-    eg_prog_fd = open_prog_by_name(ctx, XDP_EGRESS_PROG);
+    int eg_prog_fd = open_prog_by_name(ctx, XDP_EGRESS_PROG);
 
     nikss_bpf_map_descriptor_t devmap;
     ret = open_bpf_map(ctx, XDP_DEVMAP, NULL, &devmap);
@@ -249,30 +248,135 @@ static int xdp_port_add(nikss_context_t *ctx, const char *intf, int ifindex)
         }
     }
 
-    ret = tc_create_hook_and_attach_progs(ctx, ifindex, intf);
+    return NO_ERROR;
+}
+
+/* Programs and maps required to add ports, opened once for all the ports added together */
+struct port_attach_objects {
+    bool is_xdp;
+    /* XDP ingress program for XDP-based pipeline or XDP helper for TC-based one */
+    int xdp_prog_fd;
+    int tc_ingress_prog_fd;
+    /* optional */
+    int tc_egress_prog_fd;
+    int xdp_egress_prog_fd;
+    nikss_bpf_map_descriptor_t devmap;
+};
+
+static void close_port_attach_objects(struct port_attach_objects *objs)
+{
+    close_object_fd(&objs->xdp_prog_fd);
+    close_object_fd(&objs->tc_ingress_prog_fd);
+    close_object_fd(&objs->tc_egress_prog_fd);
+    close_object_fd(&objs->xdp_egress_prog_fd);
+    close_object_fd(&objs->devmap.fd);
+}
+
+static int open_required_prog(nikss_context_t *ctx, const char *prog, int *fd)
+{
+    *fd = open_prog_by_name(ctx, prog);
+    if (*fd < 0) {
+        int ret = errno;
+        fprintf(stderr, "failed to open program %s: %s\n", prog, strerror(ret));
+        return ret;
+    }
+    return NO_ERROR;
+}
+
+static int open_port_attach_objects(nikss_context_t *ctx, struct port_attach_objects *objs)
+{
+    memset(objs, 0, sizeof(struct port_attach_objects));
+    objs->xdp_prog_fd = -1;
+    objs->tc_ingress_prog_fd = -1;
+    objs->tc_egress_prog_fd = -1;
+    objs->xdp_egress_prog_fd = -1;
+    objs->devmap.fd = -1;
+
+    /* Determine firstly if we have TC-based or XDP-based pipeline.
+     * We can do this by just checking if XDP helper exists under a mount path. */
+    char pinned_file[256];
+    build_ebpf_prog_filename(pinned_file, sizeof(pinned_file), ctx, XDP_HELPER_PROG);
+    objs->is_xdp = access(pinned_file, F_OK) != 0;
+
+    int ret = open_required_prog(ctx, objs->is_xdp ? XDP_INGRESS_PROG : XDP_HELPER_PROG, &objs->xdp_prog_fd);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+    ret = open_required_prog(ctx, TC_INGRESS_PROG, &objs->tc_ingress_prog_fd);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+    /* may not exist, ignore errors */
+    objs->tc_egress_prog_fd = open_prog_by_name(ctx, TC_EGRESS_PROG);
+
+    if (!objs->is_xdp) {
+        return NO_ERROR;
+    }
+
+    /* may not exist, ignore errors */
+    objs->xdp_egress_prog_fd = open_prog_by_name(ctx, XDP_EGRESS_PROG);
+    ret = open_bpf_map(ctx, XDP_DEVMAP, NULL, &objs->devmap);
     if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to open DEVMAP: %s\n", strerror(ret));
         return ret;
     }
 
+    /* Jump table has a single entry shared by all ports, so set it up only once */
+    int eg_prog_fd = open_prog_by_name(ctx, XDP_EGRESS_PROG_OPTIMIZED);
+    if (eg_prog_fd >= 0) {
+        nikss_bpf_map_descriptor_t jmpmap;
+        ret = open_bpf_map(ctx, XDP_JUMP_TBL, NULL, &jmpmap);
+        if (ret != NO_ERROR) {
+            fprintf(stderr, "failed to open map %s: %s\n", XDP_JUMP_TBL, strerror(errno));
+            close_object_fd(&eg_prog_fd);
+            return ENOENT;
+        }
+
+        int index = 0;
+        ret = bpf_map_update_elem(jmpmap.fd, &index, &eg_prog_fd, 0);
+        int errno_val = errno;
+        close_object_fd(&eg_prog_fd);
+        close_object_fd(&jmpmap.fd);
+        if (ret) {
+            fprintf(stderr, "failed to update map %s: %s\n", XDP_JUMP_TBL, strerror(errno_val));
+            return errno_val;
+        }
+    }
+
     return NO_ERROR;
 }
 
-static int tc_port_add(nikss_context_t *ctx, const char *interface, int ifindex)
+static int attach_port(struct port_attach_objects *objs, const char *interface, int ifindex)
 {
-    int xdp_helper_fd = -1;
+    /* TODO: Should we attach ingress pipeline at the end of whole procedure?
+     *  For short time packets will be served only in ingress but not in egress pipeline. */
+    int ret = xdp_attach_fd_to_port(objs->xdp_prog_fd, ifindex);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+
+    if (objs->is_xdp) {
+        ret = update_prog_devmap(&objs->devmap, ifindex, interface, objs->xdp_egress_prog_fd);
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+    }
 
-    int ret = xdp_attach_prog_to_port(&xdp_helper_fd, ctx, ifindex, XDP_HELPER_PROG);
+    ret = tc_create_hook(ifindex, interface);
     if (ret != NO_ERROR) {
         return ret;
     }
-    close_object_fd(&xdp_helper_fd);
 
-    ret = tc_create_hook_and_attach_progs(ctx, ifindex, interface);
+    ret = tc_attach_fd(objs->tc_ingress_prog_fd, ifindex, BPF_TC_INGRESS, interface, false);
     if (ret != NO_ERROR) {
         return ret;
     }
 
-    return NO_ERROR;
+    if (objs->tc_egress_prog_fd < 0) {
+        fprintf(stderr, "skipping empty egress program...\n");
+        return NO_ERROR;
+    }
+    return tc_attach_fd(objs->tc_egress_prog_fd, ifindex, BPF_TC_EGRESS, interface, false);
 }
 
 bool nikss_pipeline_exists(nikss_context_t *ctx)
@@ -300,363 +404,1492 @@ static int extract_tuple_id_from_tuple(const char *tuple_name, uint32_t *tuple_i
     return NO_ERROR;
 }
 
-static int join_tuple_to_map_if_tuple(nikss_context_t *ctx, const char *tuple_name)
-{
-    // We assume that each tuple has "_tuple_" suffix
-    // This name also is reserved in a p4c-ebpf-psa compiler
-    const char *suffix = "_tuple_";
-    const char *ternary_tbl_name_lst_char_ptr = strstr(tuple_name, suffix);
-
-    if (ternary_tbl_name_lst_char_ptr) {
-        char tuples_map_name[268];
-        int ternary_map_name_length = (int)(ternary_tbl_name_lst_char_ptr - tuple_name);
-        snprintf(tuples_map_name, sizeof(tuples_map_name), "%.*s_tuples_map", ternary_map_name_length, tuple_name);
-
-        nikss_bpf_map_descriptor_t tuple_map;
-        int ret = open_bpf_map(ctx, tuples_map_name, NULL, &tuple_map);
-        if (ret != NO_ERROR) {
-            fprintf(stderr, "couldn't open map %s: %s\n", tuples_map_name, strerror(ret));
-            return ret;
-        }
-
-        // Take tuple_id from a tuple map name
-        uint32_t tuple_id = 0;
-        ret = extract_tuple_id_from_tuple(tuple_name, &tuple_id);
-        if (ret != NO_ERROR) {
-            fprintf(stderr, "cannot extract tuple_id from tuple name %s: %s", tuple_name, strerror(ret));
-            return ENODATA;
-        }
-
-        nikss_bpf_map_descriptor_t tuple;
-        ret = open_bpf_map(ctx, tuple_name, NULL, &tuple);
-        if (ret != NO_ERROR) {
-            fprintf(stderr, "couldn't open map %s: %s\n", tuple_name, strerror(ret));
-            return ret;
-        }
-
-        ret = bpf_map_update_elem(tuple_map.fd, &tuple_id, &tuple.fd, 0);
-        if (ret != NO_ERROR) {
-            fprintf(stderr, "failed to add tuple %u: %s\n", tuple_id, strerror(ret));
-        }
+/* Tuples maps of ternary tables found while pinning maps, so each of them is looked up only once */
+struct tuples_map_registry {
+    size_t n_maps;
+    struct tuples_map_registry_entry {
+        char name[268];
+        int fd;
+    } *maps;
+};
 
-        tuple_id++;
+static void free_tuples_map_registry(struct tuples_map_registry *registry)
+{
+    if (registry->maps != NULL) {
+        free(registry->maps);
     }
-
-    return NO_ERROR;
+    registry->maps = NULL;
+    registry->n_maps = 0;
 }
 
-int nikss_pipeline_load(nikss_context_t *ctx, const char *file)
+static int find_tuples_map_fd(struct bpf_object *obj, struct tuples_map_registry *registry, const char *name)
 {
-    struct bpf_object *obj = NULL;
-    int ret = 0;
-    int fd = -1;
-    char pinned_file[256];
-    struct bpf_program *pos = NULL;
-
-    ret = bpf_prog_load(file, BPF_PROG_TYPE_UNSPEC, &obj, &fd);
-    /* Do not close fd obtained from above call, it is maintained by obj */
-    if (ret < 0 || obj == NULL) {
-        ret = errno;
-        fprintf(stderr, "cannot load the BPF program: %s\n", strerror(ret));
-        return ret;
-    }
-
-    bpf_object__for_each_program(pos, obj) {
-        const char *sec_name = bpf_program__section_name(pos);
-        char *pin_name = program_pin_name(pos);
-
-        build_ebpf_prog_filename(pinned_file, sizeof(pinned_file),
-                                 ctx, pin_name);
-        free(pin_name);
-
-        ret = bpf_program__pin(pos, pinned_file);
-        if (ret < 0) {
-            fprintf(stderr, "failed to pin %s at %s: %s\n",
-                    sec_name, pinned_file, strerror(-ret));
-            goto err_close_obj;
+    for (size_t i = 0; i < registry->n_maps; i++) {
+        if (strcmp(registry->maps[i].name, name) == 0) {
+            return registry->maps[i].fd;
         }
     }
 
+    /* fd belongs to the object, there is no need to open pinned map */
+    int fd = -1;
     struct bpf_map *map = NULL;
     bpf_object__for_each_map(map, obj) {
-        if (bpf_map__is_pinned(map)) {
-            ret = bpf_map__unpin(map, NULL);
-            if (ret) {
-                fprintf(stderr, "failed to remove old map pin file: %s\n", strerror(-ret));
-                goto err_close_obj;
-            }
+        if (strcmp(bpf_map__name(map), name) == 0) {
+            fd = bpf_map__fd(map);
+            break;
         }
+    }
+    if (fd < 0) {
+        return -ENOENT;
+    }
 
-        const char *map_name = bpf_map__name(map);
+    struct tuples_map_registry_entry *tmp = realloc(registry->maps,
+                                                    (registry->n_maps + 1) * sizeof(struct tuples_map_registry_entry));
+    if (tmp == NULL) {
+        return -ENOMEM;
+    }
+    registry->maps = tmp;
+    snprintf(registry->maps[registry->n_maps].name, sizeof(registry->maps[0].name), "%s", name);
+    registry->maps[registry->n_maps].fd = fd;
+    registry->n_maps++;
 
-        /* Pinned file name cannot contain a dot */
-        if (strstr(map_name, ".") != NULL) {
-            continue;
-        }
+    return fd;
+}
 
-        build_ebpf_map_filename(pinned_file, sizeof(pinned_file), ctx, map_name);
-        ret = bpf_map__set_pin_path(map, pinned_file);
-        if (ret) {
-            fprintf(stderr, "failed to pin map at %s: %s\n", pinned_file, strerror(-ret));
-            goto err_close_obj;
-        }
+static int join_tuple_to_map_if_tuple(struct bpf_object *obj, struct tuples_map_registry *registry,
+                                      struct bpf_map *tuple, unsigned *n_tuples)
+{
+    // We assume that each tuple has "_tuple_" suffix
+    // This name also is reserved in a p4c-ebpf-psa compiler
+    const char *suffix = "_tuple_";
+    const char *tuple_name = bpf_map__name(tuple);
+    const char *ternary_tbl_name_lst_char_ptr = strstr(tuple_name, suffix);
 
-        ret = bpf_map__pin(map, pinned_file);
-        if (ret) {
-            fprintf(stderr, "failed to pin map at %s: %s\n", pinned_file, strerror(-ret));
-            goto err_close_obj;
-        }
+    if (ternary_tbl_name_lst_char_ptr == NULL) {
+        return NO_ERROR;
+    }
 
-        ret = join_tuple_to_map_if_tuple(ctx, map_name);
-        if (ret) {
-            fprintf(stderr, "failed to add tuple (%s) to tuples map\n", map_name);
-            goto err_close_obj;
-        }
+    char tuples_map_name[268];
+    int ternary_map_name_length = (int)(ternary_tbl_name_lst_char_ptr - tuple_name);
+    snprintf(tuples_map_name, sizeof(tuples_map_name), "%.*s_tuples_map", ternary_map_name_length, tuple_name);
+
+    int tuples_map_fd = find_tuples_map_fd(obj, registry, tuples_map_name);
+    if (tuples_map_fd < 0) {
+        fprintf(stderr, "couldn't find map %s: %s\n", tuples_map_name, strerror(-tuples_map_fd));
+        return -tuples_map_fd;
     }
 
-    bpf_object__for_each_program(pos, obj) {
-        const char *sec_name = bpf_program__section_name(pos);
-        fd = bpf_program__fd(pos);
-        if (!strcmp(sec_name, TC_INIT_PROG) || !strcmp(sec_name, XDP_INIT_PROG)) {
-            ret = do_initialize_maps(fd);
-            if (ret) {
-                ret = -errno;
-                fprintf(stderr, "failed to initialize maps: %s\n", strerror(errno));
-                goto err_close_obj;
-            }
-        }
+    // Take tuple_id from a tuple map name
+    uint32_t tuple_id = 0;
+    int ret = extract_tuple_id_from_tuple(tuple_name, &tuple_id);
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "cannot extract tuple_id from tuple name %s: %s", tuple_name, strerror(ret));
+        return ENODATA;
     }
 
-err_close_obj:
-    bpf_object__close(obj);
+    int tuple_fd = bpf_map__fd(tuple);
+    if (bpf_map_update_elem(tuples_map_fd, &tuple_id, &tuple_fd, 0) != 0) {
+        ret = errno;
+        fprintf(stderr, "failed to add tuple %u: %s\n", tuple_id, strerror(ret));
+        return ret;
+    }
+    (*n_tuples)++;
 
-    /* ret is negative value from returned libbpf, but we should return positive ones */
-    return -ret;
+    return NO_ERROR;
 }
 
-static int remove_file(const char *fpath, const struct stat *sb, int tflag, struct FTW *ftwbuf)
+static uint64_t elapsed_ns_since(struct timespec *start)
 {
-    (void) sb; (void) tflag; (void) ftwbuf;
-
-    /* Ignore any error and continue */
-    remove(fpath);
-    return 0;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t elapsed = (uint64_t) (now.tv_sec - start->tv_sec) * 1000000000ULL +
+                       (uint64_t) now.tv_nsec - (uint64_t) start->tv_nsec;
+    *start = now;
+    return elapsed;
 }
 
-static int remove_pipeline_directory(nikss_context_t *ctx)
+/* Maps of ternary table which are created from the tuple template */
+static bool is_tuple_of_table(const char *map_name, const char *table_name)
 {
-    char pipeline_path[256];
-    build_ebpf_pipeline_path(pipeline_path, sizeof(pipeline_path), ctx);
-
-    /* 16 - Maximum number of file descriptors used by nftw(). In case lack of
-     *      available file descriptors it can be reduced at the cost of performance.
-     * FTW_DEPTH - Call callback for the directory itself after handling the
-     *             contents of the directory and its subdirectories.
-     * FTW_MOUNT - Stay within the same filesystem (i.e., do not cross mount points).
-     * FTW_PHYS  - Do  not  follow  symbolic  links. */
-    if (nftw(pipeline_path, remove_file, 16, FTW_DEPTH | FTW_MOUNT | FTW_PHYS) != 0) {
-        int err = errno;
-        fprintf(stderr, "failed to remove pipeline directory: %s\n", strerror(err));
-        return err;
+    size_t len = strlen(table_name);
+    if (strncmp(map_name, table_name, len) != 0) {
+        return false;
     }
 
-    return NO_ERROR;
+    const char *suffix = map_name + len;
+    return strcmp(suffix, "_tuple") == 0 || strncmp(suffix, "_tuple_", strlen("_tuple_")) == 0;
 }
 
-int nikss_pipeline_unload(nikss_context_t *ctx)
+static bool is_tuples_map_of_table(const char *map_name, const char *table_name)
 {
-    /* TODO: Should we scan all interfaces to detect if it uses current pipeline programs and detach it? */
-
-    return remove_pipeline_directory(ctx);
+    size_t len = strlen(table_name);
+    return strncmp(map_name, table_name, len) == 0 && strcmp(map_name + len, "_tuples_map") == 0;
 }
 
-int nikss_pipeline_add_port(nikss_context_t *ctx, const char *interface, int *port_id)
+static int apply_map_override(struct bpf_map *map, const nikss_map_override_t *override, bool is_tuple)
 {
-    char pinned_file[256];
-    bool isXDP = false;
-
-    /* Determine firstly if we have TC-based or XDP-based pipeline.
-     * We can do this by just checking if XDP helper exists under a mount path. */
-    build_ebpf_prog_filename(pinned_file, sizeof(pinned_file), ctx, XDP_HELPER_PROG);
-    isXDP = access(pinned_file, F_OK) != 0;
+    int ret = 0;
 
-    int ifindex = (int) if_nametoindex(interface);
-    if (!ifindex) {
-        fprintf(stderr, "no such interface: %s\n", interface);
-        return ENODEV;
+    if (override->max_entries > 0) {
+        ret = bpf_map__set_max_entries(map, override->max_entries);
     }
-
-    if (port_id != NULL) {
-        *port_id = ifindex;
+    if (ret == 0 && override->no_prealloc) {
+        ret = bpf_map__set_map_flags(map, bpf_map__map_flags(map) | BPF_F_NO_PREALLOC);
     }
-
-    return isXDP ? xdp_port_add(ctx, interface, ifindex) : tc_port_add(ctx, interface, ifindex);
+    if (ret == 0 && override->mmapable && !is_tuple) {
+        ret = bpf_map__set_map_flags(map, bpf_map__map_flags(map) | BPF_F_MMAPABLE);
+    }
+    if (ret == 0 && override->numa_node >= 0) {
+        ret = bpf_map__set_numa_node(map, override->numa_node);
+        if (ret == 0) {
+            ret = bpf_map__set_map_flags(map, bpf_map__map_flags(map) | BPF_F_NUMA_NODE);
+        }
+    }
+    if (ret != 0) {
+        fprintf(stderr, "failed to change map %s: %s\n", bpf_map__name(map), strerror(-ret));
+    }
+
+    return ret;
 }
 
-int nikss_pipeline_del_port(nikss_context_t *ctx, const char *interface)
+/* Tuples joined at load and created later must match the inner map of tuples map, otherwise kernel
+ * rejects them with EINVAL. Returns negative error code as libbpf does. */
+static int check_tuples_map_definition(struct bpf_object *obj, const char *table_name)
 {
-    (void) ctx;
-    __u32 flags = 0;
-    int ifindex = 0;
+    char name[256];
 
-    ifindex = (int) if_nametoindex(interface);
-    if (!ifindex) {
-        fprintf(stderr, "no such interface: %s\n", interface);
-        return ENODEV;
+    snprintf(name, sizeof(name), "%s_tuples_map", table_name);
+    struct bpf_map *tuples_map = bpf_object__find_map_by_name(obj, name);
+    snprintf(name, sizeof(name), "%s_tuple", table_name);
+    struct bpf_map *tuple = bpf_object__find_map_by_name(obj, name);
+    if (tuples_map == NULL || tuple == NULL) {
+        return 0;
     }
 
-    int ret = bpf_set_link_xdp_fd(ifindex, -1, flags);
-    if (ret) {
-        fprintf(stderr, "failed to detach XDP program: %s\n", strerror(-ret));
-        return -ret;
+    struct bpf_map *inner = bpf_map__inner_map(tuples_map);
+    if (inner != NULL && bpf_map__map_flags(inner) != bpf_map__map_flags(tuple)) {
+        fprintf(stderr, "flags of %s tuples differ from the inner map of tuples map\n", table_name);
+        return -EINVAL;
     }
 
-    DECLARE_LIBBPF_OPTS(bpf_tc_hook, hook,
-                        .ifindex = ifindex,
-                        .attach_point = BPF_TC_INGRESS | BPF_TC_EGRESS);
-    if (bpf_tc_hook_destroy(&hook) != 0) {
-        ret = errno;
-        /* Ignore error when qdisc does not exist, e.g. for XDP dummy program */
-        if (ret != ENOENT) {
-            fprintf(stderr, "failed to detach TC program from %s: %s\n", interface, strerror(ret));
+    return 0;
+}
+
+/* Returns negative error code as libbpf does */
+static int apply_map_overrides(struct bpf_object *obj, const nikss_pipeline_load_opts_t *opts)
+{
+    if (opts == NULL) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < opts->n_map_overrides; i++) {
+        const nikss_map_override_t *override = &opts->map_overrides[i];
+        struct bpf_map *map = NULL;
+        bool found = false;
+
+        if (override->name == NULL) {
+            return -EINVAL;
+        }
+        bpf_object__for_each_map(map, obj) {
+            const char *map_name = bpf_map__name(map);
+            int ret = 0;
+            if (is_tuples_map_of_table(map_name, override->name)) {
+                /* Kernel compares definition of a tuple with the inner map definition of tuples map, which
+                 * libbpf keeps outside of the list of maps of the object */
+                struct bpf_map *inner = bpf_map__inner_map(map);
+                if (inner != NULL) {
+                    ret = apply_map_override(inner, override, true);
+                }
+            } else if (strcmp(map_name, override->name) == 0 || is_tuple_of_table(map_name, override->name)) {
+                ret = apply_map_override(map, override, is_tuple_of_table(map_name, override->name));
+                found = true;
+            }
+            if (ret != 0) {
+                return ret;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "map %s not found in the program\n", override->name);
+            return -ENOENT;
+        }
+
+        int ret = check_tuples_map_definition(obj, override->name);
+        if (ret != 0) {
             return ret;
         }
     }
 
-    return NO_ERROR;
+    return 0;
 }
 
-int nikss_port_list_init(nikss_port_list_t *list, nikss_context_t *ctx)
+/* Name of ternary table to which tuple, tuple template or tuples map belongs, false for other maps */
+static bool get_table_of_tuple(const char *map_name, char *table_name, size_t len)
 {
-    int ret = NO_ERROR;
-    if (list == NULL || ctx == NULL) {
-        return EINVAL;
+    const char *suffix = strstr(map_name, "_tuple");
+    const char *next = suffix;
+    while (next != NULL) {
+        suffix = next;
+        next = strstr(suffix + 1, "_tuple");
+    }
+    if (suffix == NULL || suffix == map_name) {
+        return false;
+    }
+    if (strcmp(suffix, "_tuple") != 0 && strcmp(suffix, "_tuples_map") != 0 &&
+        strncmp(suffix, "_tuple_", strlen("_tuple_")) != 0) {
+        return false;
     }
 
-    memset(list, 0, sizeof(nikss_port_list_t));
+    snprintf(table_name, len, "%.*s", (int) (suffix - map_name), map_name);
+    return true;
+}
 
-    list->iface_list = if_nameindex();
-    if (list->iface_list == NULL) {
-        return errno;
-    }
+/* Returns negative value when NUMA node of tuples was not saved */
+static int read_tuples_numa_node(nikss_context_t *ctx, const char *table_name)
+{
+    char name[256];
+    char pinned_file[256];
+    uint32_t key = 0;
+    uint32_t node = 0;
 
-    int fd = open_prog_by_name(ctx, XDP_HELPER_PROG);
+    snprintf(name, sizeof(name), "%s%s", table_name, TUPLES_NUMA_NODE_SUFFIX);
+    build_ebpf_prog_filename(pinned_file, sizeof(pinned_file), ctx, name);
+    int fd = bpf_obj_get(pinned_file);
     if (fd < 0) {
-        /* XDP helper not found, try XDP ingress program */
-        fd = open_prog_by_name(ctx, XDP_INGRESS_PROG);
+        return -1;
     }
+    int ret = bpf_map_lookup_elem(fd, &key, &node);
+    close_object_fd(&fd);
+
+    return ret == 0 && node <= INT32_MAX ? (int) node : -1;
+}
+
+/* Map of the running pipeline is kept as it is, so size and flags which were given at its load are not lost */
+static int inherit_map_definition(nikss_context_t *old_ctx, const char *old_name, struct bpf_map *map)
+{
+    char pinned_file[256];
+    char table_name[256];
+    struct bpf_map_info info = {0};
+    uint32_t info_len = sizeof(info);
 
+    build_ebpf_map_filename(pinned_file, sizeof(pinned_file), old_ctx, old_name);
+    int fd = bpf_obj_get(pinned_file);
     if (fd < 0) {
-        ret = errno;
-        fprintf(stderr, "failed to open pipeline program: %s\n", strerror(ret));
-        return ret;
+        return 0;
+    }
+    int ret = bpf_obj_get_info_by_fd(fd, &info, &info_len);
+    close_object_fd(&fd);
+    if (ret != 0) {
+        return 0;
     }
 
-    struct bpf_prog_info prog_info = {};
-    unsigned len = sizeof(struct bpf_prog_info);
-    if (bpf_obj_get_info_by_fd(fd, &prog_info, &len) != 0) {
-        ret = errno;
-        fprintf(stderr, "failed to get BPF program info: %s\n", strerror(ret));
-        goto free_program;
+    /* Changed maps are not migrated, so their definition from the program is used */
+    if (info.type != (uint32_t) bpf_map__type(map) || info.key_size != bpf_map__key_size(map) ||
+        info.value_size != bpf_map__value_size(map)) {
+        return 0;
     }
 
-    list->xdp_prog_id = prog_info.id;
+    if (info.max_entries != bpf_map__max_entries(map)) {
+        ret = bpf_map__set_max_entries(map, info.max_entries);
+    }
+    uint32_t flags = bpf_map__map_flags(map) | (info.map_flags & (BPF_F_NO_PREALLOC | BPF_F_MMAPABLE));
+    if (ret == 0 && (info.map_flags & BPF_F_NUMA_NODE) != 0) {
+        /* Kernel does not report NUMA node, it is known only for tuples */
+        int node = get_table_of_tuple(old_name, table_name, sizeof(table_name)) ?
+                   read_tuples_numa_node(old_ctx, table_name) : -1;
+        if (node >= 0) {
+            ret = bpf_map__set_numa_node(map, (uint32_t) node);
+            flags |= BPF_F_NUMA_NODE;
+        } else {
+            fprintf(stderr, "warning: map %s: NUMA node is not known, not kept\n", old_name);
+        }
+    }
+    if (ret == 0) {
+        ret = bpf_map__set_map_flags(map, flags);
+    }
+    if (ret != 0) {
+        fprintf(stderr, "failed to keep definition of map %s: %s\n", old_name, strerror(-ret));
+    }
 
-free_program:
-    close(fd);
     return ret;
 }
 
-void nikss_port_list_free(nikss_port_list_t *list)
+/* Returns negative error code as libbpf does */
+static int inherit_map_definitions(struct bpf_object *obj, nikss_context_t *old_ctx)
 {
-    if (list == NULL) {
-        return;
+    struct bpf_map *map = NULL;
+    char table_name[256];
+    char template_name[256];
+
+    if (old_ctx == NULL) {
+        return 0;
     }
 
-    if (list->iface_list != NULL) {
-        if_freenameindex(list->iface_list);
+    bpf_object__for_each_map(map, obj) {
+        const char *map_name = bpf_map__name(map);
+        /* Not pinned, so not present in the running pipeline */
+        if (strchr(map_name, '.') != NULL) {
+            continue;
+        }
+
+        int ret = inherit_map_definition(old_ctx, map_name, map);
+        if (ret == 0 && get_table_of_tuple(map_name, table_name, sizeof(table_name)) &&
+            is_tuples_map_of_table(map_name, table_name) && bpf_map__inner_map(map) != NULL) {
+            /* Inner map must have the same definition as tuples, which is the one of tuple template */
+            snprintf(template_name, sizeof(template_name), "%s_tuple", table_name);
+            ret = inherit_map_definition(old_ctx, template_name, bpf_map__inner_map(map));
+        }
+        if (ret != 0) {
+            return ret;
+        }
     }
 
-    list->iface_list = NULL;
-    list->current_iface = NULL;
+    return 0;
 }
 
-nikss_port_spec_t * nikss_port_list_get_next_port(nikss_port_list_t *list)
+/* Kernel does not report NUMA node of a map, so it is saved for tuples which are created later */
+static int save_tuples_numa_node(nikss_context_t *ctx, struct bpf_object *obj, const char *table_name, int numa_node)
 {
-    if (list == NULL) {
-        return NULL;
+    char name[256];
+    char pinned_file[256];
+
+    snprintf(name, sizeof(name), "%s_tuple", table_name);
+    if (bpf_object__find_map_by_name(obj, name) == NULL) {
+        return 0;
     }
-    if (list->iface_list == NULL) {
-        return NULL;
+
+    snprintf(name, sizeof(name), "%s%s", table_name, TUPLES_NUMA_NODE_SUFFIX);
+    struct bpf_create_map_attr attr = {
+            .name = TUPLES_NUMA_NODE_SUFFIX + 1,
+            .map_type = BPF_MAP_TYPE_ARRAY,
+            .key_size = sizeof(uint32_t),
+            .value_size = sizeof(uint32_t),
+            .max_entries = 1,
+    };
+    int fd = bpf_create_map_xattr(&attr);
+    if (fd < 0) {
+        return -errno;
     }
 
-    bool iface_found = false;
+    int ret = 0;
+    uint32_t key = 0;
+    uint32_t node = (uint32_t) numa_node;
+    build_ebpf_prog_filename(pinned_file, sizeof(pinned_file), ctx, name);
+    /* Node given explicitly replaces the inherited one */
+    unlink(pinned_file);
+    if (bpf_map_update_elem(fd, &key, &node, BPF_ANY) != 0 || bpf_obj_pin(fd, pinned_file) != 0) {
+        ret = -errno;
+        fprintf(stderr, "failed to save NUMA node of %s tuples: %s\n", table_name, strerror(-ret));
+    }
+    close_object_fd(&fd);
 
-    while (!iface_found) {
-        if (list->current_iface == NULL) {
-            list->current_iface = list->iface_list;
-        } else {
-            list->current_iface = ((struct if_nameindex *) list->current_iface) + 1;
+    return ret;
+}
+
+static int save_tuples_numa_nodes(nikss_context_t *ctx, struct bpf_object *obj, const nikss_pipeline_load_opts_t *opts,
+                                  nikss_context_t *old_ctx)
+{
+    struct bpf_map *map = NULL;
+    char table_name[256];
+
+    /* Tuples created later by the new pipeline are placed on the same node as before */
+    bpf_object__for_each_map(map, obj) {
+        const char *map_name = bpf_map__name(map);
+        if (old_ctx == NULL || !get_table_of_tuple(map_name, table_name, sizeof(table_name)) ||
+            !is_tuples_map_of_table(map_name, table_name)) {
+            continue;
+        }
+        int node = read_tuples_numa_node(old_ctx, table_name);
+        int ret = node >= 0 ? save_tuples_numa_node(ctx, obj, table_name, node) : 0;
+        if (ret != 0) {
+            return ret;
         }
+    }
 
-        list->current_port.id = ((struct if_nameindex *) list->current_iface)->if_index;
-        list->current_port.name = ((struct if_nameindex *) list->current_iface)->if_name;
+    for (size_t i = 0; opts != NULL && i < opts->n_map_overrides; i++) {
+        if (opts->map_overrides[i].numa_node < 0) {
+            continue;
+        }
+        int ret = save_tuples_numa_node(ctx, obj, opts->map_overrides[i].name, opts->map_overrides[i].numa_node);
+        if (ret != 0) {
+            return ret;
+        }
+    }
 
-        if (list->current_port.id == 0 || list->current_port.name == NULL) {
-            /* End of the list */
-            list->current_iface = NULL;
-            return NULL;
+    return 0;
+}
+
+int nikss_pipeline_load_with_stats(nikss_context_t *ctx, const char *file, nikss_pipeline_load_stats_t *stats)
+{
+    return nikss_pipeline_load_with_opts(ctx, file, NULL, stats);
+}
+
+/* Definitions of maps of old_ctx pipeline, if given, are kept; explicit overrides are applied after them */
+static int load_pipeline(nikss_context_t *ctx, const char *file, const nikss_pipeline_load_opts_t *opts,
+                         nikss_pipeline_load_stats_t *stats, nikss_context_t *old_ctx)
+{
+    struct bpf_object *obj = NULL;
+    int ret = 0;
+    int fd = -1;
+    char pinned_file[256];
+    struct bpf_program *pos = NULL;
+    struct tuples_map_registry tuples_maps = {0};
+    nikss_pipeline_load_stats_t local_stats;
+    struct timespec phase_start;
+    struct timespec load_start;
+
+    if (stats == NULL) {
+        stats = &local_stats;
+    }
+    memset(stats, 0, sizeof(nikss_pipeline_load_stats_t));
+    clock_gettime(CLOCK_MONOTONIC, &load_start);
+    phase_start = load_start;
+
+    /* Objects cached in context will be replaced */
+    free_context_cache(ctx);
+
+    /* Open and load are done separately (as bpf_prog_load() would do) to measure them */
+    obj = bpf_object__open_file(file, NULL);
+    if (libbpf_get_error(obj) != 0) {
+        ret = (int) -libbpf_get_error(obj);
+        fprintf(stderr, "cannot open the BPF program: %s\n", strerror(ret));
+        return ret;
+    }
+    stats->object_open_ns = elapsed_ns_since(&phase_start);
+
+    ret = inherit_map_definitions(obj, old_ctx);
+    if (ret == 0) {
+        ret = apply_map_overrides(obj, opts);
+    }
+    if (ret < 0) {
+        goto err_close_obj;
+    }
+
+    ret = bpf_object__load(obj);
+    /* Do not close fd of programs, they are maintained by obj */
+    if (ret < 0) {
+        fprintf(stderr, "cannot load the BPF program: %s\n", strerror(-ret));
+        goto err_close_obj;
+    }
+    stats->object_load_ns = elapsed_ns_since(&phase_start);
+
+    bpf_object__for_each_program(pos, obj) {
+        const char *sec_name = bpf_program__section_name(pos);
+        char *pin_name = program_pin_name(pos);
+
+        build_ebpf_prog_filename(pinned_file, sizeof(pinned_file),
+                                 ctx, pin_name);
+        free(pin_name);
+
+        ret = bpf_program__pin(pos, pinned_file);
+        if (ret < 0) {
+            fprintf(stderr, "failed to pin %s at %s: %s\n",
+                    sec_name, pinned_file, strerror(-ret));
+            goto err_close_obj;
         }
+        stats->n_programs++;
+    }
+    stats->prog_pin_ns = elapsed_ns_since(&phase_start);
 
-        uint32_t prog_id = 0;
-        int ret = bpf_get_link_xdp_id((int) list->current_port.id, &prog_id, 0);
-        if (ret != 0 || prog_id == 0) {
+    struct bpf_map *map = NULL;
+    bpf_object__for_each_map(map, obj) {
+        if (bpf_map__is_pinned(map)) {
+            ret = bpf_map__unpin(map, NULL);
+            if (ret) {
+                fprintf(stderr, "failed to remove old map pin file: %s\n", strerror(-ret));
+                goto err_close_obj;
+            }
+        }
+
+        const char *map_name = bpf_map__name(map);
+
+        /* Pinned file name cannot contain a dot */
+        if (strstr(map_name, ".") != NULL) {
             continue;
         }
 
-        if (prog_id == list->xdp_prog_id) {
-            iface_found = true;
-            break;
+        build_ebpf_map_filename(pinned_file, sizeof(pinned_file), ctx, map_name);
+        ret = bpf_map__set_pin_path(map, pinned_file);
+        if (ret) {
+            fprintf(stderr, "failed to pin map at %s: %s\n", pinned_file, strerror(-ret));
+            goto err_close_obj;
+        }
+
+        ret = bpf_map__pin(map, pinned_file);
+        if (ret) {
+            fprintf(stderr, "failed to pin map at %s: %s\n", pinned_file, strerror(-ret));
+            goto err_close_obj;
         }
+        stats->n_maps++;
     }
+    ret = save_tuples_numa_nodes(ctx, obj, opts, old_ctx);
+    if (ret) {
+        goto err_close_obj;
+    }
+    stats->map_pin_ns = elapsed_ns_since(&phase_start);
 
-    if (!iface_found) {
-        return NULL;
+    bpf_object__for_each_map(map, obj) {
+        ret = join_tuple_to_map_if_tuple(obj, &tuples_maps, map, &stats->n_tuples);
+        if (ret) {
+            fprintf(stderr, "failed to add tuple (%s) to tuples map\n", bpf_map__name(map));
+            ret = -ret;
+            goto err_close_obj;
+        }
     }
-    return &list->current_port;
+    stats->tuples_ns = elapsed_ns_since(&phase_start);
+
+    bpf_object__for_each_program(pos, obj) {
+        const char *sec_name = bpf_program__section_name(pos);
+        fd = bpf_program__fd(pos);
+        if (!strcmp(sec_name, TC_INIT_PROG) || !strcmp(sec_name, XDP_INIT_PROG)) {
+            ret = do_initialize_maps(fd);
+            if (ret) {
+                ret = -errno;
+                fprintf(stderr, "failed to initialize maps: %s\n", strerror(errno));
+                goto err_close_obj;
+            }
+        }
+    }
+    stats->map_init_ns = elapsed_ns_since(&phase_start);
+    stats->total_ns = elapsed_ns_since(&load_start);
+
+err_close_obj:
+    free_tuples_map_registry(&tuples_maps);
+    bpf_object__close(obj);
+
+    /* ret is negative value from returned libbpf, but we should return positive ones */
+    return -ret;
 }
 
-const char * nikss_port_spec_get_name(nikss_port_spec_t *port)
+int nikss_pipeline_load_with_opts(nikss_context_t *ctx, const char *file, const nikss_pipeline_load_opts_t *opts,
+                                  nikss_pipeline_load_stats_t *stats)
 {
-    if (port == NULL) {
-        return NULL;
+    return load_pipeline(ctx, file, opts, stats, NULL);
+}
+
+int nikss_pipeline_load(nikss_context_t *ctx, const char *file)
+{
+    return nikss_pipeline_load_with_stats(ctx, file, NULL);
+}
+
+/* Removes everything from the directory in a single pass over its entries. Type of entry is taken
+ * from readdir(), so there is no stat() and path lookup for every pinned object. Directories on other
+ * filesystems than dev (mount points) are not entered, like with FTW_MOUNT. Takes ownership of dir_fd. */
+static int remove_directory_content(int dir_fd, dev_t dev)
+{
+    DIR *directory = fdopendir(dir_fd);
+    if (directory == NULL) {
+        int err = errno;
+        close(dir_fd);
+        return err;
+    }
+
+    struct dirent *file = NULL;
+    while ((file = readdir(directory)) != NULL) {
+        const char *name = file->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+
+        /* Ignore any error and continue, like for regular files */
+        if (file->d_type != DT_DIR && unlinkat(dirfd(directory), name, 0) == 0) {
+            continue;
+        }
+        if (file->d_type != DT_DIR && file->d_type != DT_UNKNOWN) {
+            continue;
+        }
+
+        struct stat sub_dir_stat;
+        int sub_dir_fd = openat(dirfd(directory), name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (sub_dir_fd < 0) {
+            continue;
+        }
+        if (fstat(sub_dir_fd, &sub_dir_stat) != 0 || sub_dir_stat.st_dev != dev) {
+            close(sub_dir_fd);
+            continue;
+        }
+        remove_directory_content(sub_dir_fd, dev);
+        unlinkat(dirfd(directory), name, AT_REMOVEDIR);
+    }
+
+    closedir(directory);
+    return NO_ERROR;
+}
+
+static int remove_pipeline_directory(nikss_context_t *ctx)
+{
+    char pipeline_path[256];
+    build_ebpf_pipeline_path(pipeline_path, sizeof(pipeline_path), ctx);
+
+    /* Entries unlinked during readdir() may make it skip others, and pins may be added concurrently,
+     * so the directory is read again while it is not empty. */
+    int err = ENOTEMPTY;
+    for (unsigned attempt = 0; err == ENOTEMPTY && attempt < 3; attempt++) {
+        struct stat dir_stat;
+        int dir_fd = open(pipeline_path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (dir_fd < 0) {
+            err = errno;
+            break;
+        }
+        if (fstat(dir_fd, &dir_stat) != 0) {
+            err = errno;
+            close(dir_fd);
+            break;
+        }
+
+        err = remove_directory_content(dir_fd, dir_stat.st_dev);
+        if (err == NO_ERROR && rmdir(pipeline_path) != 0) {
+            err = errno;
+        }
+    }
+
+    if (err != NO_ERROR) {
+        fprintf(stderr, "failed to remove pipeline directory: %s\n", strerror(err));
+    }
+
+    return err;
+}
+
+int nikss_pipeline_unload(nikss_context_t *ctx)
+{
+    /* TODO: Should we scan all interfaces to detect if it uses current pipeline programs and detach it? */
+
+    free_context_cache(ctx);
+    /* Cached BTF would keep BTF of removed programs in kernel */
+    invalidate_btf_cache();
+
+    return remove_pipeline_directory(ctx);
+}
+
+/* Ports registry: ifindex -> port flags (unused yet), so ports can be listed without scanning all interfaces */
+#define PORTS_REGISTRY_SIZE 65536
+
+static int open_ports_registry(nikss_context_t *ctx, bool create, bool *created)
+{
+    char pinned_file[256];
+    build_ebpf_prog_filename(pinned_file, sizeof(pinned_file), ctx, PORTS_REGISTRY);
+
+    int fd = bpf_obj_get(pinned_file);
+    if (fd >= 0 || errno != ENOENT || !create) {
+        return fd;
+    }
+
+    struct bpf_create_map_attr attr = {
+            .name = PORTS_REGISTRY,
+            .map_type = BPF_MAP_TYPE_HASH,
+            .map_flags = BPF_F_NO_PREALLOC,
+            .key_size = sizeof(uint32_t),
+            .value_size = sizeof(uint32_t),
+            .max_entries = PORTS_REGISTRY_SIZE,
+    };
+    fd = bpf_create_map_xattr(&attr);
+    if (fd < 0) {
+        return fd;
+    }
+
+    if (bpf_obj_pin(fd, pinned_file) != 0) {
+        int err = errno;
+        close_object_fd(&fd);
+        /* Created by someone else in the meantime */
+        if (err == EEXIST) {
+            return bpf_obj_get(pinned_file);
+        }
+        errno = err;
+        return -1;
+    }
+    *created = true;
+
+    return fd;
+}
+
+
+static int init_port_list(nikss_port_list_t *list, nikss_context_t *ctx, bool use_registry)
+{
+    int ret = NO_ERROR;
+    if (list == NULL || ctx == NULL) {
+        return EINVAL;
+    }
+
+    memset(list, 0, sizeof(nikss_port_list_t));
+    list->registry_fd = -1;
+
+    int fd = open_prog_by_name(ctx, XDP_HELPER_PROG);
+    if (fd < 0) {
+        /* XDP helper not found, try XDP ingress program */
+        fd = open_prog_by_name(ctx, XDP_INGRESS_PROG);
+    }
+
+    if (fd < 0) {
+        ret = errno;
+        fprintf(stderr, "failed to open pipeline program: %s\n", strerror(ret));
+        return ret;
+    }
+
+    struct bpf_prog_info prog_info = {};
+    unsigned len = sizeof(struct bpf_prog_info);
+    if (bpf_obj_get_info_by_fd(fd, &prog_info, &len) != 0) {
+        ret = errno;
+        fprintf(stderr, "failed to get BPF program info: %s\n", strerror(ret));
+        goto free_program;
+    }
+
+    list->xdp_prog_id = prog_info.id;
+
+    /* Ports added by this library are registered, so there is no need to check every interface */
+    if (use_registry) {
+        list->registry_fd = open_ports_registry(ctx, false, NULL);
+        if (list->registry_fd >= 0) {
+            goto free_program;
+        }
+    }
+
+    list->iface_list = if_nameindex();
+    if (list->iface_list == NULL) {
+        ret = errno;
+    }
+
+free_program:
+    close(fd);
+    return ret;
+}
+
+int nikss_port_list_init(nikss_port_list_t *list, nikss_context_t *ctx)
+{
+    return init_port_list(list, ctx, true);
+}
+
+void nikss_port_list_free(nikss_port_list_t *list)
+{
+    if (list == NULL) {
+        return;
+    }
+
+    if (list->iface_list != NULL) {
+        if_freenameindex(list->iface_list);
+    }
+    if (list->registry_fd >= 0) {
+        close_object_fd(&list->registry_fd);
+    }
+
+    list->iface_list = NULL;
+    list->current_iface = NULL;
+}
+
+static nikss_port_spec_t * get_next_registered_port(nikss_port_list_t *list)
+{
+    uint32_t next_key = 0;
+    bool stale = false;
+
+    /* Interfaces removed from the host or detached from the pipeline in the meantime (e.g. by other
+     * tools or by a reboot) are removed from the registry, but only after the iteration moved past them */
+    while (bpf_map_get_next_key(list->registry_fd, list->has_registry_key ? &list->registry_key : NULL,
+                                &next_key) == 0) {
+        if (stale) {
+            bpf_map_delete_elem(list->registry_fd, &list->registry_key);
+        }
+        list->registry_key = next_key;
+        list->has_registry_key = true;
+
+        uint32_t prog_id = 0;
+        stale = bpf_get_link_xdp_id((int) next_key, &prog_id, 0) != 0 || prog_id != list->xdp_prog_id ||
+                if_indextoname(next_key, list->current_name) == NULL;
+        if (!stale) {
+            list->current_port.id = next_key;
+            list->current_port.name = list->current_name;
+            return &list->current_port;
+        }
+    }
+    if (stale) {
+        bpf_map_delete_elem(list->registry_fd, &list->registry_key);
+    }
+
+    return NULL;
+}
+
+nikss_port_spec_t * nikss_port_list_get_next_port(nikss_port_list_t *list)
+{
+    if (list == NULL) {
+        return NULL;
+    }
+    if (list->registry_fd >= 0) {
+        return get_next_registered_port(list);
+    }
+    if (list->iface_list == NULL) {
+        return NULL;
+    }
+
+    bool iface_found = false;
+
+    while (!iface_found) {
+        if (list->current_iface == NULL) {
+            list->current_iface = list->iface_list;
+        } else {
+            list->current_iface = ((struct if_nameindex *) list->current_iface) + 1;
+        }
+
+        list->current_port.id = ((struct if_nameindex *) list->current_iface)->if_index;
+        list->current_port.name = ((struct if_nameindex *) list->current_iface)->if_name;
+
+        if (list->current_port.id == 0 || list->current_port.name == NULL) {
+            /* End of the list */
+            list->current_iface = NULL;
+            return NULL;
+        }
+
+        uint32_t prog_id = 0;
+        int ret = bpf_get_link_xdp_id((int) list->current_port.id, &prog_id, 0);
+        if (ret != 0 || prog_id == 0) {
+            continue;
+        }
+
+        if (prog_id == list->xdp_prog_id) {
+            iface_found = true;
+            break;
+        }
+    }
+
+    if (!iface_found) {
+        return NULL;
+    }
+    return &list->current_port;
+}
+
+static void update_ports_registry(nikss_context_t *ctx, int ifindex, bool add)
+{
+    bool created = false;
+    int fd = open_ports_registry(ctx, add, &created);
+    if (fd < 0) {
+        /* Ports will be still found by scanning interfaces */
+        if (add) {
+            fprintf(stderr, "warning: failed to register port: %s\n", strerror(errno));
+        }
+        return;
+    }
+
+    uint32_t key = (uint32_t) ifindex;
+    uint32_t value = 0;
+
+    /* Ports added before the registry existed are found once by scanning interfaces */
+    if (created) {
+        nikss_port_list_t list;
+        if (init_port_list(&list, ctx, false) == NO_ERROR) {
+            nikss_port_spec_t *port = NULL;
+            while ((port = nikss_port_list_get_next_port(&list)) != NULL) {
+                key = port->id;
+                bpf_map_update_elem(fd, &key, &value, BPF_ANY);
+            }
+        }
+        nikss_port_list_free(&list);
+        key = (uint32_t) ifindex;
+    }
+
+    if (add) {
+        bpf_map_update_elem(fd, &key, &value, BPF_ANY);
+    } else {
+        bpf_map_delete_elem(fd, &key);
+    }
+    close_object_fd(&fd);
+}
+
+int nikss_pipeline_add_port(nikss_context_t *ctx, const char *interface, int *port_id)
+{
+    return nikss_pipeline_add_ports(ctx, &interface, 1, port_id);
+}
+
+int nikss_pipeline_add_ports(nikss_context_t *ctx, const char *interfaces[], size_t n_interfaces, int *port_ids)
+{
+    struct port_attach_objects objs;
+    int first_error = NO_ERROR;
+
+    if (ctx == NULL || (interfaces == NULL && n_interfaces > 0)) {
+        return EINVAL;
+    }
+
+    int ret = open_port_attach_objects(ctx, &objs);
+    if (ret != NO_ERROR) {
+        close_port_attach_objects(&objs);
+        return ret;
+    }
+
+    /* Failure on one port does not prevent adding other ports */
+    for (size_t i = 0; i < n_interfaces; i++) {
+        int ifindex = (int) if_nametoindex(interfaces[i]);
+        if (!ifindex) {
+            fprintf(stderr, "no such interface: %s\n", interfaces[i]);
+            ret = ENODEV;
+        } else {
+            ret = attach_port(&objs, interfaces[i], ifindex);
+        }
+
+        if (ret == NO_ERROR) {
+            update_ports_registry(ctx, ifindex, true);
+        }
+        if (port_ids != NULL) {
+            port_ids[i] = ret == NO_ERROR ? ifindex : 0;
+        }
+        if (ret != NO_ERROR && first_error == NO_ERROR) {
+            first_error = ret;
+        }
+    }
+
+    close_port_attach_objects(&objs);
+
+    return first_error;
+}
+
+int nikss_pipeline_del_port(nikss_context_t *ctx, const char *interface)
+{
+    __u32 flags = 0;
+    int ifindex = 0;
+
+    ifindex = (int) if_nametoindex(interface);
+    if (!ifindex) {
+        fprintf(stderr, "no such interface: %s\n", interface);
+        return ENODEV;
+    }
+
+    int ret = bpf_set_link_xdp_fd(ifindex, -1, flags);
+    if (ret) {
+        fprintf(stderr, "failed to detach XDP program: %s\n", strerror(-ret));
+        return -ret;
+    }
+
+    DECLARE_LIBBPF_OPTS(bpf_tc_hook, hook,
+                        .ifindex = ifindex,
+                        .attach_point = BPF_TC_INGRESS | BPF_TC_EGRESS);
+    if (bpf_tc_hook_destroy(&hook) != 0) {
+        ret = errno;
+        /* Ignore error when qdisc does not exist, e.g. for XDP dummy program */
+        if (ret != ENOENT) {
+            fprintf(stderr, "failed to detach TC program from %s: %s\n", interface, strerror(ret));
+            return ret;
+        }
+    }
+
+    update_ports_registry(ctx, ifindex, false);
+
+    return NO_ERROR;
+}
+
+const char * nikss_port_spec_get_name(nikss_port_spec_t *port)
+{
+    if (port == NULL) {
+        return NULL;
+    }
+
+    return port->name;
+}
+
+unsigned nikss_port_sepc_get_id(nikss_port_spec_t *port)
+{
+    if (port == NULL) {
+        return 0;
+    }
+
+    return port->id;
+}
+
+void nikss_port_spec_free(nikss_port_spec_t *port)
+{
+    (void) port;
+}
+
+/*
+ * Pipeline replace: new program is loaded as a shadow pipeline, state is migrated from maps
+ * of the running pipeline and then programs are exchanged on every port without detaching them.
+ */
+
+static int find_free_pipeline_id(nikss_context_t *ctx, nikss_pipeline_id_t *id)
+{
+    nikss_context_t probe;
+    nikss_context_init(&probe);
+
+    int ret = ENOSPC;
+    nikss_pipeline_id_t candidate = nikss_context_get_pipeline(ctx);
+    for (unsigned i = 0; i < 1024; i++) {
+        candidate++;
+        nikss_context_set_pipeline(&probe, candidate);
+        if (candidate != nikss_context_get_pipeline(ctx) && !nikss_pipeline_exists(&probe)) {
+            *id = candidate;
+            ret = NO_ERROR;
+            break;
+        }
+    }
+
+    nikss_context_free(&probe);
+    return ret;
+}
+
+static bool btf_types_are_compatible(struct btf *a, uint32_t a_id, struct btf *b, uint32_t b_id, unsigned depth)
+{
+    if (depth > 32) {
+        return false;
+    }
+
+    const struct btf_type *ta = btf_get_type_by_id(a, a_id);
+    const struct btf_type *tb = btf_get_type_by_id(b, b_id);
+    if (ta == NULL || tb == NULL) {
+        return ta == tb;
+    }
+
+    if (btf_kind(ta) != btf_kind(tb) || btf_vlen(ta) != btf_vlen(tb) ||
+        btf_get_type_size_by_id(a, a_id) != btf_get_type_size_by_id(b, b_id)) {
+        return false;
+    }
+
+    switch (btf_kind(ta)) {
+        case BTF_KIND_STRUCT:
+        case BTF_KIND_UNION: {
+            const struct btf_member *ma = btf_members(ta);
+            const struct btf_member *mb = btf_members(tb);
+            for (unsigned i = 0; i < btf_vlen(ta); i++) {
+                if (ma[i].offset != mb[i].offset ||
+                    strcmp(btf__name_by_offset(a, ma[i].name_off), btf__name_by_offset(b, mb[i].name_off)) != 0) {
+                    return false;
+                }
+                if (!btf_types_are_compatible(a, ma[i].type, b, mb[i].type, depth + 1)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        case BTF_KIND_ARRAY:
+            if (btf_array(ta)->nelems != btf_array(tb)->nelems) {
+                return false;
+            }
+            return btf_types_are_compatible(a, btf_array(ta)->type, b, btf_array(tb)->type, depth + 1);
+
+        default:
+            /* integers and enums, size is already compared */
+            return true;
+    }
+}
+
+static bool maps_are_compatible(const char *name, nikss_bpf_map_descriptor_t *old_map, nikss_btf_t *old_btf,
+                                nikss_bpf_map_descriptor_t *new_map, nikss_btf_t *new_btf)
+{
+    if (old_map->type != new_map->type || old_map->key_size != new_map->key_size ||
+        old_map->value_size != new_map->value_size) {
+        fprintf(stderr, "map %s: definition changed, not migrated\n", name);
+        return false;
+    }
+
+    /* Without BTF only layout of map can be compared */
+    if (old_btf->btf == NULL || new_btf->btf == NULL) {
+        return true;
+    }
+
+    if (!btf_types_are_compatible(old_btf->btf, old_map->key_type_id, new_btf->btf, new_map->key_type_id, 0) ||
+        !btf_types_are_compatible(old_btf->btf, old_map->value_type_id, new_btf->btf, new_map->value_type_id, 0)) {
+        fprintf(stderr, "map %s: key or value type changed, not migrated\n", name);
+        return false;
+    }
+
+    return true;
+}
+
+static int migrate_map_entries(const char *name, nikss_bpf_map_descriptor_t *old_map,
+                               nikss_bpf_map_descriptor_t *new_map)
+{
+    bool map_in_map = old_map->type == BPF_MAP_TYPE_ARRAY_OF_MAPS || old_map->type == BPF_MAP_TYPE_HASH_OF_MAPS;
+    size_t value_size = get_map_value_buffer_size(old_map);
+    char *key = malloc(old_map->key_size);
+    char *next_key = malloc(old_map->key_size);
+    char *value = malloc(value_size);
+    unsigned n_entries = 0;
+    unsigned n_failed = 0;
+    int first_err = NO_ERROR;
+    int ret = NO_ERROR;
+
+    if (key == NULL || next_key == NULL || value == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        ret = ENOMEM;
+        goto clean_up;
+    }
+
+    if (bpf_map_get_next_key(old_map->fd, NULL, next_key) != 0) {
+        goto clean_up;  /* map empty */
+    }
+    do {
+        char *tmp_key = next_key;
+        next_key = key;
+        key = tmp_key;
+
+        if (bpf_map_lookup_elem(old_map->fd, key, value) != 0) {
+            continue;
+        }
+
+        /* Lookup returns ID of the inner map, but update requires its fd; inner map is shared, not copied */
+        int inner_fd = -1;
+        if (map_in_map) {
+            inner_fd = bpf_map_get_fd_by_id(*((uint32_t *) value));
+            if (inner_fd < 0) {
+                first_err = first_err != NO_ERROR ? first_err : errno;
+                n_failed++;
+                continue;
+            }
+            memcpy(value, &inner_fd, sizeof(inner_fd));
+        }
+
+        if (bpf_map_update_elem(new_map->fd, key, value, BPF_ANY) != 0) {
+            first_err = first_err != NO_ERROR ? first_err : errno;
+            n_failed++;
+        } else {
+            n_entries++;
+        }
+        close_object_fd(&inner_fd);
+    } while (bpf_map_get_next_key(old_map->fd, key, next_key) == 0);
+
+    /* Entries would be lost, so replace must not continue */
+    if (n_failed > 0) {
+        fprintf(stderr, "map %s: failed to migrate %u entries: %s\n", name, n_failed, strerror(first_err));
+        ret = first_err != NO_ERROR ? first_err : EIO;
+    }
+
+clean_up:
+    if (key != NULL) {
+        free(key);
+    }
+    if (next_key != NULL) {
+        free(next_key);
+    }
+    if (value != NULL) {
+        free(value);
+    }
+
+    return ret;
+}
+
+/* CPUMAP entries refer to the program of the pipeline, so only queue sizes are copied */
+static int migrate_cpumap(nikss_context_t *old_ctx, nikss_context_t *new_ctx)
+{
+    uint32_t n_cpus = nikss_pipeline_cpumap_size(old_ctx);
+    uint32_t new_n_cpus = nikss_pipeline_cpumap_size(new_ctx);
+
+    for (uint32_t cpu = 0; cpu < n_cpus && cpu < new_n_cpus; cpu++) {
+        nikss_cpumap_entry_t entry;
+        int ret = nikss_pipeline_cpumap_get(old_ctx, cpu, &entry);
+        if (ret == NO_ERROR && entry.qsize > 0) {
+            ret = nikss_pipeline_cpumap_set(new_ctx, cpu, entry.qsize);
+        }
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+static int migrate_pipeline_maps(nikss_context_t *old_ctx, nikss_context_t *new_ctx)
+{
+    char maps_path[256];
+    nikss_btf_t old_btf;
+    nikss_btf_t new_btf;
+    int ret = NO_ERROR;
+
+    init_btf(&old_btf);
+    init_btf(&new_btf);
+    int btf_err = load_btf(old_ctx, &old_btf);
+    if (btf_err == NO_ERROR) {
+        btf_err = load_btf(new_ctx, &new_btf);
+    }
+    if (btf_err != NO_ERROR) {
+        fprintf(stderr, "warning: BTF not available, maps are compared only by their definition\n");
+    }
+
+    build_ebpf_map_filename(maps_path, sizeof(maps_path), old_ctx, "");
+    DIR *directory = opendir(maps_path);
+    if (directory == NULL) {
+        ret = errno;
+        fprintf(stderr, "failed to open maps of the pipeline: %s\n", strerror(ret));
+        goto clean_up;
+    }
+
+    struct dirent *file = NULL;
+    while ((file = readdir(directory)) != NULL) {
+        const char *name = file->d_name;
+        if (name[0] == '.') {
+            continue;
+        }
+
+        nikss_bpf_map_descriptor_t old_map = { .fd = -1 };
+        nikss_bpf_map_descriptor_t new_map = { .fd = -1 };
+        if (open_bpf_map(old_ctx, name, &old_btf, &old_map) != NO_ERROR) {
+            continue;
+        }
+        if (open_bpf_map(new_ctx, name, &new_btf, &new_map) != NO_ERROR) {
+            fprintf(stderr, "map %s: not present in the new pipeline\n", name);
+            close_object_fd(&old_map.fd);
+            continue;
+        }
+
+        if (is_pipeline_state_map(name, old_map.type) &&
+            maps_are_compatible(name, &old_map, &old_btf, &new_map, &new_btf)) {
+            ret = migrate_map_entries(name, &old_map, &new_map);
+        }
+
+        close_object_fd(&old_map.fd);
+        close_object_fd(&new_map.fd);
+        if (ret != NO_ERROR) {
+            break;
+        }
+    }
+
+    closedir(directory);
+
+    if (ret == NO_ERROR) {
+        ret = migrate_cpumap(old_ctx, new_ctx);
+    }
+
+clean_up:
+    free_btf(&old_btf);
+    free_btf(&new_btf);
+
+    return ret;
+}
+
+static int xdp_replace_prog_on_port(nikss_context_t *ctx, int ifindex, const char *interface, const char *prog)
+{
+    struct xdp_link_info info;
+    memset(&info, 0, sizeof(info));
+
+    int ret = bpf_get_link_xdp_info(ifindex, &info, sizeof(info), 0);
+    if (ret < 0) {
+        fprintf(stderr, "failed to get XDP program of %s: %s\n", interface, strerror(-ret));
+        return -ret;
+    }
+
+    /* New program must be attached in the same mode as the current one */
+    __u32 flags = XDP_FLAGS_REPLACE;
+    switch (info.attach_mode) {
+        case XDP_ATTACHED_DRV:
+            flags |= XDP_FLAGS_DRV_MODE;
+            break;
+        case XDP_ATTACHED_SKB:
+            flags |= XDP_FLAGS_SKB_MODE;
+            break;
+        case XDP_ATTACHED_HW:
+            flags |= XDP_FLAGS_HW_MODE;
+            break;
+        default:
+            fprintf(stderr, "unsupported XDP attach mode on %s\n", interface);
+            return ENOTSUP;
+    }
+
+    int old_fd = bpf_prog_get_fd_by_id(info.prog_id);
+    if (old_fd < 0) {
+        ret = errno;
+        fprintf(stderr, "failed to open current XDP program of %s: %s\n", interface, strerror(ret));
+        return ret;
+    }
+    int new_fd = open_prog_by_name(ctx, prog);
+    if (new_fd < 0) {
+        ret = errno;
+        fprintf(stderr, "failed to open program %s: %s\n", prog, strerror(ret));
+        close_object_fd(&old_fd);
+        return ret;
+    }
+
+    DECLARE_LIBBPF_OPTS(bpf_xdp_set_link_opts, opts,
+                        .old_fd = old_fd);
+    ret = bpf_set_link_xdp_fd_opts(ifindex, new_fd, flags, &opts);
+    if (ret < 0) {
+        ret = -ret;
+        fprintf(stderr, "failed to replace XDP program on %s: %s\n", interface, strerror(ret));
+    }
+
+    close_object_fd(&old_fd);
+    close_object_fd(&new_fd);
+
+    return ret;
+}
+
+static int replace_port_programs(nikss_context_t *new_ctx, const char *interface, int ifindex, bool is_tc_based)
+{
+    int ret = NO_ERROR;
+
+    /* Egress is prepared first, so packets from the new ingress never reach old egress programs */
+    if (!is_tc_based) {
+        ret = xdp_port_setup_egress(new_ctx, interface, ifindex);
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+    }
+
+    ret = tc_attach_prog(new_ctx, TC_EGRESS_PROG, ifindex, BPF_TC_EGRESS, interface, true);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+    ret = tc_attach_prog(new_ctx, TC_INGRESS_PROG, ifindex, BPF_TC_INGRESS, interface, true);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+
+    return xdp_replace_prog_on_port(new_ctx, ifindex, interface,
+                                    is_tc_based ? XDP_HELPER_PROG : XDP_INGRESS_PROG);
+}
+
+static int replace_pipeline_ports(nikss_context_t *old_ctx, nikss_context_t *new_ctx)
+{
+    nikss_port_list_t list;
+    int ret = nikss_port_list_init(&list, old_ctx);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+
+    bool is_tc_based = nikss_pipeline_is_TC_based(new_ctx);
+    if (is_tc_based != nikss_pipeline_is_TC_based(old_ctx)) {
+        fprintf(stderr, "can't replace TC-based pipeline with XDP-based one or vice versa\n");
+        nikss_port_list_free(&list);
+        return ENOTSUP;
+    }
+
+    /* List of ports is based on XDP program ID, so collect them all before any change */
+    size_t n_ports = 0;
+    struct if_nameindex *ports = NULL;
+    nikss_port_spec_t *port = NULL;
+    while ((port = nikss_port_list_get_next_port(&list)) != NULL) {
+        struct if_nameindex *tmp = realloc(ports, (n_ports + 1) * sizeof(struct if_nameindex));
+        if (tmp == NULL) {
+            ret = ENOMEM;
+            goto clean_up;
+        }
+        ports = tmp;
+        ports[n_ports].if_index = port->id;
+        ports[n_ports].if_name = strdup(port->name);
+        if (ports[n_ports].if_name == NULL) {
+            ret = ENOMEM;
+            goto clean_up;
+        }
+        n_ports++;
+        nikss_port_spec_free(port);
+    }
+
+    for (size_t i = 0; i < n_ports; i++) {
+        ret = replace_port_programs(new_ctx, ports[i].if_name, (int) ports[i].if_index, is_tc_based);
+        if (ret != NO_ERROR) {
+            fprintf(stderr, "failed to replace pipeline on port %s\n", ports[i].if_name);
+            break;
+        }
+        update_ports_registry(new_ctx, (int) ports[i].if_index, true);
+    }
+
+clean_up:
+    if (ret == ENOMEM) {
+        fprintf(stderr, "not enough memory\n");
+    }
+    for (size_t i = 0; i < n_ports; i++) {
+        free(ports[i].if_name);
+    }
+    if (ports != NULL) {
+        free(ports);
+    }
+    nikss_port_list_free(&list);
+
+    return ret;
+}
+
+int nikss_pipeline_replace(nikss_context_t *ctx, const char *file)
+{
+    char pipeline_path[256];
+    char shadow_path[256];
+    nikss_pipeline_id_t shadow_id = 0;
+    nikss_context_t shadow_ctx;
+    bool ports_swapped = false;
+
+    if (ctx == NULL || file == NULL) {
+        return EINVAL;
+    }
+    if (!nikss_pipeline_exists(ctx)) {
+        return ENOENT;
+    }
+
+    int ret = find_free_pipeline_id(ctx, &shadow_id);
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "no free pipeline id for the new pipeline\n");
+        return ret;
+    }
+
+    nikss_context_init(&shadow_ctx);
+    nikss_context_set_pipeline(&shadow_ctx, shadow_id);
+    build_ebpf_pipeline_path(pipeline_path, sizeof(pipeline_path), ctx);
+    build_ebpf_pipeline_path(shadow_path, sizeof(shadow_path), &shadow_ctx);
+
+    /* Sizes and flags given at load of the running pipeline are kept, so its entries fit into new maps */
+    ret = load_pipeline(&shadow_ctx, file, NULL, NULL, ctx);
+    if (ret != NO_ERROR) {
+        goto clean_up;
+    }
+
+    ret = migrate_pipeline_maps(ctx, &shadow_ctx);
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to migrate state of the pipeline: %s\n", strerror(ret));
+        goto clean_up;
+    }
+
+    /* From here on new pipeline handles traffic on (some) ports */
+    ports_swapped = true;
+    ret = replace_pipeline_ports(ctx, &shadow_ctx);
+    if (ret != NO_ERROR) {
+        goto clean_up;
+    }
+
+    /* New pipeline takes over ID of the old one; attached programs are not affected by that */
+    free_context_cache(&shadow_ctx);
+    ret = nikss_pipeline_unload(ctx);
+    if (ret == NO_ERROR && rename(shadow_path, pipeline_path) != 0) {
+        ret = errno;
+    }
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to move new pipeline to id %u: %s\n", nikss_context_get_pipeline(ctx), strerror(ret));
+    }
+
+clean_up:
+    if (ret != NO_ERROR) {
+        if (ports_swapped) {
+            fprintf(stderr, "new pipeline is left as id %u\n", shadow_id);
+        } else {
+            nikss_pipeline_unload(&shadow_ctx);
+        }
+    }
+    nikss_context_free(&shadow_ctx);
+
+    return ret;
+}
+
+static int open_pipeline_prog(nikss_context_t *ctx)
+{
+    int fd = open_prog_by_name(ctx, XDP_HELPER_PROG);
+    if (fd < 0) {
+        /* XDP helper not found, try XDP ingress program */
+        fd = open_prog_by_name(ctx, XDP_INGRESS_PROG);
     }
 
-    return port->name;
+    return fd;
 }
 
-unsigned nikss_port_sepc_get_id(nikss_port_spec_t *port)
+uint64_t nikss_pipeline_get_load_time(nikss_context_t *ctx)
 {
-    if (port == NULL) {
+    int fd = open_pipeline_prog(ctx);
+    if (fd < 0) {
         return 0;
     }
 
-    return port->id;
-}
+    struct bpf_prog_info prog_info = {};
+    unsigned len = sizeof(struct bpf_prog_info);
+    uint64_t load_time = 0;
+    if (bpf_obj_get_info_by_fd(fd, &prog_info, &len) == 0) {
+        load_time = prog_info.load_time;
+    }
+    close(fd);
 
-void nikss_port_spec_free(nikss_port_spec_t *port)
-{
-    (void) port;
+    return load_time;
 }
 
 uint64_t nikss_pipeline_get_load_timestamp(nikss_context_t *ctx)
 {
     uint64_t load_timestamp = 0;
-    int fd = open_prog_by_name(ctx, XDP_HELPER_PROG);
-    if (fd < 0) {
-        /* XDP helper not found, try XDP ingress program */
-        fd = open_prog_by_name(ctx, XDP_INGRESS_PROG);
-    }
+    int fd = open_pipeline_prog(ctx);
 
     if (fd < 0) {
         fprintf(stderr, "failed to open pipeline program: %s\n", strerror(errno));
@@ -733,6 +1966,234 @@ bool nikss_pipeline_has_egress_program(nikss_context_t *ctx)
            check_if_program_exists(ctx, XDP_EGRESS_PROG_OPTIMIZED);
 }
 
+int nikss_pipeline_stats_enable(void)
+{
+    int fd = bpf_enable_stats(BPF_STATS_RUN_TIME);
+    if (fd < 0) {
+        int err = errno;
+        fprintf(stderr, "failed to enable BPF statistics: %s\n", strerror(err));
+        return -err;
+    }
+
+    return fd;
+}
+
+void nikss_pipeline_stats_disable(int stats_fd)
+{
+    close_object_fd(&stats_fd);
+}
+
+bool nikss_pipeline_stats_enabled_by_sysctl(void)
+{
+    FILE *f = fopen("/proc/sys/kernel/bpf_stats_enabled", "r");
+    int enabled = 0;
+
+    if (f == NULL) {
+        return false;
+    }
+    if (fscanf(f, "%d", &enabled) != 1) {
+        enabled = 0;
+    }
+    fclose(f);
+
+    return enabled != 0;
+}
+
+int nikss_pipeline_get_stats(nikss_context_t *ctx, nikss_pipeline_stats_t *stats)
+{
+    const char *programs[NIKSS_PIPELINE_MAX_PROGS] = {
+        TC_INGRESS_PROG, TC_EGRESS_PROG, XDP_HELPER_PROG,
+        XDP_INGRESS_PROG, XDP_EGRESS_PROG, XDP_EGRESS_PROG_OPTIMIZED,
+    };
+
+    if (ctx == NULL || stats == NULL) {
+        return EINVAL;
+    }
+
+    memset(stats, 0, sizeof(nikss_pipeline_stats_t));
+    for (int i = 0; i < NIKSS_PIPELINE_MAX_PROGS; i++) {
+        int fd = open_prog_by_name(ctx, programs[i]);
+        if (fd < 0) {
+            /* not every program exists in every pipeline */
+            continue;
+        }
+
+        struct bpf_prog_info prog_info = {};
+        unsigned len = sizeof(struct bpf_prog_info);
+        if (bpf_obj_get_info_by_fd(fd, &prog_info, &len) != 0) {
+            int err = errno;
+            fprintf(stderr, "failed to get BPF program info: %s\n", strerror(err));
+            close_object_fd(&fd);
+            return err;
+        }
+        close_object_fd(&fd);
+
+        nikss_pipeline_prog_stats_t *prog = &stats->progs[stats->n_progs++];
+        prog->name = programs[i];
+        prog->prog_id = prog_info.id;
+        prog->run_cnt = prog_info.run_cnt;
+        prog->run_time_ns = prog_info.run_time_ns;
+        prog->recursion_misses = prog_info.recursion_misses;
+    }
+
+    if (stats->n_progs == 0) {
+        return ENOENT;
+    }
+
+    return NO_ERROR;
+}
+
+uint32_t nikss_pipeline_cpumap_size(nikss_context_t *ctx)
+{
+    nikss_bpf_map_descriptor_t cpumap;
+
+    if (ctx == NULL || open_bpf_map(ctx, XDP_CPUMAP, NULL, &cpumap) != NO_ERROR) {
+        return 0;
+    }
+    close_object_fd(&cpumap.fd);
+
+    return cpumap.type == BPF_MAP_TYPE_CPUMAP ? cpumap.max_entries : 0;
+}
+
+static int open_cpumap(nikss_context_t *ctx, uint32_t cpu, nikss_bpf_map_descriptor_t *cpumap)
+{
+    int ret = open_bpf_map(ctx, XDP_CPUMAP, NULL, cpumap);
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to open CPUMAP: %s\n", strerror(ret));
+        return ret;
+    }
+
+    if (cpumap->type != BPF_MAP_TYPE_CPUMAP || cpumap->value_size < sizeof(uint32_t)) {
+        fprintf(stderr, "map %s is not a CPUMAP\n", XDP_CPUMAP);
+        close_object_fd(&cpumap->fd);
+        return EINVAL;
+    }
+    if (cpu >= cpumap->max_entries) {
+        fprintf(stderr, "CPU %u out of range, CPUMAP has %u entries\n", cpu, cpumap->max_entries);
+        close_object_fd(&cpumap->fd);
+        return ERANGE;
+    }
+
+    return NO_ERROR;
+}
+
+int nikss_pipeline_cpumap_set(nikss_context_t *ctx, uint32_t cpu, uint32_t qsize)
+{
+    nikss_bpf_map_descriptor_t cpumap;
+
+    if (ctx == NULL) {
+        return EINVAL;
+    }
+
+    int ret = open_cpumap(ctx, cpu, &cpumap);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+
+    if (qsize == 0) {
+        if (bpf_map_delete_elem(cpumap.fd, &cpu) != 0 && errno != ENOENT) {
+            ret = errno;
+            fprintf(stderr, "failed to disable CPU %u: %s\n", cpu, strerror(ret));
+        }
+        close_object_fd(&cpumap.fd);
+        return ret;
+    }
+
+    /* Older definitions of CPUMAP have only queue size in the value */
+    struct bpf_cpumap_val value = {
+            .qsize = qsize,
+            .bpf_prog.fd = -1,
+    };
+    if (cpumap.value_size >= sizeof(value)) {
+        /* may not exist, ignore errors */
+        value.bpf_prog.fd = open_prog_by_name(ctx, XDP_CPUMAP_PROG);
+    }
+
+    if (bpf_map_update_elem(cpumap.fd, &cpu, &value, BPF_ANY) != 0) {
+        ret = errno;
+        fprintf(stderr, "failed to set up CPU %u: %s\n", cpu, strerror(ret));
+    }
+    close_object_fd(&value.bpf_prog.fd);
+    close_object_fd(&cpumap.fd);
+
+    return ret;
+}
+
+/* Sums counters of the target CPU over all the source CPUs */
+static int read_cpumap_stats(nikss_context_t *ctx, nikss_cpumap_entry_t *entry)
+{
+    nikss_bpf_map_descriptor_t stats_map;
+    const size_t n_counters = 2;
+
+    if (open_bpf_map(ctx, XDP_CPUMAP_STATS, NULL, &stats_map) != NO_ERROR) {
+        /* optional */
+        return NO_ERROR;
+    }
+    if (stats_map.value_size < n_counters * sizeof(uint64_t) || entry->cpu >= stats_map.max_entries) {
+        close_object_fd(&stats_map.fd);
+        return NO_ERROR;
+    }
+
+    size_t n_slots = get_map_value_slots(&stats_map);
+    size_t slot_size = get_map_value_slot_size(&stats_map);
+    char *value = malloc(get_map_value_buffer_size(&stats_map));
+    if (value == NULL) {
+        close_object_fd(&stats_map.fd);
+        return ENOMEM;
+    }
+
+    int ret = NO_ERROR;
+    if (bpf_map_lookup_elem(stats_map.fd, &entry->cpu, value) != 0) {
+        ret = errno;
+        fprintf(stderr, "failed to read CPUMAP statistics: %s\n", strerror(ret));
+    } else {
+        for (size_t i = 0; i < n_slots; i++) {
+            uint64_t counters[2];
+            memcpy(counters, value + i * slot_size, sizeof(counters));
+            entry->enqueued += counters[0];
+            entry->received += counters[1];
+        }
+        /* Both counters are updated without synchronization, so received may be ahead */
+        entry->dropped = entry->enqueued > entry->received ? entry->enqueued - entry->received : 0;
+    }
+
+    free(value);
+    close_object_fd(&stats_map.fd);
+
+    return ret;
+}
+
+int nikss_pipeline_cpumap_get(nikss_context_t *ctx, uint32_t cpu, nikss_cpumap_entry_t *entry)
+{
+    nikss_bpf_map_descriptor_t cpumap;
+
+    if (ctx == NULL || entry == NULL) {
+        return EINVAL;
+    }
+    memset(entry, 0, sizeof(nikss_cpumap_entry_t));
+    entry->cpu = cpu;
+
+    int ret = open_cpumap(ctx, cpu, &cpumap);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+
+    struct bpf_cpumap_val value = {0};
+    if (bpf_map_lookup_elem(cpumap.fd, &cpu, &value) == 0) {
+        entry->qsize = value.qsize;
+    } else if (errno != ENOENT) {
+        ret = errno;
+        fprintf(stderr, "failed to read CPUMAP entry: %s\n", strerror(ret));
+    }
+    close_object_fd(&cpumap.fd);
+
+    if (ret == NO_ERROR) {
+        ret = read_cpumap_stats(ctx, entry);
+    }
+
+    return ret;
+}
+
 int nikss_pipeline_objects_list_init(nikss_pipeline_objects_list_t *list, nikss_context_t *ctx)
 {
     if (list == NULL || ctx == NULL) {
@@ -897,3 +2358,311 @@ void nikss_pipeline_object_free(nikss_pipeline_object_t *obj)
 {
     (void) obj;
 }
+
+static bool object_has_map(nikss_context_t *ctx, const char *name, const char *suffix)
+{
+    char path[512];
+    char map_name[300];
+
+    snprintf(map_name, sizeof(map_name), "%s%s", name, suffix);
+    build_ebpf_map_filename(path, sizeof(path), ctx, map_name);
+    return access(path, F_OK) == 0;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+nikss_pipeline_object_type_t nikss_pipeline_object_get_type(nikss_context_t *ctx, const char *name)
+{
+    if (ctx == NULL || name == NULL) {
+        return NIKSS_PIPELINE_OBJECT_UNKNOWN;
+    }
+
+    /* Objects with additional maps, ActionSelector has also "_defaultActionGroup" map */
+    if (object_has_map(ctx, name, "_actions")) {
+        return NIKSS_PIPELINE_OBJECT_ACTION_SELECTOR;
+    }
+    if (object_has_map(ctx, name, "_defaultAction") || object_has_map(ctx, name, "_prefixes")) {
+        return NIKSS_PIPELINE_OBJECT_TABLE;
+    }
+
+    nikss_pipeline_object_type_t type = NIKSS_PIPELINE_OBJECT_UNKNOWN;
+    nikss_bpf_map_descriptor_t md;
+    nikss_btf_t btf;
+    btf_struct_member_md_t member;
+
+    init_btf(&btf);
+    if (load_btf(ctx, &btf) != NO_ERROR) {
+        goto clean_up;
+    }
+    if (open_bpf_map(ctx, name, &btf, &md) != NO_ERROR) {
+        goto clean_up;
+    }
+
+    bool has_value_type = md.value_type_id != 0;
+    if (md.type == BPF_MAP_TYPE_QUEUE || md.type == BPF_MAP_TYPE_STACK) {
+        type = NIKSS_PIPELINE_OBJECT_DIGEST;
+    } else if (has_value_type && get_counter_type(&btf, md.value_type_id) != NIKSS_COUNTER_TYPE_UNKNOWN) {
+        type = NIKSS_PIPELINE_OBJECT_COUNTER;
+    } else if (has_value_type &&
+               btf_get_member_md_by_name(btf.btf, md.value_type_id, "pir_period", &member) == NO_ERROR) {
+        type = NIKSS_PIPELINE_OBJECT_METER;
+    } else if (md.type == BPF_MAP_TYPE_ARRAY || md.type == BPF_MAP_TYPE_PERCPU_ARRAY) {
+        type = NIKSS_PIPELINE_OBJECT_REGISTER;
+    }
+    close_object_fd(&md.fd);
+
+clean_up:
+    free_btf(&btf);
+
+    return type;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+const char * nikss_pipeline_object_type_to_str(nikss_pipeline_object_type_t type)
+{
+    switch (type) {
+        case NIKSS_PIPELINE_OBJECT_TABLE:
+            return "table";
+        case NIKSS_PIPELINE_OBJECT_ACTION_SELECTOR:
+            return "action-selector";
+        case NIKSS_PIPELINE_OBJECT_COUNTER:
+            return "counter";
+        case NIKSS_PIPELINE_OBJECT_METER:
+            return "meter";
+        case NIKSS_PIPELINE_OBJECT_REGISTER:
+            return "register";
+        case NIKSS_PIPELINE_OBJECT_DIGEST:
+            return "digest";
+        default:
+            return "unknown";
+    }
+}
+
+struct pipeline_dump_item {
+    nikss_pipeline_dump_object_t obj;
+    char name[256];
+    bool done;
+};
+
+struct pipeline_dump_state {
+    nikss_pipeline_id_t pipeline_id;
+    struct pipeline_dump_item *items;
+    size_t n_items;
+    /* Index of the next object to read, objects are taken in order so they are emitted early */
+    size_t next_item;
+    /* Objects taken by workers but not yet emitted are limited to window, so read data does not pile up */
+    size_t n_emitted;
+    size_t window;
+    bool stopped;
+    pthread_mutex_t lock;
+    pthread_cond_t item_done;
+    pthread_cond_t item_emitted;
+    nikss_pipeline_dump_read_cb_t read_cb;
+    void *arg;
+};
+
+static int compare_dump_items(const void *a, const void *b)
+{
+    return strcmp(((const struct pipeline_dump_item *) a)->name, ((const struct pipeline_dump_item *) b)->name);
+}
+
+static int collect_dump_items(nikss_context_t *ctx, struct pipeline_dump_state *state)
+{
+    nikss_pipeline_objects_list_t list;
+    size_t capacity = 0;
+
+    int ret = nikss_pipeline_objects_list_init(&list, ctx);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+
+    nikss_pipeline_object_t *obj = NULL;
+    while ((obj = nikss_pipeline_objects_list_get_next_object(&list)) != NULL) {
+        if (state->n_items == capacity) {
+            size_t new_capacity = capacity == 0 ? 64 : capacity * 2;
+            struct pipeline_dump_item *items = realloc(state->items, new_capacity * sizeof(*items));
+            if (items == NULL) {
+                ret = ENOMEM;
+                break;
+            }
+            state->items = items;
+            capacity = new_capacity;
+        }
+
+        struct pipeline_dump_item *item = &state->items[state->n_items++];
+        memset(item, 0, sizeof(*item));
+        snprintf(item->name, sizeof(item->name), "%s", nikss_pipeline_object_get_name(obj));
+        nikss_pipeline_object_free(obj);
+    }
+    nikss_pipeline_objects_list_free(&list);
+
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+
+    /* Directory order is random, so sort objects to get the same output every time */
+    if (state->n_items > 0) {
+        qsort(state->items, state->n_items, sizeof(state->items[0]), compare_dump_items);
+    }
+    for (size_t i = 0; i < state->n_items; i++) {
+        state->items[i].obj.name = state->items[i].name;
+    }
+
+    return NO_ERROR;
+}
+
+static void read_dump_item(nikss_context_t *ctx, struct pipeline_dump_state *state, struct pipeline_dump_item *item)
+{
+    item->obj.type = nikss_pipeline_object_get_type(ctx, item->name);
+    item->obj.error = state->read_cb(ctx, &item->obj, state->arg);
+}
+
+static void *pipeline_dump_worker(void *arg)
+{
+    struct pipeline_dump_state *state = arg;
+    nikss_context_t ctx;
+
+    nikss_context_init(&ctx);
+    nikss_context_set_pipeline(&ctx, state->pipeline_id);
+
+    while (true) {
+        pthread_mutex_lock(&state->lock);
+        while (!state->stopped && state->next_item < state->n_items &&
+               state->next_item - state->n_emitted >= state->window) {
+            pthread_cond_wait(&state->item_emitted, &state->lock);
+        }
+        if (state->stopped || state->next_item >= state->n_items) {
+            pthread_mutex_unlock(&state->lock);
+            break;
+        }
+        struct pipeline_dump_item *item = &state->items[state->next_item++];
+        pthread_mutex_unlock(&state->lock);
+
+        read_dump_item(&ctx, state, item);
+
+        pthread_mutex_lock(&state->lock);
+        item->done = true;
+        pthread_cond_broadcast(&state->item_done);
+        pthread_mutex_unlock(&state->lock);
+    }
+
+    nikss_context_free(&ctx);
+
+    return NULL;
+}
+
+static int dump_serially(nikss_context_t *ctx, struct pipeline_dump_state *state,
+                         nikss_pipeline_dump_emit_cb_t emit_cb)
+{
+    int ret = NO_ERROR;
+
+    for (size_t i = 0; i < state->n_items; i++) {
+        struct pipeline_dump_item *item = &state->items[i];
+        if (ret == NO_ERROR) {
+            read_dump_item(ctx, state, item);
+        } else {
+            item->obj.error = ECANCELED;
+        }
+
+        int emit_ret = emit_cb(&item->obj, state->arg);
+        if (ret == NO_ERROR) {
+            ret = emit_ret;
+        }
+    }
+
+    return ret;
+}
+
+static int dump_in_parallel(struct pipeline_dump_state *state, unsigned n_workers,
+                            nikss_pipeline_dump_emit_cb_t emit_cb)
+{
+    int ret = NO_ERROR;
+    unsigned n_started = 0;
+    pthread_t *workers = calloc(n_workers, sizeof(pthread_t));
+    if (workers == NULL) {
+        return ENOMEM;
+    }
+
+    for (; n_started < n_workers; n_started++) {
+        if (pthread_create(&workers[n_started], NULL, pipeline_dump_worker, state) != 0) {
+            break;
+        }
+    }
+    if (n_started == 0) {
+        free(workers);
+        return EAGAIN;
+    }
+
+    for (size_t i = 0; i < state->n_items; i++) {
+        struct pipeline_dump_item *item = &state->items[i];
+
+        pthread_mutex_lock(&state->lock);
+        /* After stop, objects which were not taken by any worker are never read */
+        while (!item->done && !(state->stopped && i >= state->next_item)) {
+            pthread_cond_wait(&state->item_done, &state->lock);
+        }
+        if (!item->done) {
+            item->obj.error = ECANCELED;
+        }
+        pthread_mutex_unlock(&state->lock);
+
+        int emit_ret = emit_cb(&item->obj, state->arg);
+
+        pthread_mutex_lock(&state->lock);
+        state->n_emitted = i + 1;
+        if (emit_ret != NO_ERROR && ret == NO_ERROR) {
+            ret = emit_ret;
+            state->stopped = true;
+        }
+        pthread_cond_broadcast(&state->item_emitted);
+        pthread_mutex_unlock(&state->lock);
+    }
+
+    for (unsigned i = 0; i < n_started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+
+    return ret;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_pipeline_dump(nikss_context_t *ctx, unsigned n_workers, nikss_pipeline_dump_read_cb_t read_cb,
+                        nikss_pipeline_dump_emit_cb_t emit_cb, void *arg)
+{
+    if (ctx == NULL || read_cb == NULL || emit_cb == NULL) {
+        return EINVAL;
+    }
+
+    struct pipeline_dump_state state = {
+            .pipeline_id = nikss_context_get_pipeline(ctx),
+            .read_cb = read_cb,
+            .arg = arg,
+    };
+
+    int ret = collect_dump_items(ctx, &state);
+    if (ret != NO_ERROR) {
+        free(state.items);
+        return ret;
+    }
+
+    if (n_workers > state.n_items) {
+        n_workers = (unsigned) state.n_items;
+    }
+
+    if (n_workers < 2) {
+        ret = dump_serially(ctx, &state, emit_cb);
+    } else {
+        pthread_mutex_init(&state.lock, NULL);
+        pthread_cond_init(&state.item_done, NULL);
+        pthread_cond_init(&state.item_emitted, NULL);
+        state.window = n_workers;
+        ret = dump_in_parallel(&state, n_workers, emit_cb);
+        pthread_cond_destroy(&state.item_emitted);
+        pthread_cond_destroy(&state.item_done);
+        pthread_mutex_destroy(&state.lock);
+    }
+
+    free(state.items);
+
+    return ret;
+}
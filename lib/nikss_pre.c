@@ -18,6 +18,7 @@
 #include <bpf/bpf.h>
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 #include <nikss/nikss_pre.h>
@@ -73,13 +74,8 @@ err:
     return ret;
 }
 
-static int open_session_map(nikss_bpf_map_descriptor_t *pr_map,
-                            nikss_bpf_map_descriptor_t *session_map, uint32_t session)
+static int lookup_inner_map_id(nikss_bpf_map_descriptor_t *pr_map, uint32_t session, uint32_t *inner_map_id)
 {
-    session_map->fd = -1;
-    session_map->key_size = 0;
-    session_map->value_size = 0;
-
     if (pr_map->fd < 0) {
         fprintf(stderr, "map not opened\n");
         return EBADF;
@@ -89,22 +85,26 @@ static int open_session_map(nikss_bpf_map_descriptor_t *pr_map,
         return EINVAL;
     }
 
-    uint32_t inner_map_id = 0;
-    int ret = bpf_map_lookup_elem(pr_map->fd, &session, &inner_map_id);
+    int ret = bpf_map_lookup_elem(pr_map->fd, &session, inner_map_id);
     if (ret != 0) {
         ret = errno;
         fprintf(stderr, "could not find session/group: %s\n", strerror(ret));
         return ret;
     }
 
+    return NO_ERROR;
+}
+
+static int open_inner_session_map(nikss_bpf_map_descriptor_t *session_map, uint32_t inner_map_id)
+{
     session_map->fd = bpf_map_get_fd_by_id(inner_map_id);
     if (session_map->fd < 0) {
-        ret = errno;
+        int ret = errno;
         fprintf(stderr, "could not get inner map: %s\n", strerror(ret));
         return ret;
     }
 
-    ret = update_map_info(session_map);
+    int ret = update_map_info(session_map);
     if (ret != NO_ERROR) {
         return ret;
     }
@@ -117,25 +117,34 @@ static int open_session_map(nikss_bpf_map_descriptor_t *pr_map,
     return NO_ERROR;
 }
 
-static int do_create_pre_session(nikss_bpf_map_descriptor_t *pr_map,
-                                 nikss_bpf_map_descriptor_t *session_template, uint32_t session, nikss_btf_t *btf)
+static int open_session_map(nikss_bpf_map_descriptor_t *pr_map,
+                            nikss_bpf_map_descriptor_t *session_map, uint32_t session)
 {
-    int error_code = 0;
-    if (pr_map->fd < 0 || session_template->fd < 0) {
+    session_map->fd = -1;
+    session_map->key_size = 0;
+    session_map->value_size = 0;
+
+    uint32_t inner_map_id = 0;
+    int ret = lookup_inner_map_id(pr_map, session, &inner_map_id);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+
+    return open_inner_session_map(session_map, inner_map_id);
+}
+
+static int create_inner_session_map(nikss_bpf_map_descriptor_t *session_template, nikss_btf_t *btf,
+                                    int *inner_map_fd)
+{
+    if (session_template->fd < 0) {
         fprintf(stderr, "maps not opened\n");
         return EBADF;
     }
-    if (pr_map->key_size != sizeof(session)) {
-        /* cppcheck-suppress invalidPrintfArgType_uint ; cppcheck failed to recognize a real type of size_t */
-        fprintf(stderr, "key map size must be equal to %lu\n", sizeof(session));
-        return EINVAL;
-    }
     if (session_template->key_size != sizeof(elem_t) || session_template->value_size != sizeof(struct element)) {
         fprintf(stderr, "invalid session/group map template\n");
         return EINVAL;
     }
 
-    /* create inner map */
     struct bpf_create_map_attr attr = {
             .key_size = session_template->key_size,
             .value_size = session_template->value_size,
@@ -145,13 +154,37 @@ static int do_create_pre_session(nikss_bpf_map_descriptor_t *pr_map,
             .btf_key_type_id = session_template->map_key_type_id,
             .btf_value_type_id = session_template->map_value_type_id,
     };
-    int inner_map_fd = bpf_create_map_xattr(&attr);
-    if (inner_map_fd < 0) {
-        error_code = errno;
+    *inner_map_fd = bpf_create_map_xattr(&attr);
+    if (*inner_map_fd < 0) {
+        int error_code = errno;
         fprintf(stderr, "failed to create inner session/group map: %s\n", strerror(error_code));
         return error_code;
     }
 
+    return NO_ERROR;
+}
+
+static int do_create_pre_session(nikss_bpf_map_descriptor_t *pr_map,
+                                 nikss_bpf_map_descriptor_t *session_template, uint32_t session, nikss_btf_t *btf)
+{
+    int error_code = 0;
+    if (pr_map->fd < 0) {
+        fprintf(stderr, "maps not opened\n");
+        return EBADF;
+    }
+    if (pr_map->key_size != sizeof(session)) {
+        /* cppcheck-suppress invalidPrintfArgType_uint ; cppcheck failed to recognize a real type of size_t */
+        fprintf(stderr, "key map size must be equal to %lu\n", sizeof(session));
+        return EINVAL;
+    }
+
+    /* create inner map */
+    int inner_map_fd = -1;
+    error_code = create_inner_session_map(session_template, btf, &inner_map_fd);
+    if (error_code != NO_ERROR) {
+        return error_code;
+    }
+
     /* add head in inner map */
     elem_t head_idx = { 0 };
     struct element head_elem =  { 0 };
@@ -277,44 +310,254 @@ static bool pre_session_exists(nikss_context_t *ctx, const char *pr_map_name, ui
     return inner_map_id != 0;
 }
 
-static int pre_session_insert_entry(nikss_context_t *ctx, const char *pr_map_name,
-                                    uint32_t session, nikss_clone_session_entry_t *entry)
+/******************************************************************************
+ * Member index
+ ******************************************************************************/
+
+/* Predecessor of a member in the list. Items are kept sorted by key. */
+struct pre_member_index_item {
+    elem_t key;
+    elem_t prev;
+};
+
+/* Userspace copy of the list structure, so members can be unlinked without walking
+ * the list. Index is bound to the inner map it was built from, it is dropped when
+ * the session/group points to another inner map. */
+struct nikss_pre_member_index {
+    nikss_bpf_map_descriptor_t session_map;
+    uint32_t inner_map_id;
+
+    bool valid;
+    size_t n_items;
+    size_t capacity;
+    struct pre_member_index_item *items;
+};
+
+static void set_elem_key(elem_t *key, uint32_t port, uint16_t instance)
 {
-    if (ctx == NULL || entry == NULL) {
-        return EINVAL;
+    /* Padding is a part of the map key, so it must be zeroed */
+    memset(key, 0, sizeof(elem_t));
+    key->port = port;
+    key->instance = instance;
+}
+
+static bool elem_key_is_head(const elem_t *key)
+{
+    return key->port == 0 && key->instance == 0;
+}
+
+static int compare_elem_keys(const void *first, const void *second)
+{
+    const elem_t *a = first;
+    const elem_t *b = second;
+
+    if (a->port != b->port) {
+        return a->port < b->port ? -1 : 1;
     }
-    if (entry->instance == 0 && entry->egress_port == 0) {
-        fprintf(stderr, "instance and egress port not set\n");
-        return EINVAL;
+    if (a->instance != b->instance) {
+        return a->instance < b->instance ? -1 : 1;
     }
+    return 0;
+}
 
-    nikss_bpf_map_descriptor_t session_map;
-    nikss_bpf_map_descriptor_t pr_map;
+static void member_index_reset(struct nikss_pre_member_index *index)
+{
+    index->n_items = 0;
+    index->valid = false;
+}
+
+static void free_member_index(struct nikss_pre_member_index **index)
+{
+    if (*index == NULL) {
+        return;
+    }
+
+    close_object_fd(&(*index)->session_map.fd);
+    if ((*index)->items != NULL) {
+        free((*index)->items);
+    }
+    free(*index);
+    *index = NULL;
+}
+
+static struct pre_member_index_item *member_index_find(struct nikss_pre_member_index *index, const elem_t *key)
+{
+    if (index->n_items == 0) {
+        return NULL;
+    }
+    /* Key is the first field of an item, so keys can be compared directly */
+    return bsearch(key, index->items, index->n_items, sizeof(struct pre_member_index_item), compare_elem_keys);
+}
+
+static int member_index_set(struct nikss_pre_member_index *index, const elem_t *key, const elem_t *prev)
+{
+    struct pre_member_index_item *item = member_index_find(index, key);
+    if (item != NULL) {
+        item->prev = *prev;
+        return NO_ERROR;
+    }
+
+    if (index->n_items == index->capacity) {
+        size_t new_capacity = index->capacity == 0 ? 16 : 2 * index->capacity;
+        struct pre_member_index_item *new_items =
+                realloc(index->items, new_capacity * sizeof(struct pre_member_index_item));
+        if (new_items == NULL) {
+            return ENOMEM;
+        }
+        index->items = new_items;
+        index->capacity = new_capacity;
+    }
+
+    size_t low = 0;
+    size_t high = index->n_items;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (compare_elem_keys(&index->items[mid].key, key) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    memmove(&index->items[low + 1], &index->items[low],
+            (index->n_items - low) * sizeof(struct pre_member_index_item));
+    index->items[low].key = *key;
+    index->items[low].prev = *prev;
+    index->n_items += 1;
+
+    return NO_ERROR;
+}
+
+static void member_index_remove(struct nikss_pre_member_index *index, const elem_t *key)
+{
+    struct pre_member_index_item *item = member_index_find(index, key);
+    if (item == NULL) {
+        return;
+    }
+
+    size_t pos = item - index->items;
+    memmove(&index->items[pos], &index->items[pos + 1],
+            (index->n_items - pos - 1) * sizeof(struct pre_member_index_item));
+    index->n_items -= 1;
+}
+
+/* Walks the list once and records predecessor of every member. */
+static int build_member_index(struct nikss_pre_member_index *index)
+{
+    member_index_reset(index);
+
+    elem_t key;
+    set_elem_key(&key, 0, 0);
+    struct element value;
+    size_t n_visited = 0;
     int ret = NO_ERROR;
 
-    ret = open_pr_maps(ctx, pr_map_name, NULL, &pr_map, NULL);
-    if (ret != 0) {
+    while (true) {
+        if (bpf_map_lookup_elem(index->session_map.fd, &key, &value) != 0) {
+            ret = errno;
+            fprintf(stderr, "failed to read session/group list: %s\n", strerror(ret));
+            goto err;
+        }
+        if (elem_key_is_head(&value.next_id)) {
+            break;
+        }
+
+        n_visited += 1;
+        if (n_visited > index->session_map.max_entries) {
+            fprintf(stderr, "loop detected in session/group list\n");
+            ret = ELOOP;
+            goto err;
+        }
+
+        elem_t next;
+        set_elem_key(&next, value.next_id.port, value.next_id.instance);
+        ret = member_index_set(index, &next, &key);
+        if (ret != NO_ERROR) {
+            goto err;
+        }
+        key = next;
+    }
+
+    index->valid = true;
+    return NO_ERROR;
+
+err:
+    member_index_reset(index);
+    return ret;
+}
+
+/* Opens inner map of the session/group. Map opened before is reused as long as
+ * the session/group still points to it. */
+static int open_indexed_session_map(nikss_context_t *ctx, const char *pr_map_name, uint32_t session,
+                                    struct nikss_pre_member_index **index_ptr)
+{
+    if (*index_ptr == NULL) {
+        *index_ptr = calloc(1, sizeof(struct nikss_pre_member_index));
+        if (*index_ptr == NULL) {
+            return ENOMEM;
+        }
+        (*index_ptr)->session_map.fd = -1;
+    }
+    struct nikss_pre_member_index *index = *index_ptr;
+
+    nikss_bpf_map_descriptor_t pr_map;
+    int ret = open_pr_maps(ctx, pr_map_name, NULL, &pr_map, NULL);
+    if (ret != NO_ERROR) {
         return ret;
     }
 
-    ret = open_session_map(&pr_map, &session_map, session);
+    uint32_t inner_map_id = 0;
+    ret = lookup_inner_map_id(&pr_map, session, &inner_map_id);
     if (ret != NO_ERROR) {
         goto err;
     }
 
-    if (session_map.key_size != sizeof(elem_t) || session_map.value_size != sizeof(struct element)) {
-        fprintf(stderr, "invalid session/group inner map\n");
+    if (index->session_map.fd >= 0 && index->inner_map_id == inner_map_id) {
+        goto err;
+    }
+
+    close_object_fd(&index->session_map.fd);
+    member_index_reset(index);
+
+    ret = open_inner_session_map(&index->session_map, inner_map_id);
+    if (ret != NO_ERROR) {
+        close_object_fd(&index->session_map.fd);
         goto err;
     }
+    index->inner_map_id = inner_map_id;
+
+err:
+    close_object_fd(&pr_map.fd);
+
+    return ret;
+}
+
+static int pre_session_insert_entry(nikss_context_t *ctx, const char *pr_map_name, uint32_t session,
+                                    nikss_clone_session_entry_t *entry, struct nikss_pre_member_index **index_ptr)
+{
+    if (ctx == NULL || entry == NULL) {
+        return EINVAL;
+    }
+    if (entry->instance == 0 && entry->egress_port == 0) {
+        fprintf(stderr, "instance and egress port not set\n");
+        return EINVAL;
+    }
+
+    int ret = open_indexed_session_map(ctx, pr_map_name, session, index_ptr);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+    struct nikss_pre_member_index *index = *index_ptr;
 
     /* 1. Gead head. */
-    elem_t head_idx = { 0 };
+    elem_t head_idx;
+    set_elem_key(&head_idx, 0, 0);
     struct element head;
-    ret = bpf_map_lookup_elem(session_map.fd, &head_idx, &head);
+    ret = bpf_map_lookup_elem(index->session_map.fd, &head_idx, &head);
     if (ret != 0) {
         ret = errno;
         fprintf(stderr, "error getting head of list: %s\n", strerror(ret));
-        goto err;
+        return ret;
     }
 
     /* 2. Allocate new element and put in the data. */
@@ -323,11 +566,9 @@ static int pre_session_insert_entry(nikss_context_t *ctx, const char *pr_map_nam
             /* 3. Make next of new node as next of head */
             .next_id = head.next_id,
     };
-    elem_t new_node_key = {
-            .port = entry->egress_port,
-            .instance = entry->instance,
-    };
-    ret = bpf_map_update_elem(session_map.fd, &new_node_key, &new_node_value, BPF_NOEXIST);
+    elem_t new_node_key;
+    set_elem_key(&new_node_key, entry->egress_port, entry->instance);
+    ret = bpf_map_update_elem(index->session_map.fd, &new_node_key, &new_node_value, BPF_NOEXIST);
     if (ret != 0) {
         ret = errno;
         if (ret == EEXIST) {
@@ -335,30 +576,93 @@ static int pre_session_insert_entry(nikss_context_t *ctx, const char *pr_map_nam
                             "Increment 'instance' to clone more than one packet to the same port.\n",
                     entry->egress_port,
                     entry->instance);
-        } else if (ret < 0) {
+        } else {
             printf("error creating list element: %s\n", strerror(ret));
         }
-        goto err;
+        return ret;
     }
 
     /* 4. move the head to point to the new node */
+    elem_t old_first;
+    set_elem_key(&old_first, head.next_id.port, head.next_id.instance);
     head.next_id = new_node_key;
-    ret = bpf_map_update_elem(session_map.fd, &head_idx, &head, 0);
-    if (ret < 0) {
+    ret = bpf_map_update_elem(index->session_map.fd, &head_idx, &head, 0);
+    if (ret != 0) {
         ret = errno;
         printf("error updating head: %s\n", strerror(ret));
-        goto err;
+        return ret;
     }
 
-err:
-    close_object_fd(&pr_map.fd);
-    close_object_fd(&session_map.fd);
+    /* 5. Keep predecessors in sync, on failure index will be built again at next deletion */
+    if (index->valid) {
+        if (member_index_set(index, &new_node_key, &head_idx) != NO_ERROR ||
+            (!elem_key_is_head(&old_first) && member_index_set(index, &old_first, &new_node_key) != NO_ERROR)) {
+            member_index_reset(index);
+        }
+    }
 
-    return ret;
+    return NO_ERROR;
 }
 
-static int pre_session_del_entry(nikss_context_t *ctx, const char *pr_map_name,
-                                 uint32_t session, nikss_clone_session_entry_t *entry)
+/* Returns ESTALE when index does not reflect content of the map (e.g. list has been
+ * modified by another process), so it has to be built again. */
+static int unlink_indexed_entry(struct nikss_pre_member_index *index, const elem_t *key_to_delete)
+{
+    int fd = index->session_map.fd;
+    struct element elem_to_delete;
+
+    struct pre_member_index_item *item = member_index_find(index, key_to_delete);
+    if (item == NULL) {
+        if (bpf_map_lookup_elem(fd, key_to_delete, &elem_to_delete) != 0) {
+            return ENOENT;
+        }
+        return ESTALE;
+    }
+    elem_t prev_elem_key = item->prev;
+
+    /* Previous node must still point to the node to remove */
+    struct element prev_elem_value;
+    if (bpf_map_lookup_elem(fd, &prev_elem_key, &prev_elem_value) != 0 ||
+        compare_elem_keys(&prev_elem_value.next_id, key_to_delete) != 0) {
+        return ESTALE;
+    }
+
+    /* Get node to remove */
+    if (bpf_map_lookup_elem(fd, key_to_delete, &elem_to_delete) != 0) {
+        return ESTALE;
+    }
+
+    /* Update previous node to point to next node */
+    prev_elem_value.next_id = elem_to_delete.next_id;
+    int ret = bpf_map_update_elem(fd, &prev_elem_key, &prev_elem_value, BPF_EXIST);
+    if (ret != 0) {
+        ret = errno;
+        fprintf(stderr, "failed to update previous element: %s\n", strerror(ret));
+        return ret;
+    }
+
+    /* Remove node */
+    ret = bpf_map_delete_elem(fd, key_to_delete);
+    if (ret != 0) {
+        ret = errno;
+        fprintf(stderr, "failed to delete element: %s\n", strerror(ret));
+        return ret;
+    }
+
+    member_index_remove(index, key_to_delete);
+    if (!elem_key_is_head(&elem_to_delete.next_id)) {
+        elem_t next_key;
+        set_elem_key(&next_key, elem_to_delete.next_id.port, elem_to_delete.next_id.instance);
+        if (member_index_set(index, &next_key, &prev_elem_key) != NO_ERROR) {
+            member_index_reset(index);
+        }
+    }
+
+    return NO_ERROR;
+}
+
+static int pre_session_del_entry(nikss_context_t *ctx, const char *pr_map_name, uint32_t session,
+                                 nikss_clone_session_entry_t *entry, struct nikss_pre_member_index **index_ptr)
 {
     if (ctx == NULL || entry == NULL) {
         return EINVAL;
@@ -368,91 +672,265 @@ static int pre_session_del_entry(nikss_context_t *ctx, const char *pr_map_name,
         return EINVAL;
     }
 
-    nikss_bpf_map_descriptor_t session_map;
-    nikss_bpf_map_descriptor_t pr_map;
-    int ret = NO_ERROR;
-
-    ret = open_pr_maps(ctx, pr_map_name, NULL, &pr_map, NULL);
-    if (ret != 0) {
+    int ret = open_indexed_session_map(ctx, pr_map_name, session, index_ptr);
+    if (ret != NO_ERROR) {
         return ret;
     }
+    struct nikss_pre_member_index *index = *index_ptr;
 
-    ret = open_session_map(&pr_map, &session_map, session);
-    if (ret != NO_ERROR) {
-        goto err;
+    bool index_rebuilt = false;
+    if (!index->valid) {
+        ret = build_member_index(index);
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+        index_rebuilt = true;
     }
 
-    if (session_map.key_size != sizeof(elem_t) || session_map.value_size != sizeof(struct element)) {
-        ret = EINVAL;
-        fprintf(stderr, "invalid session/group inner map\n");
-        goto err;
+    elem_t key_to_delete;
+    set_elem_key(&key_to_delete, entry->egress_port, entry->instance);
+    ret = unlink_indexed_entry(index, &key_to_delete);
+    if (ret == ESTALE && !index_rebuilt) {
+        ret = build_member_index(index);
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+        ret = unlink_indexed_entry(index, &key_to_delete);
     }
 
-    /* Find previous node */
-    elem_t prev_elem_key = { 0 };
-    struct element prev_elem_value;
-    bool found = false;
-    do {
-        ret = bpf_map_lookup_elem(session_map.fd, &prev_elem_key, &prev_elem_value);
-        if (ret != 0) {
-            ret = errno;
-            break;
+    if (ret == ESTALE || ret == ENOENT) {
+        if (ret == ESTALE) {
+            member_index_reset(index);
         }
+        fprintf(stderr, "error getting element from list (egress_port=%u, instance=%d): %s\n",
+                entry->egress_port, entry->instance, strerror(ret));
+    }
 
-        if (prev_elem_value.next_id.instance == entry->instance &&
-            prev_elem_value.next_id.port == entry->egress_port) {
-            found = true;
-            break;
+    return ret;
+}
+
+static int update_session_elements(int fd, elem_t *keys, struct element *values, uint32_t count)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = BPF_ANY,
+                        .flags = 0,
+    );
+    if (count == 0) {
+        return NO_ERROR;
+    }
+
+    uint32_t processed = count;
+    if (bpf_map_update_batch(fd, keys, values, &processed, &opts) == 0) {
+        return NO_ERROR;
+    }
+    /* Kernels without batch operations do not update the counter */
+    if (processed >= count) {
+        processed = 0;
+    }
+
+    for (uint32_t i = processed; i < count; i++) {
+        if (bpf_map_update_elem(fd, &keys[i], &values[i], BPF_ANY) != 0) {
+            int ret = errno;
+            fprintf(stderr, "failed to write session/group element: %s\n", strerror(ret));
+            return ret;
         }
-        prev_elem_key = prev_elem_value.next_id;
-    } while (prev_elem_value.next_id.port != 0 && prev_elem_value.next_id.instance != 0);
+    }
+
+    return NO_ERROR;
+}
 
-    if (ret != 0 || found == false) {
-        if (ret == NO_ERROR) {
-            ret = ENOENT;
+/* Builds list nodes in userspace. Last slot of keys and values is for the head.
+ * Sorted copy of keys is returned to look up members quickly. */
+static int build_session_list(const nikss_clone_session_entry_t *entries, size_t n_entries,
+                              elem_t **keys_ptr, struct element **values_ptr, elem_t **sorted_keys_ptr)
+{
+    for (size_t i = 0; i < n_entries; i++) {
+        if (entries[i].instance == 0 && entries[i].egress_port == 0) {
+            fprintf(stderr, "instance and egress port not set\n");
+            return EINVAL;
         }
-        fprintf(stderr, "error getting element from list (egress_port=%u, instance=%d): %s\n",
-                entry->egress_port, entry->instance, strerror(ret));
-        goto err;
     }
 
-    /* Get node to remove */
-    struct element elem_to_delete;
-    elem_t key_to_delete = {
-            .instance = entry->instance,
-            .port = entry->egress_port,
-    };
-    ret = bpf_map_lookup_elem(session_map.fd, &key_to_delete, &elem_to_delete);
-    if (ret != 0) {
-        ret = errno;
-        fprintf(stderr, "error getting element to delete: %s\n", strerror(ret));
+    elem_t *keys = calloc(n_entries + 1, sizeof(elem_t));
+    struct element *values = calloc(n_entries + 1, sizeof(struct element));
+    elem_t *sorted_keys = calloc(n_entries + 1, sizeof(elem_t));
+    int ret = NO_ERROR;
+    if (keys == NULL || values == NULL || sorted_keys == NULL) {
+        ret = ENOMEM;
         goto err;
     }
 
-    /* Update previous node to point to next node */
-    prev_elem_value.next_id = elem_to_delete.next_id;
-    ret = bpf_map_update_elem(session_map.fd, &prev_elem_key, &prev_elem_value, BPF_EXIST);
-    if (ret != 0) {
-        ret = errno;
-        fprintf(stderr, "failed to update previous element: %s\n", strerror(ret));
-        goto err;
+    for (size_t i = 0; i < n_entries; i++) {
+        set_elem_key(&keys[i], entries[i].egress_port, entries[i].instance);
+        values[i].entry = entries[i];
+    }
+    set_elem_key(&keys[n_entries], 0, 0);
+    for (size_t i = 0; i < n_entries; i++) {
+        values[i].next_id = keys[i + 1];
     }
+    values[n_entries].next_id = keys[0];
 
-    /* Remove node */
-    ret = bpf_map_delete_elem(session_map.fd, &key_to_delete);
+    memcpy(sorted_keys, keys, n_entries * sizeof(elem_t));
+    qsort(sorted_keys, n_entries, sizeof(elem_t), compare_elem_keys);
+    for (size_t i = 1; i < n_entries; i++) {
+        if (compare_elem_keys(&sorted_keys[i - 1], &sorted_keys[i]) == 0) {
+            fprintf(stderr, "Clone session/multicast member [port=%u, instance=%d] specified more than once\n",
+                    sorted_keys[i].port, sorted_keys[i].instance);
+            ret = EEXIST;
+            goto err;
+        }
+    }
+
+    *keys_ptr = keys;
+    *values_ptr = values;
+    *sorted_keys_ptr = sorted_keys;
+
+    return NO_ERROR;
+
+err:
+    if (keys != NULL) {
+        free(keys);
+    }
+    if (values != NULL) {
+        free(values);
+    }
+    if (sorted_keys != NULL) {
+        free(sorted_keys);
+    }
+
+    return ret;
+}
+
+/* Fills index from a list built by build_session_list() */
+static void member_index_load(struct nikss_pre_member_index *index, elem_t *keys, size_t n_entries)
+{
+    member_index_reset(index);
+    for (size_t i = 0; i < n_entries; i++) {
+        elem_t *prev = i == 0 ? &keys[n_entries] : &keys[i - 1];
+        if (member_index_set(index, &keys[i], prev) != NO_ERROR) {
+            member_index_reset(index);
+            return;
+        }
+    }
+    index->valid = true;
+}
+
+/* Builds a new inner map with the given entries and swaps it into the outer map, so
+ * the data plane switches from the old list to the new one with a single update.
+ * Session/group is created if it does not exist. */
+static int pre_session_replace_entries(nikss_context_t *ctx, const char *pr_map_name, const char *pr_map_inner,
+                                       uint32_t session, const nikss_clone_session_entry_t *entries,
+                                       size_t n_entries, struct nikss_pre_member_index **index_ptr)
+{
+    if (ctx == NULL || session == 0 || (entries == NULL && n_entries > 0)) {
+        fprintf(stderr, "invalid session/group or context\n");
+        return EINVAL;
+    }
+
+    elem_t *keys = NULL;
+    struct element *values = NULL;
+    elem_t *sorted_keys = NULL;
+    int ret = build_session_list(entries, n_entries, &keys, &values, &sorted_keys);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+
+    nikss_bpf_map_descriptor_t outer_map;
+    nikss_bpf_map_descriptor_t session_template;
+    nikss_btf_t btf;
+    int inner_map_fd = -1;
+    init_btf(&btf);
+
+    ret = open_pr_maps(ctx, pr_map_name, pr_map_inner, &outer_map, &session_template);
+    if (ret != NO_ERROR) {
+        goto clean_up;
+    }
+    if (outer_map.key_size != sizeof(session) || outer_map.value_size != sizeof(uint32_t)) {
+        fprintf(stderr, "invalid session/group map\n");
+        ret = EINVAL;
+        goto clean_up;
+    }
+    if (n_entries >= session_template.max_entries) {
+        fprintf(stderr, "too many members for session/group, maximum is %u\n",
+                session_template.max_entries - 1);
+        ret = E2BIG;
+        goto clean_up;
+    }
+
+    load_btf(ctx, &btf);
+    ret = create_inner_session_map(&session_template, &btf, &inner_map_fd);
+    if (ret != NO_ERROR) {
+        goto clean_up;
+    }
+
+    /* New map is not reachable yet, so the order of writes does not matter */
+    ret = update_session_elements(inner_map_fd, keys, values, n_entries + 1);
+    if (ret != NO_ERROR) {
+        goto clean_up;
+    }
+
+    ret = bpf_map_update_elem(outer_map.fd, &session, &inner_map_fd, BPF_ANY);
     if (ret != 0) {
         ret = errno;
-        fprintf(stderr, "failed to delete element: %s\n", strerror(ret));
-        goto err;
+        fprintf(stderr, "failed to swap session/group map: %s\n", strerror(ret));
+        goto clean_up;
     }
 
-err:
-    close_object_fd(&session_map.fd);
-    close_object_fd(&pr_map.fd);
+    /* Keep the new map in the index, so following updates don't have to open it */
+    if (*index_ptr == NULL) {
+        *index_ptr = calloc(1, sizeof(struct nikss_pre_member_index));
+        if (*index_ptr == NULL) {
+            goto clean_up;
+        }
+        (*index_ptr)->session_map.fd = -1;
+    }
+    struct nikss_pre_member_index *index = *index_ptr;
+    close_object_fd(&index->session_map.fd);
+    member_index_reset(index);
+
+    struct bpf_map_info info = {};
+    uint32_t info_len = sizeof(info);
+    index->session_map.fd = inner_map_fd;
+    inner_map_fd = -1;
+    if (bpf_obj_get_info_by_fd(index->session_map.fd, &info, &info_len) != 0 ||
+        update_map_info(&index->session_map) != NO_ERROR) {
+        /* Map will be opened again at next update */
+        close_object_fd(&index->session_map.fd);
+        goto clean_up;
+    }
+    index->inner_map_id = info.id;
+    member_index_load(index, keys, n_entries);
+
+clean_up:
+    close_object_fd(&inner_map_fd);
+    close_object_fd(&session_template.fd);
+    close_object_fd(&outer_map.fd);
+    free_btf(&btf);
+    free(keys);
+    free(values);
+    free(sorted_keys);
 
     return ret;
 }
 
+/* Replaces the whole list of existing session/group. Rewriting nodes of the list in place
+ * would let the data plane see a mix of the old and the new list (or even a loop), so the
+ * list is built in a new map which is swapped in, the same way as by replace. */
+static int pre_session_set_entries(nikss_context_t *ctx, const char *pr_map_name, const char *pr_map_inner,
+                                   uint32_t session, const nikss_clone_session_entry_t *entries,
+                                   size_t n_entries, struct nikss_pre_member_index **index_ptr)
+{
+    if (ctx == NULL || (entries == NULL && n_entries > 0)) {
+        return EINVAL;
+    }
+    if (!pre_session_exists(ctx, pr_map_name, session)) {
+        fprintf(stderr, "session/group %u does not exist\n", session);
+        return ENOENT;
+    }
+
+    return pre_session_replace_entries(ctx, pr_map_name, pr_map_inner, session, entries, n_entries, index_ptr);
+}
+
 static int pre_get_next_entry(nikss_context_t *ctx,
                               nikss_bpf_map_descriptor_t *session_map, const char *pr_map_name,
                               uint32_t session, uint32_t *current_egress_port, uint16_t *current_instance,
@@ -568,6 +1046,7 @@ void nikss_clone_session_context_free(nikss_clone_session_ctx_t *ctx)
     }
 
     close_object_fd(&ctx->session_map.fd);
+    free_member_index(&ctx->member_index);
 }
 
 void nikss_clone_session_id(nikss_clone_session_ctx_t *ctx, nikss_clone_session_id_t id)
@@ -579,6 +1058,7 @@ void nikss_clone_session_id(nikss_clone_session_ctx_t *ctx, nikss_clone_session_
 
     /* Also reset session map if opened */
     close_object_fd(&ctx->session_map.fd);
+    free_member_index(&ctx->member_index);
 }
 
 nikss_clone_session_id_t nikss_clone_session_get_id(nikss_clone_session_ctx_t *ctx)
@@ -692,7 +1172,7 @@ int nikss_clone_session_entry_update(nikss_context_t *ctx, nikss_clone_session_c
         return EINVAL;
     }
 
-    return pre_session_insert_entry(ctx, CLONE_SESSION_TABLE, session->id, entry);
+    return pre_session_insert_entry(ctx, CLONE_SESSION_TABLE, session->id, entry, &session->member_index);
 }
 
 int nikss_clone_session_delete(nikss_context_t *ctx, nikss_clone_session_ctx_t *session)
@@ -709,7 +1189,31 @@ int nikss_clone_session_entry_delete(nikss_context_t *ctx, nikss_clone_session_c
     if (session == NULL) {
         return EINVAL;
     }
-    return pre_session_del_entry(ctx, CLONE_SESSION_TABLE, session->id, entry);
+    return pre_session_del_entry(ctx, CLONE_SESSION_TABLE, session->id, entry, &session->member_index);
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_clone_session_set_entries(nikss_context_t *ctx, nikss_clone_session_ctx_t *session,
+                                    const nikss_clone_session_entry_t *entries, size_t n_entries)
+{
+    if (session == NULL) {
+        return EINVAL;
+    }
+
+    return pre_session_set_entries(ctx, CLONE_SESSION_TABLE, CLONE_SESSION_TABLE_INNER, session->id,
+                                   entries, n_entries, &session->member_index);
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_clone_session_replace(nikss_context_t *ctx, nikss_clone_session_ctx_t *session,
+                                const nikss_clone_session_entry_t *entries, size_t n_entries)
+{
+    if (session == NULL) {
+        return EINVAL;
+    }
+
+    return pre_session_replace_entries(ctx, CLONE_SESSION_TABLE, CLONE_SESSION_TABLE_INNER, session->id,
+                                       entries, n_entries, &session->member_index);
 }
 
 /* cppcheck-suppress unusedFunction ; public API call */
@@ -797,6 +1301,7 @@ void nikss_mcast_grp_context_free(nikss_mcast_grp_ctx_t *group)
     }
 
     close_object_fd(&group->group_map.fd);
+    free_member_index(&group->member_index);
 
     memset(group, 0, sizeof(nikss_mcast_grp_ctx_t));
     group->group_map.fd = -1;
@@ -804,12 +1309,14 @@ void nikss_mcast_grp_context_free(nikss_mcast_grp_ctx_t *group)
 
 void nikss_mcast_grp_id(nikss_mcast_grp_ctx_t *group, nikss_mcast_grp_id_t mcast_grp_id)
 {
-    if (group != NULL) {
-        group->id = mcast_grp_id;
+    if (group == NULL) {
+        return;
     }
+    group->id = mcast_grp_id;
 
     /* Also reset group map */
     close_object_fd(&group->group_map.fd);
+    free_member_index(&group->member_index);
 }
 
 nikss_mcast_grp_id_t nikss_mcast_grp_get_id(nikss_mcast_grp_ctx_t *group)
@@ -900,7 +1407,7 @@ int nikss_mcast_grp_member_update(nikss_context_t *ctx, nikss_mcast_grp_ctx_t *g
             .instance = member->instance,
     };
 
-    return pre_session_insert_entry(ctx, MULTICAST_GROUP_TABLE, group->id, &entry);
+    return pre_session_insert_entry(ctx, MULTICAST_GROUP_TABLE, group->id, &entry, &group->member_index);
 }
 
 /* cppcheck-suppress unusedFunction ; public API call */
@@ -921,7 +1428,73 @@ int nikss_mcast_grp_member_delete(nikss_context_t *ctx, nikss_mcast_grp_ctx_t *g
             .instance = member->instance,
     };
 
-    return pre_session_del_entry(ctx, MULTICAST_GROUP_TABLE, group->id, &entry);
+    return pre_session_del_entry(ctx, MULTICAST_GROUP_TABLE, group->id, &entry, &group->member_index);
+}
+
+static int mcast_grp_members_to_entries(const nikss_mcast_grp_member_t *members, size_t n_members,
+                                       nikss_clone_session_entry_t **entries)
+{
+    *entries = NULL;
+    if (n_members == 0) {
+        return NO_ERROR;
+    }
+
+    *entries = calloc(n_members, sizeof(nikss_clone_session_entry_t));
+    if (*entries == NULL) {
+        return ENOMEM;
+    }
+    for (size_t i = 0; i < n_members; i++) {
+        (*entries)[i].egress_port = members[i].egress_port;
+        (*entries)[i].instance = members[i].instance;
+    }
+
+    return NO_ERROR;
+}
+
+int nikss_mcast_grp_set_members(nikss_context_t *ctx, nikss_mcast_grp_ctx_t *group,
+                                const nikss_mcast_grp_member_t *members, size_t n_members)
+{
+    if (group == NULL || (members == NULL && n_members > 0)) {
+        return EINVAL;
+    }
+
+    nikss_clone_session_entry_t *entries = NULL;
+    int ret = mcast_grp_members_to_entries(members, n_members, &entries);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+
+    ret = pre_session_set_entries(ctx, MULTICAST_GROUP_TABLE, MULTICAST_GROUP_TABLE_INNER, group->id,
+                                  entries, n_members, &group->member_index);
+
+    if (entries != NULL) {
+        free(entries);
+    }
+
+    return ret;
+}
+
+int nikss_mcast_grp_replace(nikss_context_t *ctx, nikss_mcast_grp_ctx_t *group,
+                            const nikss_mcast_grp_member_t *members, size_t n_members)
+{
+    if (group == NULL || (members == NULL && n_members > 0)) {
+        return EINVAL;
+    }
+
+    nikss_clone_session_entry_t *entries = NULL;
+    int ret = mcast_grp_members_to_entries(members, n_members, &entries);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+
+    ret = pre_session_replace_entries(ctx, MULTICAST_GROUP_TABLE, MULTICAST_GROUP_TABLE_INNER, group->id,
+                                      entries, n_members, &group->member_index);
+
+    if (entries != NULL) {
+        free(entries);
+    }
+
+    return ret;
 }
 
 nikss_mcast_grp_member_t *nikss_mcast_grp_get_next_member(nikss_context_t *ctx, nikss_mcast_grp_ctx_t *group)
@@ -17,8 +17,11 @@
 
 #include <bpf/bpf.h>
 #include <errno.h>
+#include <linux/bpf.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include <nikss/nikss.h>
 
@@ -41,6 +44,11 @@ void nikss_register_ctx_free(nikss_register_context_t *ctx)
         return;
     }
 
+    if (ctx->mmap_base != NULL) {
+        munmap(ctx->mmap_base, ctx->mmap_size);
+    }
+    ctx->mmap_base = NULL;
+
     free_btf(&ctx->btf_metadata);
     close_object_fd(&(ctx->reg.fd));
     free_struct_field_descriptor_set(&ctx->key_fds);
@@ -166,7 +174,7 @@ static void *allocate_value_buffer(nikss_register_context_t *ctx, nikss_register
         return entry->raw_value;
     }
 
-    entry->raw_value = malloc(ctx->reg.value_size);
+    entry->raw_value = malloc(get_map_value_buffer_size(&ctx->reg));
     if (entry->raw_value == NULL) {
         fprintf(stderr, "not enough memory\n");
     }
@@ -190,13 +198,51 @@ nikss_struct_field_t * nikss_register_get_next_value_field(nikss_register_contex
     entry->current_field.type = fd->type;
     entry->current_field.data_len = fd->data_len;
     entry->current_field.name = fd->name;
-    entry->current_field.data = entry->raw_value + fd->data_offset;
+    entry->current_field.data = entry->raw_value + entry->current_cpu * get_map_value_slot_size(&ctx->reg) +
+                                fd->data_offset;
 
     entry->current_field_id = entry->current_field_id + 1;
 
     return &entry->current_field;
 }
 
+/* cppcheck-suppress unusedFunction ; public API call */
+size_t nikss_register_get_n_cpus(nikss_register_context_t *ctx)
+{
+    if (ctx == NULL) {
+        return 0;
+    }
+
+    return get_map_value_slots(&ctx->reg);
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_register_entry_select_cpu(nikss_register_context_t *ctx, nikss_register_entry_t *entry, size_t cpu)
+{
+    if (ctx == NULL || entry == NULL) {
+        return EINVAL;
+    }
+
+    if (cpu >= get_map_value_slots(&ctx->reg)) {
+        return ERANGE;
+    }
+
+    entry->current_cpu = cpu;
+    entry->current_field_id = 0;
+
+    return NO_ERROR;
+}
+
+static void fix_value_byte_order(nikss_register_context_t *ctx, char *value)
+{
+    size_t n_slots = get_map_value_slots(&ctx->reg);
+    size_t slot_size = get_map_value_slot_size(&ctx->reg);
+
+    for (size_t i = 0; i < n_slots; i++) {
+        fix_struct_data_byte_order(&ctx->value_fds, value + i * slot_size, ctx->reg.value_size);
+    }
+}
+
 nikss_struct_field_t * nikss_register_get_next_index_field(nikss_register_context_t *ctx, nikss_register_entry_t *entry)
 {
     if (ctx == NULL || entry == NULL) {
@@ -262,7 +308,7 @@ nikss_register_entry_t * nikss_register_get_next(nikss_register_context_t *ctx)
     }
 
     fix_struct_data_byte_order(&ctx->key_fds, ctx->current_entry.raw_key, ctx->reg.key_size);
-    fix_struct_data_byte_order(&ctx->value_fds, ctx->current_entry.raw_value, ctx->reg.value_size);
+    fix_value_byte_order(ctx, ctx->current_entry.raw_value);
 
     return &ctx->current_entry;
 }
@@ -290,7 +336,7 @@ int nikss_register_get(nikss_register_context_t *ctx, nikss_register_entry_t *en
     }
 
     fix_struct_data_byte_order(&ctx->value_fds, entry->raw_key, ctx->reg.key_size);
-    fix_struct_data_byte_order(&ctx->value_fds, entry->raw_value, ctx->reg.value_size);
+    fix_value_byte_order(ctx, entry->raw_value);
 
     return NO_ERROR;
 }
@@ -314,6 +360,15 @@ int nikss_register_set(nikss_register_context_t *ctx, nikss_register_entry_t *en
         return ret;
     }
 
+    /* Per-CPU register: every CPU starts from the same state */
+    size_t slot_size = get_map_value_slot_size(&ctx->reg);
+    if (slot_size > ctx->reg.value_size) {
+        memset(entry->raw_value + ctx->reg.value_size, 0, slot_size - ctx->reg.value_size);
+    }
+    for (size_t i = 1; i < get_map_value_slots(&ctx->reg); i++) {
+        memcpy(entry->raw_value + i * slot_size, entry->raw_value, slot_size);
+    }
+
     ret = bpf_map_update_elem(ctx->reg.fd, entry->raw_key, entry->raw_value, 0);
     if (ret != NO_ERROR) {
         fprintf(stderr, "failed to set a register: %s\n", strerror(ret));
@@ -322,3 +377,249 @@ int nikss_register_set(nikss_register_context_t *ctx, nikss_register_entry_t *en
 
     return NO_ERROR;
 }
+
+/* cppcheck-suppress unusedFunction ; public API call */
+size_t nikss_register_get_value_size(nikss_register_context_t *ctx)
+{
+    if (ctx == NULL) {
+        return 0;
+    }
+    return ctx->reg.value_size;
+}
+
+/* Kernel aligns cells of memory mapped array to 8B */
+static size_t get_register_cell_size(nikss_register_context_t *ctx)
+{
+    return (ctx->reg.value_size + 7) & ~((size_t) 7);
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_register_map(nikss_register_context_t *ctx, nikss_register_view_t *view)
+{
+    if (ctx == NULL || view == NULL) {
+        return EINVAL;
+    }
+
+    if (ctx->mmap_base == NULL) {
+        if (ctx->reg.type != BPF_MAP_TYPE_ARRAY) {
+            return ENOTSUP;
+        }
+
+        struct bpf_map_info info = {};
+        uint32_t info_len = sizeof(info);
+        if (bpf_obj_get_info_by_fd(ctx->reg.fd, &info, &info_len) != 0) {
+            int ret = errno;
+            fprintf(stderr, "failed to get register info: %s\n", strerror(ret));
+            return ret;
+        }
+        if ((info.map_flags & BPF_F_MMAPABLE) == 0) {
+            return ENOTSUP;
+        }
+
+        size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+        size_t size = get_register_cell_size(ctx) * ctx->reg.max_entries;
+        size = (size + page_size - 1) / page_size * page_size;
+        void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ctx->reg.fd, 0);
+        if (base == MAP_FAILED) {
+            int ret = errno;
+            fprintf(stderr, "failed to map register into memory: %s\n", strerror(ret));
+            return ret;
+        }
+        ctx->mmap_base = base;
+        ctx->mmap_size = size;
+    }
+
+    view->cells = ctx->mmap_base;
+    view->n_cells = ctx->reg.max_entries;
+    view->cell_size = get_register_cell_size(ctx);
+    view->value_size = ctx->reg.value_size;
+
+    return NO_ERROR;
+}
+
+static int check_register_range(nikss_register_context_t *ctx, uint32_t first_index, uint32_t n_cells)
+{
+    if (ctx->reg.key_size != sizeof(uint32_t)) {
+        fprintf(stderr, "register must be indexed with 32-bit integer\n");
+        return ENOTSUP;
+    }
+    if ((uint64_t) first_index + n_cells > ctx->reg.max_entries) {
+        fprintf(stderr, "register range out of bounds, register has %u cells\n", ctx->reg.max_entries);
+        return ERANGE;
+    }
+    return NO_ERROR;
+}
+
+/* Reads cells of array map in index order with batch lookup */
+static int read_register_batch(nikss_register_context_t *ctx, uint32_t first_index, uint32_t n_cells,
+                               char *values, size_t value_buffer_size)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = 0,
+                        .flags = 0,
+    );
+
+    uint32_t *keys = malloc(n_cells * sizeof(uint32_t));
+    if (keys == NULL) {
+        return ENOMEM;
+    }
+
+    /* Batch lookup starts from the key following the token */
+    uint32_t token = first_index - 1;
+    uint32_t done = 0;
+    int ret = NO_ERROR;
+    while (done < n_cells) {
+        uint32_t count = n_cells - done;
+        int err = bpf_map_lookup_batch(ctx->reg.fd, first_index == 0 && done == 0 ? NULL : &token, &token,
+                                       keys + done, values + done * value_buffer_size, &count, &opts);
+        if (err != 0) {
+            err = errno;
+        }
+        if (err != NO_ERROR && err != ENOENT) {
+            ret = err;
+            break;
+        }
+        done += count;
+        if (err == ENOENT || count == 0) {
+            break;
+        }
+    }
+    if (ret == NO_ERROR && done < n_cells) {
+        ret = ENOENT;
+    }
+
+    free(keys);
+    return ret;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_register_read_range(nikss_register_context_t *ctx, uint32_t first_index, uint32_t n_cells, void *values)
+{
+    if (ctx == NULL || (values == NULL && n_cells > 0)) {
+        return EINVAL;
+    }
+    int ret = check_register_range(ctx, first_index, n_cells);
+    if (ret != NO_ERROR || n_cells == 0) {
+        return ret;
+    }
+
+    char *dst = values;
+    nikss_register_view_t view;
+    if (ctx->mmap_base != NULL || nikss_register_map(ctx, &view) == NO_ERROR) {
+        char *cells = ctx->mmap_base;
+        size_t cell_size = get_register_cell_size(ctx);
+        for (uint32_t i = 0; i < n_cells; i++) {
+            memcpy(dst + (size_t) i * ctx->reg.value_size, cells + (size_t) (first_index + i) * cell_size,
+                   ctx->reg.value_size);
+        }
+        return NO_ERROR;
+    }
+
+    size_t value_buffer_size = get_map_value_buffer_size(&ctx->reg);
+    char *buffer = malloc(n_cells * value_buffer_size);
+    if (buffer == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return ENOMEM;
+    }
+
+    ret = ENOTSUP;
+    if (ctx->reg.type == BPF_MAP_TYPE_ARRAY || ctx->reg.type == BPF_MAP_TYPE_PERCPU_ARRAY) {
+        ret = read_register_batch(ctx, first_index, n_cells, buffer, value_buffer_size);
+    }
+    if (ret != NO_ERROR) {
+        /* Kernel or map type does not support batch lookup */
+        ret = NO_ERROR;
+        for (uint32_t i = 0; i < n_cells; i++) {
+            uint32_t key = first_index + i;
+            if (bpf_map_lookup_elem(ctx->reg.fd, &key, buffer + i * value_buffer_size) != 0) {
+                ret = errno;
+                fprintf(stderr, "failed to read Register entry: %s\n", strerror(ret));
+                break;
+            }
+        }
+    }
+
+    /* Only CPU 0 is returned for per-CPU register, it's in the first slot */
+    for (uint32_t i = 0; i < n_cells && ret == NO_ERROR; i++) {
+        memcpy(dst + (size_t) i * ctx->reg.value_size, buffer + i * value_buffer_size, ctx->reg.value_size);
+    }
+
+    free(buffer);
+    return ret;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_register_write_range(nikss_register_context_t *ctx, uint32_t first_index, uint32_t n_cells,
+                               const void *values)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = 0,
+                        .flags = 0,
+    );
+
+    if (ctx == NULL || (values == NULL && n_cells > 0)) {
+        return EINVAL;
+    }
+    int ret = check_register_range(ctx, first_index, n_cells);
+    if (ret != NO_ERROR || n_cells == 0) {
+        return ret;
+    }
+
+    const char *src = values;
+    nikss_register_view_t view;
+    if (ctx->mmap_base != NULL || nikss_register_map(ctx, &view) == NO_ERROR) {
+        char *cells = ctx->mmap_base;
+        size_t cell_size = get_register_cell_size(ctx);
+        for (uint32_t i = 0; i < n_cells; i++) {
+            memcpy(cells + (size_t) (first_index + i) * cell_size, src + (size_t) i * ctx->reg.value_size,
+                   ctx->reg.value_size);
+        }
+        return NO_ERROR;
+    }
+
+    size_t value_buffer_size = get_map_value_buffer_size(&ctx->reg);
+    size_t slot_size = get_map_value_slot_size(&ctx->reg);
+    size_t n_slots = get_map_value_slots(&ctx->reg);
+    uint32_t *keys = malloc(n_cells * sizeof(uint32_t));
+    char *buffer = calloc(n_cells, value_buffer_size);
+    if (keys == NULL || buffer == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        ret = ENOMEM;
+        goto clean_up;
+    }
+
+    /* Per-CPU register: every CPU starts from the same state */
+    for (uint32_t i = 0; i < n_cells; i++) {
+        keys[i] = first_index + i;
+        for (size_t slot = 0; slot < n_slots; slot++) {
+            memcpy(buffer + i * value_buffer_size + slot * slot_size, src + (size_t) i * ctx->reg.value_size,
+                   ctx->reg.value_size);
+        }
+    }
+
+    uint32_t processed = n_cells;
+    if (bpf_map_update_batch(ctx->reg.fd, keys, buffer, &processed, &opts) == 0) {
+        goto clean_up;
+    }
+    /* Kernels without batch operations do not update the counter */
+    if (processed >= n_cells) {
+        processed = 0;
+    }
+    for (uint32_t i = processed; i < n_cells; i++) {
+        if (bpf_map_update_elem(ctx->reg.fd, &keys[i], buffer + i * value_buffer_size, 0) != 0) {
+            ret = errno;
+            fprintf(stderr, "failed to set a register: %s\n", strerror(ret));
+            break;
+        }
+    }
+
+clean_up:
+    if (keys != NULL) {
+        free(keys);
+    }
+    if (buffer != NULL) {
+        free(buffer);
+    }
+
+    return ret;
+}
@@ -0,0 +1,1149 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <nikss/nikss_snapshot.h>
+
+#include "bpf_defs.h"
+#include "btf.h"
+#include "common.h"
+
+/* Entries of a single map read from the kernel */
+typedef struct snapshot_map_entries {
+    size_t n_entries;
+    char *keys;
+    char *values;
+} snapshot_map_entries_t;
+
+typedef struct snapshot_writer {
+    FILE *file;
+    size_t n_maps;
+    size_t capacity;
+    nikss_snapshot_map_t *maps;
+} snapshot_writer_t;
+
+typedef struct snapshot_key_order {
+    const char *keys;
+    size_t key_size;
+} snapshot_key_order_t;
+
+static bool is_map_in_map(uint32_t type)
+{
+    return type == BPF_MAP_TYPE_ARRAY_OF_MAPS || type == BPF_MAP_TYPE_HASH_OF_MAPS;
+}
+
+static bool is_array_map(uint32_t type)
+{
+    return type == BPF_MAP_TYPE_ARRAY || type == BPF_MAP_TYPE_PERCPU_ARRAY;
+}
+
+/******************************************************************************
+ * Reading maps
+ *****************************************************************************/
+
+static void free_map_entries(snapshot_map_entries_t *entries)
+{
+    if (entries->keys != NULL) {
+        free(entries->keys);
+    }
+    if (entries->values != NULL) {
+        free(entries->values);
+    }
+    entries->keys = NULL;
+    entries->values = NULL;
+    entries->n_entries = 0;
+}
+
+static int read_map_entries_batch(int fd, const nikss_snapshot_map_t *map, snapshot_map_entries_t *entries)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = 0,
+                        .flags = 0,
+    );
+
+    /* For hash maps batch token is a bucket number, for arrays it is a key */
+    size_t token_size = map->key_size > sizeof(uint64_t) ? map->key_size : sizeof(uint64_t);
+    char *token = calloc(1, token_size);
+    if (token == NULL) {
+        return ENOMEM;
+    }
+
+    int ret = NO_ERROR;
+    bool first = true;
+    entries->n_entries = 0;
+    while (entries->n_entries < map->max_entries) {
+        uint32_t count = map->max_entries - entries->n_entries;
+        int err = bpf_map_lookup_batch(fd, first ? NULL : token, token,
+                                       entries->keys + entries->n_entries * map->key_size,
+                                       entries->values + entries->n_entries * map->value_buffer_size,
+                                       &count, &opts);
+        if (err != 0) {
+            err = errno;
+        }
+        if (err != NO_ERROR && err != ENOENT) {
+            ret = err;
+            break;
+        }
+        entries->n_entries += count;
+        first = false;
+        if (err == ENOENT || count == 0) {
+            break;
+        }
+    }
+
+    free(token);
+    return ret;
+}
+
+static int read_map_entries_one_by_one(int fd, const nikss_snapshot_map_t *map, snapshot_map_entries_t *entries)
+{
+    char *prev_key = malloc(map->key_size);
+    if (prev_key == NULL) {
+        return ENOMEM;
+    }
+
+    bool has_prev_key = false;
+    entries->n_entries = 0;
+    while (entries->n_entries < map->max_entries) {
+        char *key = entries->keys + entries->n_entries * map->key_size;
+        char *value = entries->values + entries->n_entries * map->value_buffer_size;
+        if (bpf_map_get_next_key(fd, has_prev_key ? prev_key : NULL, key) != 0) {
+            break;
+        }
+        memcpy(prev_key, key, map->key_size);
+        has_prev_key = true;
+
+        /* Unused slots of array of maps have a key but no value */
+        if (bpf_map_lookup_elem(fd, key, value) == 0) {
+            entries->n_entries++;
+        }
+    }
+
+    free(prev_key);
+    return NO_ERROR;
+}
+
+static int read_map_entries(int fd, const nikss_snapshot_map_t *map, snapshot_map_entries_t *entries)
+{
+    memset(entries, 0, sizeof(snapshot_map_entries_t));
+    if (map->max_entries == 0) {
+        return NO_ERROR;
+    }
+
+    entries->keys = malloc((size_t) map->max_entries * map->key_size);
+    entries->values = malloc((size_t) map->max_entries * map->value_buffer_size);
+    if (entries->keys == NULL || entries->values == NULL) {
+        free_map_entries(entries);
+        return ENOMEM;
+    }
+
+    /* Kernel or map type might not support batch lookup */
+    if (read_map_entries_batch(fd, map, entries) == NO_ERROR) {
+        return NO_ERROR;
+    }
+
+    return read_map_entries_one_by_one(fd, map, entries);
+}
+
+static int compare_snapshot_keys(const void *a, const void *b, void *arg)
+{
+    const snapshot_key_order_t *order = arg;
+    size_t idx_a = *((const size_t *) a);
+    size_t idx_b = *((const size_t *) b);
+
+    return memcmp(order->keys + idx_a * order->key_size, order->keys + idx_b * order->key_size, order->key_size);
+}
+
+static size_t *sort_map_entries(const snapshot_map_entries_t *entries, size_t key_size)
+{
+    size_t *sorted = malloc((entries->n_entries + 1) * sizeof(size_t));
+    if (sorted == NULL) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < entries->n_entries; i++) {
+        sorted[i] = i;
+    }
+    snapshot_key_order_t order = { .keys = entries->keys, .key_size = key_size };
+    qsort_r(sorted, entries->n_entries, sizeof(size_t), compare_snapshot_keys, &order);
+
+    return sorted;
+}
+
+/* Describes fields of key and value, e.g. "key{dst_addr@0:4};value{action@0:4,port@4:4}" */
+static char *build_map_schema(nikss_btf_t *btf, nikss_bpf_map_descriptor_t *md)
+{
+    char *schema = NULL;
+    size_t schema_size = 0;
+    FILE *stream = open_memstream(&schema, &schema_size);
+    if (stream == NULL) {
+        return NULL;
+    }
+
+    if (btf->btf != NULL && md->key_type_id != 0 && md->value_type_id != 0) {
+        const char *parts[] = { "key", "value" };
+        uint32_t type_ids[] = { md->key_type_id, md->value_type_id };
+        size_t sizes[] = { md->key_size, md->value_size };
+
+        for (int part = 0; part < 2; part++) {
+            nikss_struct_field_descriptor_set_t fds = { 0 };
+            bool first_field = true;
+            fprintf(stream, "%s%s{", part > 0 ? ";" : "", parts[part]);
+            if (parse_struct_type(btf, type_ids[part], sizes[part], &fds) == NO_ERROR) {
+                for (size_t i = 0; i < fds.n_fields; i++) {
+                    const nikss_struct_field_descriptor_t *field = &fds.fields[i];
+                    if (field->type != NIKSS_STRUCT_FIELD_TYPE_DATA) {
+                        continue;
+                    }
+                    fprintf(stream, "%s%s@%zu:%zu", first_field ? "" : ",", field->name != NULL ? field->name : "",
+                            field->data_offset, field->data_len);
+                    first_field = false;
+                }
+            }
+            fputc('}', stream);
+            free_struct_field_descriptor_set(&fds);
+        }
+    }
+
+    fclose(stream);
+    return schema;
+}
+
+/******************************************************************************
+ * Export
+ *****************************************************************************/
+
+static int begin_block(FILE *file, uint64_t *offset)
+{
+    static const char zeros[8] = { 0 };
+
+    long pos = ftell(file);
+    if (pos < 0) {
+        return errno;
+    }
+    size_t padding = (8 - (size_t) pos % 8) % 8;
+    if (padding > 0 && fwrite(zeros, 1, padding, file) != padding) {
+        return EIO;
+    }
+    *offset = (uint64_t) pos + padding;
+
+    return NO_ERROR;
+}
+
+static int append_map_record(snapshot_writer_t *writer, size_t *idx)
+{
+    if (writer->n_maps >= NIKSS_SNAPSHOT_NO_PARENT) {
+        return EFBIG;
+    }
+    if (writer->n_maps >= writer->capacity) {
+        size_t new_capacity = writer->capacity == 0 ? 64 : writer->capacity * 2;
+        nikss_snapshot_map_t *maps = realloc(writer->maps, new_capacity * sizeof(nikss_snapshot_map_t));
+        if (maps == NULL) {
+            return ENOMEM;
+        }
+        writer->maps = maps;
+        writer->capacity = new_capacity;
+    }
+
+    *idx = writer->n_maps++;
+    memset(&writer->maps[*idx], 0, sizeof(nikss_snapshot_map_t));
+
+    return NO_ERROR;
+}
+
+static int write_map_blocks(FILE *file, nikss_snapshot_map_t *map, const char *schema,
+                            const snapshot_map_entries_t *entries, const size_t *sorted, size_t first_inner_idx)
+{
+    map->schema_size = strlen(schema) + 1;
+    int ret = begin_block(file, &map->schema_offset);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+    if (fwrite(schema, 1, map->schema_size, file) != map->schema_size) {
+        return EIO;
+    }
+
+    if ((ret = begin_block(file, &map->keys_offset)) != NO_ERROR) {
+        return ret;
+    }
+    for (size_t i = 0; i < entries->n_entries; i++) {
+        if (fwrite(entries->keys + sorted[i] * map->key_size, map->key_size, 1, file) != 1) {
+            return EIO;
+        }
+    }
+
+    if ((ret = begin_block(file, &map->values_offset)) != NO_ERROR) {
+        return ret;
+    }
+    for (size_t i = 0; i < entries->n_entries; i++) {
+        size_t written;
+        if (is_map_in_map(map->type)) {
+            /* ID of inner map is meaningless outside of this system, store index of its record */
+            uint32_t inner_idx = (uint32_t) (first_inner_idx + i);
+            written = fwrite(&inner_idx, sizeof(inner_idx), 1, file);
+        } else {
+            written = fwrite(entries->values + sorted[i] * map->value_buffer_size, map->value_buffer_size, 1, file);
+        }
+        if (written != 1) {
+            return EIO;
+        }
+    }
+    map->n_entries = entries->n_entries;
+
+    return NO_ERROR;
+}
+
+static void build_inner_map_name(char *buffer, size_t maxlen, const char *outer_name, const char *key, size_t key_size)
+{
+    int len = snprintf(buffer, maxlen, "%s/", outer_name);
+    for (size_t i = 0; i < key_size && len > 0 && (size_t) len + 2 < maxlen; i++) {
+        len += snprintf(buffer + len, maxlen - len, "%02x", (unsigned char) key[i]);
+    }
+}
+
+static int dump_map(snapshot_writer_t *writer, const char *name, int fd, const char *schema, uint32_t parent)
+{
+    struct bpf_map_info info = {};
+    uint32_t info_len = sizeof(info);
+    if (bpf_obj_get_info_by_fd(fd, &info, &info_len) != 0) {
+        int ret = errno;
+        fprintf(stderr, "map %s: can't get info: %s\n", name, strerror(ret));
+        return ret;
+    }
+
+    size_t idx = 0;
+    int ret = append_map_record(writer, &idx);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+
+    nikss_snapshot_map_t *map = &writer->maps[idx];
+    snprintf(map->name, sizeof(map->name), "%s", name);
+    map->type = info.type;
+    map->key_size = info.key_size;
+    map->value_size = info.value_size;
+    map->max_entries = info.max_entries;
+    map->map_flags = info.map_flags;
+    map->parent = parent;
+    nikss_bpf_map_descriptor_t md = {
+            .fd = fd,
+            .type = info.type,
+            .key_size = info.key_size,
+            .value_size = info.value_size,
+            .max_entries = info.max_entries,
+    };
+    map->value_buffer_size = get_map_value_buffer_size(&md);
+
+    snapshot_map_entries_t entries;
+    size_t *sorted = NULL;
+    ret = read_map_entries(fd, map, &entries);
+    if (ret == NO_ERROR) {
+        sorted = sort_map_entries(&entries, map->key_size);
+        if (sorted == NULL) {
+            ret = ENOMEM;
+        }
+    }
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "map %s: failed to read entries: %s\n", name, strerror(ret));
+        goto clean_up;
+    }
+
+    ret = write_map_blocks(writer->file, map, schema, &entries, sorted, idx + 1);
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to write snapshot: %s\n", strerror(ret));
+        goto clean_up;
+    }
+    if (is_map_in_map(map->type)) {
+        /* Record of outer map is written, so it is no longer used; writer->maps might be reallocated */
+        map->value_buffer_size = sizeof(uint32_t);
+        map = NULL;
+    }
+
+    /* Inner maps are dumped in the order of outer keys, right after the outer map */
+    for (size_t i = 0; i < entries.n_entries && is_map_in_map(info.type); i++) {
+        char inner_name[NIKSS_SNAPSHOT_MAP_NAME_LEN];
+        const char *key = entries.keys + sorted[i] * info.key_size;
+        uint32_t inner_id = 0;
+        memcpy(&inner_id, entries.values + sorted[i] * info.value_size, sizeof(inner_id));
+        build_inner_map_name(inner_name, sizeof(inner_name), name, key, info.key_size);
+
+        int inner_fd = bpf_map_get_fd_by_id(inner_id);
+        if (inner_fd < 0) {
+            ret = errno;
+            fprintf(stderr, "map %s: can't open inner map: %s\n", inner_name, strerror(ret));
+            goto clean_up;
+        }
+        ret = dump_map(writer, inner_name, inner_fd, "", (uint32_t) idx);
+        close_object_fd(&inner_fd);
+        if (ret != NO_ERROR) {
+            goto clean_up;
+        }
+    }
+
+clean_up:
+    free_map_entries(&entries);
+    if (sorted != NULL) {
+        free(sorted);
+    }
+
+    return ret;
+}
+
+static int dump_pipeline_maps(nikss_context_t *ctx, snapshot_writer_t *writer, nikss_btf_t *btf)
+{
+    char maps_path[256];
+    build_ebpf_map_filename(maps_path, sizeof(maps_path), ctx, "");
+    DIR *directory = opendir(maps_path);
+    if (directory == NULL) {
+        int ret = errno;
+        fprintf(stderr, "failed to open maps of the pipeline: %s\n", strerror(ret));
+        return ret;
+    }
+
+    int ret = NO_ERROR;
+    struct dirent *file = NULL;
+    while ((file = readdir(directory)) != NULL) {
+        const char *name = file->d_name;
+        /* Ports are attached again when node is restored */
+        if (name[0] == '.' || strcmp(name, PORTS_REGISTRY) == 0) {
+            continue;
+        }
+
+        nikss_bpf_map_descriptor_t md = { .fd = -1 };
+        if (open_bpf_map(ctx, name, btf, &md) != NO_ERROR) {
+            continue;
+        }
+        if (!is_pipeline_state_map(name, md.type)) {
+            close_object_fd(&md.fd);
+            continue;
+        }
+
+        char *schema = build_map_schema(btf, &md);
+        if (schema == NULL) {
+            ret = ENOMEM;
+        } else {
+            ret = dump_map(writer, name, md.fd, schema, NIKSS_SNAPSHOT_NO_PARENT);
+            free(schema);
+        }
+        close_object_fd(&md.fd);
+        if (ret != NO_ERROR) {
+            break;
+        }
+    }
+
+    closedir(directory);
+    return ret;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_snapshot_export(nikss_context_t *ctx, const char *path)
+{
+    nikss_snapshot_header_t header;
+    snapshot_writer_t writer;
+    nikss_btf_t btf;
+    int ret = NO_ERROR;
+
+    if (ctx == NULL || path == NULL) {
+        return EINVAL;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memset(&writer, 0, sizeof(writer));
+    init_btf(&btf);
+    if (load_btf(ctx, &btf) != NO_ERROR) {
+        fprintf(stderr, "warning: BTF not available, snapshot will not contain schema of maps\n");
+    }
+
+    writer.file = fopen(path, "wb");
+    if (writer.file == NULL) {
+        ret = errno;
+        fprintf(stderr, "%s: %s\n", path, strerror(ret));
+        goto clean_up;
+    }
+
+    /* Header is written at the end, when offsets are known */
+    if (fwrite(&header, sizeof(header), 1, writer.file) != 1) {
+        ret = EIO;
+        goto clean_up;
+    }
+
+    ret = dump_pipeline_maps(ctx, &writer, &btf);
+    if (ret != NO_ERROR) {
+        goto clean_up;
+    }
+
+    if ((ret = begin_block(writer.file, &header.maps_offset)) != NO_ERROR) {
+        goto clean_up;
+    }
+    if (writer.n_maps > 0 && fwrite(writer.maps, sizeof(nikss_snapshot_map_t), writer.n_maps, writer.file) != writer.n_maps) {
+        ret = EIO;
+        goto clean_up;
+    }
+
+    memcpy(header.magic, NIKSS_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = NIKSS_SNAPSHOT_VERSION;
+    header.pipeline_id = ctx->pipeline_id;
+    header.n_maps = (uint32_t) writer.n_maps;
+    header.n_cpus = (uint32_t) libbpf_num_possible_cpus();
+    header.file_size = (uint64_t) ftell(writer.file);
+    if (fseek(writer.file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, writer.file) != 1) {
+        ret = EIO;
+    }
+
+clean_up:
+    if (writer.file != NULL) {
+        if (fclose(writer.file) != 0 && ret == NO_ERROR) {
+            ret = errno;
+        }
+        if (ret != NO_ERROR) {
+            fprintf(stderr, "failed to write snapshot: %s\n", strerror(ret));
+            unlink(path);
+        }
+    }
+    if (writer.maps != NULL) {
+        free(writer.maps);
+    }
+    free_btf(&btf);
+
+    return ret;
+}
+
+/******************************************************************************
+ * Reading snapshot
+ *****************************************************************************/
+
+void nikss_snapshot_init(nikss_snapshot_t *snapshot)
+{
+    if (snapshot == NULL) {
+        return;
+    }
+    memset(snapshot, 0, sizeof(nikss_snapshot_t));
+}
+
+void nikss_snapshot_close(nikss_snapshot_t *snapshot)
+{
+    if (snapshot == NULL) {
+        return;
+    }
+    if (snapshot->base != NULL) {
+        munmap(snapshot->base, snapshot->size);
+    }
+    nikss_snapshot_init(snapshot);
+}
+
+static bool is_block_in_file(uint64_t offset, uint64_t n_elements, uint64_t element_size, size_t file_size)
+{
+    if (offset > file_size) {
+        return false;
+    }
+    return element_size == 0 || n_elements <= (file_size - offset) / element_size;
+}
+
+static bool is_valid_snapshot(const nikss_snapshot_t *snapshot)
+{
+    const nikss_snapshot_header_t *header = snapshot->header;
+
+    if (memcmp(header->magic, NIKSS_SNAPSHOT_MAGIC, sizeof(header->magic)) != 0) {
+        fprintf(stderr, "not a snapshot file\n");
+        return false;
+    }
+    if (header->version != NIKSS_SNAPSHOT_VERSION) {
+        fprintf(stderr, "unsupported snapshot version %u\n", header->version);
+        return false;
+    }
+    if (header->file_size != snapshot->size || header->maps_offset % 8 != 0 ||
+        !is_block_in_file(header->maps_offset, header->n_maps, sizeof(nikss_snapshot_map_t), snapshot->size)) {
+        fprintf(stderr, "snapshot file is truncated or corrupted\n");
+        return false;
+    }
+
+    for (uint32_t i = 0; i < header->n_maps; i++) {
+        const nikss_snapshot_map_t *map = &snapshot->maps[i];
+        const char *schema = (const char *) snapshot->base + map->schema_offset;
+        if (memchr(map->name, '\0', sizeof(map->name)) == NULL || map->key_size == 0 ||
+            (map->parent != NIKSS_SNAPSHOT_NO_PARENT && map->parent >= header->n_maps) ||
+            map->schema_size == 0 || !is_block_in_file(map->schema_offset, map->schema_size, 1, snapshot->size) ||
+            schema[map->schema_size - 1] != '\0' ||
+            !is_block_in_file(map->keys_offset, map->n_entries, map->key_size, snapshot->size) ||
+            !is_block_in_file(map->values_offset, map->n_entries, map->value_buffer_size, snapshot->size) ||
+            (is_map_in_map(map->type) && map->value_buffer_size != sizeof(uint32_t))) {
+            fprintf(stderr, "snapshot file is corrupted (map %u)\n", i);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_snapshot_open(nikss_snapshot_t *snapshot, const char *path)
+{
+    if (snapshot == NULL || path == NULL) {
+        return EINVAL;
+    }
+    nikss_snapshot_init(snapshot);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        int ret = errno;
+        fprintf(stderr, "%s: %s\n", path, strerror(ret));
+        return ret;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(nikss_snapshot_header_t)) {
+        fprintf(stderr, "%s: not a snapshot file\n", path);
+        close(fd);
+        return EINVAL;
+    }
+
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        int ret = errno;
+        fprintf(stderr, "%s: failed to map file: %s\n", path, strerror(ret));
+        return ret;
+    }
+
+    snapshot->base = base;
+    snapshot->size = st.st_size;
+    snapshot->header = base;
+    snapshot->maps = (const nikss_snapshot_map_t *) ((const char *) base + snapshot->header->maps_offset);
+    if (!is_valid_snapshot(snapshot)) {
+        nikss_snapshot_close(snapshot);
+        return EINVAL;
+    }
+
+    return NO_ERROR;
+}
+
+size_t nikss_snapshot_get_n_maps(const nikss_snapshot_t *snapshot)
+{
+    if (snapshot == NULL || snapshot->header == NULL) {
+        return 0;
+    }
+    return snapshot->header->n_maps;
+}
+
+const nikss_snapshot_map_t *nikss_snapshot_get_map(const nikss_snapshot_t *snapshot, size_t idx)
+{
+    if (idx >= nikss_snapshot_get_n_maps(snapshot)) {
+        return NULL;
+    }
+    return &snapshot->maps[idx];
+}
+
+const nikss_snapshot_map_t *nikss_snapshot_find_map(const nikss_snapshot_t *snapshot, const char *name)
+{
+    size_t n_maps = nikss_snapshot_get_n_maps(snapshot);
+    for (size_t i = 0; i < n_maps && name != NULL; i++) {
+        if (strcmp(snapshot->maps[i].name, name) == 0) {
+            return &snapshot->maps[i];
+        }
+    }
+    return NULL;
+}
+
+const void *nikss_snapshot_get_map_keys(const nikss_snapshot_t *snapshot, const nikss_snapshot_map_t *map)
+{
+    if (snapshot == NULL || map == NULL) {
+        return NULL;
+    }
+    return (const char *) snapshot->base + map->keys_offset;
+}
+
+const void *nikss_snapshot_get_map_values(const nikss_snapshot_t *snapshot, const nikss_snapshot_map_t *map)
+{
+    if (snapshot == NULL || map == NULL) {
+        return NULL;
+    }
+    return (const char *) snapshot->base + map->values_offset;
+}
+
+const char *nikss_snapshot_get_map_schema(const nikss_snapshot_t *snapshot, const nikss_snapshot_map_t *map)
+{
+    if (snapshot == NULL || map == NULL) {
+        return NULL;
+    }
+    return (const char *) snapshot->base + map->schema_offset;
+}
+
+/******************************************************************************
+ * Import
+ *****************************************************************************/
+
+static int write_map_entries(int fd, const char *keys, const char *values, size_t n_entries,
+                             size_t key_size, size_t value_size)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = BPF_ANY,
+                        .flags = 0,
+    );
+
+    if (n_entries == 0) {
+        return NO_ERROR;
+    }
+
+    uint32_t processed = (uint32_t) n_entries;
+    if (bpf_map_update_batch(fd, (void *) keys, (void *) values, &processed, &opts) == 0) {
+        return NO_ERROR;
+    }
+    /* Kernels without batch operations do not update the counter */
+    if (processed >= n_entries) {
+        processed = 0;
+    }
+    for (size_t i = processed; i < n_entries; i++) {
+        if (bpf_map_update_elem(fd, keys + i * key_size, values + i * value_size, BPF_ANY) != 0) {
+            return errno;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+static int delete_map_entries(int fd, const char *keys, size_t n_entries, size_t key_size)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = 0,
+                        .flags = 0,
+    );
+
+    if (n_entries == 0) {
+        return NO_ERROR;
+    }
+
+    uint32_t processed = (uint32_t) n_entries;
+    if (bpf_map_delete_batch(fd, (void *) keys, &processed, &opts) == 0) {
+        return NO_ERROR;
+    }
+    if (processed >= n_entries) {
+        processed = 0;
+    }
+    for (size_t i = processed; i < n_entries; i++) {
+        if (bpf_map_delete_elem(fd, keys + i * key_size) != 0 && errno != ENOENT) {
+            return errno;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+static bool snapshot_has_key(const char *keys, size_t n_entries, size_t key_size, const char *key)
+{
+    size_t low = 0;
+    size_t high = n_entries;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        int cmp = memcmp(keys + mid * key_size, key, key_size);
+        if (cmp == 0) {
+            return true;
+        }
+        if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return false;
+}
+
+/* Removes entries which are not present in the snapshot, array maps always have all the entries */
+static int delete_stale_entries(int fd, const nikss_snapshot_map_t *map, const char *keys)
+{
+    if (is_array_map(map->type)) {
+        return NO_ERROR;
+    }
+
+    size_t n_stale = 0;
+    size_t capacity = 0;
+    char *stale = NULL;
+    char *key = malloc(map->key_size);
+    char *prev_key = malloc(map->key_size);
+    int ret = NO_ERROR;
+    if (key == NULL || prev_key == NULL) {
+        ret = ENOMEM;
+        goto clean_up;
+    }
+
+    bool has_prev_key = false;
+    while (bpf_map_get_next_key(fd, has_prev_key ? prev_key : NULL, key) == 0) {
+        memcpy(prev_key, key, map->key_size);
+        has_prev_key = true;
+        if (snapshot_has_key(keys, map->n_entries, map->key_size, key)) {
+            continue;
+        }
+
+        if (n_stale >= capacity) {
+            size_t new_capacity = capacity == 0 ? 64 : capacity * 2;
+            char *tmp = realloc(stale, new_capacity * map->key_size);
+            if (tmp == NULL) {
+                ret = ENOMEM;
+                goto clean_up;
+            }
+            stale = tmp;
+            capacity = new_capacity;
+        }
+        memcpy(stale + n_stale * map->key_size, key, map->key_size);
+        n_stale++;
+    }
+
+    ret = delete_map_entries(fd, stale, n_stale, map->key_size);
+
+clean_up:
+    if (key != NULL) {
+        free(key);
+    }
+    if (prev_key != NULL) {
+        free(prev_key);
+    }
+    if (stale != NULL) {
+        free(stale);
+    }
+
+    return ret;
+}
+
+/* Per-CPU values are stored for every CPU of the exporting system, extra CPUs are cleared */
+static char *convert_snapshot_values(const nikss_snapshot_map_t *map, const char *values, size_t value_buffer_size)
+{
+    char *buffer = calloc(map->n_entries + 1, value_buffer_size);
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+    size_t copy_size = map->value_buffer_size < value_buffer_size ? map->value_buffer_size : value_buffer_size;
+    for (size_t i = 0; i < map->n_entries; i++) {
+        memcpy(buffer + i * value_buffer_size, values + i * map->value_buffer_size, copy_size);
+    }
+
+    return buffer;
+}
+
+/* Writes entries of map from the snapshot, snapshot must not be a map-in-map */
+static int write_snapshot_entries(int fd, const nikss_snapshot_t *snapshot, const nikss_snapshot_map_t *map,
+                                  const nikss_bpf_map_descriptor_t *md)
+{
+    const char *keys = nikss_snapshot_get_map_keys(snapshot, map);
+    const char *values = nikss_snapshot_get_map_values(snapshot, map);
+    size_t value_buffer_size = get_map_value_buffer_size(md);
+    char *buffer = NULL;
+
+    if (value_buffer_size != map->value_buffer_size) {
+        buffer = convert_snapshot_values(map, values, value_buffer_size);
+        if (buffer == NULL) {
+            return ENOMEM;
+        }
+        values = buffer;
+    }
+
+    int ret = write_map_entries(fd, keys, values, map->n_entries, map->key_size, value_buffer_size);
+
+    if (buffer != NULL) {
+        free(buffer);
+    }
+
+    return ret;
+}
+
+/* Inner maps are created from the snapshot and replace the current ones, fds are stored in inner_fds */
+static int restore_inner_maps(const nikss_snapshot_t *snapshot, const nikss_snapshot_map_t *map, int *inner_fds)
+{
+    const char *values = nikss_snapshot_get_map_values(snapshot, map);
+    size_t map_idx = map - snapshot->maps;
+
+    for (size_t i = 0; i < map->n_entries; i++) {
+        uint32_t inner_idx = 0;
+        memcpy(&inner_idx, values + i * sizeof(uint32_t), sizeof(inner_idx));
+        const nikss_snapshot_map_t *inner = nikss_snapshot_get_map(snapshot, inner_idx);
+        if (inner == NULL || inner->parent != map_idx || is_map_in_map(inner->type)) {
+            fprintf(stderr, "map %s: invalid inner map\n", map->name);
+            return EINVAL;
+        }
+
+        struct bpf_create_map_attr attr = {
+                .map_type = inner->type,
+                .key_size = inner->key_size,
+                .value_size = inner->value_size,
+                .max_entries = inner->max_entries,
+                .map_flags = inner->map_flags,
+        };
+        inner_fds[i] = bpf_create_map_xattr(&attr);
+        if (inner_fds[i] < 0) {
+            int ret = errno;
+            fprintf(stderr, "map %s: failed to create: %s\n", inner->name, strerror(ret));
+            return ret;
+        }
+
+        nikss_bpf_map_descriptor_t inner_md = {
+                .fd = inner_fds[i],
+                .type = inner->type,
+                .key_size = inner->key_size,
+                .value_size = inner->value_size,
+                .max_entries = inner->max_entries,
+        };
+        int ret = write_snapshot_entries(inner_fds[i], snapshot, inner, &inner_md);
+        if (ret != NO_ERROR) {
+            fprintf(stderr, "map %s: failed to restore: %s\n", inner->name, strerror(ret));
+            return ret;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+static int restore_map_entries(int fd, const nikss_snapshot_t *snapshot, const nikss_snapshot_map_t *map,
+                               const nikss_bpf_map_descriptor_t *md)
+{
+    const char *keys = nikss_snapshot_get_map_keys(snapshot, map);
+    int ret = NO_ERROR;
+
+    if (is_map_in_map(map->type)) {
+        int *inner_fds = malloc((map->n_entries + 1) * sizeof(int));
+        if (inner_fds == NULL) {
+            return ENOMEM;
+        }
+        for (size_t i = 0; i < map->n_entries; i++) {
+            inner_fds[i] = -1;
+        }
+
+        ret = restore_inner_maps(snapshot, map, inner_fds);
+        if (ret == NO_ERROR) {
+            ret = write_map_entries(fd, keys, (const char *) inner_fds, map->n_entries, map->key_size, sizeof(int));
+        }
+
+        for (size_t i = 0; i < map->n_entries; i++) {
+            close_object_fd(&inner_fds[i]);
+        }
+        free(inner_fds);
+    } else {
+        ret = write_snapshot_entries(fd, snapshot, map, md);
+    }
+
+    if (ret == NO_ERROR) {
+        ret = delete_stale_entries(fd, map, keys);
+    }
+
+    return ret;
+}
+
+static bool snapshot_map_is_compatible(const nikss_snapshot_t *snapshot, const nikss_snapshot_map_t *map,
+                                       nikss_bpf_map_descriptor_t *md, nikss_btf_t *btf)
+{
+    if (md->type != map->type || md->key_size != map->key_size || md->value_size != map->value_size) {
+        fprintf(stderr, "map %s: definition changed, skipped\n", map->name);
+        return false;
+    }
+
+    /* Without schema only layout of map can be compared */
+    const char *snapshot_schema = nikss_snapshot_get_map_schema(snapshot, map);
+    char *schema = build_map_schema(btf, md);
+    bool compatible = schema == NULL || snapshot_schema[0] == '\0' || schema[0] == '\0' ||
+                      strcmp(schema, snapshot_schema) == 0;
+    if (!compatible) {
+        fprintf(stderr, "map %s: key or value type changed, skipped\n", map->name);
+    }
+    if (schema != NULL) {
+        free(schema);
+    }
+
+    return compatible;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_snapshot_import(nikss_context_t *ctx, const nikss_snapshot_t *snapshot)
+{
+    nikss_btf_t btf;
+    int ret = NO_ERROR;
+
+    if (ctx == NULL || snapshot == NULL || snapshot->header == NULL) {
+        return EINVAL;
+    }
+
+    init_btf(&btf);
+    if (load_btf(ctx, &btf) != NO_ERROR) {
+        fprintf(stderr, "warning: BTF not available, maps are compared only by their definition\n");
+    }
+
+    for (size_t i = 0; i < nikss_snapshot_get_n_maps(snapshot); i++) {
+        const nikss_snapshot_map_t *map = nikss_snapshot_get_map(snapshot, i);
+        if (map->parent != NIKSS_SNAPSHOT_NO_PARENT) {
+            continue;
+        }
+
+        nikss_bpf_map_descriptor_t md = { .fd = -1 };
+        if (open_bpf_map(ctx, map->name, &btf, &md) != NO_ERROR) {
+            fprintf(stderr, "map %s: not present in the pipeline, skipped\n", map->name);
+            continue;
+        }
+
+        if (snapshot_map_is_compatible(snapshot, map, &md, &btf)) {
+            int err = restore_map_entries(md.fd, snapshot, map, &md);
+            if (err != NO_ERROR) {
+                fprintf(stderr, "map %s: failed to restore: %s\n", map->name, strerror(err));
+                if (ret == NO_ERROR) {
+                    ret = err;
+                }
+            }
+        }
+        close_object_fd(&md.fd);
+    }
+
+    free_btf(&btf);
+
+    return ret;
+}
+
+/******************************************************************************
+ * Diff
+ *****************************************************************************/
+
+static int report_entry_diff(const nikss_snapshot_t *snapshot, const nikss_snapshot_map_t *map, size_t idx,
+                             nikss_snapshot_diff_type_t type, nikss_snapshot_diff_cb_t cb, void *arg)
+{
+    const char *keys = nikss_snapshot_get_map_keys(snapshot, map);
+    const char *values = nikss_snapshot_get_map_values(snapshot, map);
+    const void *value = is_map_in_map(map->type) ? NULL : values + idx * map->value_buffer_size;
+    size_t value_size = value != NULL ? map->value_buffer_size : 0;
+
+    nikss_snapshot_diff_entry_t entry = {
+            .map_name = map->name,
+            .type = type,
+            .key = keys + idx * map->key_size,
+            .key_size = map->key_size,
+            .old_value = type == NIKSS_SNAPSHOT_ENTRY_REMOVED ? value : NULL,
+            .old_value_size = type == NIKSS_SNAPSHOT_ENTRY_REMOVED ? value_size : 0,
+            .new_value = type == NIKSS_SNAPSHOT_ENTRY_ADDED ? value : NULL,
+            .new_value_size = type == NIKSS_SNAPSHOT_ENTRY_ADDED ? value_size : 0,
+    };
+
+    return cb(&entry, arg);
+}
+
+static int diff_whole_map(const nikss_snapshot_t *snapshot, const nikss_snapshot_map_t *map,
+                          nikss_snapshot_diff_type_t type, nikss_snapshot_diff_cb_t cb, void *arg)
+{
+    for (size_t i = 0; i < map->n_entries; i++) {
+        int ret = report_entry_diff(snapshot, map, i, type, cb, arg);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/* Keys of both maps are sorted, so they are merged in a single pass */
+static int diff_map(const nikss_snapshot_t *old_snapshot, const nikss_snapshot_map_t *old_map,
+                    const nikss_snapshot_t *new_snapshot, const nikss_snapshot_map_t *new_map,
+                    nikss_snapshot_diff_cb_t cb, void *arg)
+{
+    if (old_map->key_size != new_map->key_size || old_map->type != new_map->type) {
+        int ret = diff_whole_map(old_snapshot, old_map, NIKSS_SNAPSHOT_ENTRY_REMOVED, cb, arg);
+        if (ret != 0) {
+            return ret;
+        }
+        return diff_whole_map(new_snapshot, new_map, NIKSS_SNAPSHOT_ENTRY_ADDED, cb, arg);
+    }
+
+    const char *old_keys = nikss_snapshot_get_map_keys(old_snapshot, old_map);
+    const char *new_keys = nikss_snapshot_get_map_keys(new_snapshot, new_map);
+    const char *old_values = nikss_snapshot_get_map_values(old_snapshot, old_map);
+    const char *new_values = nikss_snapshot_get_map_values(new_snapshot, new_map);
+    size_t key_size = old_map->key_size;
+    /* Inner maps are compared as separate maps */
+    bool compare_values = !is_map_in_map(old_map->type);
+    size_t i = 0;
+    size_t j = 0;
+    int ret = 0;
+
+    while (ret == 0 && (i < old_map->n_entries || j < new_map->n_entries)) {
+        int cmp;
+        if (i >= old_map->n_entries) {
+            cmp = 1;
+        } else if (j >= new_map->n_entries) {
+            cmp = -1;
+        } else {
+            cmp = memcmp(old_keys + i * key_size, new_keys + j * key_size, key_size);
+        }
+
+        if (cmp < 0) {
+            ret = report_entry_diff(old_snapshot, old_map, i++, NIKSS_SNAPSHOT_ENTRY_REMOVED, cb, arg);
+        } else if (cmp > 0) {
+            ret = report_entry_diff(new_snapshot, new_map, j++, NIKSS_SNAPSHOT_ENTRY_ADDED, cb, arg);
+        } else {
+            const char *old_value = old_values + i * old_map->value_buffer_size;
+            const char *new_value = new_values + j * new_map->value_buffer_size;
+            if (compare_values && (old_map->value_buffer_size != new_map->value_buffer_size ||
+                                   memcmp(old_value, new_value, old_map->value_buffer_size) != 0)) {
+                nikss_snapshot_diff_entry_t entry = {
+                        .map_name = old_map->name,
+                        .type = NIKSS_SNAPSHOT_ENTRY_CHANGED,
+                        .key = old_keys + i * key_size,
+                        .key_size = key_size,
+                        .old_value = old_value,
+                        .old_value_size = old_map->value_buffer_size,
+                        .new_value = new_value,
+                        .new_value_size = new_map->value_buffer_size,
+                };
+                ret = cb(&entry, arg);
+            }
+            i++;
+            j++;
+        }
+    }
+
+    return ret;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_snapshot_diff(const nikss_snapshot_t *old_snapshot, const nikss_snapshot_t *new_snapshot,
+                        nikss_snapshot_diff_cb_t cb, void *arg)
+{
+    if (old_snapshot == NULL || new_snapshot == NULL || cb == NULL) {
+        return EINVAL;
+    }
+
+    int ret = 0;
+    for (size_t i = 0; i < nikss_snapshot_get_n_maps(old_snapshot) && ret == 0; i++) {
+        const nikss_snapshot_map_t *old_map = nikss_snapshot_get_map(old_snapshot, i);
+        const nikss_snapshot_map_t *new_map = nikss_snapshot_find_map(new_snapshot, old_map->name);
+        if (new_map == NULL) {
+            ret = diff_whole_map(old_snapshot, old_map, NIKSS_SNAPSHOT_ENTRY_REMOVED, cb, arg);
+        } else {
+            ret = diff_map(old_snapshot, old_map, new_snapshot, new_map, cb, arg);
+        }
+    }
+
+    for (size_t i = 0; i < nikss_snapshot_get_n_maps(new_snapshot) && ret == 0; i++) {
+        const nikss_snapshot_map_t *new_map = nikss_snapshot_get_map(new_snapshot, i);
+        if (nikss_snapshot_find_map(old_snapshot, new_map->name) == NULL) {
+            ret = diff_whole_map(new_snapshot, new_map, NIKSS_SNAPSHOT_ENTRY_ADDED, cb, arg);
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include <nikss/nikss.h>
+#include <nikss/nikss_stats.h>
+
+#include "stats.h"
+
+static const char *op_names[NIKSS_STATS_N_OPS] = {
+    [NIKSS_STATS_TABLE_ADD] = "table_add",
+    [NIKSS_STATS_TABLE_UPDATE] = "table_update",
+    [NIKSS_STATS_TABLE_GET] = "table_get",
+    [NIKSS_STATS_TABLE_DEL] = "table_del",
+    [NIKSS_STATS_TERNARY_TUPLE_OPEN] = "ternary_tuple_open",
+    [NIKSS_STATS_LOAD_BTF] = "load_btf",
+    [NIKSS_STATS_BPF_MAP_LOOKUP_ELEM] = "bpf_map_lookup_elem",
+    [NIKSS_STATS_BPF_MAP_UPDATE_ELEM] = "bpf_map_update_elem",
+    [NIKSS_STATS_BPF_MAP_DELETE_ELEM] = "bpf_map_delete_elem",
+    [NIKSS_STATS_BPF_MAP_GET_NEXT_KEY] = "bpf_map_get_next_key",
+    [NIKSS_STATS_BPF_MAP_LOOKUP_AND_DELETE_ELEM] = "bpf_map_lookup_and_delete_elem",
+    [NIKSS_STATS_BPF_MAP_LOOKUP_BATCH] = "bpf_map_lookup_batch",
+    [NIKSS_STATS_BPF_MAP_UPDATE_BATCH] = "bpf_map_update_batch",
+    [NIKSS_STATS_BPF_MAP_DELETE_BATCH] = "bpf_map_delete_batch",
+    [NIKSS_STATS_BPF_MAP_GET_FD_BY_ID] = "bpf_map_get_fd_by_id",
+    [NIKSS_STATS_BPF_OBJ_GET] = "bpf_obj_get",
+};
+
+const char *nikss_stats_op_name(nikss_stats_op_t op)
+{
+    if (op < 0 || op >= NIKSS_STATS_N_OPS) {
+        return NULL;
+    }
+    return op_names[op];
+}
+
+#ifdef NIKSS_STATS
+
+/* Updated with relaxed atomics, so a snapshot might be slightly inconsistent between fields */
+static nikss_stats_t global_stats;  /* NOLINT(cppcoreguidelines-avoid-non-const-global-variables) */
+
+uint64_t stats_timestamp(void)
+{
+    struct timespec ts;
+    int saved_errno = errno;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    errno = saved_errno;
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static unsigned histogram_bucket(uint64_t ns)
+{
+    unsigned bucket = 0;
+    while (ns > 1 && bucket < NIKSS_STATS_HISTOGRAM_BUCKETS - 1) {
+        ns >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/* Preserves errno, callers often read it after the measured call */
+void stats_record(nikss_stats_op_t op, uint64_t start_ns, bool failed)
+{
+    uint64_t elapsed = stats_timestamp() - start_ns;
+    nikss_stats_op_counters_t *counters = &global_stats.ops[op];
+
+    __atomic_fetch_add(&counters->calls, 1, __ATOMIC_RELAXED);
+    if (failed) {
+        __atomic_fetch_add(&counters->errors, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_add(&counters->total_ns, elapsed, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&counters->histogram[histogram_bucket(elapsed)], 1, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&counters->max_ns, __ATOMIC_RELAXED);
+    while (elapsed > max &&
+           !__atomic_compare_exchange_n(&counters->max_ns, &max, elapsed, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+bool nikss_stats_available(void)
+{
+    return true;
+}
+
+int nikss_stats_get(nikss_stats_t *stats)
+{
+    if (stats == NULL) {
+        return EINVAL;
+    }
+
+    for (int op = 0; op < NIKSS_STATS_N_OPS; op++) {
+        const nikss_stats_op_counters_t *src = &global_stats.ops[op];
+        nikss_stats_op_counters_t *dst = &stats->ops[op];
+        dst->calls = __atomic_load_n(&src->calls, __ATOMIC_RELAXED);
+        dst->errors = __atomic_load_n(&src->errors, __ATOMIC_RELAXED);
+        dst->total_ns = __atomic_load_n(&src->total_ns, __ATOMIC_RELAXED);
+        dst->max_ns = __atomic_load_n(&src->max_ns, __ATOMIC_RELAXED);
+        for (int i = 0; i < NIKSS_STATS_HISTOGRAM_BUCKETS; i++) {
+            dst->histogram[i] = __atomic_load_n(&src->histogram[i], __ATOMIC_RELAXED);
+        }
+    }
+
+    return NO_ERROR;
+}
+
+void nikss_stats_reset(void)
+{
+    for (int op = 0; op < NIKSS_STATS_N_OPS; op++) {
+        nikss_stats_op_counters_t *counters = &global_stats.ops[op];
+        __atomic_store_n(&counters->calls, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&counters->errors, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&counters->total_ns, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&counters->max_ns, 0, __ATOMIC_RELAXED);
+        for (int i = 0; i < NIKSS_STATS_HISTOGRAM_BUCKETS; i++) {
+            __atomic_store_n(&counters->histogram[i], 0, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+#else
+
+bool nikss_stats_available(void)
+{
+    return false;
+}
+
+int nikss_stats_get(nikss_stats_t *stats)
+{
+    if (stats == NULL) {
+        return EINVAL;
+    }
+    memset(stats, 0, sizeof(nikss_stats_t));
+    return ENOTSUP;
+}
+
+void nikss_stats_reset(void)
+{
+}
+
+#endif  /* NIKSS_STATS */
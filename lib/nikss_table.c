@@ -18,20 +18,61 @@
 #include <bpf/bpf.h>
 #include <bpf/btf.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <linux/bpf.h>
 #include <linux/btf.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <nikss/nikss.h>
 
+#include "bpf_defs.h"
 #include "btf.h"
 #include "common.h"
 #include "nikss_counter.h"
 #include "nikss_meter.h"
 #include "nikss_table.h"
 
+/* Number of entries read at once from a tuple by many threads, when batch_size is not set */
+#define TERNARY_TUPLE_DUMP_CHUNK_SIZE 256
+/* Number of entries read at once by nikss_table_entry_ctx_dump_direct_objects() when batch size is not set */
+#define TABLE_DUMP_CHUNK_SIZE 1024
+
+/* Evaluates call with ternary table locked when context is thread safe */
+#define TERNARY_TABLE_LOCKED(ctx, call) ({                           \
+        int _lock_fd = -1;                                           \
+        int _ret = lock_ternary_table((ctx), &_lock_fd);             \
+        if (_ret == NO_ERROR) {                                      \
+            _ret = (call);                                           \
+            pipeline_unlock(&_lock_fd);                              \
+        }                                                            \
+        _ret;                                                        \
+    })
+
+static int lock_ternary_table(nikss_table_entry_ctx_t *ctx, int *lock_fd)
+{
+    *lock_fd = -1;
+    if (ctx == NULL || ctx->is_ternary == false || ctx->thread_safe == false) {
+        return NO_ERROR;
+    }
+
+    *lock_fd = pipeline_lock(ctx->pipeline_id);
+    if (*lock_fd < 0) {
+        int err = -(*lock_fd);
+        *lock_fd = -1;
+        fprintf(stderr, "failed to lock pipeline: %s\n", strerror(err));
+        return err;
+    }
+
+    /* Other writers might have changed prefixes while the lock was not held */
+    ctx->prefix_cache_valid = false;
+
+    return NO_ERROR;
+}
+
 void nikss_table_entry_ctx_init(nikss_table_entry_ctx_t *ctx)
 {
     if (ctx == NULL) {
@@ -47,16 +88,104 @@ void nikss_table_entry_ctx_init(nikss_table_entry_ctx_t *ctx)
     ctx->prefixes.fd = -1;
     ctx->tuple_map.fd = -1;
     ctx->cache.fd = -1;
+    ctx->cache_epoch.fd = -1;
+    ctx->dir24.fd = -1;
+    ctx->dir24_tbl8.fd = -1;
+    ctx->dir24_routes.fd = -1;
+    ctx->tuple_numa_node = -1;
 
     nikss_table_entry_init(&ctx->current_entry);
 }
 
+static void reset_table_batch_iterator(nikss_table_entry_ctx_t *ctx)
+{
+    ctx->batch_count = 0;
+    ctx->batch_position = 0;
+    ctx->batch_started = false;
+    ctx->batch_finished = false;
+}
+
+static void free_table_batch_iterator(nikss_table_entry_ctx_t *ctx)
+{
+    if (ctx->batch_keys != NULL) {
+        free(ctx->batch_keys);
+    }
+    ctx->batch_keys = NULL;
+    if (ctx->batch_values != NULL) {
+        free(ctx->batch_values);
+    }
+    ctx->batch_values = NULL;
+    if (ctx->batch_token != NULL) {
+        free(ctx->batch_token);
+    }
+    ctx->batch_token = NULL;
+
+    reset_table_batch_iterator(ctx);
+}
+
+/* Content of a single tuple of ternary table, read by nikss_table_entry_get_next() with tuple_threads > 1 */
+struct nikss_ternary_tuple_dump {
+    char *key_mask;
+    uint32_t inner_map_id;
+    char *keys;
+    char *values;
+    uint32_t count;
+    uint32_t capacity;
+    int error;
+};
+
+static void free_ternary_tuple_dumps(nikss_table_entry_ctx_t *ctx)
+{
+    if (ctx->tuple_dumps != NULL) {
+        for (uint32_t i = 0; i < ctx->n_tuple_dumps; i++) {
+            free(ctx->tuple_dumps[i].key_mask);
+            free(ctx->tuple_dumps[i].keys);
+            free(ctx->tuple_dumps[i].values);
+        }
+        free(ctx->tuple_dumps);
+    }
+    ctx->tuple_dumps = NULL;
+
+    ctx->n_tuple_dumps = 0;
+    ctx->tuple_dump_index = 0;
+    ctx->tuple_dump_position = 0;
+    ctx->tuple_dumps_loaded = false;
+}
+
+static void free_ternary_prefix_cache(nikss_table_entry_ctx_t *ctx)
+{
+    if (ctx->prefix_cache_keys != NULL) {
+        free(ctx->prefix_cache_keys);
+    }
+    ctx->prefix_cache_keys = NULL;
+    if (ctx->prefix_cache_values != NULL) {
+        free(ctx->prefix_cache_values);
+    }
+    ctx->prefix_cache_values = NULL;
+    if (ctx->prefix_cache_priorities != NULL) {
+        free(ctx->prefix_cache_priorities);
+    }
+    ctx->prefix_cache_priorities = NULL;
+
+    ctx->prefix_cache_count = 0;
+    ctx->prefix_cache_capacity = 0;
+    ctx->prefix_cache_valid = false;
+    ctx->prefix_cache_has_priorities = false;
+}
+
 void nikss_table_entry_ctx_free(nikss_table_entry_ctx_t *ctx)
 {
     if (ctx == NULL) {
         return;
     }
 
+    /* Worker uses clone of this context, so it must finish first */
+    nikss_table_entry_ctx_async_stop(ctx);
+
+    table_shadow_free(ctx->shadow);
+    ctx->shadow = NULL;
+    nikss_table_entry_ctx_aging_stop(ctx);
+
     free_btf(&ctx->btf_metadata);
 
     close_object_fd(&(ctx->table.fd));
@@ -64,34 +193,55 @@ void nikss_table_entry_ctx_free(nikss_table_entry_ctx_t *ctx)
     close_object_fd(&(ctx->prefixes.fd));
     close_object_fd(&(ctx->tuple_map.fd));
     close_object_fd(&(ctx->cache.fd));
-
-    if (ctx->direct_counters_ctx != NULL) {
-        for (unsigned i = 0; i < ctx->n_direct_counters; i++) {
-            nikss_direct_counter_ctx_free(&ctx->direct_counters_ctx[i]);
+    close_object_fd(&(ctx->cache_epoch.fd));
+    close_object_fd(&(ctx->dir24.fd));
+    close_object_fd(&(ctx->dir24_tbl8.fd));
+    close_object_fd(&(ctx->dir24_routes.fd));
+
+    /* Metadata of clone is owned by its source */
+    if (ctx->clone_source == NULL) {
+        if (ctx->direct_counters_ctx != NULL) {
+            for (unsigned i = 0; i < ctx->n_direct_counters; i++) {
+                nikss_direct_counter_ctx_free(&ctx->direct_counters_ctx[i]);
+            }
+            free(ctx->direct_counters_ctx);
         }
-        free(ctx->direct_counters_ctx);
-        ctx->direct_counters_ctx = NULL;
-    }
-    ctx->n_direct_counters = 0;
 
-    if (ctx->direct_meters_ctx != NULL) {
-        for (unsigned i = 0; i < ctx->n_direct_meters; i++) {
-            nikss_direct_meter_ctx_free(&ctx->direct_meters_ctx[i]);
+        if (ctx->direct_meters_ctx != NULL) {
+            for (unsigned i = 0; i < ctx->n_direct_meters; i++) {
+                nikss_direct_meter_ctx_free(&ctx->direct_meters_ctx[i]);
+            }
+            free(ctx->direct_meters_ctx);
         }
-        free(ctx->direct_meters_ctx);
-        ctx->direct_meters_ctx = NULL;
+
+        free_struct_field_descriptor_set(&ctx->table_implementations);
+        free_struct_field_descriptor_set(&ctx->table_implementation_group_marks);
+        free_table_codec(&ctx->codec);
     }
+    ctx->direct_counters_ctx = NULL;
+    ctx->n_direct_counters = 0;
+    ctx->direct_meters_ctx = NULL;
     ctx->n_direct_meters = 0;
-
-    free_struct_field_descriptor_set(&ctx->table_implementations);
-    free_struct_field_descriptor_set(&ctx->table_implementation_group_marks);
+    memset(&ctx->table_implementations, 0, sizeof(ctx->table_implementations));
+    memset(&ctx->table_implementation_group_marks, 0, sizeof(ctx->table_implementation_group_marks));
+    memset(&ctx->codec, 0, sizeof(ctx->codec));
+    ctx->clone_source = NULL;
 
     if (ctx->current_raw_key != NULL) {
         free(ctx->current_raw_key);
     }
     ctx->current_raw_key = NULL;
+    if (ctx->current_raw_key_mask != NULL) {
+        free(ctx->current_raw_key_mask);
+    }
+    ctx->current_raw_key_mask = NULL;
+
+    free_table_batch_iterator(ctx);
+    free_ternary_tuple_dumps(ctx);
+    free_ternary_prefix_cache(ctx);
 
     nikss_table_entry_free(&ctx->current_entry);
+    nikss_arena_free(&ctx->entry_arena);
 }
 
 static int get_value_type(nikss_table_entry_ctx_t *ctx, const struct btf_type **value_type)
@@ -309,6 +459,13 @@ static int init_direct_objects(nikss_table_entry_ctx_t *ctx)
         return ret;
     }
 
+    btf_struct_member_md_t last_hit_md = {};
+    if (btf_get_member_md_by_name(ctx->btf_metadata.btf, ctx->table.value_type_id, "last_hit", &last_hit_md) == NO_ERROR &&
+        btf_get_type_size_by_id(ctx->btf_metadata.btf, last_hit_md.effective_type_id) == sizeof(uint64_t)) {
+        ctx->has_last_hit = true;
+        ctx->last_hit_offset = last_hit_md.bit_offset / 8;
+    }
+
     if (ctx->n_direct_counters > 0) {
         ctx->direct_counters_ctx = malloc(ctx->n_direct_counters * sizeof(nikss_direct_counter_context_t));
         if (ctx->direct_counters_ctx == NULL) {
@@ -379,6 +536,20 @@ int open_ternary_table(nikss_context_t *nikss_ctx, nikss_table_entry_ctx_t *ctx,
         return ret;
     }
 
+    /* Saved only when NUMA node was given at pipeline load */
+    char pinned_file[256];
+    snprintf(derived_name, sizeof(derived_name), "%s%s", name, TUPLES_NUMA_NODE_SUFFIX);
+    build_ebpf_prog_filename(pinned_file, sizeof(pinned_file), nikss_ctx, derived_name);
+    int numa_fd = bpf_obj_get(pinned_file);
+    if (numa_fd >= 0) {
+        uint32_t key = 0;
+        uint32_t node = 0;
+        if (bpf_map_lookup_elem(numa_fd, &key, &node) == 0 && node <= INT32_MAX) {
+            ctx->tuple_numa_node = (int) node;
+        }
+        close_object_fd(&numa_fd);
+    }
+
     ctx->is_ternary = true;
 
     return NO_ERROR;
@@ -395,6 +566,8 @@ int nikss_table_entry_ctx_tblname(nikss_context_t *nikss_ctx, nikss_table_entry_
         fprintf(stderr, "warning: couldn't find BTF info\n");
     }
 
+    ctx->pipeline_id = nikss_context_get_pipeline(nikss_ctx);
+
     int ret = open_bpf_map(nikss_ctx, name, &ctx->btf_metadata, &ctx->table);
 
     /* if map does not exist, try the ternary table */
@@ -421,6 +594,8 @@ int nikss_table_entry_ctx_tblname(nikss_context_t *nikss_ctx, nikss_table_entry_
     ret = open_bpf_map(nikss_ctx, map_name, &ctx->btf_metadata, &ctx->cache);
     if (ret == NO_ERROR) {
         fprintf(stderr, "found cache for table: %s\n", name);
+        snprintf(map_name, sizeof(map_name), "%s_cache_epoch", name);
+        open_bpf_map(nikss_ctx, map_name, &ctx->btf_metadata, &ctx->cache_epoch);
     }
 
     ret = init_direct_objects(ctx);
@@ -429,6 +604,11 @@ int nikss_table_entry_ctx_tblname(nikss_context_t *nikss_ctx, nikss_table_entry_
         return ret;
     }
 
+    /* optional as well, requires knowledge of direct objects */
+    open_table_dir24(nikss_ctx, ctx, name);
+
+    compile_table_codec(ctx);
+
     return NO_ERROR;
 }
 
@@ -456,6 +636,186 @@ bool nikss_table_entry_ctx_has_priority(nikss_table_entry_ctx_t *ctx)
     return ctx->is_ternary;
 }
 
+/* cppcheck-suppress unusedFunction ; public API call */
+size_t nikss_table_entry_ctx_get_key_size(nikss_table_entry_ctx_t *ctx)
+{
+    if (ctx == NULL) {
+        return 0;
+    }
+    return ctx->table.key_size;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+size_t nikss_table_entry_ctx_get_value_size(nikss_table_entry_ctx_t *ctx)
+{
+    if (ctx == NULL) {
+        return 0;
+    }
+    return ctx->table.value_size;
+}
+
+int nikss_table_entry_ctx_batch_size(nikss_table_entry_ctx_t *ctx, uint32_t batch_size)
+{
+    if (ctx == NULL) {
+        return EINVAL;
+    }
+
+    /* buffers will be allocated again with new size on next read */
+    free_table_batch_iterator(ctx);
+    ctx->batch_size = batch_size;
+    ctx->batch_not_supported = false;
+
+    return NO_ERROR;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_entry_ctx_sort_tuples(nikss_table_entry_ctx_t *ctx, bool enable)
+{
+    if (ctx == NULL) {
+        return EINVAL;
+    }
+
+    /* priorities of tuples will be loaded on next reload of the prefixes list */
+    ctx->sort_tuples = enable;
+    ctx->prefix_cache_valid = false;
+    ctx->prefix_cache_has_priorities = false;
+
+    return NO_ERROR;
+}
+
+int nikss_table_entry_ctx_tuple_threads(nikss_table_entry_ctx_t *ctx, uint32_t threads)
+{
+    if (ctx == NULL) {
+        return EINVAL;
+    }
+
+    /* tuples will be read again on next iteration */
+    free_ternary_tuple_dumps(ctx);
+    ctx->tuple_threads = threads;
+
+    return NO_ERROR;
+}
+
+int nikss_table_entry_ctx_use_arena(nikss_table_entry_ctx_t *ctx, bool enable)
+{
+    if (ctx == NULL) {
+        return EINVAL;
+    }
+
+    /* Current entry may use memory from the arena */
+    nikss_table_entry_free(&ctx->current_entry);
+    nikss_table_entry_init(&ctx->current_entry);
+
+    if (!enable) {
+        nikss_arena_free(&ctx->entry_arena);
+    }
+    ctx->use_entry_arena = enable;
+
+    return NO_ERROR;
+}
+
+int nikss_table_entry_ctx_thread_safe(nikss_table_entry_ctx_t *ctx, bool enable)
+{
+    if (ctx == NULL) {
+        return EINVAL;
+    }
+
+    ctx->thread_safe = enable;
+
+    return NO_ERROR;
+}
+
+static int duplicate_map_fd(nikss_bpf_map_descriptor_t *md)
+{
+    if (md->fd < 0) {
+        return NO_ERROR;
+    }
+
+    md->fd = fcntl(md->fd, F_DUPFD_CLOEXEC, 0);
+    if (md->fd < 0) {
+        return errno;
+    }
+
+    return NO_ERROR;
+}
+
+int nikss_table_entry_ctx_clone(nikss_table_entry_ctx_t *dst, const nikss_table_entry_ctx_t *src)
+{
+    if (dst == NULL || src == NULL || dst == src) {
+        return EINVAL;
+    }
+
+    /* Start from the copy of metadata, then replace everything what is owned by the context */
+    memcpy(dst, src, sizeof(nikss_table_entry_ctx_t));
+    dst->clone_source = src->clone_source != NULL ? src->clone_source : src;
+    dst->thread_safe = true;
+    dst->async = NULL;
+    dst->shadow = NULL;
+    dst->aging = NULL;
+
+    nikss_bpf_map_descriptor_t *maps[] = {
+            &dst->table, &dst->default_entry, &dst->prefixes, &dst->tuple_map, &dst->cache,
+            &dst->cache_epoch, &dst->dir24, &dst->dir24_tbl8, &dst->dir24_routes,
+    };
+    size_t n_maps = sizeof(maps) / sizeof(maps[0]);
+    if (dst->is_ternary) {
+        /* Tuple is opened only for a single operation */
+        dst->table.fd = -1;
+    }
+
+    /* Iteration state and caches */
+    dst->current_raw_key = NULL;
+    dst->current_raw_key_mask = NULL;
+    nikss_table_entry_init(&dst->current_entry);
+    dst->batch_keys = NULL;
+    dst->batch_values = NULL;
+    dst->batch_token = NULL;
+    reset_table_batch_iterator(dst);
+    dst->tuple_dumps = NULL;
+    free_ternary_tuple_dumps(dst);
+    dst->prefix_cache_keys = NULL;
+    dst->prefix_cache_values = NULL;
+    dst->prefix_cache_priorities = NULL;
+    free_ternary_prefix_cache(dst);
+    nikss_arena_init(&dst->entry_arena, src->entry_arena.chunk_size);
+
+    int ret = share_btf(&dst->btf_metadata, &src->btf_metadata);
+    for (size_t i = 0; i < n_maps; i++) {
+        if (ret != NO_ERROR) {
+            /* do not close descriptors of the source */
+            maps[i]->fd = -1;
+        } else {
+            ret = duplicate_map_fd(maps[i]);
+        }
+    }
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to clone table context: %s\n", strerror(ret));
+        nikss_table_entry_ctx_free(dst);
+        return ret;
+    }
+
+    return NO_ERROR;
+}
+
+static void reset_current_entry(nikss_table_entry_ctx_t *ctx)
+{
+    nikss_table_entry_free(&ctx->current_entry);
+    nikss_table_entry_init(&ctx->current_entry);
+
+    if (ctx->use_entry_arena) {
+        nikss_arena_reset(&ctx->entry_arena);
+        ctx->current_entry.arena = &ctx->entry_arena;
+    }
+}
+
+static void *entry_alloc(nikss_table_entry_t *entry, size_t size)
+{
+    if (entry->arena != NULL) {
+        return arena_alloc(entry->arena, size);
+    }
+    return malloc(size);
+}
+
 void nikss_table_entry_init(nikss_table_entry_t *entry)
 {
     if (entry == NULL) {
@@ -474,11 +834,14 @@ void nikss_table_entry_free(nikss_table_entry_t *entry)
         return;
     }
 
-    /* free match keys */
+    /* free match keys, key structures and list of them are released with arena */
     for (size_t i = 0; i < entry->n_keys; i++) {
         nikss_matchkey_free(entry->match_keys[i]);
+        if (entry->arena == NULL) {
+            free(entry->match_keys[i]);
+        }
     }
-    if (entry->match_keys) {
+    if (entry->match_keys && entry->arena == NULL) {
         free(entry->match_keys);
     }
     entry->match_keys = NULL;
@@ -487,7 +850,9 @@ void nikss_table_entry_free(nikss_table_entry_t *entry)
     /* free action data */
     if (entry->action != NULL) {
         nikss_action_free(entry->action);
-        free(entry->action);
+        if (entry->arena == NULL) {
+            free(entry->action);
+        }
         entry->action = NULL;
     }
 
@@ -518,6 +883,21 @@ void nikss_table_entry_free(nikss_table_entry_t *entry)
     nikss_direct_meter_ctx_free(&entry->current_direct_meter_ctx);
 }
 
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_entry_use_arena(nikss_table_entry_t *entry, nikss_arena_t *arena)
+{
+    if (entry == NULL) {
+        return EINVAL;
+    }
+    if (entry->n_keys != 0 || entry->action != NULL) {
+        return EBUSY;
+    }
+
+    entry->arena = arena;
+
+    return NO_ERROR;
+}
+
 /* can be invoked multiple times */
 int nikss_table_entry_matchkey(nikss_table_entry_t *entry, nikss_match_key_t *mk)
 {
@@ -538,14 +918,14 @@ int nikss_table_entry_matchkey(nikss_table_entry_t *entry, nikss_match_key_t *mk
     }
 
     size_t new_size = (entry->n_keys + 1) * sizeof(nikss_match_key_t *);
-    nikss_match_key_t ** tmp = malloc(new_size);
-    nikss_match_key_t * new_mk = malloc(sizeof(nikss_match_key_t));
+    nikss_match_key_t ** tmp = entry_alloc(entry, new_size);
+    nikss_match_key_t * new_mk = entry_alloc(entry, sizeof(nikss_match_key_t));
 
     if (tmp == NULL || new_mk == NULL) {
-        if (tmp != NULL) {
+        if (tmp != NULL && entry->arena == NULL) {
             free(tmp);
         }
-        if (new_mk != NULL) {
+        if (new_mk != NULL && entry->arena == NULL) {
             free(new_mk);
         }
         return ENOMEM;
@@ -554,7 +934,7 @@ int nikss_table_entry_matchkey(nikss_table_entry_t *entry, nikss_match_key_t *mk
     if (entry->n_keys != 0) {
         memcpy(tmp, entry->match_keys, (entry->n_keys) * sizeof(nikss_match_key_t *));
     }
-    if (entry->match_keys != NULL) {
+    if (entry->match_keys != NULL && entry->arena == NULL) {
         free(entry->match_keys);
     }
     entry->match_keys = tmp;
@@ -612,7 +992,7 @@ void nikss_table_entry_action(nikss_table_entry_t *entry, nikss_action_t *act)
         return;
     }
 
-    entry->action = malloc(sizeof(nikss_action_t));
+    entry->action = entry_alloc(entry, sizeof(nikss_action_t));
     if (entry->action == NULL) {
         return;
     }
@@ -967,7 +1347,7 @@ void nikss_action_free(nikss_action_t *action)
     for (size_t i = 0; i < action->n_params; i++) {
         nikss_action_param_free(&(action->params[i]));
     }
-    if (action->params != NULL) {
+    if (action->params != NULL && !action->params_from_arena) {
         free(action->params);
     }
     action->params = NULL;
@@ -1091,12 +1471,10 @@ enum write_flags {
     WRITE_NETWORK_ORDER
 };
 
-static int write_buffer_btf(char *buffer, size_t buffer_len, size_t offset,
-                            const void *data, size_t data_len, nikss_table_entry_ctx_t *ctx,
-                            uint32_t dst_type_id, const char *dst_type, enum write_flags flags)
+static int write_buffer_field(char *buffer, size_t buffer_len, size_t offset,
+                              const void *data, size_t data_len, size_t data_type_len,
+                              const char *dst_type, enum write_flags flags)
 {
-    size_t data_type_len = btf_get_type_size_by_id(ctx->btf_metadata.btf, dst_type_id);
-
     if (offset + data_len > buffer_len || data_len > data_type_len) {
         fprintf(stderr, "too much data in %s "
                         "(buffer len: %zu; offset: %zu; data size: %zu; type size: %zu)\n",
@@ -1120,6 +1498,20 @@ static int write_buffer_btf(char *buffer, size_t buffer_len, size_t offset,
     return NO_ERROR;
 }
 
+static int write_buffer_btf(char *buffer, size_t buffer_len, size_t offset,
+                            const void *data, size_t data_len, nikss_table_entry_ctx_t *ctx,
+                            uint32_t dst_type_id, const char *dst_type, enum write_flags flags)
+{
+    size_t data_type_len = btf_get_type_size_by_id(ctx->btf_metadata.btf, dst_type_id);
+    return write_buffer_field(buffer, buffer_len, offset, data, data_len, data_type_len, dst_type, flags);
+}
+
+static int write_buffer_codec(char *buffer, size_t buffer_len, const nikss_table_codec_field_t *field,
+                              const void *data, size_t data_len, const char *dst_type, enum write_flags flags)
+{
+    return write_buffer_field(buffer, buffer_len, field->offset, data, data_len, field->size, dst_type, flags);
+}
+
 int fill_key_byte_by_byte(char * buffer, nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry)
 {
     size_t bytes_to_write = ctx->table.key_size;
@@ -1195,8 +1587,54 @@ static bool is_table_dummy_key(nikss_table_entry_ctx_t *ctx, const struct btf_ty
     return false;
 }
 
+static int fill_key_codec(char * buffer, nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry)
+{
+    const nikss_table_codec_t *codec = &ctx->codec;
+    if (entry->n_keys != codec->n_key_fields) {
+        fprintf(stderr, "expected %zu keys, got %zu\n", codec->n_key_fields, entry->n_keys);
+        return EAGAIN;
+    }
+
+    for (size_t i = 0; i < codec->n_key_fields; i++) {
+        const nikss_table_codec_field_t *field = &codec->key_fields[i];
+        nikss_match_key_t *mk = entry->match_keys[i];
+        int flags = WRITE_HOST_ORDER;
+
+        if (codec->has_lpm_prefix && mk->type == NIKSS_LPM) {
+            flags = WRITE_NETWORK_ORDER;
+        }
+        int ret = write_buffer_codec(buffer, ctx->table.key_size, field, mk->data, mk->key_size, "key", flags);
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+
+        /* write prefix value for LPM field */
+        if (codec->has_lpm_prefix) {
+            /* LPM field have to be last field in the key structure, so we can assume that whole key must match for other keys */
+            uint32_t prefix_value = ctx->table.key_size * 8 - 32;
+            if (mk->type == NIKSS_LPM) {
+                prefix_value = (unsigned long)(field->offset * 8) + mk->u.lpm.prefix_len - 32;
+            } else if (mk->type == NIKSS_TERNARY) {
+                fprintf(stderr, "ternary key is not allowed for this table\n");
+                return EINVAL;
+            }
+            ret = write_buffer_codec(buffer, ctx->table.key_size, &codec->lpm_prefix,
+                                     &prefix_value, sizeof(prefix_value), "prefix", WRITE_HOST_ORDER);
+            if (ret != NO_ERROR) {
+                return ret;
+            }
+        }
+    }
+
+    return NO_ERROR;
+}
+
 int fill_key_btf_info(char * buffer, nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry)
 {
+    if (ctx->codec.key_compiled) {
+        return fill_key_codec(buffer, ctx, entry);
+    }
+
     uint32_t key_type_id = ctx->table.key_type_id;
     if (key_type_id == 0) {
         return EAGAIN;
@@ -1478,10 +1916,73 @@ static int fill_action_references(char * buffer, nikss_table_entry_ctx_t *ctx,
     return NO_ERROR;
 }
 
+static int fill_action_codec(char * buffer, nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry)
+{
+    const nikss_table_codec_t *codec = &ctx->codec;
+    if (!codec->has_action_id) {
+        fprintf(stderr, "action id entry not found\n");
+        return EAGAIN;  /* Allow fallback to byte by byte mode */
+    }
+    int ret = write_buffer_codec(buffer, ctx->table.value_size, &codec->action_id,
+                                 &(entry->action->action_id), sizeof(entry->action->action_id),
+                                 "action id", WRITE_HOST_ORDER);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+
+    if (codec->actions == NULL) {
+        fprintf(stderr, "actions data structure not found\n");
+        return ENOENT;
+    }
+    if (entry->action->action_id >= codec->n_actions) {
+        fprintf(stderr, "action with id %u does not exist\n", entry->action->action_id);
+        return EPERM;  /* not fixable, invalid action ID */
+    }
+
+    const nikss_table_codec_action_t *action = &codec->actions[entry->action->action_id];
+    if (entry->action->n_params != action->n_params) {
+        fprintf(stderr, "expected %zu action parameters, got %zu\n",
+                action->n_params, entry->action->n_params);
+        return EAGAIN;
+    }
+    for (size_t i = 0; i < action->n_params; i++) {
+        ret = write_buffer_codec(buffer, ctx->table.value_size, &action->params[i],
+                                 entry->action->params[i].data, entry->action->params[i].len,
+                                 "value", WRITE_HOST_ORDER);
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+static int fill_priority_codec(char * buffer, nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry)
+{
+    if (ctx->is_ternary == false) {
+        return NO_ERROR;
+    }
+
+    if (!ctx->codec.has_priority) {
+        fprintf(stderr, "priority entry not found\n");
+        return ENOENT;
+    }
+    return write_buffer_codec(buffer, ctx->table.value_size, &ctx->codec.priority,
+                              &(entry->priority), sizeof(entry->priority), "priority", WRITE_HOST_ORDER);
+}
+
 static int fill_value_btf_info(char * buffer, nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry)
 {
     int ret = NO_ERROR;
 
+    if (ctx->codec.value_compiled && ctx->is_indirect == false) {
+        ret = fill_action_codec(buffer, ctx, entry);
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+        return fill_priority_codec(buffer, ctx, entry);
+    }
+
     uint32_t value_type_id = ctx->table.value_type_id;
     if (value_type_id == 0) {
         return EAGAIN;
@@ -1765,6 +2266,14 @@ static int handle_direct_objects_write(const char *key, char *value, nikss_bpf_m
         return ret;
     }
 
+    /* Written entry is not idle, the same clock is used by bpf_ktime_get_ns() */
+    if (ctx->has_last_hit && ctx->last_hit_offset + sizeof(uint64_t) <= map->value_size) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        uint64_t last_hit = (uint64_t) now.tv_sec * 1000000000ULL + (uint64_t) now.tv_nsec;
+        memcpy(value + ctx->last_hit_offset, &last_hit, sizeof(last_hit));
+    }
+
     return handle_direct_counter_write(key, value, map, ctx, entry, bpf_flags);
 }
 
@@ -1827,1352 +2336,4149 @@ static int get_ternary_table_prefix_md(nikss_table_entry_ctx_t *ctx, struct tern
     return NO_ERROR;
 }
 
-static int add_ternary_table_prefix(char *new_prefix, char *prefix_value,
-                                    nikss_table_entry_ctx_t *ctx)
+static uint32_t get_cached_prefix_tuple_id(nikss_table_entry_ctx_t *ctx, uint32_t index,
+                                           struct ternary_table_prefix_metadata *md)
 {
-    int err = NO_ERROR;
-    uint32_t tuple_id = 0;
-    struct ternary_table_prefix_metadata prefix_md;
+    const char *value = ctx->prefix_cache_values + (size_t) index * ctx->prefixes.value_size;
+    return *((const uint32_t *) (value + md->tuple_id_offset));
+}
 
-    if (get_ternary_table_prefix_md(ctx, &prefix_md) != NO_ERROR) {
-        fprintf(stderr, "failed to obtain offsets and sizes of prefix\n");
-        return EPERM;
-    }
+static int compare_tuple_ids(const void *a, const void *b)
+{
+    uint32_t id_a = *((const uint32_t *) a);
+    uint32_t id_b = *((const uint32_t *) b);
 
-    char *key = malloc(ctx->prefixes.key_size);
-    char *value = malloc(ctx->prefixes.value_size);
+    return id_a < id_b ? -1 : (id_a > id_b ? 1 : 0);
+}
+
+/* Walks prefixes in the map, not in the cache, to find out whether any of them uses tuple_id */
+static int prefix_list_references_tuple(nikss_table_entry_ctx_t *ctx, struct ternary_table_prefix_metadata *md,
+                                        uint32_t tuple_id, bool *referenced)
+{
+    int err = NO_ERROR;
+    char *key = calloc(1, ctx->prefixes.key_size);
+    char *value = calloc(1, ctx->prefixes.value_size);
+
+    *referenced = false;
     if (key == NULL || value == NULL) {
-        fprintf(stderr, "not enough memory\n");
         err = ENOMEM;
         goto clean_up;
     }
 
-    /* Process head */
-    memset(key, 0, ctx->prefixes.key_size);
-    err = bpf_map_lookup_elem(ctx->prefixes.fd, key, value);
-    if (err != 0) {
-        /* Construct head, it will be added later */
-        memset(value, 0, ctx->prefixes.value_size);
-        *((uint32_t *) (value + prefix_md.tuple_id_offset)) = tuple_id;
+    /* Empty table has no head */
+    if (bpf_map_lookup_elem(ctx->prefixes.fd, key, value) != 0) {
+        goto clean_up;
     }
 
-    /* Iterate over every prefix to the last one */
-    while (true) {
-        uint8_t has_next = *((uint8_t *) (value + prefix_md.has_next_offset));
-        if (has_next == 0) {
-            break;
+    /* Head has no tuple, so start from the next prefix */
+    for (uint32_t i = 0; *((uint8_t *) (value + md->has_next_offset)) != 0; i++) {
+        if (i > ctx->prefixes.max_entries) {
+            fprintf(stderr, "detected loop in prefixes, aborting\n");
+            err = ELOOP;
+            goto clean_up;
         }
-
-        /* Get next prefix */
-        memcpy(key, value + prefix_md.next_mask_offset, prefix_md.next_mask_size);
-        err = bpf_map_lookup_elem(ctx->prefixes.fd, key, value);
-        if (err != 0) {
-            err = errno;
+        memcpy(key, value + md->next_mask_offset, md->next_mask_size);
+        if (bpf_map_lookup_elem(ctx->prefixes.fd, key, value) != 0) {
             fprintf(stderr, "detected data inconsistency in prefixes, aborting\n");
+            err = ENOENT;
             goto clean_up;
         }
-
-        /* Find highest tuple id */
-        uint32_t current_tuple_id = *((uint32_t *) (value + prefix_md.tuple_id_offset));
-        if (current_tuple_id > tuple_id) {
-            tuple_id = current_tuple_id;
+        if (*((uint32_t *) (value + md->tuple_id_offset)) == tuple_id) {
+            *referenced = true;
+            break;
         }
     }
 
-    /* First add new prefix to avoid data inconsistency */
-    memset(prefix_value, 0, ctx->prefixes.value_size);
-    *((uint32_t *) (prefix_value + prefix_md.tuple_id_offset)) = ++tuple_id;
-    err = bpf_map_update_elem(ctx->prefixes.fd, new_prefix, prefix_value, BPF_NOEXIST);
-    if (err != 0) {
-        goto clean_up;
+clean_up:
+    free(key);
+    free(value);
+
+    return err;
+}
+
+/* Lowest tuple id which is not used by any prefix, so ids of removed tuples are reused. Candidate is taken
+ * from the cache and checked against the map, ESTALE is returned when another writer changed the prefixes,
+ * caller then must reload the cache and try again. */
+static int get_lowest_free_tuple_id(nikss_table_entry_ctx_t *ctx, struct ternary_table_prefix_metadata *md,
+                                    uint32_t *tuple_id)
+{
+    /* Head has no tuple, so skip it */
+    uint32_t n_ids = ctx->prefix_cache_count > 0 ? ctx->prefix_cache_count - 1 : 0;
+    uint32_t *ids = malloc((n_ids + 1) * sizeof(uint32_t));
+    if (ids == NULL) {
+        return ENOMEM;
     }
 
-    /* Update previous node */
-    memcpy(value + prefix_md.next_mask_offset, new_prefix, prefix_md.next_mask_size);
-    *((uint8_t *) (value + prefix_md.has_next_offset)) = 1;
-    err = bpf_map_update_elem(ctx->prefixes.fd, key, value, BPF_ANY);
-    if (err != 0) {
-        goto clean_up;
+    for (uint32_t i = 0; i < n_ids; i++) {
+        ids[i] = get_cached_prefix_tuple_id(ctx, i + 1, md);
     }
+    qsort(ids, n_ids, sizeof(uint32_t), compare_tuple_ids);
 
-    err = NO_ERROR;
+    uint32_t candidate = 1;
+    for (uint32_t i = 0; i < n_ids; i++) {
+        if (ids[i] == candidate) {
+            candidate++;
+        } else if (ids[i] > candidate) {
+            break;
+        }
+    }
+    free(ids);
 
-clean_up:
-    if (key != NULL) {
-        free(key);
+    bool referenced = false;
+    int err = prefix_list_references_tuple(ctx, md, candidate, &referenced);
+    if (err != NO_ERROR) {
+        return err;
     }
-    if (value != NULL) {
-        free(value);
+    if (referenced) {
+        ctx->prefix_cache_valid = false;
+        return ESTALE;
     }
 
-    return err;
+    *tuple_id = candidate;
+
+    return NO_ERROR;
 }
 
-static int ternary_table_add_tuple_and_open(nikss_table_entry_ctx_t *ctx, const uint32_t tuple_id)
+static int insert_cached_prefix(nikss_table_entry_ctx_t *ctx, uint32_t index, const char *key, const char *value,
+                                uint32_t priority)
 {
-    int err = NO_ERROR;
+    if (index > ctx->prefix_cache_count) {
+        return EINVAL;
+    }
 
-    struct bpf_create_map_attr attr = {
-            .key_size = ctx->table.key_size,
-            .value_size = ctx->table.value_size,
-            .max_entries = ctx->table.max_entries,
-            .map_type = ctx->table.type,
-            .btf_fd = ctx->btf_metadata.btf_fd,
-            .btf_key_type_id = ctx->table.map_key_type_id,
-            .btf_value_type_id = ctx->table.map_value_type_id,
-    };
-    ctx->table.fd = bpf_create_map_xattr(&attr);
-    if (ctx->table.fd < 0) {
-        err = errno;
-        fprintf(stderr, "failed to create tuple %u: %s\n", tuple_id, strerror(err));
-        return err;
+    if (ctx->prefix_cache_count >= ctx->prefix_cache_capacity) {
+        uint32_t new_capacity = ctx->prefix_cache_capacity > 0 ? ctx->prefix_cache_capacity * 2 : 16;
+        char *keys = realloc(ctx->prefix_cache_keys, (size_t) new_capacity * ctx->prefixes.key_size);
+        if (keys == NULL) {
+            return ENOMEM;
+        }
+        ctx->prefix_cache_keys = keys;
+        char *values = realloc(ctx->prefix_cache_values, (size_t) new_capacity * ctx->prefixes.value_size);
+        if (values == NULL) {
+            return ENOMEM;
+        }
+        ctx->prefix_cache_values = values;
+        uint32_t *priorities = realloc(ctx->prefix_cache_priorities, (size_t) new_capacity * sizeof(uint32_t));
+        if (priorities == NULL) {
+            return ENOMEM;
+        }
+        ctx->prefix_cache_priorities = priorities;
+        ctx->prefix_cache_capacity = new_capacity;
     }
 
-    /* add tuple to tuples map */
-    err = bpf_map_update_elem(ctx->tuple_map.fd, &tuple_id, &(ctx->table.fd), 0);
-    if (err != 0) {
-        err = errno;
-        fprintf(stderr, "failed to add tuple %u: %s\n", tuple_id, strerror(err));
-        close_object_fd(&(ctx->table.fd));
+    size_t to_move = ctx->prefix_cache_count - index;
+    char *key_slot = ctx->prefix_cache_keys + (size_t) index * ctx->prefixes.key_size;
+    char *value_slot = ctx->prefix_cache_values + (size_t) index * ctx->prefixes.value_size;
+    memmove(key_slot + ctx->prefixes.key_size, key_slot, to_move * ctx->prefixes.key_size);
+    memmove(value_slot + ctx->prefixes.value_size, value_slot, to_move * ctx->prefixes.value_size);
+    memmove(&ctx->prefix_cache_priorities[index + 1], &ctx->prefix_cache_priorities[index],
+            to_move * sizeof(uint32_t));
+
+    memcpy(key_slot, key, ctx->prefixes.key_size);
+    memcpy(value_slot, value, ctx->prefixes.value_size);
+    ctx->prefix_cache_priorities[index] = priority;
+    ctx->prefix_cache_count += 1;
+
+    return NO_ERROR;
+}
+
+static void remove_cached_prefix(nikss_table_entry_ctx_t *ctx, uint32_t index)
+{
+    if (index >= ctx->prefix_cache_count) {
+        return;
     }
 
-    return err;
+    size_t to_move = ctx->prefix_cache_count - index - 1;
+    memmove(ctx->prefix_cache_keys + (size_t) index * ctx->prefixes.key_size,
+            ctx->prefix_cache_keys + (size_t) (index + 1) * ctx->prefixes.key_size,
+            to_move * ctx->prefixes.key_size);
+    memmove(ctx->prefix_cache_values + (size_t) index * ctx->prefixes.value_size,
+            ctx->prefix_cache_values + (size_t) (index + 1) * ctx->prefixes.value_size,
+            to_move * ctx->prefixes.value_size);
+    memmove(&ctx->prefix_cache_priorities[index], &ctx->prefix_cache_priorities[index + 1],
+            to_move * sizeof(uint32_t));
+    ctx->prefix_cache_count -= 1;
 }
 
-static int ternary_table_open_tuple(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry,
-                                    char **key_mask, uint64_t bpf_flags)
+static int find_cached_prefix(nikss_table_entry_ctx_t *ctx, const char *key)
 {
-    if (ctx->prefixes.fd < 0 || ctx->tuple_map.fd < 0 || ctx->table.fd >= 0) {
-        fprintf(stderr, "ternary table not properly opened. BUG?\n");
-        return EINVAL;
+    /* Head is not a valid prefix, so start from the first one after it */
+    for (uint32_t i = 1; i < ctx->prefix_cache_count; i++) {
+        if (memcmp(ctx->prefix_cache_keys + (size_t) i * ctx->prefixes.key_size, key, ctx->prefixes.key_size) == 0) {
+            return (int) i;
+        }
     }
-    if (ctx->table.key_size != ctx->prefixes.key_size) {
-        fprintf(stderr, "key and its mask have different length. BUG?\n");
-        return EINVAL;
+
+    return -1;
+}
+
+static int get_raw_value_priority_offset(nikss_table_entry_ctx_t *ctx, size_t *offset, size_t *size)
+{
+    /* Without BTF, priority is after action ID (see parse_table_value_no_btf) */
+    *offset = ctx->is_indirect ? 0 : sizeof(uint32_t);
+    *size = sizeof(uint32_t);
+
+    if (ctx->btf_metadata.btf != NULL && ctx->table.value_type_id != 0) {
+        btf_struct_member_md_t priority_md = {};
+        if (btf_get_member_md_by_name(ctx->btf_metadata.btf, ctx->table.value_type_id,
+                                      "priority", &priority_md) != NO_ERROR) {
+            return ENOENT;
+        }
+        *offset = priority_md.bit_offset / 8;
+        *size = btf_get_type_size_by_id(ctx->btf_metadata.btf, priority_md.effective_type_id);
     }
-    if (ctx->tuple_map.key_size != 4 || ctx->tuple_map.value_size != 4) {
-        fprintf(stderr, "key/value size of tuples map have to be 4B.\n");
+
+    if (*size > sizeof(uint32_t) || *offset + *size > ctx->table.value_size) {
         return EINVAL;
     }
 
+    return NO_ERROR;
+}
+
+/* Reads every entry in the tuple to find the highest priority within it */
+static int get_tuple_max_priority(nikss_table_entry_ctx_t *ctx, uint32_t tuple_id, uint32_t *max_priority)
+{
     int err = NO_ERROR;
-    char *value_mask = malloc(ctx->prefixes.value_size);
-    *key_mask = malloc(ctx->prefixes.key_size);
+    int tuple_fd = -1;
+    uint32_t inner_map_id = 0;
+    size_t priority_offset = 0, priority_size = 0;
+    char *key = malloc(ctx->table.key_size);
+    char *next_key = malloc(ctx->table.key_size);
+    char *value = malloc(ctx->table.value_size);
+
+    *max_priority = 0;
 
-    if (*key_mask == NULL || value_mask == NULL) {
+    if (key == NULL || next_key == NULL || value == NULL) {
         fprintf(stderr, "not enough memory\n");
         err = ENOMEM;
         goto clean_up;
     }
-    memset(*key_mask, 0, ctx->prefixes.key_size);
-    memset(value_mask, 0, ctx->prefixes.value_size);
-
-    err = construct_buffer(*key_mask, ctx->prefixes.key_size, ctx, entry,
-                           fill_key_mask_btf, fill_key_mask_byte_by_byte);
-    if (err != NO_ERROR) {
-        goto clean_up;
-    }
 
-    /* prefixes head protection - check whether mask is different from all 0 */
-    bool mask_is_valid = false;
-    for (unsigned i = 0; i < ctx->prefixes.key_size; i++) {
-        if ((*key_mask)[i] != 0) {
-            mask_is_valid = true;
-            break;
-        }
-    }
-    if (mask_is_valid == false) {
-        fprintf(stderr, "invalid key mask: all bytes are zeroed - use default action instead\n");
-        err = EINVAL;
+    if ((err = get_raw_value_priority_offset(ctx, &priority_offset, &priority_size)) != NO_ERROR) {
+        fprintf(stderr, "failed to obtain offset of priority\n");
         goto clean_up;
     }
 
-    err = bpf_map_lookup_elem(ctx->prefixes.fd, *key_mask, value_mask);
-    /* It is not allowed to add new prefix when updating existing entry */
-    if (err != 0 && bpf_flags != BPF_EXIST) {
-        err = add_ternary_table_prefix(*key_mask, value_mask, ctx);
-        if (err != NO_ERROR) {
-            fprintf(stderr, "unable to add new prefix\n");
-            goto clean_up;
-        }
-    } else if (err != 0) {
-        fprintf(stderr, "entry with prefix not found\n");
-        err = ENOENT;
+    if (bpf_map_lookup_elem(ctx->tuple_map.fd, &tuple_id, &inner_map_id) != 0) {
+        /* Tuple without entries */
         goto clean_up;
     }
-
-    struct ternary_table_prefix_metadata prefix_md;
-    if (get_ternary_table_prefix_md(ctx, &prefix_md) != NO_ERROR) {
-        fprintf(stderr, "failed to obtain offsets and sizes of prefix\n");
-        err = EPERM;
+    tuple_fd = bpf_map_get_fd_by_id(inner_map_id);
+    if (tuple_fd < 0) {
+        err = errno;
+        fprintf(stderr, "failed to open tuple %u: %s\n", tuple_id, strerror(err));
         goto clean_up;
     }
-    uint32_t tuple_id = *((uint32_t *) (value_mask + prefix_md.tuple_id_offset));
-    uint32_t inner_map_id = 0;
 
-    err = bpf_map_lookup_elem(ctx->tuple_map.fd, &tuple_id, &inner_map_id);
-    if (err == 0) {
-        ctx->table.fd = bpf_map_get_fd_by_id(inner_map_id);
-        err = NO_ERROR;
-    } else {
-        if (bpf_flags == BPF_EXIST) {
-            fprintf(stderr, "tuple not found\n");
-            err = ENOENT;
-            goto clean_up;
+    char *current_key = NULL;
+    while (bpf_map_get_next_key(tuple_fd, current_key, next_key) == 0) {
+        if (bpf_map_lookup_elem(tuple_fd, next_key, value) == 0) {
+            uint32_t priority = 0;
+            memcpy(&priority, value + priority_offset, priority_size);
+            if (priority > *max_priority) {
+                *max_priority = priority;
+            }
         }
-        err = ternary_table_add_tuple_and_open(ctx, tuple_id);
+        memcpy(key, next_key, ctx->table.key_size);
+        current_key = key;
     }
 
 clean_up:
-    if (value_mask != NULL) {
-        free(value_mask);
+    close_object_fd(&tuple_fd);
+    if (key != NULL) {
+        free(key);
+    }
+    if (next_key != NULL) {
+        free(next_key);
+    }
+    if (value != NULL) {
+        free(value);
     }
 
     return err;
 }
 
-static void ternary_table_close_tuple(nikss_table_entry_ctx_t *ctx)
+/* Cache taken over by a reload, its priorities are reused for prefixes which still point to the same tuple */
+struct previous_prefix_cache {
+    char *keys;
+    char *values;
+    uint32_t *priorities;
+    uint32_t count;
+};
+
+static void take_previous_prefix_cache(nikss_table_entry_ctx_t *ctx, struct previous_prefix_cache *previous)
 {
-    /* Allow for reuse table context with the same table but other tuple (inner map). */
-    if (ctx->is_ternary) {
-        close_object_fd(&(ctx->table.fd));
+    memset(previous, 0, sizeof(*previous));
+    if (ctx->sort_tuples == false || ctx->prefix_cache_has_priorities == false) {
+        return;
     }
+
+    previous->keys = ctx->prefix_cache_keys;
+    previous->values = ctx->prefix_cache_values;
+    previous->priorities = ctx->prefix_cache_priorities;
+    previous->count = ctx->prefix_cache_count;
+    ctx->prefix_cache_keys = NULL;
+    ctx->prefix_cache_values = NULL;
+    ctx->prefix_cache_priorities = NULL;
+    ctx->prefix_cache_capacity = 0;
 }
 
-int delete_all_map_entries(nikss_bpf_map_descriptor_t *map)
+static void free_previous_prefix_cache(struct previous_prefix_cache *previous)
 {
-    fprintf(stderr, "removing all entries from table\n");
+    free(previous->keys);
+    free(previous->values);
+    free(previous->priorities);
+    memset(previous, 0, sizeof(*previous));
+}
 
-    char * key = malloc(map->key_size);
-    char * next_key = malloc(map->key_size);
-    char * value = calloc(1, map->value_size);
-    int error_code = NO_ERROR;
+static bool get_previous_prefix_priority(nikss_table_entry_ctx_t *ctx, struct ternary_table_prefix_metadata *md,
+                                         const struct previous_prefix_cache *previous, uint32_t index,
+                                         uint32_t *priority)
+{
+    const char *key = ctx->prefix_cache_keys + (size_t) index * ctx->prefixes.key_size;
+    uint32_t tuple_id = get_cached_prefix_tuple_id(ctx, index, md);
+
+    /* Order rarely changes, so start from the same position; head is never a tuple */
+    for (uint32_t n = 1; n < previous->count; n++) {
+        uint32_t i = 1 + (index - 1 + n - 1) % (previous->count - 1);
+        const char *previous_value = previous->values + (size_t) i * ctx->prefixes.value_size;
+        if (memcmp(previous->keys + (size_t) i * ctx->prefixes.key_size, key, ctx->prefixes.key_size) == 0) {
+            if (*((const uint32_t *) (previous_value + md->tuple_id_offset)) != tuple_id) {
+                return false;
+            }
+            *priority = previous->priorities[i];
+            return true;
+        }
+    }
 
-    if (key == NULL || next_key == NULL || value == NULL) {
+    return false;
+}
+
+/* Loads the whole prefixes list from the map, one lookup per prefix. Missing
+ * head is cached as zeroed value, the same way as it is constructed on insert. */
+static int load_ternary_prefix_cache(nikss_table_entry_ctx_t *ctx, struct ternary_table_prefix_metadata *md)
+{
+    int err = NO_ERROR;
+    struct previous_prefix_cache previous;
+    char *key = calloc(1, ctx->prefixes.key_size);
+    char *value = calloc(1, ctx->prefixes.value_size);
+
+    take_previous_prefix_cache(ctx, &previous);
+    ctx->prefix_cache_valid = false;
+    ctx->prefix_cache_has_priorities = false;
+    ctx->prefix_cache_count = 0;
+
+    if (key == NULL || value == NULL) {
         fprintf(stderr, "not enough memory\n");
-        error_code = ENOMEM;
+        err = ENOMEM;
         goto clean_up;
     }
 
-    if (bpf_map_get_next_key(map->fd, NULL, next_key) != 0) {
-        goto clean_up;  /* table empty */
+    if (bpf_map_lookup_elem(ctx->prefixes.fd, key, value) != 0) {
+        memset(value, 0, ctx->prefixes.value_size);
     }
-    do {
-        /* Swap buffers, so next_key will become key and next_key may be reused */
-        char * tmp_key = next_key;
-        next_key = key;
-        key = tmp_key;
 
-        /* Ignore error(s) from bpf_map_delete_elem(). In some cases key may exist
-         * but entry not exists (e.g. array map in map). So in any case we have to
-         * iterate over all keys and try to delete it. It is not possible to remove
-         * entry from array map, in such case reset entries to zero value. */
-        if (map->type == BPF_MAP_TYPE_ARRAY) {
-            bpf_map_update_elem(map->fd, key, value, BPF_ANY);
-        } else {
-            bpf_map_delete_elem(map->fd, key);
+    while (true) {
+        if (ctx->prefix_cache_count > ctx->prefixes.max_entries) {
+            fprintf(stderr, "detected loop in prefixes, aborting\n");
+            err = ELOOP;
+            goto clean_up;
         }
-    } while (bpf_map_get_next_key(map->fd, key, next_key) == 0);
+
+        err = insert_cached_prefix(ctx, ctx->prefix_cache_count, key, value, 0);
+        if (err != NO_ERROR) {
+            fprintf(stderr, "not enough memory\n");
+            goto clean_up;
+        }
+
+        uint8_t has_next = *((uint8_t *) (value + md->has_next_offset));
+        if (has_next == 0) {
+            break;
+        }
+
+        /* Get next prefix */
+        memcpy(key, value + md->next_mask_offset, md->next_mask_size);
+        if (bpf_map_lookup_elem(ctx->prefixes.fd, key, value) != 0) {
+            err = errno;
+            fprintf(stderr, "detected data inconsistency in prefixes, aborting\n");
+            goto clean_up;
+        }
+    }
+
+    /* Priorities are needed only to keep list sorted. Entries added by this context raise priorities
+     * of cached tuples, so only tuples of new or changed prefixes have to be read. */
+    if (ctx->sort_tuples) {
+        for (uint32_t i = 1; i < ctx->prefix_cache_count; i++) {
+            if (get_previous_prefix_priority(ctx, md, &previous, i, &ctx->prefix_cache_priorities[i])) {
+                continue;
+            }
+            err = get_tuple_max_priority(ctx, get_cached_prefix_tuple_id(ctx, i, md),
+                                         &ctx->prefix_cache_priorities[i]);
+            if (err != NO_ERROR) {
+                goto clean_up;
+            }
+        }
+        ctx->prefix_cache_has_priorities = true;
+    }
+
+    ctx->prefix_cache_valid = true;
 
 clean_up:
-    if (key) {
+    free_previous_prefix_cache(&previous);
+    if (key != NULL) {
         free(key);
     }
-    if (next_key) {
-        free(next_key);
-    }
-    if (value) {
+    if (value != NULL) {
         free(value);
     }
-    return error_code;
+
+    return err;
 }
 
-int clear_table_cache(nikss_bpf_map_descriptor_t *map)
+/* Checks whether cached prefix is the same as in the map. This detects changes
+ * made by other writers, at the cost of one lookup instead of walking the list. */
+static bool cached_prefix_is_current(nikss_table_entry_ctx_t *ctx, uint32_t index)
 {
-    if (map == NULL || map->fd < 0) {
-        return NO_ERROR;
+    if (ctx->prefix_cache_valid == false || index >= ctx->prefix_cache_count) {
+        return false;
     }
 
-    fprintf(stderr, "clearing table cache: ");
-    return delete_all_map_entries(map);
+    const char *key = ctx->prefix_cache_keys + (size_t) index * ctx->prefixes.key_size;
+    const char *cached_value = ctx->prefix_cache_values + (size_t) index * ctx->prefixes.value_size;
+    char *value = calloc(1, ctx->prefixes.value_size);
+    if (value == NULL) {
+        return false;
+    }
+
+    bool is_current = false;
+    if (bpf_map_lookup_elem(ctx->prefixes.fd, key, value) == 0) {
+        is_current = memcmp(value, cached_value, ctx->prefixes.value_size) == 0;
+    } else if (index == 0) {
+        /* head does not exist yet, so it is current only when cached as empty list */
+        memset(value, 0, ctx->prefixes.value_size);
+        is_current = memcmp(value, cached_value, ctx->prefixes.value_size) == 0;
+    }
+
+    free(value);
+
+    return is_current;
 }
 
-static int nikss_table_entry_write(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, uint64_t bpf_flags)
+/* Ensures that the prefix at a given index is the same in the cache and in the map,
+ * reloads the cache otherwise. Index might be different after reload, so update it. */
+static int sync_ternary_prefix_cache(nikss_table_entry_ctx_t *ctx, struct ternary_table_prefix_metadata *md,
+                                     uint32_t *index, const char *key)
 {
-    char *key_buffer = NULL;
-    char *key_mask_buffer = NULL;
-    char *value_buffer = NULL;
-    int return_code = NO_ERROR;
+    if (ctx->prefix_cache_valid) {
+        if (key != NULL) {
+            int found = find_cached_prefix(ctx, key);
+            *index = found > 0 ? (uint32_t) found - 1 : 0;
+            if (found > 0 && cached_prefix_is_current(ctx, *index)) {
+                return NO_ERROR;
+            }
+        } else {
+            *index = ctx->prefix_cache_count - 1;
+            if (cached_prefix_is_current(ctx, *index)) {
+                return NO_ERROR;
+            }
+        }
+    }
 
-    if (ctx == NULL || entry == NULL) {
-        return EINVAL;
+    int err = load_ternary_prefix_cache(ctx, md);
+    if (err != NO_ERROR) {
+        return err;
     }
 
-    if (ctx->is_ternary) {
-        return_code = ternary_table_open_tuple(ctx, entry, &key_mask_buffer, bpf_flags);
-        if (return_code != NO_ERROR) {
-            goto clean_up;
+    if (key != NULL) {
+        int found = find_cached_prefix(ctx, key);
+        if (found <= 0) {
+            return ENOENT;
         }
+        *index = (uint32_t) found - 1;
+    } else {
+        *index = ctx->prefix_cache_count - 1;
     }
 
-    if (ctx->table.fd < 0) {
-        fprintf(stderr, "can't add entry: table not opened\n");
-        return_code = EBADF;
-        goto clean_up;
-    }
-    if (ctx->table.key_size == 0 || ctx->table.value_size == 0) {
-        fprintf(stderr, "zero-size key or value is not supported\n");
-        return_code = ENOTSUP;
-        goto clean_up;
-    }
-    if (entry->action == NULL) {
-        fprintf(stderr, "missing action specification\n");
-        return_code = ENODATA;
-        goto clean_up;
-    }
+    return NO_ERROR;
+}
 
-    /* prepare buffers for map key/value */
-    key_buffer = malloc(ctx->table.key_size);
-    value_buffer = malloc(ctx->table.value_size);
-    if (key_buffer == NULL || value_buffer == NULL) {
-        fprintf(stderr, "not enough memory\n");
-        return_code = ENOMEM;
-        goto clean_up;
+/* Finds prefix after which new tuple with given priority should be inserted. Tuples
+ * are sorted from the highest priority, so new one is placed after all tuples with
+ * the same priority to preserve insertion order between them. */
+static uint32_t find_sorted_prefix_position(nikss_table_entry_ctx_t *ctx, uint32_t priority)
+{
+    uint32_t position = 0;
+    for (uint32_t i = 1; i < ctx->prefix_cache_count; i++) {
+        if (ctx->prefix_cache_priorities[i] < priority) {
+            break;
+        }
+        position = i;
     }
 
-    return_code = construct_buffer(key_buffer, ctx->table.key_size, ctx, entry,
-                                   fill_key_btf_info, fill_key_byte_by_byte);
-    if (return_code != NO_ERROR) {
-        fprintf(stderr, "failed to construct key\n");
-        goto clean_up;
-    }
+    return position;
+}
 
-    return_code = construct_buffer(value_buffer, ctx->table.value_size, ctx, entry,
-                                   fill_value_btf_info, fill_value_byte_by_byte);
-    if (return_code != NO_ERROR) {
-        fprintf(stderr, "failed to construct value\n");
-        goto clean_up;
-    }
+static int add_ternary_table_prefix(char *new_prefix, char *prefix_value, uint32_t priority,
+                                    nikss_table_entry_ctx_t *ctx)
+{
+    int err = NO_ERROR;
+    uint32_t prev = 0;
+    struct ternary_table_prefix_metadata prefix_md;
 
-    if (ctx->is_ternary == true && key_mask_buffer != NULL) {
-        mem_bitwise_and((uint32_t *) key_buffer, (uint32_t *) key_mask_buffer, ctx->table.key_size);
+    if (get_ternary_table_prefix_md(ctx, &prefix_md) != NO_ERROR) {
+        fprintf(stderr, "failed to obtain offsets and sizes of prefix\n");
+        return EPERM;
     }
 
-    /* Handle direct objects */
-    return_code = handle_direct_objects_write(key_buffer, value_buffer, &ctx->table, ctx, entry, bpf_flags);
-    if (return_code != NO_ERROR) {
-        fprintf(stderr, "failed to handle direct objects: %s\n", strerror(return_code));
-        goto clean_up;
-    }
+    uint32_t tuple_id = 0;
+    for (unsigned attempt = 0; ; attempt++) {
+        /* Find the last prefix, it is also required to allocate unique tuple id */
+        err = sync_ternary_prefix_cache(ctx, &prefix_md, &prev, NULL);
+        if (err != NO_ERROR) {
+            return err;
+        }
 
-    /* update map */
-    if (ctx->table.type == BPF_MAP_TYPE_ARRAY) {
-        bpf_flags = BPF_ANY;
-    }
-    return_code = bpf_map_update_elem(ctx->table.fd, key_buffer, value_buffer, bpf_flags);
-    if (return_code != 0) {
-        return_code = errno;
-        fprintf(stderr, "failed to set up entry: %s\n", strerror(errno));
-    } else {
-        return_code = clear_table_cache(&ctx->cache);
-        if (return_code != NO_ERROR) {
-            fprintf(stderr, "failed to clear cache: %s\n", strerror(return_code));
+        if (ctx->sort_tuples) {
+            prev = find_sorted_prefix_position(ctx, priority);
+            if (prev != ctx->prefix_cache_count - 1 && cached_prefix_is_current(ctx, prev) == false) {
+                if ((err = load_ternary_prefix_cache(ctx, &prefix_md)) != NO_ERROR) {
+                    return err;
+                }
+                prev = find_sorted_prefix_position(ctx, priority);
+            }
         }
-    }
 
-clean_up:
-    if (key_buffer != NULL) {
-        free(key_buffer);
+        err = get_lowest_free_tuple_id(ctx, &prefix_md, &tuple_id);
+        /* Stale cache is invalidated, so the next attempt reloads it */
+        if (err != ESTALE || attempt > 0) {
+            break;
+        }
     }
-    if (key_mask_buffer != NULL) {
-        free(key_mask_buffer);
+    if (err != NO_ERROR) {
+        return err;
     }
-    if (value_buffer != NULL) {
-        free(value_buffer);
+    if (tuple_id >= ctx->tuple_map.max_entries) {
+        fprintf(stderr, "no free tuple left, consider compaction of tuples\n");
+        return ENOSPC;
     }
+    /* Tuple left by a failed delete must not be used by new prefix */
+    bpf_map_delete_elem(ctx->tuple_map.fd, &tuple_id);
 
-    if (ctx->is_ternary) {
-        ternary_table_close_tuple(ctx);
+    char *key = ctx->prefix_cache_keys + (size_t) prev * ctx->prefixes.key_size;
+    char *value = ctx->prefix_cache_values + (size_t) prev * ctx->prefixes.value_size;
+
+    /* First add new prefix to avoid data inconsistency, it takes over
+     * the next prefix from the previous one */
+    memset(prefix_value, 0, ctx->prefixes.value_size);
+    *((uint32_t *) (prefix_value + prefix_md.tuple_id_offset)) = tuple_id;
+    memcpy(prefix_value + prefix_md.next_mask_offset, value + prefix_md.next_mask_offset, prefix_md.next_mask_size);
+    memcpy(prefix_value + prefix_md.has_next_offset, value + prefix_md.has_next_offset, prefix_md.has_next_size);
+    err = bpf_map_update_elem(ctx->prefixes.fd, new_prefix, prefix_value, BPF_NOEXIST);
+    if (err != 0) {
+        err = errno;
+        ctx->prefix_cache_valid = false;
+        return err;
     }
 
-    return return_code;
-}
+    /* Update previous node */
+    memcpy(value + prefix_md.next_mask_offset, new_prefix, prefix_md.next_mask_size);
+    *((uint8_t *) (value + prefix_md.has_next_offset)) = 1;
+    err = bpf_map_update_elem(ctx->prefixes.fd, key, value, BPF_ANY);
+    if (err != 0) {
+        err = errno;
+        ctx->prefix_cache_valid = false;
+        return err;
+    }
 
-int nikss_table_entry_add(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry)
-{
-    return nikss_table_entry_write(ctx, entry, BPF_NOEXIST);
-}
+    if (insert_cached_prefix(ctx, prev + 1, new_prefix, prefix_value, priority) != NO_ERROR) {
+        /* Map is already updated, so reload cache on the next use */
+        ctx->prefix_cache_valid = false;
+        return NO_ERROR;
+    }
 
-int nikss_table_entry_update(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry)
-{
-    return nikss_table_entry_write(ctx, entry, BPF_EXIST);
+    return NO_ERROR;
 }
 
-static int prepare_ternary_table_delete(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, char **key_mask)
+static int ternary_table_create_tuple(nikss_table_entry_ctx_t *ctx, uint32_t max_entries)
 {
-    if (entry->n_keys != 0) {
-        return ternary_table_open_tuple(ctx, entry, key_mask, BPF_EXIST);
+    struct bpf_create_map_attr attr = {
+            .key_size = ctx->table.key_size,
+            .value_size = ctx->table.value_size,
+            .max_entries = max_entries,
+            .map_type = ctx->table.type,
+            /* Flags given to tuple template at pipeline load, e.g. BPF_F_NO_PREALLOC */
+            .map_flags = ctx->table.map_flags,
+            .btf_fd = ctx->btf_metadata.btf_fd,
+            .btf_key_type_id = ctx->table.map_key_type_id,
+            .btf_value_type_id = ctx->table.map_value_type_id,
+    };
+    if ((attr.map_flags & BPF_F_NUMA_NODE) != 0) {
+        /* Without the saved node tuple would be placed on node 0; dropping the flag makes it
+         * incompatible with the inner map of tuples map, so tuple can't be created at all */
+        if (ctx->tuple_numa_node < 0) {
+            fprintf(stderr, "NUMA node of tuples is not known\n");
+            errno = ENODEV;
+            return -1;
+        }
+        attr.numa_node = (uint32_t) ctx->tuple_numa_node;
     }
 
-    delete_all_map_entries(&ctx->prefixes);
-    fprintf(stderr, "removing entries from tuples_map, this may take a while\n");
-    delete_all_map_entries(&ctx->tuple_map);
-
-    /* Unpinning inner maps for our table is not required
-     * because they are not pinned by this tool. */
-
-    return NO_ERROR;
+    return bpf_create_map_xattr(&attr);
 }
 
-static int ternary_table_remove_prefix(nikss_table_entry_ctx_t *ctx, const char *key_mask)
+static int ternary_table_add_tuple_and_open(nikss_table_entry_ctx_t *ctx, const uint32_t tuple_id)
 {
     int err = NO_ERROR;
-    char *prev_key_mask = malloc(ctx->prefixes.key_size);
-    char *prev_value_mask = malloc(ctx->prefixes.value_size);
-    char *value_mask = malloc(ctx->prefixes.value_size);
-
-    if (prev_key_mask == NULL || prev_value_mask == NULL || value_mask == NULL) {
-        fprintf(stderr, "not enough memory\n");
-        err = ENOMEM;
-        goto clean_up;
+    uint32_t max_entries = ctx->table.max_entries;
+    if (ctx->tuple_initial_size > 0 && ctx->tuple_initial_size < max_entries) {
+        max_entries = ctx->tuple_initial_size;
     }
 
-    if (bpf_map_lookup_elem(ctx->prefixes.fd, key_mask, value_mask) != 0) {
+    ctx->table.fd = ternary_table_create_tuple(ctx, max_entries);
+    if (ctx->table.fd < 0) {
         err = errno;
-        fprintf(stderr, "unable to obtain prefix: %s\n", strerror(err));
-        goto clean_up;
-    }
-
-    struct ternary_table_prefix_metadata prefix_md;
-    if ((err = get_ternary_table_prefix_md(ctx, &prefix_md)) != NO_ERROR) {
-        fprintf(stderr, "failed to obtain offsets and sizes of prefix\n");
-        goto clean_up;
+        fprintf(stderr, "failed to create tuple %u: %s\n", tuple_id, strerror(err));
+        return err;
     }
 
-    /* find previous prefix */
-    bool prev_prefix_found = false;
-    memset(prev_key_mask, 0, ctx->prefixes.key_size);
-    err = bpf_map_lookup_elem(ctx->prefixes.fd, prev_key_mask, prev_value_mask);
+    /* add tuple to tuples map */
+    err = bpf_map_update_elem(ctx->tuple_map.fd, &tuple_id, &(ctx->table.fd), 0);
     if (err != 0) {
         err = errno;
-        fprintf(stderr, "head not found: %s\n", strerror(err));
-        goto clean_up;
-    }
-
-    while (true) {
-        /* it is an previous prefix? */
-        if (memcmp(prev_value_mask + prefix_md.next_mask_offset, key_mask, prefix_md.next_mask_size) == 0) {
-            prev_prefix_found = true;
-            break;
-        }
-
-        /* get next prefix */
-        uint8_t has_next = *((uint8_t *) (prev_value_mask + prefix_md.has_next_offset));
-        if (has_next == 0) {
-            break;
-        }
-        memcpy(prev_key_mask, prev_value_mask + prefix_md.next_mask_offset, prefix_md.next_mask_size);
-        if (bpf_map_lookup_elem(ctx->prefixes.fd, prev_key_mask, prev_value_mask) != 0) {
-            break;
+        close_object_fd(&(ctx->table.fd));
+        if (err == EINVAL && max_entries != ctx->table.max_entries) {
+            /* Inner map must have the same size as the one from the program */
+            fprintf(stderr, "warning: tuples of different size are not supported, using size of the table\n");
+            ctx->tuple_initial_size = 0;
+            return ternary_table_add_tuple_and_open(ctx, tuple_id);
         }
+        fprintf(stderr, "failed to add tuple %u: %s\n", tuple_id, strerror(err));
     }
 
-    if (prev_prefix_found == false) {
-        fprintf(stderr, "detected data inconsistency in prefixes: no previous prefix\n");
-    } else {
-        /* copy next_mask and has_next to the previous prefix */
-        memcpy(prev_value_mask + prefix_md.next_mask_offset,
-               value_mask + prefix_md.next_mask_offset, prefix_md.next_mask_size);
-        memcpy(prev_value_mask + prefix_md.has_next_offset,
-               value_mask + prefix_md.has_next_offset, prefix_md.has_next_size);
+    return err;
+}
 
-        err = bpf_map_update_elem(ctx->prefixes.fd, prev_key_mask, prev_value_mask, BPF_EXIST);
-        if (err != 0) {
-            err = errno;
-            fprintf(stderr, "failed to update previous prefix: %s\n", strerror(err));
-            goto clean_up;
-        }
-    }
+static int copy_map_entries(int src_fd, int dst_fd, uint32_t key_size, uint32_t value_size)
+{
+    int err = NO_ERROR;
+    char *key = malloc(key_size);
+    char *next_key = malloc(key_size);
+    char *value = malloc(value_size);
 
-    /* there are no prefixes that points to removing prefix, so it can be safely removed now */
-    if (bpf_map_delete_elem(ctx->prefixes.fd, key_mask) != 0) {
-        fprintf(stderr, "warning: failed to remove prefix from prefixes list\n");
+    if (key == NULL || next_key == NULL || value == NULL) {
+        err = ENOMEM;
+        goto clean_up;
     }
 
-    /* also remove tuple from tuple_map */
-    uint32_t tuple_id = *((uint32_t *) (value_mask + prefix_md.tuple_id_offset));
-    if (bpf_map_delete_elem(ctx->tuple_map.fd, &tuple_id) != 0) {
-        fprintf(stderr, "warning: failed to remove tuple from tuples_map\n");
+    if (bpf_map_get_next_key(src_fd, NULL, next_key) != 0) {
+        goto clean_up;  /* empty map */
     }
-
-    /* unpinning not required - inner map is not pinned by this tool*/
-
-    err = NO_ERROR;
+    do {
+        memcpy(key, next_key, key_size);
+        if (bpf_map_lookup_elem(src_fd, key, value) != 0) {
+            continue;  /* removed in the meantime */
+        }
+        if (bpf_map_update_elem(dst_fd, key, value, BPF_NOEXIST) != 0) {
+            err = errno;
+            break;
+        }
+    } while (bpf_map_get_next_key(src_fd, key, next_key) == 0);
 
 clean_up:
-    if (prev_key_mask != NULL) {
-        free(prev_key_mask);
+    if (key != NULL) {
+        free(key);
     }
-    if (prev_value_mask != NULL) {
-        free(prev_value_mask);
+    if (next_key != NULL) {
+        free(next_key);
     }
-    if (value_mask != NULL) {
-        free(value_mask);
+    if (value != NULL) {
+        free(value);
     }
 
     return err;
 }
 
-static int post_ternary_table_delete(nikss_table_entry_ctx_t *ctx, const char *key_mask)
+/* Replaces opened tuple with a new one of the given size. Entries are copied first, then the new tuple
+ * is swapped in the tuples map, so the data plane always sees a complete tuple. New tuple stays opened. */
+static int ternary_table_resize_tuple(nikss_table_entry_ctx_t *ctx, uint32_t tuple_id, uint32_t max_entries)
 {
-    if (ctx->is_ternary == false || ctx->table.fd < 0) {
-        return NO_ERROR;
-    }
-    if (key_mask == NULL) {
-        return ENODATA;
+    int new_fd = ternary_table_create_tuple(ctx, max_entries);
+    if (new_fd < 0) {
+        int err = errno;
+        fprintf(stderr, "failed to create tuple %u: %s\n", tuple_id, strerror(err));
+        return err;
     }
 
-    int err = NO_ERROR;
-    char *tuple_next_key = malloc(ctx->table.key_size);
+    int err = copy_map_entries(ctx->table.fd, new_fd, ctx->table.key_size, ctx->table.value_size);
+    if (err != NO_ERROR) {
+        fprintf(stderr, "failed to copy entries of tuple %u: %s\n", tuple_id, strerror(err));
+        close_object_fd(&new_fd);
+        return err;
+    }
 
-    if (tuple_next_key == NULL) {
-        fprintf(stderr, "not enough memory\n");
-        err = ENOMEM;
-        goto clean_up;
-    }
-
-    if (bpf_map_get_next_key(ctx->table.fd, NULL, tuple_next_key) != 0) {
-        err = ternary_table_remove_prefix(ctx, key_mask);
-    }
-
-clean_up:
-    if (tuple_next_key != NULL) {
-        free(tuple_next_key);
+    if (bpf_map_update_elem(ctx->tuple_map.fd, &tuple_id, &new_fd, BPF_ANY) != 0) {
+        err = errno;
+        fprintf(stderr, "failed to replace tuple %u: %s\n", tuple_id, strerror(err));
+        close_object_fd(&new_fd);
+        return err;
     }
 
     close_object_fd(&(ctx->table.fd));
-    return err;
+    ctx->table.fd = new_fd;
+
+    return NO_ERROR;
 }
 
-int nikss_table_entry_del(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry)
+static int get_tuple_id_by_mask(nikss_table_entry_ctx_t *ctx, const char *key_mask, uint32_t *tuple_id)
 {
-    char *key_buffer = NULL;
-    char *key_mask_buffer = NULL;
-    int return_code = NO_ERROR;
-
-    if (ctx == NULL || entry == NULL) {
-        return EINVAL;
+    struct ternary_table_prefix_metadata prefix_md;
+    if (get_ternary_table_prefix_md(ctx, &prefix_md) != NO_ERROR) {
+        fprintf(stderr, "failed to obtain offsets and sizes of prefix\n");
+        return EPERM;
     }
 
-    if (ctx->is_ternary) {
-        return_code = prepare_ternary_table_delete(ctx, entry, &key_mask_buffer);
-        if (return_code != NO_ERROR) {
-            fprintf(stderr, "failed to prepare ternary table for delete\n");
-            goto clean_up;
-        }
-        if (entry->n_keys == 0) {
-            goto clean_up;
-        }
+    char *value = malloc(ctx->prefixes.value_size);
+    if (value == NULL) {
+        return ENOMEM;
     }
 
-    if (ctx->table.fd < 0) {
-        fprintf(stderr, "can't delete entry: table not opened\n");
-        return EBADF;
-    }
-    if (ctx->table.key_size == 0) {
-        fprintf(stderr, "zero-size key is not supported\n");
-        return ENOTSUP;
+    int err = NO_ERROR;
+    if (bpf_map_lookup_elem(ctx->prefixes.fd, key_mask, value) != 0) {
+        err = errno;
+    } else {
+        *tuple_id = *((uint32_t *) (value + prefix_md.tuple_id_offset));
     }
+    free(value);
 
-    /* remove all entries from table if key is not present */
-    if (entry->n_keys == 0) {
-        if (ctx->table.type == BPF_MAP_TYPE_ARRAY) {
-            fprintf(stderr, "removing entries from array map may take a while\n");
-        }
-        return_code = delete_all_map_entries(&ctx->table);
-        if (return_code == NO_ERROR) {
-            return_code = clear_table_cache(&ctx->cache);
-            if (return_code != NO_ERROR) {
-                fprintf(stderr, "failed to clear table cache: %s\n", strerror(return_code));
-            }
-        }
-        return return_code;
-    }
+    return err;
+}
 
-    /* prepare buffers for map key */
-    key_buffer = malloc(ctx->table.key_size);
-    if (key_buffer == NULL) {
-        fprintf(stderr, "not enough memory\n");
-        return_code = ENOMEM;
-        goto clean_up;
-    }
+/* Called when opened tuple is full, doubles its size up to the size of the table. Tuple might be created small
+ * by another context or shrunk by compaction, so it does not depend on tuple_initial_size of this context. */
+static int ternary_table_grow_tuple(nikss_table_entry_ctx_t *ctx, const char *key_mask)
+{
+    struct bpf_map_info info = {0};
+    uint32_t info_len = sizeof(info);
+    uint32_t tuple_id = 0;
 
-    return_code = construct_buffer(key_buffer, ctx->table.key_size, ctx, entry,
-                                   fill_key_btf_info, fill_key_byte_by_byte);
-    if (return_code != NO_ERROR) {
-        fprintf(stderr, "failed to construct key\n");
-        goto clean_up;
+    if (key_mask == NULL || ctx->table.fd < 0) {
+        return E2BIG;
     }
-
-    if (ctx->is_ternary == true && key_mask_buffer != NULL) {
-        mem_bitwise_and((uint32_t *) key_buffer, (uint32_t *) key_mask_buffer, ctx->table.key_size);
+    if (bpf_obj_get_info_by_fd(ctx->table.fd, &info, &info_len) != 0) {
+        return errno;
     }
-
-    /* delete pointed entry */
-    return_code = bpf_map_delete_elem(ctx->table.fd, key_buffer);
-    if (return_code != 0) {
-        return_code = errno;
-        fprintf(stderr, "failed to delete entry: %s\n", strerror(errno));
-    } else {
-        return_code = clear_table_cache(&ctx->cache);
-        if (return_code != NO_ERROR) {
-            fprintf(stderr, "failed to clear cache: %s\n", strerror(return_code));
-        }
+    if (info.max_entries >= ctx->table.max_entries) {
+        return E2BIG;
     }
 
-clean_up:
-    /* cleanup ternary table */
-    if (ctx->is_ternary) {
-        post_ternary_table_delete(ctx, key_mask_buffer);
+    int err = get_tuple_id_by_mask(ctx, key_mask, &tuple_id);
+    if (err != NO_ERROR) {
+        return err;
     }
 
-    if (key_buffer != NULL) {
-        free(key_buffer);
-    }
-    if (key_mask_buffer != NULL) {
-        free(key_mask_buffer);
+    uint32_t new_size = info.max_entries * 2;
+    if (new_size > ctx->table.max_entries) {
+        new_size = ctx->table.max_entries;
     }
 
-    return return_code;
+    return ternary_table_resize_tuple(ctx, tuple_id, new_size);
 }
 
-int nikss_table_entry_set_default_entry(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry)
+/* Tracks the highest priority of the tuple; list order is fixed by nikss_table_entry_ctx_rebalance_tuples() */
+static void track_cached_prefix_priority(nikss_table_entry_ctx_t *ctx, const char *key_mask, uint32_t priority)
 {
-    /* For default entry array map is used, it always has key 32-bit width and its value is assumed to be 0. */
-    const uint32_t key = 0;
-    char *value_buffer = NULL;
-    int return_code = NO_ERROR;
+    if (ctx->sort_tuples == false || ctx->prefix_cache_valid == false) {
+        return;
+    }
 
-    if (ctx == NULL || entry == NULL) {
-        return EINVAL;
+    int index = find_cached_prefix(ctx, key_mask);
+    if (index > 0 && ctx->prefix_cache_priorities[index] < priority) {
+        ctx->prefix_cache_priorities[index] = priority;
     }
+}
 
-    if (ctx->default_entry.fd < 0) {
-        fprintf(stderr, "can't add default entry: table not opened or table has no default entry\n");
-        return EBADF;
+/* Opens tuple for already encoded key mask, adds new prefix and tuple when needed */
+static int ternary_table_open_tuple_by_mask(nikss_table_entry_ctx_t *ctx, char *key_mask,
+                                            uint32_t priority, uint64_t bpf_flags)
+{
+    if (ctx->prefixes.fd < 0 || ctx->tuple_map.fd < 0 || ctx->table.fd >= 0) {
+        fprintf(stderr, "ternary table not properly opened. BUG?\n");
+        return EINVAL;
     }
-    if (ctx->default_entry.key_size != sizeof(key) ||
-            ctx->default_entry.value_size == 0 || ctx->default_entry.value_size != ctx->table.value_size) {
-        fprintf(stderr, "key size or value is not supported\n");
-        return ENOTSUP;
+    if (ctx->table.key_size != ctx->prefixes.key_size) {
+        fprintf(stderr, "key and its mask have different length. BUG?\n");
+        return EINVAL;
     }
-    if (entry->action == NULL) {
-        fprintf(stderr, "missing action specification\n");
-        return ENODATA;
+    if (ctx->tuple_map.key_size != 4 || ctx->tuple_map.value_size != 4) {
+        fprintf(stderr, "key/value size of tuples map have to be 4B.\n");
+        return EINVAL;
     }
 
-    /* prepare buffer for map value */
-    value_buffer = malloc(ctx->default_entry.value_size);
-    if (value_buffer == NULL) {
+    int err = NO_ERROR;
+    char *value_mask = malloc(ctx->prefixes.value_size);
+
+    if (value_mask == NULL) {
         fprintf(stderr, "not enough memory\n");
         return ENOMEM;
     }
+    memset(value_mask, 0, ctx->prefixes.value_size);
 
-    return_code = construct_buffer(value_buffer, ctx->default_entry.value_size, ctx, entry,
-                                   fill_value_btf_info, fill_value_byte_by_byte);
-    if (return_code != NO_ERROR) {
-        fprintf(stderr, "failed to construct value\n");
+    /* prefixes head protection - check whether mask is different from all 0 */
+    bool mask_is_valid = false;
+    for (unsigned i = 0; i < ctx->prefixes.key_size; i++) {
+        if (key_mask[i] != 0) {
+            mask_is_valid = true;
+            break;
+        }
+    }
+    if (mask_is_valid == false) {
+        fprintf(stderr, "invalid key mask: all bytes are zeroed - use default action instead\n");
+        err = EINVAL;
         goto clean_up;
     }
 
-    /* Handle direct objects - default entry always exists
-     * and is treated like a regular entry, including with regards to direct resources */
-    return_code = handle_direct_objects_write((void *) &key, value_buffer, &ctx->default_entry, ctx, entry, BPF_EXIST);
-    if (return_code != NO_ERROR) {
-        fprintf(stderr, "failed to handle direct objects: %s\n", strerror(return_code));
+    err = bpf_map_lookup_elem(ctx->prefixes.fd, key_mask, value_mask);
+    /* It is not allowed to add new prefix when updating existing entry */
+    if (err != 0 && bpf_flags != BPF_EXIST) {
+        err = add_ternary_table_prefix(key_mask, value_mask, priority, ctx);
+        if (err != NO_ERROR) {
+            fprintf(stderr, "unable to add new prefix\n");
+            goto clean_up;
+        }
+    } else if (err != 0) {
+        fprintf(stderr, "entry with prefix not found\n");
+        err = ENOENT;
         goto clean_up;
     }
 
-    /* update map */
-    return_code = bpf_map_update_elem(ctx->default_entry.fd, &key, value_buffer, BPF_ANY);
-    if (return_code != 0) {
-        return_code = errno;
-        fprintf(stderr, "failed to set up entry: %s\n", strerror(errno));
+    struct ternary_table_prefix_metadata prefix_md;
+    if (get_ternary_table_prefix_md(ctx, &prefix_md) != NO_ERROR) {
+        fprintf(stderr, "failed to obtain offsets and sizes of prefix\n");
+        err = EPERM;
+        goto clean_up;
+    }
+    uint32_t tuple_id = *((uint32_t *) (value_mask + prefix_md.tuple_id_offset));
+    uint32_t inner_map_id = 0;
+
+    track_cached_prefix_priority(ctx, key_mask, priority);
+
+    err = bpf_map_lookup_elem(ctx->tuple_map.fd, &tuple_id, &inner_map_id);
+    if (err == 0) {
+        ctx->table.fd = bpf_map_get_fd_by_id(inner_map_id);
+        err = NO_ERROR;
     } else {
-        return_code = clear_table_cache(&ctx->cache);
-        if (return_code != NO_ERROR) {
-            fprintf(stderr, "failed to clear cache: %s\n", strerror(return_code));
+        if (bpf_flags == BPF_EXIST) {
+            fprintf(stderr, "tuple not found\n");
+            err = ENOENT;
+            goto clean_up;
         }
+        err = ternary_table_add_tuple_and_open(ctx, tuple_id);
     }
 
 clean_up:
-    if (value_buffer != NULL) {
-        free(value_buffer);
+    if (value_mask != NULL) {
+        free(value_mask);
     }
 
-    return return_code;
+    return err;
 }
 
-static int parse_table_value_no_btf(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, const char *value)
+static int ternary_table_open_tuple(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry,
+                                    char **key_mask, uint64_t bpf_flags)
 {
-    size_t buffer_size = ctx->table.value_size;
+    *key_mask = malloc(ctx->prefixes.key_size);
+    if (*key_mask == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return ENOMEM;
+    }
+    memset(*key_mask, 0, ctx->prefixes.key_size);
 
-    /* Action ID */
-    if (ctx->is_indirect == false) {
-        if (buffer_size < sizeof(uint32_t)) {
-            fprintf(stderr, "too small value type\n");
-            return EINVAL;
-        }
-        entry->action->action_id = *((uint32_t *) value);
-        value += sizeof(uint32_t);
-        buffer_size -= sizeof(uint32_t);
+    int err = construct_buffer(*key_mask, ctx->prefixes.key_size, ctx, entry,
+                               fill_key_mask_btf, fill_key_mask_byte_by_byte);
+    if (err != NO_ERROR) {
+        return err;
     }
 
-    /* Priority */
+    return NIKSS_STATS_CALL(NIKSS_STATS_TERNARY_TUPLE_OPEN,
+                            ternary_table_open_tuple_by_mask(ctx, *key_mask, entry->priority, bpf_flags));
+}
+
+static void ternary_table_close_tuple(nikss_table_entry_ctx_t *ctx)
+{
+    /* Allow for reuse table context with the same table but other tuple (inner map). */
     if (ctx->is_ternary) {
-        if (buffer_size < sizeof(uint32_t)) {
-            fprintf(stderr, "too small value type\n");
-            return EINVAL;
-        }
-        entry->priority = *((uint32_t *) value);
-        value += sizeof(uint32_t);
-        buffer_size -= sizeof(uint32_t);
+        close_object_fd(&(ctx->table.fd));
     }
+}
 
-    /* Action data, without BTF we can only return binary blob */
-    if (buffer_size > 0) {
-        entry->action->params = malloc(sizeof(nikss_action_param_t));
-        if (entry->action->params == NULL) {
-            return ENOMEM;
+#define DELETE_ALL_BATCH_SIZE 1024
+
+/* Entries of array can't be removed, so they are reset to zero value in batches */
+static int reset_array_map_batch(nikss_bpf_map_descriptor_t *map)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = 0,
+                        .flags = 0,
+    );
+    uint32_t *keys = malloc(DELETE_ALL_BATCH_SIZE * sizeof(uint32_t));
+    char *values = calloc(DELETE_ALL_BATCH_SIZE, map->value_size);
+    int error_code = NO_ERROR;
+
+    if (keys == NULL || values == NULL || map->key_size != sizeof(uint32_t)) {
+        error_code = keys == NULL || values == NULL ? ENOMEM : ENOTSUP;
+        goto clean_up;
+    }
+
+    for (uint32_t first = 0; first < map->max_entries; first += DELETE_ALL_BATCH_SIZE) {
+        uint32_t count = map->max_entries - first;
+        if (count > DELETE_ALL_BATCH_SIZE) {
+            count = DELETE_ALL_BATCH_SIZE;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            keys[i] = first + i;
+        }
+        if (bpf_map_update_batch(map->fd, keys, values, &count, &opts) != 0) {
+            error_code = errno;
+            break;
         }
-        entry->action->n_params = 1;
-        return nikss_action_param_create(&entry->action->params[0], value, buffer_size);
     }
 
-    return NO_ERROR;
+clean_up:
+    if (keys != NULL) {
+        free(keys);
+    }
+    if (values != NULL) {
+        free(values);
+    }
+    return error_code;
 }
 
-static int parse_table_value_action(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry,
-                                    const char *value, uint32_t value_type_id)
+static int delete_hash_map_batch(nikss_bpf_map_descriptor_t *map)
 {
-    /* Get action ID */
-    btf_struct_member_md_t action_id_md = {};
-    if (btf_get_member_md_by_name(ctx->btf_metadata.btf, value_type_id, "action", &action_id_md) != NO_ERROR) {
-        return ENOENT;
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = 0,
+                        .flags = 0,
+    );
+    /* For hash maps batch token is a bucket number */
+    size_t token_size = map->key_size > sizeof(uint64_t) ? map->key_size : sizeof(uint64_t);
+    char *in_token = calloc(1, token_size);
+    char *out_token = calloc(1, token_size);
+    char *keys = malloc((size_t) DELETE_ALL_BATCH_SIZE * map->key_size);
+    char *values = malloc((size_t) DELETE_ALL_BATCH_SIZE * get_map_value_buffer_size(map));
+    int error_code = NO_ERROR;
+    bool first = true;
+
+    if (in_token == NULL || out_token == NULL || keys == NULL || values == NULL) {
+        error_code = ENOMEM;
+        goto clean_up;
     }
-    size_t action_id_size = btf_get_type_size_by_id(ctx->btf_metadata.btf, action_id_md.effective_type_id);
-    if (action_id_size > sizeof(entry->action->action_id)) {
-        return EINVAL;
+
+    while (true) {
+        uint32_t count = DELETE_ALL_BATCH_SIZE;
+        int err = bpf_map_lookup_and_delete_batch(map->fd, first ? NULL : in_token, out_token,
+                                                  keys, values, &count, &opts);
+        if (err != 0) {
+            err = errno;
+        }
+        if (err == ENOENT) {
+            break;  /* all buckets visited */
+        }
+        if (err != NO_ERROR) {
+            error_code = err;
+            break;
+        }
+        memcpy(in_token, out_token, token_size);
+        first = false;
     }
-    entry->action->action_id = 0;
-    memcpy(&entry->action->action_id, value + action_id_md.bit_offset / 8, action_id_size);
 
-    /* Get action params */
-    btf_struct_member_md_t union_md = {};
-    if (btf_get_member_md_by_name(ctx->btf_metadata.btf, value_type_id, "u", &union_md) != NO_ERROR) {
-        return EINVAL;
+clean_up:
+    if (in_token != NULL) {
+        free(in_token);
     }
-    btf_struct_member_md_t action_md = {};
-    if (btf_get_member_md_by_index(ctx->btf_metadata.btf, union_md.effective_type_id, entry->action->action_id, &action_md) != NO_ERROR) {
-        return EINVAL;
+    if (out_token != NULL) {
+        free(out_token);
     }
-
-    const struct btf_type *action_type = btf_get_type_by_id(ctx->btf_metadata.btf, action_md.effective_type_id);
-    if (action_type == NULL) {
-        return EINVAL;
+    if (keys != NULL) {
+        free(keys);
     }
-    if (!btf_is_struct(action_type)) {
-        return EINVAL;
+    if (values != NULL) {
+        free(values);
     }
+    return error_code;
+}
 
-    const unsigned number_of_params = btf_vlen(action_type);
-    if (number_of_params == 0) {
+/* Returns ENOTSUP or other error when map has to be cleared element by element */
+static int delete_all_map_entries_batch(nikss_bpf_map_descriptor_t *map)
+{
+    switch (map->type) {
+        case BPF_MAP_TYPE_ARRAY:
+            return reset_array_map_batch(map);
+        case BPF_MAP_TYPE_HASH:
+        case BPF_MAP_TYPE_PERCPU_HASH:
+        case BPF_MAP_TYPE_LRU_HASH:
+        case BPF_MAP_TYPE_LRU_PERCPU_HASH:
+            return delete_hash_map_batch(map);
+        default:
+            return ENOTSUP;
+    }
+}
+
+int delete_all_map_entries(nikss_bpf_map_descriptor_t *map)
+{
+    fprintf(stderr, "removing all entries from table\n");
+
+    /* Entries left after failure of batch operation are removed below */
+    if (delete_all_map_entries_batch(map) == NO_ERROR) {
         return NO_ERROR;
     }
-    entry->action->params = malloc(number_of_params * sizeof(nikss_action_param_t));
-    if (entry->action->params == NULL) {
-        return ENOMEM;
+
+    char * key = malloc(map->key_size);
+    char * next_key = malloc(map->key_size);
+    char * value = calloc(1, map->value_size);
+    int error_code = NO_ERROR;
+
+    if (key == NULL || next_key == NULL || value == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        error_code = ENOMEM;
+        goto clean_up;
     }
-    entry->action->n_params = number_of_params;
 
-    const size_t base_offset = (union_md.bit_offset + action_md.bit_offset) / 8;
-    const struct btf_member *member = btf_members(action_type);
-    for (unsigned i = 0; i < number_of_params; i++, member++) {
-        btf_struct_member_md_t param_md = {};
-        if (btf_get_member_md_by_index(ctx->btf_metadata.btf, action_md.effective_type_id, i, &param_md) != NO_ERROR) {
-            return EINVAL;
-        }
+    if (bpf_map_get_next_key(map->fd, NULL, next_key) != 0) {
+        goto clean_up;  /* table empty */
+    }
+    do {
+        /* Swap buffers, so next_key will become key and next_key may be reused */
+        char * tmp_key = next_key;
+        next_key = key;
+        key = tmp_key;
 
-        size_t offset = base_offset + param_md.bit_offset / 8;
-        size_t size = btf_get_type_size_by_id(ctx->btf_metadata.btf, param_md.effective_type_id);
-        if (size + offset > ctx->table.value_size) {
-            return EINVAL;
+        /* Ignore error(s) from bpf_map_delete_elem(). In some cases key may exist
+         * but entry not exists (e.g. array map in map). So in any case we have to
+         * iterate over all keys and try to delete it. It is not possible to remove
+         * entry from array map, in such case reset entries to zero value. */
+        if (map->type == BPF_MAP_TYPE_ARRAY) {
+            bpf_map_update_elem(map->fd, key, value, BPF_ANY);
+        } else {
+            bpf_map_delete_elem(map->fd, key);
         }
+    } while (bpf_map_get_next_key(map->fd, key, next_key) == 0);
 
-        int ret = nikss_action_param_create(&entry->action->params[i], value + offset, size);
-        entry->action->params[i].param_id = i;
-        if (ret != NO_ERROR) {
-            return ret;
-        }
+clean_up:
+    if (key) {
+        free(key);
+    }
+    if (next_key) {
+        free(next_key);
+    }
+    if (value) {
+        free(value);
+    }
+    return error_code;
+}
 
-        /* params wider than 64 bits are in network byte order */
-        if (entry->action->params[i].len > 8) {
-            swap_byte_order(entry->action->params[i].data, entry->action->params[i].len);
-        }
+int clear_table_cache(nikss_bpf_map_descriptor_t *map)
+{
+    if (map == NULL || map->fd < 0) {
+        return NO_ERROR;
     }
 
-    return NO_ERROR;
+    fprintf(stderr, "clearing table cache: ");
+    return delete_all_map_entries(map);
 }
 
-static int parse_table_value_priority(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry,
-                                      const char *value, uint32_t value_type_id)
+/* Data plane ignores cache entries stored with another epoch, so incrementing it invalidates whole cache */
+static int increment_table_cache_epoch(nikss_table_entry_ctx_t *ctx)
 {
-    if (ctx->is_ternary == false) {
-        return NO_ERROR;
+    uint32_t key = 0;
+    uint64_t epoch = 0;
+    uint32_t epoch32 = 0;
+    void *value = ctx->cache_epoch.value_size == sizeof(epoch32) ? (void *) &epoch32 : (void *) &epoch;
+    int return_code = NO_ERROR;
+
+    if (ctx->cache_epoch.value_size != sizeof(epoch32) && ctx->cache_epoch.value_size != sizeof(epoch)) {
+        return ENOTSUP;
     }
 
-    btf_struct_member_md_t priority_md = {};
-    if (btf_get_member_md_by_name(ctx->btf_metadata.btf, value_type_id, "priority", &priority_md) != NO_ERROR) {
-        return ENOENT;
+    /* Increment must not be lost when other process changes the table at the same time. Ternary writes
+     * already hold this lock, it is reentrant so it is only taken again here. */
+    int lock_fd = pipeline_lock(ctx->pipeline_id);
+    if (lock_fd < 0) {
+        return -lock_fd;
     }
-    size_t size = btf_get_type_size_by_id(ctx->btf_metadata.btf, priority_md.effective_type_id);
-    if (size > sizeof(entry->priority)) {
-        return EINVAL;
+
+    if (bpf_map_lookup_elem(ctx->cache_epoch.fd, &key, value) != 0) {
+        return_code = errno;
+        goto clean_up;
+    }
+    epoch32 += 1;
+    epoch += 1;
+    if (bpf_map_update_elem(ctx->cache_epoch.fd, &key, value, BPF_ANY) != 0) {
+        return_code = errno;
     }
-    entry->priority = 0;
-    memcpy(&entry->priority, value + priority_md.bit_offset / 8, size);
 
-    return NO_ERROR;
+clean_up:
+    pipeline_unlock(&lock_fd);
+
+    return return_code;
 }
 
-static int parse_table_value_direct_counter(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, const char *value)
+/* Only the first prefixlen bits of LPM key are compared by lookup */
+static void build_lpm_key_mask(nikss_table_entry_ctx_t *ctx, const char *key, unsigned char *mask)
 {
-    if (ctx->n_direct_counters == 0) {
-        return NO_ERROR;
-    }
+    const nikss_table_codec_field_t *prefix_field = &ctx->codec.lpm_prefix;
+    uint32_t prefix_len = 0;
 
-    entry->direct_counters = malloc(ctx->n_direct_counters * sizeof(nikss_direct_counter_entry_t));
-    if (entry->direct_counters == NULL) {
-        return ENOMEM;
+    memset(mask, 0, ctx->table.key_size);
+    memcpy(&prefix_len, key + prefix_field->offset, sizeof(prefix_len));
+    for (size_t i = prefix_field->offset + prefix_field->size; i < ctx->table.key_size && prefix_len > 0; i++) {
+        uint32_t bits = prefix_len < 8 ? prefix_len : 8;
+        mask[i] = (unsigned char) (0xFF << (8 - bits));
+        prefix_len -= bits;
     }
+}
 
-    for (unsigned i = 0; i < ctx->n_direct_counters; i++) {
-        nikss_counter_entry_init(&entry->direct_counters[i].counter);
-        entry->direct_counters[i].counter_idx = ctx->direct_counters_ctx[i].counter_idx;
-        convert_counter_data_to_entry(value + ctx->direct_counters_ctx[i].counter_offset,
-                                      ctx->direct_counters_ctx[i].counter_size,
-                                      ctx->direct_counters_ctx[i].counter_type,
-                                      &entry->direct_counters[i].counter);
+static bool cache_key_matches_entry(const nikss_table_codec_t *codec, const unsigned char *cache_key,
+                                    const unsigned char *key, const unsigned char *mask)
+{
+    for (size_t i = 0; i < codec->n_cache_key_fields; i++) {
+        const nikss_table_codec_cache_field_t *field = &codec->cache_key_fields[i];
+        for (size_t j = 0; j < field->size; j++) {
+            unsigned char field_mask = mask != NULL ? mask[field->key_offset + j] : 0xFF;
+            if (((cache_key[field->cache_offset + j] ^ key[field->key_offset + j]) & field_mask) != 0) {
+                return false;
+            }
+        }
     }
-    entry->n_direct_counters = ctx->n_direct_counters;
 
-    return NO_ERROR;
+    return true;
 }
 
-static int parse_table_value_direct_meter(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, const char *value)
+/* Removes from cache only packets which could be matched by the entry */
+static int remove_matching_cache_entries(nikss_table_entry_ctx_t *ctx, const void *key, const void *key_mask)
 {
-    if (ctx->n_direct_meters == 0) {
-        return NO_ERROR;
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = 0,
+                        .flags = 0,
+    );
+    nikss_bpf_map_descriptor_t *cache = &ctx->cache;
+    unsigned char *lpm_mask = NULL;
+    char *cache_key = malloc(cache->key_size);
+    char *next_key = malloc(cache->key_size);
+    char *matched_keys = NULL;
+    uint32_t n_matched = 0;
+    uint32_t capacity = 0;
+    int return_code = NO_ERROR;
+
+    if (cache_key == NULL || next_key == NULL) {
+        return_code = ENOMEM;
+        goto clean_up;
     }
 
-    entry->direct_meters = malloc(ctx->n_direct_meters * sizeof(nikss_direct_meter_entry_t));
-    if (entry->direct_meters == NULL) {
-        return ENOMEM;
+    if (ctx->table.type == BPF_MAP_TYPE_LPM_TRIE) {
+        lpm_mask = malloc(ctx->table.key_size);
+        if (lpm_mask == NULL) {
+            return_code = ENOMEM;
+            goto clean_up;
+        }
+        build_lpm_key_mask(ctx, key, lpm_mask);
+        key_mask = lpm_mask;
     }
 
-    for (unsigned i = 0; i < ctx->n_direct_meters; i++) {
-        nikss_meter_entry_init(&entry->direct_meters[i].meter);
-        entry->direct_meters[i].meter_idx = ctx->direct_meters_ctx[i].meter_idx;
-        convert_meter_data_to_entry((const nikss_meter_data_t *) (value + ctx->direct_meters_ctx[i].meter_offset),
-                                    &entry->direct_meters[i].meter);
+    /* Keys are collected first, because deleting current key restarts iteration over hash map */
+    if (bpf_map_get_next_key(cache->fd, NULL, next_key) != 0) {
+        goto clean_up;  /* cache empty */
     }
-    entry->n_direct_meters = ctx->n_direct_meters;
+    do {
+        char *tmp_key = next_key;
+        next_key = cache_key;
+        cache_key = tmp_key;
 
-    return NO_ERROR;
+        if (!cache_key_matches_entry(&ctx->codec, (unsigned char *) cache_key, key, key_mask)) {
+            continue;
+        }
+        if (n_matched >= capacity) {
+            uint32_t new_capacity = capacity > 0 ? capacity * 2 : 64;
+            char *keys = realloc(matched_keys, (size_t) new_capacity * cache->key_size);
+            if (keys == NULL) {
+                return_code = ENOMEM;
+                goto clean_up;
+            }
+            matched_keys = keys;
+            capacity = new_capacity;
+        }
+        memcpy(matched_keys + (size_t) n_matched * cache->key_size, cache_key, cache->key_size);
+        n_matched += 1;
+    } while (bpf_map_get_next_key(cache->fd, cache_key, next_key) == 0);
+
+    uint32_t count = n_matched;
+    if (n_matched > 0 && bpf_map_delete_batch(cache->fd, matched_keys, &count, &opts) != 0) {
+        /* Entries may be already evicted by the data plane, so errors are ignored */
+        for (uint32_t i = 0; i < n_matched; i++) {
+            bpf_map_delete_elem(cache->fd, matched_keys + (size_t) i * cache->key_size);
+        }
+    }
+
+clean_up:
+    if (cache_key != NULL) {
+        free(cache_key);
+    }
+    if (next_key != NULL) {
+        free(next_key);
+    }
+    if (matched_keys != NULL) {
+        free(matched_keys);
+    }
+    if (lpm_mask != NULL) {
+        free(lpm_mask);
+    }
+
+    return return_code;
 }
 
-static int parse_table_value_direct_objects(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, const char *value)
+int invalidate_table_cache(nikss_table_entry_ctx_t *ctx, const void *key, const void *key_mask)
 {
-    int ret = parse_table_value_direct_counter(ctx, entry, value);
-    if (ret != NO_ERROR) {
-        return ret;
+    if (ctx->cache.fd < 0) {
+        return NO_ERROR;
     }
 
-    ret = parse_table_value_direct_meter(ctx, entry, value);
-    if (ret != NO_ERROR) {
-        return ret;
+    if (ctx->cache_epoch.fd >= 0 && increment_table_cache_epoch(ctx) == NO_ERROR) {
+        return NO_ERROR;
     }
 
-    return NO_ERROR;
+    bool can_match_entry = key != NULL && ctx->codec.cache_key_compiled &&
+                           (ctx->is_ternary == false || key_mask != NULL) &&
+                           (ctx->table.type != BPF_MAP_TYPE_LPM_TRIE || ctx->codec.has_lpm_prefix);
+    if (can_match_entry && remove_matching_cache_entries(ctx, key, ctx->is_ternary ? key_mask : NULL) == NO_ERROR) {
+        return NO_ERROR;
+    }
+
+    return clear_table_cache(&ctx->cache);
 }
 
-static int parse_table_value_references(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, const char *value)
+/* Keeps the shadow copy in sync with the table, value is NULL for deleted entry */
+static void update_table_shadow(nikss_table_entry_ctx_t *ctx, const void *key, const void *value)
 {
-    unsigned number_of_implementations = ctx->table_implementations.n_fields;
-    if (number_of_implementations < 1) {
-        return NO_ERROR;
+    if (ctx->shadow == NULL) {
+        return;
     }
 
-    entry->action->params = malloc(number_of_implementations * sizeof(nikss_action_param_t));
-    if (entry->action->params == NULL) {
-        return ENOMEM;
+    if (value == NULL) {
+        table_shadow_remove(ctx->shadow, key);
+    } else if (table_shadow_put(ctx->shadow, key, value) != NO_ERROR) {
+        /* Incomplete copy would serve wrong reads */
+        fprintf(stderr, "not enough memory for shadow table, disabling it\n");
+        nikss_table_entry_ctx_shadow(ctx, false);
     }
-    entry->action->n_params = number_of_implementations;
-
-    for (unsigned i = 0; i < number_of_implementations; i++) {
-        nikss_action_param_create(&entry->action->params[i],
-                                   value + ctx->table_implementations.fields[i].data_offset,
-                                   ctx->table_implementations.fields[i].data_len);
-        entry->action->params[i].param_id = i;
+}
 
-        if (ctx->table_implementation_group_marks.fields[i].type == NIKSS_STRUCT_FIELD_TYPE_DATA) {
-            /* Has group mark */
-            const uint32_t *is_group = (uint32_t *) (value + ctx->table_implementation_group_marks.fields[i].data_offset);
-            if (*is_group != 0) {
-                entry->action->params[i].is_group_reference = true;
-            }
-        }
+/* Update of an entry which already has this value does not change anything */
+static bool is_update_in_shadow(nikss_table_entry_ctx_t *ctx, const void *key, const void *value, uint64_t bpf_flags)
+{
+    if (ctx->shadow == NULL || (bpf_flags != BPF_EXIST && ctx->table.type != BPF_MAP_TYPE_ARRAY)) {
+        return false;
     }
 
-    return NO_ERROR;
+    const void *shadow_value = table_shadow_lookup(ctx->shadow, key);
+    return shadow_value != NULL && memcmp(shadow_value, value, ctx->table.value_size) == 0;
 }
 
-static int parse_table_value_btf_info(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, const char *value)
+static void refresh_table_shadow_after_delete_all(nikss_table_entry_ctx_t *ctx)
 {
-    int ret = NO_ERROR;
-    uint32_t value_type_id = ctx->table.value_type_id;
-    if (value_type_id == 0) {
-        return ENOENT;
+    if (ctx->shadow == NULL) {
+        return;
     }
 
-    if (ctx->is_indirect == false) {
-        ret = parse_table_value_action(ctx, entry, value, value_type_id);
-        if (ret != NO_ERROR) {
-            return ret;
-        }
+    /* Entries of array are reset instead of removed */
+    if (ctx->table.type == BPF_MAP_TYPE_ARRAY) {
+        nikss_table_entry_ctx_shadow_reconcile(ctx, NULL, NULL);
     } else {
-        ret = parse_table_value_references(ctx, entry, value);
-        if (ret != NO_ERROR) {
-            return ret;
-        }
+        table_shadow_clear(ctx->shadow);
     }
+}
 
-    ret = parse_table_value_priority(ctx, entry, value, value_type_id);
-    if (ret != NO_ERROR) {
-        return ret;
+/* Builds map key and value for an entry; key_mask_buffer is used only for ternary tables. */
+static int encode_table_entry(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, char *key_buffer,
+                              char *value_buffer, const char *key_mask_buffer, uint64_t bpf_flags)
+{
+    if (entry->action == NULL) {
+        fprintf(stderr, "missing action specification\n");
+        return ENODATA;
     }
 
-    ret = parse_table_value_direct_objects(ctx, entry, value);
-    if (ret != NO_ERROR) {
-        return ret;
+    int return_code = construct_buffer(key_buffer, ctx->table.key_size, ctx, entry,
+                                       fill_key_btf_info, fill_key_byte_by_byte);
+    if (return_code != NO_ERROR) {
+        fprintf(stderr, "failed to construct key\n");
+        return return_code;
+    }
+
+    return_code = construct_buffer(value_buffer, ctx->table.value_size, ctx, entry,
+                                   fill_value_btf_info, fill_value_byte_by_byte);
+    if (return_code != NO_ERROR) {
+        fprintf(stderr, "failed to construct value\n");
+        return return_code;
+    }
+
+    if (ctx->is_ternary == true && key_mask_buffer != NULL) {
+        mem_bitwise_and((uint32_t *) key_buffer, (uint32_t *) key_mask_buffer, ctx->table.key_size);
+    }
+
+    /* Handle direct objects */
+    return_code = handle_direct_objects_write(key_buffer, value_buffer, &ctx->table, ctx, entry, bpf_flags);
+    if (return_code != NO_ERROR) {
+        fprintf(stderr, "failed to handle direct objects: %s\n", strerror(return_code));
+    }
+
+    return return_code;
+}
+
+static int nikss_table_entry_write(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, uint64_t bpf_flags)
+{
+    char *key_buffer = NULL;
+    char *key_mask_buffer = NULL;
+    char *value_buffer = NULL;
+    int return_code = NO_ERROR;
+
+    if (ctx == NULL || entry == NULL) {
+        return EINVAL;
+    }
+
+    if (ctx->is_ternary) {
+        return_code = ternary_table_open_tuple(ctx, entry, &key_mask_buffer, bpf_flags);
+        if (return_code != NO_ERROR) {
+            goto clean_up;
+        }
+    }
+
+    if (ctx->table.fd < 0) {
+        fprintf(stderr, "can't add entry: table not opened\n");
+        return_code = EBADF;
+        goto clean_up;
+    }
+    if (ctx->table.key_size == 0 || ctx->table.value_size == 0) {
+        fprintf(stderr, "zero-size key or value is not supported\n");
+        return_code = ENOTSUP;
+        goto clean_up;
+    }
+
+    /* prepare buffers for map key/value */
+    key_buffer = malloc(ctx->table.key_size);
+    value_buffer = malloc(ctx->table.value_size);
+    if (key_buffer == NULL || value_buffer == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return_code = ENOMEM;
+        goto clean_up;
+    }
+
+    return_code = encode_table_entry(ctx, entry, key_buffer, value_buffer, key_mask_buffer, bpf_flags);
+    if (return_code != NO_ERROR) {
+        goto clean_up;
+    }
+
+    if (is_update_in_shadow(ctx, key_buffer, value_buffer, bpf_flags)) {
+        goto clean_up;
+    }
+
+    /* update map */
+    if (ctx->table.type == BPF_MAP_TYPE_ARRAY) {
+        bpf_flags = BPF_ANY;
+    }
+    if (ctx->dir24.fd >= 0) {
+        return_code = write_table_dir24_entry(ctx, key_buffer, value_buffer, bpf_flags);
+    } else {
+        return_code = bpf_map_update_elem(ctx->table.fd, key_buffer, value_buffer, bpf_flags);
+        if (return_code != 0) {
+            return_code = errno;
+        }
+    }
+    if (return_code == E2BIG && ctx->is_ternary && ternary_table_grow_tuple(ctx, key_mask_buffer) == NO_ERROR) {
+        return_code = bpf_map_update_elem(ctx->table.fd, key_buffer, value_buffer, bpf_flags);
+        if (return_code != 0) {
+            return_code = errno;
+        }
+    }
+    if (return_code != NO_ERROR) {
+        fprintf(stderr, "failed to set up entry: %s\n", strerror(return_code));
+    } else {
+        update_table_shadow(ctx, key_buffer, value_buffer);
+        return_code = invalidate_table_cache(ctx, key_buffer, key_mask_buffer);
+        if (return_code != NO_ERROR) {
+            fprintf(stderr, "failed to clear cache: %s\n", strerror(return_code));
+        }
+    }
+
+clean_up:
+    if (key_buffer != NULL) {
+        free(key_buffer);
+    }
+    if (key_mask_buffer != NULL) {
+        free(key_mask_buffer);
+    }
+    if (value_buffer != NULL) {
+        free(value_buffer);
+    }
+
+    if (ctx->is_ternary) {
+        ternary_table_close_tuple(ctx);
+    }
+
+    return return_code;
+}
+
+int nikss_table_entry_add(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry)
+{
+    return NIKSS_STATS_CALL(NIKSS_STATS_TABLE_ADD,
+                            TERNARY_TABLE_LOCKED(ctx, nikss_table_entry_write(ctx, entry, BPF_NOEXIST)));
+}
+
+int nikss_table_entry_update(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry)
+{
+    return NIKSS_STATS_CALL(NIKSS_STATS_TABLE_UPDATE,
+                            TERNARY_TABLE_LOCKED(ctx, nikss_table_entry_write(ctx, entry, BPF_EXIST)));
+}
+
+static int prepare_ternary_table_delete(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, char **key_mask)
+{
+    return ternary_table_open_tuple(ctx, entry, key_mask, BPF_EXIST);
+}
+
+static int ternary_table_clear(nikss_table_entry_ctx_t *ctx)
+{
+    struct ternary_table_prefix_metadata md;
+    bool has_tuple_ids = get_ternary_table_prefix_md(ctx, &md) == NO_ERROR &&
+                         load_ternary_prefix_cache(ctx, &md) == NO_ERROR;
+
+    int err = NO_ERROR;
+
+    /* Lookup in data plane starts from the head of prefixes, so without it the table is empty at once */
+    char *head_key = calloc(1, ctx->prefixes.key_size);
+    if (head_key == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return ENOMEM;
+    }
+    if (bpf_map_delete_elem(ctx->prefixes.fd, head_key) != 0 && errno != ENOENT) {
+        err = errno;
+    }
+    free(head_key);
+    if (err != NO_ERROR) {
+        /* Data plane still matches entries, so leave the list for it untouched */
+        fprintf(stderr, "failed to remove head of prefixes: %s\n", strerror(err));
+        return err;
+    }
+    ctx->prefix_cache_valid = false;
+    /* Removed prefixes may be added again for new tuples with the same ids */
+    ctx->prefix_cache_has_priorities = false;
+
+    /* Inner maps are released by the kernel when they are removed from tuples_map, so every tuple costs
+     * a single delete regardless of its number of entries. Unpinning them is not required because they
+     * are not pinned by this tool. Tuple without entries might not be in tuples_map. */
+    if (has_tuple_ids) {
+        for (uint32_t i = 1; i < ctx->prefix_cache_count; i++) {
+            uint32_t tuple_id = get_cached_prefix_tuple_id(ctx, i, &md);
+            if (bpf_map_delete_elem(ctx->tuple_map.fd, &tuple_id) != 0 && errno != ENOENT && err == NO_ERROR) {
+                err = errno;
+                fprintf(stderr, "failed to remove tuple %u: %s\n", tuple_id, strerror(err));
+            }
+        }
+    } else {
+        fprintf(stderr, "removing entries from tuples_map, this may take a while\n");
+        err = delete_all_map_entries(&ctx->tuple_map);
+    }
+
+    int prefixes_err = delete_all_map_entries(&ctx->prefixes);
+    if (err == NO_ERROR) {
+        err = prefixes_err;
+    }
+
+    return err;
+}
+
+static int ternary_table_remove_prefix(nikss_table_entry_ctx_t *ctx, const char *key_mask)
+{
+    int err = NO_ERROR;
+    char *value_mask = malloc(ctx->prefixes.value_size);
+
+    if (value_mask == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        err = ENOMEM;
+        goto clean_up;
+    }
+
+    if (bpf_map_lookup_elem(ctx->prefixes.fd, key_mask, value_mask) != 0) {
+        err = errno;
+        fprintf(stderr, "unable to obtain prefix: %s\n", strerror(err));
+        goto clean_up;
+    }
+
+    struct ternary_table_prefix_metadata prefix_md;
+    if ((err = get_ternary_table_prefix_md(ctx, &prefix_md)) != NO_ERROR) {
+        fprintf(stderr, "failed to obtain offsets and sizes of prefix\n");
+        goto clean_up;
+    }
+
+    /* find previous prefix */
+    uint32_t prev_index = 0;
+    err = sync_ternary_prefix_cache(ctx, &prefix_md, &prev_index, key_mask);
+    if (err == ENOENT) {
+        fprintf(stderr, "detected data inconsistency in prefixes: no previous prefix\n");
+    } else if (err != NO_ERROR) {
+        goto clean_up;
+    } else {
+        char *prev_key_mask = ctx->prefix_cache_keys + (size_t) prev_index * ctx->prefixes.key_size;
+        char *prev_value_mask = ctx->prefix_cache_values + (size_t) prev_index * ctx->prefixes.value_size;
+        char *cached_value_mask = prev_value_mask + ctx->prefixes.value_size;
+        bool removed_is_current = memcmp(cached_value_mask, value_mask, ctx->prefixes.value_size) == 0;
+
+        /* copy next_mask and has_next to the previous prefix */
+        memcpy(prev_value_mask + prefix_md.next_mask_offset,
+               value_mask + prefix_md.next_mask_offset, prefix_md.next_mask_size);
+        memcpy(prev_value_mask + prefix_md.has_next_offset,
+               value_mask + prefix_md.has_next_offset, prefix_md.has_next_size);
+
+        err = bpf_map_update_elem(ctx->prefixes.fd, prev_key_mask, prev_value_mask, BPF_EXIST);
+        if (err != 0) {
+            err = errno;
+            ctx->prefix_cache_valid = false;
+            fprintf(stderr, "failed to update previous prefix: %s\n", strerror(err));
+            goto clean_up;
+        }
+
+        /* When removed prefix was modified by someone else, cache would be no longer valid */
+        if (removed_is_current) {
+            remove_cached_prefix(ctx, prev_index + 1);
+        } else {
+            ctx->prefix_cache_valid = false;
+        }
+    }
+
+    /* there are no prefixes that points to removing prefix, so it can be safely removed now */
+    if (bpf_map_delete_elem(ctx->prefixes.fd, key_mask) != 0) {
+        fprintf(stderr, "warning: failed to remove prefix from prefixes list\n");
+    }
+
+    /* also remove tuple from tuple_map */
+    uint32_t tuple_id = *((uint32_t *) (value_mask + prefix_md.tuple_id_offset));
+    if (bpf_map_delete_elem(ctx->tuple_map.fd, &tuple_id) != 0) {
+        fprintf(stderr, "warning: failed to remove tuple from tuples_map\n");
+    }
+
+    /* unpinning not required - inner map is not pinned by this tool*/
+
+    err = NO_ERROR;
+
+clean_up:
+    if (value_mask != NULL) {
+        free(value_mask);
+    }
+
+    return err;
+}
+
+static int move_cached_prefix_to_position(nikss_table_entry_ctx_t *ctx, struct ternary_table_prefix_metadata *md,
+                                          uint32_t from, uint32_t to)
+{
+    /* Moves prefix at index "from" directly after prefix at index "to - 1", where to < from. Each
+     * step changes one link, so lookup never loops and only moved tuple is skipped for a while. */
+    size_t key_size = ctx->prefixes.key_size;
+    size_t value_size = ctx->prefixes.value_size;
+    char *moved_key = ctx->prefix_cache_keys + from * key_size;
+    char *moved_value = ctx->prefix_cache_values + from * value_size;
+    char *old_prev_key = moved_key - key_size;
+    char *old_prev_value = moved_value - value_size;
+    char *new_prev_key = ctx->prefix_cache_keys + (to - 1) * key_size;
+    char *new_prev_value = ctx->prefix_cache_values + (to - 1) * value_size;
+    char *new_next_key = ctx->prefix_cache_keys + to * key_size;
+
+    /* 1. Unlink moved prefix */
+    memcpy(old_prev_value + md->next_mask_offset, moved_value + md->next_mask_offset, md->next_mask_size);
+    memcpy(old_prev_value + md->has_next_offset, moved_value + md->has_next_offset, md->has_next_size);
+    if (bpf_map_update_elem(ctx->prefixes.fd, old_prev_key, old_prev_value, BPF_EXIST) != 0) {
+        return errno;
+    }
+
+    /* 2. Point moved prefix to its new successor */
+    memcpy(moved_value + md->next_mask_offset, new_next_key, md->next_mask_size);
+    *((uint8_t *) (moved_value + md->has_next_offset)) = 1;
+    if (bpf_map_update_elem(ctx->prefixes.fd, moved_key, moved_value, BPF_EXIST) != 0) {
+        return errno;
+    }
+
+    /* 3. Link moved prefix into the new place */
+    memcpy(new_prev_value + md->next_mask_offset, moved_key, md->next_mask_size);
+    *((uint8_t *) (new_prev_value + md->has_next_offset)) = 1;
+    if (bpf_map_update_elem(ctx->prefixes.fd, new_prev_key, new_prev_value, BPF_EXIST) != 0) {
+        return errno;
+    }
+
+    /* Update order in the cache */
+    char *key = malloc(key_size);
+    char *value = malloc(value_size);
+    if (key == NULL || value == NULL) {
+        if (key != NULL) {
+            free(key);
+        }
+        if (value != NULL) {
+            free(value);
+        }
+        /* map is already consistent, only cache is lost */
+        ctx->prefix_cache_valid = false;
+        return ENOMEM;
+    }
+    memcpy(key, moved_key, key_size);
+    memcpy(value, moved_value, value_size);
+    uint32_t priority = ctx->prefix_cache_priorities[from];
+    remove_cached_prefix(ctx, from);
+    int err = insert_cached_prefix(ctx, to, key, value, priority);
+    free(key);
+    free(value);
+    if (err != NO_ERROR) {
+        /* map is already consistent, only cache is lost */
+        ctx->prefix_cache_valid = false;
+        ctx->prefix_cache_has_priorities = false;
+    }
+
+    return err;
+}
+
+static int rebalance_tuples(nikss_table_entry_ctx_t *ctx)
+{
+    if (ctx == NULL) {
+        return EINVAL;
+    }
+    if (ctx->is_ternary == false || ctx->prefixes.fd < 0 || ctx->tuple_map.fd < 0) {
+        fprintf(stderr, "tuples can be rebalanced only in ternary table\n");
+        return EINVAL;
+    }
+
+    struct ternary_table_prefix_metadata prefix_md;
+    if (get_ternary_table_prefix_md(ctx, &prefix_md) != NO_ERROR) {
+        fprintf(stderr, "failed to obtain offsets and sizes of prefix\n");
+        return EPERM;
+    }
+
+    /* Priorities might have been lowered by deleted entries, so always read them again */
+    bool sort_tuples = ctx->sort_tuples;
+    ctx->sort_tuples = true;
+    ctx->prefix_cache_has_priorities = false;
+    int err = load_ternary_prefix_cache(ctx, &prefix_md);
+    ctx->sort_tuples = sort_tuples;
+    if (err != NO_ERROR) {
+        return err;
+    }
+
+    /* Selection sort from the highest priority, stable for equal priorities. Position 0 is the head. */
+    for (uint32_t position = 1; position < ctx->prefix_cache_count; position++) {
+        uint32_t best = position;
+        for (uint32_t i = position + 1; i < ctx->prefix_cache_count; i++) {
+            if (ctx->prefix_cache_priorities[i] > ctx->prefix_cache_priorities[best]) {
+                best = i;
+            }
+        }
+        if (best == position) {
+            continue;
+        }
+
+        err = move_cached_prefix_to_position(ctx, &prefix_md, best, position);
+        if (err != NO_ERROR) {
+            fprintf(stderr, "failed to reorder tuples: %s\n", strerror(err));
+            ctx->prefix_cache_valid = false;
+            return err;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_entry_ctx_rebalance_tuples(nikss_table_entry_ctx_t *ctx)
+{
+    return TERNARY_TABLE_LOCKED(ctx, rebalance_tuples(ctx));
+}
+
+int nikss_table_entry_ctx_tuple_initial_size(nikss_table_entry_ctx_t *ctx, uint32_t max_entries)
+{
+    if (ctx == NULL) {
+        return EINVAL;
+    }
+
+    ctx->tuple_initial_size = max_entries;
+
+    return NO_ERROR;
+}
+
+/* Opens inner map of the tuple at a given index of prefixes cache, returns ENOENT when it has no inner map */
+static int open_cached_prefix_tuple(nikss_table_entry_ctx_t *ctx, struct ternary_table_prefix_metadata *md,
+                                    uint32_t index)
+{
+    uint32_t tuple_id = get_cached_prefix_tuple_id(ctx, index, md);
+    uint32_t inner_map_id = 0;
+
+    ternary_table_close_tuple(ctx);
+    if (bpf_map_lookup_elem(ctx->tuple_map.fd, &tuple_id, &inner_map_id) != 0) {
+        return ENOENT;
+    }
+    ctx->table.fd = bpf_map_get_fd_by_id(inner_map_id);
+    if (ctx->table.fd < 0) {
+        return errno;
+    }
+
+    return NO_ERROR;
+}
+
+static uint32_t count_map_entries(int fd, uint32_t key_size)
+{
+    uint32_t count = 0;
+    char *key = malloc(key_size);
+    char *next_key = malloc(key_size);
+
+    if (key != NULL && next_key != NULL) {
+        const char *prev_key = NULL;
+        while (bpf_map_get_next_key(fd, prev_key, next_key) == 0) {
+            memcpy(key, next_key, key_size);
+            prev_key = key;
+            count++;
+        }
+    }
+
+    if (key != NULL) {
+        free(key);
+    }
+    if (next_key != NULL) {
+        free(next_key);
+    }
+
+    return count;
+}
+
+/* Moves tuple to another id: new id is filled in first and old one is removed
+ * only after prefix points to the new id, so lookup never misses the tuple. */
+static int move_cached_prefix_tuple(nikss_table_entry_ctx_t *ctx, struct ternary_table_prefix_metadata *md,
+                                    uint32_t index, uint32_t new_tuple_id)
+{
+    uint32_t old_tuple_id = get_cached_prefix_tuple_id(ctx, index, md);
+    const char *key = ctx->prefix_cache_keys + (size_t) index * ctx->prefixes.key_size;
+    char *value = ctx->prefix_cache_values + (size_t) index * ctx->prefixes.value_size;
+
+    int err = open_cached_prefix_tuple(ctx, md, index);
+    if (err != NO_ERROR) {
+        return err;
+    }
+
+    if (bpf_map_update_elem(ctx->tuple_map.fd, &new_tuple_id, &(ctx->table.fd), BPF_ANY) != 0) {
+        err = errno;
+        ternary_table_close_tuple(ctx);
+        return err;
+    }
+    ternary_table_close_tuple(ctx);
+
+    *((uint32_t *) (value + md->tuple_id_offset)) = new_tuple_id;
+    if (bpf_map_update_elem(ctx->prefixes.fd, key, value, BPF_EXIST) != 0) {
+        err = errno;
+        *((uint32_t *) (value + md->tuple_id_offset)) = old_tuple_id;
+        bpf_map_delete_elem(ctx->tuple_map.fd, &new_tuple_id);
+        return err;
+    }
+
+    if (bpf_map_delete_elem(ctx->tuple_map.fd, &old_tuple_id) != 0) {
+        fprintf(stderr, "warning: failed to remove tuple from tuples_map\n");
+    }
+
+    return NO_ERROR;
+}
+
+static int compact_tuples(nikss_table_entry_ctx_t *ctx, nikss_tuple_compaction_stats_t *stats)
+{
+    nikss_tuple_compaction_stats_t local_stats;
+
+    if (ctx == NULL) {
+        return EINVAL;
+    }
+    if (ctx->is_ternary == false || ctx->prefixes.fd < 0 || ctx->tuple_map.fd < 0) {
+        fprintf(stderr, "tuples can be compacted only in ternary table\n");
+        return EINVAL;
+    }
+    if (stats == NULL) {
+        stats = &local_stats;
+    }
+    memset(stats, 0, sizeof(*stats));
+
+    struct ternary_table_prefix_metadata prefix_md;
+    if (get_ternary_table_prefix_md(ctx, &prefix_md) != NO_ERROR) {
+        fprintf(stderr, "failed to obtain offsets and sizes of prefix\n");
+        return EPERM;
+    }
+
+    int err = load_ternary_prefix_cache(ctx, &prefix_md);
+    if (err != NO_ERROR) {
+        return err;
+    }
+
+    char *key_mask = malloc(ctx->prefixes.key_size);
+    if (key_mask == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return ENOMEM;
+    }
+
+    /* 1. Remove empty tuples, from the end of the list because removing shifts the cache */
+    for (uint32_t i = ctx->prefix_cache_count - 1; i >= 1 && i < ctx->prefix_cache_count; i--) {
+        err = open_cached_prefix_tuple(ctx, &prefix_md, i);
+        if (err == NO_ERROR && count_map_entries(ctx->table.fd, ctx->table.key_size) > 0) {
+            continue;
+        }
+        ternary_table_close_tuple(ctx);
+        if (err != NO_ERROR && err != ENOENT) {
+            fprintf(stderr, "failed to open tuple: %s\n", strerror(err));
+            goto clean_up;
+        }
+
+        memcpy(key_mask, ctx->prefix_cache_keys + (size_t) i * ctx->prefixes.key_size, ctx->prefixes.key_size);
+        err = ternary_table_remove_prefix(ctx, key_mask);
+        if (err != NO_ERROR) {
+            goto clean_up;
+        }
+        stats->removed_tuples++;
+        if (ctx->prefix_cache_valid == false && (err = load_ternary_prefix_cache(ctx, &prefix_md)) != NO_ERROR) {
+            goto clean_up;
+        }
+    }
+    err = NO_ERROR;
+
+    /* 2. Fill holes in tuple ids, always moving the tuple with the highest id */
+    while (ctx->prefix_cache_count > 1) {
+        uint32_t free_id = 0;
+        uint32_t highest = 1;
+        err = get_lowest_free_tuple_id(ctx, &prefix_md, &free_id);
+        if (err == ESTALE && (err = load_ternary_prefix_cache(ctx, &prefix_md)) == NO_ERROR) {
+            err = get_lowest_free_tuple_id(ctx, &prefix_md, &free_id);
+        }
+        if (err != NO_ERROR) {
+            goto clean_up;
+        }
+        for (uint32_t i = 2; i < ctx->prefix_cache_count; i++) {
+            if (get_cached_prefix_tuple_id(ctx, i, &prefix_md) > get_cached_prefix_tuple_id(ctx, highest, &prefix_md)) {
+                highest = i;
+            }
+        }
+        if (get_cached_prefix_tuple_id(ctx, highest, &prefix_md) < free_id) {
+            break;
+        }
+
+        err = move_cached_prefix_tuple(ctx, &prefix_md, highest, free_id);
+        if (err != NO_ERROR) {
+            fprintf(stderr, "failed to move tuple: %s\n", strerror(err));
+            ctx->prefix_cache_valid = false;
+            goto clean_up;
+        }
+        stats->moved_tuples++;
+    }
+
+    /* 3. Shrink tuples to the smallest size which leaves at least a half of it free */
+    for (uint32_t i = 1; ctx->tuple_initial_size > 0 && i < ctx->prefix_cache_count; i++) {
+        struct bpf_map_info info = {0};
+        uint32_t info_len = sizeof(info);
+
+        if ((err = open_cached_prefix_tuple(ctx, &prefix_md, i)) != NO_ERROR) {
+            goto clean_up;
+        }
+        if (bpf_obj_get_info_by_fd(ctx->table.fd, &info, &info_len) != 0) {
+            err = errno;
+            goto clean_up;
+        }
+
+        uint32_t count = count_map_entries(ctx->table.fd, ctx->table.key_size);
+        uint32_t new_size = ctx->tuple_initial_size;
+        while (new_size < count * 2 && new_size < ctx->table.max_entries) {
+            new_size *= 2;
+        }
+        if ((uint64_t) count * 4 > info.max_entries || new_size >= info.max_entries) {
+            continue;
+        }
+
+        err = ternary_table_resize_tuple(ctx, get_cached_prefix_tuple_id(ctx, i, &prefix_md), new_size);
+        if (err == EINVAL) {
+            /* Inner map must have the same size as the one from the program */
+            fprintf(stderr, "warning: tuples of different size are not supported, tuples are not resized\n");
+            err = NO_ERROR;
+            break;
+        }
+        if (err != NO_ERROR) {
+            goto clean_up;
+        }
+        stats->resized_tuples++;
+    }
+
+clean_up:
+    stats->n_tuples = ctx->prefix_cache_count > 0 ? ctx->prefix_cache_count - 1 : 0;
+    ternary_table_close_tuple(ctx);
+    free(key_mask);
+
+    return err;
+}
+
+int nikss_table_entry_ctx_compact_tuples(nikss_table_entry_ctx_t *ctx, nikss_tuple_compaction_stats_t *stats)
+{
+    return TERNARY_TABLE_LOCKED(ctx, compact_tuples(ctx, stats));
+}
+
+static int post_ternary_table_delete(nikss_table_entry_ctx_t *ctx, const char *key_mask)
+{
+    if (ctx->is_ternary == false || ctx->table.fd < 0) {
+        return NO_ERROR;
+    }
+    if (key_mask == NULL) {
+        return ENODATA;
+    }
+
+    int err = NO_ERROR;
+    char *tuple_next_key = malloc(ctx->table.key_size);
+
+    if (tuple_next_key == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        err = ENOMEM;
+        goto clean_up;
+    }
+
+    if (bpf_map_get_next_key(ctx->table.fd, NULL, tuple_next_key) != 0) {
+        err = ternary_table_remove_prefix(ctx, key_mask);
+    }
+
+clean_up:
+    if (tuple_next_key != NULL) {
+        free(tuple_next_key);
+    }
+
+    close_object_fd(&(ctx->table.fd));
+    return err;
+}
+
+static int table_clear(nikss_table_entry_ctx_t *ctx)
+{
+    int return_code = NO_ERROR;
+
+    if (ctx == NULL) {
+        return EINVAL;
+    }
+
+    if (ctx->is_ternary) {
+        if (ctx->prefixes.fd < 0 || ctx->tuple_map.fd < 0) {
+            fprintf(stderr, "can't clear table: table not opened\n");
+            return EBADF;
+        }
+        return_code = ternary_table_clear(ctx);
+    } else {
+        if (ctx->table.fd < 0) {
+            fprintf(stderr, "can't clear table: table not opened\n");
+            return EBADF;
+        }
+        return_code = delete_all_map_entries(&ctx->table);
+        if (return_code == NO_ERROR) {
+            return_code = clear_table_dir24(ctx);
+        }
+        if (return_code == NO_ERROR) {
+            refresh_table_shadow_after_delete_all(ctx);
+        }
+    }
+
+    if (return_code == NO_ERROR) {
+        return_code = invalidate_table_cache(ctx, NULL, NULL);
+        if (return_code != NO_ERROR) {
+            fprintf(stderr, "failed to clear table cache: %s\n", strerror(return_code));
+        }
+    }
+
+    return return_code;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_clear(nikss_table_entry_ctx_t *ctx)
+{
+    return NIKSS_STATS_CALL(NIKSS_STATS_TABLE_DEL, TERNARY_TABLE_LOCKED(ctx, table_clear(ctx)));
+}
+
+static int table_entry_del(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry)
+{
+    char *key_buffer = NULL;
+    char *key_mask_buffer = NULL;
+    int return_code = NO_ERROR;
+
+    if (ctx == NULL || entry == NULL) {
+        return EINVAL;
+    }
+
+    /* remove all entries from table if key is not present */
+    if (entry->n_keys == 0) {
+        return table_clear(ctx);
+    }
+
+    if (ctx->is_ternary) {
+        return_code = prepare_ternary_table_delete(ctx, entry, &key_mask_buffer);
+        if (return_code != NO_ERROR) {
+            fprintf(stderr, "failed to prepare ternary table for delete\n");
+            goto clean_up;
+        }
+    }
+
+    if (ctx->table.fd < 0) {
+        fprintf(stderr, "can't delete entry: table not opened\n");
+        return EBADF;
+    }
+    if (ctx->table.key_size == 0) {
+        fprintf(stderr, "zero-size key is not supported\n");
+        return ENOTSUP;
+    }
+
+    /* prepare buffers for map key */
+    key_buffer = malloc(ctx->table.key_size);
+    if (key_buffer == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return_code = ENOMEM;
+        goto clean_up;
+    }
+
+    return_code = construct_buffer(key_buffer, ctx->table.key_size, ctx, entry,
+                                   fill_key_btf_info, fill_key_byte_by_byte);
+    if (return_code != NO_ERROR) {
+        fprintf(stderr, "failed to construct key\n");
+        goto clean_up;
+    }
+
+    if (ctx->is_ternary == true && key_mask_buffer != NULL) {
+        mem_bitwise_and((uint32_t *) key_buffer, (uint32_t *) key_mask_buffer, ctx->table.key_size);
+    }
+
+    /* delete pointed entry */
+    if (ctx->dir24.fd >= 0) {
+        return_code = write_table_dir24_entry(ctx, key_buffer, NULL, 0);
+    } else {
+        return_code = bpf_map_delete_elem(ctx->table.fd, key_buffer) != 0 ? errno : NO_ERROR;
+    }
+    if (return_code != NO_ERROR) {
+        fprintf(stderr, "failed to delete entry: %s\n", strerror(return_code));
+    } else {
+        update_table_shadow(ctx, key_buffer, NULL);
+        return_code = invalidate_table_cache(ctx, key_buffer, key_mask_buffer);
+        if (return_code != NO_ERROR) {
+            fprintf(stderr, "failed to clear cache: %s\n", strerror(return_code));
+        }
+    }
+
+clean_up:
+    /* cleanup ternary table */
+    if (ctx->is_ternary) {
+        post_ternary_table_delete(ctx, key_mask_buffer);
+    }
+
+    if (key_buffer != NULL) {
+        free(key_buffer);
+    }
+    if (key_mask_buffer != NULL) {
+        free(key_mask_buffer);
+    }
+
+    return return_code;
+}
+
+int nikss_table_entry_del(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry)
+{
+    return NIKSS_STATS_CALL(NIKSS_STATS_TABLE_DEL, TERNARY_TABLE_LOCKED(ctx, table_entry_del(ctx, entry)));
+}
+
+/******************************************************************************
+ * Batch operations
+ *****************************************************************************/
+
+/* cppcheck-suppress unusedFunction ; public API call */
+void nikss_table_entry_batch_init(nikss_table_entry_batch_t *batch)
+{
+    if (batch == NULL) {
+        return;
+    }
+    memset(batch, 0, sizeof(nikss_table_entry_batch_t));
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+void nikss_table_entry_batch_free(nikss_table_entry_batch_t *batch)
+{
+    if (batch == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < batch->n_entries; i++) {
+        nikss_table_entry_free(&batch->entries[i]);
+    }
+    if (batch->entries != NULL) {
+        free(batch->entries);
+    }
+    if (batch->results != NULL) {
+        free(batch->results);
+    }
+    memset(batch, 0, sizeof(nikss_table_entry_batch_t));
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_entry_batch_append(nikss_table_entry_batch_t *batch, nikss_table_entry_t *entry)
+{
+    if (batch == NULL || entry == NULL) {
+        return EINVAL;
+    }
+
+    if (batch->n_entries >= batch->capacity) {
+        size_t new_capacity = batch->capacity == 0 ? 64 : batch->capacity * 2;
+        nikss_table_entry_t *entries = realloc(batch->entries, new_capacity * sizeof(nikss_table_entry_t));
+        if (entries == NULL) {
+            return ENOMEM;
+        }
+        batch->entries = entries;
+        int *results = realloc(batch->results, new_capacity * sizeof(int));
+        if (results == NULL) {
+            return ENOMEM;
+        }
+        batch->results = results;
+        batch->capacity = new_capacity;
+    }
+
+    /* stole data from entry, so it can be reused by caller */
+    memcpy(&batch->entries[batch->n_entries], entry, sizeof(nikss_table_entry_t));
+    batch->results[batch->n_entries] = NO_ERROR;
+    batch->n_entries += 1;
+    nikss_table_entry_init(entry);
+    /* keep arena, so next entry is allocated in the same way */
+    entry->arena = batch->entries[batch->n_entries - 1].arena;
+
+    return NO_ERROR;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+size_t nikss_table_entry_batch_get_size(nikss_table_entry_batch_t *batch)
+{
+    if (batch == NULL) {
+        return 0;
+    }
+    return batch->n_entries;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_entry_batch_get_result(nikss_table_entry_batch_t *batch, size_t idx)
+{
+    if (batch == NULL || idx >= batch->n_entries) {
+        return EINVAL;
+    }
+    return batch->results[idx];
+}
+
+struct table_batch_state {
+    nikss_table_entry_batch_t *batch;
+
+    /* encoded entries waiting for commit */
+    char *keys;
+    char *values;
+    size_t *entry_ids;
+    uint32_t count;
+
+    /* for ternary tables: mask of the currently opened tuple */
+    char *tuple_mask;
+
+    uint64_t commit_flags;
+    bool is_delete;
+    bool no_batch_support;
+    bool any_committed;
+};
+
+static int table_batch_commit_element(nikss_table_entry_ctx_t *ctx, struct table_batch_state *state, uint32_t slot)
+{
+    const char *key = state->keys + (size_t) slot * ctx->table.key_size;
+    int ret = 0;
+
+    if (ctx->dir24.fd >= 0) {
+        return write_table_dir24_entry(ctx, key, state->is_delete ? NULL :
+                                       state->values + (size_t) slot * ctx->table.value_size, state->commit_flags);
+    }
+    if (state->is_delete) {
+        ret = bpf_map_delete_elem(ctx->table.fd, key);
+    } else {
+        ret = bpf_map_update_elem(ctx->table.fd, key, state->values + (size_t) slot * ctx->table.value_size,
+                                  state->commit_flags);
+    }
+    if (ret != 0) {
+        ret = errno;
+        /* Tuple is full, so retry after it has grown */
+        if (ret == E2BIG && state->is_delete == false && ctx->is_ternary &&
+            ternary_table_grow_tuple(ctx, state->tuple_mask) == NO_ERROR) {
+            return table_batch_commit_element(ctx, state, slot);
+        }
+        return ret;
+    }
+
+    return NO_ERROR;
+}
+
+static void table_batch_commit(nikss_table_entry_ctx_t *ctx, struct table_batch_state *state)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = state->commit_flags,
+                        .flags = 0,
+    );
+    uint32_t done = 0;
+
+    /* Leaves depend on all routes, so entries of DIR-24-8 tables are written one by one with their leaves */
+    if (ctx->dir24.fd >= 0) {
+        state->no_batch_support = true;
+    }
+
+    while (done < state->count) {
+        uint32_t remaining = state->count - done;
+        uint32_t processed = remaining;
+        int ret = NO_ERROR;
+
+        if (state->no_batch_support == false) {
+            char *keys = state->keys + (size_t) done * ctx->table.key_size;
+            if (state->is_delete) {
+                ret = bpf_map_delete_batch(ctx->table.fd, keys, &processed, &opts);
+            } else {
+                char *values = state->values + (size_t) done * ctx->table.value_size;
+                ret = bpf_map_update_batch(ctx->table.fd, keys, values, &processed, &opts);
+            }
+            if (ret == 0) {
+                state->any_committed = true;
+                break;
+            }
+
+            /* Kernels without batch operations do not update the counter */
+            if (processed >= remaining) {
+                processed = 0;
+            }
+            if (processed > 0) {
+                state->any_committed = true;
+            }
+            done += processed;
+        }
+
+        /* Retry failed element alone: when it succeeds even though nothing has been
+         * processed, batch operations are not supported by the kernel or map type. */
+        ret = table_batch_commit_element(ctx, state, done);
+        if (ret == NO_ERROR) {
+            state->any_committed = true;
+            if (state->no_batch_support == false && processed == 0) {
+                fprintf(stderr, "batch operations not supported, falling back to per-element mode\n");
+                state->no_batch_support = true;
+            }
+        } else {
+            state->batch->results[state->entry_ids[done]] = ret;
+        }
+        done += 1;
+    }
+
+    for (uint32_t i = 0; ctx->shadow != NULL && i < state->count; i++) {
+        if (state->batch->results[state->entry_ids[i]] == NO_ERROR) {
+            update_table_shadow(ctx, state->keys + (size_t) i * ctx->table.key_size,
+                                state->is_delete ? NULL : state->values + (size_t) i * ctx->table.value_size);
+        }
+    }
+
+    state->count = 0;
+}
+
+static void table_batch_flush(nikss_table_entry_ctx_t *ctx, struct table_batch_state *state)
+{
+    if (state->count > 0) {
+        table_batch_commit(ctx, state);
+    }
+
+    if (ctx->is_ternary) {
+        if (state->is_delete) {
+            post_ternary_table_delete(ctx, state->tuple_mask);
+        } else {
+            ternary_table_close_tuple(ctx);
+        }
+    }
+
+    if (state->tuple_mask != NULL) {
+        free(state->tuple_mask);
+    }
+    state->tuple_mask = NULL;
+}
+
+static int table_batch_select_tuple(nikss_table_entry_ctx_t *ctx, struct table_batch_state *state,
+                                    nikss_table_entry_t *entry, char *entry_mask, uint64_t bpf_flags)
+{
+    int ret = construct_buffer(entry_mask, ctx->prefixes.key_size, ctx, entry,
+                               fill_key_mask_btf, fill_key_mask_byte_by_byte);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+
+    /* Consecutive entries with the same mask are stored in the same tuple, which is opened for the first
+     * of them, so priorities of the others are tracked here */
+    if (state->tuple_mask != NULL && memcmp(entry_mask, state->tuple_mask, ctx->prefixes.key_size) == 0) {
+        if (state->is_delete == false) {
+            track_cached_prefix_priority(ctx, state->tuple_mask, entry->priority);
+        }
+        return NO_ERROR;
+    }
+
+    table_batch_flush(ctx, state);
+
+    ret = ternary_table_open_tuple(ctx, entry, &state->tuple_mask, state->is_delete ? BPF_EXIST : bpf_flags);
+    if (ret == NO_ERROR && ctx->table.fd < 0) {
+        ret = EBADF;
+    }
+    if (ret != NO_ERROR) {
+        if (state->tuple_mask != NULL) {
+            free(state->tuple_mask);
+        }
+        state->tuple_mask = NULL;
+        ternary_table_close_tuple(ctx);
+    }
+
+    return ret;
+}
+
+static int table_batch_process(nikss_table_entry_ctx_t *ctx, nikss_table_entry_batch_t *batch,
+                               uint64_t bpf_flags, bool is_delete)
+{
+    char *entry_mask = NULL;
+    int return_code = NO_ERROR;
+
+    if (ctx == NULL || batch == NULL) {
+        return EINVAL;
+    }
+    if (batch->n_entries == 0) {
+        return NO_ERROR;
+    }
+    if (ctx->is_ternary == false && ctx->table.fd < 0) {
+        fprintf(stderr, "can't process entries: table not opened\n");
+        return EBADF;
+    }
+    if (ctx->table.key_size == 0 || (is_delete == false && ctx->table.value_size == 0)) {
+        fprintf(stderr, "zero-size key or value is not supported\n");
+        return ENOTSUP;
+    }
+
+    struct table_batch_state state = {
+            .batch = batch,
+            .commit_flags = bpf_flags,
+            .is_delete = is_delete,
+    };
+    if (is_delete) {
+        state.commit_flags = 0;
+    } else if (ctx->table.type == BPF_MAP_TYPE_ARRAY) {
+        state.commit_flags = BPF_ANY;
+    }
+
+    state.keys = malloc(batch->n_entries * ctx->table.key_size);
+    state.entry_ids = malloc(batch->n_entries * sizeof(size_t));
+    if (is_delete == false) {
+        state.values = malloc(batch->n_entries * ctx->table.value_size);
+    }
+    if (ctx->is_ternary) {
+        entry_mask = malloc(ctx->prefixes.key_size);
+    }
+    if (state.keys == NULL || state.entry_ids == NULL || (is_delete == false && state.values == NULL) ||
+        (ctx->is_ternary && entry_mask == NULL)) {
+        fprintf(stderr, "not enough memory\n");
+        for (size_t i = 0; i < batch->n_entries; i++) {
+            batch->results[i] = ENOMEM;
+        }
+        return_code = ENOMEM;
+        goto clean_up;
+    }
+
+    for (size_t i = 0; i < batch->n_entries; i++) {
+        nikss_table_entry_t *entry = &batch->entries[i];
+        batch->results[i] = NO_ERROR;
+
+        if (is_delete && entry->n_keys == 0) {
+            fprintf(stderr, "entry without key is not allowed in batch\n");
+            batch->results[i] = EINVAL;
+            continue;
+        }
+
+        if (ctx->is_ternary) {
+            int ret = table_batch_select_tuple(ctx, &state, entry, entry_mask, bpf_flags);
+            if (ret != NO_ERROR) {
+                batch->results[i] = ret;
+                continue;
+            }
+        }
+
+        char *key = state.keys + (size_t) state.count * ctx->table.key_size;
+        int ret = NO_ERROR;
+        if (is_delete) {
+            ret = construct_buffer(key, ctx->table.key_size, ctx, entry, fill_key_btf_info, fill_key_byte_by_byte);
+            if (ret == NO_ERROR && ctx->is_ternary && state.tuple_mask != NULL) {
+                mem_bitwise_and((uint32_t *) key, (uint32_t *) state.tuple_mask, ctx->table.key_size);
+            }
+        } else {
+            char *value = state.values + (size_t) state.count * ctx->table.value_size;
+            ret = encode_table_entry(ctx, entry, key, value, state.tuple_mask, bpf_flags);
+            if (ret == NO_ERROR && is_update_in_shadow(ctx, key, value, state.commit_flags)) {
+                continue;
+            }
+        }
+        if (ret != NO_ERROR) {
+            batch->results[i] = ret;
+            continue;
+        }
+
+        state.entry_ids[state.count++] = i;
+    }
+
+    table_batch_flush(ctx, &state);
+
+    if (state.any_committed) {
+        /* Matching cache with every entry of batch would take more time than clearing it */
+        int ret = invalidate_table_cache(ctx, NULL, NULL);
+        if (ret != NO_ERROR) {
+            fprintf(stderr, "failed to clear cache: %s\n", strerror(ret));
+        }
+    }
+
+    size_t n_failed = 0;
+    for (size_t i = 0; i < batch->n_entries; i++) {
+        if (batch->results[i] != NO_ERROR) {
+            if (n_failed == 0) {
+                return_code = batch->results[i];
+            }
+            n_failed++;
+        }
+    }
+    if (n_failed > 0) {
+        fprintf(stderr, "%zu of %zu entries failed\n", n_failed, batch->n_entries);
+    }
+
+clean_up:
+    if (state.keys != NULL) {
+        free(state.keys);
+    }
+    if (state.values != NULL) {
+        free(state.values);
+    }
+    if (state.entry_ids != NULL) {
+        free(state.entry_ids);
+    }
+    if (state.tuple_mask != NULL) {
+        free(state.tuple_mask);
+    }
+    if (entry_mask != NULL) {
+        free(entry_mask);
+    }
+
+    return return_code;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_entry_batch_add(nikss_table_entry_ctx_t *ctx, nikss_table_entry_batch_t *batch)
+{
+    return TERNARY_TABLE_LOCKED(ctx, table_batch_process(ctx, batch, BPF_NOEXIST, false));
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_entry_batch_update(nikss_table_entry_ctx_t *ctx, nikss_table_entry_batch_t *batch)
+{
+    return TERNARY_TABLE_LOCKED(ctx, table_batch_process(ctx, batch, BPF_EXIST, false));
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_entry_batch_del(nikss_table_entry_ctx_t *ctx, nikss_table_entry_batch_t *batch)
+{
+    return TERNARY_TABLE_LOCKED(ctx, table_batch_process(ctx, batch, 0, true));
+}
+
+int nikss_table_entry_set_default_entry(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry)
+{
+    /* For default entry array map is used, it always has key 32-bit width and its value is assumed to be 0. */
+    const uint32_t key = 0;
+    char *value_buffer = NULL;
+    int return_code = NO_ERROR;
+
+    if (ctx == NULL || entry == NULL) {
+        return EINVAL;
+    }
+
+    if (ctx->default_entry.fd < 0) {
+        fprintf(stderr, "can't add default entry: table not opened or table has no default entry\n");
+        return EBADF;
+    }
+    if (ctx->default_entry.key_size != sizeof(key) ||
+            ctx->default_entry.value_size == 0 || ctx->default_entry.value_size != ctx->table.value_size) {
+        fprintf(stderr, "key size or value is not supported\n");
+        return ENOTSUP;
+    }
+    if (entry->action == NULL) {
+        fprintf(stderr, "missing action specification\n");
+        return ENODATA;
+    }
+
+    /* prepare buffer for map value */
+    value_buffer = malloc(ctx->default_entry.value_size);
+    if (value_buffer == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return ENOMEM;
+    }
+
+    return_code = construct_buffer(value_buffer, ctx->default_entry.value_size, ctx, entry,
+                                   fill_value_btf_info, fill_value_byte_by_byte);
+    if (return_code != NO_ERROR) {
+        fprintf(stderr, "failed to construct value\n");
+        goto clean_up;
+    }
+
+    /* Handle direct objects - default entry always exists
+     * and is treated like a regular entry, including with regards to direct resources */
+    return_code = handle_direct_objects_write((void *) &key, value_buffer, &ctx->default_entry, ctx, entry, BPF_EXIST);
+    if (return_code != NO_ERROR) {
+        fprintf(stderr, "failed to handle direct objects: %s\n", strerror(return_code));
+        goto clean_up;
+    }
+
+    /* update map */
+    return_code = bpf_map_update_elem(ctx->default_entry.fd, &key, value_buffer, BPF_ANY);
+    if (return_code != 0) {
+        return_code = errno;
+        fprintf(stderr, "failed to set up entry: %s\n", strerror(errno));
+    } else {
+        return_code = invalidate_table_cache(ctx, NULL, NULL);
+        if (return_code != NO_ERROR) {
+            fprintf(stderr, "failed to clear cache: %s\n", strerror(return_code));
+        }
+    }
+
+clean_up:
+    if (value_buffer != NULL) {
+        free(value_buffer);
+    }
+
+    return return_code;
+}
+
+static int alloc_entry_action_params(nikss_table_entry_t *entry, size_t n_params)
+{
+    entry->action->params = entry_alloc(entry, n_params * sizeof(nikss_action_param_t));
+    if (entry->action->params == NULL) {
+        return ENOMEM;
+    }
+    entry->action->params_from_arena = entry->arena != NULL;
+    entry->action->n_params = n_params;
+
+    return NO_ERROR;
+}
+
+static int create_entry_action_param(nikss_table_entry_t *entry, nikss_action_param_t *param,
+                                     const char *data, size_t size)
+{
+    if (entry->arena == NULL || size == 0) {
+        return nikss_action_param_create(param, data, size);
+    }
+
+    param->is_group_reference = false;
+    param->mem_can_be_freed = false;
+    param->len = size;
+    param->data = arena_alloc(entry->arena, size);
+    if (param->data == NULL) {
+        return ENOMEM;
+    }
+    memcpy(param->data, data, size);
+
+    return NO_ERROR;
+}
+
+static int parse_table_value_no_btf(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, const char *value)
+{
+    size_t buffer_size = ctx->table.value_size;
+
+    /* Action ID */
+    if (ctx->is_indirect == false) {
+        if (buffer_size < sizeof(uint32_t)) {
+            fprintf(stderr, "too small value type\n");
+            return EINVAL;
+        }
+        entry->action->action_id = *((uint32_t *) value);
+        value += sizeof(uint32_t);
+        buffer_size -= sizeof(uint32_t);
+    }
+
+    /* Priority */
+    if (ctx->is_ternary) {
+        if (buffer_size < sizeof(uint32_t)) {
+            fprintf(stderr, "too small value type\n");
+            return EINVAL;
+        }
+        entry->priority = *((uint32_t *) value);
+        value += sizeof(uint32_t);
+        buffer_size -= sizeof(uint32_t);
+    }
+
+    /* Action data, without BTF we can only return binary blob */
+    if (buffer_size > 0) {
+        if (alloc_entry_action_params(entry, 1) != NO_ERROR) {
+            return ENOMEM;
+        }
+        return create_entry_action_param(entry, &entry->action->params[0], value, buffer_size);
+    }
+
+    return NO_ERROR;
+}
+
+static int parse_table_value_action(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry,
+                                    const char *value, uint32_t value_type_id)
+{
+    /* Get action ID */
+    btf_struct_member_md_t action_id_md = {};
+    if (btf_get_member_md_by_name(ctx->btf_metadata.btf, value_type_id, "action", &action_id_md) != NO_ERROR) {
+        return ENOENT;
+    }
+    size_t action_id_size = btf_get_type_size_by_id(ctx->btf_metadata.btf, action_id_md.effective_type_id);
+    if (action_id_size > sizeof(entry->action->action_id)) {
+        return EINVAL;
+    }
+    entry->action->action_id = 0;
+    memcpy(&entry->action->action_id, value + action_id_md.bit_offset / 8, action_id_size);
+
+    /* Get action params */
+    btf_struct_member_md_t union_md = {};
+    if (btf_get_member_md_by_name(ctx->btf_metadata.btf, value_type_id, "u", &union_md) != NO_ERROR) {
+        return EINVAL;
+    }
+    btf_struct_member_md_t action_md = {};
+    if (btf_get_member_md_by_index(ctx->btf_metadata.btf, union_md.effective_type_id, entry->action->action_id, &action_md) != NO_ERROR) {
+        return EINVAL;
+    }
+
+    const struct btf_type *action_type = btf_get_type_by_id(ctx->btf_metadata.btf, action_md.effective_type_id);
+    if (action_type == NULL) {
+        return EINVAL;
+    }
+    if (!btf_is_struct(action_type)) {
+        return EINVAL;
+    }
+
+    const unsigned number_of_params = btf_vlen(action_type);
+    if (number_of_params == 0) {
+        return NO_ERROR;
+    }
+    if (alloc_entry_action_params(entry, number_of_params) != NO_ERROR) {
+        return ENOMEM;
+    }
+
+    const size_t base_offset = (union_md.bit_offset + action_md.bit_offset) / 8;
+    const struct btf_member *member = btf_members(action_type);
+    for (unsigned i = 0; i < number_of_params; i++, member++) {
+        btf_struct_member_md_t param_md = {};
+        if (btf_get_member_md_by_index(ctx->btf_metadata.btf, action_md.effective_type_id, i, &param_md) != NO_ERROR) {
+            return EINVAL;
+        }
+
+        size_t offset = base_offset + param_md.bit_offset / 8;
+        size_t size = btf_get_type_size_by_id(ctx->btf_metadata.btf, param_md.effective_type_id);
+        if (size + offset > ctx->table.value_size) {
+            return EINVAL;
+        }
+
+        int ret = create_entry_action_param(entry, &entry->action->params[i], value + offset, size);
+        entry->action->params[i].param_id = i;
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+
+        /* params wider than 64 bits are in network byte order */
+        if (entry->action->params[i].len > 8) {
+            swap_byte_order(entry->action->params[i].data, entry->action->params[i].len);
+        }
+    }
+
+    return NO_ERROR;
+}
+
+static int parse_table_value_priority(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry,
+                                      const char *value, uint32_t value_type_id)
+{
+    if (ctx->is_ternary == false) {
+        return NO_ERROR;
+    }
+
+    btf_struct_member_md_t priority_md = {};
+    if (btf_get_member_md_by_name(ctx->btf_metadata.btf, value_type_id, "priority", &priority_md) != NO_ERROR) {
+        return ENOENT;
+    }
+    size_t size = btf_get_type_size_by_id(ctx->btf_metadata.btf, priority_md.effective_type_id);
+    if (size > sizeof(entry->priority)) {
+        return EINVAL;
+    }
+    entry->priority = 0;
+    memcpy(&entry->priority, value + priority_md.bit_offset / 8, size);
+
+    return NO_ERROR;
+}
+
+static int parse_table_value_direct_counter(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, const char *value)
+{
+    if (ctx->n_direct_counters == 0) {
+        return NO_ERROR;
+    }
+
+    entry->direct_counters = malloc(ctx->n_direct_counters * sizeof(nikss_direct_counter_entry_t));
+    if (entry->direct_counters == NULL) {
+        return ENOMEM;
+    }
+
+    for (unsigned i = 0; i < ctx->n_direct_counters; i++) {
+        nikss_counter_entry_init(&entry->direct_counters[i].counter);
+        entry->direct_counters[i].counter_idx = ctx->direct_counters_ctx[i].counter_idx;
+        convert_counter_data_to_entry(value + ctx->direct_counters_ctx[i].counter_offset,
+                                      ctx->direct_counters_ctx[i].counter_size,
+                                      ctx->direct_counters_ctx[i].counter_type,
+                                      &entry->direct_counters[i].counter);
+    }
+    entry->n_direct_counters = ctx->n_direct_counters;
+
+    return NO_ERROR;
+}
+
+static int parse_table_value_direct_meter(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, const char *value)
+{
+    if (ctx->n_direct_meters == 0) {
+        return NO_ERROR;
+    }
+
+    entry->direct_meters = malloc(ctx->n_direct_meters * sizeof(nikss_direct_meter_entry_t));
+    if (entry->direct_meters == NULL) {
+        return ENOMEM;
+    }
+
+    for (unsigned i = 0; i < ctx->n_direct_meters; i++) {
+        nikss_meter_entry_init(&entry->direct_meters[i].meter);
+        entry->direct_meters[i].meter_idx = ctx->direct_meters_ctx[i].meter_idx;
+        convert_meter_data_to_entry((const nikss_meter_data_t *) (value + ctx->direct_meters_ctx[i].meter_offset),
+                                    &entry->direct_meters[i].meter);
+    }
+    entry->n_direct_meters = ctx->n_direct_meters;
+
+    return NO_ERROR;
+}
+
+static int parse_table_value_direct_objects(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, const char *value)
+{
+    int ret = parse_table_value_direct_counter(ctx, entry, value);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+
+    ret = parse_table_value_direct_meter(ctx, entry, value);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+
+    return NO_ERROR;
+}
+
+static int parse_table_value_references(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, const char *value)
+{
+    unsigned number_of_implementations = ctx->table_implementations.n_fields;
+    if (number_of_implementations < 1) {
+        return NO_ERROR;
+    }
+
+    if (alloc_entry_action_params(entry, number_of_implementations) != NO_ERROR) {
+        return ENOMEM;
+    }
+
+    for (unsigned i = 0; i < number_of_implementations; i++) {
+        create_entry_action_param(entry, &entry->action->params[i],
+                                   value + ctx->table_implementations.fields[i].data_offset,
+                                   ctx->table_implementations.fields[i].data_len);
+        entry->action->params[i].param_id = i;
+
+        if (ctx->table_implementation_group_marks.fields[i].type == NIKSS_STRUCT_FIELD_TYPE_DATA) {
+            /* Has group mark */
+            const uint32_t *is_group = (uint32_t *) (value + ctx->table_implementation_group_marks.fields[i].data_offset);
+            if (*is_group != 0) {
+                entry->action->params[i].is_group_reference = true;
+            }
+        }
+    }
+
+    return NO_ERROR;
+}
+
+static int parse_table_value_action_codec(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, const char *value)
+{
+    const nikss_table_codec_t *codec = &ctx->codec;
+    if (!codec->has_action_id) {
+        return ENOENT;
+    }
+    entry->action->action_id = 0;
+    memcpy(&entry->action->action_id, value + codec->action_id.offset, codec->action_id.size);
+
+    if (codec->actions == NULL || entry->action->action_id >= codec->n_actions) {
+        return EINVAL;
+    }
+    const nikss_table_codec_action_t *action = &codec->actions[entry->action->action_id];
+    if (action->n_params == 0) {
+        return NO_ERROR;
+    }
+
+    if (alloc_entry_action_params(entry, action->n_params) != NO_ERROR) {
+        return ENOMEM;
+    }
+
+    for (size_t i = 0; i < action->n_params; i++) {
+        const nikss_table_codec_field_t *field = &action->params[i];
+        int ret = create_entry_action_param(entry, &entry->action->params[i], value + field->offset, field->size);
+        entry->action->params[i].param_id = i;
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+
+        if (field->network_order) {
+            swap_byte_order(entry->action->params[i].data, entry->action->params[i].len);
+        }
+    }
+
+    return NO_ERROR;
+}
+
+static int parse_table_value_btf_info(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, const char *value)
+{
+    int ret = NO_ERROR;
+    uint32_t value_type_id = ctx->table.value_type_id;
+    if (value_type_id == 0) {
+        return ENOENT;
+    }
+
+    if (ctx->is_indirect == false) {
+        if (ctx->codec.value_compiled) {
+            ret = parse_table_value_action_codec(ctx, entry, value);
+        } else {
+            ret = parse_table_value_action(ctx, entry, value, value_type_id);
+        }
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+    } else {
+        ret = parse_table_value_references(ctx, entry, value);
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+    }
+
+    if (ctx->codec.value_compiled && ctx->codec.has_priority && ctx->is_ternary) {
+        entry->priority = 0;
+        memcpy(&entry->priority, value + ctx->codec.priority.offset, ctx->codec.priority.size);
+    } else {
+        ret = parse_table_value_priority(ctx, entry, value, value_type_id);
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+    }
+
+    ret = parse_table_value_direct_objects(ctx, entry, value);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+
+    return NO_ERROR;
+}
+
+static int parse_table_value(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, const char *value)
+{
+    entry->action = entry_alloc(entry, sizeof(nikss_action_t));
+    if (entry->action == NULL) {
+        return ENOMEM;
+    }
+    nikss_action_init(entry->action);
+
+    if (ctx->btf_metadata.btf == NULL || ctx->table.value_type_id == 0) {
+        return parse_table_value_no_btf(ctx, entry, value);
+    }
+
+    return parse_table_value_btf_info(ctx, entry, value);
+}
+
+static int table_entry_get(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry)
+{
+    char *key_buffer = NULL;
+    char *key_mask_buffer = NULL;
+    char *value_buffer = NULL;
+    int return_code = NO_ERROR;
+
+    if (ctx == NULL || entry == NULL) {
+        return EINVAL;
+    }
+
+    if (entry->n_keys == 0 || entry->match_keys == NULL) {
+        fprintf(stderr, "can't get entry: missing key\n");
+        return ENODATA;
+    }
+
+    if (ctx->is_ternary) {
+        return_code = ternary_table_open_tuple(ctx, entry, &key_mask_buffer, BPF_EXIST);
+        if (return_code != NO_ERROR) {
+            goto clean_up;
+        }
+    }
+
+    if (ctx->table.fd < 0) {
+        fprintf(stderr, "can't get entry: table not opened\n");
+        return_code = EBADF;
+        goto clean_up;
+    }
+    if (ctx->table.key_size == 0 || ctx->table.value_size == 0) {
+        fprintf(stderr, "zero-size key or value is not supported\n");
+        return_code = EINVAL;
+        goto clean_up;
+    }
+
+    /* Prepare entry - remove everything but not key */
+    size_t tmp_n_keys = entry->n_keys;
+    entry->n_keys = 0;
+    void *tmp_keys = entry->match_keys;
+    nikss_arena_t *arena = entry->arena;
+    entry->match_keys = NULL;
+    nikss_table_entry_free(entry);
+    nikss_table_entry_init(entry);
+    entry->n_keys = tmp_n_keys;
+    entry->match_keys = tmp_keys;
+    entry->arena = arena;
+
+    /* prepare buffers for map key/value */
+    key_buffer = malloc(ctx->table.key_size);
+    value_buffer = malloc(ctx->table.value_size);
+    if (key_buffer == NULL || value_buffer == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return_code = ENOMEM;
+        goto clean_up;
+    }
+
+    return_code = construct_buffer(key_buffer, ctx->table.key_size, ctx, entry,
+                                   fill_key_btf_info, fill_key_byte_by_byte);
+    if (return_code != NO_ERROR) {
+        fprintf(stderr, "failed to construct key\n");
+        goto clean_up;
+    }
+    if (ctx->is_ternary == true && key_mask_buffer != NULL) {
+        mem_bitwise_and((uint32_t *) key_buffer, (uint32_t *) key_mask_buffer, ctx->table.key_size);
+    }
+
+    if (ctx->shadow != NULL) {
+        const void *shadow_value = table_shadow_lookup(ctx->shadow, key_buffer);
+        if (shadow_value == NULL) {
+            return_code = ENOENT;
+            fprintf(stderr, "failed to get entry: %s\n", strerror(return_code));
+            goto clean_up;
+        }
+        memcpy(value_buffer, shadow_value, ctx->table.value_size);
+    } else {
+        return_code = bpf_map_lookup_elem(ctx->table.fd, key_buffer, value_buffer);
+        if (return_code != 0) {
+            return_code = errno;
+            fprintf(stderr, "failed to get entry: %s\n", strerror(return_code));
+            goto clean_up;
+        }
+    }
+
+    /* No need to parse key - already provided by user */
+
+    /* Parse value */
+    return_code = parse_table_value(ctx, entry, value_buffer);
+    if (return_code != NO_ERROR) {
+        fprintf(stderr, "failed to parse entry: %s\n", strerror(return_code));
+    }
+
+clean_up:
+    if (key_buffer != NULL) {
+        free(key_buffer);
+    }
+    if (key_mask_buffer != NULL) {
+        free(key_mask_buffer);
+    }
+    if (value_buffer != NULL) {
+        free(value_buffer);
+    }
+
+    if (ctx->is_ternary) {
+        ternary_table_close_tuple(ctx);
+    }
+
+    return return_code;
+}
+
+int nikss_table_entry_get(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry)
+{
+    return NIKSS_STATS_CALL(NIKSS_STATS_TABLE_GET, table_entry_get(ctx, entry));
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+bool nikss_table_entry_shadow_equal(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry)
+{
+    if (ctx == NULL || entry == NULL || ctx->shadow == NULL) {
+        return false;
+    }
+
+    bool is_equal = false;
+    char *key_buffer = malloc(ctx->table.key_size);
+    char *value_buffer = malloc(ctx->table.value_size);
+    if (key_buffer == NULL || value_buffer == NULL) {
+        goto clean_up;
+    }
+
+    /* Shadow is not available for tables with direct objects, so nothing is written here */
+    if (encode_table_entry(ctx, entry, key_buffer, value_buffer, NULL, BPF_EXIST) != NO_ERROR) {
+        goto clean_up;
+    }
+    const void *shadow_value = table_shadow_lookup(ctx->shadow, key_buffer);
+    is_equal = shadow_value != NULL && memcmp(shadow_value, value_buffer, ctx->table.value_size) == 0;
+
+clean_up:
+    if (key_buffer != NULL) {
+        free(key_buffer);
+    }
+    if (value_buffer != NULL) {
+        free(value_buffer);
+    }
+
+    return is_equal;
+}
+
+/* Raw entries: key, mask and value are already encoded in the layout of the BPF map */
+
+static uint32_t get_raw_entry_priority(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, const char *value)
+{
+    uint32_t priority = 0;
+
+    if (ctx->codec.value_compiled && ctx->codec.has_priority) {
+        memcpy(&priority, value + ctx->codec.priority.offset, ctx->codec.priority.size);
+    } else if (entry != NULL) {
+        priority = entry->priority;
+    }
+
+    return priority;
+}
+
+/* For ternary tables opens tuple and returns masked copy of the key in key_buffer,
+ * otherwise key_buffer is left NULL and the key can be used as is. */
+static int prepare_raw_entry_key(nikss_table_entry_ctx_t *ctx, const void *key, const void *mask, uint32_t priority,
+                                 uint64_t bpf_flags, char **key_buffer, char **key_mask)
+{
+    if (ctx->is_ternary) {
+        if (mask == NULL) {
+            fprintf(stderr, "missing key mask for ternary table\n");
+            return EINVAL;
+        }
+
+        *key_mask = malloc(ctx->prefixes.key_size);
+        *key_buffer = malloc(ctx->table.key_size);
+        if (*key_mask == NULL || *key_buffer == NULL) {
+            fprintf(stderr, "not enough memory\n");
+            return ENOMEM;
+        }
+        memcpy(*key_mask, mask, ctx->prefixes.key_size);
+        memcpy(*key_buffer, key, ctx->table.key_size);
+
+        int ret = NIKSS_STATS_CALL(NIKSS_STATS_TERNARY_TUPLE_OPEN,
+                                   ternary_table_open_tuple_by_mask(ctx, *key_mask, priority, bpf_flags));
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+        mem_bitwise_and((uint32_t *) *key_buffer, (uint32_t *) *key_mask, ctx->table.key_size);
+    }
+
+    if (ctx->table.fd < 0) {
+        fprintf(stderr, "table not opened\n");
+        return EBADF;
+    }
+    if (ctx->table.key_size == 0) {
+        fprintf(stderr, "zero-size key is not supported\n");
+        return ENOTSUP;
+    }
+
+    return NO_ERROR;
+}
+
+static int nikss_table_entry_write_raw(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, const void *key,
+                                       const void *mask, const void *value, uint64_t bpf_flags)
+{
+    char *key_buffer = NULL;
+    char *key_mask_buffer = NULL;
+    char *value_buffer = NULL;
+    int return_code = NO_ERROR;
+
+    if (ctx == NULL || key == NULL || value == NULL) {
+        return EINVAL;
+    }
+
+    uint32_t priority = get_raw_entry_priority(ctx, entry, value);
+    return_code = prepare_raw_entry_key(ctx, key, mask, priority, bpf_flags, &key_buffer, &key_mask_buffer);
+    if (return_code != NO_ERROR) {
+        goto clean_up;
+    }
+    if (ctx->table.value_size == 0) {
+        fprintf(stderr, "zero-size value is not supported\n");
+        return_code = ENOTSUP;
+        goto clean_up;
+    }
+
+    const void *map_key = key_buffer != NULL ? key_buffer : key;
+    const void *map_value = value;
+
+    /* Value has to be copied only when direct objects are written into it */
+    bool has_direct_objects = ctx->n_direct_counters > 0 || ctx->has_last_hit ||
+                              (entry != NULL && entry->n_direct_meters > 0);
+    if (has_direct_objects) {
+        nikss_table_entry_t no_direct_objects = {0};
+        value_buffer = malloc(ctx->table.value_size);
+        if (value_buffer == NULL) {
+            fprintf(stderr, "not enough memory\n");
+            return_code = ENOMEM;
+            goto clean_up;
+        }
+        memcpy(value_buffer, value, ctx->table.value_size);
+
+        return_code = handle_direct_objects_write(map_key, value_buffer, &ctx->table, ctx,
+                                                  entry != NULL ? entry : &no_direct_objects, bpf_flags);
+        if (return_code != NO_ERROR) {
+            fprintf(stderr, "failed to handle direct objects: %s\n", strerror(return_code));
+            goto clean_up;
+        }
+        map_value = value_buffer;
+    }
+
+    if (is_update_in_shadow(ctx, map_key, map_value, bpf_flags)) {
+        goto clean_up;
+    }
+
+    if (ctx->table.type == BPF_MAP_TYPE_ARRAY) {
+        bpf_flags = BPF_ANY;
+    }
+    if (ctx->dir24.fd >= 0) {
+        return_code = write_table_dir24_entry(ctx, map_key, map_value, bpf_flags);
+    } else {
+        return_code = bpf_map_update_elem(ctx->table.fd, map_key, map_value, bpf_flags) != 0 ? errno : NO_ERROR;
+    }
+    if (return_code != NO_ERROR) {
+        fprintf(stderr, "failed to set up entry: %s\n", strerror(return_code));
+    } else {
+        update_table_shadow(ctx, map_key, map_value);
+        return_code = invalidate_table_cache(ctx, map_key, key_mask_buffer);
+        if (return_code != NO_ERROR) {
+            fprintf(stderr, "failed to clear cache: %s\n", strerror(return_code));
+        }
+    }
+
+clean_up:
+    if (key_buffer != NULL) {
+        free(key_buffer);
+    }
+    if (key_mask_buffer != NULL) {
+        free(key_mask_buffer);
+    }
+    if (value_buffer != NULL) {
+        free(value_buffer);
+    }
+
+    if (ctx->is_ternary) {
+        ternary_table_close_tuple(ctx);
+    }
+
+    return return_code;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_entry_add_raw(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry,
+                              const void *key, const void *mask, const void *value)
+{
+    return TERNARY_TABLE_LOCKED(ctx, nikss_table_entry_write_raw(ctx, entry, key, mask, value, BPF_NOEXIST));
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_entry_update_raw(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry,
+                                 const void *key, const void *mask, const void *value)
+{
+    return TERNARY_TABLE_LOCKED(ctx, nikss_table_entry_write_raw(ctx, entry, key, mask, value, BPF_EXIST));
+}
+
+static int table_entry_del_raw(nikss_table_entry_ctx_t *ctx, const void *key, const void *mask)
+{
+    char *key_buffer = NULL;
+    char *key_mask_buffer = NULL;
+    int return_code = NO_ERROR;
+
+    if (ctx == NULL || key == NULL) {
+        return EINVAL;
+    }
+
+    return_code = prepare_raw_entry_key(ctx, key, mask, 0, BPF_EXIST, &key_buffer, &key_mask_buffer);
+    if (return_code != NO_ERROR) {
+        goto clean_up;
+    }
+
+    const void *map_key = key_buffer != NULL ? key_buffer : key;
+    if (ctx->dir24.fd >= 0) {
+        return_code = write_table_dir24_entry(ctx, map_key, NULL, 0);
+    } else {
+        return_code = bpf_map_delete_elem(ctx->table.fd, map_key) != 0 ? errno : NO_ERROR;
+    }
+    if (return_code != NO_ERROR) {
+        fprintf(stderr, "failed to delete entry: %s\n", strerror(return_code));
+    } else {
+        update_table_shadow(ctx, map_key, NULL);
+        return_code = invalidate_table_cache(ctx, map_key, key_mask_buffer);
+        if (return_code != NO_ERROR) {
+            fprintf(stderr, "failed to clear cache: %s\n", strerror(return_code));
+        }
+    }
+
+clean_up:
+    /* removes also prefix and tuple of ternary table when tuple becomes empty */
+    if (ctx->is_ternary) {
+        post_ternary_table_delete(ctx, key_mask_buffer);
+    }
+
+    if (key_buffer != NULL) {
+        free(key_buffer);
+    }
+    if (key_mask_buffer != NULL) {
+        free(key_mask_buffer);
+    }
+
+    return return_code;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_entry_del_raw(nikss_table_entry_ctx_t *ctx, const void *key, const void *mask)
+{
+    return TERNARY_TABLE_LOCKED(ctx, table_entry_del_raw(ctx, key, mask));
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_entry_get_raw(nikss_table_entry_ctx_t *ctx, const void *key, const void *mask, void *value)
+{
+    char *key_buffer = NULL;
+    char *key_mask_buffer = NULL;
+    int return_code = NO_ERROR;
+
+    if (ctx == NULL || key == NULL || value == NULL) {
+        return EINVAL;
+    }
+
+    return_code = prepare_raw_entry_key(ctx, key, mask, 0, BPF_EXIST, &key_buffer, &key_mask_buffer);
+    if (return_code != NO_ERROR) {
+        goto clean_up;
+    }
+
+    const void *map_key = key_buffer != NULL ? key_buffer : key;
+    if (ctx->shadow != NULL) {
+        const void *shadow_value = table_shadow_lookup(ctx->shadow, map_key);
+        if (shadow_value != NULL) {
+            memcpy(value, shadow_value, ctx->table.value_size);
+        } else {
+            return_code = ENOENT;
+        }
+    } else if (bpf_map_lookup_elem(ctx->table.fd, map_key, value) != 0) {
+        return_code = errno;
+    }
+    if (return_code != NO_ERROR) {
+        fprintf(stderr, "failed to get entry: %s\n", strerror(return_code));
+    }
+
+clean_up:
+    if (key_buffer != NULL) {
+        free(key_buffer);
+    }
+    if (key_mask_buffer != NULL) {
+        free(key_mask_buffer);
+    }
+
+    if (ctx->is_ternary) {
+        ternary_table_close_tuple(ctx);
+    }
+
+    return return_code;
+}
+
+static int parse_table_key_no_btf(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry,
+                                  const char *key, const char *key_mask)
+{
+    nikss_match_key_t mk;
+    nikss_matchkey_init(&mk);
+
+    if (ctx->is_ternary) {
+        nikss_matchkey_type(&mk, NIKSS_TERNARY);
+        nikss_matchkey_data(&mk, key, ctx->table.key_size);
+        nikss_matchkey_mask(&mk, key_mask, ctx->table.key_size);
+    } else if (ctx->table.type == BPF_MAP_TYPE_LPM_TRIE) {
+        nikss_matchkey_type(&mk, NIKSS_LPM);
+        /* We should change byte order back to host order. It isn't doable because
+         * there is no information how long is the last field - this is the only one
+         * field in the network byte order. */
+        nikss_matchkey_data(&mk, key + sizeof(uint32_t), ctx->table.key_size - sizeof(uint32_t));
+        nikss_matchkey_prefix_len(&mk, *((uint32_t *) key));
+    } else {
+        nikss_matchkey_type(&mk, NIKSS_EXACT);
+        nikss_matchkey_data(&mk, key, ctx->table.key_size);
+    }
+
+    nikss_table_entry_matchkey(entry, &mk);
+    nikss_matchkey_free(&mk);
+
+    return NO_ERROR;
+}
+
+static enum nikss_matchkind_t decode_key_field_type_btf_info(nikss_table_entry_ctx_t *ctx, const char *field_mask,
+                                                             size_t field_len, uint32_t type_fields, uint32_t field_id)
+{
+    if (ctx->is_ternary) {
+        /* LPM is not distinguishable from ternary field. Exact can be detected when mask has all-set bits. */
+        for (size_t i = 0; i < field_len; ++i) {
+            if (*((uint8_t *)(field_mask + i)) != 0xFF) {
+                return NIKSS_TERNARY;
+            }
+        }
+    } else if (ctx->table.type == BPF_MAP_TYPE_LPM_TRIE) {
+        /* Last field is lpm, others are exact. */
+        if (field_id + 1 == type_fields) {
+            return NIKSS_LPM;
+        }
+    }
+
+    return NIKSS_EXACT;
+}
+
+/* Same as nikss_matchkey_data() and nikss_matchkey_mask(), but memory is taken from entry's arena if set */
+static int set_entry_matchkey_data(nikss_table_entry_t *entry, nikss_match_key_t *mk, const char *data, size_t size)
+{
+    if (entry->arena == NULL) {
+        return nikss_matchkey_data(mk, data, size);
+    }
+
+    mk->data = arena_alloc(entry->arena, size);
+    if (mk->data == NULL) {
+        return ENOMEM;
+    }
+    memcpy(mk->data, data, size);
+    mk->key_size = size;
+    mk->mem_can_be_freed = false;
+
+    return NO_ERROR;
+}
+
+static int set_entry_matchkey_mask(nikss_table_entry_t *entry, nikss_match_key_t *mk, const char *mask, size_t size)
+{
+    if (entry->arena == NULL) {
+        return nikss_matchkey_mask(mk, mask, size);
+    }
+
+    mk->u.ternary.mask = arena_alloc(entry->arena, size);
+    if (mk->u.ternary.mask == NULL) {
+        return ENOMEM;
+    }
+    memcpy(mk->u.ternary.mask, mask, size);
+    mk->u.ternary.mask_size = size;
+    mk->mem_can_be_freed = false;
+
+    return NO_ERROR;
+}
+
+static int parse_table_key_add_key_field(nikss_table_entry_t *entry, int field_type, const char *field_data,
+                                         const char *field_mask, uint32_t prefix, size_t field_len)
+{
+    if (field_len < 1) {
+        return ENODATA;
+    }
+    nikss_match_key_t mk;
+    nikss_matchkey_init(&mk);
+    bool do_swap_byte_order = false;
+
+    /* Key fields wider than 64 bits are in network byte order */
+    if (field_len > 8) {
+        do_swap_byte_order = true;
+    }
+
+    if (field_type == NIKSS_TERNARY) {
+        nikss_matchkey_type(&mk, NIKSS_TERNARY);
+        set_entry_matchkey_data(entry, &mk, field_data, field_len);
+        set_entry_matchkey_mask(entry, &mk, field_mask, field_len);
+    } else if (field_type == NIKSS_LPM) {
+        nikss_matchkey_type(&mk, NIKSS_LPM);
+        set_entry_matchkey_data(entry, &mk, field_data, field_len);
+        nikss_matchkey_prefix_len(&mk, prefix);
+        /* LPM keys are always in network byte order in LPM tables. We can assume that
+         * it is LPM_TRIE map because keys in ternary table are never resolved into LPM match type */
+        do_swap_byte_order = true;
+    } else if (field_type == NIKSS_EXACT) {
+        nikss_matchkey_type(&mk, NIKSS_EXACT);
+        set_entry_matchkey_data(entry, &mk, field_data, field_len);
+    }
+
+    if (do_swap_byte_order) {
+        swap_byte_order(mk.data, mk.key_size);
+    }
+
+    int ret = nikss_table_entry_matchkey(entry, &mk);
+    nikss_matchkey_free(&mk);
+
+    return ret;
+}
+
+static int parse_table_key_codec(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry,
+                                 const char *key, const char *key_mask)
+{
+    const nikss_table_codec_t *codec = &ctx->codec;
+    uint32_t global_prefix = 0;
+    if (codec->has_lpm_prefix) {
+        memcpy(&global_prefix, key + codec->lpm_prefix.offset, sizeof(global_prefix));
+    }
+
+    for (size_t i = 0; i < codec->n_key_fields; i++) {
+        const nikss_table_codec_field_t *field = &codec->key_fields[i];
+        enum nikss_matchkind_t field_type = field->match_kind;
+        if (field_type == NIKSS_TERNARY) {
+            /* LPM is not distinguishable from ternary field. Exact can be detected when mask has all-set bits. */
+            field_type = NIKSS_EXACT;
+            for (size_t k = 0; k < field->size; ++k) {
+                if (*((uint8_t *)(key_mask + field->offset + k)) != 0xFF) {
+                    field_type = NIKSS_TERNARY;
+                    break;
+                }
+            }
+        }
+        uint32_t prefix = global_prefix + 32 - field->offset * 8;
+
+        int ret = parse_table_key_add_key_field(entry, field_type, key + field->offset, key_mask + field->offset,
+                                                prefix, field->size);
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+static int parse_table_key_btf_info(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry,
+                                    const char *key, const char *key_mask)
+{
+    if (ctx->codec.key_compiled) {
+        return parse_table_key_codec(ctx, entry, key, key_mask);
+    }
+
+    uint32_t key_type_id = ctx->table.key_type_id;
+    if (key_type_id == 0) {
+        return EINVAL;
+    }
+    const struct btf_type *key_type = btf_get_type_by_id(ctx->btf_metadata.btf, key_type_id);
+    if (key_type == NULL) {
+        return EINVAL;
+    }
+
+    if (btf_kind(key_type) == BTF_KIND_INT) {
+        int field_type = decode_key_field_type_btf_info(ctx, key_mask, ctx->table.key_size, 1, 0);
+        uint32_t prefix = 0;
+        if (field_type == NIKSS_LPM) {
+            prefix = *((uint32_t *) key);
+            key = key + sizeof(uint32_t);
+        }
+        return parse_table_key_add_key_field(entry, field_type, key, key_mask, prefix, ctx->table.key_size);
+    }
+
+    if (btf_kind(key_type) != BTF_KIND_STRUCT) {
+        return EINVAL;
+    }
+
+    const struct btf_member *member = btf_members(key_type);
+    unsigned entries = btf_vlen(key_type);
+    uint32_t global_prefix = 0;
+
+    for (unsigned member_idx = 0; member_idx < entries; member_idx++, member++) {
+        if (member_idx == 0 && ctx->table.type == BPF_MAP_TYPE_LPM_TRIE) {
+            global_prefix = *((uint32_t *) key);
+            continue;
+        }
+        if (is_table_dummy_key(ctx, key_type, key_type_id)) {
+            continue;
+        }
+
+        /* assume that every field is byte aligned */
+        unsigned offset = btf_member_bit_offset(key_type, member_idx) / 8;
+        unsigned member_size = btf_get_type_size_by_id(ctx->btf_metadata.btf, member->type);
+        int field_type = decode_key_field_type_btf_info(ctx, key_mask + offset, member_size, entries, member_idx);
+        uint32_t prefix = global_prefix + 32 - offset * 8;
+
+        int ret = parse_table_key_add_key_field(entry, field_type, key + offset, key_mask + offset, prefix, member_size);
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+int parse_table_key(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry,
+                    const char *key, const char *key_mask)
+{
+    if (ctx->btf_metadata.btf == NULL || ctx->table.key_type_id == 0) {
+        return parse_table_key_no_btf(ctx, entry, key, key_mask);
+    }
+
+    return parse_table_key_btf_info(ctx, entry, key, key_mask);
+}
+
+static int get_next_ternary_table_key_mask(nikss_table_entry_ctx_t *ctx)
+{
+    int ret_code = NO_ERROR;
+    char *prefix_value = NULL;
+    char *next_key = NULL;
+    uint8_t has_next_mask = 0;
+    uint32_t tuple_id = 0;
+    uint32_t inner_map_id = 0;
+    struct ternary_table_prefix_metadata prefix_md;
+
+    if ((ret_code = get_ternary_table_prefix_md(ctx, &prefix_md)) != NO_ERROR) {
+        return ret_code;
+    }
+
+    prefix_value = malloc(ctx->prefixes.value_size);
+    next_key = malloc(ctx->table.key_size);
+
+    /* Iterate in order assumed by data plane algorithm */
+    if (ctx->current_raw_key_mask == NULL) {
+        ctx->current_raw_key_mask = calloc(1, ctx->prefixes.key_size);
+    }
+
+    if (prefix_value == NULL || next_key == NULL || ctx->current_raw_key_mask == NULL) {
+        ret_code = ENOMEM;
+        goto clean_up;
+    }
+
+    for (unsigned i = 0; i < ctx->prefixes.max_entries; ++i) {
+        /* Let's see if current mask has next key entry. */
+        if (ctx->table.fd >= 0) {
+            if (bpf_map_get_next_key(ctx->table.fd, ctx->current_raw_key, next_key) == 0) {
+                break;
+            }
+        }
+
+        /* No next key, get current mask metadata. */
+        if (bpf_map_lookup_elem(ctx->prefixes.fd, ctx->current_raw_key_mask, prefix_value) != 0) {
+            ret_code = ENOENT;
+            break;
+        }
+        has_next_mask = *((uint8_t *) (prefix_value + prefix_md.has_next_offset));
+
+        if (has_next_mask == 0) {
+            break;
+        }
+
+        /* Restart get next key for next tuple. */
+        if (ctx->current_raw_key != NULL) {
+            free(ctx->current_raw_key);
+        }
+        ctx->current_raw_key = NULL;
+
+        /* Go to the next tuple. */
+        ternary_table_close_tuple(ctx);
+        memcpy(ctx->current_raw_key_mask, prefix_value + prefix_md.next_mask_offset, ctx->prefixes.key_size);
+        if (bpf_map_lookup_elem(ctx->prefixes.fd, ctx->current_raw_key_mask, prefix_value) != 0) {
+            ret_code = ENOENT;
+            break;
+        }
+        tuple_id = *((uint32_t *) (prefix_value + prefix_md.tuple_id_offset));
+        if (bpf_map_lookup_elem(ctx->tuple_map.fd, &tuple_id, &inner_map_id) != 0) {
+            ret_code = ENOENT;
+            break;
+        }
+        ctx->table.fd = bpf_map_get_fd_by_id(inner_map_id);
+    }
+
+clean_up:
+    if (prefix_value != NULL) {
+        free(prefix_value);
+    }
+    if (next_key != NULL) {
+        free(next_key);
+    }
+
+    if (ret_code != NO_ERROR && ctx->current_raw_key_mask != NULL) {
+        free(ctx->current_raw_key_mask);
+        ctx->current_raw_key_mask = NULL;
+    }
+
+    return ret_code;
+}
+
+int nikss_table_entry_goto_next_key(nikss_table_entry_ctx_t *ctx)
+{
+    void *next_key = NULL; /* do not free */
+
+    if (ctx == NULL) {
+        return ENODATA;
+    }
+
+    if (ctx->is_ternary) {
+        if (get_next_ternary_table_key_mask(ctx) != NO_ERROR) {
+            if (ctx->table.fd < 0) {
+                return NO_ERROR;  /* Silently ignore error when table is empty */
+            }
+            fprintf(stderr, "failed to iterate over table key masks\n");
+            return ENODATA;
+        }
+    }
+
+    if (ctx->table.fd < 0) {
+        fprintf(stderr, "can't get entry: table not opened\n");
+        return ENODATA;
+    }
+    if (ctx->table.key_size == 0 || ctx->table.value_size == 0) {
+        fprintf(stderr, "zero-size key or value is not supported\n");
+        return ENODATA;
+    }
+
+    next_key = malloc(ctx->table.key_size);
+    if (next_key == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return ENOMEM;
+    }
+
+    if (bpf_map_get_next_key(ctx->table.fd, ctx->current_raw_key, next_key) != 0) {
+        /* restart iteration */
+        if (ctx->is_ternary) {
+            ternary_table_close_tuple(ctx);
+        }
+        if (ctx->current_raw_key != NULL) {
+            free(ctx->current_raw_key);
+        }
+        ctx->current_raw_key = NULL;
+        if (ctx->current_raw_key_mask != NULL) {
+            free(ctx->current_raw_key_mask);
+        }
+        ctx->current_raw_key_mask = NULL;
+
+        return ENODATA;
+    }
+
+    if (ctx->current_raw_key != NULL) {
+        free(ctx->current_raw_key);
+    }
+    ctx->current_raw_key = next_key;
+
+    return NO_ERROR;
+}
+
+/* Finds the tuple which follows the one identified by current_raw_key_mask in order assumed by data plane
+ * algorithm, NULL mask stands for the head of the list. Returns ENODATA after the last tuple. */
+static int ternary_table_find_next_tuple(nikss_table_entry_ctx_t *ctx, struct ternary_table_prefix_metadata *md,
+                                         char *prefix_value, uint32_t *inner_map_id)
+{
+    if (ctx->current_raw_key_mask == NULL) {
+        ctx->current_raw_key_mask = calloc(1, ctx->prefixes.key_size);
+        if (ctx->current_raw_key_mask == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    for (unsigned i = 0; i < ctx->prefixes.max_entries; ++i) {
+        /* Head does not exist when table is empty */
+        if (bpf_map_lookup_elem(ctx->prefixes.fd, ctx->current_raw_key_mask, prefix_value) != 0) {
+            return ENODATA;
+        }
+        if (*((uint8_t *) (prefix_value + md->has_next_offset)) == 0) {
+            return ENODATA;
+        }
+
+        memcpy(ctx->current_raw_key_mask, prefix_value + md->next_mask_offset, ctx->prefixes.key_size);
+        if (bpf_map_lookup_elem(ctx->prefixes.fd, ctx->current_raw_key_mask, prefix_value) != 0) {
+            fprintf(stderr, "detected data inconsistency in prefixes, aborting\n");
+            return ENOENT;
+        }
+        uint32_t tuple_id = *((uint32_t *) (prefix_value + md->tuple_id_offset));
+        if (bpf_map_lookup_elem(ctx->tuple_map.fd, &tuple_id, inner_map_id) == 0) {
+            return NO_ERROR;
+        }
+        /* Tuple without inner map has no entries, so skip it */
+    }
+
+    fprintf(stderr, "detected loop in prefixes, aborting\n");
+    return ELOOP;
+}
+
+/* Opens the next tuple as the table, so it is opened only once during iteration */
+static int ternary_table_open_next_tuple(nikss_table_entry_ctx_t *ctx)
+{
+    struct ternary_table_prefix_metadata prefix_md;
+    uint32_t inner_map_id = 0;
+
+    int ret = get_ternary_table_prefix_md(ctx, &prefix_md);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+
+    char *prefix_value = malloc(ctx->prefixes.value_size);
+    if (prefix_value == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return ENOMEM;
+    }
+
+    ternary_table_close_tuple(ctx);
+    ret = ternary_table_find_next_tuple(ctx, &prefix_md, prefix_value, &inner_map_id);
+    if (ret == NO_ERROR) {
+        ctx->table.fd = bpf_map_get_fd_by_id(inner_map_id);
+        if (ctx->table.fd < 0) {
+            ret = errno;
+            fprintf(stderr, "failed to open tuple: %s\n", strerror(ret));
+        }
+    }
+
+    free(prefix_value);
+
+    return ret;
+}
+
+/* Restarts iteration over tuples */
+static void ternary_table_finish_iteration(nikss_table_entry_ctx_t *ctx)
+{
+    if (ctx->is_ternary == false) {
+        return;
     }
 
-    return NO_ERROR;
+    ternary_table_close_tuple(ctx);
+    if (ctx->current_raw_key_mask != NULL) {
+        free(ctx->current_raw_key_mask);
+    }
+    ctx->current_raw_key_mask = NULL;
 }
 
-static int parse_table_value(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry, const char *value)
+static int reserve_ternary_tuple_dump(nikss_table_entry_ctx_t *ctx, struct nikss_ternary_tuple_dump *dump,
+                                      uint32_t n_entries)
 {
-    entry->action = malloc(sizeof(nikss_action_t));
-    if (entry->action == NULL) {
+    if (dump->count + n_entries <= dump->capacity) {
+        return NO_ERROR;
+    }
+
+    uint32_t new_capacity = dump->capacity > 0 ? dump->capacity : n_entries;
+    while (new_capacity < dump->count + n_entries) {
+        new_capacity *= 2;
+    }
+
+    char *keys = realloc(dump->keys, (size_t) new_capacity * ctx->table.key_size);
+    if (keys == NULL) {
         return ENOMEM;
     }
-    nikss_action_init(entry->action);
+    dump->keys = keys;
 
-    if (ctx->btf_metadata.btf == NULL || ctx->table.value_type_id == 0) {
-        return parse_table_value_no_btf(ctx, entry, value);
+    char *values = realloc(dump->values, (size_t) new_capacity * ctx->table.value_size);
+    if (values == NULL) {
+        return ENOMEM;
     }
+    dump->values = values;
 
-    return parse_table_value_btf_info(ctx, entry, value);
+    dump->capacity = new_capacity;
+
+    return NO_ERROR;
 }
 
-int nikss_table_entry_get(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry)
+static int read_ternary_tuple_by_entry(nikss_table_entry_ctx_t *ctx, int fd, struct nikss_ternary_tuple_dump *dump)
 {
-    char *key_buffer = NULL;
-    char *key_mask_buffer = NULL;
-    char *value_buffer = NULL;
-    int return_code = NO_ERROR;
-
-    if (ctx == NULL || entry == NULL) {
-        return EINVAL;
-    }
+    while (true) {
+        if (reserve_ternary_tuple_dump(ctx, dump, 1) != NO_ERROR) {
+            return ENOMEM;
+        }
 
-    if (entry->n_keys == 0 || entry->match_keys == NULL) {
-        fprintf(stderr, "can't get entry: missing key\n");
-        return ENODATA;
-    }
+        /* buffer might be reallocated, so find previous key every time */
+        const char *prev_key = dump->count > 0 ? dump->keys + (size_t) (dump->count - 1) * ctx->table.key_size : NULL;
+        char *key = dump->keys + (size_t) dump->count * ctx->table.key_size;
+        char *value = dump->values + (size_t) dump->count * ctx->table.value_size;
 
-    if (ctx->is_ternary) {
-        return_code = ternary_table_open_tuple(ctx, entry, &key_mask_buffer, BPF_EXIST);
-        if (return_code != NO_ERROR) {
-            goto clean_up;
+        if (bpf_map_get_next_key(fd, prev_key, key) != 0) {
+            return NO_ERROR;
+        }
+        if (bpf_map_lookup_elem(fd, key, value) != 0) {
+            return errno;
         }
+        dump->count += 1;
     }
+}
 
-    if (ctx->table.fd < 0) {
-        fprintf(stderr, "can't get entry: table not opened\n");
-        return_code = EBADF;
+/* Reads all the entries of a tuple, in chunks when kernel supports it. Must not modify
+ * the table context, because it is called from many threads at once. */
+static int read_ternary_tuple(nikss_table_entry_ctx_t *ctx, struct nikss_ternary_tuple_dump *dump)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = 0,
+                        .flags = 0,
+    );
+    int ret = NO_ERROR;
+    bool started = false;
+    uint32_t chunk = ctx->batch_size > 0 ? ctx->batch_size : TERNARY_TUPLE_DUMP_CHUNK_SIZE;
+    size_t token_size = ctx->table.key_size > sizeof(uint64_t) ? ctx->table.key_size : sizeof(uint64_t);
+    void *token = calloc(1, token_size);
+
+    int fd = bpf_map_get_fd_by_id(dump->inner_map_id);
+    if (fd < 0) {
+        ret = errno;
         goto clean_up;
     }
-    if (ctx->table.key_size == 0 || ctx->table.value_size == 0) {
-        fprintf(stderr, "zero-size key or value is not supported\n");
-        return_code = EINVAL;
+    if (token == NULL) {
+        ret = ENOMEM;
         goto clean_up;
     }
 
-    /* Prepare entry - remove everything but not key */
-    size_t tmp_n_keys = entry->n_keys;
-    entry->n_keys = 0;
-    void *tmp_keys = entry->match_keys;
-    entry->match_keys = NULL;
-    nikss_table_entry_free(entry);
-    nikss_table_entry_init(entry);
-    entry->n_keys = tmp_n_keys;
-    entry->match_keys = tmp_keys;
+    while (true) {
+        if (reserve_ternary_tuple_dump(ctx, dump, chunk) != NO_ERROR) {
+            ret = ENOMEM;
+            break;
+        }
 
-    /* prepare buffers for map key/value */
-    key_buffer = malloc(ctx->table.key_size);
-    value_buffer = malloc(ctx->table.value_size);
-    if (key_buffer == NULL || value_buffer == NULL) {
-        fprintf(stderr, "not enough memory\n");
-        return_code = ENOMEM;
-        goto clean_up;
-    }
+        uint32_t count = chunk;
+        ret = bpf_map_lookup_batch(fd, started ? token : NULL, token,
+                                   dump->keys + (size_t) dump->count * ctx->table.key_size,
+                                   dump->values + (size_t) dump->count * ctx->table.value_size, &count, &opts);
+        if (ret == 0) {
+            dump->count += count;
+            started = true;
+            continue;
+        }
 
-    return_code = construct_buffer(key_buffer, ctx->table.key_size, ctx, entry,
-                                   fill_key_btf_info, fill_key_byte_by_byte);
-    if (return_code != NO_ERROR) {
-        fprintf(stderr, "failed to construct key\n");
-        goto clean_up;
-    }
-    if (ctx->is_ternary == true && key_mask_buffer != NULL) {
-        mem_bitwise_and((uint32_t *) key_buffer, (uint32_t *) key_mask_buffer, ctx->table.key_size);
+        ret = errno;
+        if (ret == ENOENT) {
+            dump->count += count;
+            ret = NO_ERROR;
+            break;
+        }
+        if (ret == ENOSPC && chunk < ctx->table.max_entries) {
+            chunk = chunk * 2 > ctx->table.max_entries ? ctx->table.max_entries : chunk * 2;
+            continue;
+        }
+        if (started == false) {
+            /* Kernel does not support batch lookup */
+            ret = read_ternary_tuple_by_entry(ctx, fd, dump);
+        }
+        break;
     }
 
-    return_code = bpf_map_lookup_elem(ctx->table.fd, key_buffer, value_buffer);
-    if (return_code != 0) {
-        return_code = errno;
-        fprintf(stderr, "failed to get entry: %s\n", strerror(return_code));
-        goto clean_up;
+clean_up:
+    close_object_fd(&fd);
+    if (token != NULL) {
+        free(token);
     }
 
-    /* No need to parse key - already provided by user */
+    return ret;
+}
 
-    /* Parse value */
-    return_code = parse_table_value(ctx, entry, value_buffer);
-    if (return_code != NO_ERROR) {
-        fprintf(stderr, "failed to parse entry: %s\n", strerror(return_code));
-    }
+struct ternary_tuple_dump_job {
+    nikss_table_entry_ctx_t *ctx;
+    uint32_t next_tuple;
+};
 
-clean_up:
-    if (key_buffer != NULL) {
-        free(key_buffer);
-    }
-    if (key_mask_buffer != NULL) {
-        free(key_mask_buffer);
-    }
-    if (value_buffer != NULL) {
-        free(value_buffer);
-    }
+static void *ternary_tuple_dump_worker(void *arg)
+{
+    struct ternary_tuple_dump_job *job = arg;
 
-    if (ctx->is_ternary) {
-        ternary_table_close_tuple(ctx);
+    while (true) {
+        uint32_t idx = __atomic_fetch_add(&job->next_tuple, 1, __ATOMIC_RELAXED);
+        if (idx >= job->ctx->n_tuple_dumps) {
+            break;
+        }
+        struct nikss_ternary_tuple_dump *dump = &job->ctx->tuple_dumps[idx];
+        dump->error = read_ternary_tuple(job->ctx, dump);
     }
 
-    return return_code;
+    return NULL;
 }
 
-static int parse_table_key_no_btf(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry,
-                                  const char *key, const char *key_mask)
+static int load_ternary_tuple_dumps(nikss_table_entry_ctx_t *ctx)
 {
-    nikss_match_key_t mk;
-    nikss_matchkey_init(&mk);
+    struct ternary_table_prefix_metadata prefix_md;
+    struct ternary_tuple_dump_job job = { .ctx = ctx, .next_tuple = 0 };
+    pthread_t *threads = NULL;
+    uint32_t n_threads = 0;
+    uint32_t capacity = 0;
+    uint32_t inner_map_id = 0;
 
-    if (ctx->is_ternary) {
-        nikss_matchkey_type(&mk, NIKSS_TERNARY);
-        nikss_matchkey_data(&mk, key, ctx->table.key_size);
-        nikss_matchkey_mask(&mk, key_mask, ctx->table.key_size);
-    } else if (ctx->table.type == BPF_MAP_TYPE_LPM_TRIE) {
-        nikss_matchkey_type(&mk, NIKSS_LPM);
-        /* We should change byte order back to host order. It isn't doable because
-         * there is no information how long is the last field - this is the only one
-         * field in the network byte order. */
-        nikss_matchkey_data(&mk, key + sizeof(uint32_t), ctx->table.key_size - sizeof(uint32_t));
-        nikss_matchkey_prefix_len(&mk, *((uint32_t *) key));
-    } else {
-        nikss_matchkey_type(&mk, NIKSS_EXACT);
-        nikss_matchkey_data(&mk, key, ctx->table.key_size);
-    }
+    free_ternary_tuple_dumps(ctx);
+    ternary_table_finish_iteration(ctx);
 
-    nikss_table_entry_matchkey(entry, &mk);
-    nikss_matchkey_free(&mk);
+    int ret = get_ternary_table_prefix_md(ctx, &prefix_md);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
 
-    return NO_ERROR;
-}
+    char *prefix_value = malloc(ctx->prefixes.value_size);
+    if (prefix_value == NULL) {
+        ret = ENOMEM;
+        goto clean_up;
+    }
 
-static enum nikss_matchkind_t decode_key_field_type_btf_info(nikss_table_entry_ctx_t *ctx, const char *field_mask,
-                                                             size_t field_len, uint32_t type_fields, uint32_t field_id)
-{
-    if (ctx->is_ternary) {
-        /* LPM is not distinguishable from ternary field. Exact can be detected when mask has all-set bits. */
-        for (size_t i = 0; i < field_len; ++i) {
-            if (*((uint8_t *)(field_mask + i)) != 0xFF) {
-                return NIKSS_TERNARY;
+    /* Walk over the list of tuples first, then read them in parallel */
+    while ((ret = ternary_table_find_next_tuple(ctx, &prefix_md, prefix_value, &inner_map_id)) == NO_ERROR) {
+        if (ctx->n_tuple_dumps >= capacity) {
+            uint32_t new_capacity = capacity > 0 ? capacity * 2 : 16;
+            struct nikss_ternary_tuple_dump *dumps = realloc(ctx->tuple_dumps, new_capacity * sizeof(*dumps));
+            if (dumps == NULL) {
+                ret = ENOMEM;
+                goto clean_up;
             }
+            ctx->tuple_dumps = dumps;
+            capacity = new_capacity;
         }
-    } else if (ctx->table.type == BPF_MAP_TYPE_LPM_TRIE) {
-        /* Last field is lpm, others are exact. */
-        if (field_id + 1 == type_fields) {
-            return NIKSS_LPM;
+
+        struct nikss_ternary_tuple_dump *dump = &ctx->tuple_dumps[ctx->n_tuple_dumps];
+        memset(dump, 0, sizeof(*dump));
+        ctx->n_tuple_dumps += 1;
+        dump->inner_map_id = inner_map_id;
+        dump->key_mask = malloc(ctx->prefixes.key_size);
+        if (dump->key_mask == NULL) {
+            ret = ENOMEM;
+            goto clean_up;
         }
+        memcpy(dump->key_mask, ctx->current_raw_key_mask, ctx->prefixes.key_size);
     }
-
-    return NIKSS_EXACT;
-}
-
-static int parse_table_key_add_key_field(nikss_table_entry_t *entry, int field_type, const char *field_data,
-                                         const char *field_mask, uint32_t prefix, size_t field_len)
-{
-    if (field_len < 1) {
-        return ENODATA;
+    if (ret != ENODATA) {
+        goto clean_up;
     }
-    nikss_match_key_t mk;
-    nikss_matchkey_init(&mk);
-    bool do_swap_byte_order = false;
+    ret = NO_ERROR;
 
-    /* Key fields wider than 64 bits are in network byte order */
-    if (field_len > 8) {
-        do_swap_byte_order = true;
+    n_threads = ctx->tuple_threads < ctx->n_tuple_dumps ? ctx->tuple_threads : ctx->n_tuple_dumps;
+    threads = calloc(n_threads > 0 ? n_threads : 1, sizeof(pthread_t));
+    if (threads == NULL) {
+        ret = ENOMEM;
+        goto clean_up;
     }
-
-    if (field_type == NIKSS_TERNARY) {
-        nikss_matchkey_type(&mk, NIKSS_TERNARY);
-        nikss_matchkey_data(&mk, field_data, field_len);
-        nikss_matchkey_mask(&mk, field_mask, field_len);
-    } else if (field_type == NIKSS_LPM) {
-        nikss_matchkey_type(&mk, NIKSS_LPM);
-        nikss_matchkey_data(&mk, field_data, field_len);
-        nikss_matchkey_prefix_len(&mk, prefix);
-        /* LPM keys are always in network byte order in LPM tables. We can assume that
-         * it is LPM_TRIE map because keys in ternary table are never resolved into LPM match type */
-        do_swap_byte_order = true;
-    } else if (field_type == NIKSS_EXACT) {
-        nikss_matchkey_type(&mk, NIKSS_EXACT);
-        nikss_matchkey_data(&mk, field_data, field_len);
+    uint32_t n_started = 0;
+    for (; n_started < n_threads; n_started++) {
+        if (pthread_create(&threads[n_started], NULL, ternary_tuple_dump_worker, &job) != 0) {
+            break;
+        }
     }
-
-    if (do_swap_byte_order) {
-        swap_byte_order(mk.data, mk.key_size);
+    /* Read remaining tuples also in this thread, e.g. when threads could not be created */
+    ternary_tuple_dump_worker(&job);
+    for (uint32_t i = 0; i < n_started; i++) {
+        pthread_join(threads[i], NULL);
     }
 
-    int ret = nikss_table_entry_matchkey(entry, &mk);
-    nikss_matchkey_free(&mk);
-
-    return ret;
-}
+    for (uint32_t i = 0; i < ctx->n_tuple_dumps; i++) {
+        if (ctx->tuple_dumps[i].error != NO_ERROR) {
+            ret = ctx->tuple_dumps[i].error;
+            fprintf(stderr, "failed to read tuple: %s\n", strerror(ret));
+            break;
+        }
+    }
 
-static int parse_table_key_btf_info(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry,
-                                    const char *key, const char *key_mask)
-{
-    uint32_t key_type_id = ctx->table.key_type_id;
-    if (key_type_id == 0) {
-        return EINVAL;
+clean_up:
+    if (prefix_value != NULL) {
+        free(prefix_value);
     }
-    const struct btf_type *key_type = btf_get_type_by_id(ctx->btf_metadata.btf, key_type_id);
-    if (key_type == NULL) {
-        return EINVAL;
+    if (threads != NULL) {
+        free(threads);
     }
+    ternary_table_finish_iteration(ctx);
 
-    if (btf_kind(key_type) == BTF_KIND_INT) {
-        int field_type = decode_key_field_type_btf_info(ctx, key_mask, ctx->table.key_size, 1, 0);
-        uint32_t prefix = 0;
-        if (field_type == NIKSS_LPM) {
-            prefix = *((uint32_t *) key);
-            key = key + sizeof(uint32_t);
+    if (ret != NO_ERROR) {
+        if (ret == ENOMEM) {
+            fprintf(stderr, "not enough memory\n");
         }
-        return parse_table_key_add_key_field(entry, field_type, key, key_mask, prefix, ctx->table.key_size);
+        free_ternary_tuple_dumps(ctx);
+        return ret;
     }
 
-    if (btf_kind(key_type) != BTF_KIND_STRUCT) {
-        return EINVAL;
-    }
+    ctx->tuple_dumps_loaded = true;
 
-    const struct btf_member *member = btf_members(key_type);
-    unsigned entries = btf_vlen(key_type);
-    uint32_t global_prefix = 0;
+    return NO_ERROR;
+}
 
-    for (unsigned member_idx = 0; member_idx < entries; member_idx++, member++) {
-        if (member_idx == 0 && ctx->table.type == BPF_MAP_TYPE_LPM_TRIE) {
-            global_prefix = *((uint32_t *) key);
-            continue;
-        }
-        if (is_table_dummy_key(ctx, key_type, key_type_id)) {
-            continue;
+static nikss_table_entry_t *get_next_entry_from_tuple_dumps(nikss_table_entry_ctx_t *ctx)
+{
+    if (ctx->tuple_dumps_loaded == false) {
+        if (load_ternary_tuple_dumps(ctx) != NO_ERROR) {
+            return NULL;
         }
+    }
 
-        /* assume that every field is byte aligned */
-        unsigned offset = btf_member_bit_offset(key_type, member_idx) / 8;
-        unsigned member_size = btf_get_type_size_by_id(ctx->btf_metadata.btf, member->type);
-        int field_type = decode_key_field_type_btf_info(ctx, key_mask + offset, member_size, entries, member_idx);
-        uint32_t prefix = global_prefix + 32 - offset * 8;
+    while (ctx->tuple_dump_index < ctx->n_tuple_dumps &&
+           ctx->tuple_dump_position >= ctx->tuple_dumps[ctx->tuple_dump_index].count) {
+        ctx->tuple_dump_index += 1;
+        ctx->tuple_dump_position = 0;
+    }
 
-        int ret = parse_table_key_add_key_field(entry, field_type, key + offset, key_mask + offset, prefix, member_size);
-        if (ret != NO_ERROR) {
-            return ret;
-        }
+    if (ctx->tuple_dump_index >= ctx->n_tuple_dumps) {
+        /* restart iteration */
+        free_ternary_tuple_dumps(ctx);
+        return NULL;
     }
 
-    return NO_ERROR;
-}
+    struct nikss_ternary_tuple_dump *dump = &ctx->tuple_dumps[ctx->tuple_dump_index];
+    const char *key = dump->keys + (size_t) ctx->tuple_dump_position * ctx->table.key_size;
+    const char *value = dump->values + (size_t) ctx->tuple_dump_position * ctx->table.value_size;
+    ctx->tuple_dump_position += 1;
 
-int parse_table_key(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry,
-                    const char *key, const char *key_mask)
-{
-    if (ctx->btf_metadata.btf == NULL || ctx->table.key_type_id == 0) {
-        return parse_table_key_no_btf(ctx, entry, key, key_mask);
+    reset_current_entry(ctx);
+
+    int ret = parse_table_key(ctx, &ctx->current_entry, key, dump->key_mask);
+    if (ret == NO_ERROR) {
+        ret = parse_table_value(ctx, &ctx->current_entry, value);
+    }
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to parse entry: %s\n", strerror(ret));
+        free_ternary_tuple_dumps(ctx);
+        return NULL;
     }
 
-    return parse_table_key_btf_info(ctx, entry, key, key_mask);
+    return &ctx->current_entry;
 }
 
-static int get_next_ternary_table_key_mask(nikss_table_entry_ctx_t *ctx)
+static bool table_batch_iterator_enabled(nikss_table_entry_ctx_t *ctx)
 {
-    int ret_code = NO_ERROR;
-    char *prefix_value = NULL;
-    char *next_key = NULL;
-    uint8_t has_next_mask = 0;
-    uint32_t tuple_id = 0;
-    uint32_t inner_map_id = 0;
-    struct ternary_table_prefix_metadata prefix_md;
+    /* Ternary tables are iterated over tuples, they are opened on demand */
+    bool table_opened = ctx->is_ternary ? (ctx->prefixes.fd >= 0 && ctx->tuple_map.fd >= 0) : ctx->table.fd >= 0;
+    return ctx->batch_size > 0 && ctx->batch_not_supported == false && table_opened &&
+           ctx->table.key_size > 0 && ctx->table.value_size > 0;
+}
 
-    if ((ret_code = get_ternary_table_prefix_md(ctx, &prefix_md)) != NO_ERROR) {
-        return ret_code;
+static int allocate_table_batch_buffers(nikss_table_entry_ctx_t *ctx, uint32_t batch_size)
+{
+    char *keys = realloc(ctx->batch_keys, (size_t) batch_size * ctx->table.key_size);
+    if (keys == NULL) {
+        return ENOMEM;
     }
+    ctx->batch_keys = keys;
 
-    prefix_value = malloc(ctx->prefixes.value_size);
-    next_key = malloc(ctx->table.key_size);
-
-    /* Iterate in order assumed by data plane algorithm */
-    if (ctx->current_raw_key_mask == NULL) {
-        ctx->current_raw_key_mask = calloc(1, ctx->prefixes.key_size);
+    char *values = realloc(ctx->batch_values, (size_t) batch_size * ctx->table.value_size);
+    if (values == NULL) {
+        return ENOMEM;
     }
+    ctx->batch_values = values;
 
-    if (prefix_value == NULL || next_key == NULL || ctx->current_raw_key_mask == NULL) {
-        ret_code = ENOMEM;
-        goto clean_up;
+    /* Token is a bucket number for hash maps and a key for other maps */
+    if (ctx->batch_token == NULL) {
+        size_t token_size = ctx->table.key_size > sizeof(uint64_t) ? ctx->table.key_size : sizeof(uint64_t);
+        ctx->batch_token = calloc(1, token_size);
+        if (ctx->batch_token == NULL) {
+            return ENOMEM;
+        }
     }
 
-    for (unsigned i = 0; i < ctx->prefixes.max_entries; ++i) {
-        /* Let's see if current mask has next key entry. */
-        if (ctx->table.fd >= 0) {
-            if (bpf_map_get_next_key(ctx->table.fd, ctx->current_raw_key, next_key) == 0) {
-                break;
-            }
+    ctx->batch_size = batch_size;
+
+    return NO_ERROR;
+}
+
+static int fetch_table_batch(nikss_table_entry_ctx_t *ctx)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = 0,
+                        .flags = 0,
+    );
+
+    if (ctx->batch_keys == NULL || ctx->batch_values == NULL || ctx->batch_token == NULL) {
+        if (allocate_table_batch_buffers(ctx, ctx->batch_size) != NO_ERROR) {
+            fprintf(stderr, "not enough memory\n");
+            return ENOMEM;
         }
+    }
 
-        /* No next key, get current mask metadata. */
-        if (bpf_map_lookup_elem(ctx->prefixes.fd, ctx->current_raw_key_mask, prefix_value) != 0) {
-            ret_code = ENOENT;
+    while (true) {
+        uint32_t count = ctx->batch_size;
+        void *in_batch = ctx->batch_started ? ctx->batch_token : NULL;
+        int ret = bpf_map_lookup_batch(ctx->table.fd, in_batch, ctx->batch_token,
+                                       ctx->batch_keys, ctx->batch_values, &count, &opts);
+        if (ret == 0) {
+            ctx->batch_count = count;
             break;
         }
-        has_next_mask = *((uint8_t *) (prefix_value + prefix_md.has_next_offset));
 
-        if (has_next_mask == 0) {
+        ret = errno;
+        if (ret == ENOENT) {
+            /* No more entries, but the last chunk is still valid */
+            ctx->batch_count = count;
+            ctx->batch_finished = true;
             break;
         }
 
-        /* Restart get next key for next tuple. */
-        if (ctx->current_raw_key != NULL) {
-            free(ctx->current_raw_key);
+        if (ret == ENOSPC && ctx->batch_size < ctx->table.max_entries) {
+            /* Hash bucket does not fit into chunk, so increase it */
+            uint32_t new_size = ctx->batch_size * 2;
+            if (new_size > ctx->table.max_entries) {
+                new_size = ctx->table.max_entries;
+            }
+            if (allocate_table_batch_buffers(ctx, new_size) != NO_ERROR) {
+                fprintf(stderr, "not enough memory\n");
+                return ENOMEM;
+            }
+            continue;
         }
-        ctx->current_raw_key = NULL;
 
-        /* Go to the next tuple. */
-        ternary_table_close_tuple(ctx);
-        memcpy(ctx->current_raw_key_mask, prefix_value + prefix_md.next_mask_offset, ctx->prefixes.key_size);
-        if (bpf_map_lookup_elem(ctx->prefixes.fd, ctx->current_raw_key_mask, prefix_value) != 0) {
-            ret_code = ENOENT;
-            break;
+        if (ret == ENOSPC) {
+            /* Not a missing support of batch lookup, so do not disable it for the context */
+            fprintf(stderr, "failed to read entries: chunk of %u entries is too small\n", ctx->batch_size);
+            return ENOSPC;
         }
-        tuple_id = *((uint32_t *) (prefix_value + prefix_md.tuple_id_offset));
-        if (bpf_map_lookup_elem(ctx->tuple_map.fd, &tuple_id, &inner_map_id) != 0) {
-            ret_code = ENOENT;
-            break;
+
+        if (ctx->batch_started == false) {
+            /* Kernel or map type does not support batch lookup */
+            ctx->batch_not_supported = true;
+            return ENOTSUP;
         }
-        ctx->table.fd = bpf_map_get_fd_by_id(inner_map_id);
-    }
 
-clean_up:
-    if (prefix_value != NULL) {
-        free(prefix_value);
-    }
-    if (next_key != NULL) {
-        free(next_key);
+        fprintf(stderr, "failed to read entries: %s\n", strerror(ret));
+        return ret;
     }
 
-    if (ret_code != NO_ERROR && ctx->current_raw_key_mask != NULL) {
-        free(ctx->current_raw_key_mask);
-        ctx->current_raw_key_mask = NULL;
-    }
+    ctx->batch_started = true;
+    ctx->batch_position = 0;
 
-    return ret_code;
+    return NO_ERROR;
 }
 
-int nikss_table_entry_goto_next_key(nikss_table_entry_ctx_t *ctx)
+static nikss_table_entry_t *get_next_entry_from_batch(nikss_table_entry_ctx_t *ctx, int *error_code)
 {
-    void *next_key = NULL; /* do not free */
-
-    if (ctx == NULL) {
-        return ENODATA;
-    }
+    *error_code = NO_ERROR;
 
-    if (ctx->is_ternary) {
-        if (get_next_ternary_table_key_mask(ctx) != NO_ERROR) {
-            if (ctx->table.fd < 0) {
-                return NO_ERROR;  /* Silently ignore error when table is empty */
+    while (ctx->batch_position >= ctx->batch_count) {
+        if (ctx->batch_finished || (ctx->is_ternary && ctx->table.fd < 0)) {
+            reset_table_batch_iterator(ctx);
+            if (ctx->is_ternary == false) {
+                return NULL;
+            }
+            /* Current tuple is drained, move on to the next one */
+            *error_code = ternary_table_open_next_tuple(ctx);
+            if (*error_code != NO_ERROR) {
+                if (*error_code == ENODATA) {
+                    *error_code = NO_ERROR;
+                }
+                ternary_table_finish_iteration(ctx);
+                return NULL;
             }
-            fprintf(stderr, "failed to iterate over table key masks\n");
-            return ENODATA;
+        }
+        *error_code = fetch_table_batch(ctx);
+        if (*error_code != NO_ERROR) {
+            reset_table_batch_iterator(ctx);
+            /* On ENOTSUP current tuple is read again entry by entry */
+            if (*error_code != ENOTSUP) {
+                ternary_table_finish_iteration(ctx);
+            }
+            return NULL;
+        }
+        if (ctx->batch_count == 0) {
+            ctx->batch_finished = true;
         }
     }
 
-    if (ctx->table.fd < 0) {
-        fprintf(stderr, "can't get entry: table not opened\n");
-        return ENODATA;
-    }
-    if (ctx->table.key_size == 0 || ctx->table.value_size == 0) {
-        fprintf(stderr, "zero-size key or value is not supported\n");
-        return ENODATA;
-    }
-
-    next_key = malloc(ctx->table.key_size);
-    if (next_key == NULL) {
-        fprintf(stderr, "not enough memory\n");
-        return ENOMEM;
-    }
+    const char *key = ctx->batch_keys + (size_t) ctx->batch_position * ctx->table.key_size;
+    const char *value = ctx->batch_values + (size_t) ctx->batch_position * ctx->table.value_size;
+    ctx->batch_position += 1;
 
-    if (bpf_map_get_next_key(ctx->table.fd, ctx->current_raw_key, next_key) != 0) {
-        /* restart iteration */
-        if (ctx->is_ternary) {
-            ternary_table_close_tuple(ctx);
-        }
-        if (ctx->current_raw_key != NULL) {
-            free(ctx->current_raw_key);
-        }
-        ctx->current_raw_key = NULL;
-        if (ctx->current_raw_key_mask != NULL) {
-            free(ctx->current_raw_key_mask);
-        }
-        ctx->current_raw_key_mask = NULL;
+    reset_current_entry(ctx);
 
-        return ENODATA;
+    int ret = parse_table_key(ctx, &ctx->current_entry, key, ctx->is_ternary ? ctx->current_raw_key_mask : NULL);
+    if (ret == NO_ERROR) {
+        ret = parse_table_value(ctx, &ctx->current_entry, value);
     }
-
-    if (ctx->current_raw_key != NULL) {
-        free(ctx->current_raw_key);
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to parse entry: %s\n", strerror(ret));
+        reset_table_batch_iterator(ctx);
+        ternary_table_finish_iteration(ctx);
+        *error_code = ret;
+        return NULL;
     }
-    ctx->current_raw_key = next_key;
 
-    return NO_ERROR;
+    return &ctx->current_entry;
 }
 
 nikss_table_entry_t *nikss_table_entry_get_next(nikss_table_entry_ctx_t *ctx)
@@ -3184,6 +6490,19 @@ nikss_table_entry_t *nikss_table_entry_get_next(nikss_table_entry_ctx_t *ctx)
         return NULL;
     }
 
+    if (ctx->is_ternary && ctx->tuple_threads > 1) {
+        return get_next_entry_from_tuple_dumps(ctx);
+    }
+
+    if (table_batch_iterator_enabled(ctx)) {
+        int error_code = NO_ERROR;
+        ret_instance = get_next_entry_from_batch(ctx, &error_code);
+        if (error_code != ENOTSUP) {
+            return ret_instance;
+        }
+        /* otherwise fall back to reading entry by entry */
+    }
+
     if (nikss_table_entry_goto_next_key(ctx) != NO_ERROR) {
         /* Error or no next key */
         return NULL;
@@ -3202,8 +6521,7 @@ nikss_table_entry_t *nikss_table_entry_get_next(nikss_table_entry_ctx_t *ctx)
         goto clean_up;
     }
 
-    nikss_table_entry_free(&ctx->current_entry);
-    nikss_table_entry_init(&ctx->current_entry);
+    reset_current_entry(ctx);
 
     /* Parse key */
     return_code = parse_table_key(ctx, &ctx->current_entry, ctx->current_raw_key, ctx->current_raw_key_mask);
@@ -3229,6 +6547,262 @@ clean_up:
     return ret_instance;
 }
 
+/******************************************************************************
+ * Fast dump of direct objects
+ *****************************************************************************/
+
+struct direct_objects_dump {
+    nikss_table_direct_objects_cb_t cb;
+    void *arg;
+    nikss_table_direct_objects_entry_t entry;
+    nikss_direct_counter_value_t *counters;
+    nikss_direct_meter_value_t *meters;
+
+    uint32_t chunk;
+    char *keys;
+    char *values;
+    void *token;
+};
+
+static int reserve_direct_objects_dump(nikss_table_entry_ctx_t *ctx, struct direct_objects_dump *dump,
+                                       uint32_t chunk)
+{
+    char *keys = realloc(dump->keys, (size_t) chunk * ctx->table.key_size);
+    if (keys == NULL) {
+        return ENOMEM;
+    }
+    dump->keys = keys;
+
+    char *values = realloc(dump->values, (size_t) chunk * ctx->table.value_size);
+    if (values == NULL) {
+        return ENOMEM;
+    }
+    dump->values = values;
+    dump->chunk = chunk;
+
+    return NO_ERROR;
+}
+
+static int emit_direct_objects(nikss_table_entry_ctx_t *ctx, struct direct_objects_dump *dump,
+                               const char *key, const char *value)
+{
+    for (size_t i = 0; i < ctx->n_direct_counters; i++) {
+        const nikss_direct_counter_context_t *dc_ctx = &ctx->direct_counters_ctx[i];
+        nikss_counter_entry_t counter = {0};
+        convert_counter_data_to_entry(value + dc_ctx->counter_offset, dc_ctx->counter_size,
+                                      dc_ctx->counter_type, &counter);
+        dump->counters[i].bytes = counter.bytes;
+        dump->counters[i].packets = counter.packets;
+    }
+
+    for (size_t i = 0; i < ctx->n_direct_meters; i++) {
+        nikss_meter_entry_t meter = {0};
+        convert_meter_data_to_entry((const nikss_meter_data_t *) (value + ctx->direct_meters_ctx[i].meter_offset),
+                                    &meter);
+        dump->meters[i].pir = meter.pir;
+        dump->meters[i].pbs = meter.pbs;
+        dump->meters[i].cir = meter.cir;
+        dump->meters[i].cbs = meter.cbs;
+    }
+
+    dump->entry.key = key;
+    return dump->cb(&dump->entry, dump->arg);
+}
+
+static int dump_direct_objects_by_entry(nikss_table_entry_ctx_t *ctx, struct direct_objects_dump *dump, int fd)
+{
+    bool started = false;
+
+    /* Two keys are used as previous and next key, buffer may be moved by the reservation */
+    if (dump->chunk < 2 && reserve_direct_objects_dump(ctx, dump, 2) != NO_ERROR) {
+        return ENOMEM;
+    }
+    char *key = dump->keys;
+    char *next_key = dump->keys + ctx->table.key_size;
+
+    while (bpf_map_get_next_key(fd, started ? key : NULL, next_key) == 0) {
+        char *tmp_key = key;
+        key = next_key;
+        next_key = tmp_key;
+        started = true;
+
+        if (bpf_map_lookup_elem(fd, key, dump->values) != 0) {
+            if (errno == ENOENT) {
+                /* removed in the meantime */
+                continue;
+            }
+            return errno;
+        }
+        int ret = emit_direct_objects(ctx, dump, key, dump->values);
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+static int dump_direct_objects_of_map(nikss_table_entry_ctx_t *ctx, struct direct_objects_dump *dump, int fd)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = 0,
+                        .flags = 0,
+    );
+    bool started = false;
+
+    while (true) {
+        uint32_t count = dump->chunk;
+        int ret = bpf_map_lookup_batch(fd, started ? dump->token : NULL, dump->token,
+                                       dump->keys, dump->values, &count, &opts);
+        bool finished = false;
+        if (ret != 0) {
+            ret = errno;
+            if (ret == ENOSPC && dump->chunk < ctx->table.max_entries) {
+                /* Hash bucket does not fit into chunk */
+                uint32_t new_chunk = dump->chunk * 2 > ctx->table.max_entries ? ctx->table.max_entries :
+                                     dump->chunk * 2;
+                if (reserve_direct_objects_dump(ctx, dump, new_chunk) != NO_ERROR) {
+                    return ENOMEM;
+                }
+                continue;
+            }
+            if (ret != ENOENT) {
+                if (started == false) {
+                    /* Kernel or map type does not support batch lookup */
+                    return dump_direct_objects_by_entry(ctx, dump, fd);
+                }
+                return ret;
+            }
+            finished = true;
+        }
+        started = true;
+
+        for (uint32_t i = 0; i < count; i++) {
+            ret = emit_direct_objects(ctx, dump, dump->keys + (size_t) i * ctx->table.key_size,
+                                      dump->values + (size_t) i * ctx->table.value_size);
+            if (ret != NO_ERROR) {
+                return ret;
+            }
+        }
+        if (finished) {
+            return NO_ERROR;
+        }
+    }
+}
+
+static int dump_direct_objects_of_tuples(nikss_table_entry_ctx_t *ctx, struct direct_objects_dump *dump)
+{
+    struct ternary_table_prefix_metadata prefix_md;
+    uint32_t inner_map_id = 0;
+
+    int ret = get_ternary_table_prefix_md(ctx, &prefix_md);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+
+    char *prefix_value = malloc(ctx->prefixes.value_size);
+    if (prefix_value == NULL) {
+        return ENOMEM;
+    }
+
+    while ((ret = ternary_table_find_next_tuple(ctx, &prefix_md, prefix_value, &inner_map_id)) == NO_ERROR) {
+        int fd = bpf_map_get_fd_by_id(inner_map_id);
+        if (fd < 0) {
+            ret = errno;
+            fprintf(stderr, "failed to open tuple: %s\n", strerror(ret));
+            break;
+        }
+        /* Every entry of the tuple has the same mask */
+        dump->entry.mask = ctx->current_raw_key_mask;
+        ret = dump_direct_objects_of_map(ctx, dump, fd);
+        close_object_fd(&fd);
+        if (ret != NO_ERROR) {
+            break;
+        }
+    }
+    if (ret == ENODATA) {
+        ret = NO_ERROR;
+    }
+
+    free(prefix_value);
+    ternary_table_finish_iteration(ctx);
+
+    return ret;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_entry_ctx_dump_direct_objects(nikss_table_entry_ctx_t *ctx, nikss_table_direct_objects_cb_t cb,
+                                              void *arg)
+{
+    if (ctx == NULL || cb == NULL) {
+        return EINVAL;
+    }
+    if (ctx->n_direct_counters == 0 && ctx->n_direct_meters == 0) {
+        fprintf(stderr, "table has no direct counters nor meters\n");
+        return ENOENT;
+    }
+    if (ctx->table.key_size == 0 || ctx->table.value_size == 0 ||
+        (ctx->is_ternary ? ctx->prefixes.fd < 0 || ctx->tuple_map.fd < 0 : ctx->table.fd < 0)) {
+        fprintf(stderr, "can't read entries: table not opened\n");
+        return EBADF;
+    }
+
+    size_t token_size = ctx->table.key_size > sizeof(uint64_t) ? ctx->table.key_size : sizeof(uint64_t);
+    struct direct_objects_dump dump = {
+            .cb = cb,
+            .arg = arg,
+            .entry = {
+                    .key_size = ctx->table.key_size,
+                    .mask_size = ctx->is_ternary ? ctx->prefixes.key_size : 0,
+                    .n_counters = ctx->n_direct_counters,
+                    .n_meters = ctx->n_direct_meters,
+            },
+            .counters = calloc(ctx->n_direct_counters + 1, sizeof(nikss_direct_counter_value_t)),
+            .meters = calloc(ctx->n_direct_meters + 1, sizeof(nikss_direct_meter_value_t)),
+            .token = calloc(1, token_size),
+    };
+    int ret = NO_ERROR;
+
+    if (dump.counters == NULL || dump.meters == NULL || dump.token == NULL ||
+        reserve_direct_objects_dump(ctx, &dump, ctx->batch_size > 0 ? ctx->batch_size : TABLE_DUMP_CHUNK_SIZE) !=
+        NO_ERROR) {
+        fprintf(stderr, "not enough memory\n");
+        ret = ENOMEM;
+        goto clean_up;
+    }
+    for (size_t i = 0; i < ctx->n_direct_counters; i++) {
+        dump.counters[i].name = ctx->direct_counters_ctx[i].name;
+        dump.counters[i].type = ctx->direct_counters_ctx[i].counter_type;
+    }
+    for (size_t i = 0; i < ctx->n_direct_meters; i++) {
+        dump.meters[i].name = ctx->direct_meters_ctx[i].name;
+    }
+    dump.entry.counters = dump.counters;
+    dump.entry.meters = dump.meters;
+
+    /* Iteration of nikss_table_entry_get_next() starts again after the dump */
+    reset_table_batch_iterator(ctx);
+    if (ctx->current_raw_key != NULL) {
+        free(ctx->current_raw_key);
+    }
+    ctx->current_raw_key = NULL;
+    if (ctx->is_ternary) {
+        ternary_table_finish_iteration(ctx);
+        ret = dump_direct_objects_of_tuples(ctx, &dump);
+    } else {
+        ret = dump_direct_objects_of_map(ctx, &dump, ctx->table.fd);
+    }
+
+clean_up:
+    free(dump.counters);
+    free(dump.meters);
+    free(dump.token);
+    free(dump.keys);
+    free(dump.values);
+
+    return ret;
+}
+
 int nikss_table_entry_get_default_entry(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry)
 {
     uint32_t key_buffer = 0;
@@ -3249,8 +6823,10 @@ int nikss_table_entry_get_default_entry(nikss_table_entry_ctx_t *ctx, nikss_tabl
     }
 
     /* Prepare entry - remove everything from entry */
+    nikss_arena_t *arena = entry->arena;
     nikss_table_entry_free(entry);
     nikss_table_entry_init(entry);
+    entry->arena = arena;
 
     value_buffer = malloc(ctx->table.value_size);
     if (value_buffer == NULL) {
@@ -36,4 +36,28 @@ int parse_table_key(nikss_table_entry_ctx_t *ctx, nikss_table_entry_t *entry,
 int open_ternary_table(nikss_context_t *nikss_ctx, nikss_table_entry_ctx_t *ctx, const char *name);
 int nikss_table_entry_goto_next_key(nikss_table_entry_ctx_t *ctx);
 
+/* Resolves key/value layout from BTF; table without BTF or with unexpected layout is not compiled */
+void compile_table_codec(nikss_table_entry_ctx_t *ctx);
+void free_table_codec(nikss_table_codec_t *codec);
+
+/* Hash map of encoded keys and values, see nikss_table_entry_ctx_shadow() */
+struct nikss_table_shadow *table_shadow_create(size_t key_size, size_t value_size);
+void table_shadow_free(struct nikss_table_shadow *shadow);
+void table_shadow_clear(struct nikss_table_shadow *shadow);
+/* Returns NULL when key is not present */
+const void *table_shadow_lookup(const struct nikss_table_shadow *shadow, const void *key);
+int table_shadow_put(struct nikss_table_shadow *shadow, const void *key, const void *value);
+void table_shadow_remove(struct nikss_table_shadow *shadow, const void *key);
+
+/* Invalidates cache entries affected by change of an entry, all of them when key is NULL.
+ * key_mask is used only for ternary tables. */
+int invalidate_table_cache(nikss_table_entry_ctx_t *ctx, const void *key, const void *key_mask);
+
+/* DIR-24-8 maps of LPM table, see nikss_table_dir24.c */
+int open_table_dir24(nikss_context_t *nikss_ctx, nikss_table_entry_ctx_t *ctx, const char *name);
+/* Writes entry of the LPM trie and its leaves, value is NULL for deleted entry. Returns errno of the
+ * trie write or of the leaves update, in the latter case the previous entry of the trie is restored. */
+int write_table_dir24_entry(nikss_table_entry_ctx_t *ctx, const void *key, const void *value, uint64_t flags);
+int clear_table_dir24(nikss_table_entry_ctx_t *ctx);
+
 #endif  /* __NIKSS_TABLE_H */
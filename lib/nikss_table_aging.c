@@ -0,0 +1,343 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <bpf/bpf.h>
+#include <errno.h>
+#include <linux/bpf.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <nikss/nikss.h>
+
+#include "common.h"
+#include "nikss_table.h"
+
+#define TABLE_AGING_DEFAULT_SLICE_SIZE 4096
+
+/* Value of records, followed by the activity signature */
+struct table_aging_record {
+    /* when the signature was seen changed for the last time */
+    uint64_t last_change_ns;
+};
+
+struct nikss_table_aging {
+    uint64_t idle_timeout_ns;
+    uint32_t slice_size;
+    nikss_table_aging_expiry_cb_t cb;
+    void *cb_arg;
+
+    /* Bytes of value which are changed by a match: last_hit or the first direct counter */
+    size_t signature_offset;
+    size_t signature_size;
+
+    /* Records from the previous pass are looked up, records of visited entries are stored for the next
+     * one, so records of entries removed by other means are dropped when a pass is finished. */
+    struct nikss_table_shadow *records;
+    struct nikss_table_shadow *next_records;
+    char *record_buffer;
+
+    /* Position in the table between steps */
+    bool pass_started;
+    bool batch_not_supported;
+    char *in_token;
+    char *out_token;
+    size_t token_size;
+    char *last_key;
+    bool has_last_key;
+
+    /* Buffers for a single slice */
+    char *keys;
+    char *values;
+    char *expired_keys;
+    uint64_t *expired_idle_ns;
+};
+
+static uint64_t aging_timestamp(void)
+{
+    /* bpf_ktime_get_ns() uses the same clock */
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static void free_table_aging(struct nikss_table_aging *aging)
+{
+    if (aging == NULL) {
+        return;
+    }
+    table_shadow_free(aging->records);
+    table_shadow_free(aging->next_records);
+    free(aging->record_buffer);
+    free(aging->in_token);
+    free(aging->out_token);
+    free(aging->last_key);
+    free(aging->keys);
+    free(aging->values);
+    free(aging->expired_keys);
+    free(aging->expired_idle_ns);
+    free(aging);
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_entry_ctx_aging_start(nikss_table_entry_ctx_t *ctx, uint64_t idle_timeout_ns, uint32_t slice_size,
+                                      nikss_table_aging_expiry_cb_t cb, void *arg)
+{
+    if (ctx == NULL || idle_timeout_ns == 0) {
+        return EINVAL;
+    }
+    if (ctx->aging != NULL) {
+        return EEXIST;
+    }
+    if (ctx->table.fd < 0) {
+        return EBADF;
+    }
+
+    /* Only exact match tables are aged, other map types can't be iterated with deletes in between */
+    if (ctx->is_ternary || (ctx->table.type != BPF_MAP_TYPE_HASH && ctx->table.type != BPF_MAP_TYPE_LRU_HASH)) {
+        fprintf(stderr, "aging is supported only for exact match tables\n");
+        return ENOTSUP;
+    }
+    if (!ctx->has_last_hit && ctx->n_direct_counters == 0) {
+        fprintf(stderr, "table has no last_hit timestamp nor direct counter\n");
+        return ENOTSUP;
+    }
+
+    struct nikss_table_aging *aging = calloc(1, sizeof(struct nikss_table_aging));
+    if (aging == NULL) {
+        return ENOMEM;
+    }
+    aging->idle_timeout_ns = idle_timeout_ns;
+    aging->slice_size = slice_size > 0 ? slice_size : TABLE_AGING_DEFAULT_SLICE_SIZE;
+    aging->cb = cb;
+    aging->cb_arg = arg;
+
+    if (ctx->has_last_hit) {
+        aging->signature_offset = ctx->last_hit_offset;
+        aging->signature_size = sizeof(uint64_t);
+    } else {
+        aging->signature_offset = ctx->direct_counters_ctx[0].counter_offset;
+        aging->signature_size = ctx->direct_counters_ctx[0].counter_size;
+    }
+    if (aging->signature_offset + aging->signature_size > ctx->table.value_size) {
+        free_table_aging(aging);
+        return EINVAL;
+    }
+
+    size_t record_size = sizeof(struct table_aging_record) + aging->signature_size;
+    /* For hash maps batch token is a bucket number */
+    aging->token_size = ctx->table.key_size > sizeof(uint64_t) ? ctx->table.key_size : sizeof(uint64_t);
+    aging->records = table_shadow_create(ctx->table.key_size, record_size);
+    aging->next_records = table_shadow_create(ctx->table.key_size, record_size);
+    aging->record_buffer = malloc(record_size);
+    aging->in_token = calloc(1, aging->token_size);
+    aging->out_token = calloc(1, aging->token_size);
+    aging->last_key = malloc(ctx->table.key_size);
+    aging->keys = malloc((size_t) aging->slice_size * ctx->table.key_size);
+    aging->values = malloc((size_t) aging->slice_size * ctx->table.value_size);
+    aging->expired_keys = malloc((size_t) aging->slice_size * ctx->table.key_size);
+    aging->expired_idle_ns = malloc(aging->slice_size * sizeof(uint64_t));
+    if (aging->records == NULL || aging->next_records == NULL || aging->record_buffer == NULL ||
+        aging->in_token == NULL || aging->out_token == NULL || aging->last_key == NULL || aging->keys == NULL ||
+        aging->values == NULL || aging->expired_keys == NULL || aging->expired_idle_ns == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        free_table_aging(aging);
+        return ENOMEM;
+    }
+
+    ctx->aging = aging;
+
+    return NO_ERROR;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+void nikss_table_entry_ctx_aging_stop(nikss_table_entry_ctx_t *ctx)
+{
+    if (ctx == NULL) {
+        return;
+    }
+    free_table_aging(ctx->aging);
+    ctx->aging = NULL;
+}
+
+/* Reads the next slice of the table, returns ENOENT as the last slice of a pass */
+static int read_aging_slice(nikss_table_entry_ctx_t *ctx, struct nikss_table_aging *aging, uint32_t *count)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = 0,
+                        .flags = 0,
+    );
+
+    if (aging->batch_not_supported == false) {
+        *count = aging->slice_size;
+        int err = bpf_map_lookup_batch(ctx->table.fd, aging->pass_started ? aging->in_token : NULL,
+                                       aging->out_token, aging->keys, aging->values, count, &opts);
+        if (err != 0) {
+            err = errno;
+        }
+        if (err == NO_ERROR || err == ENOENT) {
+            memcpy(aging->in_token, aging->out_token, aging->token_size);
+            aging->pass_started = true;
+            return err;
+        }
+        if (aging->pass_started || (err != EINVAL && err != ENOTSUP)) {
+            return err;
+        }
+        fprintf(stderr, "batch operations not supported, falling back to per-element mode\n");
+        aging->batch_not_supported = true;
+    }
+
+    *count = 0;
+    while (*count < aging->slice_size) {
+        char *key = aging->keys + (size_t) *count * ctx->table.key_size;
+        if (bpf_map_get_next_key(ctx->table.fd, aging->has_last_key ? aging->last_key : NULL, key) != 0) {
+            aging->has_last_key = false;
+            return ENOENT;
+        }
+        memcpy(aging->last_key, key, ctx->table.key_size);
+        aging->has_last_key = true;
+        /* Entry removed in the meantime is skipped */
+        if (bpf_map_lookup_elem(ctx->table.fd, key, aging->values + (size_t) *count * ctx->table.value_size) == 0) {
+            *count += 1;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+/* Time of the last activity of an entry, records the signature for the next pass */
+static uint64_t get_entry_last_activity(nikss_table_entry_ctx_t *ctx, struct nikss_table_aging *aging,
+                                        const char *key, const char *value, uint64_t now)
+{
+    const char *signature = value + aging->signature_offset;
+    if (ctx->has_last_hit) {
+        uint64_t last_hit = 0;
+        memcpy(&last_hit, signature, sizeof(last_hit));
+        /* Entries written without the library are aged from the time they are found */
+        if (last_hit != 0) {
+            return last_hit;
+        }
+    }
+
+    struct table_aging_record *record = (struct table_aging_record *) aging->record_buffer;
+    const char *previous = table_shadow_lookup(aging->records, key);
+    if (previous != NULL &&
+        memcmp(previous + sizeof(struct table_aging_record), signature, aging->signature_size) == 0) {
+        memcpy(record, previous, sizeof(struct table_aging_record));
+    } else {
+        record->last_change_ns = now;
+    }
+    memcpy(aging->record_buffer + sizeof(struct table_aging_record), signature, aging->signature_size);
+    if (table_shadow_put(aging->next_records, key, aging->record_buffer) != NO_ERROR) {
+        /* Entry is aged again from now in the next pass */
+        fprintf(stderr, "not enough memory for aging record\n");
+    }
+
+    return record->last_change_ns;
+}
+
+static void remove_expired_entries(nikss_table_entry_ctx_t *ctx, struct nikss_table_aging *aging, uint32_t n_expired)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = 0,
+                        .flags = 0,
+    );
+
+    uint32_t count = n_expired;
+    if (bpf_map_delete_batch(ctx->table.fd, aging->expired_keys, &count, &opts) != 0) {
+        /* Entries removed in the meantime stop batch with ENOENT, so the rest is removed one by one */
+        for (uint32_t i = count < n_expired ? count : 0; i < n_expired; i++) {
+            bpf_map_delete_elem(ctx->table.fd, aging->expired_keys + (size_t) i * ctx->table.key_size);
+        }
+    }
+
+    for (uint32_t i = 0; i < n_expired; i++) {
+        const char *key = aging->expired_keys + (size_t) i * ctx->table.key_size;
+        table_shadow_remove(aging->next_records, key);
+        if (aging->cb != NULL) {
+            aging->cb(key, ctx->table.key_size, aging->expired_idle_ns[i], aging->cb_arg);
+        }
+    }
+
+    int ret = invalidate_table_cache(ctx, NULL, NULL);
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to clear cache: %s\n", strerror(ret));
+    }
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_entry_ctx_aging_step(nikss_table_entry_ctx_t *ctx, nikss_table_aging_stats_t *stats)
+{
+    if (ctx == NULL || ctx->aging == NULL) {
+        return EINVAL;
+    }
+    struct nikss_table_aging *aging = ctx->aging;
+    nikss_table_aging_stats_t step_stats = {0};
+
+    uint32_t count = 0;
+    int ret = read_aging_slice(ctx, aging, &count);
+    if (ret != NO_ERROR && ret != ENOENT) {
+        fprintf(stderr, "failed to read table: %s\n", strerror(ret));
+        return ret;
+    }
+    step_stats.pass_finished = ret == ENOENT;
+
+    uint64_t now = aging_timestamp();
+    uint32_t n_expired = 0;
+    const char *last_kept_key = NULL;
+    for (uint32_t i = 0; i < count; i++) {
+        const char *key = aging->keys + (size_t) i * ctx->table.key_size;
+        const char *value = aging->values + (size_t) i * ctx->table.value_size;
+        uint64_t last_activity = get_entry_last_activity(ctx, aging, key, value, now);
+        if (last_activity > now || now - last_activity < aging->idle_timeout_ns) {
+            last_kept_key = key;
+            continue;
+        }
+        memcpy(aging->expired_keys + (size_t) n_expired * ctx->table.key_size, key, ctx->table.key_size);
+        aging->expired_idle_ns[n_expired] = now - last_activity;
+        n_expired++;
+    }
+    step_stats.scanned = count;
+    step_stats.expired = n_expired;
+
+    if (n_expired > 0) {
+        remove_expired_entries(ctx, aging, n_expired);
+        /* Iteration can't continue from removed key, without any kept key it starts from the beginning */
+        if (aging->batch_not_supported && aging->has_last_key) {
+            aging->has_last_key = last_kept_key != NULL;
+            if (last_kept_key != NULL) {
+                memcpy(aging->last_key, last_kept_key, ctx->table.key_size);
+            }
+        }
+    }
+
+    if (step_stats.pass_finished) {
+        struct nikss_table_shadow *tmp = aging->records;
+        aging->records = aging->next_records;
+        aging->next_records = tmp;
+        table_shadow_clear(aging->next_records);
+        aging->pass_started = false;
+    }
+
+    if (stats != NULL) {
+        *stats = step_stats;
+    }
+
+    return NO_ERROR;
+}
@@ -0,0 +1,393 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <nikss/nikss.h>
+
+#include "common.h"
+#include "nikss_table.h"
+
+#define TABLE_ASYNC_DEFAULT_MAX_BATCH 1024
+
+struct table_async_request {
+    nikss_table_entry_t entry;
+    nikss_table_async_op_t op;
+    uint64_t cookie;
+};
+
+struct table_async_queue {
+    struct table_async_request *requests;
+    size_t n_requests;
+    size_t capacity;
+};
+
+struct nikss_table_async {
+    /* Clone of the context used only by the worker */
+    nikss_table_entry_ctx_t worker_ctx;
+    pthread_t worker;
+    uint32_t max_batch;
+
+    pthread_mutex_t lock;
+    /* Signalled when requests are submitted or worker has to stop */
+    pthread_cond_t submitted;
+    /* Signalled when requests are completed */
+    pthread_cond_t completed;
+
+    struct table_async_queue pending;
+    /* Submitted, but not yet completed */
+    size_t n_in_flight;
+    bool stopping;
+
+    /* Room for completions of all requests in flight is reserved on submit, so results are never lost */
+    nikss_table_async_completion_t *completions;
+    size_t n_completions;
+    size_t completions_capacity;
+    int event_fd;
+};
+
+static void free_async_queue(struct table_async_queue *queue)
+{
+    for (size_t i = 0; i < queue->n_requests; i++) {
+        nikss_table_entry_free(&queue->requests[i].entry);
+    }
+    if (queue->requests != NULL) {
+        free(queue->requests);
+    }
+    memset(queue, 0, sizeof(struct table_async_queue));
+}
+
+static int reserve_completions(struct nikss_table_async *async, size_t n)
+{
+    if (async->n_completions + n <= async->completions_capacity) {
+        return NO_ERROR;
+    }
+
+    size_t new_capacity = async->completions_capacity == 0 ? 64 : async->completions_capacity;
+    while (new_capacity < async->n_completions + n) {
+        new_capacity *= 2;
+    }
+    nikss_table_async_completion_t *completions =
+            realloc(async->completions, new_capacity * sizeof(nikss_table_async_completion_t));
+    if (completions == NULL) {
+        return ENOMEM;
+    }
+    async->completions = completions;
+    async->completions_capacity = new_capacity;
+
+    return NO_ERROR;
+}
+
+static int write_async_batch(nikss_table_entry_ctx_t *ctx, nikss_table_async_op_t op,
+                             nikss_table_entry_batch_t *batch)
+{
+    switch (op) {
+        case NIKSS_TABLE_ASYNC_ADD:
+            return nikss_table_entry_batch_add(ctx, batch);
+        case NIKSS_TABLE_ASYNC_UPDATE:
+            return nikss_table_entry_batch_update(ctx, batch);
+        case NIKSS_TABLE_ASYNC_DELETE:
+            return nikss_table_entry_batch_del(ctx, batch);
+        default:
+            return EINVAL;
+    }
+}
+
+/* Writes requests[0..n) which have the same type and stores their results in the completion queue */
+static void complete_async_requests(struct nikss_table_async *async, struct table_async_request *requests, size_t n)
+{
+    nikss_table_entry_batch_t batch;
+    int batch_ret = NO_ERROR;
+
+    nikss_table_entry_batch_init(&batch);
+    for (size_t i = 0; i < n && batch_ret == NO_ERROR; i++) {
+        batch_ret = nikss_table_entry_batch_append(&batch, &requests[i].entry);
+    }
+    if (batch_ret == NO_ERROR) {
+        /* Results of every entry are in the batch, so returned value is not needed */
+        write_async_batch(&async->worker_ctx, requests[0].op, &batch);
+    }
+
+    pthread_mutex_lock(&async->lock);
+    for (size_t i = 0; i < n; i++) {
+        nikss_table_async_completion_t *completion = &async->completions[async->n_completions++];
+        completion->cookie = requests[i].cookie;
+        completion->op = requests[i].op;
+        completion->result = batch_ret != NO_ERROR ? batch_ret : nikss_table_entry_batch_get_result(&batch, i);
+    }
+    async->n_in_flight -= n;
+
+    /* eventfd is non-zero as long as there are completions, so keep it in sync with the queue */
+    uint64_t one = 1;
+    if (async->n_completions > 0 && write(async->event_fd, &one, sizeof(one)) < 0) {
+        fprintf(stderr, "failed to signal completion of table writes: %s\n", strerror(errno));
+    }
+    pthread_cond_broadcast(&async->completed);
+    pthread_mutex_unlock(&async->lock);
+
+    for (size_t i = 0; i < n; i++) {
+        nikss_table_entry_free(&requests[i].entry);
+    }
+    nikss_table_entry_batch_free(&batch);
+}
+
+static void *table_async_worker(void *arg)
+{
+    struct nikss_table_async *async = arg;
+    struct table_async_queue queue;
+
+    memset(&queue, 0, sizeof(queue));
+
+    while (true) {
+        pthread_mutex_lock(&async->lock);
+        while (async->pending.n_requests == 0 && !async->stopping) {
+            pthread_cond_wait(&async->submitted, &async->lock);
+        }
+        if (async->pending.n_requests == 0) {
+            pthread_mutex_unlock(&async->lock);
+            break;
+        }
+
+        /* Take all pending requests at once, so new ones can be submitted in the meantime */
+        struct table_async_queue taken = async->pending;
+        async->pending = queue;
+        pthread_mutex_unlock(&async->lock);
+
+        /* Consecutive requests of the same type are written together, order of requests is kept */
+        size_t first = 0;
+        while (first < taken.n_requests) {
+            size_t last = first + 1;
+            while (last < taken.n_requests && last - first < async->max_batch &&
+                   taken.requests[last].op == taken.requests[first].op) {
+                last++;
+            }
+            complete_async_requests(async, &taken.requests[first], last - first);
+            first = last;
+        }
+
+        /* Reuse memory of the taken queue for the next swap */
+        taken.n_requests = 0;
+        queue = taken;
+    }
+
+    free_async_queue(&queue);
+
+    return NULL;
+}
+
+static void free_table_async(struct nikss_table_async *async)
+{
+    nikss_table_entry_ctx_free(&async->worker_ctx);
+    free_async_queue(&async->pending);
+    if (async->completions != NULL) {
+        free(async->completions);
+    }
+    close_object_fd(&async->event_fd);
+    pthread_cond_destroy(&async->completed);
+    pthread_cond_destroy(&async->submitted);
+    pthread_mutex_destroy(&async->lock);
+    free(async);
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_entry_ctx_async_start(nikss_table_entry_ctx_t *ctx, uint32_t max_batch)
+{
+    if (ctx == NULL) {
+        return EINVAL;
+    }
+    if (ctx->async != NULL) {
+        return EALREADY;
+    }
+
+    struct nikss_table_async *async = calloc(1, sizeof(struct nikss_table_async));
+    if (async == NULL) {
+        return ENOMEM;
+    }
+    pthread_mutex_init(&async->lock, NULL);
+    pthread_cond_init(&async->submitted, NULL);
+    pthread_cond_init(&async->completed, NULL);
+    async->max_batch = max_batch != 0 ? max_batch : TABLE_ASYNC_DEFAULT_MAX_BATCH;
+    nikss_table_entry_ctx_init(&async->worker_ctx);
+
+    async->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (async->event_fd < 0) {
+        int err = errno;
+        fprintf(stderr, "failed to create eventfd: %s\n", strerror(err));
+        free_table_async(async);
+        return err;
+    }
+
+    /* Writes from the worker and from the caller may happen at the same time */
+    ctx->thread_safe = true;
+    int ret = nikss_table_entry_ctx_clone(&async->worker_ctx, ctx);
+    if (ret != NO_ERROR) {
+        nikss_table_entry_ctx_init(&async->worker_ctx);
+        free_table_async(async);
+        return ret;
+    }
+
+    ret = pthread_create(&async->worker, NULL, table_async_worker, async);
+    if (ret != 0) {
+        fprintf(stderr, "failed to start worker of table writes: %s\n", strerror(ret));
+        free_table_async(async);
+        return ret;
+    }
+
+    ctx->async = async;
+
+    return NO_ERROR;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_entry_ctx_async_fd(nikss_table_entry_ctx_t *ctx)
+{
+    if (ctx == NULL || ctx->async == NULL) {
+        return -1;
+    }
+    return ctx->async->event_fd;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_entry_async_submit(nikss_table_entry_ctx_t *ctx, nikss_table_async_op_t op,
+                                   nikss_table_entry_t *entry, uint64_t cookie)
+{
+    if (ctx == NULL || entry == NULL || ctx->async == NULL) {
+        return EINVAL;
+    }
+    if (op != NIKSS_TABLE_ASYNC_ADD && op != NIKSS_TABLE_ASYNC_UPDATE && op != NIKSS_TABLE_ASYNC_DELETE) {
+        return EINVAL;
+    }
+    /* Arena may be reset by the caller before entry is written */
+    if (entry->arena != NULL) {
+        return EINVAL;
+    }
+
+    struct nikss_table_async *async = ctx->async;
+    struct table_async_queue *queue = &async->pending;
+    int ret = NO_ERROR;
+
+    pthread_mutex_lock(&async->lock);
+    if (async->stopping) {
+        ret = ESHUTDOWN;
+        goto clean_up;
+    }
+
+    ret = reserve_completions(async, async->n_in_flight + 1);
+    if (ret != NO_ERROR) {
+        goto clean_up;
+    }
+
+    if (queue->n_requests >= queue->capacity) {
+        size_t new_capacity = queue->capacity == 0 ? 64 : queue->capacity * 2;
+        struct table_async_request *requests =
+                realloc(queue->requests, new_capacity * sizeof(struct table_async_request));
+        if (requests == NULL) {
+            ret = ENOMEM;
+            goto clean_up;
+        }
+        queue->requests = requests;
+        queue->capacity = new_capacity;
+    }
+
+    /* stole data from entry, so it can be reused by caller */
+    struct table_async_request *request = &queue->requests[queue->n_requests++];
+    memcpy(&request->entry, entry, sizeof(nikss_table_entry_t));
+    request->op = op;
+    request->cookie = cookie;
+    nikss_table_entry_init(entry);
+
+    async->n_in_flight++;
+    pthread_cond_signal(&async->submitted);
+
+clean_up:
+    pthread_mutex_unlock(&async->lock);
+
+    return ret;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+size_t nikss_table_entry_async_poll(nikss_table_entry_ctx_t *ctx, nikss_table_async_completion_t *completions,
+                                    size_t max)
+{
+    if (ctx == NULL || ctx->async == NULL || completions == NULL) {
+        return 0;
+    }
+
+    struct nikss_table_async *async = ctx->async;
+
+    pthread_mutex_lock(&async->lock);
+    size_t n = async->n_completions < max ? async->n_completions : max;
+    memcpy(completions, async->completions, n * sizeof(nikss_table_async_completion_t));
+    async->n_completions -= n;
+    memmove(async->completions, async->completions + n,
+            async->n_completions * sizeof(nikss_table_async_completion_t));
+
+    if (async->n_completions == 0) {
+        /* Reset counter of eventfd, so it is not readable until the next completion */
+        uint64_t value = 0;
+        if (read(async->event_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+            fprintf(stderr, "failed to read eventfd: %s\n", strerror(errno));
+        }
+    }
+    pthread_mutex_unlock(&async->lock);
+
+    return n;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_entry_ctx_async_flush(nikss_table_entry_ctx_t *ctx)
+{
+    if (ctx == NULL || ctx->async == NULL) {
+        return EINVAL;
+    }
+
+    struct nikss_table_async *async = ctx->async;
+
+    pthread_mutex_lock(&async->lock);
+    while (async->n_in_flight > 0) {
+        pthread_cond_wait(&async->completed, &async->lock);
+    }
+    pthread_mutex_unlock(&async->lock);
+
+    return NO_ERROR;
+}
+
+void nikss_table_entry_ctx_async_stop(nikss_table_entry_ctx_t *ctx)
+{
+    if (ctx == NULL || ctx->async == NULL) {
+        return;
+    }
+
+    struct nikss_table_async *async = ctx->async;
+
+    /* Worker exits when the queue is empty */
+    pthread_mutex_lock(&async->lock);
+    async->stopping = true;
+    pthread_cond_signal(&async->submitted);
+    pthread_mutex_unlock(&async->lock);
+    pthread_join(async->worker, NULL);
+
+    free_table_async(async);
+    ctx->async = NULL;
+}
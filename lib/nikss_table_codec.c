@@ -0,0 +1,310 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <bpf/btf.h>
+#include <errno.h>
+#include <linux/bpf.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nikss/nikss.h>
+
+#include "btf.h"
+#include "nikss_table.h"
+
+static void free_key_codec(nikss_table_codec_t *codec)
+{
+    if (codec->key_fields != NULL) {
+        free(codec->key_fields);
+    }
+    codec->key_fields = NULL;
+    codec->n_key_fields = 0;
+    codec->has_lpm_prefix = false;
+    codec->key_compiled = false;
+}
+
+static void free_value_codec(nikss_table_codec_t *codec)
+{
+    if (codec->actions != NULL) {
+        for (size_t i = 0; i < codec->n_actions; i++) {
+            if (codec->actions[i].params != NULL) {
+                free(codec->actions[i].params);
+            }
+        }
+        free(codec->actions);
+    }
+    codec->actions = NULL;
+    codec->n_actions = 0;
+    codec->has_action_id = false;
+    codec->has_priority = false;
+    codec->value_compiled = false;
+}
+
+static void free_cache_key_codec(nikss_table_codec_t *codec)
+{
+    if (codec->cache_key_fields != NULL) {
+        free(codec->cache_key_fields);
+    }
+    codec->cache_key_fields = NULL;
+    codec->n_cache_key_fields = 0;
+    codec->cache_key_compiled = false;
+}
+
+void free_table_codec(nikss_table_codec_t *codec)
+{
+    free_key_codec(codec);
+    free_value_codec(codec);
+    free_cache_key_codec(codec);
+}
+
+static void set_codec_field(nikss_table_codec_field_t *field, struct btf *btf, size_t offset, uint32_t type_id)
+{
+    field->offset = offset;
+    field->size = btf_get_type_size_by_id(btf, type_id);
+    /* P4C-ebpf compiler does not change byte order for fields with size over 64 bits */
+    field->network_order = field->size > 8;
+    field->match_kind = NIKSS_EXACT;
+}
+
+static bool is_dummy_key(struct btf *btf, const struct btf_type *key_type)
+{
+    if (btf_vlen(key_type) != 1) {
+        return false;
+    }
+
+    const char *name = btf__name_by_offset(btf, btf_members(key_type)->name_off);
+    return name != NULL && strcmp(name, "__dummy_table_key") == 0;
+}
+
+static int compile_key_codec(nikss_table_entry_ctx_t *ctx, nikss_table_codec_t *codec)
+{
+    struct btf *btf = ctx->btf_metadata.btf;
+    const struct btf_type *key_type = btf_get_type_by_id(btf, ctx->table.key_type_id);
+    if (key_type == NULL || btf_kind(key_type) != BTF_KIND_STRUCT) {
+        return ENOTSUP;  /* non-struct keys are cheap to encode anyway */
+    }
+
+    if (is_dummy_key(btf, key_type)) {
+        /* Table do not define key, all bytes stays zeroed */
+        codec->key_compiled = true;
+        return NO_ERROR;
+    }
+
+    unsigned entries = btf_vlen(key_type);
+    unsigned first_field = 0;
+    const struct btf_member *member = btf_members(key_type);
+
+    if (ctx->table.type == BPF_MAP_TYPE_LPM_TRIE) {
+        if (entries < 1) {
+            return EINVAL;
+        }
+        set_codec_field(&codec->lpm_prefix, btf, btf_member_bit_offset(key_type, 0) / 8, member->type);
+        codec->lpm_prefix.network_order = false;
+        codec->has_lpm_prefix = true;
+        first_field = 1;
+    }
+
+    codec->n_key_fields = entries - first_field;
+    if (codec->n_key_fields == 0) {
+        codec->key_compiled = true;
+        return NO_ERROR;
+    }
+
+    codec->key_fields = calloc(codec->n_key_fields, sizeof(nikss_table_codec_field_t));
+    if (codec->key_fields == NULL) {
+        return ENOMEM;
+    }
+
+    for (unsigned i = first_field; i < entries; i++) {
+        nikss_table_codec_field_t *field = &codec->key_fields[i - first_field];
+        /* assume that every field is byte aligned */
+        set_codec_field(field, btf, btf_member_bit_offset(key_type, i) / 8, member[i].type);
+        if (field->offset + field->size > ctx->table.key_size) {
+            return EINVAL;
+        }
+
+        if (ctx->is_ternary) {
+            field->match_kind = NIKSS_TERNARY;
+        } else if (ctx->table.type == BPF_MAP_TYPE_LPM_TRIE && i + 1 == entries) {
+            /* Last field is lpm, others are exact. */
+            field->match_kind = NIKSS_LPM;
+        }
+    }
+
+    codec->key_compiled = true;
+
+    return NO_ERROR;
+}
+
+static int compile_action_codec(struct btf *btf, size_t base_offset, uint32_t action_type_id,
+                                size_t value_size, nikss_table_codec_action_t *action)
+{
+    const struct btf_type *action_type = btf_get_type_by_id(btf, action_type_id);
+    if (action_type == NULL || !btf_is_struct(action_type)) {
+        return EINVAL;
+    }
+
+    action->n_params = btf_vlen(action_type);
+    if (action->n_params == 0) {
+        return NO_ERROR;
+    }
+
+    action->params = calloc(action->n_params, sizeof(nikss_table_codec_field_t));
+    if (action->params == NULL) {
+        return ENOMEM;
+    }
+
+    for (unsigned i = 0; i < action->n_params; i++) {
+        btf_struct_member_md_t param_md = {};
+        if (btf_get_member_md_by_index(btf, action_type_id, i, &param_md) != NO_ERROR) {
+            return EINVAL;
+        }
+        set_codec_field(&action->params[i], btf, base_offset + param_md.bit_offset / 8, param_md.effective_type_id);
+        if (action->params[i].offset + action->params[i].size > value_size) {
+            return EINVAL;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+static int compile_value_codec(nikss_table_entry_ctx_t *ctx, nikss_table_codec_t *codec)
+{
+    struct btf *btf = ctx->btf_metadata.btf;
+    uint32_t value_type_id = ctx->table.value_type_id;
+    const struct btf_type *value_type = btf_get_type_by_id(btf, value_type_id);
+    if (value_type == NULL || btf_kind(value_type) != BTF_KIND_STRUCT) {
+        return ENOTSUP;
+    }
+
+    btf_struct_member_md_t md = {};
+    if (btf_get_member_md_by_name(btf, value_type_id, "action", &md) == NO_ERROR) {
+        set_codec_field(&codec->action_id, btf, md.bit_offset / 8, md.effective_type_id);
+        codec->has_action_id = codec->action_id.size <= sizeof(uint32_t);
+    }
+
+    if (btf_get_member_md_by_name(btf, value_type_id, "priority", &md) == NO_ERROR) {
+        set_codec_field(&codec->priority, btf, md.bit_offset / 8, md.effective_type_id);
+        codec->has_priority = codec->priority.size <= sizeof(uint32_t);
+    }
+
+    btf_struct_member_md_t union_md = {};
+    if (btf_get_member_md_by_name(btf, value_type_id, "u", &union_md) == NO_ERROR) {
+        const struct btf_type *union_type = btf_get_type_by_id(btf, union_md.effective_type_id);
+        if (union_type == NULL) {
+            return EINVAL;
+        }
+
+        codec->n_actions = btf_vlen(union_type);
+        codec->actions = calloc(codec->n_actions, sizeof(nikss_table_codec_action_t));
+        if (codec->actions == NULL && codec->n_actions > 0) {
+            return ENOMEM;
+        }
+
+        for (unsigned i = 0; i < codec->n_actions; i++) {
+            btf_struct_member_md_t action_md = {};
+            if (btf_get_member_md_by_index(btf, union_md.effective_type_id, i, &action_md) != NO_ERROR) {
+                return EINVAL;
+            }
+            size_t base_offset = (union_md.bit_offset + action_md.bit_offset) / 8;
+            int ret = compile_action_codec(btf, base_offset, action_md.effective_type_id,
+                                           ctx->table.value_size, &codec->actions[i]);
+            if (ret != NO_ERROR) {
+                return ret;
+            }
+        }
+    }
+
+    codec->value_compiled = true;
+
+    return NO_ERROR;
+}
+
+/* Cache is indexed by the packet key, its fields are found in the table key by name */
+static int compile_cache_key_codec(nikss_table_entry_ctx_t *ctx, nikss_table_codec_t *codec)
+{
+    struct btf *btf = ctx->btf_metadata.btf;
+    const struct btf_type *cache_key_type = btf_get_type_by_id(btf, ctx->cache.key_type_id);
+    if (cache_key_type == NULL || btf_kind(cache_key_type) != BTF_KIND_STRUCT) {
+        return ENOTSUP;
+    }
+
+    unsigned entries = btf_vlen(cache_key_type);
+    const struct btf_member *member = btf_members(cache_key_type);
+    if (entries > 0) {
+        codec->cache_key_fields = calloc(entries, sizeof(nikss_table_codec_cache_field_t));
+        if (codec->cache_key_fields == NULL) {
+            return ENOMEM;
+        }
+    }
+
+    for (unsigned i = 0; i < entries; i++) {
+        const char *name = btf__name_by_offset(btf, member[i].name_off);
+        if (name == NULL) {
+            return EINVAL;
+        }
+        /* Prefix length of LPM key does not select packets */
+        if (strcmp(name, "prefixlen") == 0) {
+            continue;
+        }
+
+        btf_struct_member_md_t key_md = {};
+        if (btf_get_member_md_by_name(btf, ctx->table.key_type_id, name, &key_md) != NO_ERROR) {
+            return ENOENT;
+        }
+
+        nikss_table_codec_cache_field_t *field = &codec->cache_key_fields[codec->n_cache_key_fields];
+        field->cache_offset = btf_member_bit_offset(cache_key_type, i) / 8;
+        field->key_offset = key_md.bit_offset / 8;
+        field->size = btf_get_type_size_by_id(btf, member[i].type);
+        if (field->size != btf_get_type_size_by_id(btf, key_md.effective_type_id) ||
+            field->cache_offset + field->size > ctx->cache.key_size ||
+            field->key_offset + field->size > ctx->table.key_size) {
+            return EINVAL;
+        }
+        codec->n_cache_key_fields += 1;
+    }
+
+    codec->cache_key_compiled = true;
+
+    return NO_ERROR;
+}
+
+void compile_table_codec(nikss_table_entry_ctx_t *ctx)
+{
+    free_table_codec(&ctx->codec);
+
+    if (ctx->btf_metadata.btf == NULL) {
+        return;
+    }
+
+    /* Errors are not fatal, encoding and decoding falls back to walking BTF */
+    nikss_table_codec_t *codec = &ctx->codec;
+    if (ctx->table.key_type_id != 0 && compile_key_codec(ctx, codec) != NO_ERROR) {
+        free_key_codec(codec);
+    }
+
+    if (ctx->table.value_type_id != 0 && compile_value_codec(ctx, codec) != NO_ERROR) {
+        free_value_codec(codec);
+    }
+
+    /* Without it, the whole cache is cleared on every change */
+    if (ctx->cache.fd >= 0 && ctx->cache.key_type_id != 0 && ctx->table.key_type_id != 0 &&
+        compile_cache_key_codec(ctx, codec) != NO_ERROR) {
+        free_cache_key_codec(codec);
+    }
+}
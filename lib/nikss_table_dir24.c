@@ -0,0 +1,590 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * DIR-24-8 acceleration of LPM tables with a single 32-bit field. Next to the LPM trie the program defines:
+ *  - <table>_dir24: array of 2^24 leaves indexed by the first 24 bits of address,
+ *  - <table>_dir24_tbl8: hash map of leaves indexed by the whole address (in host byte order), used only for
+ *    addresses whose /24 is covered by a prefix longer than 24 bits (DIR24_LEAF_EXT is set in <table>_dir24),
+ *  - <table>_dir24_routes: hash map with the same key and value as the table, key masked to its prefix length.
+ * A leaf stores the length of the longest prefix matching its addresses, so the data plane finds a route
+ * with at most three lookups of fixed cost: leaf, then value from routes with the key masked to that length.
+ * The LPM trie remains the source of truth for reads; leaves are updated incrementally on every change,
+ * together with the trie under the pipeline lock.
+ */
+
+#include <bpf/bpf.h>
+#include <errno.h>
+#include <linux/bpf.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nikss/nikss.h>
+
+#include "btf.h"
+#include "common.h"
+#include "nikss_table.h"
+
+#define DIR24_LEAF_VALID       (1U << 31)
+#define DIR24_LEAF_EXT         (1U << 30)
+#define DIR24_LEAF_DEPTH_MASK  0x3FU
+
+#define DIR24_TBL24_ENTRIES    (1U << 24)
+#define DIR24_GROUP_SIZE       256U
+/* number of leaves of <table>_dir24 read and written at once */
+#define DIR24_CHUNK_SIZE       65536U
+
+/* prefix length and address of single field LPM key */
+struct dir24_route {
+    uint32_t depth;
+    uint32_t addr;
+};
+
+static int open_dir24_map(nikss_context_t *nikss_ctx, nikss_table_entry_ctx_t *ctx, const char *table_name,
+                          const char *suffix, nikss_bpf_map_descriptor_t *md)
+{
+    char map_name[256];
+    snprintf(map_name, sizeof(map_name), "%s%s", table_name, suffix);
+    return open_bpf_map(nikss_ctx, map_name, &ctx->btf_metadata, md);
+}
+
+static void close_table_dir24(nikss_table_entry_ctx_t *ctx)
+{
+    close_object_fd(&(ctx->dir24.fd));
+    close_object_fd(&(ctx->dir24_tbl8.fd));
+    close_object_fd(&(ctx->dir24_routes.fd));
+}
+
+int open_table_dir24(nikss_context_t *nikss_ctx, nikss_table_entry_ctx_t *ctx, const char *name)
+{
+    if (ctx->table.type != BPF_MAP_TYPE_LPM_TRIE || ctx->is_ternary) {
+        return ENOENT;
+    }
+
+    int ret = open_dir24_map(nikss_ctx, ctx, name, "_dir24", &ctx->dir24);
+    if (ret != NO_ERROR) {
+        return ret;
+    }
+    ret = open_dir24_map(nikss_ctx, ctx, name, "_dir24_tbl8", &ctx->dir24_tbl8);
+    if (ret == NO_ERROR) {
+        ret = open_dir24_map(nikss_ctx, ctx, name, "_dir24_routes", &ctx->dir24_routes);
+    }
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "warning: incomplete DIR-24-8 maps for table %s\n", name);
+        close_table_dir24(ctx);
+        return ret;
+    }
+
+    bool layout_valid = ctx->table.key_size == sizeof(struct dir24_route) &&
+                        ctx->dir24.type == BPF_MAP_TYPE_ARRAY && ctx->dir24.max_entries == DIR24_TBL24_ENTRIES &&
+                        ctx->dir24.key_size == sizeof(uint32_t) && ctx->dir24.value_size == sizeof(uint32_t) &&
+                        ctx->dir24_tbl8.type == BPF_MAP_TYPE_HASH &&
+                        ctx->dir24_tbl8.key_size == sizeof(uint32_t) &&
+                        ctx->dir24_tbl8.value_size == sizeof(uint32_t) &&
+                        ctx->dir24_routes.type == BPF_MAP_TYPE_HASH &&
+                        ctx->dir24_routes.key_size == ctx->table.key_size &&
+                        ctx->dir24_routes.value_size == ctx->table.value_size;
+    if (!layout_valid) {
+        fprintf(stderr, "warning: DIR-24-8 maps of table %s have unsupported layout, ignoring them\n", name);
+        close_table_dir24(ctx);
+        return ENOTSUP;
+    }
+
+    /* Direct objects would be updated by the data plane in routes, not in the table */
+    if (ctx->n_direct_counters > 0 || ctx->n_direct_meters > 0 || ctx->has_last_hit) {
+        fprintf(stderr, "warning: DIR-24-8 is not supported for table %s with direct objects\n", name);
+        close_table_dir24(ctx);
+        return ENOTSUP;
+    }
+
+    fprintf(stderr, "found DIR-24-8 maps for table: %s\n", name);
+    return NO_ERROR;
+}
+
+static uint32_t dir24_prefix_mask(uint32_t depth)
+{
+    return depth == 0 ? 0 : ~0U << (32 - depth);
+}
+
+static int decode_dir24_route(const void *key, struct dir24_route *route)
+{
+    const unsigned char *data = (const unsigned char *) key + sizeof(uint32_t);
+
+    memcpy(&route->depth, key, sizeof(route->depth));
+    if (route->depth > 32) {
+        return EINVAL;
+    }
+    /* LPM key is in network byte order */
+    route->addr = ((uint32_t) data[0] << 24) | ((uint32_t) data[1] << 16) | ((uint32_t) data[2] << 8) | data[3];
+    route->addr &= dir24_prefix_mask(route->depth);
+
+    return NO_ERROR;
+}
+
+static void encode_dir24_route(const struct dir24_route *route, char *key)
+{
+    unsigned char *data = (unsigned char *) key + sizeof(uint32_t);
+
+    memcpy(key, &route->depth, sizeof(route->depth));
+    data[0] = (unsigned char) (route->addr >> 24);
+    data[1] = (unsigned char) (route->addr >> 16);
+    data[2] = (unsigned char) (route->addr >> 8);
+    data[3] = (unsigned char) route->addr;
+}
+
+static uint32_t dir24_leaf(uint32_t depth)
+{
+    return DIR24_LEAF_VALID | depth;
+}
+
+static uint32_t dir24_leaf_depth(uint32_t leaf)
+{
+    return leaf & DIR24_LEAF_DEPTH_MASK;
+}
+
+/* Reads count leaves of <table>_dir24 starting from index first */
+static int read_tbl24_leaves(nikss_table_entry_ctx_t *ctx, uint32_t first, uint32_t count,
+                             uint32_t *keys, uint32_t *leaves)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = 0,
+                        .flags = 0,
+    );
+    /* Batch starts from the element next to in_batch */
+    uint32_t in_batch = first - 1;
+    uint32_t out_batch = 0;
+    uint32_t n = count;
+
+    int ret = bpf_map_lookup_batch(ctx->dir24.fd, first > 0 ? &in_batch : NULL, &out_batch,
+                                   keys, leaves, &n, &opts);
+    if ((ret == 0 || errno == ENOENT) && n == count && keys[0] == first) {
+        return NO_ERROR;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        keys[i] = first + i;
+        if (bpf_map_lookup_elem(ctx->dir24.fd, &keys[i], &leaves[i]) != 0) {
+            return errno;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+static int write_dir24_leaves(int fd, uint32_t *keys, uint32_t *leaves, uint32_t count)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = BPF_ANY,
+                        .flags = 0,
+    );
+    uint32_t n = count;
+
+    if (count == 0 || bpf_map_update_batch(fd, keys, leaves, &n, &opts) == 0) {
+        return NO_ERROR;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (bpf_map_update_elem(fd, &keys[i], &leaves[i], BPF_ANY) != 0) {
+            return errno;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+static int delete_tbl8_leaves(nikss_table_entry_ctx_t *ctx, const uint32_t *keys, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        if (bpf_map_delete_elem(ctx->dir24_tbl8.fd, &keys[i]) != 0 && errno != ENOENT) {
+            return errno;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+/* Absent leaf of <table>_dir24_tbl8 is returned as 0 (no route) */
+static int read_tbl8_leaf(nikss_table_entry_ctx_t *ctx, uint32_t addr, uint32_t *leaf)
+{
+    if (bpf_map_lookup_elem(ctx->dir24_tbl8.fd, &addr, leaf) != 0) {
+        if (errno != ENOENT) {
+            return errno;
+        }
+        *leaf = 0;
+    }
+
+    return NO_ERROR;
+}
+
+/*
+ * Sets leaf of addresses [first, first + count) in <table>_dir24_tbl8 to new_leaf. When inserting, leaves of
+ * shorter prefixes are overwritten; when removing a route of old_depth, only its own leaves are replaced.
+ */
+static int update_tbl8_range(nikss_table_entry_ctx_t *ctx, uint32_t first, uint32_t count,
+                             bool is_insert, uint32_t old_depth, uint32_t new_leaf)
+{
+    uint32_t keys[DIR24_GROUP_SIZE];
+    uint32_t leaves[DIR24_GROUP_SIZE];
+    uint32_t deleted[DIR24_GROUP_SIZE];
+    uint32_t n_changed = 0;
+    uint32_t n_deleted = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t leaf = 0;
+        int ret = read_tbl8_leaf(ctx, first + i, &leaf);
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+
+        bool is_valid = (leaf & DIR24_LEAF_VALID) != 0;
+        if (is_insert) {
+            if (is_valid && dir24_leaf_depth(leaf) >= dir24_leaf_depth(new_leaf)) {
+                continue;
+            }
+        } else if (!is_valid || dir24_leaf_depth(leaf) != old_depth) {
+            continue;
+        }
+
+        if (new_leaf == 0) {
+            deleted[n_deleted++] = first + i;
+        } else {
+            keys[n_changed] = first + i;
+            leaves[n_changed++] = new_leaf;
+        }
+    }
+
+    int ret = write_dir24_leaves(ctx->dir24_tbl8.fd, keys, leaves, n_changed);
+    if (ret == NO_ERROR) {
+        ret = delete_tbl8_leaves(ctx, deleted, n_deleted);
+    }
+    return ret;
+}
+
+/* Moves leaf of /24 to its group in <table>_dir24_tbl8, so it can hold longer prefixes */
+static int expand_tbl24_leaf(nikss_table_entry_ctx_t *ctx, uint32_t index, uint32_t leaf)
+{
+    uint32_t keys[DIR24_GROUP_SIZE];
+    uint32_t leaves[DIR24_GROUP_SIZE];
+    uint32_t ext_leaf = DIR24_LEAF_EXT;
+
+    if ((leaf & DIR24_LEAF_VALID) != 0) {
+        for (uint32_t i = 0; i < DIR24_GROUP_SIZE; i++) {
+            keys[i] = (index << 8) | i;
+            leaves[i] = leaf;
+        }
+        int ret = write_dir24_leaves(ctx->dir24_tbl8.fd, keys, leaves, DIR24_GROUP_SIZE);
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+    }
+
+    /* Group is complete, so data plane can be redirected to it */
+    if (bpf_map_update_elem(ctx->dir24.fd, &index, &ext_leaf, BPF_ANY) != 0) {
+        return errno;
+    }
+
+    return NO_ERROR;
+}
+
+/* Moves group back to <table>_dir24 when none of its leaves is longer than 24 bits */
+static int try_collapse_tbl8_group(nikss_table_entry_ctx_t *ctx, uint32_t index)
+{
+    uint32_t keys[DIR24_GROUP_SIZE];
+    uint32_t common_leaf = 0;
+
+    for (uint32_t i = 0; i < DIR24_GROUP_SIZE; i++) {
+        uint32_t leaf = 0;
+        keys[i] = (index << 8) | i;
+        int ret = read_tbl8_leaf(ctx, keys[i], &leaf);
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+        if (dir24_leaf_depth(leaf) > 24 || (i > 0 && leaf != common_leaf)) {
+            return NO_ERROR;
+        }
+        common_leaf = leaf;
+    }
+
+    if (bpf_map_update_elem(ctx->dir24.fd, &index, &common_leaf, BPF_ANY) != 0) {
+        return errno;
+    }
+
+    return delete_tbl8_leaves(ctx, keys, DIR24_GROUP_SIZE);
+}
+
+/* Route of up to 24 bits covers whole leaves of <table>_dir24 and, for those extended, their groups */
+static int update_tbl24_range(nikss_table_entry_ctx_t *ctx, const struct dir24_route *route,
+                              bool is_insert, uint32_t new_leaf)
+{
+    uint32_t first = route->addr >> 8;
+    uint32_t total = 1U << (24 - route->depth);
+    uint32_t n_chunk = total < DIR24_CHUNK_SIZE ? total : DIR24_CHUNK_SIZE;
+    uint32_t *keys = malloc(n_chunk * sizeof(uint32_t));
+    uint32_t *leaves = malloc(n_chunk * sizeof(uint32_t));
+    uint32_t *changed_keys = malloc(n_chunk * sizeof(uint32_t));
+    uint32_t *changed_leaves = malloc(n_chunk * sizeof(uint32_t));
+    int return_code = NO_ERROR;
+
+    if (keys == NULL || leaves == NULL || changed_keys == NULL || changed_leaves == NULL) {
+        return_code = ENOMEM;
+        goto clean_up;
+    }
+
+    for (uint32_t done = 0; done < total && return_code == NO_ERROR; done += n_chunk) {
+        uint32_t n_changed = 0;
+
+        return_code = read_tbl24_leaves(ctx, first + done, n_chunk, keys, leaves);
+        for (uint32_t i = 0; i < n_chunk && return_code == NO_ERROR; i++) {
+            uint32_t leaf = leaves[i];
+            if ((leaf & DIR24_LEAF_EXT) != 0) {
+                return_code = update_tbl8_range(ctx, keys[i] << 8, DIR24_GROUP_SIZE,
+                                                is_insert, route->depth, new_leaf);
+                if (return_code == NO_ERROR && is_insert == false) {
+                    return_code = try_collapse_tbl8_group(ctx, keys[i]);
+                }
+                continue;
+            }
+
+            bool is_valid = (leaf & DIR24_LEAF_VALID) != 0;
+            if (is_insert) {
+                if (is_valid && dir24_leaf_depth(leaf) >= route->depth) {
+                    continue;
+                }
+            } else if (!is_valid || dir24_leaf_depth(leaf) != route->depth) {
+                continue;
+            }
+            changed_keys[n_changed] = keys[i];
+            changed_leaves[n_changed++] = new_leaf;
+        }
+
+        if (return_code == NO_ERROR) {
+            return_code = write_dir24_leaves(ctx->dir24.fd, changed_keys, changed_leaves, n_changed);
+        }
+    }
+
+clean_up:
+    free(keys);
+    free(leaves);
+    free(changed_keys);
+    free(changed_leaves);
+
+    return return_code;
+}
+
+static int update_tbl8_route(nikss_table_entry_ctx_t *ctx, const struct dir24_route *route,
+                             bool is_insert, uint32_t new_leaf)
+{
+    uint32_t index = route->addr >> 8;
+    uint32_t leaf = 0;
+
+    if (bpf_map_lookup_elem(ctx->dir24.fd, &index, &leaf) != 0) {
+        return errno;
+    }
+
+    if ((leaf & DIR24_LEAF_EXT) == 0) {
+        if (is_insert == false) {
+            /* Route was never expanded, nothing to remove */
+            return NO_ERROR;
+        }
+        int ret = expand_tbl24_leaf(ctx, index, leaf);
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+    }
+
+    int ret = update_tbl8_range(ctx, route->addr, 1U << (32 - route->depth), is_insert, route->depth, new_leaf);
+    if (ret == NO_ERROR && is_insert == false) {
+        ret = try_collapse_tbl8_group(ctx, index);
+    }
+
+    return ret;
+}
+
+/* Leaf of the longest route which covers the removed one, 0 if there is none */
+static int find_covering_leaf(nikss_table_entry_ctx_t *ctx, const struct dir24_route *route, char *key_buffer,
+                              char *value_buffer, uint32_t *leaf)
+{
+    *leaf = 0;
+    for (uint32_t depth = route->depth; depth > 0; depth--) {
+        struct dir24_route parent = {
+                .depth = depth - 1,
+                .addr = route->addr & dir24_prefix_mask(depth - 1),
+        };
+        encode_dir24_route(&parent, key_buffer);
+        if (bpf_map_lookup_elem(ctx->dir24_routes.fd, key_buffer, value_buffer) == 0) {
+            *leaf = dir24_leaf(parent.depth);
+            return NO_ERROR;
+        }
+        if (errno != ENOENT) {
+            return errno;
+        }
+    }
+
+    return NO_ERROR;
+}
+
+static int update_dir24_leaves(nikss_table_entry_ctx_t *ctx, const struct dir24_route *route,
+                               bool is_insert, uint32_t new_leaf)
+{
+    if (route->depth <= 24) {
+        return update_tbl24_range(ctx, route, is_insert, new_leaf);
+    }
+    return update_tbl8_route(ctx, route, is_insert, new_leaf);
+}
+
+/*
+ * Route is stored before leaves pointing to it and removed after them,
+ * so the data plane never finds a leaf without its route.
+ */
+static int dir24_insert_route(nikss_table_entry_ctx_t *ctx, const struct dir24_route *route,
+                              const char *key, const void *value)
+{
+    if (bpf_map_update_elem(ctx->dir24_routes.fd, key, value, BPF_ANY) != 0) {
+        return errno;
+    }
+
+    return update_dir24_leaves(ctx, route, true, dir24_leaf(route->depth));
+}
+
+static int dir24_remove_route(nikss_table_entry_ctx_t *ctx, const struct dir24_route *route, const char *key)
+{
+    char *parent_key = malloc(ctx->dir24_routes.key_size);
+    char *parent_value = malloc(ctx->dir24_routes.value_size);
+    uint32_t new_leaf = 0;
+    int return_code = NO_ERROR;
+
+    if (parent_key == NULL || parent_value == NULL) {
+        return_code = ENOMEM;
+        goto clean_up;
+    }
+
+    return_code = find_covering_leaf(ctx, route, parent_key, parent_value, &new_leaf);
+    if (return_code == NO_ERROR) {
+        return_code = update_dir24_leaves(ctx, route, false, new_leaf);
+    }
+    if (return_code == NO_ERROR && bpf_map_delete_elem(ctx->dir24_routes.fd, key) != 0 && errno != ENOENT) {
+        return_code = errno;
+    }
+
+clean_up:
+    free(parent_key);
+    free(parent_value);
+
+    return return_code;
+}
+
+/* Restores the previous entry of the trie with its leaves, old_value is NULL when there was none */
+static void restore_dir24_entry(nikss_table_entry_ctx_t *ctx, const struct dir24_route *route, const void *key,
+                                const char *route_key, const void *old_value)
+{
+    int return_code = NO_ERROR;
+    if (old_value != NULL) {
+        return_code = bpf_map_update_elem(ctx->table.fd, key, old_value, BPF_ANY) != 0 ?
+                      errno : dir24_insert_route(ctx, route, route_key, old_value);
+    } else {
+        return_code = bpf_map_delete_elem(ctx->table.fd, key) != 0 && errno != ENOENT ?
+                      errno : dir24_remove_route(ctx, route, route_key);
+    }
+
+    if (return_code != NO_ERROR) {
+        fprintf(stderr, "failed to restore entry of LPM table: %s\n", strerror(return_code));
+    }
+}
+
+int write_table_dir24_entry(nikss_table_entry_ctx_t *ctx, const void *key, const void *value, uint64_t flags)
+{
+    struct dir24_route route = {0};
+    if (decode_dir24_route(key, &route) != NO_ERROR) {
+        return EINVAL;
+    }
+
+    char *route_key = malloc(ctx->dir24_routes.key_size);
+    char *old_value = malloc(ctx->table.value_size);
+    if (route_key == NULL || old_value == NULL) {
+        free(route_key);
+        free(old_value);
+        return ENOMEM;
+    }
+    /* Key has to be equal to the one built by the data plane from leaf */
+    encode_dir24_route(&route, route_key);
+
+    /* Trie and leaves are changed together and leaves are read, modified and written,
+     * so changes from many processes must not interleave */
+    int lock_fd = pipeline_lock(ctx->pipeline_id);
+    if (lock_fd < 0) {
+        free(route_key);
+        free(old_value);
+        return -lock_fd;
+    }
+
+    bool has_old_value = bpf_map_lookup_elem(ctx->table.fd, key, old_value) == 0;
+    int return_code = NO_ERROR;
+    if (value != NULL) {
+        return_code = bpf_map_update_elem(ctx->table.fd, key, value, flags) != 0 ? errno : NO_ERROR;
+    } else {
+        return_code = bpf_map_delete_elem(ctx->table.fd, key) != 0 ? errno : NO_ERROR;
+    }
+
+    /* The trie is the source of truth, so it is changed back when leaves can't follow it */
+    if (return_code == NO_ERROR) {
+        if (value != NULL) {
+            return_code = dir24_insert_route(ctx, &route, route_key, value);
+        } else {
+            return_code = dir24_remove_route(ctx, &route, route_key);
+        }
+        if (return_code != NO_ERROR) {
+            fprintf(stderr, "failed to update DIR-24-8 leaves: %s\n", strerror(return_code));
+            restore_dir24_entry(ctx, &route, key, route_key, has_old_value ? old_value : NULL);
+        }
+    }
+
+    pipeline_unlock(&lock_fd);
+    free(route_key);
+    free(old_value);
+
+    return return_code;
+}
+
+int clear_table_dir24(nikss_table_entry_ctx_t *ctx)
+{
+    if (ctx->dir24.fd < 0) {
+        return NO_ERROR;
+    }
+
+    int lock_fd = pipeline_lock(ctx->pipeline_id);
+    if (lock_fd < 0) {
+        return -lock_fd;
+    }
+
+    /* Leaves first, so none of them points to removed group or route */
+    int return_code = delete_all_map_entries(&ctx->dir24);
+    if (return_code == NO_ERROR) {
+        return_code = delete_all_map_entries(&ctx->dir24_tbl8);
+    }
+    if (return_code == NO_ERROR) {
+        return_code = delete_all_map_entries(&ctx->dir24_routes);
+    }
+
+    pipeline_unlock(&lock_fd);
+
+    if (return_code != NO_ERROR) {
+        fprintf(stderr, "failed to clear DIR-24-8 maps: %s\n", strerror(return_code));
+    }
+    return return_code;
+}
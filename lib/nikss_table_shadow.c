@@ -0,0 +1,437 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <bpf/bpf.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nikss/nikss.h>
+
+#include "common.h"
+#include "nikss_table.h"
+
+/* Open addressing with linear probing, slots are kept under 70% of use */
+struct nikss_table_shadow {
+    size_t key_size;
+    size_t value_size;
+    size_t n_entries;
+    size_t n_slots;
+    bool *used;
+    char *keys;
+    char *values;
+};
+
+#define SHADOW_INITIAL_SLOTS 64
+
+static uint64_t hash_shadow_key(const struct nikss_table_shadow *shadow, const void *key)
+{
+    /* FNV-1a */
+    const unsigned char *data = key;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < shadow->key_size; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static char *slot_key(const struct nikss_table_shadow *shadow, size_t slot)
+{
+    return shadow->keys + slot * shadow->key_size;
+}
+
+static char *slot_value(const struct nikss_table_shadow *shadow, size_t slot)
+{
+    return shadow->values + slot * shadow->value_size;
+}
+
+static int alloc_shadow_slots(struct nikss_table_shadow *shadow, size_t n_slots)
+{
+    shadow->used = calloc(n_slots, sizeof(bool));
+    shadow->keys = malloc(n_slots * shadow->key_size);
+    shadow->values = malloc(n_slots * shadow->value_size);
+    if (shadow->used == NULL || shadow->keys == NULL || shadow->values == NULL) {
+        free(shadow->used);
+        free(shadow->keys);
+        free(shadow->values);
+        return ENOMEM;
+    }
+    shadow->n_slots = n_slots;
+    shadow->n_entries = 0;
+
+    return NO_ERROR;
+}
+
+struct nikss_table_shadow *table_shadow_create(size_t key_size, size_t value_size)
+{
+    struct nikss_table_shadow *shadow = calloc(1, sizeof(struct nikss_table_shadow));
+    if (shadow == NULL) {
+        return NULL;
+    }
+    shadow->key_size = key_size;
+    shadow->value_size = value_size;
+    if (alloc_shadow_slots(shadow, SHADOW_INITIAL_SLOTS) != NO_ERROR) {
+        free(shadow);
+        return NULL;
+    }
+
+    return shadow;
+}
+
+void table_shadow_free(struct nikss_table_shadow *shadow)
+{
+    if (shadow == NULL) {
+        return;
+    }
+    free(shadow->used);
+    free(shadow->keys);
+    free(shadow->values);
+    free(shadow);
+}
+
+void table_shadow_clear(struct nikss_table_shadow *shadow)
+{
+    if (shadow == NULL) {
+        return;
+    }
+    memset(shadow->used, 0, shadow->n_slots * sizeof(bool));
+    shadow->n_entries = 0;
+}
+
+static bool find_shadow_slot(const struct nikss_table_shadow *shadow, const void *key, size_t *slot)
+{
+    size_t mask = shadow->n_slots - 1;
+    size_t i = hash_shadow_key(shadow, key) & mask;
+
+    while (shadow->used[i]) {
+        if (memcmp(slot_key(shadow, i), key, shadow->key_size) == 0) {
+            *slot = i;
+            return true;
+        }
+        i = (i + 1) & mask;
+    }
+    /* First free slot, where the key would be inserted */
+    *slot = i;
+
+    return false;
+}
+
+const void *table_shadow_lookup(const struct nikss_table_shadow *shadow, const void *key)
+{
+    size_t slot = 0;
+    if (shadow == NULL || !find_shadow_slot(shadow, key, &slot)) {
+        return NULL;
+    }
+    return slot_value(shadow, slot);
+}
+
+static int grow_shadow(struct nikss_table_shadow *shadow)
+{
+    struct nikss_table_shadow old = *shadow;
+
+    if (alloc_shadow_slots(shadow, old.n_slots * 2) != NO_ERROR) {
+        *shadow = old;
+        return ENOMEM;
+    }
+
+    for (size_t i = 0; i < old.n_slots; i++) {
+        if (old.used[i]) {
+            size_t slot = 0;
+            find_shadow_slot(shadow, slot_key(&old, i), &slot);
+            shadow->used[slot] = true;
+            memcpy(slot_key(shadow, slot), slot_key(&old, i), shadow->key_size);
+            memcpy(slot_value(shadow, slot), slot_value(&old, i), shadow->value_size);
+            shadow->n_entries++;
+        }
+    }
+
+    free(old.used);
+    free(old.keys);
+    free(old.values);
+
+    return NO_ERROR;
+}
+
+int table_shadow_put(struct nikss_table_shadow *shadow, const void *key, const void *value)
+{
+    if (shadow == NULL) {
+        return NO_ERROR;
+    }
+
+    if ((shadow->n_entries + 1) * 10 > shadow->n_slots * 7) {
+        int ret = grow_shadow(shadow);
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+    }
+
+    size_t slot = 0;
+    if (!find_shadow_slot(shadow, key, &slot)) {
+        shadow->used[slot] = true;
+        memcpy(slot_key(shadow, slot), key, shadow->key_size);
+        shadow->n_entries++;
+    }
+    memcpy(slot_value(shadow, slot), value, shadow->value_size);
+
+    return NO_ERROR;
+}
+
+void table_shadow_remove(struct nikss_table_shadow *shadow, const void *key)
+{
+    size_t hole = 0;
+    if (shadow == NULL || !find_shadow_slot(shadow, key, &hole)) {
+        return;
+    }
+
+    /* Backward shift deletion: move following entries of the cluster into the hole, so lookup
+     * never stops before reaching them. Entry stays when its home slot is in (hole, i]. */
+    size_t mask = shadow->n_slots - 1;
+    shadow->used[hole] = false;
+    shadow->n_entries--;
+    for (size_t i = (hole + 1) & mask; shadow->used[i]; i = (i + 1) & mask) {
+        size_t home = hash_shadow_key(shadow, slot_key(shadow, i)) & mask;
+        bool stays = hole <= i ? (hole < home && home <= i) : (hole < home || home <= i);
+        if (stays) {
+            continue;
+        }
+        memcpy(slot_key(shadow, hole), slot_key(shadow, i), shadow->key_size);
+        memcpy(slot_value(shadow, hole), slot_value(shadow, i), shadow->value_size);
+        shadow->used[hole] = true;
+        shadow->used[i] = false;
+        hole = i;
+    }
+}
+
+/******************************************************************************
+ * Reading the table from the kernel
+ *****************************************************************************/
+
+static int read_table_batch(nikss_bpf_map_descriptor_t *map, char *keys, char *values, uint32_t *n_entries)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = 0,
+                        .flags = 0,
+    );
+
+    /* For hash maps batch token is a bucket number, for arrays it is a key */
+    size_t token_size = map->key_size > sizeof(uint64_t) ? map->key_size : sizeof(uint64_t);
+    char *token = calloc(1, token_size);
+    if (token == NULL) {
+        return ENOMEM;
+    }
+
+    int ret = NO_ERROR;
+    bool first = true;
+    *n_entries = 0;
+    while (*n_entries < map->max_entries) {
+        uint32_t count = map->max_entries - *n_entries;
+        int err = bpf_map_lookup_batch(map->fd, first ? NULL : token, token,
+                                       keys + (size_t) *n_entries * map->key_size,
+                                       values + (size_t) *n_entries * map->value_size, &count, &opts);
+        if (err != 0) {
+            err = errno;
+        }
+        if (err != NO_ERROR && err != ENOENT) {
+            ret = err;
+            break;
+        }
+        *n_entries += count;
+        first = false;
+        if (err == ENOENT || count == 0) {
+            break;
+        }
+    }
+
+    free(token);
+    return ret;
+}
+
+static int read_table_one_by_one(nikss_bpf_map_descriptor_t *map, char *keys, char *values, uint32_t *n_entries)
+{
+    *n_entries = 0;
+    while (*n_entries < map->max_entries) {
+        char *key = keys + (size_t) *n_entries * map->key_size;
+        const char *prev_key = *n_entries > 0 ? key - map->key_size : NULL;
+        if (bpf_map_get_next_key(map->fd, prev_key, key) != 0) {
+            break;
+        }
+        if (bpf_map_lookup_elem(map->fd, key, values + (size_t) *n_entries * map->value_size) != 0) {
+            /* Removed in the meantime, key is still needed to get the next one */
+            continue;
+        }
+        *n_entries += 1;
+    }
+
+    return NO_ERROR;
+}
+
+static int read_table_into_shadow(nikss_table_entry_ctx_t *ctx, struct nikss_table_shadow *shadow)
+{
+    nikss_bpf_map_descriptor_t *map = &ctx->table;
+    uint32_t n_entries = 0;
+    int ret = NO_ERROR;
+
+    if (map->max_entries == 0) {
+        return NO_ERROR;
+    }
+
+    char *keys = malloc((size_t) map->max_entries * map->key_size);
+    char *values = malloc((size_t) map->max_entries * map->value_size);
+    if (keys == NULL || values == NULL) {
+        ret = ENOMEM;
+        goto clean_up;
+    }
+
+    /* LPM tries do not support batch lookup */
+    if (map->type == BPF_MAP_TYPE_LPM_TRIE || read_table_batch(map, keys, values, &n_entries) != NO_ERROR) {
+        read_table_one_by_one(map, keys, values, &n_entries);
+    }
+
+    for (uint32_t i = 0; i < n_entries && ret == NO_ERROR; i++) {
+        ret = table_shadow_put(shadow, keys + (size_t) i * map->key_size, values + (size_t) i * map->value_size);
+    }
+
+clean_up:
+    free(keys);
+    free(values);
+
+    return ret;
+}
+
+/******************************************************************************
+ * Public API
+ *****************************************************************************/
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_entry_ctx_shadow(nikss_table_entry_ctx_t *ctx, bool enable)
+{
+    if (ctx == NULL) {
+        return EINVAL;
+    }
+
+    if (!enable) {
+        table_shadow_free(ctx->shadow);
+        ctx->shadow = NULL;
+        return NO_ERROR;
+    }
+    if (ctx->shadow != NULL) {
+        return NO_ERROR;
+    }
+
+    /* Keys live in many tuples and direct objects are changed by the data plane */
+    if (ctx->is_ternary || ctx->n_direct_counters > 0 || ctx->n_direct_meters > 0 || ctx->has_last_hit) {
+        return ENOTSUP;
+    }
+    if (ctx->table.fd < 0) {
+        return EBADF;
+    }
+    if (ctx->table.key_size == 0 || ctx->table.value_size == 0) {
+        return ENOTSUP;
+    }
+
+    struct nikss_table_shadow *shadow = table_shadow_create(ctx->table.key_size, ctx->table.value_size);
+    if (shadow == NULL) {
+        return ENOMEM;
+    }
+    int ret = read_table_into_shadow(ctx, shadow);
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to read table into its shadow copy: %s\n", strerror(ret));
+        table_shadow_free(shadow);
+        return ret;
+    }
+    ctx->shadow = shadow;
+
+    return NO_ERROR;
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+size_t nikss_table_entry_ctx_shadow_size(nikss_table_entry_ctx_t *ctx)
+{
+    if (ctx == NULL || ctx->shadow == NULL) {
+        return 0;
+    }
+    return ctx->shadow->n_entries;
+}
+
+static int report_shadow_diff(nikss_table_shadow_diff_cb_t cb, void *arg, nikss_table_shadow_diff_type_t type,
+                              const struct nikss_table_shadow *shadow, const void *key,
+                              const void *shadow_value, const void *kernel_value)
+{
+    if (cb == NULL) {
+        return NO_ERROR;
+    }
+
+    nikss_table_shadow_diff_t diff = {
+            .type = type,
+            .key = key,
+            .key_size = shadow->key_size,
+            .shadow_value = shadow_value,
+            .kernel_value = kernel_value,
+            .value_size = shadow->value_size,
+    };
+    return cb(&diff, arg);
+}
+
+/* cppcheck-suppress unusedFunction ; public API call */
+int nikss_table_entry_ctx_shadow_reconcile(nikss_table_entry_ctx_t *ctx, nikss_table_shadow_diff_cb_t cb, void *arg)
+{
+    if (ctx == NULL || ctx->shadow == NULL) {
+        return EINVAL;
+    }
+
+    struct nikss_table_shadow *shadow = ctx->shadow;
+    struct nikss_table_shadow *kernel = table_shadow_create(shadow->key_size, shadow->value_size);
+    if (kernel == NULL) {
+        return ENOMEM;
+    }
+    int ret = read_table_into_shadow(ctx, kernel);
+    if (ret != NO_ERROR) {
+        fprintf(stderr, "failed to read table: %s\n", strerror(ret));
+        table_shadow_free(kernel);
+        return ret;
+    }
+
+    for (size_t i = 0; i < kernel->n_slots && ret == NO_ERROR; i++) {
+        if (!kernel->used[i]) {
+            continue;
+        }
+        const char *key = slot_key(kernel, i);
+        const char *kernel_value = slot_value(kernel, i);
+        const void *shadow_value = table_shadow_lookup(shadow, key);
+        if (shadow_value == NULL) {
+            ret = report_shadow_diff(cb, arg, NIKSS_TABLE_SHADOW_ENTRY_ADDED, kernel, key, NULL, kernel_value);
+        } else if (memcmp(shadow_value, kernel_value, kernel->value_size) != 0) {
+            ret = report_shadow_diff(cb, arg, NIKSS_TABLE_SHADOW_ENTRY_CHANGED, kernel, key,
+                                     shadow_value, kernel_value);
+        }
+    }
+    for (size_t i = 0; i < shadow->n_slots && ret == NO_ERROR; i++) {
+        if (shadow->used[i] && table_shadow_lookup(kernel, slot_key(shadow, i)) == NULL) {
+            ret = report_shadow_diff(cb, arg, NIKSS_TABLE_SHADOW_ENTRY_REMOVED, shadow, slot_key(shadow, i),
+                                     slot_value(shadow, i), NULL);
+        }
+    }
+
+    /* Shadow follows the kernel from now on, also when comparison was stopped */
+    table_shadow_free(shadow);
+    ctx->shadow = kernel;
+
+    return ret;
+}
@@ -224,3 +224,240 @@ int nikss_value_set_delete(nikss_value_set_context_t *ctx, nikss_table_entry_t *
 
     return ret;
 }
+
+/* Reads all keys from the value_set, using batch lookup when supported by the kernel. */
+static int read_value_set_keys(nikss_value_set_context_t *ctx, char *keys, size_t *n_keys)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = 0,
+                        .flags = 0,
+    );
+    size_t key_size = ctx->set_map.key_size;
+    size_t max_entries = ctx->set_map.max_entries;
+    int ret = NO_ERROR;
+
+    *n_keys = 0;
+
+    char *values = malloc(max_entries * (size_t) ctx->set_map.value_size);
+    /* Token is a bucket number for hash maps and a key for other maps */
+    size_t token_size = key_size > sizeof(uint64_t) ? key_size : sizeof(uint64_t);
+    char *token = calloc(1, token_size);
+    if (values == NULL || token == NULL) {
+        ret = ENOMEM;
+        goto clean_up;
+    }
+
+    bool started = false;
+    while (*n_keys < max_entries) {
+        uint32_t count = max_entries - *n_keys;
+        ret = bpf_map_lookup_batch(ctx->set_map.fd, started ? token : NULL, token,
+                                   keys + *n_keys * key_size, values, &count, &opts);
+        int err = ret != 0 ? errno : NO_ERROR;
+        if (ret == 0 || err == ENOENT) {
+            *n_keys += count;
+            started = true;
+            ret = NO_ERROR;
+            if (err == ENOENT) {
+                goto clean_up;
+            }
+            continue;
+        }
+
+        if (started) {
+            ret = err;
+            fprintf(stderr, "failed to read value_set: %s\n", strerror(ret));
+            goto clean_up;
+        }
+
+        /* Kernel or map type does not support batch lookup */
+        break;
+    }
+    if (started) {
+        goto clean_up;
+    }
+
+    char *prev_key = NULL;
+    while (*n_keys < max_entries &&
+           bpf_map_get_next_key(ctx->set_map.fd, prev_key, keys + *n_keys * key_size) == 0) {
+        prev_key = keys + *n_keys * key_size;
+        *n_keys += 1;
+    }
+    ret = NO_ERROR;
+
+clean_up:
+    if (values != NULL) {
+        free(values);
+    }
+    if (token != NULL) {
+        free(token);
+    }
+
+    return ret;
+}
+
+static int compare_value_set_keys(const void *a, const void *b, void *key_size)
+{
+    return memcmp(a, b, *((size_t *) key_size));
+}
+
+static int write_value_set_keys(nikss_value_set_context_t *ctx, char *keys, uint32_t count, bool delete)
+{
+    DECLARE_LIBBPF_OPTS(bpf_map_batch_opts, opts,
+                        .elem_flags = BPF_ANY,
+                        .flags = 0,
+    );
+    size_t key_size = ctx->set_map.key_size;
+    if (count == 0) {
+        return NO_ERROR;
+    }
+
+    char *values = calloc(count, ctx->set_map.value_size);
+    if (values == NULL) {
+        return ENOMEM;
+    }
+
+    int ret = NO_ERROR;
+    uint32_t processed = count;
+    if (delete) {
+        ret = bpf_map_delete_batch(ctx->set_map.fd, keys, &processed, &opts);
+    } else {
+        ret = bpf_map_update_batch(ctx->set_map.fd, keys, values, &processed, &opts);
+    }
+    if (ret != 0) {
+        /* Kernels without batch operations do not update the counter */
+        if (processed >= count) {
+            processed = 0;
+        }
+        ret = NO_ERROR;
+        for (uint32_t i = processed; i < count; i++) {
+            char *key = keys + (size_t) i * key_size;
+            int err = delete ? bpf_map_delete_elem(ctx->set_map.fd, key) :
+                               bpf_map_update_elem(ctx->set_map.fd, key, values, BPF_ANY);
+            if (err != 0 && !(delete && errno == ENOENT)) {
+                ret = errno;
+                fprintf(stderr, "failed to %s entry: %s\n", delete ? "delete" : "set up", strerror(ret));
+                break;
+            }
+        }
+    }
+
+    free(values);
+    return ret;
+}
+
+int nikss_value_set_replace(nikss_value_set_context_t *ctx, nikss_table_entry_t *entries, size_t n_entries)
+{
+    if (ctx == NULL || (entries == NULL && n_entries > 0)) {
+        return EINVAL;
+    }
+    if (ctx->is_ternary_match ||
+        (ctx->set_map.type != BPF_MAP_TYPE_HASH && ctx->set_map.type != BPF_MAP_TYPE_LRU_HASH)) {
+        fprintf(stderr, "bulk replace is supported only for exact match value_set\n");
+        return ENOTSUP;
+    }
+    if (n_entries > ctx->set_map.max_entries) {
+        fprintf(stderr, "too many entries, value_set can hold at most %u\n", ctx->set_map.max_entries);
+        return E2BIG;
+    }
+
+    size_t key_size = ctx->set_map.key_size;
+    int return_code = NO_ERROR;
+    size_t n_current = 0;
+    char *new_keys = malloc(n_entries * key_size + 1);
+    char *current_keys = malloc((size_t) ctx->set_map.max_entries * key_size + 1);
+    /* Keys to insert are stored in the front, keys to delete from the end of buffer */
+    char *diff_keys = malloc((n_entries + ctx->set_map.max_entries) * key_size + 1);
+    if (new_keys == NULL || current_keys == NULL || diff_keys == NULL) {
+        fprintf(stderr, "not enough memory\n");
+        return_code = ENOMEM;
+        goto clean_up;
+    }
+
+    nikss_table_entry_ctx_t tec = {
+            .table = ctx->set_map,
+            .btf_metadata = ctx->btf_metadata,
+            .cache = ctx->cache,
+            .is_ternary = ctx->is_ternary_match,
+    };
+    for (size_t i = 0; i < n_entries; i++) {
+        return_code = construct_buffer(new_keys + i * key_size, key_size, &tec, &entries[i],
+                                       fill_key_btf_info, fill_key_byte_by_byte);
+        if (return_code != NO_ERROR) {
+            /* cppcheck-suppress invalidPrintfArgType_uint ; cppcheck failed to recognize a real type of size_t */
+            fprintf(stderr, "failed to construct key of entry %lu\n", i);
+            goto clean_up;
+        }
+    }
+
+    return_code = read_value_set_keys(ctx, current_keys, &n_current);
+    if (return_code != NO_ERROR) {
+        goto clean_up;
+    }
+
+    qsort_r(new_keys, n_entries, key_size, compare_value_set_keys, &key_size);
+    qsort_r(current_keys, n_current, key_size, compare_value_set_keys, &key_size);
+
+    /* Merge both sorted lists to find the difference */
+    size_t n_insert = 0;
+    size_t n_delete = 0;
+    char *delete_keys = diff_keys + n_entries * key_size;
+    size_t new_idx = 0;
+    size_t current_idx = 0;
+    while (new_idx < n_entries || current_idx < n_current) {
+        int cmp = 0;
+        if (new_idx >= n_entries) {
+            cmp = 1;
+        } else if (current_idx >= n_current) {
+            cmp = -1;
+        } else {
+            cmp = memcmp(new_keys + new_idx * key_size, current_keys + current_idx * key_size, key_size);
+        }
+
+        if (cmp < 0) {
+            /* Skip duplicates on the input list */
+            if (n_insert == 0 ||
+                memcmp(diff_keys + (n_insert - 1) * key_size, new_keys + new_idx * key_size, key_size) != 0) {
+                memcpy(diff_keys + n_insert * key_size, new_keys + new_idx * key_size, key_size);
+                n_insert++;
+            }
+            new_idx++;
+        } else if (cmp > 0) {
+            memcpy(delete_keys + n_delete * key_size, current_keys + current_idx * key_size, key_size);
+            n_delete++;
+            current_idx++;
+        } else {
+            new_idx++;
+            /* Keep current key for following duplicates on the input list */
+            if (new_idx >= n_entries ||
+                memcmp(new_keys + new_idx * key_size, current_keys + current_idx * key_size, key_size) != 0) {
+                current_idx++;
+            }
+        }
+    }
+
+    /* Delete first, so the set never holds more entries than max_entries */
+    return_code = write_value_set_keys(ctx, delete_keys, n_delete, true);
+    if (return_code == NO_ERROR) {
+        return_code = write_value_set_keys(ctx, diff_keys, n_insert, false);
+    }
+
+    if ((n_insert > 0 || n_delete > 0) && ctx->cache.fd >= 0) {
+        int ret = clear_table_cache(&ctx->cache);
+        if (ret != NO_ERROR) {
+            fprintf(stderr, "failed to clear cache: %s\n", strerror(ret));
+        }
+    }
+
+clean_up:
+    if (new_keys != NULL) {
+        free(new_keys);
+    }
+    if (current_keys != NULL) {
+        free(current_keys);
+    }
+    if (diff_keys != NULL) {
+        free(diff_keys);
+    }
+
+    return return_code;
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2022 Orange
+ * Copyright 2022 Warsaw University of Technology
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __NIKSS_STATS_INTERNAL_H
+#define __NIKSS_STATS_INTERNAL_H
+
+/*
+ * Instrumentation of library calls. When NIKSS_STATS is not defined, everything here compiles to
+ * the bare calls. libbpf has to be included before macros are defined, so map operations used by
+ * the library are transparently replaced by measured ones.
+ */
+
+#include <bpf/bpf.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <nikss/nikss_stats.h>
+
+#ifdef NIKSS_STATS
+
+uint64_t stats_timestamp(void);
+void stats_record(nikss_stats_op_t op, uint64_t start_ns, bool failed);
+
+/* Call which returns NO_ERROR on success */
+#define NIKSS_STATS_CALL(op, call) ({                                   \
+        uint64_t stats_start_ = stats_timestamp();                      \
+        int stats_ret_ = (call);                                        \
+        stats_record((op), stats_start_, stats_ret_ != NO_ERROR);       \
+        stats_ret_; })
+
+/* libbpf call which returns negative value on error */
+#define NIKSS_STATS_BPF_CALL(op, call) ({                               \
+        uint64_t stats_start_ = stats_timestamp();                      \
+        int stats_ret_ = (call);                                        \
+        stats_record((op), stats_start_, stats_ret_ < 0);               \
+        stats_ret_; })
+
+/* A macro is not expanded again inside its own replacement, so these still call libbpf */
+#define bpf_map_lookup_elem(...) \
+        NIKSS_STATS_BPF_CALL(NIKSS_STATS_BPF_MAP_LOOKUP_ELEM, bpf_map_lookup_elem(__VA_ARGS__))
+#define bpf_map_lookup_elem_flags(...) \
+        NIKSS_STATS_BPF_CALL(NIKSS_STATS_BPF_MAP_LOOKUP_ELEM, bpf_map_lookup_elem_flags(__VA_ARGS__))
+#define bpf_map_update_elem(...) \
+        NIKSS_STATS_BPF_CALL(NIKSS_STATS_BPF_MAP_UPDATE_ELEM, bpf_map_update_elem(__VA_ARGS__))
+#define bpf_map_delete_elem(...) \
+        NIKSS_STATS_BPF_CALL(NIKSS_STATS_BPF_MAP_DELETE_ELEM, bpf_map_delete_elem(__VA_ARGS__))
+#define bpf_map_get_next_key(...) \
+        NIKSS_STATS_BPF_CALL(NIKSS_STATS_BPF_MAP_GET_NEXT_KEY, bpf_map_get_next_key(__VA_ARGS__))
+#define bpf_map_lookup_and_delete_elem(...) \
+        NIKSS_STATS_BPF_CALL(NIKSS_STATS_BPF_MAP_LOOKUP_AND_DELETE_ELEM, bpf_map_lookup_and_delete_elem(__VA_ARGS__))
+#define bpf_map_lookup_batch(...) \
+        NIKSS_STATS_BPF_CALL(NIKSS_STATS_BPF_MAP_LOOKUP_BATCH, bpf_map_lookup_batch(__VA_ARGS__))
+#define bpf_map_update_batch(...) \
+        NIKSS_STATS_BPF_CALL(NIKSS_STATS_BPF_MAP_UPDATE_BATCH, bpf_map_update_batch(__VA_ARGS__))
+#define bpf_map_delete_batch(...) \
+        NIKSS_STATS_BPF_CALL(NIKSS_STATS_BPF_MAP_DELETE_BATCH, bpf_map_delete_batch(__VA_ARGS__))
+#define bpf_map_get_fd_by_id(...) \
+        NIKSS_STATS_BPF_CALL(NIKSS_STATS_BPF_MAP_GET_FD_BY_ID, bpf_map_get_fd_by_id(__VA_ARGS__))
+#define bpf_obj_get(...) \
+        NIKSS_STATS_BPF_CALL(NIKSS_STATS_BPF_OBJ_GET, bpf_obj_get(__VA_ARGS__))
+
+#else
+
+#define NIKSS_STATS_CALL(op, call) (call)
+
+#endif  /* NIKSS_STATS */
+
+#endif  /* __NIKSS_STATS_INTERNAL_H */
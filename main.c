@@ -15,10 +15,12 @@
  * limitations under the License.
  */
 
+#include <errno.h>
 #include <getopt.h>
 #include <stdio.h>
 
 #include "CLI/action_selector.h"
+#include "CLI/batch.h"
 #include "CLI/clone_session.h"
 #include "CLI/common.h"
 #include "CLI/counter.h"
@@ -28,11 +30,16 @@
 #include "CLI/os_validate.h"
 #include "CLI/pipeline.h"
 #include "CLI/register.h"
+#include "CLI/serve.h"
+#include "CLI/snapshot.h"
+#include "CLI/stats.h"
 #include "CLI/table.h"
 #include "CLI/value_set.h"
 
 /* Removing this line will require too much effort or result in strange C construct (assign to const value) */
 const char *program_name;  /* NOLINT(cppcoreguidelines-avoid-non-const-global-variables) */
+bool ndjson_output = false;  /* NOLINT(cppcoreguidelines-avoid-non-const-global-variables) */
+bool non_interactive = false;  /* NOLINT(cppcoreguidelines-avoid-non-const-global-variables) */
 
 int cmd_select(const struct cmd *cmds, int argc, char **argv,
                int (*help)(int, char **))
@@ -76,8 +83,14 @@ static int do_help(int argc, char **argv)
             "                   counter |\n"
             "                   register |\n"
             "                   value-set |\n"
-            "                   validate-os }\n"
-            "       OPTIONS := {}\n"
+            "                   snapshot |\n"
+            "                   stats |\n"
+            "                   validate-os |\n"
+            "                   serve |\n"
+            "                   batch }\n"
+            "       OPTIONS := { --ndjson }\n"
+            "\n"
+            "       --ndjson  print dumps as one JSON value per line\n"
             "",
             program_name, program_name);
 
@@ -162,6 +175,16 @@ static int do_value_set(int argc, char **argv)
     return cmd_select(value_set_cmds, argc, argv, do_value_set_help);
 }
 
+static int do_snapshot(int argc, char **argv)
+{
+    return cmd_select(snapshot_cmds, argc, argv, do_snapshot_help);
+}
+
+static int do_stats(int argc, char **argv)
+{
+    return cmd_select(stats_cmds, argc, argv, do_stats_help);
+}
+
 static const struct cmd cmds[] = {
         { "help",            do_help },
         { "pipeline",        do_pipeline },
@@ -177,18 +200,41 @@ static const struct cmd cmds[] = {
         { "counter",         do_counter },
         { "register",        do_register },
         { "value-set",       do_value_set },
+        { "snapshot",        do_snapshot },
+        { "stats",           do_stats },
         { "validate-os",     do_os_validate },
+        { "serve",           do_serve },
+        { "batch",           do_batch },
         { 0 }
 };
 
+int run_nikssctl_command(int argc, char **argv)
+{
+    return cmd_select(cmds, argc, argv, do_help);
+}
+
 int main(int argc, char **argv)
 {
     program_name = argv[0];
 
-    /* TODO: parse program options */
+    static const struct option options[] = {
+            { "ndjson", no_argument, NULL, 'n' },
+            { 0 }
+    };
+
+    /* Stop at the first non-option argument, options of commands are parsed by commands */
+    int opt;
+    while ((opt = getopt_long(argc, argv, "+", options, NULL)) != -1) {
+        if (opt == 'n') {
+            ndjson_output = true;
+        } else {
+            do_help(argc, argv);
+            return EINVAL;
+        }
+    }
 
     argc -= optind;
     argv += optind;
 
-    return cmd_select(cmds, argc, argv, do_help);
+    return run_nikssctl_command(argc, argv);
 }
\ No newline at end of file
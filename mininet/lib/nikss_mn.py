@@ -1,4 +1,6 @@
 
+import json
+
 from mininet.net import Mininet
 from mininet.node import Switch, Host
 from mininet.log import setLogLevel, info, error, debug
@@ -62,6 +64,13 @@ class NIKSSSwitch(Switch):
         
     def start(self, controllers):
         info("Starting NIKSS switch {}.\n".format(self.name))
+        self.load_pipeline()
+
+    def stop(self, deleteIntfs=True):
+        self.unload_pipeline()
+        super( NIKSSSwitch, self ).stop( deleteIntfs )
+
+    def load_pipeline(self):
         self.cmd("nikss-ctl pipeline load id {} {}".format(self.device_id, self.bpf_path))
 
         for port, intf in self.intfs.items():
@@ -70,12 +79,24 @@ class NIKSSSwitch(Switch):
             info("Attaching port {} to NIKSS switch {}.\n".format(intf, self.name))
             self.cmd("nikss-ctl add-port pipe {} dev {}".format(self.device_id, intf))
 
-
-    def stop(self, deleteIntfs=True):
+    def unload_pipeline(self):
         for port, intf in self.intfs.items():
             if not "s1-" in str(intf):
                 continue
             info("Detaching port {} from NIKSS switch {}.\n".format(intf, self.name))
             self.cmd("nikss-ctl del-port pipe {} dev {}".format(self.device_id, intf))
         self.cmd("nikss-ctl pipeline unload id {}".format(self.device_id))
-        super( NIKSSSwitch, self ).stop( deleteIntfs )
+
+    def reload(self, bpf_path):
+        """
+        Replaces the P4 program, all the table entries are lost.
+        """
+        self.unload_pipeline()
+        self.bpf_path = bpf_path
+        self.load_pipeline()
+
+    def pipeline_info(self):
+        """
+        Returns output of `nikss-ctl pipeline show` as a dictionary.
+        """
+        return json.loads(self.cmd("nikss-ctl pipeline show id {}".format(self.device_id)))["pipeline"]
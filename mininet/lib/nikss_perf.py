@@ -0,0 +1,214 @@
+import os
+import re
+import shlex
+import subprocess
+import time
+
+"""
+Helpers for data plane performance measurements: traffic generators, interface counters,
+per-CPU softirq load and latency probes. Every function takes a node which runs shell commands,
+either a Mininet host (commands are executed in its network namespace) or LocalNode.
+"""
+
+
+class LocalNode(object):
+    """
+    Runs commands in the current network namespace, used with physical ports.
+    """
+
+    name = "local"
+
+    def cmd(self, command):
+        return subprocess.run(command, shell=True, stdout=subprocess.PIPE,
+                              stderr=subprocess.STDOUT, universal_newlines=True).stdout
+
+    def popen(self, command, **kwargs):
+        return subprocess.Popen(command, **kwargs)
+
+
+def read_interface_counter(node, dev, counter):
+    out = node.cmd("cat /sys/class/net/{}/statistics/{}".format(dev, counter)).strip()
+    return int(out) if out.isdigit() else 0
+
+
+def percentile(samples, p):
+    if not samples:
+        return None
+    ordered = sorted(samples)
+    return ordered[min(len(ordered) - 1, int((len(ordered) - 1) * p / 100.0))]
+
+
+def pipeline_mode(pipeline_info, pipeline_id):
+    """
+    Name of the hook used by the pipeline: "tc", "xdp" or "xdp-optimized-egress".
+    The optimized XDP egress program is found by its pinned name.
+    """
+    if pipeline_info.get("bpf_hook") == "TC":
+        return "tc"
+    if os.path.exists("/sys/fs/bpf/pipeline{}/xdp_xdp-egress".format(pipeline_id)):
+        return "xdp-optimized-egress"
+    return "xdp"
+
+
+class SoftirqSampler(object):
+    """
+    Per-CPU time spent in softirq handlers (mostly NET_RX), based on /proc/stat.
+    """
+
+    def __init__(self):
+        self.start = None
+
+    @staticmethod
+    def _read():
+        cpus = {}
+        with open("/proc/stat") as f:
+            for line in f:
+                fields = line.split()
+                if not re.match(r"^cpu[0-9]+$", fields[0]):
+                    continue
+                values = [int(v) for v in fields[1:]]
+                # user nice system idle iowait irq softirq ...
+                cpus[fields[0]] = (values[6], sum(values))
+        return cpus
+
+    def begin(self):
+        self.start = self._read()
+
+    def end(self):
+        """
+        Returns softirq load of every CPU in percents since begin().
+        """
+        stop = self._read()
+        load = {}
+        for cpu, (softirq, total) in stop.items():
+            if cpu not in self.start:
+                continue
+            d_total = total - self.start[cpu][1]
+            d_softirq = softirq - self.start[cpu][0]
+            load[cpu] = round(100.0 * d_softirq / d_total, 2) if d_total > 0 else 0.0
+        return load
+
+
+class PktgenGenerator(object):
+    """
+    Kernel pktgen, one kernel thread per queue. The pktgen module must be available.
+    """
+
+    name = "pktgen"
+
+    def __init__(self, node, dev, dst_mac, dst_ip, src_ip, pkt_size=64, threads=1):
+        self.node = node
+        self.dev = dev
+        self.dst_mac = dst_mac
+        self.dst_ip = dst_ip
+        self.src_ip = src_ip
+        self.pkt_size = pkt_size
+        self.threads = threads
+        self.process = None
+
+    def _write(self, path, value):
+        self.node.cmd("echo '{}' > /proc/net/pktgen/{}".format(value, path))
+
+    def setup(self):
+        self.node.cmd("modprobe pktgen")
+        self._write("pgctrl", "reset")
+        for t in range(self.threads):
+            # every thread sends through its own queue
+            dev = "{}@{}".format(self.dev, t)
+            self._write("kpktgend_{}".format(t), "rem_device_all")
+            self._write("kpktgend_{}".format(t), "add_device {}".format(dev))
+            for option in ["count 0", "delay 0", "clone_skb 0", "burst 1",
+                           "pkt_size {}".format(self.pkt_size),
+                           "queue_map_min {}".format(t), "queue_map_max {}".format(t),
+                           "dst_mac {}".format(self.dst_mac),
+                           "dst {}".format(self.dst_ip), "src_min {}".format(self.src_ip),
+                           "src_max {}".format(self.src_ip),
+                           "udp_src_min 9", "udp_src_max 1009", "flag UDPSRC_RND"]:
+                self._write(dev, option)
+
+    def start(self, duration):
+        self.setup()
+        command = "timeout {} sh -c 'echo start > /proc/net/pktgen/pgctrl'".format(duration)
+        self.process = self.node.popen(["sh", "-c", command])
+
+    def wait(self):
+        if self.process is not None:
+            self.process.wait()
+            self.process = None
+        self._write("pgctrl", "stop")
+
+
+class CommandGenerator(object):
+    """
+    Any external generator, e.g. AF_XDP based xdpsock. The command template can use
+    {dev}, {duration}, {dst_mac}, {dst_ip}, {src_ip} and {pkt_size}.
+    """
+
+    name = "command"
+    AF_XDP_TEMPLATE = "xdpsock -i {dev} -t -q 0 -s {pkt_size} -d {duration}"
+
+    def __init__(self, node, template, name=None, **params):
+        self.node = node
+        self.template = template
+        if name is not None:
+            self.name = name
+        self.params = params
+        self.process = None
+
+    def start(self, duration):
+        command = self.template.format(duration=duration, **self.params)
+        self.process = self.node.popen(shlex.split(command))
+
+    def wait(self):
+        if self.process is not None:
+            self.process.wait()
+            self.process = None
+
+
+def ping_latency(node, dst_ip, duration, interval=0.01):
+    """
+    Round-trip time in microseconds of ICMP echo sent during `duration` seconds.
+    """
+    count = max(1, int(duration / interval))
+    out = node.cmd("ping -n -i {} -c {} -W 1 {} 2>/dev/null".format(interval, count, dst_ip))
+    return [float(v) * 1000.0 for v in re.findall(r"time=([0-9.]+) ms", out)]
+
+
+def measure(generator, duration, rx_node, rx_dev, tx_node, tx_dev, latency_node=None, dst_ip=None):
+    """
+    Runs the generator for `duration` seconds and measures rates at the sink and softirq load.
+    """
+    softirq = SoftirqSampler()
+    tx_start = read_interface_counter(tx_node, tx_dev, "tx_packets")
+    rx_start = read_interface_counter(rx_node, rx_dev, "rx_packets")
+    softirq.begin()
+    start = time.time()
+
+    generator.start(duration)
+    latencies = []
+    if latency_node is not None and dst_ip is not None:
+        latencies = ping_latency(latency_node, dst_ip, max(1, duration - 1))
+    generator.wait()
+
+    elapsed = time.time() - start
+    load = softirq.end()
+    tx = read_interface_counter(tx_node, tx_dev, "tx_packets") - tx_start
+    rx = read_interface_counter(rx_node, rx_dev, "rx_packets") - rx_start
+
+    return {
+        "generator": generator.name,
+        "duration_sec": round(elapsed, 3),
+        "tx_packets": tx,
+        "rx_packets": rx,
+        "tx_mpps": round(tx / elapsed / 1e6, 4),
+        "rx_mpps": round(rx / elapsed / 1e6, 4),
+        "loss_ratio": round(1.0 - float(rx) / tx, 4) if tx > 0 else None,
+        "latency_us": {
+            "samples": len(latencies),
+            "p50": percentile(latencies, 50),
+            "p90": percentile(latencies, 90),
+            "p99": percentile(latencies, 99),
+            "max": max(latencies) if latencies else None,
+        },
+        "softirq_load_pct": load,
+    }
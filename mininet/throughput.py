@@ -0,0 +1,202 @@
+#!/usr/bin/env python3
+
+"""
+Data plane throughput benchmark. Forwards generated traffic through a NIKSS switch and measures
+Mpps, latency and per-CPU softirq load for every P4 program (e.g. TC, XDP and XDP with optimized egress
+builds of simple_switch.p4) and every number of table entries. Results are written as JSON.
+
+Two setups are supported:
+- Mininet (default): generator host h1 and sink host h2 connected to s1 with veth pairs.
+- Physical ports (--ports): programs are attached to local interfaces and traffic is sent from
+  --tx-dev and received on --rx-dev, these are usually cabled back to the ports under test.
+"""
+
+import argparse
+import json
+import os
+import socket
+import sys
+import tempfile
+
+from time import sleep
+
+from lib.nikss_perf import LocalNode, PktgenGenerator, CommandGenerator, measure, pipeline_mode
+
+TABLE = "ingress_tbl_fwd"
+PIPELINE_ID = 0
+
+GEN_MAC = "00:04:00:00:00:01"
+SINK_MAC = "00:04:00:00:00:02"
+GEN_IP = "10.0.0.1"
+SINK_IP = "10.0.0.2"
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--program", action="append", metavar="LABEL=PATH",
+                        help="compiled P4 program, can be repeated (default: simple_switch=simple_switch.o)")
+    parser.add_argument("--table-entries", default="0,1000,10000",
+                        help="comma separated numbers of additional entries in {} (default: %(default)s)".format(TABLE))
+    parser.add_argument("--duration", type=int, default=10, help="seconds of every run (default: %(default)s)")
+    parser.add_argument("--pkt-size", type=int, default=64, help="frame size in bytes (default: %(default)s)")
+    parser.add_argument("--generator", choices=["pktgen", "afxdp"], default="pktgen")
+    parser.add_argument("--generator-cmd", help="command template for the afxdp generator (default: \"{}\")"
+                        .format(CommandGenerator.AF_XDP_TEMPLATE))
+    parser.add_argument("--threads", type=int, default=1, help="pktgen threads, one per TX queue (default: %(default)s)")
+    parser.add_argument("--no-latency", action="store_true", help="do not run ping during the load")
+    parser.add_argument("--ports", metavar="IN,OUT", help="use physical ports instead of Mininet")
+    parser.add_argument("--tx-dev", help="interface of the generator (physical setup)")
+    parser.add_argument("--rx-dev", help="interface of the sink (physical setup)")
+    parser.add_argument("--dst-mac", default=SINK_MAC, help="destination MAC of generated frames (physical setup)")
+    parser.add_argument("--output", "-o", help="write results to the file instead of standard output")
+    args = parser.parse_args()
+
+    args.programs = []
+    for program in args.program or ["simple_switch=simple_switch.o"]:
+        label, sep, path = program.partition("=")
+        if not sep:
+            label, path = os.path.splitext(os.path.basename(program))[0], program
+        args.programs.append((label, path))
+    args.table_entries = [int(n) for n in args.table_entries.split(",")]
+    if args.ports is not None:
+        args.ports = args.ports.split(",")
+        if len(args.ports) != 2 or args.tx_dev is None or args.rx_dev is None:
+            parser.error("--ports requires IN,OUT with --tx-dev and --rx-dev")
+    return args
+
+
+def fill_table(switch, n_entries, out_port_entries):
+    """
+    Installs entries forwarding to the sink and n_entries which never match, using `nikss-ctl batch`.
+    """
+    with tempfile.NamedTemporaryFile("w", suffix=".txt", delete=False) as f:
+        for mac, port in out_port_entries:
+            f.write("table add pipe {} {} id 1 key {} data {}\n".format(switch.device_id, TABLE, mac, port))
+        for i in range(n_entries):
+            mac = "02:00:{:02x}:{:02x}:{:02x}:{:02x}".format((i >> 24) & 0xFF, (i >> 16) & 0xFF, (i >> 8) & 0xFF, i & 0xFF)
+            f.write("table add pipe {} {} id 1 key {} data 0\n".format(switch.device_id, TABLE, mac))
+        path = f.name
+    switch.cmd("nikss-ctl batch file {} > /dev/null".format(path))
+    os.unlink(path)
+
+
+def create_generator(args, node, dev, dst_mac):
+    if args.generator == "afxdp":
+        return CommandGenerator(node, args.generator_cmd or CommandGenerator.AF_XDP_TEMPLATE, name="afxdp",
+                                dev=dev, dst_mac=dst_mac, dst_ip=SINK_IP, src_ip=GEN_IP, pkt_size=args.pkt_size)
+    return PktgenGenerator(node, dev, dst_mac, SINK_IP, GEN_IP, pkt_size=args.pkt_size, threads=args.threads)
+
+
+class PhysicalSwitch(object):
+    """
+    The same interface as NIKSSSwitch from lib.nikss_mn for local interfaces.
+    """
+
+    device_id = PIPELINE_ID
+
+    def __init__(self, ports):
+        self.node = LocalNode()
+        self.ports = ports
+        self.bpf_path = None
+
+    def cmd(self, command):
+        return self.node.cmd(command)
+
+    def reload(self, bpf_path):
+        if self.bpf_path is not None:
+            self.unload_pipeline()
+        self.bpf_path = bpf_path
+        self.cmd("nikss-ctl pipeline load id {} {}".format(self.device_id, bpf_path))
+        self.cmd("nikss-ctl add-port pipe {} dev {}".format(self.device_id, " ".join(self.ports)))
+
+    def unload_pipeline(self):
+        for port in self.ports:
+            self.cmd("nikss-ctl del-port pipe {} dev {}".format(self.device_id, port))
+        self.cmd("nikss-ctl pipeline unload id {}".format(self.device_id))
+
+    def pipeline_info(self):
+        return json.loads(self.cmd("nikss-ctl pipeline show id {}".format(self.device_id)))["pipeline"]
+
+
+def run(args, switch, gen_node, gen_dev, sink_node, sink_dev, forward_entries, latency):
+    results = []
+    for label, path in args.programs:
+        for n_entries in args.table_entries:
+            switch.reload(path)
+            fill_table(switch, n_entries, forward_entries)
+            sleep(1)
+
+            info = switch.pipeline_info()
+            generator = create_generator(args, gen_node, gen_dev, args.dst_mac)
+            result = {
+                "program": label,
+                "path": path,
+                "mode": pipeline_mode(info, switch.device_id),
+                "has_egress_program": info.get("has_egress_program"),
+                "table_entries": n_entries,
+                "pkt_size": args.pkt_size,
+            }
+            result.update(measure(generator, args.duration, sink_node, sink_dev, gen_node, gen_dev,
+                                  latency_node=gen_node if latency else None, dst_ip=SINK_IP))
+            print("{program} ({mode}), {table_entries} entries: {rx_mpps} Mpps".format(**result), file=sys.stderr)
+            results.append(result)
+    return results
+
+
+def run_mininet(args):
+    from lib.nikss_mn import P4Host, NIKSSSwitch
+    from mininet.net import Mininet
+    from mininet.topo import Topo
+    from mininet.log import setLogLevel
+
+    class PerfTopo(Topo):
+
+        def __init__(self, **opts):
+            Topo.__init__(self, **opts)
+            switch = self.addSwitch('s1', bpf_path=args.programs[0][1], device_id=PIPELINE_ID)
+            for h in range(2):
+                host = self.addHost('h%d' % (h + 1), mac='00:04:00:00:00:%02x' % (h + 1),
+                                    ip='10.0.0.%d/24' % (h + 1))
+                self.addLink(host, switch, (h + 1), (h + 2))
+
+    setLogLevel('warning')
+    net = Mininet(topo=PerfTopo(), host=P4Host, switch=NIKSSSwitch, controller=None)
+    net.start()
+    try:
+        sleep(1)
+        h1, h2, s1 = net.get('h1'), net.get('h2'), net.get('s1')
+        h1.setARP(SINK_IP, SINK_MAC)
+        h2.setARP(GEN_IP, GEN_MAC)
+        forward_entries = [(SINK_MAC, socket.if_nametoindex("s1-eth3")),
+                           (GEN_MAC, socket.if_nametoindex("s1-eth2"))]
+        return run(args, s1, h1, "eth0", h2, "eth0", forward_entries, not args.no_latency)
+    finally:
+        net.stop()
+
+
+def run_physical(args):
+    switch = PhysicalSwitch(args.ports)
+    node = LocalNode()
+    forward_entries = [(args.dst_mac, socket.if_nametoindex(args.ports[1]))]
+    try:
+        # ping is not forwarded back in this setup, so latency is not measured
+        return run(args, switch, node, args.tx_dev, node, args.rx_dev, forward_entries, False)
+    finally:
+        if switch.bpf_path is not None:
+            switch.unload_pipeline()
+
+
+def main():
+    args = parse_args()
+    results = run_physical(args) if args.ports is not None else run_mininet(args)
+
+    report = json.dumps({"results": results}, indent=4)
+    if args.output is not None:
+        with open(args.output, "w") as f:
+            f.write(report + "\n")
+    else:
+        print(report)
+
+
+if __name__ == '__main__':
+    main()